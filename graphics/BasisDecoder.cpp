@@ -112,12 +112,18 @@ Reference<Map2D> BasisDecoder::decodeFromBuffer(const void* data, size_t size, g
 
 		const bool multi_frame = texture_type == basist::cBASISTexTypeVideoFrames; // Is this transcoded from an animated GIF?
 
-		CompressedImageRef image = new CompressedImage(image_0_info.m_orig_width, image_0_info.m_orig_height, format);
+		// Don't transcode the largest mip levels if we only need a lower resolution image.
+		const uint32 num_skipped_levels = (uint32)ImFormatDecoder::numMipLevelsToSkipForTargetDim(image_0_info.m_orig_width, image_0_info.m_orig_height, num_mip_levels, options.target_max_dim);
+		const uint32 num_loaded_levels = num_mip_levels - num_skipped_levels;
+		const uint32 loaded_W = myMax(1u, image_0_info.m_orig_width  >> num_skipped_levels);
+		const uint32 loaded_H = myMax(1u, image_0_info.m_orig_height >> num_skipped_levels);
+
+		CompressedImageRef image = new CompressedImage(loaded_W, loaded_H, format);
 		if(mem_allocator)
 			image->setAllocator(mem_allocator);
 		image->texture_data->num_frames = multi_frame ? num_images : 1;
-		image->texture_data->W = image_0_info.m_orig_width;
-		image->texture_data->H = image_0_info.m_orig_height;
+		image->texture_data->W = loaded_W;
+		image->texture_data->H = loaded_H;
 		image->texture_data->D = multi_frame ? 1 : num_images;
 		image->texture_data->num_array_images = (texture_type == basist::cBASISTexType2DArray) ? num_images : 0;
 
@@ -132,9 +138,9 @@ Reference<Map2D> BasisDecoder::decodeFromBuffer(const void* data, size_t size, g
 		const size_t bytes_per_block = bytesPerBlock(image->texture_data->format);
 
 		// Build level_offsets (byte offset of each MIP level in mipmap_data)
-		image->texture_data->level_offsets.resize(num_mip_levels);
+		image->texture_data->level_offsets.resize(num_loaded_levels);
 		size_t offset = 0;
-		for(uint32 lvl=0; lvl<num_mip_levels; ++lvl)
+		for(uint32 lvl=num_skipped_levels; lvl<num_mip_levels; ++lvl)
 		{
 			basist::basisu_image_level_info level_info;
 			transcoder.get_image_level_info(data, (uint32)size, level_info, /*image index=*/0, lvl);
@@ -146,8 +152,8 @@ Reference<Map2D> BasisDecoder::decodeFromBuffer(const void* data, size_t size, g
 			const size_t single_im_level_size_B = level_info.m_total_blocks * bytes_per_block; // For a single image
 			const size_t total_level_size_B = single_im_level_size_B * (multi_frame ? 1 : num_images);
 
-			image->texture_data->level_offsets[lvl].offset = offset;
-			image->texture_data->level_offsets[lvl].level_size = total_level_size_B;
+			image->texture_data->level_offsets[lvl - num_skipped_levels].offset = offset;
+			image->texture_data->level_offsets[lvl - num_skipped_levels].level_size = total_level_size_B;
 
 			offset += total_level_size_B;
 		}
@@ -199,21 +205,23 @@ Reference<Map2D> BasisDecoder::decodeFromBuffer(const void* data, size_t size, g
 		|       level_size[0]               |       level_size[1]     |
 		offset[0]                        offset[1]                offset[2]
 		*/
-		for(uint32 lvl=0; lvl<num_mip_levels; ++lvl)
+		for(uint32 lvl=num_skipped_levels; lvl<num_mip_levels; ++lvl)
 		{
+			const TextureData::LevelOffsetData& level_offset_data = image->texture_data->level_offsets[lvl - num_skipped_levels];
+
 			for(uint32 im = 0; im < num_images; ++im)
 			{
 				size_t image_level_size_B;
 				size_t dest_offset_B;
 				if(multi_frame)
 				{
-					image_level_size_B = image->texture_data->level_offsets[lvl].level_size;
-					dest_offset_B      = image->texture_data->level_offsets[lvl].offset + image->texture_data->frame_size_B * im;
+					image_level_size_B = level_offset_data.level_size;
+					dest_offset_B      = level_offset_data.offset + image->texture_data->frame_size_B * im;
 				}
 				else
 				{
-					image_level_size_B = image->texture_data->level_offsets[lvl].level_size / num_images;
-					dest_offset_B      = image->texture_data->level_offsets[lvl].offset + image_level_size_B * im;
+					image_level_size_B = level_offset_data.level_size / num_images;
+					dest_offset_B      = level_offset_data.offset + image_level_size_B * im;
 				}
 
 
@@ -417,6 +425,21 @@ void BasisDecoder::test()
 
 			testAssert(com_im->texture_data->format == OpenGLTextureFormat::Format_Compressed_DXT_SRGB_Uint8);
 		}
+		//----------------------------------- Test loading with the largest mip levels skipped -------------------------------------------
+		{
+			BasisDecoder::BasisDecoderOptions options;
+			options.target_max_dim = 256;
+			Reference<Map2D> im = BasisDecoder::decode(TestUtils::getTestReposDir() + "/testfiles/basis/italy_bolsena_flag_flowers_stairs_01.basis", /*allocator=*/nullptr, options);
+
+			testAssert(im->getMapWidth() == 187); // 750 / 4
+			testAssert(im->getMapHeight() == 288); // 1152 / 4
+			testAssert(im.isType<CompressedImage>());
+			CompressedImage* com_im = im.downcastToPtr<CompressedImage>();
+			testAssert(com_im->texture_data->level_offsets.size() == 9);
+			testAssert(com_im->texture_data->level_offsets[0].offset == 0);
+			testAssert(com_im->texture_data->level_offsets[0].level_size == TextureData::computeNum4PixelBlocksForLevel(187, 288, 0) * 8);
+			testAssert(com_im->texture_data->frame_size_B == com_im->texture_data->mipmap_data.size());
+		}
 		// Load and transcode to ETC
 		{
 			conPrint("----------------------");
@@ -25,8 +25,9 @@ public:
 
 	struct BasisDecoderOptions
 	{
-		BasisDecoderOptions() : ETC_support(false) {}
+		BasisDecoderOptions() : ETC_support(false), target_max_dim(0) {}
 		bool ETC_support;
+		size_t target_max_dim; // If non-zero, the largest mip levels are not transcoded, as long as the largest remaining level has max(width, height) >= target_max_dim.
 	};
 
 	// throws ImFormatExcep on failure
@@ -14,6 +14,7 @@ Copyright Glare Technologies Limited 2019 -
 #include "../utils/StringUtils.h"
 #include "../utils/ConPrint.h"
 #include "../utils/ArrayRef.h"
+#include "../maths/Vec4f.h"
 #define STB_DXT_STATIC 1
 #define STB_DXT_IMPLEMENTATION 1
 #ifdef _WIN32
@@ -25,101 +26,950 @@ Copyright Glare Technologies Limited 2019 -
 #pragma warning(pop)
 #endif
 #include <vector>
+#include <limits>
+#include <cmath>
+#include <cstring>
 
 
 namespace DXTCompression
 {
 
 
-class DXTCompressTask : public glare::Task
+size_t bytesPerBlock(BlockFormat format)
 {
-public:
-	virtual void run(size_t /*thread_index*/)
+	return (format == BlockFormat_BC1 || format == BlockFormat_BC4) ? 8 : 16;
+}
+
+
+size_t getCompressedSizeBytes(size_t W, size_t H, size_t bytes_pp)
+{
+	assert(bytes_pp == 3 || bytes_pp == 4);
+
+	return getCompressedSizeBytes(W, H, (bytes_pp == 3) ? BlockFormat_BC1 : BlockFormat_BC3);
+}
+
+
+size_t getCompressedSizeBytes(size_t W, size_t H, BlockFormat format)
+{
+	const size_t num_blocks_x = Maths::roundedUpDivide(W, (size_t)4);
+	const size_t num_blocks_y = Maths::roundedUpDivide(H, (size_t)4);
+	const size_t num_blocks = num_blocks_x * num_blocks_y;
+
+	return num_blocks * bytesPerBlock(format);
+}
+
+
+//==================================== SIMD helpers ====================================
+
+
+// Returns mask ? a : b for each element.  Uses SSE 2 only, unlike select().
+static GLARE_STRONG_INLINE const Vec4f selectSSE2(const Vec4f& a, const Vec4f& b, const Vec4f& mask)
+{
+	return Vec4f(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+}
+
+// Rounds each element to the nearest integer.  Elements must be in int32 range.
+static GLARE_STRONG_INLINE const Vec4f roundToInt(const Vec4f& v)
+{
+	return Vec4f(_mm_cvtepi32_ps(_mm_cvtps_epi32(v.v)));
+}
+
+// Rounds each element towards zero.  Elements must be in int32 range.
+static GLARE_STRONG_INLINE const Vec4f truncToInt(const Vec4f& v)
+{
+	return Vec4f(_mm_cvtepi32_ps(_mm_cvttps_epi32(v.v)));
+}
+
+static GLARE_STRONG_INLINE const Vec4f maskedValue(const Vec4f& mask, float x)
+{
+	return Vec4f(_mm_and_ps(mask.v, _mm_set1_ps(x)));
+}
+
+
+// The pixels of 4 blocks, as floats, with one block per SIMD lane.
+struct FourBlocks
+{
+	Vec4f c[4][16]; // c[channel][pixel]
+};
+
+
+static void loadFourBlocks(const uint8* const blocks[4], FourBlocks& out)
+{
+	const __m128i byte_mask = _mm_set1_epi32(0xFF);
+	for(int p=0; p<16; ++p)
 	{
-		const size_t W = src_W;
-		const size_t H = src_H;
-		const size_t bytes_pp = src_bytes_pp;
-		const size_t num_blocks_x = Maths::roundedUpDivide(W, (size_t)4);
-		const uint8* const src_data = src_image_data;
-		uint8* const compressed_data = compressed;
-		if(bytes_pp == 4)
-		{
-			size_t write_i = num_blocks_x * (begin_y / 4) * 16; // as DXT5 (with alpha) is 16 bytes / block
+		uint32 pixels[4];
+		for(int l=0; l<4; ++l)
+			std::memcpy(&pixels[l], blocks[l] + p * 4, 4);
+
+		const __m128i v = _mm_setr_epi32((int)pixels[0], (int)pixels[1], (int)pixels[2], (int)pixels[3]);
+		out.c[0][p] = Vec4f(_mm_cvtepi32_ps(_mm_and_si128(v, byte_mask)));
+		out.c[1][p] = Vec4f(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8), byte_mask)));
+		out.c[2][p] = Vec4f(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), byte_mask)));
+		out.c[3][p] = Vec4f(_mm_cvtepi32_ps(_mm_srli_epi32(v, 24)));
+	}
+}
+
+
+//==================================== BC1 ====================================
+
+
+// Quantises endpoint colours to 5:6:5 bits.  Returns the quantised values in q_out, and the values expanded back to 8 bits in expanded_out.
+static void quantiseRGB565(const Vec4f col[3], Vec4f q_out[3], Vec4f expanded_out[3])
+{
+	const float max_vals[3] = { 31.f, 63.f, 31.f };
+	for(int c=0; c<3; ++c)
+	{
+		const float max_val = max_vals[c];
+		q_out[c] = roundToInt(clamp(col[c], Vec4f(0.f), Vec4f(255.f)) * (max_val / 255.f));
+
+		// Expand by bit replication, e.g. for 5 bits: (q << 3) | (q >> 2)
+		if(c == 1)
+			expanded_out[c] = q_out[c] * 4.f + truncToInt(q_out[c] * (1.f / 16));
+		else
+			expanded_out[c] = q_out[c] * 8.f + truncToInt(q_out[c] * (1.f / 4));
+	}
+}
 
-			// Copy to rgba block
-			uint8 rgba_block[4*4*4];
 
-			for(size_t by=begin_y; by<end_y; by += 4) // by = y coordinate of block
-				for(size_t bx=0; bx<W; bx += 4)
+// For each 8-bit value, the pair of 5 or 6-bit endpoint values for which the palette entry 2/3 e0 + 1/3 e1 is closest to the value.
+// Used to encode blocks of a single colour, which are common in textures.  The nearest 5:6:5 colour can be off by up to 4.
+struct BC1SingleColourTables
+{
+	BC1SingleColourTables()
+	{
+		buildTable(/*num_bits=*/5, match5);
+		buildTable(/*num_bits=*/6, match6);
+	}
+
+	static void buildTable(int num_bits, uint8 table_out[256][2])
+	{
+		const int max_q = (1 << num_bits) - 1;
+		for(int v=0; v<256; ++v)
+		{
+			float best_err = std::numeric_limits<float>::infinity();
+			int best_spread = 0;
+			for(int a=0; a<=max_q; ++a)
+				for(int b=0; b<=max_q; ++b)
 				{
-					int z = 0;
-					for(size_t y=by; y<by+4; ++y)
-						for(size_t x=bx; x<bx+4; ++x) // For each pixel in block:
-						{
-							const size_t use_x = myMin(x, W-1); // Clamp to image width/height in order to pad edges with edge pixel data.
-							const size_t use_y = myMin(y, H-1);
-							assert(use_x < W && use_y < H);
-							const uint8* const pixel = src_data + (use_x + W * use_y) * 4;
-
-							// Use 32 bit reads/writes here.
-							assert((uint64)pixel % 4 == 0); // Check 4-byte aligned
-							assert((uint64)rgba_block % 4 == 0); // Check 4-byte aligned
-							*((uint32*)(&rgba_block[z])) = *((uint32*)pixel);
-							//rgba_block[z + 0] = pixel[0];
-							//rgba_block[z + 1] = pixel[1];
-							//rgba_block[z + 2] = pixel[2];
-							//rgba_block[z + 3] = pixel[3];
-
-							z += 4;
-						}
-
-					stb_compress_dxt_block(&(compressed_data[write_i]), rgba_block, /*alpha=*/1, /*mode=*/STB_DXT_HIGHQUAL);
-					write_i += 16;
+					const int expanded_a = (a << (8 - num_bits)) | (a >> (2 * num_bits - 8));
+					const int expanded_b = (b << (8 - num_bits)) | (b >> (2 * num_bits - 8));
+					const float err = std::fabs((2 * expanded_a + expanded_b) * (1.f / 3) - v);
+					const int spread = std::abs(expanded_a - expanded_b); // Prefer endpoints close together, so decoder rounding differences matter less.
+					if(err < best_err || (err == best_err && spread < best_spread))
+					{
+						best_err = err;
+						best_spread = spread;
+						table_out[v][0] = (uint8)a;
+						table_out[v][1] = (uint8)b;
+					}
 				}
 		}
-		else if(bytes_pp == 3)
+	}
+
+	uint8 match5[256][2];
+	uint8 match6[256][2];
+};
+
+
+static const BC1SingleColourTables& getBC1SingleColourTables()
+{
+	static BC1SingleColourTables tables;
+	return tables;
+}
+
+
+// Assigns each pixel the nearest colour of the 4-colour palette defined by endpoints e0 and e1.
+// Returns the total squared error for each block.
+static const Vec4f computeBC1Indices(const FourBlocks& blocks, const Vec4f e0[3], const Vec4f e1[3], Vec4f indices_out[16])
+{
+	Vec4f palette[4][3];
+	for(int c=0; c<3; ++c)
+	{
+		palette[0][c] = e0[c];
+		palette[1][c] = e1[c];
+		palette[2][c] = (e0[c] * 2.f + e1[c]) * (1.f / 3);
+		palette[3][c] = (e0[c] + e1[c] * 2.f) * (1.f / 3);
+	}
+
+	Vec4f total_err(0.f);
+	for(int p=0; p<16; ++p)
+	{
+		Vec4f best_err(std::numeric_limits<float>::infinity());
+		Vec4f best_i(0.f);
+		for(int i=0; i<4; ++i)
 		{
-			size_t write_i = num_blocks_x * (begin_y / 4) * 8; // as DXT1 (no alpha) is 8 bytes / block
+			const Vec4f dr = blocks.c[0][p] - palette[i][0];
+			const Vec4f dg = blocks.c[1][p] - palette[i][1];
+			const Vec4f db = blocks.c[2][p] - palette[i][2];
+			const Vec4f err = dr*dr + dg*dg + db*db;
+			const Vec4f closer = parallelLessThan(err, best_err);
+			best_err = selectSSE2(err, best_err, closer);
+			best_i = selectSSE2(Vec4f((float)i), best_i, closer);
+		}
+		indices_out[p] = best_i;
+		total_err += best_err;
+	}
+	return total_err;
+}
 
-			// Copy to rgba block
-			uint8 rgba_block[4*4*4];
 
-			for(size_t by=begin_y; by<end_y; by += 4) // by = y coordinate of block
-				for(size_t bx=0; bx<W; bx += 4)
-				{
-					int z = 0;
-					for(size_t y=by; y<by+4; ++y)
-						for(size_t x=bx; x<bx+4; ++x) // For each pixel in block:
-						{
-							const size_t use_x = myMin(x, W-1); // Clamp to image width/height in order to pad edges with edge pixel data.
-							const size_t use_y = myMin(y, H-1);
-							assert(use_x < W && use_y < H);
-							const uint8* const pixel = src_data + (use_x + W * use_y) * 3;
-							rgba_block[z + 0] = pixel[0];
-							rgba_block[z + 1] = pixel[1];
-							rgba_block[z + 2] = pixel[2];
-							rgba_block[z + 3] = 0;
-							
-							z += 4;
-						}
-
-					// Write out block
-					/*conPrint("block:");
-					for(size_t y=0; y<4; ++y)
-					{
-						for(size_t x=0; x<4; ++x)
-						{
-							conPrintStr("(" + toString(rgba_block[y*16 + x*4 + 0]) + "," + toString(rgba_block[y*16 + x*4 + 1]) + "," + toString(rgba_block[y*16 + x*4 + 2]) + ") ");
-						}
-						conPrint("");
-					}*/
-					
-					stb_compress_dxt_block(&(compressed_data[write_i]), rgba_block, /*alpha=*/0, /*mode=*/STB_DXT_HIGHQUAL);
-					write_i += 8;
-				}
+// Encodes the RGB channels of 4 blocks.  Writes 8 bytes for each block to out[l] + out_offset.
+static void encodeBC1FourBlocks(const FourBlocks& blocks, Quality quality, uint8* const out[4], size_t out_offset)
+{
+	// Compute mean colour and covariance matrix
+	Vec4f mean[3];
+	for(int c=0; c<3; ++c)
+	{
+		Vec4f sum(0.f);
+		for(int p=0; p<16; ++p)
+			sum += blocks.c[c][p];
+		mean[c] = sum * (1.f / 16);
+	}
+
+	Vec4f cov_xx(0.f), cov_xy(0.f), cov_xz(0.f), cov_yy(0.f), cov_yz(0.f), cov_zz(0.f);
+	Vec4f axis[3] = { Vec4f(0.f), Vec4f(0.f), Vec4f(0.f) };
+	Vec4f max_dist2(-1.f);
+	for(int p=0; p<16; ++p)
+	{
+		const Vec4f dx = blocks.c[0][p] - mean[0];
+		const Vec4f dy = blocks.c[1][p] - mean[1];
+		const Vec4f dz = blocks.c[2][p] - mean[2];
+		cov_xx += dx*dx;
+		cov_xy += dx*dy;
+		cov_xz += dx*dz;
+		cov_yy += dy*dy;
+		cov_yz += dy*dz;
+		cov_zz += dz*dz;
+
+		// Start the principal axis iteration with the direction to the pixel furthest from the mean.
+		const Vec4f dist2 = dx*dx + dy*dy + dz*dz;
+		const Vec4f further = parallelLessThan(max_dist2, dist2);
+		max_dist2 = selectSSE2(dist2, max_dist2, further);
+		axis[0] = selectSSE2(dx, axis[0], further);
+		axis[1] = selectSSE2(dy, axis[1], further);
+		axis[2] = selectSSE2(dz, axis[2], further);
+	}
+
+	// Refine the axis with power iteration.
+	const int num_iters = (quality == Quality_Fast) ? 1 : 4;
+	for(int i=0; i<num_iters; ++i)
+	{
+		const Vec4f nx = cov_xx * axis[0] + cov_xy * axis[1] + cov_xz * axis[2];
+		const Vec4f ny = cov_xy * axis[0] + cov_yy * axis[1] + cov_yz * axis[2];
+		const Vec4f nz = cov_xz * axis[0] + cov_yz * axis[1] + cov_zz * axis[2];
+		const Vec4f len2 = nx*nx + ny*ny + nz*nz;
+		const Vec4f nonzero = parallelLessThan(Vec4f(1.0e-10f), len2);
+		const Vec4f scale = div(Vec4f(1.f), sqrt(max(len2, Vec4f(1.0e-10f))));
+		axis[0] = selectSSE2(nx * scale, axis[0], nonzero);
+		axis[1] = selectSSE2(ny * scale, axis[1], nonzero);
+		axis[2] = selectSSE2(nz * scale, axis[2], nonzero);
+	}
+	{
+		const Vec4f len2 = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+		const Vec4f recip_len = selectSSE2(div(Vec4f(1.f), sqrt(max(len2, Vec4f(1.0e-10f)))), Vec4f(0.f), parallelLessThan(Vec4f(1.0e-10f), len2));
+		for(int c=0; c<3; ++c)
+			axis[c] = axis[c] * recip_len;
+	}
+
+	// Project pixels onto the axis to get the endpoints
+	Vec4f t_min(std::numeric_limits<float>::infinity());
+	Vec4f t_max(-std::numeric_limits<float>::infinity());
+	for(int p=0; p<16; ++p)
+	{
+		const Vec4f t = (blocks.c[0][p] - mean[0]) * axis[0] + (blocks.c[1][p] - mean[1]) * axis[1] + (blocks.c[2][p] - mean[2]) * axis[2];
+		t_min = min(t_min, t);
+		t_max = max(t_max, t);
+	}
+
+	// Inset the endpoints slightly, as the extreme pixels are rarely best represented exactly.
+	const Vec4f inset = (t_max - t_min) * (1.f / 16);
+	t_min += inset;
+	t_max -= inset;
+
+	Vec4f e0[3], e1[3];
+	for(int c=0; c<3; ++c)
+	{
+		e0[c] = mean[c] + axis[c] * t_max;
+		e1[c] = mean[c] + axis[c] * t_min;
+	}
+
+	Vec4f q0[3], q1[3], e0_expanded[3], e1_expanded[3];
+	quantiseRGB565(e0, q0, e0_expanded);
+	quantiseRGB565(e1, q1, e1_expanded);
+
+	Vec4f indices[16];
+	Vec4f err = computeBC1Indices(blocks, e0_expanded, e1_expanded, indices);
+
+	if(quality != Quality_Fast)
+	{
+		// Least-squares refit of the endpoints given the indices.  Pixel colour is modelled as w * e0 + (1 - w) * e1.
+		Vec4f sum_ww(0.f), sum_vv(0.f), sum_wv(0.f);
+		Vec4f sum_wc[3] = { Vec4f(0.f), Vec4f(0.f), Vec4f(0.f) };
+		Vec4f sum_vc[3] = { Vec4f(0.f), Vec4f(0.f), Vec4f(0.f) };
+		for(int p=0; p<16; ++p)
+		{
+			const Vec4f w = maskedValue(parallelEq(indices[p], Vec4f(0.f)), 1.f) + maskedValue(parallelEq(indices[p], Vec4f(2.f)), 2.f / 3) + maskedValue(parallelEq(indices[p], Vec4f(3.f)), 1.f / 3);
+			const Vec4f v = Vec4f(1.f) - w;
+			sum_ww += w*w;
+			sum_vv += v*v;
+			sum_wv += w*v;
+			for(int c=0; c<3; ++c)
+			{
+				sum_wc[c] += w * blocks.c[c][p];
+				sum_vc[c] += v * blocks.c[c][p];
+			}
+		}
+
+		const Vec4f det = sum_ww * sum_vv - sum_wv * sum_wv;
+		const Vec4f valid = parallelLessThan(Vec4f(1.0e-3f), det);
+		const Vec4f recip_det = div(Vec4f(1.f), max(det, Vec4f(1.0e-3f)));
+
+		Vec4f refit_e0[3], refit_e1[3];
+		for(int c=0; c<3; ++c)
+		{
+			refit_e0[c] = selectSSE2((sum_vv * sum_wc[c] - sum_wv * sum_vc[c]) * recip_det, e0[c], valid);
+			refit_e1[c] = selectSSE2((sum_ww * sum_vc[c] - sum_wv * sum_wc[c]) * recip_det, e1[c], valid);
+		}
+
+		Vec4f refit_q0[3], refit_q1[3], refit_e0_expanded[3], refit_e1_expanded[3];
+		quantiseRGB565(refit_e0, refit_q0, refit_e0_expanded);
+		quantiseRGB565(refit_e1, refit_q1, refit_e1_expanded);
+
+		Vec4f refit_indices[16];
+		const Vec4f refit_err = computeBC1Indices(blocks, refit_e0_expanded, refit_e1_expanded, refit_indices);
+
+		const Vec4f better = parallelLessThan(refit_err, err);
+		for(int c=0; c<3; ++c)
+		{
+			q0[c] = selectSSE2(refit_q0[c], q0[c], better);
+			q1[c] = selectSSE2(refit_q1[c], q1[c], better);
+		}
+		for(int p=0; p<16; ++p)
+			indices[p] = selectSSE2(refit_indices[p], indices[p], better);
+	}
+
+	// Write out the blocks
+	GLARE_ALIGN(16) float q0_f[3][4];
+	GLARE_ALIGN(16) float q1_f[3][4];
+	GLARE_ALIGN(16) float indices_f[16][4];
+	GLARE_ALIGN(16) float mean_f[3][4];
+	GLARE_ALIGN(16) float max_dist2_f[4];
+	for(int c=0; c<3; ++c)
+	{
+		storeVec4f(q0[c], q0_f[c]);
+		storeVec4f(q1[c], q1_f[c]);
+		storeVec4f(mean[c], mean_f[c]);
+	}
+	storeVec4f(max_dist2, max_dist2_f);
+	for(int p=0; p<16; ++p)
+		storeVec4f(indices[p], indices_f[p]);
+
+	for(int l=0; l<4; ++l)
+	{
+		uint32 c0 = ((uint32)q0_f[0][l] << 11) | ((uint32)q0_f[1][l] << 5) | (uint32)q0_f[2][l];
+		uint32 c1 = ((uint32)q1_f[0][l] << 11) | ((uint32)q1_f[1][l] << 5) | (uint32)q1_f[2][l];
+		uint32 index_bits = 0;
+		for(int p=0; p<16; ++p)
+			index_bits |= (uint32)indices_f[p][l] << (2 * p);
+
+		if(max_dist2_f[l] == 0) // If all pixels in the block have the same colour:
+		{
+			const BC1SingleColourTables& tables = getBC1SingleColourTables();
+			const int r = (int)mean_f[0][l];
+			const int g = (int)mean_f[1][l];
+			const int b = (int)mean_f[2][l];
+			c0 = ((uint32)tables.match5[r][0] << 11) | ((uint32)tables.match6[g][0] << 5) | (uint32)tables.match5[b][0];
+			c1 = ((uint32)tables.match5[r][1] << 11) | ((uint32)tables.match6[g][1] << 5) | (uint32)tables.match5[b][1];
+			index_bits = 0xAAAAAAAA; // All pixels use index 2: 2/3 c0 + 1/3 c1.
+		}
+
+		// c0 > c1 selects the 4-colour mode, so swap the endpoints if needed.
+		if(c0 < c1)
+		{
+			mySwap(c0, c1);
+			index_bits ^= 0x55555555; // Swap indices 0 <-> 1, 2 <-> 3.
+		}
+		else if(c0 == c1)
+			index_bits = 0; // All palette colours are the same apart from index 3, which is black in 3-colour mode.
+
+		uint8* const block = out[l] + out_offset;
+		block[0] = (uint8)(c0 & 0xFF);
+		block[1] = (uint8)(c0 >> 8);
+		block[2] = (uint8)(c1 & 0xFF);
+		block[3] = (uint8)(c1 >> 8);
+		std::memcpy(block + 4, &index_bits, 4);
+	}
+}
+
+
+//==================================== BC4 ====================================
+
+
+// Computes indices for the 8-value mode, with endpoints r0 >= r1.
+// Returns the total squared error.  codes_out gets the BC4 index codes, and weights_out gets the fraction of r0 for each pixel.
+static const Vec4f computeBC4Mode8Indices(const Vec4f v[16], const Vec4f& r0, const Vec4f& r1, Vec4f codes_out[16], Vec4f weights_out[16])
+{
+	const Vec4f range = r0 - r1;
+	const Vec4f scale = selectSSE2(div(Vec4f(7.f), max(range, Vec4f(1.f))), Vec4f(0.f), parallelLessThan(Vec4f(0.f), range));
+
+	Vec4f total_err(0.f);
+	for(int p=0; p<16; ++p)
+	{
+		// Interpolation step k: 0 = r0, 7 = r1.
+		const Vec4f k = roundToInt(clamp((r0 - v[p]) * scale, Vec4f(0.f), Vec4f(7.f)));
+		const Vec4f decoded = r0 - range * k * (1.f / 7);
+		const Vec4f err = v[p] - decoded;
+		total_err += err * err;
+
+		// Code 0 is r0, code 1 is r1, codes 2-7 are the interpolated values.
+		Vec4f code = k + Vec4f(1.f);
+		code = selectSSE2(Vec4f(0.f), code, parallelEq(k, Vec4f(0.f)));
+		code = selectSSE2(Vec4f(1.f), code, parallelEq(k, Vec4f(7.f)));
+		codes_out[p] = code;
+		weights_out[p] = Vec4f(1.f) - k * (1.f / 7);
+	}
+	return total_err;
+}
+
+
+// Computes indices for the 6-value mode, with endpoints r0 <= r1, where codes 6 and 7 are 0 and 255.
+static const Vec4f computeBC4Mode6Indices(const Vec4f v[16], const Vec4f& r0, const Vec4f& r1, Vec4f codes_out[16])
+{
+	const Vec4f range = r1 - r0;
+	const Vec4f scale = selectSSE2(div(Vec4f(5.f), max(range, Vec4f(1.f))), Vec4f(0.f), parallelLessThan(Vec4f(0.f), range));
+
+	Vec4f total_err(0.f);
+	for(int p=0; p<16; ++p)
+	{
+		// Interpolation step k: 0 = r0, 5 = r1.
+		const Vec4f k = roundToInt(clamp((v[p] - r0) * scale, Vec4f(0.f), Vec4f(5.f)));
+		const Vec4f decoded = r0 + range * k * (1.f / 5);
+		const Vec4f d = v[p] - decoded;
+		Vec4f err = d * d;
+
+		Vec4f code = k + Vec4f(1.f);
+		code = selectSSE2(Vec4f(0.f), code, parallelEq(k, Vec4f(0.f)));
+		code = selectSSE2(Vec4f(1.f), code, parallelEq(k, Vec4f(5.f)));
+
+		const Vec4f err_0 = v[p] * v[p];
+		const Vec4f use_0 = parallelLessThan(err_0, err);
+		err = selectSSE2(err_0, err, use_0);
+		code = selectSSE2(Vec4f(6.f), code, use_0);
+
+		const Vec4f err_255 = (Vec4f(255.f) - v[p]) * (Vec4f(255.f) - v[p]);
+		const Vec4f use_255 = parallelLessThan(err_255, err);
+		err = selectSSE2(err_255, err, use_255);
+		code = selectSSE2(Vec4f(7.f), code, use_255);
+
+		codes_out[p] = code;
+		total_err += err;
+	}
+	return total_err;
+}
+
+
+// Encodes a single channel of 4 blocks.  Writes 8 bytes for each block to out[l] + out_offset.
+static void encodeBC4FourBlocks(const Vec4f v[16], Quality quality, uint8* const out[4], size_t out_offset)
+{
+	Vec4f v_min(255.f), v_max(0.f);
+	Vec4f inner_min(255.f), inner_max(0.f); // Min and max of values excluding 0 and 255.
+	for(int p=0; p<16; ++p)
+	{
+		v_min = min(v_min, v[p]);
+		v_max = max(v_max, v[p]);
+		const Vec4f inner = parallelAnd(parallelLessThan(Vec4f(0.f), v[p]), parallelLessThan(v[p], Vec4f(255.f)));
+		inner_min = min(inner_min, selectSSE2(v[p], Vec4f(255.f), inner));
+		inner_max = max(inner_max, selectSSE2(v[p], Vec4f(0.f), inner));
+	}
+
+	// 8-value mode with the value range as endpoints
+	Vec4f r0 = v_max;
+	Vec4f r1 = v_min;
+	Vec4f codes[16], weights[16];
+	Vec4f err = computeBC4Mode8Indices(v, r0, r1, codes, weights);
+
+	if(quality == Quality_High)
+	{
+		// Least-squares refit of the endpoints given the interpolation weights.
+		Vec4f sum_ww(0.f), sum_uu(0.f), sum_wu(0.f), sum_wv(0.f), sum_uv(0.f);
+		for(int p=0; p<16; ++p)
+		{
+			const Vec4f u = Vec4f(1.f) - weights[p];
+			sum_ww += weights[p] * weights[p];
+			sum_uu += u * u;
+			sum_wu += weights[p] * u;
+			sum_wv += weights[p] * v[p];
+			sum_uv += u * v[p];
 		}
+		const Vec4f det = sum_ww * sum_uu - sum_wu * sum_wu;
+		const Vec4f valid = parallelLessThan(Vec4f(1.0e-3f), det);
+		const Vec4f recip_det = div(Vec4f(1.f), max(det, Vec4f(1.0e-3f)));
+		const Vec4f a = roundToInt(clamp((sum_uu * sum_wv - sum_wu * sum_uv) * recip_det, Vec4f(0.f), Vec4f(255.f)));
+		const Vec4f b = roundToInt(clamp((sum_ww * sum_uv - sum_wu * sum_wv) * recip_det, Vec4f(0.f), Vec4f(255.f)));
+		const Vec4f refit_r0 = selectSSE2(max(a, b), r0, valid);
+		const Vec4f refit_r1 = selectSSE2(min(a, b), r1, valid);
+
+		Vec4f refit_codes[16], refit_weights[16];
+		const Vec4f refit_err = computeBC4Mode8Indices(v, refit_r0, refit_r1, refit_codes, refit_weights);
+		const Vec4f better = parallelLessThan(refit_err, err);
+		r0 = selectSSE2(refit_r0, r0, better);
+		r1 = selectSSE2(refit_r1, r1, better);
+		err = selectSSE2(refit_err, err, better);
+		for(int p=0; p<16; ++p)
+			codes[p] = selectSSE2(refit_codes[p], codes[p], better);
+	}
+
+	if(quality != Quality_Fast)
+	{
+		// 6-value mode, which has exact 0 and 255 values, with the range of the other values as endpoints.
+		const Vec4f has_inner = parallelLessThan(inner_min, inner_max + Vec4f(0.5f));
+		const Vec4f m6_r0 = selectSSE2(inner_min, Vec4f(0.f), has_inner);
+		const Vec4f m6_r1 = selectSSE2(inner_max, Vec4f(0.f), has_inner);
+
+		Vec4f m6_codes[16];
+		const Vec4f m6_err = computeBC4Mode6Indices(v, m6_r0, m6_r1, m6_codes);
+		const Vec4f better = parallelLessThan(m6_err, err);
+		r0 = selectSSE2(m6_r0, r0, better);
+		r1 = selectSSE2(m6_r1, r1, better);
+		for(int p=0; p<16; ++p)
+			codes[p] = selectSSE2(m6_codes[p], codes[p], better);
+	}
+
+	// Write out the blocks
+	GLARE_ALIGN(16) float r0_f[4];
+	GLARE_ALIGN(16) float r1_f[4];
+	GLARE_ALIGN(16) float codes_f[16][4];
+	storeVec4f(r0, r0_f);
+	storeVec4f(r1, r1_f);
+	for(int p=0; p<16; ++p)
+		storeVec4f(codes[p], codes_f[p]);
+
+	for(int l=0; l<4; ++l)
+	{
+		uint64 index_bits = 0;
+		for(int p=0; p<16; ++p)
+			index_bits |= (uint64)codes_f[p][l] << (3 * p);
+
+		uint8* const block = out[l] + out_offset;
+		block[0] = (uint8)r0_f[l];
+		block[1] = (uint8)r1_f[l];
+		for(int i=0; i<6; ++i)
+			block[2 + i] = (uint8)(index_bits >> (8 * i));
 	}
-	size_t begin_y, end_y;
+}
+
+
+//==================================== BC7 ====================================
+
+
+static const int bc7_weights_4bit[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+
+// Mode 6 endpoints: 7 bits per channel, plus a p-bit per endpoint which is the lowest bit of the 8-bit value.
+struct BC7Mode6Endpoints
+{
+	int e[2][4];
+	int p[2];
+};
+
+
+static inline const Vec4f expandBC7Mode6Endpoint(const BC7Mode6Endpoints& endpoints, int i)
+{
+	return Vec4f((float)(endpoints.e[i][0] * 2 + endpoints.p[i]), (float)(endpoints.e[i][1] * 2 + endpoints.p[i]), (float)(endpoints.e[i][2] * 2 + endpoints.p[i]), (float)(endpoints.e[i][3] * 2 + endpoints.p[i]));
+}
+
+
+// Quantises endpoint colour col with p-bit p, returns squared quantisation error.
+static inline float quantiseBC7Mode6Endpoint(const Vec4f& col, int p, int e_out[4])
+{
+	float err = 0;
+	for(int c=0; c<4; ++c)
+	{
+		const int q = myClamp((int)((col[c] - p) * 0.5f + 0.5f), 0, 127);
+		const float d = col[c] - (float)(q * 2 + p);
+		err += d * d;
+		e_out[c] = q;
+	}
+	return err;
+}
+
+
+// Quantises endpoint col, choosing the p-bit with the lowest error.
+static inline void quantiseBC7Mode6EndpointBestP(const Vec4f& col, BC7Mode6Endpoints& endpoints, int i)
+{
+	int e_p1[4];
+	const float err_p0 = quantiseBC7Mode6Endpoint(col, 0, endpoints.e[i]);
+	const float err_p1 = quantiseBC7Mode6Endpoint(col, 1, e_p1);
+	endpoints.p[i] = 0;
+	if(err_p1 < err_p0)
+	{
+		for(int c=0; c<4; ++c)
+			endpoints.e[i][c] = e_p1[c];
+		endpoints.p[i] = 1;
+	}
+}
+
+
+// Assigns each pixel the nearest of the 16 palette colours.  Returns the total squared error.
+static float computeBC7Mode6Indices(const Vec4f pixels[16], const BC7Mode6Endpoints& endpoints, int indices_out[16])
+{
+	// Compute the palette, with channels in separate vectors, 4 palette entries per vector.
+	const Vec4f e0 = expandBC7Mode6Endpoint(endpoints, 0);
+	const Vec4f e1 = expandBC7Mode6Endpoint(endpoints, 1);
+	GLARE_ALIGN(16) float palette[4][16]; // palette[channel][entry]
+	for(int i=0; i<16; ++i)
+	{
+		const int w = bc7_weights_4bit[i];
+		for(int c=0; c<4; ++c)
+			palette[c][i] = (float)(((64 - w) * (int)e0[c] + w * (int)e1[c] + 32) >> 6);
+	}
+
+	float total_err = 0;
+	for(int p=0; p<16; ++p)
+	{
+		const Vec4f r = copyToAll<0>(pixels[p]);
+		const Vec4f g = copyToAll<1>(pixels[p]);
+		const Vec4f b = copyToAll<2>(pixels[p]);
+		const Vec4f a = copyToAll<3>(pixels[p]);
+
+		Vec4f best_err(std::numeric_limits<float>::infinity());
+		Vec4f best_i(0.f);
+		for(int z=0; z<4; ++z)
+		{
+			const Vec4f dr = r - loadVec4f(&palette[0][z * 4]);
+			const Vec4f dg = g - loadVec4f(&palette[1][z * 4]);
+			const Vec4f db = b - loadVec4f(&palette[2][z * 4]);
+			const Vec4f da = a - loadVec4f(&palette[3][z * 4]);
+			const Vec4f err = dr*dr + dg*dg + db*db + da*da;
+			const Vec4f closer = parallelLessThan(err, best_err);
+			best_err = selectSSE2(err, best_err, closer);
+			best_i = selectSSE2(Vec4f((float)(z * 4), (float)(z * 4 + 1), (float)(z * 4 + 2), (float)(z * 4 + 3)), best_i, closer);
+		}
+
+		int best_lane = 0;
+		for(int l=1; l<4; ++l)
+			if(best_err[l] < best_err[best_lane])
+				best_lane = l;
+		indices_out[p] = (int)best_i[best_lane];
+		total_err += best_err[best_lane];
+	}
+	return total_err;
+}
+
+
+// Encodes a block using mode 6.
+static void encodeBC7Block(const uint8* rgba_block, Quality quality, uint8* block_out)
+{
+	Vec4f pixels[16];
+	Vec4f sum(0.f);
+	for(int p=0; p<16; ++p)
+	{
+		pixels[p] = Vec4f((float)rgba_block[p*4 + 0], (float)rgba_block[p*4 + 1], (float)rgba_block[p*4 + 2], (float)rgba_block[p*4 + 3]);
+		sum += pixels[p];
+	}
+	const Vec4f mean = sum * (1.f / 16);
+
+	// Compute covariance matrix rows, and the initial principal axis estimate: the direction to the pixel furthest from the mean.
+	Vec4f cov[4] = { Vec4f(0.f), Vec4f(0.f), Vec4f(0.f), Vec4f(0.f) };
+	Vec4f axis(0.f);
+	float max_dist2 = -1;
+	for(int p=0; p<16; ++p)
+	{
+		const Vec4f d = pixels[p] - mean;
+		cov[0] += d * copyToAll<0>(d);
+		cov[1] += d * copyToAll<1>(d);
+		cov[2] += d * copyToAll<2>(d);
+		cov[3] += d * copyToAll<3>(d);
+		const float dist2 = dot(d, d);
+		if(dist2 > max_dist2)
+		{
+			max_dist2 = dist2;
+			axis = d;
+		}
+	}
+
+	const int num_iters = (quality == Quality_Fast) ? 2 : ((quality == Quality_Normal) ? 4 : 8);
+	for(int i=0; i<num_iters; ++i)
+	{
+		const Vec4f new_axis = cov[0] * copyToAll<0>(axis) + cov[1] * copyToAll<1>(axis) + cov[2] * copyToAll<2>(axis) + cov[3] * copyToAll<3>(axis);
+		const float len2 = dot(new_axis, new_axis);
+		if(len2 < 1.0e-10f)
+			break;
+		axis = new_axis * (1 / std::sqrt(len2));
+	}
+	const float axis_len2 = dot(axis, axis);
+	axis = (axis_len2 > 1.0e-10f) ? axis * (1 / std::sqrt(axis_len2)) : Vec4f(0.f);
+
+	float t_min = std::numeric_limits<float>::infinity();
+	float t_max = -std::numeric_limits<float>::infinity();
+	for(int p=0; p<16; ++p)
+	{
+		const float t = dot(pixels[p] - mean, axis);
+		t_min = myMin(t_min, t);
+		t_max = myMax(t_max, t);
+	}
+
+	const Vec4f zero(0.f);
+	const Vec4f max_val(255.f);
+	Vec4f e0 = clamp(mean + axis * t_min, zero, max_val);
+	Vec4f e1 = clamp(mean + axis * t_max, zero, max_val);
+
+	BC7Mode6Endpoints best;
+	int best_indices[16];
+	float best_err;
+	if(quality == Quality_High)
+	{
+		// Try all p-bit combinations
+		best_err = std::numeric_limits<float>::infinity();
+		for(int pbits=0; pbits<4; ++pbits)
+		{
+			BC7Mode6Endpoints endpoints;
+			endpoints.p[0] = pbits & 1;
+			endpoints.p[1] = pbits >> 1;
+			quantiseBC7Mode6Endpoint(e0, endpoints.p[0], endpoints.e[0]);
+			quantiseBC7Mode6Endpoint(e1, endpoints.p[1], endpoints.e[1]);
+			int indices[16];
+			const float err = computeBC7Mode6Indices(pixels, endpoints, indices);
+			if(err < best_err)
+			{
+				best_err = err;
+				best = endpoints;
+				std::memcpy(best_indices, indices, sizeof(indices));
+			}
+		}
+	}
+	else
+	{
+		quantiseBC7Mode6EndpointBestP(e0, best, 0);
+		quantiseBC7Mode6EndpointBestP(e1, best, 1);
+		best_err = computeBC7Mode6Indices(pixels, best, best_indices);
+	}
+
+	// Least-squares refits of the endpoints given the indices.  Pixel colour is modelled as (1 - w) * e0 + w * e1.
+	const int num_refits = (quality == Quality_Fast) ? 0 : ((quality == Quality_Normal) ? 1 : 2);
+	for(int r=0; r<num_refits && best_err > 0; ++r)
+	{
+		float sum_uu = 0, sum_ww = 0, sum_uw = 0;
+		Vec4f sum_uc(0.f), sum_wc(0.f);
+		for(int p=0; p<16; ++p)
+		{
+			const float w = bc7_weights_4bit[best_indices[p]] * (1.f / 64);
+			const float u = 1 - w;
+			sum_uu += u * u;
+			sum_ww += w * w;
+			sum_uw += u * w;
+			sum_uc += pixels[p] * u;
+			sum_wc += pixels[p] * w;
+		}
+		const float det = sum_uu * sum_ww - sum_uw * sum_uw;
+		if(det < 1.0e-3f)
+			break;
+		const float recip_det = 1 / det;
+		const Vec4f refit_e0 = clamp((sum_wc * -sum_uw + sum_uc * sum_ww) * recip_det, zero, max_val);
+		const Vec4f refit_e1 = clamp((sum_wc * sum_uu - sum_uc * sum_uw) * recip_det, zero, max_val);
+
+		BC7Mode6Endpoints endpoints;
+		quantiseBC7Mode6EndpointBestP(refit_e0, endpoints, 0);
+		quantiseBC7Mode6EndpointBestP(refit_e1, endpoints, 1);
+		int indices[16];
+		const float err = computeBC7Mode6Indices(pixels, endpoints, indices);
+		if(err < best_err)
+		{
+			best_err = err;
+			best = endpoints;
+			std::memcpy(best_indices, indices, sizeof(indices));
+		}
+	}
+
+	// The top bit of the index of pixel 0 (the anchor) is implicitly zero, so swap the endpoints if needed.
+	if(best_indices[0] >= 8)
+	{
+		for(int c=0; c<4; ++c)
+			mySwap(best.e[0][c], best.e[1][c]);
+		mySwap(best.p[0], best.p[1]);
+		for(int p=0; p<16; ++p)
+			best_indices[p] = 15 - best_indices[p];
+	}
+
+	// Pack bits
+	uint64 bits[2] = { 0, 0 };
+	int bit_pos = 0;
+	auto writeBits = [&](uint64 val, int num_bits)
+	{
+		const int word = bit_pos / 64;
+		const int shift = bit_pos % 64;
+		bits[word] |= val << shift;
+		if(shift + num_bits > 64)
+			bits[word + 1] |= val >> (64 - shift);
+		bit_pos += num_bits;
+	};
+
+	writeBits(1 << 6, 7); // Mode 6
+	for(int c=0; c<4; ++c)
+	{
+		writeBits((uint64)best.e[0][c], 7);
+		writeBits((uint64)best.e[1][c], 7);
+	}
+	writeBits((uint64)best.p[0], 1);
+	writeBits((uint64)best.p[1], 1);
+	writeBits((uint64)best_indices[0], 3);
+	for(int p=1; p<16; ++p)
+		writeBits((uint64)best_indices[p], 4);
+	assert(bit_pos == 128);
+
+	std::memcpy(block_out, bits, 16);
+}
+
+
+//==================================== Default encoder ====================================
+
+
+class DefaultBlockEncoder : public BlockEncoder
+{
+public:
+	virtual void encodeBlocks(BlockFormat format, Quality quality, const uint8* rgba_blocks, size_t num_blocks, uint8* blocks_out) const
+	{
+		const size_t block_bytes = bytesPerBlock(format);
+
+		if(quality == Quality_High && (format == BlockFormat_BC1 || format == BlockFormat_BC3))
+		{
+			for(size_t i=0; i<num_blocks; ++i)
+				stb_compress_dxt_block(blocks_out + i * block_bytes, rgba_blocks + i * 64, /*alpha=*/(format == BlockFormat_BC3) ? 1 : 0, /*mode=*/STB_DXT_HIGHQUAL);
+			return;
+		}
+
+		if(format == BlockFormat_BC7)
+		{
+			for(size_t i=0; i<num_blocks; ++i)
+				encodeBC7Block(rgba_blocks + i * 64, quality, blocks_out + i * block_bytes);
+			return;
+		}
+
+		// Encode 4 blocks at a time, one per SIMD lane.
+		for(size_t i=0; i<num_blocks; i += 4)
+		{
+			const uint8* src_blocks[4];
+			uint8* out[4];
+			uint8 unused_out[4][16]; // Output for lanes past the end, which encode a duplicate of the last block.
+			for(int l=0; l<4; ++l)
+			{
+				const size_t block_i = myMin(i + l, num_blocks - 1);
+				src_blocks[l] = rgba_blocks + block_i * 64;
+				out[l] = (i + l < num_blocks) ? (blocks_out + (i + l) * block_bytes) : unused_out[l];
+			}
+
+			FourBlocks blocks;
+			loadFourBlocks(src_blocks, blocks);
+
+			switch(format)
+			{
+			case BlockFormat_BC1:
+				encodeBC1FourBlocks(blocks, quality, out, /*out_offset=*/0);
+				break;
+			case BlockFormat_BC3:
+				encodeBC4FourBlocks(blocks.c[3], quality, out, /*out_offset=*/0);
+				encodeBC1FourBlocks(blocks, quality, out, /*out_offset=*/8);
+				break;
+			case BlockFormat_BC4:
+				encodeBC4FourBlocks(blocks.c[0], quality, out, /*out_offset=*/0);
+				break;
+			case BlockFormat_BC5:
+				encodeBC4FourBlocks(blocks.c[0], quality, out, /*out_offset=*/0);
+				encodeBC4FourBlocks(blocks.c[1], quality, out, /*out_offset=*/8);
+				break;
+			case BlockFormat_BC7:
+				assert(0);
+				break;
+			}
+		}
+	}
+};
+
+
+const BlockEncoder& getDefaultBlockEncoder()
+{
+	static DefaultBlockEncoder encoder;
+	return encoder;
+}
+
+
+//==================================== Compression of images ====================================
+
+
+// Copies a 4x4 block of pixels with top-left corner (x0, y0) to RGBA format.
+static inline void gatherRGBABlock(const uint8* src_data, size_t W, size_t H, size_t bytes_pp, size_t x0, size_t y0, uint8* rgba_block_out)
+{
+	for(size_t y=0; y<4; ++y)
+	{
+		const size_t use_y = myMin(y0 + y, H - 1); // Clamp to image width/height in order to pad edges with edge pixel data.
+		const uint8* const src_row = src_data + W * use_y * bytes_pp;
+		uint8* const dest_row = rgba_block_out + y * 16;
+
+		if(bytes_pp == 4 && x0 + 4 <= W)
+		{
+			std::memcpy(dest_row, src_row + x0 * 4, 16);
+			continue;
+		}
+
+		for(size_t x=0; x<4; ++x)
+		{
+			const size_t use_x = myMin(x0 + x, W - 1);
+			const uint8* const pixel = src_row + use_x * bytes_pp;
+			uint8* const dest = dest_row + x * 4;
+			switch(bytes_pp)
+			{
+			case 1:
+				dest[0] = dest[1] = dest[2] = pixel[0];
+				dest[3] = 255;
+				break;
+			case 2:
+				dest[0] = pixel[0];
+				dest[1] = pixel[1];
+				dest[2] = 0;
+				dest[3] = 255;
+				break;
+			case 3:
+				dest[0] = pixel[0];
+				dest[1] = pixel[1];
+				dest[2] = pixel[2];
+				dest[3] = 255;
+				break;
+			default:
+				std::memcpy(dest, pixel, 4);
+				break;
+			}
+		}
+	}
+}
+
+
+// Compresses block rows [begin_block_y, end_block_y)
+struct BlockCompressRowsFunc
+{
+	void operator() (size_t begin_block_y, size_t end_block_y, size_t /*thread_index*/) const
+	{
+		const size_t W = src_W;
+		const size_t H = src_H;
+		const size_t num_blocks_x = Maths::roundedUpDivide(W, (size_t)4);
+		const size_t block_bytes = bytesPerBlock(options->format);
+		const BlockEncoder* const encoder = options->encoder ? options->encoder : &getDefaultBlockEncoder();
+
+		// Gather a batch of blocks along the row, then pass them to the encoder together.
+		const size_t max_batch_size = 16;
+		GLARE_ALIGN(16) uint8 rgba_blocks[max_batch_size * 64];
+
+		for(size_t block_y=begin_block_y; block_y<end_block_y; ++block_y)
+			for(size_t batch_begin=0; batch_begin<num_blocks_x; batch_begin += max_batch_size)
+			{
+				const size_t batch_size = myMin(max_batch_size, num_blocks_x - batch_begin);
+				for(size_t i=0; i<batch_size; ++i)
+					gatherRGBABlock(src_image_data, W, H, src_bytes_pp, (batch_begin + i) * 4, block_y * 4, rgba_blocks + i * 64);
+
+				encoder->encodeBlocks(options->format, options->quality, rgba_blocks, batch_size, compressed + (block_y * num_blocks_x + batch_begin) * block_bytes);
+			}
+	}
+	const CompressOptions* options;
 	uint8* compressed;
 	size_t src_W;
 	size_t src_H;
@@ -128,93 +978,203 @@ public:
 };
 
 
-size_t getCompressedSizeBytes(size_t W, size_t H, size_t bytes_pp)
+// Multi-thread if task_manager is non-null
+void compress(glare::TaskManager* task_manager, TempData& temp_data, size_t src_W, size_t src_H, size_t src_bytes_pp, const uint8* src_image_data, uint8* compressed_data_out, size_t compressed_data_out_size)
 {
-	assert(bytes_pp == 3 || bytes_pp == 4);
-
-	const size_t num_blocks_x = Maths::roundedUpDivide(W, (size_t)4);
-	const size_t num_blocks_y = Maths::roundedUpDivide(H, (size_t)4);
-	const size_t num_blocks = num_blocks_x * num_blocks_y;
+	assert(src_bytes_pp == 3 || src_bytes_pp == 4);
 
-	return (bytes_pp == 3) ? (num_blocks * 8) : (num_blocks * 16);
+	const CompressOptions options((src_bytes_pp == 3) ? BlockFormat_BC1 : BlockFormat_BC3, Quality_High);
+	compress(task_manager, temp_data, options, src_W, src_H, src_bytes_pp, src_image_data, compressed_data_out, compressed_data_out_size);
 }
 
 
 // Multi-thread if task_manager is non-null
-void compress(glare::TaskManager* task_manager, TempData& temp_data, size_t src_W, size_t src_H, size_t src_bytes_pp, const uint8* src_image_data, uint8* compressed_data_out, size_t compressed_data_out_size)
+void compress(glare::TaskManager* task_manager, TempData& temp_data, const CompressOptions& options, size_t src_W, size_t src_H, size_t src_bytes_pp, const uint8* src_image_data,
+	uint8* compressed_data_out, size_t compressed_data_out_size)
 {
-	// Try and load as a DXT texture compression
 	const size_t W = src_W;
 	const size_t H = src_H;
-	assert(src_bytes_pp == 3 || src_bytes_pp == 4);
+	assert(src_bytes_pp >= 1 && src_bytes_pp <= 4);
 
 	const size_t num_blocks_x = Maths::roundedUpDivide(W, (size_t)4);
 	const size_t num_blocks_y = Maths::roundedUpDivide(H, (size_t)4);
 	const size_t num_blocks = num_blocks_x * num_blocks_y;
 
-	assert(compressed_data_out_size >= /*compressed_data_size=*/((src_bytes_pp == 3) ? (num_blocks * 8) : (num_blocks * 16)));
+	assert(compressed_data_out_size >= getCompressedSizeBytes(W, H, options.format));
+
+	BlockCompressRowsFunc func;
+	func.options = &options;
+	func.compressed = compressed_data_out;
+	func.src_W = src_W;
+	func.src_H = src_H;
+	func.src_bytes_pp = src_bytes_pp;
+	func.src_image_data = src_image_data;
 
 	// Timer timer;
 	if(!task_manager || (num_blocks < 1024))
 	{
-		DXTCompressTask task;
-		task.compressed = compressed_data_out;
-		task.src_W = src_W;
-		task.src_H = src_H;
-		task.src_bytes_pp = src_bytes_pp;
-		task.src_image_data = src_image_data;
-		task.begin_y = 0;
-		task.end_y = H;
-		task.run(0);
+		func(0, num_blocks_y, /*thread_index=*/0);
 	}
 	else
 	{
 		if(temp_data.task_group.isNull())
 			temp_data.task_group = new glare::TaskGroup();
 
-		// Create temp_data compress_tasks if not already created.
-		// Note that even if we decide to use fewer tasks than this, we will not destroy these tasks here.
-		std::vector<Reference<glare::Task> >& compress_tasks = temp_data.compress_tasks;
-		compress_tasks.resize(myMax<size_t>(1, task_manager->getConcurrency()));
+		// Threads claim chunks of block rows dynamically, so that threads finishing early (e.g. on rows with lots of flat colour) keep taking work.
+		// Avoid chunks with too small an amount of work.
+		const size_t min_blocks_per_chunk = 256;
+		const size_t y_blocks_per_chunk = myMax<size_t>(1, min_blocks_per_chunk / num_blocks_x);
 
-		for(size_t z=0; z<compress_tasks.size(); ++z)
-			if(compress_tasks[z].isNull())
-				compress_tasks[z] = new DXTCompressTask();
+		task_manager->runParallelForDynamic(func, 0, num_blocks_y, /*grain_size=*/y_blocks_per_chunk, temp_data.task_group);
+	}
+	// conPrint("DXT compression took " + timer.elapsedString());
+}
+
+
+//==================================== Decompression ====================================
+
+
+static void decompressBC1ColourBlock(const uint8* block, bool always_4_colour, uint8* rgba_out)
+{
+	const uint32 c0 = block[0] | ((uint32)block[1] << 8);
+	const uint32 c1 = block[2] | ((uint32)block[3] << 8);
+
+	int palette[4][3];
+	const uint32 cols[2] = { c0, c1 };
+	for(int i=0; i<2; ++i)
+	{
+		const int r = (cols[i] >> 11) & 31;
+		const int g = (cols[i] >> 5) & 63;
+		const int b = cols[i] & 31;
+		palette[i][0] = (r << 3) | (r >> 2);
+		palette[i][1] = (g << 2) | (g >> 4);
+		palette[i][2] = (b << 3) | (b >> 2);
+	}
+	for(int c=0; c<3; ++c)
+	{
+		if(always_4_colour || c0 > c1)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	uint32 index_bits;
+	std::memcpy(&index_bits, block + 4, 4);
+	for(int p=0; p<16; ++p)
+	{
+		const uint32 index = (index_bits >> (2 * p)) & 3;
+		for(int c=0; c<3; ++c)
+			rgba_out[p*4 + c] = (uint8)palette[index][c];
+	}
+}
+
+
+// Decodes a BC4 block to channel 'channel' of rgba_out.
+// Interpolated values are rounded to the nearest integer, which is what GPUs are required to approximate.
+static void decompressBC4Block(const uint8* block, int channel, uint8* rgba_out)
+{
+	const int r0 = block[0];
+	const int r1 = block[1];
+	int palette[8];
+	palette[0] = r0;
+	palette[1] = r1;
+	if(r0 > r1)
+	{
+		for(int i=1; i<7; ++i)
+			palette[i + 1] = ((7 - i) * r0 + i * r1 + 3) / 7;
+	}
+	else
+	{
+		for(int i=1; i<5; ++i)
+			palette[i + 1] = ((5 - i) * r0 + i * r1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
 
+	uint64 index_bits = 0;
+	for(int i=0; i<6; ++i)
+		index_bits |= (uint64)block[2 + i] << (8 * i);
+	for(int p=0; p<16; ++p)
+		rgba_out[p*4 + channel] = (uint8)palette[(index_bits >> (3 * p)) & 7];
+}
 
-		// Avoid creating tasks with too small an amount of work.
-		const size_t min_blocks_per_task = 1024; // min_blocks_per_task = num_blocks_x * min_y_blocks_per_task
-		const size_t min_y_blocks_per_task = myMax<size_t>(1, min_blocks_per_task / num_blocks_x);
 
-		const size_t even_divided_blocks_per_task = Maths::roundedUpDivide((size_t)num_blocks_y, compress_tasks.size());
-		const size_t y_blocks_per_task = myMax(min_y_blocks_per_task, even_divided_blocks_per_task);
-		//printVar(y_blocks_per_task * num_blocks_x);
+static bool decompressBC7Block(const uint8* block, uint8* rgba_out)
+{
+	uint64 bits[2];
+	std::memcpy(bits, block, 16);
+	if((bits[0] & 0x7F) != 0x40) // If not mode 6:
+		return false;
 
-		const size_t use_num_tasks = Maths::roundedUpDivide(num_blocks_y, y_blocks_per_task);
-		//printVar(use_num_tasks);
-		assert(y_blocks_per_task * use_num_tasks >= num_blocks_y);
+	int bit_pos = 7;
+	auto readBits = [&](int num_bits) -> int
+	{
+		const int word = bit_pos / 64;
+		const int shift = bit_pos % 64;
+		uint64 val = bits[word] >> shift;
+		if(shift + num_bits > 64)
+			val |= bits[word + 1] << (64 - shift);
+		bit_pos += num_bits;
+		return (int)(val & ((1ull << num_bits) - 1));
+	};
 
-		temp_data.task_group->tasks.resize(use_num_tasks);
+	BC7Mode6Endpoints endpoints;
+	for(int c=0; c<4; ++c)
+	{
+		endpoints.e[0][c] = readBits(7);
+		endpoints.e[1][c] = readBits(7);
+	}
+	endpoints.p[0] = readBits(1);
+	endpoints.p[1] = readBits(1);
 
-		for(size_t z=0; z<use_num_tasks; ++z)
+	for(int p=0; p<16; ++p)
+	{
+		const int w = bc7_weights_4bit[readBits((p == 0) ? 3 : 4)];
+		for(int c=0; c<4; ++c)
 		{
-			temp_data.task_group->tasks[z] = compress_tasks[z];
-
-			// Set compress_tasks fields
-			assert(dynamic_cast<DXTCompressTask*>(compress_tasks[z].ptr()));
-			DXTCompressTask* task = static_cast<DXTCompressTask*>(compress_tasks[z].ptr());
-			task->compressed = compressed_data_out;
-			task->src_W = src_W;
-			task->src_H = src_H;
-			task->src_bytes_pp = src_bytes_pp;
-			task->src_image_data = src_image_data;
-			task->begin_y = (size_t)myMin((size_t)H, (z       * y_blocks_per_task) * 4);
-			task->end_y   = (size_t)myMin((size_t)H, ((z + 1) * y_blocks_per_task) * 4);
-			assert(task->begin_y >= 0 && task->begin_y <= H && task->end_y >= 0 && task->end_y <= H);
+			const int e0 = endpoints.e[0][c] * 2 + endpoints.p[0];
+			const int e1 = endpoints.e[1][c] * 2 + endpoints.p[1];
+			rgba_out[p*4 + c] = (uint8)(((64 - w) * e0 + w * e1 + 32) >> 6);
 		}
-		task_manager->runTaskGroup(temp_data.task_group);
 	}
-	// conPrint("DXT compression took " + timer.elapsedString());
+	return true;
+}
+
+
+bool decompressBlock(BlockFormat format, const uint8* block, uint8* rgba_out)
+{
+	for(int p=0; p<16; ++p)
+	{
+		rgba_out[p*4 + 0] = rgba_out[p*4 + 1] = rgba_out[p*4 + 2] = 0;
+		rgba_out[p*4 + 3] = 255;
+	}
+
+	switch(format)
+	{
+	case BlockFormat_BC1:
+		decompressBC1ColourBlock(block, /*always_4_colour=*/false, rgba_out);
+		return true;
+	case BlockFormat_BC3:
+		decompressBC4Block(block, /*channel=*/3, rgba_out);
+		decompressBC1ColourBlock(block + 8, /*always_4_colour=*/true, rgba_out);
+		return true;
+	case BlockFormat_BC4:
+		decompressBC4Block(block, /*channel=*/0, rgba_out);
+		return true;
+	case BlockFormat_BC5:
+		decompressBC4Block(block, /*channel=*/0, rgba_out);
+		decompressBC4Block(block + 8, /*channel=*/1, rgba_out);
+		return true;
+	case BlockFormat_BC7:
+		return decompressBC7Block(block, rgba_out);
+	}
+	return false;
 }
 
 
@@ -11,21 +11,93 @@ Copyright Glare Technologies Limited 2019 -
 namespace glare { class TaskManager; }
 
 
+/*=====================================================================
+DXTCompression
+--------------
+Block compression of 8-bit images, to BC1 (DXT1), BC3 (DXT5), BC4, BC5
+and BC7 formats.
+
+The actual block encoding is done by a BlockEncoder.  The default block
+encoder uses stb_dxt for BC1 and BC3 with Quality_High, and its own
+encoders otherwise.  Its BC1, BC3, BC4 and BC5 encoders encode 4 blocks at
+once with SSE, one block per SIMD lane.  The BC7 encoder only uses mode 6
+(single subset, RGBA, 4-bit indices).
+
+Tests are in DXTImageMapTests.cpp
+=====================================================================*/
 namespace DXTCompression
 {
-	size_t getCompressedSizeBytes(size_t w, size_t h, size_t bytes_pp);
+	enum BlockFormat
+	{
+		BlockFormat_BC1, // Aka DXT1.  RGB, 8 bytes per block.
+		BlockFormat_BC3, // Aka DXT5.  RGBA, 16 bytes per block.
+		BlockFormat_BC4, // Aka RGTC1.  Red channel only, 8 bytes per block.
+		BlockFormat_BC5, // Aka RGTC2.  Red and green channels, 16 bytes per block.
+		BlockFormat_BC7  // RGBA, 16 bytes per block.
+	};
+
+	enum Quality
+	{
+		Quality_Fast,   // Endpoints from a rough principal axis of the block colours.
+		Quality_Normal, // More accurate principal axis, plus least-squares refinement of the endpoints.
+		Quality_High    // Slowest.  For BC1 and BC3 uses stb_dxt in high quality mode.
+	};
+
+	size_t bytesPerBlock(BlockFormat format);
+
+	size_t getCompressedSizeBytes(size_t w, size_t h, size_t bytes_pp); // Size with BC1 for 3 bytes per pixel, BC3 for 4 bytes per pixel.
+	size_t getCompressedSizeBytes(size_t w, size_t h, BlockFormat format);
+
+
+	/*=====================================================================
+	BlockEncoder
+	------------
+	Backend that does the encoding of 4x4 pixel blocks.
+	=====================================================================*/
+	class BlockEncoder
+	{
+	public:
+		virtual ~BlockEncoder() {}
+
+		// Encodes num_blocks blocks.  rgba_blocks contains 64 bytes per block: 16 RGBA pixels in row-major order.
+		// Writes bytesPerBlock(format) bytes per block to blocks_out.
+		// May be called from multiple threads at once.
+		virtual void encodeBlocks(BlockFormat format, Quality quality, const uint8* rgba_blocks, size_t num_blocks, uint8* blocks_out) const = 0;
+	};
+
+	const BlockEncoder& getDefaultBlockEncoder();
+
+
+	struct CompressOptions
+	{
+		CompressOptions() : format(BlockFormat_BC1), quality(Quality_High), encoder(NULL) {}
+		CompressOptions(BlockFormat format_, Quality quality_) : format(format_), quality(quality_), encoder(NULL) {}
+
+		BlockFormat format;
+		Quality quality;
+		const BlockEncoder* encoder; // Encoder to use.  If NULL, the default encoder is used.
+	};
+
 
 	struct TempData
 	{
-		std::vector<Reference<glare::Task> > compress_tasks;
-		glare::TaskGroupRef task_group;
+		glare::TaskGroupRef task_group; // Task group for compression tasks, reused between compress() calls.
 	};
 
 	// Multi-thread if task_manager is non-null
-	void compress(glare::TaskManager* task_manager, TempData& temp_data, size_t src_W, size_t src_H, size_t src_bytes_pp, const uint8* src_image_data, 
+	// Compresses to BC1 if src_bytes_pp is 3, or BC3 if src_bytes_pp is 4, with Quality_High.
+	void compress(glare::TaskManager* task_manager, TempData& temp_data, size_t src_W, size_t src_H, size_t src_bytes_pp, const uint8* src_image_data,
 		uint8* compressed_data_out, size_t compressed_data_out_size);
 
+	// Multi-thread if task_manager is non-null
+	// The source channels are used as red, green, blue and alpha.  Single channel sources are used as grey, and the alpha is 255 if there are less than 4 channels.
+	void compress(glare::TaskManager* task_manager, TempData& temp_data, const CompressOptions& options, size_t src_W, size_t src_H, size_t src_bytes_pp, const uint8* src_image_data,
+		uint8* compressed_data_out, size_t compressed_data_out_size);
+
+	// Decodes a single block to 16 RGBA pixels.  Channels not stored in the format are set to 0, apart from alpha which is set to 255.
+	// Returns false if the block could not be decoded: BC7 blocks are only decoded if they use mode 6, as produced by the default encoder.
+	bool decompressBlock(BlockFormat format, const uint8* block, uint8* rgba_out);
+
 
 	void test();
 };
-
@@ -264,6 +264,199 @@ static void checkCompressionWithConstantColour(glare::TaskManager& task_manager,
 }
 
 
+static int numFormatChannels(DXTCompression::BlockFormat format)
+{
+	switch(format)
+	{
+	case DXTCompression::BlockFormat_BC1: return 3;
+	case DXTCompression::BlockFormat_BC3: return 4;
+	case DXTCompression::BlockFormat_BC4: return 1;
+	case DXTCompression::BlockFormat_BC5: return 2;
+	case DXTCompression::BlockFormat_BC7: return 4;
+	}
+	return 4;
+}
+
+
+static const std::string formatName(DXTCompression::BlockFormat format)
+{
+	switch(format)
+	{
+	case DXTCompression::BlockFormat_BC1: return "BC1";
+	case DXTCompression::BlockFormat_BC3: return "BC3";
+	case DXTCompression::BlockFormat_BC4: return "BC4";
+	case DXTCompression::BlockFormat_BC5: return "BC5";
+	case DXTCompression::BlockFormat_BC7: return "BC7";
+	}
+	return "";
+}
+
+
+static const std::string qualityName(DXTCompression::Quality quality)
+{
+	switch(quality)
+	{
+	case DXTCompression::Quality_Fast: return "fast";
+	case DXTCompression::Quality_Normal: return "normal";
+	case DXTCompression::Quality_High: return "high";
+	}
+	return "";
+}
+
+
+// Decodes all blocks of compressed data, and returns the max absolute error over the channels stored by the format.
+// Also computes the sum of squared errors.
+static int computeDecompressionError(const ImageMapUInt8& image_map, DXTCompression::BlockFormat format, const std::vector<uint8>& compressed, double& sum_sqr_err_out)
+{
+	const size_t W = image_map.getWidth();
+	const size_t H = image_map.getHeight();
+	const size_t N = image_map.getN();
+	const size_t num_blocks_x = Maths::roundedUpDivide(W, (size_t)4);
+	const size_t num_blocks_y = Maths::roundedUpDivide(H, (size_t)4);
+	const size_t block_bytes = DXTCompression::bytesPerBlock(format);
+	const int num_channels = numFormatChannels(format);
+
+	int max_err = 0;
+	double sum_sqr_err = 0;
+	for(size_t by=0; by<num_blocks_y; ++by)
+		for(size_t bx=0; bx<num_blocks_x; ++bx)
+		{
+			uint8 rgba[64];
+			testAssert(DXTCompression::decompressBlock(format, &compressed[(by * num_blocks_x + bx) * block_bytes], rgba));
+
+			for(size_t y=by*4; y<myMin(by*4 + 4, H); ++y)
+				for(size_t x=bx*4; x<myMin(bx*4 + 4, W); ++x)
+				{
+					const uint8* decoded = &rgba[((y - by*4) * 4 + (x - bx*4)) * 4];
+					for(int c=0; c<num_channels; ++c)
+					{
+						// Single channel sources are expanded to grey, and alpha is 255 if not present.
+						const int ref = (c < (int)N) ? image_map.getPixel(x, y)[c] : ((N == 1 && c < 3) ? image_map.getPixel(x, y)[0] : ((c == 3) ? 255 : 0));
+						const int err = std::abs(ref - (int)decoded[c]);
+						max_err = myMax(max_err, err);
+						sum_sqr_err += (double)(err * err);
+					}
+				}
+		}
+	sum_sqr_err_out = sum_sqr_err;
+	return max_err;
+}
+
+
+static void checkBlockCompressionWithConstantColour(glare::TaskManager& task_manager, const Vec4i& rgba, int W, int H, int N)
+{
+	ImageMapUInt8 image_map(W, H, N);
+	for(int x=0; x<W; ++x)
+		for(int y=0; y<H; ++y)
+			for(int c=0; c<N; ++c)
+				image_map.getPixel(x, y)[c] = (uint8)rgba[c];
+
+	const DXTCompression::BlockFormat formats[] = { DXTCompression::BlockFormat_BC1, DXTCompression::BlockFormat_BC3, DXTCompression::BlockFormat_BC4, DXTCompression::BlockFormat_BC5, DXTCompression::BlockFormat_BC7 };
+	for(int f=0; f<5; ++f)
+		for(int q=0; q<3; ++q)
+		{
+			const DXTCompression::CompressOptions options(formats[f], (DXTCompression::Quality)q);
+			std::vector<uint8> compressed(DXTCompression::getCompressedSizeBytes(W, H, formats[f]));
+			DXTCompression::TempData temp_data;
+			DXTCompression::compress(&task_manager, temp_data, options, W, H, N, image_map.getData(), compressed.data(), compressed.size());
+
+			double sum_sqr_err;
+			const int max_err = computeDecompressionError(image_map, formats[f], compressed, sum_sqr_err);
+
+			// BC4 and BC5 can represent any constant value exactly, and the others can represent 0 and 255 exactly.
+			// BC7 mode 6 endpoints have a p-bit (lowest bit) shared between the channels, so only get within 1 when the channels need different p-bits.
+			const int allowed_error = (formats[f] == DXTCompression::BlockFormat_BC7) ? 1 : 0;
+			if(max_err > allowed_error)
+				failTest(formatName(formats[f]) + " " + qualityName((DXTCompression::Quality)q) + ": error of " + toString(max_err) + " was greater than allowed error of " + toString(allowed_error));
+		}
+}
+
+
+// Makes an image with smooth gradients, hard edges and some noise.
+static void makeBlockCompressionTestImage(ImageMapUInt8& image_map)
+{
+	const size_t W = image_map.getWidth();
+	const size_t H = image_map.getHeight();
+	const size_t N = image_map.getN();
+	uint32 rng_state = 1;
+	for(size_t y=0; y<H; ++y)
+		for(size_t x=0; x<W; ++x)
+		{
+			rng_state = rng_state * 1664525u + 1013904223u;
+			const int noise = (int)((rng_state >> 24) % 16) - 8;
+			const bool in_square = ((x / 24) + (y / 24)) % 2 == 0;
+			const float fx = (float)x / W;
+			const float fy = (float)y / H;
+			const float vals[4] = {
+				128 + 100 * std::sin(fx * 7.f + fy * 3.f),
+				in_square ? 200.f + 40 * fy : 30.f + 60 * fx,
+				128 + 120 * std::cos(fx * fy * 20.f),
+				(x < W / 2) ? 255.f : 255 * fy
+			};
+			for(size_t c=0; c<N; ++c)
+				image_map.getPixel(x, y)[c] = (uint8)myClamp((int)vals[c] + ((c < 3) ? noise : 0), 0, 255);
+		}
+}
+
+
+// Measures the PSNR and speed of each format and quality level, and checks the PSNRs are reasonable.
+static void testBlockCompressionQuality(glare::TaskManager& task_manager)
+{
+	const size_t W = 512;
+	const size_t H = 512;
+	const size_t N = 4;
+	ImageMapUInt8 image_map(W, H, N);
+	makeBlockCompressionTestImage(image_map);
+
+	const DXTCompression::BlockFormat formats[] = { DXTCompression::BlockFormat_BC1, DXTCompression::BlockFormat_BC3, DXTCompression::BlockFormat_BC4, DXTCompression::BlockFormat_BC5, DXTCompression::BlockFormat_BC7 };
+	for(int f=0; f<5; ++f)
+	{
+		double psnr[3];
+		std::vector<uint8> compressed_single_threaded;
+		for(int q=0; q<3; ++q)
+		{
+			const DXTCompression::CompressOptions options(formats[f], (DXTCompression::Quality)q);
+			std::vector<uint8> compressed(DXTCompression::getCompressedSizeBytes(W, H, formats[f]));
+			DXTCompression::TempData temp_data;
+
+			double min_elapsed = 1.0e10;
+			for(int t=0; t<3; ++t)
+			{
+				Timer timer;
+				DXTCompression::compress(/*task_manager=*/NULL, temp_data, options, W, H, N, image_map.getData(), compressed.data(), compressed.size());
+				min_elapsed = myMin(min_elapsed, timer.elapsed());
+			}
+
+			// Check multi-threaded compression gives the same result.
+			std::vector<uint8> compressed_mt(compressed.size());
+			DXTCompression::compress(&task_manager, temp_data, options, W, H, N, image_map.getData(), compressed_mt.data(), compressed_mt.size());
+			testAssert(compressed_mt == compressed);
+
+			double sum_sqr_err;
+			computeDecompressionError(image_map, formats[f], compressed, sum_sqr_err);
+			const double mse = sum_sqr_err / (W * H * numFormatChannels(formats[f]));
+			psnr[q] = 10 * std::log10(255.0 * 255.0 / myMax(mse, 1.0e-10));
+
+			conPrint(formatName(formats[f]) + " " + rightPad(qualityName((DXTCompression::Quality)q), ' ', 6) + ": PSNR: " + doubleToStringNDecimalPlaces(psnr[q], 2) + " dB, " +
+				doubleToStringNDecimalPlaces((W * H * N) / min_elapsed * 1.0e-6, 1) + " MB/s (single thread)");
+		}
+
+		// Quality_High for BC1 and BC3 is stb_dxt in high quality mode, the other levels use the SIMD encoder.
+		// The SIMD encoder should be close to stb_dxt, and higher quality levels should not be worse.
+		testAssert(psnr[DXTCompression::Quality_Normal] >= psnr[DXTCompression::Quality_Fast] - 0.05);
+		if(formats[f] == DXTCompression::BlockFormat_BC1 || formats[f] == DXTCompression::BlockFormat_BC3)
+		{
+			testAssert(psnr[DXTCompression::Quality_Fast] >= psnr[DXTCompression::Quality_High] - 0.5);
+			testAssert(psnr[DXTCompression::Quality_Normal] >= psnr[DXTCompression::Quality_High] - 0.25);
+		}
+		else
+			testAssert(psnr[DXTCompression::Quality_High] >= psnr[DXTCompression::Quality_Normal] - 0.05);
+
+		testAssert(psnr[DXTCompression::Quality_Fast] >= 35.0);
+	}
+}
+
+
 void DXTImageMapTests::test()
 {
 	conPrint("DXTImageMapTests::test()");
@@ -430,6 +623,77 @@ void DXTImageMapTests::test()
 			testAssert(!dxt_image->isAlphaChannelAllWhite());
 		}
 
+		//=================== Test block compression with DXTCompression::CompressOptions ===================
+		for(int N=1; N<=4; ++N)
+		{
+			checkBlockCompressionWithConstantColour(task_manager, Vec4i(0, 0, 0, 0), /*W=*/20, /*H=*/10, N);
+			checkBlockCompressionWithConstantColour(task_manager, Vec4i(255, 255, 255, 255), /*W=*/20, /*H=*/10, N);
+			checkBlockCompressionWithConstantColour(task_manager, Vec4i(255, 0, 255, 0), /*W=*/7, /*H=*/5, N);
+			checkBlockCompressionWithConstantColour(task_manager, Vec4i(0, 255, 0, 255), /*W=*/3, /*H=*/1, N);
+		}
+
+		// BC4 and BC5 should be exact for any constant value
+		for(int v=0; v<256; v += 17)
+		{
+			ImageMapUInt8 image_map(8, 8, 2);
+			for(int x=0; x<8; ++x)
+				for(int y=0; y<8; ++y)
+				{
+					image_map.getPixel(x, y)[0] = (uint8)v;
+					image_map.getPixel(x, y)[1] = (uint8)(255 - v);
+				}
+
+			for(int q=0; q<3; ++q)
+			{
+				const DXTCompression::BlockFormat format = DXTCompression::BlockFormat_BC5;
+				std::vector<uint8> compressed(DXTCompression::getCompressedSizeBytes(8, 8, format));
+				DXTCompression::TempData temp_data;
+				DXTCompression::compress(&task_manager, temp_data, DXTCompression::CompressOptions(format, (DXTCompression::Quality)q), 8, 8, 2, image_map.getData(), compressed.data(), compressed.size());
+				double sum_sqr_err;
+				testEqual(computeDecompressionError(image_map, format, compressed, sum_sqr_err), 0);
+			}
+		}
+
+		// BC1 and BC3 should be within 1 for any constant colour, since blocks of a single colour are encoded with the best endpoints for the colour.
+		for(int v=0; v<256; v += 3)
+		{
+			ImageMapUInt8 image_map(8, 8, 4);
+			for(int x=0; x<8; ++x)
+				for(int y=0; y<8; ++y)
+				{
+					image_map.getPixel(x, y)[0] = (uint8)v;
+					image_map.getPixel(x, y)[1] = (uint8)(255 - v);
+					image_map.getPixel(x, y)[2] = (uint8)((v * 7) % 256);
+					image_map.getPixel(x, y)[3] = (uint8)((v * 13) % 256);
+				}
+
+			for(int f=0; f<2; ++f)
+			for(int q=0; q<3; ++q)
+			{
+				const DXTCompression::BlockFormat format = (f == 0) ? DXTCompression::BlockFormat_BC1 : DXTCompression::BlockFormat_BC3;
+				std::vector<uint8> compressed(DXTCompression::getCompressedSizeBytes(8, 8, format));
+				DXTCompression::TempData temp_data;
+				DXTCompression::compress(&task_manager, temp_data, DXTCompression::CompressOptions(format, (DXTCompression::Quality)q), 8, 8, 4, image_map.getData(), compressed.data(), compressed.size());
+				double sum_sqr_err;
+				testAssert(computeDecompressionError(image_map, format, compressed, sum_sqr_err) <= 1);
+			}
+		}
+
+		// The old interface should give the same result as BC1 and BC3 with Quality_High.
+		{
+			ImageMapUInt8 image_map(64, 64, 4);
+			makeBlockCompressionTestImage(image_map);
+			std::vector<uint8> compressed(DXTCompression::getCompressedSizeBytes(64, 64, 4));
+			std::vector<uint8> compressed_with_options(compressed.size());
+			DXTCompression::TempData temp_data;
+			DXTCompression::compress(&task_manager, temp_data, 64, 64, 4, image_map.getData(), compressed.data(), compressed.size());
+			DXTCompression::compress(&task_manager, temp_data, DXTCompression::CompressOptions(DXTCompression::BlockFormat_BC3, DXTCompression::Quality_High), 64, 64, 4, image_map.getData(),
+				compressed_with_options.data(), compressed_with_options.size());
+			testAssert(compressed == compressed_with_options);
+		}
+
+		testBlockCompressionQuality(task_manager);
+
 		//=================== Do performance tests ===================
 		if(true)
 		{
@@ -11,6 +11,8 @@ File created by ClassTemplate on Fri Jul 11 02:36:44 2008
 #include "../graphics/image.h"
 #include "../graphics/Image4f.h"
 #include "../graphics/ImageMap.h"
+#include "../graphics/ImageRowDownsampler.h"
+#include "../graphics/TiledImageMap.h"
 #include "../utils/StringUtils.h"
 #include "../utils/FileUtils.h"
 #include "../utils/Exception.h"
@@ -21,13 +23,18 @@ File created by ClassTemplate on Fri Jul 11 02:36:44 2008
 #include "../utils/BufferViewInStream.h"
 #include "../utils/MemMappedFile.h"
 #include "../utils/ConPrint.h"
+#include "../utils/UniqueRef.h"
 #include <ImathBox.h>
 #include <fstream>
 #include <ImfStdIO.h>
 #include <ImfInputFile.h>
 #include <ImfOutputFile.h>
+#include <ImfTiledInputFile.h>
+#include <ImfTiledOutputFile.h>
+#include <ImfTestFile.h>
 #include <ImfChannelList.h>
 #include <ImfRgbaFile.h>
+#include <ImfCompressor.h>
 #include <IlmThreadPool.h>
 
 /*
@@ -254,12 +261,12 @@ public:
 };
 
 
-Reference<Map2D> EXRDecoder::decode(const std::string& pathname, glare::Allocator* mem_allocator)
+Reference<Map2D> EXRDecoder::decode(const std::string& pathname, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	try
 	{
 		MemMappedFile file(pathname);
-		return decodeFromBuffer(file.fileData(), file.fileSize(), pathname, mem_allocator);
+		return decodeFromBuffer(file.fileData(), file.fileSize(), pathname, mem_allocator, target_max_dim);
 	}
 	catch(glare::Exception& e)
 	{
@@ -268,115 +275,173 @@ Reference<Map2D> EXRDecoder::decode(const std::string& pathname, glare::Allocato
 }
 
 
-Reference<Map2D> EXRDecoder::decodeFromBuffer(const void* data, size_t size, const std::string& pathname, glare::Allocator* mem_allocator)
+// Reads the pixels of the data window in strips of rows, and box-filters each strip down by a factor of 2^num_halvings in each dimension, 
+// so that only the reduced resolution image and one strip at full resolution are stored.
+template <class V, class VTraits>
+static Reference<ImageMap<V, VTraits> > readPixelsDownsampled(Imf::InputFile& file, const std::vector<std::string>& channel_names, Imf::PixelType pixel_type, 
+	const Imath::Box2i& dw, int num_halvings, glare::Allocator* mem_allocator)
 {
-	try
+	const size_t width  = (size_t)(dw.max.x - dw.min.x + 1);
+	const size_t height = (size_t)(dw.max.y - dw.min.y + 1);
+	const size_t N = channel_names.size();
+	const size_t factor = (size_t)1 << num_halvings;
+
+	Reference<ImageMap<V, VTraits> > image = new ImageMap<V, VTraits>((width + factor - 1) / factor, (height + factor - 1) / factor, N, mem_allocator);
+
+	// Read strips that contain whole chunks (groups of scanlines that are compressed together, or rows of tiles) where possible, 
+	// so that chunks don't get decompressed more than once.
+	const int lines_per_chunk = file.header().hasTileDescription() ? (int)file.header().tileDescription().ySize : Imf::numLinesInBuffer(file.header().compression());
+	const size_t strip_num_rows = (myMax(factor, (size_t)myClamp(lines_per_chunk, 1, 256)) + factor - 1) / factor * factor; // Round up to a multiple of factor.
+
+	glare::AllocatorVector<V, 16> strip(mem_allocator);
+	strip.resizeNoCopy(width * N * strip_num_rows);
+
+	ImageRowDownsampler<V, VTraits, float> downsampler(*image, width, height, num_halvings, mem_allocator);
+
+	const size_t x_stride = sizeof(V) * N;
+	const size_t y_stride = sizeof(V) * N * width;
+
+	for(size_t strip_begin=0; strip_begin<height; strip_begin += strip_num_rows)
 	{
-		EXRDecoderInputStream in_stream(ArrayRef<uint8>((const uint8*)data, size), pathname);
+		const size_t strip_end = myMin(height, strip_begin + strip_num_rows);
+		const int strip_begin_y = dw.min.y + (int)strip_begin;
 
-		Imf::InputFile file(in_stream);
+		// Set up the frame buffer so that pixel (dw.min.x, strip_begin_y) is at the start of the strip buffer.
+		V* channel_0_base = strip.data() + (-(intptr_t)dw.min.x - (intptr_t)strip_begin_y * (intptr_t)width) * (intptr_t)N;
 
-		const Imf::ChannelList& channels = file.header().channels();
+		Imf::FrameBuffer frame_buffer;
+		for(size_t i=0; i<N; ++i)
+			frame_buffer.insert(channel_names[i], Imf::Slice(pixel_type, (char*)(channel_0_base + i), x_stride, y_stride));
 
-		if(channels.begin() == channels.end())
-			throw ImFormatExcep("EXR file had no channels.");
+		file.setFrameBuffer(frame_buffer);
+		file.readPixels(strip_begin_y, dw.min.y + (int)strip_end - 1);
 
-		// Get names of all layers in the EXR
-		std::set<std::string> layer_names;
-		channels.layers(layer_names);
+		for(size_t y=strip_begin; y<strip_end; ++y)
+			downsampler.addRow(strip.data() + (y - strip_begin) * width * N);
+	}
 
-		std::vector<std::string> channels_to_load_names;
-		if(layer_names.empty())
+	return image;
+}
+
+
+// Chooses the channels to load from an EXR file, in the order they are stored in the decoded image.  Throws glare::Exception on failure.
+static void getChannelsToLoad(const Imf::ChannelList& channels, std::vector<std::string>& channels_to_load_names)
+{
+	if(channels.begin() == channels.end())
+		throw ImFormatExcep("EXR file had no channels.");
+
+	// Get names of all layers in the EXR
+	std::set<std::string> layer_names;
+	channels.layers(layer_names);
+
+	if(layer_names.empty())
+	{
+		// Look for channels called R, G, B, or R, G, B, A, and if found, load them in RGBA order.
+		if(channels.findChannel("R"))
 		{
-			// Look for channels called R, G, B, or R, G, B, A, and if found, load them in RGBA order.
-			if(channels.findChannel("R"))
-			{
-				channels_to_load_names.push_back("R");
+			channels_to_load_names.push_back("R");
 
-				if(channels.findChannel("G"))
-					channels_to_load_names.push_back("G");
+			if(channels.findChannel("G"))
+				channels_to_load_names.push_back("G");
 
-				if(channels.findChannel("B"))
-					channels_to_load_names.push_back("B");
+			if(channels.findChannel("B"))
+				channels_to_load_names.push_back("B");
 
-				if(channels.findChannel("A"))
-					channels_to_load_names.push_back("A");
-			}
-			else
+			if(channels.findChannel("A"))
+				channels_to_load_names.push_back("A");
+		}
+		else
+		{
+			/*
+			Try and load a multi-wavelength EXR, should have channel names like
+			wavelength430_5
+			wavelength460_25
+			wavelength490_75
+			etc..
+			*/
+			if(::hasPrefix(channels.begin().name(), "wavelength"))
 			{
-				/*
-				Try and load a multi-wavelength EXR, should have channel names like
-				wavelength430_5
-				wavelength460_25
-				wavelength490_75
-				etc..
-				*/
-				if(::hasPrefix(channels.begin().name(), "wavelength"))
+				for(auto it = channels.begin(); it != channels.end(); ++it)
 				{
-					for(auto it = channels.begin(); it != channels.end(); ++it)
-					{
-						const std::string channel_name = it.name();
-						if(!::hasPrefix(channel_name, "wavelength"))
-							throw glare::Exception("Found a channel name that did not start with 'wavelength' while loading a spectral EXR.");
+					const std::string channel_name = it.name();
+					if(!::hasPrefix(channel_name, "wavelength"))
+						throw glare::Exception("Found a channel name that did not start with 'wavelength' while loading a spectral EXR.");
 
-						channels_to_load_names.push_back(channel_name);
-					}
-				}
-				else
-				{
-					// Just use the first channel (in alphabetic order)
-					channels_to_load_names.push_back(channels.begin().name());
+					channels_to_load_names.push_back(channel_name);
 				}
 			}
+			else
+			{
+				// Just use the first channel (in alphabetic order)
+				channels_to_load_names.push_back(channels.begin().name());
+			}
 		}
-		else // Else we have one or more layers:
+	}
+	else // Else we have one or more layers:
+	{
+		for(auto z = layer_names.begin(); z != layer_names.end(); ++z)
 		{
-			for(auto z = layer_names.begin(); z != layer_names.end(); ++z)
+			const std::string layer = *z;
+			if(layer == "spectral")
 			{
-				const std::string layer = *z;
-				if(layer == "spectral")
-				{
-					Imf::ChannelList::ConstIterator begin, end;
-					channels.channelsInLayer(layer, begin, end);
+				Imf::ChannelList::ConstIterator begin, end;
+				channels.channelsInLayer(layer, begin, end);
 
-					for(auto it = begin; it != end; ++it)
-					{
-						const std::string channel_name = it.name();
-						if(!::hasPrefix(channel_name, "spectral.wavelength"))
-							throw glare::Exception("Found a channel name that did not start with 'wavelength' while loading a spectral EXR.");
+				for(auto it = begin; it != end; ++it)
+				{
+					const std::string channel_name = it.name();
+					if(!::hasPrefix(channel_name, "spectral.wavelength"))
+						throw glare::Exception("Found a channel name that did not start with 'wavelength' while loading a spectral EXR.");
 
-						channels_to_load_names.push_back(channel_name);
-					}
+					channels_to_load_names.push_back(channel_name);
 				}
-				else
+			}
+			else
+			{
+				// Look for channels called R, G, B, or R, G, B, A, and if found, load them in RGBA order.
+				if(channels.findChannel(layer + ".R"))
 				{
-					// Look for channels called R, G, B, or R, G, B, A, and if found, load them in RGBA order.
-					if(channels.findChannel(layer + ".R"))
-					{
-						channels_to_load_names.push_back(layer + ".R");
+					channels_to_load_names.push_back(layer + ".R");
 
-						if(channels.findChannel(layer + ".G"))
-							channels_to_load_names.push_back(layer + ".G");
+					if(channels.findChannel(layer + ".G"))
+						channels_to_load_names.push_back(layer + ".G");
 
-						if(channels.findChannel(layer + ".B"))
-							channels_to_load_names.push_back(layer + ".B");
+					if(channels.findChannel(layer + ".B"))
+						channels_to_load_names.push_back(layer + ".B");
 
-						if(channels.findChannel(layer + ".A"))
-							channels_to_load_names.push_back(layer + ".A");
-					}
-					else
-					{
-						// Just use the first channel in this layer (in alphabetic order)
-						Imf::ChannelList::ConstIterator begin, end;
-						channels.channelsInLayer(layer, begin, end);
-						if(begin == end)
-							throw ImFormatExcep("layer had no channels."); // Shouldn't get here.
+					if(channels.findChannel(layer + ".A"))
+						channels_to_load_names.push_back(layer + ".A");
+				}
+				else
+				{
+					// Just use the first channel in this layer (in alphabetic order)
+					Imf::ChannelList::ConstIterator begin, end;
+					channels.channelsInLayer(layer, begin, end);
+					if(begin == end)
+						throw ImFormatExcep("layer had no channels."); // Shouldn't get here.
 
-						channels_to_load_names.push_back(begin.name());
-					}
+					channels_to_load_names.push_back(begin.name());
 				}
 			}
 		}
+	}
+
+	assert(!channels_to_load_names.empty() && channels.findChannel(channels_to_load_names[0]));
+}
+
+
+Reference<Map2D> EXRDecoder::decodeFromBuffer(const void* data, size_t size, const std::string& pathname, glare::Allocator* mem_allocator, size_t target_max_dim)
+{
+	try
+	{
+		EXRDecoderInputStream in_stream(ArrayRef<uint8>((const uint8*)data, size), pathname);
+
+		Imf::InputFile file(in_stream);
+
+		const Imf::ChannelList& channels = file.header().channels();
+
+		std::vector<std::string> channels_to_load_names;
+		getChannelsToLoad(channels, channels_to_load_names);
 
 		assert(!channels_to_load_names.empty() && channels.findChannel(channels_to_load_names[0]));
 
@@ -400,6 +465,26 @@ Reference<Map2D> EXRDecoder::decodeFromBuffer(const void* data, size_t size, con
 		if(result_num_channels > 100000)
 			throw glare::Exception("Num channels to load is too large: " + toString(result_num_channels));
 
+		const int num_halvings = ImFormatDecoder::numHalvingsForTargetDim(width, height, target_max_dim, /*max num halvings=*/16);
+		if(num_halvings > 0)
+		{
+			if(use_pixel_type == Imf::FLOAT)
+			{
+				Reference<ImageMap<float, FloatComponentValueTraits> > new_image = readPixelsDownsampled<float, FloatComponentValueTraits>(file, channels_to_load_names, Imf::FLOAT, dw, num_halvings, mem_allocator);
+				new_image->setGamma(1); // HDR images should have gamma 1.
+				new_image->channel_names = channels_to_load_names;
+				return new_image;
+			}
+			else if(use_pixel_type == Imf::HALF)
+			{
+				Reference<ImageMap<half, HalfComponentValueTraits> > new_image = readPixelsDownsampled<half, HalfComponentValueTraits>(file, channels_to_load_names, Imf::HALF, dw, num_halvings, mem_allocator);
+				new_image->setGamma(1); // HDR images should have gamma 1.
+				return new_image;
+			}
+			else
+				throw ImFormatExcep("EXR pixel type must be HALF or FLOAT.");
+		}
+
 		Imf::FrameBuffer frameBuffer;
 
 		if(use_pixel_type == Imf::FLOAT)
@@ -470,6 +555,145 @@ Reference<Map2D> EXRDecoder::decodeFromBuffer(const void* data, size_t size, con
 }
 
 
+/*=====================================================================
+EXRTiledImageSource
+-------------------
+Reads an EXR file a tile at a time, for TiledImageMap.
+For tiled EXR files, the tiles are the tiles of the file (at the highest
+resolution level).  For scanline files, the tiles are blocks of full-width
+rows, a multiple of the number of rows compressed together.
+
+The file is memory-mapped, so only the tiles read are decoded into memory.
+=====================================================================*/
+class EXRTiledImageSource final : public TiledImageSource
+{
+public:
+	// Throws glare::Exception or std::exception on failure.
+	EXRTiledImageSource(const std::string& path)
+	:	mapped_file(path),
+		in_stream(ArrayRef<uint8>((const uint8*)mapped_file.fileData(), mapped_file.fileSize()), path)
+	{
+		bool is_tiled = false;
+		if(!Imf::isOpenExrFile(in_stream, is_tiled))
+			throw ImFormatExcep("File is not an EXR file.");
+		in_stream.seekg(0);
+
+		if(is_tiled)
+			tiled_file.set(new Imf::TiledInputFile(in_stream));
+		else
+			scanline_file.set(new Imf::InputFile(in_stream));
+
+		const Imf::Header& header = is_tiled ? tiled_file->header() : scanline_file->header();
+
+		getChannelsToLoad(header.channels(), channel_names);
+
+		const Imf::PixelType pixel_type = header.channels().findChannel(channel_names[0])->type;
+		if(pixel_type != Imf::FLOAT && pixel_type != Imf::HALF)
+			throw ImFormatExcep("EXR pixel type must be HALF or FLOAT.");
+		bits_per_channel = (pixel_type == Imf::FLOAT) ? 32 : 16;
+
+		dw = header.dataWindow();
+		if(dw.min.x > dw.max.x || dw.min.y > dw.max.y)
+			throw ImFormatExcep("Invalid data window");
+		width  = (size_t)((int64)dw.max.x - (int64)dw.min.x + 1);
+		height = (size_t)((int64)dw.max.y - (int64)dw.min.y + 1);
+
+		// No limit on the total number of pixels, as with decodeFromBuffer(), since the image is never stored all at once.
+		if(width > 1000000)
+			throw glare::Exception("Width is too large: " + toString(width));
+		if(height > 1000000)
+			throw glare::Exception("Height is too large: " + toString(height));
+		if(channel_names.size() > 64)
+			throw glare::Exception("Num channels to load is too large: " + toString(channel_names.size()));
+
+		if(is_tiled)
+		{
+			tile_w = tiled_file->tileXSize();
+			tile_h = tiled_file->tileYSize();
+		}
+		else
+		{
+			tile_w = width;
+			tile_h = (size_t)myMax(16, Imf::numLinesInBuffer(header.compression()));
+		}
+	}
+
+	virtual size_t getWidth() const override { return width; }
+	virtual size_t getHeight() const override { return height; }
+	virtual size_t numChannels() const override { return channel_names.size(); }
+
+	virtual size_t tileWidth() const override { return tile_w; }
+	virtual size_t tileHeight() const override { return tile_h; }
+
+	virtual void readTile(size_t tile_x, size_t tile_y, ImageMapFloat& tile_out) override
+	{
+		try
+		{
+			const size_t N = channel_names.size();
+
+			// Get the coordinates of the top left pixel of the tile, in the data window coordinate space.
+			const int tile_min_x = dw.min.x + (int)(tile_x * tile_w);
+			const int tile_min_y = dw.min.y + (int)(tile_y * tile_h);
+
+			// Set up the frame buffer so that pixel (tile_min_x, tile_min_y) is at the start of tile_out.
+			const size_t x_stride = sizeof(float) * N;
+			const size_t y_stride = sizeof(float) * N * tile_out.getWidth();
+			float* channel_0_base = tile_out.getData() + (-(intptr_t)tile_min_x - (intptr_t)tile_min_y * (intptr_t)tile_out.getWidth()) * (intptr_t)N;
+
+			Imf::FrameBuffer frame_buffer;
+			for(size_t i=0; i<N; ++i)
+				frame_buffer.insert(channel_names[i], Imf::Slice(Imf::FLOAT, (char*)(channel_0_base + i), x_stride, y_stride)); // Halfs are converted to floats by OpenEXR.
+
+			if(tiled_file.ptr())
+			{
+				tiled_file->setFrameBuffer(frame_buffer);
+				tiled_file->readTile((int)tile_x, (int)tile_y);
+			}
+			else
+			{
+				scanline_file->setFrameBuffer(frame_buffer);
+				scanline_file->readPixels(tile_min_y, tile_min_y + (int)tile_out.getHeight() - 1);
+			}
+		}
+		catch(const std::exception& e)
+		{
+			throw glare::Exception("Error reading EXR tile: " + std::string(e.what()));
+		}
+	}
+
+	virtual bool isFloatingPoint() const override { return true; }
+	virtual double uncompressedBitsPerChannel() const override { return bits_per_channel; }
+	virtual float getGamma() const override { return 1.f; } // HDR images should have gamma 1.
+
+private:
+	MemMappedFile mapped_file;
+	EXRDecoderInputStream in_stream;
+	UniqueRef<Imf::TiledInputFile> tiled_file; // Non-null if the file is tiled.
+	UniqueRef<Imf::InputFile> scanline_file; // Non-null if the file is not tiled.
+	std::vector<std::string> channel_names;
+	Imath::Box2i dw;
+	size_t width, height, tile_w, tile_h;
+	double bits_per_channel;
+};
+
+
+Reference<TiledImageMap> EXRDecoder::openTiled(const std::string& path, size_t max_tile_cache_size_B)
+{
+	try
+	{
+		return new TiledImageMap(new EXRTiledImageSource(path), max_tile_cache_size_B);
+	}
+	catch(const glare::Exception& e)
+	{
+		throw ImFormatExcep("Error opening EXR file: " + e.what());
+	}
+	catch(const std::exception& e)
+	{
+		throw ImFormatExcep("Error opening EXR file: " + std::string(e.what()));
+	}
+}
+
+
 Imf::Compression EXRDecoder::EXRCompressionMethod(EXRDecoder::CompressionMethod m)
 {
 	switch(m)
@@ -560,16 +784,16 @@ void EXRDecoder::saveImageToEXR(const float* pixel_data, size_t width, size_t he
 		for(int c=0; c<num_channels_to_save; ++c)
 			header.channels().insert(channel_names[c], Imf::Channel(options.bit_depth == BitDepth_32 ? Imf::FLOAT : Imf::HALF));
 
-		Imf::OutputFile file(exr_ofstream, header);
 		Imf::FrameBuffer frameBuffer;
 
 		const size_t N = num_channels;
 
+		js::Vector<half, 64> half_data;
 		if(options.bit_depth == BitDepth_16)
 		{
 			// Convert our float data to halfs.
 			const size_t num_values = width * height * N;
-			js::Vector<half, 64> half_data(num_values);
+			half_data.resizeNoCopy(num_values);
 			const float* const src_float_data = pixel_data;
 			
 			for(size_t i=0; i<num_values; ++i)
@@ -584,9 +808,6 @@ void EXRDecoder::saveImageToEXR(const float* pixel_data, size_t width, size_t he
 						sizeof(half) * N * width)		// yStride
 				);
 			}
-
-			file.setFrameBuffer(frameBuffer);
-			file.writePixels((int)height);
 		}
 		else
 		{
@@ -601,7 +822,19 @@ void EXRDecoder::saveImageToEXR(const float* pixel_data, size_t width, size_t he
 						sizeof(float) * N * width)		// yStride
 				);
 			}
+		}
+
+		if(options.tile_size > 0)
+		{
+			header.setTileDescription(Imf::TileDescription(options.tile_size, options.tile_size, Imf::ONE_LEVEL));
 
+			Imf::TiledOutputFile file(exr_ofstream, header);
+			file.setFrameBuffer(frameBuffer);
+			file.writeTiles(0, file.numXTiles() - 1, 0, file.numYTiles() - 1);
+		}
+		else
+		{
+			Imf::OutputFile file(exr_ofstream, header);
 			file.setFrameBuffer(frameBuffer);
 			file.writePixels((int)height);
 		}
@@ -713,6 +946,98 @@ static void testSavingWithOptions(EXRDecoder::SaveOptions options, int i)
 				}
 		}
 
+		//================================= Test saving tiled and scanline EXRs and reading them with openTiled() =================================
+		for(int tiled=0; tiled<2; ++tiled)
+		{
+			// Use an image size that is not a multiple of the tile size, so there are partial tiles at the right and bottom.
+			const size_t tiled_W = 83;
+			const size_t tiled_H = 70;
+			ImageMapFloat image(tiled_W, tiled_H, 4);
+			for(size_t y=0; y<tiled_H; ++y)
+			for(size_t x=0; x<tiled_W; ++x)
+			{
+				image.getPixel(x, y)[0] = (float)x;
+				image.getPixel(x, y)[1] = (float)y * 0.1f;
+				image.getPixel(x, y)[2] = 0.3f;
+				image.getPixel(x, y)[3] = (float)((x + y) % 3);
+			}
+
+			EXRDecoder::SaveOptions tiled_options = options;
+			tiled_options.tile_size = tiled ? 32 : 0;
+
+			const std::string path = PlatformUtils::getTempDirPath() + "/exr_write_test_tiled" + toString(i) + "_" + toString(tiled) + ".exr";
+			EXRDecoder::saveImageToEXR(image, path, "main layer", tiled_options);
+
+			Reference<Map2D> decoded = EXRDecoder::decode(path);
+			Reference<TiledImageMap> tiled_map = EXRDecoder::openTiled(path, /*max tile cache size=*/32 * 32 * 4 * sizeof(float) * 4); // Small cache, so tiles get evicted.
+			testAssert(tiled_map->getMapWidth() == tiled_W && tiled_map->getMapHeight() == tiled_H && tiled_map->numChannels() == 4);
+			testAssert(tiled_map->getGamma() == 1.f);
+			if(tiled)
+				testAssert(tiled_map->numTileReads() == 0); // Tiles should only be read when needed.
+
+			ImageMapFloat region;
+			tiled_map->readRegion(0, 0, tiled_W, tiled_H, region);
+
+			const float tiled_allowable_diff = (options.bit_depth == EXRDecoder::BitDepth_16 || options.compression_method == EXRDecoder::CompressionMethod_DWAB) ? 5.0e-2f : 1.0e-4f;
+
+			for(size_t y=0; y<tiled_H; ++y)
+			for(size_t x=0; x<tiled_W; ++x)
+			{
+				for(int c=0; c<4; ++c)
+				{
+					const float a = region.getPixel(x, y)[c];
+					const float b = image.getPixel(x, y)[c];
+					if(!(epsEqual(a, b, tiled_allowable_diff) || Maths::approxEq(a, b, tiled_allowable_diff)))
+						failTest("pixel components were different: " + toString(a) + " vs " + toString(b));
+				}
+
+				// Check we get the same RGB values as decode().
+				const Colour4f decoded_col = decoded->pixelColour(x, y);
+				for(int c=0; c<3; ++c)
+					testAssert(region.getPixel(x, y)[c] == decoded_col[c]);
+			}
+		}
+
+		//================================= Test decoding at reduced resolution =================================
+		{
+			// Use a tall image so that the pixels are read in multiple strips, with a partial strip at the end.
+			const int tall_W = 9;
+			const int tall_H = 301;
+			Image image(tall_W, tall_H);
+			for(unsigned int y=0; y<image.getHeight(); ++y)
+			for(unsigned int x=0; x<image.getWidth(); ++x)
+				image.setPixel(x, y, Colour3f((float)x, (float)y * 0.1f, 0.3f));
+
+			const std::string path = PlatformUtils::getTempDirPath() + "/exr_write_test_reduced" + toString(i) + ".exr";
+
+			EXRDecoder::saveImageToEXR(image, path, "main layer", options);
+
+			Reference<Map2D> im = EXRDecoder::decode(path, /*mem allocator=*/NULL, /*target max dim=*/40); // 301 / 4 rounded up = 76, 301 / 8 rounded up = 38.
+			testAssert(im->getMapWidth() == 3);
+			testAssert(im->getMapHeight() == 76);
+			testAssert(im->numChannels() == 3);
+
+			const float reduced_allowable_diff = (options.bit_depth == EXRDecoder::BitDepth_16 || options.compression_method == EXRDecoder::CompressionMethod_DWAB) ? 5.0e-2f : 1.0e-4f;
+			for(size_t y=0; y<im->getMapHeight(); ++y)
+			for(size_t x=0; x<im->getMapWidth(); ++x)
+			{
+				// Compute box-filtered colour
+				Colour4f sum(0.f);
+				int count = 0;
+				for(size_t sy=y*4; sy<myMin<size_t>(tall_H, y*4 + 4); ++sy)
+				for(size_t sx=x*4; sx<myMin<size_t>(tall_W, x*4 + 4); ++sx)
+				{
+					sum += image.pixelColour(sx, sy);
+					count++;
+				}
+				const Colour4f a = im->pixelColour(x, y);
+				const Colour4f b = sum * (1.f / (float)count);
+				for(int c=0; c<3; ++c)
+					if(!(epsEqual(a[c], b[c], reduced_allowable_diff) || Maths::approxEq(a[c], b[c], reduced_allowable_diff)))
+						failTest("pixel components were different: " + toString(a[c]) + " vs " + toString(b[c]));
+			}
+		}
+
 		//================================= Test with Image4f saving, with save_alpha_channel = true =================================
 		{
 			Image4f image(W, H);
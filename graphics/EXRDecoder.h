@@ -14,6 +14,7 @@ File created by ClassTemplate on Fri Jul 11 02:36:44 2008
 class Map2D;
 class Image;
 class Image4f;
+class TiledImageMap;
 template <class T> class Reference;
 
 
@@ -35,9 +36,16 @@ public:
 
 
 	// throws ImFormatExcep
-	static Reference<Map2D> decode(const std::string& path, glare::Allocator* mem_allocator = NULL);
+	// If target_max_dim is non-zero, the image may be decoded at a reduced resolution, see ImFormatDecoder::ImageDecodingOptions.
+	// The pixels are then read in strips of rows, which are box-filtered down as they are read, so the full resolution image is never stored.
+	static Reference<Map2D> decode(const std::string& path, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
 
-	static Reference<Map2D> decodeFromBuffer(const void* data, size_t size, const std::string& path, glare::Allocator* mem_allocator = NULL);
+	static Reference<Map2D> decodeFromBuffer(const void* data, size_t size, const std::string& path, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
+
+	// Opens the EXR file for reading a tile at a time, for images too large to decode into memory.  Tiled EXR files are read a file tile at a time,
+	// scanline files a block of rows at a time.  At most max_tile_cache_size_B bytes of decoded tiles are kept in memory.
+	// Loads the same channels as decode(), with values as floats.  throws ImFormatExcep
+	static Reference<TiledImageMap> openTiled(const std::string& path, size_t max_tile_cache_size_B);
 
 
 	// Options for saving
@@ -63,11 +71,12 @@ public:
 
 	struct SaveOptions
 	{
-		SaveOptions() : compression_method(CompressionMethod_PIZ), bit_depth(BitDepth_32) {}
-		SaveOptions(CompressionMethod compression_method_, BitDepth bit_depth_) : compression_method(compression_method_), bit_depth(bit_depth_) {}
+		SaveOptions() : compression_method(CompressionMethod_PIZ), bit_depth(BitDepth_32), tile_size(0) {}
+		SaveOptions(CompressionMethod compression_method_, BitDepth bit_depth_) : compression_method(compression_method_), bit_depth(bit_depth_), tile_size(0) {}
 
 		CompressionMethod compression_method;
 		BitDepth bit_depth;
+		unsigned int tile_size; // If non-zero, the image is saved as a tiled EXR with tile_size x tile_size tiles, which can be read efficiently a tile at a time with openTiled().
 
 		std::vector<std::string> channel_names; // Can leave empty, used if non-empty.
 	};
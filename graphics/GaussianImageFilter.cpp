@@ -9,8 +9,10 @@ Generated at 2011-08-16 17:22:50 +0100
 
 #include "ImageMap.h"
 #include "image.h"
+#include "TiledImageMap.h"
 #include "../utils/TaskManager.h"
 #include "../utils/Task.h"
+#include <vector>
 
 
 /*
@@ -440,27 +442,27 @@ public:
 };
 
 
-void GaussianImageFilter::gaussianFilter(const ImageMapFloat& in, ImageMapFloat& out, float standard_deviation, glare::TaskManager& task_manager)
+// Returns the filter radius in pixels for an image with dimensions w and h.
+static int getPixelRadius(float standard_deviation, int w, int h)
 {
-	assert(in.getN() == 1 && out.getN() == 1);
-	assert(in.getHeight() == out.getHeight() && in.getWidth() == out.getWidth());
-
 	const double rad_needed = Maths::inverse1DGaussian(0.00001f, standard_deviation);
 
 	//const double z = Maths::eval1DGaussian(rad_needed, standard_deviation);
 
-	const int pixel_rad = myClamp<int>(
+	return myClamp<int>(
 		(int)rad_needed,
 		1, // lower bound
-		myMin((int)in.getWidth() - 1, (int)in.getHeight() - 1) // upper bound
+		myMin(w - 1, h - 1) // upper bound
 		);
-
-	//conPrint("gaussianFilter: using pixel radius of " + toString(pixel_rad));
+}
 
 
+// Builds the normalised 1-D filter weights, for offsets -pixel_rad to pixel_rad.
+static void buildFilterWeights(float standard_deviation, int pixel_rad, std::vector<float>& filter_weights)
+{
 	const int lookup_size = pixel_rad + pixel_rad + 1;
 	// Build filter lookup table
-	float* filter_weights = new float[lookup_size];
+	filter_weights.resize(lookup_size);
 	for(int x = 0; x < lookup_size; ++x)
 	{
 		const float dist = (float)x - (float)pixel_rad;
@@ -485,6 +487,20 @@ void GaussianImageFilter::gaussianFilter(const ImageMapFloat& in, ImageMapFloat&
 			sumweight += filter_weights[x]*filter_weights[y];
 
 	assert(::epsEqual(sumweight, 1.0f));
+}
+
+
+void GaussianImageFilter::gaussianFilter(const ImageMapFloat& in, ImageMapFloat& out, float standard_deviation, glare::TaskManager& task_manager)
+{
+	assert(in.getN() == 1 && out.getN() == 1);
+	assert(in.getHeight() == out.getHeight() && in.getWidth() == out.getWidth());
+
+	const int pixel_rad = getPixelRadius(standard_deviation, (int)in.getWidth(), (int)in.getHeight());
+
+	//conPrint("gaussianFilter: using pixel radius of " + toString(pixel_rad));
+
+	std::vector<float> filter_weights;
+	buildFilterWeights(standard_deviation, pixel_rad, filter_weights);
 
 	//------------------------------------------------------------------------
 	// Do separable blur
@@ -492,7 +508,7 @@ void GaussianImageFilter::gaussianFilter(const ImageMapFloat& in, ImageMapFloat&
 	ImageMapFloat temp(in.getWidth(), in.getHeight(), 1);
 
 	GaussianImageFilterTaskClosure closure(temp, in, out);
-	closure.filter_weights = filter_weights;
+	closure.filter_weights = filter_weights.data();
 	closure.pixel_rad = pixel_rad;
 
 	// Blur in x direction, reading from 'in' and writing to 'temp'.
@@ -501,8 +517,159 @@ void GaussianImageFilter::gaussianFilter(const ImageMapFloat& in, ImageMapFloat&
 
 	// Blur in y direction, reading from 'temp' and writing to 'out'.
 	task_manager.runParallelForTasks<YBlurTask, GaussianImageFilterTaskClosure>(closure, 0, h);
+}
 
-	delete[] filter_weights;
+
+//=================================================
+
+
+// For filtering a TiledImageMap.  The image is filtered in bands of rows, with the source rows needed by a band (the band rows plus pixel_rad rows above and below,
+// wrapping around the image vertically) read into band_in, blurred in x into band_temp, then blurred in y into the band rows of out.
+struct GaussianBandTaskClosure
+{
+	const float* band_in; // (num_out_rows + 2*pixel_rad) rows of w * N floats.
+	float* band_temp; // Same size as band_in.
+	ImageMapFloat* out;
+	const float* filter_weights;
+	int pixel_rad;
+	int w, N;
+	int out_y_begin; // First row of out in the band.
+};
+
+
+class BandXBlurTask : public glare::Task
+{
+public:
+	BandXBlurTask(const GaussianBandTaskClosure& closure_, size_t begin_, size_t end_) : closure(closure_), begin((int)begin_), end((int)end_) {}
+
+	virtual void run(size_t thread_index)
+	{
+		const int pixel_rad = closure.pixel_rad;
+		const int w = closure.w;
+		const int N = closure.N;
+		const float* const filter_weights = closure.filter_weights;
+
+		for(int row = begin; row < end; ++row)
+		{
+			const float* const in_row = closure.band_in + (size_t)row * w * N;
+			float* const temp_row = closure.band_temp + (size_t)row * w * N;
+
+			for(int dx = 0; dx < w; ++dx)
+			{
+				const int start_x = dx - pixel_rad;
+				const int end_x = dx + pixel_rad + 1;
+
+				for(int c = 0; c < N; ++c)
+				{
+					float sum = 0;
+
+					// Do input off left side of image: x < 0, so x is equal (mod w) to w + x
+					for(int x = start_x; x < 0; ++x)
+						sum += in_row[(w + x) * N + c] * filter_weights[x - start_x];
+
+					// Do 0 <= x < w
+					for(int x = myMax(0, start_x); x < myMin(w, end_x); ++x)
+						sum += in_row[x * N + c] * filter_weights[x - start_x];
+
+					// Do w < x, so x is equal (mod w) to x - w
+					for(int x = w; x < end_x; ++x)
+						sum += in_row[(x - w) * N + c] * filter_weights[x - start_x];
+
+					temp_row[dx * N + c] = sum;
+				}
+			}
+		}
+	}
+
+	const GaussianBandTaskClosure& closure;
+	int begin, end;
+};
+
+
+class BandYBlurTask : public glare::Task
+{
+public:
+	BandYBlurTask(const GaussianBandTaskClosure& closure_, size_t begin_, size_t end_) : closure(closure_), begin((int)begin_), end((int)end_) {}
+
+	virtual void run(size_t thread_index)
+	{
+		const int pixel_rad = closure.pixel_rad;
+		const int w = closure.w;
+		const int N = closure.N;
+		const float* const filter_weights = closure.filter_weights;
+		const size_t row_size = (size_t)w * N;
+
+		// Output row i of the band is centred on band row i + pixel_rad, so uses band rows i to i + 2*pixel_rad.
+		for(int i = begin; i < end; ++i)
+		{
+			float* const out_row = closure.out->getPixel(0, closure.out_y_begin + i);
+			for(size_t z = 0; z < row_size; ++z)
+			{
+				float sum = 0;
+				for(int k = 0; k <= 2*pixel_rad; ++k)
+					sum += closure.band_temp[(i + k) * row_size + z] * filter_weights[k];
+				out_row[z] = sum;
+			}
+		}
+	}
+
+	const GaussianBandTaskClosure& closure;
+	int begin, end;
+};
+
+
+void GaussianImageFilter::gaussianFilter(const TiledImageMap& in, ImageMapFloat& out, float standard_deviation, glare::TaskManager& task_manager)
+{
+	assert(in.getN() == out.getN());
+	assert(in.getHeight() == out.getHeight() && in.getWidth() == out.getWidth());
+
+	const int w = (int)in.getWidth();
+	const int h = (int)in.getHeight();
+	const int N = (int)in.getN();
+
+	const int pixel_rad = getPixelRadius(standard_deviation, w, h);
+
+	std::vector<float> filter_weights;
+	buildFilterWeights(standard_deviation, pixel_rad, filter_weights);
+
+	const int band_h = myMin(h, myMax(32, 2 * pixel_rad)); // Number of output rows per band.
+	const size_t row_size = (size_t)w * N;
+
+	std::vector<float> band_in((band_h + 2 * pixel_rad) * row_size);
+	std::vector<float> band_temp(band_in.size());
+
+	GaussianBandTaskClosure closure;
+	closure.band_in = band_in.data();
+	closure.band_temp = band_temp.data();
+	closure.out = &out;
+	closure.filter_weights = filter_weights.data();
+	closure.pixel_rad = pixel_rad;
+	closure.w = w;
+	closure.N = N;
+
+	for(int band_begin = 0; band_begin < h; band_begin += band_h)
+	{
+		const int num_out_rows = myMin(h, band_begin + band_h) - band_begin;
+		const int num_in_rows = num_out_rows + 2 * pixel_rad;
+
+		// Read source rows band_begin - pixel_rad to band_begin + num_out_rows + pixel_rad, wrapping around vertically.
+		// Read runs of rows that are contiguous in the source image with a single readRegion call.
+		for(int row = 0; row < num_in_rows; )
+		{
+			const int src_y = Maths::intMod(band_begin - pixel_rad + row, h);
+			const int run_len = myMin(num_in_rows - row, h - src_y);
+			in.readRegion(/*x=*/0, src_y, w, run_len, band_in.data() + row * row_size, /*out row stride=*/row_size);
+			row += run_len;
+		}
+
+		closure.out_y_begin = band_begin;
+
+		// Blur in x direction, reading from band_in and writing to band_temp.
+		task_manager.runParallelForTasks<BandXBlurTask, GaussianBandTaskClosure>(closure, 0, num_in_rows);
+
+		// Blur in y direction, reading from band_temp and writing to out.
+		task_manager.runParallelForTasks<BandYBlurTask, GaussianBandTaskClosure>(closure, 0, num_out_rows);
+	}
 }
 
 
@@ -517,10 +684,55 @@ void GaussianImageFilter::gaussianFilter(const ImageMapFloat& in, ImageMapFloat&
 #include "../utils/TestUtils.h"
 #include "../utils/StringUtils.h"
 #include "../utils/Timer.h"
+#include "../utils/ConPrint.h"
 
 
 void GaussianImageFilter::test()
 {
+	conPrint("GaussianImageFilter::test()");
+
+	// Test that filtering a TiledImageMap gives the same result as filtering the image in memory.
+	try
+	{
+		glare::TaskManager task_manager;
+
+		const size_t W = 83;
+		const size_t H = 150;
+		Reference<ImageMapFloat> image = new ImageMapFloat(W, H, 3);
+		for(size_t y=0; y<H; ++y)
+		for(size_t x=0; x<W; ++x)
+			for(size_t c=0; c<3; ++c)
+				image->getPixel(x, y)[c] = (float)(((x * 7 + y * 13 + c * 5) % 17) + c);
+
+		// Use a small cache, so that tiles get evicted and re-read.
+		TiledImageMap tiled(new ImageMapFloatTiledImageSource(image, /*tile w=*/32, /*tile h=*/16), /*max cache size=*/32 * 16 * 3 * sizeof(float) * 8);
+
+		const float std_devs[] = { 0.5f, 2.f, 5.f, 40.f };
+		for(size_t i=0; i<staticArrayNumElems(std_devs); ++i)
+		{
+			ImageMapFloat tiled_out(W, H, 3);
+			gaussianFilter(tiled, tiled_out, std_devs[i], task_manager);
+
+			for(size_t c=0; c<3; ++c)
+			{
+				ImageMapFloat channel(W, H, 1);
+				for(size_t z=0; z<W*H; ++z)
+					channel.getData()[z] = image->getData()[z * 3 + c];
+
+				ImageMapFloat ref_out(W, H, 1);
+				gaussianFilter(channel, ref_out, std_devs[i], task_manager);
+
+				for(size_t y=0; y<H; ++y)
+				for(size_t x=0; x<W; ++x)
+					testEpsEqual(ref_out.getPixel(x, y)[0], tiled_out.getPixel(x, y)[c]);
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
 	/*try
 	{
 		// Load JPEG, convert to Image
@@ -10,6 +10,7 @@ Generated at 2011-08-16 17:22:50 +0100
 class Image;
 namespace glare { class TaskManager; }
 class FloatComponentValueTraits;
+class TiledImageMap;
 template <class V, class VTraits> class ImageMap;
 
 
@@ -24,5 +25,11 @@ namespace GaussianImageFilter
 	//void gaussianFilter(const Image& in, Image& out, float standard_deviation, glare::TaskManager& task_manager);
 	void gaussianFilter(const ImageMap<float, FloatComponentValueTraits>& in, ImageMap<float, FloatComponentValueTraits>& out, float standard_deviation, glare::TaskManager& task_manager);
 
+	// Sets out to the image in, convolved by a gaussian filter, for any number of channels.  out must have the same dimensions and number of channels as in.
+	// Reads the source image a band of rows at a time, so the source is never decoded in full: apart from the tile cache, only a band of source rows of height 
+	// about 2*(filter radius) + 32 is stored.  out is a full-resolution image though, so this is only for images where the output fits in memory.
+	// Gives the same result as the ImageMap version above for single-channel images.  Throws glare::Exception if a tile could not be read.
+	void gaussianFilter(const TiledImageMap& in, ImageMap<float, FloatComponentValueTraits>& out, float standard_deviation, glare::TaskManager& task_manager);
+
 	void test();
 };
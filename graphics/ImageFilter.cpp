@@ -12,6 +12,7 @@ Code By Nicholas Chapman.
 #include "jpegdecoder.h"
 #include "EXRDecoder.h"
 #include "GaussianImageFilter.h"
+#include "TiledImageMap.h"
 #include "image.h"
 #include "Image4f.h"
 #include "bitmap.h"
@@ -349,6 +350,44 @@ struct ResizeImageMapFloatTaskClosure
 };
 
 
+// Returns the source image coordinate of output pixel coordinate x, when resizing an image of size in_dim to size out_dim.
+static inline float resizeSourceCoord(int x, float out_dim_2, float in_dim_2, float pixel_scale)
+{
+	const float destx = x - out_dim_2;
+	const float sxf = destx * pixel_scale;
+	return sxf + in_dim_2;
+}
+
+
+// Computes a pixel of the resized image, at source image coordinates (sx_p, sy_p), from the source pixels in [x_begin, x_end) x [y_begin, y_end).
+// src holds the source image region with top left at (src_offset_x, src_offset_y).
+template <int N>
+static inline void resizeImagePixel(const ImageMapFloat& src, int src_offset_x, int src_offset_y, float sx_p, float sy_p, int x_begin, int x_end, int y_begin, int y_end, 
+	const MitchellNetravali<float>& mn, float recip_scale, float norm_factor, float* pixel_out)
+{
+	float sum[N];
+	for(int n=0; n<N; ++n)
+		sum[n] = 0;
+
+	for(int sy=y_begin; sy<y_end; ++sy)
+	for(int sx=x_begin; sx<x_end; ++sx)
+	{
+		float dx = sx - sx_p; 
+		float dy = sy - sy_p;
+		float d2 = dx*dx + dy*dy;
+
+		float f = mn.eval(std::sqrt(d2) * recip_scale);
+
+		const float* src_pixel = src.getPixel(sx - src_offset_x, sy - src_offset_y);
+		for(int n=0; n<N; ++n)
+			sum[n] += src_pixel[n] * f;
+	}
+
+	for(int n=0; n<N; ++n)
+		pixel_out[n] = sum[n] * norm_factor;
+}
+
+
 template <int N>
 class ResizeImageMapFloatTask : public glare::Task
 {
@@ -381,20 +420,12 @@ public:
 		float in_w_2 = in_w * 0.5f;
 		float in_h_2 = in_h * 0.5f;
 
-		float sum[N];
-
 		for(int y = begin; y < end; y += stride)
 		{
 			for(int x=0; x<out_w; ++x)
 			{
-				float destx = x - out_w_2;
-				float desty = y - out_h_2;
-
-				float sxf = destx * pixel_scale;
-				float syf = desty * pixel_scale;
-
-				float sx_p = sxf + in_w_2;
-				float sy_p = syf + in_h_2;
+				float sx_p = resizeSourceCoord(x, out_w_2, in_w_2, pixel_scale);
+				float sy_p = resizeSourceCoord(y, out_h_2, in_h_2, pixel_scale);
 
 				// floor to integer pixel indices
 				int sx_pi = (int)std::floor(sx_p);
@@ -407,32 +438,7 @@ public:
 				int x_end = myMin(in_w, sx_pi + r + 1);
 				int y_end = myMin(in_h, sy_pi + r + 1);
 
-				for(int n=0; n<N; ++n)
-					sum[n] = 0;
-
-				//float f_sum = 0;
-				for(int sy=y_begin; sy<y_end; ++sy)
-				for(int sx=x_begin; sx<x_end; ++sx)
-				{
-					float dx = sx - sx_p; 
-					float dy = sy - sy_p;
-					float d2 = dx*dx + dy*dy;
-
-					//assert(fabs(dx) <= ceil(2 * scale));
-					//assert(fabs(dy) <= ceil(2 * scale));
-
-					//assert((int)(scaled_d2 * mn_table_factor) < 1024);
-					//int i = (int)(scaled_d2 * mn_table_factor);
-					//float f = i < MN_TABLE_SIZE ? mn_table[i] : 0;
-					float f = mn.eval(std::sqrt(d2) * recip_scale); //std::sqrt(scaled_d2));
-					//f_sum += f;
-
-					for(int n=0; n<N; ++n)
-						sum[n] += in.getPixel(sx, sy)[n] * f;
-				}
-
-				for(int n=0; n<N; ++n)
-					out.getPixel(x, y)[n] = sum[n] * norm_factor;
+				resizeImagePixel<N>(in, /*src offset x=*/0, /*src offset y=*/0, sx_p, sy_p, x_begin, x_end, y_begin, y_end, mn, recip_scale, norm_factor, out.getPixel(x, y));
 			}
 		}
 	}
@@ -442,56 +448,104 @@ public:
 };
 
 
-void ImageFilter::resizeImage(const ImageMapFloat& in, ImageMapFloat& out, float pixel_enlargement_factor, float mn_b, float mn_c, glare::TaskManager& task_manager)
+struct ResizeTiledImageMapTaskClosure
 {
-	assert(mn_b >= 0 && mn_b <= 1);
-	assert(mn_c >= 0 && mn_c <= 1);
+	const TiledImageMap* in;
+	ImageMapFloat* out;
+	float pixel_scale;
+	float recip_scale;
+	int r;
+	float mn_b, mn_c;
+	float norm_factor;
+};
 
-	assert(in.getN() == out.getN());
 
-	MitchellNetravali<float> mn(mn_b, mn_c);
+// Like ResizeImageMapFloatTask, but reads the source pixels from a TiledImageMap.
+// Each output row is done in spans of output pixels, with the source region needed by a span read from the tiled image first.
+template <int N>
+class ResizeTiledImageMapTask : public glare::Task
+{
+public:
+	ResizeTiledImageMapTask(const ResizeTiledImageMapTaskClosure& closure_, size_t begin_, size_t end_, size_t stride_) : closure(closure_), begin((int)begin_), end((int)end_), stride((int)stride_) {}
 
-	// Pixel enlargement scale is the 'zoom factor' of out.
+	virtual void run(size_t thread_index)
+	{
+		const TiledImageMap& in = *closure.in;
+		ImageMapFloat& out = *closure.out;
+		const float pixel_scale = closure.pixel_scale;
+		const float recip_scale = closure.recip_scale;
+		const int r = closure.r;
+		const float norm_factor = closure.norm_factor;
 
-	/*
-		Let the source image be f_s(u, v).
-		Let say we want to compute f_d(s, t) = f_s(s/A, t/A)
-		Let B = 1/A
-		f_d(s, t)
-		= f_s(s/A, t/A)
-		= f_s(s*B, t*B)
+		MitchellNetravali<float> mn(closure.mn_b, closure.mn_c);
 
-		We want to reconstruct f_s at the point (s*B, t*B)
+		const int out_w = (int)out.getWidth();
+		const int out_h = (int)out.getHeight();
+		const float out_w_2 = out_w * 0.5f;
+		const float out_h_2 = out_h * 0.5f;
 
-		Suppose we are reconstructing at pointx, and x_i = floor(x).
-		Assuming a support radius of 2.
-		Therefore the point x_1-2 is the largest point before the filter support, and the point x_1+3 is the smallest point above the filter support.
-		So we want to loop over the indices like so:
-		for(int x=x_i-1; x<x_1+3; ++x)
-		In general, with radius r:
-		for(int x=x_i - r + 1; x<x_1 + r + 1; ++x)
+		const int in_w = (int)in.getWidth();
+		const int in_h = (int)in.getHeight();
+		const float in_w_2 = in_w * 0.5f;
+		const float in_h_2 = in_h * 0.5f;
 
-		                         
-x_i-2      x_i-1       x_i       x_i+1      x_i+2       x_1+3
-  |----------|----------|----------|----------|----------|
-		                  ^
-						  x
-	*/
+		const int SPAN_W = 64; // Number of output pixels to compute per source region read.
 
-	float pixel_scale = 1.0f / pixel_enlargement_factor;
+		ImageMapFloat src_region;
+
+		for(int y = begin; y < end; y += stride)
+		{
+			const float sy_p = resizeSourceCoord(y, out_h_2, in_h_2, pixel_scale);
+			const int sy_pi = (int)std::floor(sy_p);
+			const int y_begin = myMax(0, sy_pi - r + 1);
+			const int y_end = myMin(in_h, sy_pi + r + 1);
+
+			for(int span_begin = 0; span_begin < out_w; span_begin += SPAN_W)
+			{
+				const int span_end = myMin(out_w, span_begin + SPAN_W);
+
+				// Source x coordinates increase with output x coordinates, so the source region for the span goes from the region begin of the first pixel to the region end of the last pixel.
+				const int region_x_begin = myMax(0,    (int)std::floor(resizeSourceCoord(span_begin,   out_w_2, in_w_2, pixel_scale)) - r + 1);
+				const int region_x_end   = myMin(in_w, (int)std::floor(resizeSourceCoord(span_end - 1, out_w_2, in_w_2, pixel_scale)) + r + 1);
+
+				if(region_x_begin < region_x_end && y_begin < y_end)
+					in.readRegion(region_x_begin, y_begin, region_x_end - region_x_begin, y_end - y_begin, src_region);
+
+				for(int x = span_begin; x < span_end; ++x)
+				{
+					const float sx_p = resizeSourceCoord(x, out_w_2, in_w_2, pixel_scale);
+					const int sx_pi = (int)std::floor(sx_p);
+					const int x_begin = myMax(0, sx_pi - r + 1);
+					const int x_end = myMin(in_w, sx_pi + r + 1);
+
+					resizeImagePixel<N>(src_region, region_x_begin, y_begin, sx_p, sy_p, x_begin, x_end, y_begin, y_end, mn, recip_scale, norm_factor, out.getPixel(x, y));
+				}
+			}
+		}
+	}
+
+	const ResizeTiledImageMapTaskClosure& closure;
+	int begin, end, stride;
+};
+
+
+// Computes the source pixel scale, reconstruction filter radius in source pixels (r), and filter normalisation factor for resizing an image with a Mitchell-Netravali filter.
+static void getResizeFilterParams(float pixel_enlargement_factor, const MitchellNetravali<float>& mn, float& pixel_scale_out, float& recip_scale_out, int& r_out, float& norm_factor_out)
+{
+	const float pixel_scale = 1.0f / pixel_enlargement_factor;
+	pixel_scale_out = pixel_scale;
 
 	// Scale is how much we enlarge the reconstruction filter on the source image.  We don't want the reconstruction filter less than the original size.
 	// On the other hand, when enlarging the image, we want to widen the filter to filter out high frequency detail.
 	float scale = myMax(1.0f, pixel_scale);
-	float recip_scale = 1.0f / scale;
+	const float recip_scale = 1.0f / scale;
+	recip_scale_out = recip_scale;
 
 	float filter_radius = 2 * scale;
-	int r = (int)std::ceil(filter_radius);
+	const int r = (int)std::ceil(filter_radius);
+	r_out = r;
 
 
-	
-	
-
 	// Table that maps distance squared to mn value for distance
 	// Entry at index MN_TABLE_SCALE corresponds to MN filter evaluated at d^2 of 1, entry at index MN_TABLE_SCALE*2 corresponds to MN evaled at d^2 of 2, etc..
 	// So last non-zero entry will by at MN_TABLE_SCALE*4, which corresponds to a d^2 of 4, or a distance of 2, which is where the MN function becomes zero.
@@ -509,7 +563,6 @@ x_i-2      x_i-1       x_i       x_i+1      x_i+2       x_1+3
 	}*/
 
 	// Get normalisation factor for filter
-	float norm_factor = 1;
 	{
 		int x_begin = 0 - r + 1;
 		int y_begin = 0 - r + 1;
@@ -533,8 +586,50 @@ x_i-2      x_i-1       x_i       x_i+1      x_i+2       x_1+3
 			f_sum += f;
 		}
 
-		norm_factor = 1 / f_sum;
+		norm_factor_out = 1 / f_sum;
 	}
+}
+
+
+void ImageFilter::resizeImage(const ImageMapFloat& in, ImageMapFloat& out, float pixel_enlargement_factor, float mn_b, float mn_c, glare::TaskManager& task_manager)
+{
+	assert(mn_b >= 0 && mn_b <= 1);
+	assert(mn_c >= 0 && mn_c <= 1);
+
+	assert(in.getN() == out.getN());
+
+	MitchellNetravali<float> mn(mn_b, mn_c);
+
+	// Pixel enlargement scale is the 'zoom factor' of out.
+
+	/*
+		Let the source image be f_s(u, v).
+		Let say we want to compute f_d(s, t) = f_s(s/A, t/A)
+		Let B = 1/A
+		f_d(s, t)
+		= f_s(s/A, t/A)
+		= f_s(s*B, t*B)
+
+		We want to reconstruct f_s at the point (s*B, t*B)
+
+		Suppose we are reconstructing at pointx, and x_i = floor(x).
+		Assuming a support radius of 2.
+		Therefore the point x_1-2 is the largest point before the filter support, and the point x_1+3 is the smallest point above the filter support.
+		So we want to loop over the indices like so:
+		for(int x=x_i-1; x<x_1+3; ++x)
+		In general, with radius r:
+		for(int x=x_i - r + 1; x<x_1 + r + 1; ++x)
+
+		                         
+x_i-2      x_i-1       x_i       x_i+1      x_i+2       x_1+3
+  |----------|----------|----------|----------|----------|
+		                  ^
+						  x
+	*/
+
+	float pixel_scale, recip_scale, norm_factor;
+	int r;
+	getResizeFilterParams(pixel_enlargement_factor, mn, pixel_scale, recip_scale, r, norm_factor);
 
 
 	ResizeImageMapFloatTaskClosure closure;
@@ -587,6 +682,43 @@ x_i-2      x_i-1       x_i       x_i+1      x_i+2       x_1+3
 }
 
 
+void ImageFilter::resizeImage(const TiledImageMap& in, ImageMapFloat& out, float pixel_enlargement_factor, float mn_b, float mn_c, glare::TaskManager& task_manager)
+{
+	assert(mn_b >= 0 && mn_b <= 1);
+	assert(mn_c >= 0 && mn_c <= 1);
+
+	assert(in.getN() == out.getN());
+
+	MitchellNetravali<float> mn(mn_b, mn_c);
+
+	float pixel_scale, recip_scale, norm_factor;
+	int r;
+	getResizeFilterParams(pixel_enlargement_factor, mn, pixel_scale, recip_scale, r, norm_factor);
+
+	ResizeTiledImageMapTaskClosure closure;
+	closure.in = &in;
+	closure.out = &out;
+	closure.pixel_scale = pixel_scale;
+	closure.recip_scale = recip_scale;
+	closure.r = r;
+	closure.mn_b = mn_b;
+	closure.mn_c = mn_c;
+	closure.norm_factor = norm_factor;
+
+	// Use interleaved rows, so that the threads work on nearby rows at the same time, and so read from the same tiles.
+	if(in.getN() == 1)
+		task_manager.runParallelForTasksInterleaved<ResizeTiledImageMapTask<1>, ResizeTiledImageMapTaskClosure>(closure, 0, out.getHeight());
+	else if(in.getN() == 2)
+		task_manager.runParallelForTasksInterleaved<ResizeTiledImageMapTask<2>, ResizeTiledImageMapTaskClosure>(closure, 0, out.getHeight());
+	else if(in.getN() == 3)
+		task_manager.runParallelForTasksInterleaved<ResizeTiledImageMapTask<3>, ResizeTiledImageMapTaskClosure>(closure, 0, out.getHeight());
+	else if(in.getN() == 4)
+		task_manager.runParallelForTasksInterleaved<ResizeTiledImageMapTask<4>, ResizeTiledImageMapTaskClosure>(closure, 0, out.getHeight());
+	else
+		throw glare::Exception("Invalid num channels for resizing: " + toString(in.getN()));
+}
+
+
 ///==================================================================================================================
 
 
@@ -2557,10 +2689,47 @@ static void plotImageProfileAlongScanline(const std::string& path, float y)
 }*/
 
 
+// Check that resizing from a TiledImageMap gives the same result as resizing the in-memory image.
+static void testResizeTiledImageMap()
+{
+	glare::TaskManager task_manager;
+
+	const size_t W = 97;
+	const size_t H = 61;
+	for(size_t N=1; N<=4; ++N)
+	{
+		Reference<ImageMapFloat> image = new ImageMapFloat(W, H, N);
+		PCG32 rng(1);
+		for(size_t i=0; i<image->numPixels() * N; ++i)
+			image->getData()[i] = rng.unitRandom();
+
+		// Use a small cache, so that tiles get evicted and re-read.
+		TiledImageMap tiled(new ImageMapFloatTiledImageSource(image, /*tile w=*/16, /*tile h=*/16), /*max cache size=*/16 * 16 * N * sizeof(float) * 10);
+
+		const float factors[] = { 0.13f, 0.5f, 1.f, 2.3f };
+		for(size_t i=0; i<staticArrayNumElems(factors); ++i)
+		{
+			const size_t out_w = myMax<size_t>(1, (size_t)(W * factors[i]));
+			const size_t out_h = myMax<size_t>(1, (size_t)(H * factors[i]));
+			ImageMapFloat ref_out(out_w, out_h, N);
+			ImageMapFloat tiled_out(out_w, out_h, N);
+
+			ImageFilter::resizeImage(*image, ref_out, factors[i], /*mn b=*/0.6f, /*mn c=*/0.2f, task_manager);
+			ImageFilter::resizeImage(tiled, tiled_out, factors[i], /*mn b=*/0.6f, /*mn c=*/0.2f, task_manager);
+
+			for(size_t z=0; z<ref_out.numPixels() * N; ++z)
+				testEpsEqual(ref_out.getData()[z], tiled_out.getData()[z]);
+		}
+	}
+}
+
+
 void ImageFilter::test()
 {
 	conPrint("ImageFilter::test()");
 
+	testResizeTiledImageMap();
+
 
 
 
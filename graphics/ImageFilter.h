@@ -17,6 +17,7 @@ Code By Nicholas Chapman.
 class Image;
 class Image4f;
 class FFTPlan;
+class TiledImageMap;
 namespace glare { class TaskManager; }
 
 
@@ -44,6 +45,10 @@ public:
 	// in and out must have the same number of components (N) and we require N >= 1 and N <= 4
 	static void resizeImage(const ImageMapFloat& in, ImageMapFloat& out, float pixel_enlargement_factor, float mn_b, float mn_c, glare::TaskManager& task_manager);
 
+	// As above, but reads the source pixels from a TiledImageMap as they are needed, so the full resolution source image is never stored in memory.
+	// Throws glare::Exception if a tile could not be read, or if N is not in [1, 4].
+	static void resizeImage(const TiledImageMap& in, ImageMapFloat& out, float pixel_enlargement_factor, float mn_b, float mn_c, glare::TaskManager& task_manager);
+
 	//adds the image in, convolved by a Chiu filter, to out.
 	//static void chiuFilter(const Image& in, Image& out, float standard_deviation, bool include_center);
 
@@ -77,12 +77,14 @@ void readFromStream(InStream& stream, ImageMap<V, VTraits>& image)
 
 #if MAP2D_FILTERING_SUPPORT
 
+// Resizes rows [begin_y, end_y) of the output image.
 template <class V, class VTraits>
-class ResizeMidQualityTask : public glare::Task
+struct ResizeMidQualityRowsFunc
 {
-public:
-	virtual void run(size_t thread_index)
+	void operator() (size_t begin_y_, size_t end_y_, size_t thread_index) const
 	{
+		const int begin_y = (int)begin_y_;
+		const int end_y   = (int)end_y_;
 		ImageMap<V, VTraits>* const image = this->image_out;
 		const ImageMap<V, VTraits>* const src_image = this->image_in;
 
@@ -304,7 +306,6 @@ public:
 		}
 	}
 
-	int begin_y, end_y;
 	const ImageMap<V, VTraits>* image_in;
 	ImageMap<V, VTraits>* image_out;
 };
@@ -321,34 +322,18 @@ Reference<Map2D> ImageMap<V, VTraits>::resizeMidQuality(const int new_width, con
 
 	new_image->channel_names = this->channel_names;
 
+	ResizeMidQualityRowsFunc<V, VTraits> func;
+	func.image_in = this;
+	func.image_out = new_image;
+
 	if(task_manager)
 	{
-		const int num_tasks = myMin<int>((int)task_manager->getConcurrency(), myMax(1, new_height)); // We want at least one task, but no more than the number of rows in the new image.
-
-		glare::TaskGroupRef group = new glare::TaskGroup();
-		group->tasks.resize(num_tasks);
-
-		const int y_step = Maths::roundedUpDivide(new_height, num_tasks);
-		for(int z=0, begin_y=0; z<num_tasks; ++z, begin_y += y_step)
-		{
-			Reference<ResizeMidQualityTask<V, VTraits> > task = new ResizeMidQualityTask<V, VTraits>();
-			task->begin_y = myMin(begin_y,          new_height);
-			task->end_y   = myMin(begin_y + y_step, new_height);
-			task->image_in = this;
-			task->image_out = new_image;
-			group->tasks[z] = task;
-		}
-
-		task_manager->runTaskGroup(group);
+		// Use dynamic load balancing over rows, so threads that finish early (or start late) keep taking rows.
+		task_manager->runParallelForDynamic(func, 0, (size_t)myMax(0, new_height));
 	}
 	else
 	{
-		ResizeMidQualityTask<V, VTraits> task;
-		task.begin_y = 0;
-		task.end_y   = new_height;
-		task.image_in = this;
-		task.image_out = new_image;
-		task.run(0);
+		func(0, (size_t)myMax(0, new_height), /*thread_index=*/0);
 	}
 
 	return Reference<ImageMap<V, VTraits> >(new_image);
@@ -0,0 +1,153 @@
+/*=====================================================================
+ImageRowDownsampler.h
+---------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "ImageMap.h"
+#include "../utils/AllocatorVector.h"
+
+
+/*=====================================================================
+ImageRowDownsampler
+-------------------
+Box-filters an image down by a factor of 2^num_halvings in each dimension,
+with the rows of the full resolution image supplied one at a time, as a
+decoder produces them.  This means the full resolution image never has to
+be stored, only a single row of sums.
+
+Each destination pixel is the average of the source pixels in its box.
+Boxes at the right and bottom edges may be partially outside the source
+image, in which case they are averaged over the source pixels they cover.
+
+Accum is the type the sums are accumulated in, e.g. uint64 for integer
+images, and float for half and float images.
+=====================================================================*/
+template <class V, class VTraits, class Accum>
+class ImageRowDownsampler
+{
+public:
+	// dest_image should have width ceil(src_W / 2^num_halvings), height ceil(src_H / 2^num_halvings), and the same number of channels as the source rows.
+	ImageRowDownsampler(ImageMap<V, VTraits>& dest_image, size_t src_W, size_t src_H, int num_halvings, glare::Allocator* mem_allocator);
+
+	// Adds the next source row.  src_row has src_W pixels, with dest_image.getN() channels each, tightly packed.
+	void addRow(const V* src_row);
+
+	static void test();
+
+private:
+	ImageMap<V, VTraits>& dest_image;
+	size_t src_W, src_H, N;
+	int num_halvings;
+	size_t src_y; // Number of rows added so far.
+	glare::AllocatorVector<Accum, 16> row_sums;
+};
+
+
+inline uint64 imageRowDownsamplerAverage(uint64 sum, size_t count) { return (sum + count / 2) / count; } // Round to nearest.
+inline float imageRowDownsamplerAverage(float sum, size_t count) { return sum / (float)count; }
+
+
+template <class V, class VTraits, class Accum>
+ImageRowDownsampler<V, VTraits, Accum>::ImageRowDownsampler(ImageMap<V, VTraits>& dest_image_, size_t src_W_, size_t src_H_, int num_halvings_, glare::Allocator* mem_allocator)
+:	dest_image(dest_image_),
+	src_W(src_W_),
+	src_H(src_H_),
+	N(dest_image_.getN()),
+	num_halvings(num_halvings_),
+	src_y(0),
+	row_sums(mem_allocator)
+{
+	assert(dest_image.getWidth()  == ((src_W + ((size_t)1 << num_halvings) - 1) >> num_halvings));
+	assert(dest_image.getHeight() == ((src_H + ((size_t)1 << num_halvings) - 1) >> num_halvings));
+
+	row_sums.resize(dest_image.getWidth() * N, Accum(0));
+}
+
+
+template <class V, class VTraits, class Accum>
+void ImageRowDownsampler<V, VTraits, Accum>::addRow(const V* src_row)
+{
+	assert(src_y < src_H);
+
+	Accum* const sums = row_sums.data();
+	for(size_t x=0; x<src_W; ++x)
+	{
+		Accum* const pixel_sums = sums + (x >> num_halvings) * N;
+		for(size_t c=0; c<N; ++c)
+			pixel_sums[c] += (Accum)src_row[x * N + c];
+	}
+
+	src_y++;
+
+	const size_t factor = (size_t)1 << num_halvings;
+	if((src_y % factor) == 0 || src_y == src_H) // If we have finished a row of boxes:
+	{
+		const size_t dest_y = (src_y - 1) >> num_halvings;
+		const size_t box_h = src_y - (dest_y << num_halvings);
+		const size_t dest_W = dest_image.getWidth();
+
+		V* const dest_row = dest_image.getPixel(0, dest_y);
+		for(size_t dx=0; dx<dest_W; ++dx)
+		{
+			const size_t box_x_begin = dx << num_halvings;
+			const size_t box_w = myMin(src_W, box_x_begin + factor) - box_x_begin;
+			const size_t count = box_w * box_h;
+			for(size_t c=0; c<N; ++c)
+				dest_row[dx * N + c] = (V)imageRowDownsamplerAverage(sums[dx * N + c], count);
+		}
+
+		for(size_t i=0; i<row_sums.size(); ++i)
+			sums[i] = Accum(0);
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include "../utils/TestUtils.h"
+
+
+template <class V, class VTraits, class Accum>
+void ImageRowDownsampler<V, VTraits, Accum>::test()
+{
+	// Test against a direct box filter, for various sizes, including sizes that are not multiples of the box size.
+	for(int num_halvings=0; num_halvings<4; ++num_halvings)
+	for(size_t src_W=1; src_W<20; src_W += 3)
+	for(size_t src_H=1; src_H<20; src_H += 5)
+	{
+		const size_t N = 3;
+		const size_t factor = (size_t)1 << num_halvings;
+		std::vector<V> src(src_W * src_H * N);
+		for(size_t i=0; i<src.size(); ++i)
+			src[i] = (V)((i * 37) % 200);
+
+		const size_t dest_W = (src_W + factor - 1) / factor;
+		const size_t dest_H = (src_H + factor - 1) / factor;
+		ImageMap<V, VTraits> dest(dest_W, dest_H, N);
+		ImageRowDownsampler<V, VTraits, Accum> downsampler(dest, src_W, src_H, num_halvings, /*mem allocator=*/NULL);
+		for(size_t y=0; y<src_H; ++y)
+			downsampler.addRow(&src[y * src_W * N]);
+
+		for(size_t dy=0; dy<dest_H; ++dy)
+		for(size_t dx=0; dx<dest_W; ++dx)
+		for(size_t c=0; c<N; ++c)
+		{
+			double sum = 0;
+			size_t count = 0;
+			for(size_t y=dy*factor; y<myMin(src_H, (dy + 1)*factor); ++y)
+			for(size_t x=dx*factor; x<myMin(src_W, (dx + 1)*factor); ++x)
+			{
+				sum += (double)src[(y * src_W + x) * N + c];
+				count++;
+			}
+			testAssert(std::fabs((double)dest.getPixel(dx, dy)[c] - sum / count) <= 0.5001);
+		}
+	}
+}
+
+
+#endif // BUILD_TESTS
@@ -58,12 +58,12 @@ static uint8 ktx2_file_id[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB
 
 
 // throws ImFormatExcep on failure
-Reference<Map2D> KTXDecoder::decode(const std::string& path, glare::Allocator* mem_allocator)
+Reference<Map2D> KTXDecoder::decode(const std::string& path, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	try
 	{
 		MemMappedFile file(path);
-		return decodeFromBuffer(file.fileData(), file.fileSize(), mem_allocator);
+		return decodeFromBuffer(file.fileData(), file.fileSize(), mem_allocator, target_max_dim);
 	}
 	catch(glare::Exception& e)
 	{
@@ -72,7 +72,7 @@ Reference<Map2D> KTXDecoder::decode(const std::string& path, glare::Allocator* m
 }
 
 
-Reference<Map2D> KTXDecoder::decodeFromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator)
+Reference<Map2D> KTXDecoder::decodeFromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	try
 	{
@@ -158,20 +158,24 @@ Reference<Map2D> KTXDecoder::decodeFromBuffer(const void* data, size_t size, gla
 		else
 			throw glare::Exception("unhandled glInternalFormat: " + toString(glInternalFormat));
 
-		CompressedImageRef image = new CompressedImage(pixelWidth, pixelHeight, format);
+		// Skip the largest mip levels if we only need a lower resolution image.
+		const uint32 num_skipped_levels = (uint32)ImFormatDecoder::numMipLevelsToSkipForTargetDim(pixelWidth, pixelHeight, use_num_mipmap_levels, target_max_dim);
+		const uint32 num_loaded_levels = use_num_mipmap_levels - num_skipped_levels;
+
+		CompressedImageRef image = new CompressedImage(myMax(1u, pixelWidth >> num_skipped_levels), myMax(1u, pixelHeight >> num_skipped_levels), format);
 		image->setAllocator(mem_allocator);
-		image->texture_data->level_offsets.resize(use_num_mipmap_levels);
+		image->texture_data->level_offsets.resize(num_loaded_levels);
 
 
 		// Compute level offsets and total data size.
 		size_t offset = 0;
-		for(uint32 lvl = 0; lvl < use_num_mipmap_levels; ++lvl)
+		for(uint32 lvl = num_skipped_levels; lvl < use_num_mipmap_levels; ++lvl)
 		{
 			const size_t expected_blocks = TextureData::computeNum4PixelBlocksForLevel(pixelWidth, pixelHeight, lvl);
 			const size_t expected_level_size = expected_blocks * bytesPerBlock(image->texture_data->format);
 
-			image->texture_data->level_offsets[lvl].offset = offset;
-			image->texture_data->level_offsets[lvl].level_size = expected_level_size;
+			image->texture_data->level_offsets[lvl - num_skipped_levels].offset = offset;
+			image->texture_data->level_offsets[lvl - num_skipped_levels].level_size = expected_level_size;
 
 			offset += expected_level_size;
 		}
@@ -187,13 +191,23 @@ Reference<Map2D> KTXDecoder::decodeFromBuffer(const void* data, size_t size, gla
 		{
 			const uint32 image_size = readUInt32(file, swap_endianness);
 
-			if(image_size != image->texture_data->level_offsets[lvl].level_size)
-				throw glare::Exception("Unexpected mip image size.");
-
 			if(!file.canReadNBytes((size_t)image_size))
 				throw glare::Exception("MIP image size is too large");
 
-			file.readDataChecked(/*dest buf=*/data_ref, /*dest offset=*/image->texture_data->level_offsets[lvl].offset, image_size);
+			if(lvl < num_skipped_levels)
+			{
+				if(image_size != TextureData::computeNum4PixelBlocksForLevel(pixelWidth, pixelHeight, lvl) * bytesPerBlock(image->texture_data->format))
+					throw glare::Exception("Unexpected mip image size.");
+
+				file.advanceReadIndex(image_size);
+			}
+			else
+			{
+				if(image_size != image->texture_data->level_offsets[lvl - num_skipped_levels].level_size)
+					throw glare::Exception("Unexpected mip image size.");
+
+				file.readDataChecked(/*dest buf=*/data_ref, /*dest offset=*/image->texture_data->level_offsets[lvl - num_skipped_levels].offset, image_size);
+			}
 
 			// Skip mipPadding
 			file.setReadIndex(Maths::roundUpToMultipleOfPowerOf2(file.getReadIndex(), (size_t)4));
@@ -209,12 +223,12 @@ Reference<Map2D> KTXDecoder::decodeFromBuffer(const void* data, size_t size, gla
 
 
 // See http://github.khronos.org/KTX-Specification/
-Reference<Map2D> KTXDecoder::decodeKTX2(const std::string& path, glare::Allocator* mem_allocator)
+Reference<Map2D> KTXDecoder::decodeKTX2(const std::string& path, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	try
 	{
 		MemMappedFile file(path);
-		return decodeKTX2FromBuffer(file.fileData(), file.fileSize(), mem_allocator);
+		return decodeKTX2FromBuffer(file.fileData(), file.fileSize(), mem_allocator, target_max_dim);
 	}
 	catch(glare::Exception& e)
 	{
@@ -223,7 +237,7 @@ Reference<Map2D> KTXDecoder::decodeKTX2(const std::string& path, glare::Allocato
 }
 
 
-Reference<Map2D> KTXDecoder::decodeKTX2FromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator)
+Reference<Map2D> KTXDecoder::decodeKTX2FromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	try
 	{
@@ -303,15 +317,30 @@ Reference<Map2D> KTXDecoder::decodeKTX2FromBuffer(const void* data, size_t size,
 		{
 			format = OpenGLTextureFormat::Format_Compressed_DXT_SRGBA_Uint8;
 		}
+		else if(vkFormat == VK_FORMAT_BC4_UNORM_BLOCK)
+		{
+			format = OpenGLTextureFormat::Format_Compressed_BC4_Uint8;
+		}
+		else if(vkFormat == VK_FORMAT_BC5_UNORM_BLOCK)
+		{
+			format = OpenGLTextureFormat::Format_Compressed_BC5_Uint8;
+		}
+		else if(vkFormat == VK_FORMAT_BC7_UNORM_BLOCK || vkFormat == VK_FORMAT_BC7_SRGB_BLOCK)
+		{
+			format = OpenGLTextureFormat::Format_Compressed_BC7_SRGBA_Uint8;
+		}
 		else
 			throw glare::Exception("Unhandled vkFormat " + toString(vkFormat) + ".");
 
-		CompressedImageRef image = new CompressedImage(pixelWidth, pixelHeight, format);
+		// Skip the largest mip levels if we only need a lower resolution image.  Since each level is stored (and supercompressed) separately, we don't need to read the skipped levels at all.
+		const size_t num_skipped_levels = (size_t)ImFormatDecoder::numMipLevelsToSkipForTargetDim(pixelWidth, pixelHeight, use_num_mipmap_levels, target_max_dim);
+
+		CompressedImageRef image = new CompressedImage(myMax(1u, pixelWidth >> num_skipped_levels), myMax(1u, pixelHeight >> num_skipped_levels), format);
 		image->setAllocator(mem_allocator);
 
 		// Build level_offsets
 		size_t offset = 0;
-		for(size_t i=0; i<use_num_mipmap_levels; ++i)
+		for(size_t i=num_skipped_levels; i<use_num_mipmap_levels; ++i)
 		{
 			const uint64 use_level_size = level_data[i].uncompressedByteLength;
 
@@ -335,14 +364,14 @@ Reference<Map2D> KTXDecoder::decodeKTX2FromBuffer(const void* data, size_t size,
 		MutableArrayRef<uint8> data_ref(image->texture_data->mipmap_data.data(), image->texture_data->mipmap_data.size());
 
 		// Read mip levels in reverse order, since lowest level mipmap (smallest) should be first in file.
-		for(int lvl = (int)use_num_mipmap_levels - 1; lvl >= 0; --lvl)
+		for(int lvl = (int)use_num_mipmap_levels - 1; lvl >= (int)num_skipped_levels; --lvl)
 		{
 			file.setReadIndex(level_data[lvl].byteOffset); // TODO: check this has a reasonable value - past header etc.
 
 			if(level_data[lvl].uncompressedByteLength > 100000000) // Fail on excessively large files.
 				throw glare::Exception("uncompressedByteLength is too large: " + toString(level_data[lvl].uncompressedByteLength));
 
-			const size_t dest_offset = image->texture_data->level_offsets[lvl].offset;
+			const size_t dest_offset = image->texture_data->level_offsets[lvl - num_skipped_levels].offset;
 
 			if(supercompressionScheme == 0) // If no compression:
 			{
@@ -469,7 +498,17 @@ void KTXDecoder::supercompressKTX2File(const std::string& path_in, const std::st
 
 void KTXDecoder::writeKTX2File(Format format, bool supercompression, int w, int h, const std::vector<std::vector<uint8> >& level_image_data, const std::string& path_out)
 {
+	std::vector<ArrayRef<uint8> > level_refs;
+	for(size_t i=0; i<level_image_data.size(); ++i)
+		level_refs.push_back(ArrayRef<uint8>(level_image_data[i].data(), level_image_data[i].size()));
+
 	FileOutStream file(path_out);
+	writeKTX2(format, supercompression, w, h, level_refs, file);
+}
+
+
+void KTXDecoder::writeKTX2(Format format, bool supercompression, int w, int h, const std::vector<ArrayRef<uint8> >& level_image_data, OutStream& file)
+{
 	file.writeData(ktx2_file_id, 12);
 
 	uint32 vk_format;
@@ -479,6 +518,9 @@ void KTXDecoder::writeKTX2File(Format format, bool supercompression, int w, int
 		case Format_BC1:        vk_format = VK_FORMAT_BC1_RGB_UNORM_BLOCK; break;
 		case Format_BC3:        vk_format = VK_FORMAT_BC3_UNORM_BLOCK;     break;
 		case Format_BC6H:       vk_format = VK_FORMAT_BC6H_UFLOAT_BLOCK;   break;
+		case Format_BC4:        vk_format = VK_FORMAT_BC4_UNORM_BLOCK;     break;
+		case Format_BC5:        vk_format = VK_FORMAT_BC5_UNORM_BLOCK;     break;
+		case Format_BC7:        vk_format = VK_FORMAT_BC7_UNORM_BLOCK;     break;
 		default: throw glare::Exception("Invalid format");
 	}
 
@@ -512,14 +554,14 @@ void KTXDecoder::writeKTX2File(Format format, bool supercompression, int w, int
 
 	std::vector<LevelData> level_data(level_image_data.size());
 
-	const size_t mip_level_byte_start = file.getWriteIndex() + level_data.size() * sizeof(LevelData);
+	const size_t mip_level_byte_start = 80 + level_data.size() * sizeof(LevelData);
 	size_t level_byte_write_i = mip_level_byte_start;
 
 	js::Vector<uint8, 16> compressed_data;
 
 	for(int i=(int)level_image_data.size() - 1; i>=0; --i) // "Mip levels in the array are ordered from the level with the smallest size images, levelp to that with the largest size images, levelbase"
 	{
-		const std::vector<uint8>& level_i_data = level_image_data[i];
+		const ArrayRef<uint8> level_i_data = level_image_data[i];
 
 		if(supercompression)
 		{
@@ -915,8 +957,72 @@ void KTXDecoder::test()
 		testAssert(im.isType<CompressedImage>());
 		testAssert(im.downcastToPtr<CompressedImage>()->texture_data->format == OpenGLTextureFormat::Format_Compressed_BC6H);
 		testAssert(im.downcastToPtr<CompressedImage>()->texture_data->numMipLevels() == 10); // 512, 256, 128, 64, 32, 16, 8, 4, 2, 1 = 10 levels
+
+		// Test skipping the largest mip levels
+		im = KTXDecoder::decodeKTX2(TestUtils::getTestReposDir() + "/testfiles/ktx/lightmap_BC6H_with_mipmaps.KTX2", /*mem allocator=*/NULL, /*target max dim=*/100);
+		testAssert(im->getMapWidth() == 128);
+		testAssert(im->getMapHeight() == 128);
+		testAssert(im.downcastToPtr<CompressedImage>()->texture_data->numMipLevels() == 8); // 128, 64, 32, 16, 8, 4, 2, 1 = 8 levels
+		testAssert(im.downcastToPtr<CompressedImage>()->texture_data->frame_size_B == im.downcastToPtr<CompressedImage>()->texture_data->mipmap_data.size());
 		
-		
+		//---------------------------------- Test writing and reading back BC4, BC5 and BC7 KTX2 files -------------------------------------------
+		{
+			const Format formats[] = { Format_BC4, Format_BC5, Format_BC7 };
+			const DXTCompression::BlockFormat block_formats[] = { DXTCompression::BlockFormat_BC4, DXTCompression::BlockFormat_BC5, DXTCompression::BlockFormat_BC7 };
+			const OpenGLTextureFormat expected_formats[] = { OpenGLTextureFormat::Format_Compressed_BC4_Uint8, OpenGLTextureFormat::Format_Compressed_BC5_Uint8, OpenGLTextureFormat::Format_Compressed_BC7_SRGBA_Uint8 };
+			for(int f=0; f<3; ++f)
+			{
+				const int W = 16;
+				std::vector<uint8> rgba(W * W * 4);
+				for(size_t i=0; i<rgba.size(); ++i)
+					rgba[i] = (uint8)(i * 7);
+
+				std::vector<std::vector<uint8> > level_image_data;
+				for(int level_W=W; level_W >= 1; level_W /= 2)
+				{
+					level_image_data.push_back(std::vector<uint8>(DXTCompression::getCompressedSizeBytes(level_W, level_W, block_formats[f])));
+					DXTCompression::TempData temp_data;
+					DXTCompression::compress(/*task_manager=*/NULL, temp_data, DXTCompression::CompressOptions(block_formats[f], DXTCompression::Quality_Fast), level_W, level_W, /*bytes pp=*/4, rgba.data(), 
+						level_image_data.back().data(), level_image_data.back().size());
+				}
+
+				for(int supercompression=0; supercompression<2; ++supercompression)
+				{
+					const std::string path = PlatformUtils::getTempDirPath() + "/ktx_write_test.ktx2";
+					writeKTX2File(formats[f], supercompression != 0, W, W, level_image_data, path);
+
+					im = KTXDecoder::decodeKTX2(path);
+					testAssert(im->getMapWidth() == W && im->getMapHeight() == W);
+					testAssert(im.isType<CompressedImage>());
+					const TextureData* texture_data = im.downcastToPtr<CompressedImage>()->texture_data.ptr();
+					testAssert(texture_data->format == expected_formats[f]);
+					testAssert(texture_data->numMipLevels() == level_image_data.size());
+					for(size_t k=0; k<level_image_data.size(); ++k)
+					{
+						testAssert(texture_data->level_offsets[k].level_size == level_image_data[k].size());
+						testAssert(std::memcmp(&texture_data->mipmap_data[texture_data->level_offsets[k].offset], level_image_data[k].data(), level_image_data[k].size()) == 0);
+					}
+
+					// Test decoding with the two largest mip levels skipped.
+					im = KTXDecoder::decodeKTX2(path, /*mem allocator=*/NULL, /*target max dim=*/4);
+					testAssert(im->getMapWidth() == 4 && im->getMapHeight() == 4);
+					texture_data = im.downcastToPtr<CompressedImage>()->texture_data.ptr();
+					testAssert(texture_data->numMipLevels() == level_image_data.size() - 2);
+					testAssert(texture_data->frame_size_B == texture_data->mipmap_data.size());
+					for(size_t k=0; k<texture_data->numMipLevels(); ++k)
+					{
+						testAssert(texture_data->level_offsets[k].level_size == level_image_data[k + 2].size());
+						testAssert(std::memcmp(&texture_data->mipmap_data[texture_data->level_offsets[k].offset], level_image_data[k + 2].data(), level_image_data[k + 2].size()) == 0);
+					}
+
+					// A target larger than the image should give the full image.
+					im = KTXDecoder::decodeKTX2(path, /*mem allocator=*/NULL, /*target max dim=*/1000);
+					testAssert(im->getMapWidth() == W && im->getMapHeight() == W);
+					testAssert(im.downcastToPtr<CompressedImage>()->texture_data->numMipLevels() == level_image_data.size());
+				}
+			}
+		}
+
 
 		//---------------------------------- Test supercompressKTX2File -------------------------------------------
 		if(0)
@@ -9,8 +9,10 @@ Copyright Glare Technologies Limited 2023 -
 #include "../utils/Reference.h"
 #include "../utils/ArrayRef.h"
 #include <string>
+#include <vector>
 namespace glare { class Allocator; }
 class Map2D;
+class OutStream;
 
 
 /*=====================================================================
@@ -26,13 +28,15 @@ class KTXDecoder
 {
 public:
 	// throws ImFormatExcep on failure
-	static Reference<Map2D> decode(const std::string& path, glare::Allocator* mem_allocator = NULL);
+	// If target_max_dim is non-zero, the largest mip levels are skipped, as long as the largest remaining level has max(width, height) >= target_max_dim.  
+	// The returned image then has the dimensions of the largest remaining level.  See ImFormatDecoder::ImageDecodingOptions.
+	static Reference<Map2D> decode(const std::string& path, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
 
-	static Reference<Map2D> decodeFromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator = NULL);
+	static Reference<Map2D> decodeFromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
 
-	static Reference<Map2D> decodeKTX2(const std::string& path, glare::Allocator* mem_allocator = NULL);
+	static Reference<Map2D> decodeKTX2(const std::string& path, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
 
-	static Reference<Map2D> decodeKTX2FromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator = NULL);
+	static Reference<Map2D> decodeKTX2FromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
 
 
 
@@ -44,11 +48,17 @@ public:
 		//Format_SRGB_Uint8,
 		Format_BC1, // Aka DXT1 (DXT without alpha)
 		Format_BC3, // Aka DXT5 (DXT with alpha)
-		Format_BC6H
+		Format_BC6H,
+		Format_BC4, // Single channel
+		Format_BC5, // Two channels
+		Format_BC7
 	};
 
 	static void writeKTX2File(Format format, bool supercompression, int w, int h, const std::vector<std::vector<uint8> >& level_image_data, const std::string& path_out);
 
+	// Writes a KTX2 file to an output stream, e.g. a BufferOutStream.  level_image_data[i] is the data for mip level i.
+	static void writeKTX2(Format format, bool supercompression, int w, int h, const std::vector<ArrayRef<uint8> >& level_image_data, OutStream& out_stream);
+
 
 	static void test();
 };
@@ -9,6 +9,7 @@ Copyright Glare Technologies Limited 2022 -
 #include "bitmap.h"
 #include "imformatdecoder.h"
 #include "ImageMap.h"
+#include "ImageRowDownsampler.h"
 #include "../utils/ConPrint.h"
 #include "../utils/StringUtils.h"
 #include "../utils/FileUtils.h"
@@ -113,12 +114,12 @@ static void pngdecoder_read_data(png_structp png_ptr, png_bytep data, png_size_t
 #endif // LIBPNG_SUPPORT
 
 
-Reference<Map2D> PNGDecoder::decode(const std::string& path, glare::Allocator* mem_allocator)
+Reference<Map2D> PNGDecoder::decode(const std::string& path, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	try
 	{
 		MemMappedFile file(path);
-		return decodeFromBuffer(file.fileData(), file.fileSize(), mem_allocator);
+		return decodeFromBuffer(file.fileData(), file.fileSize(), mem_allocator, target_max_dim);
 	}
 	catch(glare::Exception& e)
 	{
@@ -175,7 +176,22 @@ For example it will load a 3x16 bit rgb color PNG file as a 4x16 bit format.
 As such we won't make it the default way to load PNGs for now, but will continue to use LibPNG as the default.  
 Define WUFFS_SUPPORT to make Wuffs the default way to load PNGs.
 */
-static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferWithWuffs(BufferViewInStream& buffer_view_in_stream, glare::Allocator* mem_allocator)
+// Returns image box-filtered down by a factor of 2^num_halvings in each dimension.
+template <class V, class VTraits>
+static Reference<ImageMap<V, VTraits> > downsampleDecodedImage(const ImageMap<V, VTraits>& image, int num_halvings, glare::Allocator* mem_allocator)
+{
+	const size_t factor = (size_t)1 << num_halvings;
+	Reference<ImageMap<V, VTraits> > reduced_image = new ImageMap<V, VTraits>((image.getWidth() + factor - 1) / factor, (image.getHeight() + factor - 1) / factor, image.getN(), mem_allocator);
+
+	ImageRowDownsampler<V, VTraits, uint64> downsampler(*reduced_image, image.getWidth(), image.getHeight(), num_halvings, mem_allocator);
+	for(size_t y=0; y<image.getHeight(); ++y)
+		downsampler.addRow(image.getPixel(0, y));
+
+	return reduced_image;
+}
+
+
+static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferWithWuffs(BufferViewInStream& buffer_view_in_stream, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	try
 	{
@@ -232,6 +248,9 @@ static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferWithWuffs(BufferViewIn
 		if(channel_0_bits == 0)
 			throw ImFormatExcep("channel 0 had 0 bit depth");
 
+		// Wuffs can only decode whole frames, so to decode at a reduced resolution we decode at full resolution then box-filter the result.
+		const int num_halvings = ImFormatDecoder::numHalvingsForTargetDim(w, h, target_max_dim, /*max num halvings=*/16);
+
 		// Configure the work buffer.
 		const uint64 workbuf_len = png_decoder.workbuf_len().max_incl;
 		const uint64 MAX_WORKBUF_ARRAY_SIZE = 256 * 1024 * 1024;
@@ -345,6 +364,9 @@ static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferWithWuffs(BufferViewIn
 				}
 			}
 
+			if(num_halvings > 0)
+				return downsampleDecodedImage(*imagemap, num_halvings, mem_allocator);
+
 			return imagemap;
 		}
 		else if(channel_0_bits == 16)
@@ -392,6 +414,9 @@ static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferWithWuffs(BufferViewIn
 				}
 			}
 
+			if(num_halvings > 0)
+				return downsampleDecodedImage(*imagemap, num_halvings, mem_allocator);
+
 			return imagemap;
 		}
 		else
@@ -407,7 +432,24 @@ static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferWithWuffs(BufferViewIn
 
 #if !WUFFS_SUPPORT
 
-static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferLibPNG(BufferViewInStream& buffer_view_in_stream)
+// Reads the image rows one at a time, box-filtering them down into image_map, which should have the reduced size.
+// Only works for non-interlaced images.
+template <class V, class VTraits>
+static void readRowsDownsampled(png_structp png_ptr, uint32 width, uint32 height, int num_halvings, ImageMap<V, VTraits>& image_map, glare::Allocator* mem_allocator)
+{
+	glare::AllocatorVector<V, 16> row(mem_allocator);
+	row.resizeNoCopy((size_t)width * image_map.getN());
+
+	ImageRowDownsampler<V, VTraits, uint64> downsampler(image_map, width, height, num_halvings, mem_allocator);
+	for(uint32 y=0; y<height; ++y)
+	{
+		png_read_row(png_ptr, (png_bytep)row.data(), /*display row=*/NULL);
+		downsampler.addRow(row.data());
+	}
+}
+
+
+static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferLibPNG(BufferViewInStream& buffer_view_in_stream, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	std::vector<png_bytep> row_pointers;
 
@@ -489,19 +531,33 @@ static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferLibPNG(BufferViewInStr
 		if(bit_depth != 8 && bit_depth != 16)
 			throw ImFormatExcep("Invalid bit depth found: " + toString(bit_depth));
 
-		row_pointers.resize(height);
+		// Decode at a reduced resolution if requested, by box-filtering the rows as they are decoded.
+		// Interlaced images are decoded at full resolution, since rows are not complete until the last pass.
+		const int num_halvings = (png_get_interlace_type(png_ptr, info_ptr) == PNG_INTERLACE_NONE) ? 
+			ImFormatDecoder::numHalvingsForTargetDim(width, height, target_max_dim, /*max num halvings=*/16) : 0;
+		const uint32 factor = 1u << num_halvings;
+		const uint32 reduced_width  = (width  + factor - 1) >> num_halvings;
+		const uint32 reduced_height = (height + factor - 1) >> num_halvings;
+
+		if(num_halvings == 0)
+			row_pointers.resize(height);
 
 		Map2DRef map;
 		if(bit_depth == 8)
 		{
-			Reference<ImageMapUInt8> image_map = new ImageMapUInt8(width, height, num_channels);
+			Reference<ImageMapUInt8> image_map = new ImageMapUInt8(reduced_width, reduced_height, num_channels, mem_allocator);
 			map = image_map;
 			image_map->setGamma((float)use_gamma);
 
-			for(uint32 y=0; y<height; ++y)
-				row_pointers[y] = (png_bytep)image_map->getPixel(0, y);
+			if(num_halvings == 0)
+			{
+				for(uint32 y=0; y<height; ++y)
+					row_pointers[y] = (png_bytep)image_map->getPixel(0, y);
 
-			png_read_image(png_ptr, row_pointers.data());
+				png_read_image(png_ptr, row_pointers.data());
+			}
+			else
+				readRowsDownsampled(png_ptr, width, height, num_halvings, *image_map, mem_allocator);
 		}
 		else // if(bit_depth == 16)
 		{
@@ -510,14 +566,19 @@ static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferLibPNG(BufferViewInStr
 			// Swap to little-endian (Intel) byte order, from network byte order, which is what PNG uses.
 			png_set_swap(png_ptr);
 
-			Reference<ImageMap<uint16_t, UInt16ComponentValueTraits>> image_map = new ImageMap<uint16_t, UInt16ComponentValueTraits>(width, height, num_channels);
+			Reference<ImageMap<uint16_t, UInt16ComponentValueTraits>> image_map = new ImageMap<uint16_t, UInt16ComponentValueTraits>(reduced_width, reduced_height, num_channels, mem_allocator);
 			map = image_map;
 			image_map->setGamma((float)use_gamma);
 
-			for(uint32 y=0; y<height; ++y)
-				row_pointers[y] = (png_bytep)image_map->getPixel(0, y);
+			if(num_halvings == 0)
+			{
+				for(uint32 y=0; y<height; ++y)
+					row_pointers[y] = (png_bytep)image_map->getPixel(0, y);
 
-			png_read_image(png_ptr, row_pointers.data());
+				png_read_image(png_ptr, row_pointers.data());
+			}
+			else
+				readRowsDownsampled(png_ptr, width, height, num_halvings, *image_map, mem_allocator);
 		}
 
 		// Free structures
@@ -536,14 +597,14 @@ static GLARE_NO_INLINE Reference<Map2D> doDecodeFromBufferLibPNG(BufferViewInStr
 #endif // !WUFFS_SUPPORT
 
 
-Reference<Map2D> PNGDecoder::decodeFromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator)
+Reference<Map2D> PNGDecoder::decodeFromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	BufferViewInStream buffer_view_in_stream(ArrayRef<uint8>((const uint8*)data, size));
 
 #if WUFFS_SUPPORT
-	return doDecodeFromBufferWithWuffs(buffer_view_in_stream, mem_allocator);
+	return doDecodeFromBufferWithWuffs(buffer_view_in_stream, mem_allocator, target_max_dim);
 #else
-	return doDecodeFromBufferLibPNG(buffer_view_in_stream);
+	return doDecodeFromBufferLibPNG(buffer_view_in_stream, mem_allocator, target_max_dim);
 #endif
 }
 
@@ -1367,6 +1428,64 @@ void PNGDecoder::test(const std::string& base_dir_path)
 
 
 
+	// Test decoding at reduced resolution
+	try
+	{
+		ImageMapUInt8 imagemap(100, 60, 3);
+		for(size_t y=0; y<imagemap.getHeight(); ++y)
+		for(size_t x=0; x<imagemap.getWidth(); ++x)
+		{
+			imagemap.getPixel(x, y)[0] = (uint8)(x * 2);
+			imagemap.getPixel(x, y)[1] = (uint8)(y * 4);
+			imagemap.getPixel(x, y)[2] = 100;
+		}
+
+		const std::string path = PlatformUtils::getTempDirPath() + "/indigo_png_write_test3.png";
+		write(imagemap, path);
+
+		Reference<Map2D> im = decode(path, /*mem allocator=*/NULL, /*target max dim=*/60);
+		testAssert(im->getMapWidth() == 100 && im->getMapHeight() == 60);
+
+		im = decode(path, /*mem allocator=*/NULL, /*target max dim=*/50);
+		testAssert(im->getMapWidth() == 50 && im->getMapHeight() == 30);
+
+		im = decode(path, /*mem allocator=*/NULL, /*target max dim=*/13);
+		testAssert(im->getMapWidth() == 13 && im->getMapHeight() == 8);
+		testAssert(im->numChannels() == 3);
+		testAssert(dynamic_cast<ImageMapUInt8*>(im.getPointer()) != NULL);
+
+		// Check pixel values are box-filtered.  The last column and row cover fewer source pixels.
+		const ImageMapUInt8* reduced = im.downcastToPtr<ImageMapUInt8>();
+		testAssert(reduced->getPixel(0, 0)[0] == 7); // Average of 0, 2, .., 14
+		testAssert(reduced->getPixel(0, 0)[1] == 14); // Average of 0, 4, .., 28
+		testAssert(reduced->getPixel(12, 7)[0] == 195); // Average of 192, 194, 196, 198
+		testAssert(reduced->getPixel(12, 7)[1] == 230); // Average of 224, 228, 232, 236
+		testAssert(reduced->getPixel(12, 7)[2] == 100);
+
+		// 16-bit image
+		ImageMapUInt16 imagemap16(9, 4, 1);
+		for(size_t y=0; y<imagemap16.getHeight(); ++y)
+		for(size_t x=0; x<imagemap16.getWidth(); ++x)
+			imagemap16.getPixel(x, y)[0] = (uint16)(x * 1000 + y * 10000);
+		write(imagemap16, path);
+
+		im = decode(path, /*mem allocator=*/NULL, /*target max dim=*/5);
+		testAssert(im->getMapWidth() == 5 && im->getMapHeight() == 2);
+		testAssert(dynamic_cast<ImageMapUInt16*>(im.getPointer()) != NULL);
+		const ImageMapUInt16* reduced16 = im.downcastToPtr<ImageMapUInt16>();
+		testAssert(reduced16->getPixel(0, 0)[0] == 5500);
+		testAssert(reduced16->getPixel(4, 1)[0] == 33000); // Covers a single column.
+	}
+	catch(PlatformUtils::PlatformUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+	catch(ImFormatExcep& e)
+	{
+		failTest(e.what());
+	}
+
+
 	// Try testing write failure - write to an invalid location
 	try
 	{
@@ -1418,7 +1537,7 @@ void PNGDecoder::test(const std::string& base_dir_path)
 			{
 				Timer timer;
 				BufferViewInStream buffer_view_in_stream(ArrayRef<uint8>((const uint8*)file.fileData(), file.fileSize()));
-				Reference<Map2D> map = doDecodeFromBufferLibPNG(buffer_view_in_stream);
+				Reference<Map2D> map = doDecodeFromBufferLibPNG(buffer_view_in_stream, /*mem allocator=*/NULL, /*target max dim=*/0);
 				//testAssert(map->getMapWidth() == 1000);
 				min_time = myMin(min_time, timer.elapsed());
 
@@ -1433,7 +1552,7 @@ void PNGDecoder::test(const std::string& base_dir_path)
 			{
 				Timer timer;
 				BufferViewInStream buffer_view_in_stream(ArrayRef<uint8>((const uint8*)file.fileData(), file.fileSize()));
-				Reference<Map2D> map = doDecodeFromBufferWithWuffs(buffer_view_in_stream, NULL);
+				Reference<Map2D> map = doDecodeFromBufferWithWuffs(buffer_view_in_stream, NULL, /*target max dim=*/0);
 				//testAssert(map->getMapWidth() == 1000);
 				min_time = myMin(min_time, timer.elapsed());
 			}
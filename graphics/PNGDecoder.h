@@ -28,9 +28,12 @@ class PNGDecoder
 public:
 	// All methods throw ImFormatExcep on failure.
 
-	static Reference<Map2D> decode(const std::string& path, glare::Allocator* mem_allocator = NULL);
+	// If target_max_dim is non-zero, the image may be decoded at a reduced resolution, see ImFormatDecoder::ImageDecodingOptions.
+	// With libpng, rows are box-filtered as they are decoded, so the full resolution image is never stored.  Interlaced images are decoded at full resolution.
+	// With Wuffs, the full resolution image is decoded, then box-filtered.
+	static Reference<Map2D> decode(const std::string& path, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
 
-	static Reference<Map2D> decodeFromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator = NULL);
+	static Reference<Map2D> decodeFromBuffer(const void* data, size_t size, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
 	
 	static void write(const Bitmap& bitmap, const std::map<std::string, std::string>& metadata, const std::string& path);
 	static void write(const Bitmap& bitmap, const std::string& path); // Write with no metadata
@@ -9,6 +9,7 @@ File created by ClassTemplate on Fri May 02 16:51:32 2008
 
 #include "ImageMap.h"
 #include "imformatdecoder.h"
+#include "TiledImageMap.h"
 #include "../utils/StringUtils.h"
 #include <tiffio.h>
 
@@ -127,6 +128,196 @@ Reference<Map2D> TIFFDecoder::decode(const std::string& path)
 }
 
 
+/*=====================================================================
+TIFFTiledImageSource
+--------------------
+Reads a TIFF file a tile at a time, for TiledImageMap.
+For tiled TIFF files, the tiles are the tiles of the file.  For stripped
+files, the tiles are the strips (blocks of full-width rows).  Strips larger 
+than a block of at most MAX_STRIP_BLOCK_ROWS rows, e.g. a single strip for 
+the whole image, are split into blocks read with TIFFReadScanline().
+=====================================================================*/
+class TIFFTiledImageSource final : public TiledImageSource
+{
+public:
+	static const size_t MAX_STRIP_BLOCK_ROWS = 64;
+	static const size_t MAX_STRIP_BLOCK_SIZE_B = 1 << 22; // Max size of a block of rows when converted to floats, for very wide images.
+
+	// Throws ImFormatExcep on failure.
+	TIFFTiledImageSource(const std::string& path)
+	{
+		// Stop LibTiff writing to stderr by setting NULL handlers.
+		TIFFSetWarningHandler(NULL);
+		TIFFSetErrorHandler(NULL);
+
+#if defined(_WIN32)
+		tif = TIFFOpenW(StringUtils::UTF8ToWString(path).c_str(), "r");
+#else
+		tif = TIFFOpen(path.c_str(), "r");
+#endif
+		if(!tif)
+			throw ImFormatExcep("Failed to open file '" + path + "' for reading.");
+
+		try
+		{
+			uint32 w = 0, h = 0;
+			uint16 planar_config = PLANARCONFIG_CONTIG;
+			bits_per_sample = 0;
+			samples_per_pixel = 0;
+			TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+			TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
+			TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+			TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+			TIFFGetField(tif, TIFFTAG_PLANARCONFIG, &planar_config);
+
+			if(w == 0 || h == 0)
+				throw ImFormatExcep("Tiff file has invalid dimensions.");
+			if(samples_per_pixel < 1 || samples_per_pixel > 4)
+				throw ImFormatExcep("Tiff file has unsupported number of channels: " + toString(samples_per_pixel));
+			if(bits_per_sample != 8 && bits_per_sample != 16)
+				throw ImFormatExcep("Tiff file has unsupported number of bits per sample: " + toString(bits_per_sample));
+			if(planar_config != PLANARCONFIG_CONTIG)
+				throw ImFormatExcep("Tiff files with separate planes are not supported for tiled reading.");
+
+			width = w;
+			height = h;
+
+			is_tiled = TIFFIsTiled(tif) != 0;
+			read_scanlines = false;
+			if(is_tiled)
+			{
+				uint32 tile_width = 0, tile_length = 0;
+				TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tile_width);
+				TIFFGetField(tif, TIFFTAG_TILELENGTH, &tile_length);
+				if(tile_width == 0 || tile_length == 0)
+					throw ImFormatExcep("Tiff file has invalid tile size.");
+				tile_w = tile_width;
+				tile_h = tile_length;
+				buf.resize(TIFFTileSize(tif));
+			}
+			else
+			{
+				uint32 rows_per_strip = 0;
+				TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rows_per_strip);
+				tile_w = width;
+				strip_h = (rows_per_strip == 0) ? height : myMin<size_t>(height, rows_per_strip); // Rows per strip defaults to 2^32 - 1 (one strip).
+
+				// Making each strip a tile could make the whole image one tile, which may not fit in the tile cache.  So read large strips a block of rows at a time.
+				const size_t max_block_h = myClamp<size_t>(MAX_STRIP_BLOCK_SIZE_B / (width * samples_per_pixel * sizeof(float)), 1, MAX_STRIP_BLOCK_ROWS);
+				read_scanlines = strip_h > max_block_h;
+				if(read_scanlines)
+				{
+					tile_h = max_block_h;
+					buf.resize(tile_h * TIFFScanlineSize(tif));
+					next_scanline_y = 0;
+				}
+				else
+				{
+					tile_h = strip_h;
+					buf.resize(TIFFStripSize(tif));
+				}
+			}
+
+			// The tile buffer must hold at least the pixels we will read from it.
+			if(buf.size() < tile_w * tile_h * samples_per_pixel * (bits_per_sample / 8))
+				throw ImFormatExcep("Tiff file has invalid tile or strip size.");
+		}
+		catch(ImFormatExcep&)
+		{
+			TIFFClose(tif);
+			throw;
+		}
+	}
+
+	~TIFFTiledImageSource()
+	{
+		TIFFClose(tif);
+	}
+
+	virtual size_t getWidth() const override { return width; }
+	virtual size_t getHeight() const override { return height; }
+	virtual size_t numChannels() const override { return samples_per_pixel; }
+
+	virtual size_t tileWidth() const override { return tile_w; }
+	virtual size_t tileHeight() const override { return tile_h; }
+
+	virtual void readTile(size_t tile_x, size_t tile_y, ImageMapFloat& tile_out) override
+	{
+		if(is_tiled)
+		{
+			const ttile_t tile = TIFFComputeTile(tif, (uint32)(tile_x * tile_w), (uint32)(tile_y * tile_h), /*z=*/0, /*sample=*/0);
+			if(TIFFReadEncodedTile(tif, tile, buf.data(), (tsize_t)buf.size()) == -1)
+				throw glare::Exception("TIFFReadEncodedTile failed.");
+		}
+		else if(read_scanlines)
+		{
+			// LibTiff can only decode the rows of a compressed strip in order.  So unless the block follows on from the last block read in the same strip,
+			// decode (and discard) the rows from the start of the strip up to the block.  Reading blocks in order therefore decodes each row once.
+			const size_t scanline_size = TIFFScanlineSize(tif);
+			const size_t block_begin = tile_y * tile_h;
+			const size_t strip_begin = (block_begin / strip_h) * strip_h;
+			size_t y = (next_scanline_y >= strip_begin && next_scanline_y <= block_begin) ? next_scanline_y : strip_begin;
+			next_scanline_y = height; // In case reading fails part way through.
+			for(; y<block_begin; ++y)
+				if(TIFFReadScanline(tif, buf.data(), (uint32)y, /*sample=*/0) == -1)
+					throw glare::Exception("TIFFReadScanline failed.");
+
+			for(size_t z=0; z<tile_out.getHeight(); ++z)
+				if(TIFFReadScanline(tif, buf.data() + z * scanline_size, (uint32)(block_begin + z), /*sample=*/0) == -1)
+					throw glare::Exception("TIFFReadScanline failed.");
+			next_scanline_y = block_begin + tile_out.getHeight();
+		}
+		else
+		{
+			if(TIFFReadEncodedStrip(tif, (tstrip_t)tile_y, buf.data(), (tsize_t)buf.size()) == -1)
+				throw glare::Exception("TIFFReadEncodedStrip failed.");
+		}
+
+		// Tiles in the file are always tile_w x tile_h, including at the right and bottom edges of the image, so rows in the buffer are tile_w pixels long.
+		// The last strip may be shorter than tile_h rows, which doesn't matter as tile_out is clipped to the image.
+		const size_t N = samples_per_pixel;
+		const size_t buf_row_size = tile_w * N;
+		const size_t out_row_size = tile_out.getWidth() * N;
+		for(size_t y=0; y<tile_out.getHeight(); ++y)
+		{
+			float* const out_row = tile_out.getPixel(0, y);
+			if(bits_per_sample == 8)
+			{
+				const uint8* const buf_row = buf.data() + y * buf_row_size;
+				for(size_t i=0; i<out_row_size; ++i)
+					out_row[i] = buf_row[i] * (1.f / 255.f);
+			}
+			else
+			{
+				const uint16* const buf_row = (const uint16*)buf.data() + y * buf_row_size;
+				for(size_t i=0; i<out_row_size; ++i)
+					out_row[i] = buf_row[i] * (1.f / 65535.f);
+			}
+		}
+	}
+
+	virtual bool isFloatingPoint() const override { return false; }
+	virtual double uncompressedBitsPerChannel() const override { return bits_per_sample; }
+	virtual float getGamma() const override { return 2.2f; } // Same as the ImageMaps returned by decode().
+
+private:
+	TIFF* tif;
+	bool is_tiled;
+	bool read_scanlines; // For stripped files with strips larger than a block of rows.  Tiles are then blocks of tile_h rows, read with TIFFReadScanline().
+	uint16 bits_per_sample, samples_per_pixel;
+	size_t width, height, tile_w, tile_h;
+	size_t strip_h; // For stripped files.
+	size_t next_scanline_y; // If read_scanlines, the row after the last row read with TIFFReadScanline().
+	std::vector<uint8> buf; // Holds one tile, strip or block of rows.
+};
+
+
+Reference<TiledImageMap> TIFFDecoder::openTiled(const std::string& path, size_t max_tile_cache_size_B)
+{
+	return new TiledImageMap(new TIFFTiledImageSource(path), max_tile_cache_size_B);
+}
+
+
 template <class T, class Traits>
 void TIFFDecoder::write(const ImageMap<T, Traits>& bitmap, const std::string& path)
 {
@@ -284,6 +475,152 @@ void TIFFDecoder::test()
 
 
 
+	// Test openTiled() with a stripped file and a tiled file, at 8 and 16 bits.
+	try
+	{
+		const int W = 300; const int H = 200;
+		ImageMapUInt8 imagemap(W, H, 3);
+		ImageMap<uint16, UInt16ComponentValueTraits> imagemap16(W, H, 3);
+		for(int y=0; y<H; ++y)
+		for(int x=0; x<W; ++x)
+			for(int c=0; c<3; ++c)
+			{
+				imagemap.getPixel(x, y)[c] = (uint8)((x * 3 + y * 7 + c * 50) % 256);
+				imagemap16.getPixel(x, y)[c] = (uint16)((x * 301 + y * 77 + c * 5000) % 65536);
+			}
+
+		// Stripped files, as written by write().  These have a single strip, so are read in blocks of rows.
+		{
+			const std::string path = tempdir + "/indigo_tiff_tiled_read_test.tiff";
+			write(imagemap, path);
+
+			Reference<TiledImageMap> tiled = openTiled(path, /*max tile cache size=*/W * TIFFTiledImageSource::MAX_STRIP_BLOCK_ROWS * 3 * sizeof(float));
+			testAssert(tiled->getMapWidth() == W && tiled->getMapHeight() == H && tiled->numChannels() == 3);
+			testAssert(tiled->uncompressedBitsPerChannel() == 8);
+			for(int y=0; y<H; ++y)
+			for(int x=0; x<W; ++x)
+			{
+				ImageMapFloat pixel;
+				tiled->readRegion(x, y, 1, 1, pixel);
+				for(int c=0; c<3; ++c)
+					testAssert(pixel.getPixel(0, 0)[c] == imagemap.getPixel(x, y)[c] * (1.f / 255.f));
+			}
+		}
+		{
+			const std::string path = tempdir + "/indigo_tiff_tiled_read_test_16bit.tiff";
+			write(imagemap16, path);
+
+			Reference<TiledImageMap> tiled = openTiled(path, /*max tile cache size=*/W * TIFFTiledImageSource::MAX_STRIP_BLOCK_ROWS * 3 * sizeof(float));
+			ImageMapFloat region;
+			tiled->readRegion(0, 0, W, H, region);
+			for(int y=0; y<H; ++y)
+			for(int x=0; x<W; ++x)
+				for(int c=0; c<3; ++c)
+					testAssert(region.getPixel(x, y)[c] == imagemap16.getPixel(x, y)[c] * (1.f / 65535.f));
+		}
+
+		// Stripped file with a single strip for the whole image (ROWSPERSTRIP = height).  Should be read in blocks of rows, not as a single tile.
+		{
+			const std::string path = tempdir + "/indigo_tiff_tiled_read_test_one_strip.tiff";
+			{
+				TIFF* tif = TIFFOpen(path.c_str(), "w");
+				testAssert(tif != NULL);
+				TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32)W);
+				TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32)H);
+				TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16)8);
+				TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16)3);
+				TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+				TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+				TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+				TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+				TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32)H);
+				for(uint32 y=0; y<(uint32)H; ++y)
+					testAssert(TIFFWriteScanline(tif, imagemap.getPixel(0, y), y, 0) != -1);
+				TIFFClose(tif);
+			}
+
+			const size_t block_h = TIFFTiledImageSource::MAX_STRIP_BLOCK_ROWS;
+			const size_t num_blocks = (H + block_h - 1) / block_h;
+			Reference<TiledImageMap> tiled = openTiled(path, /*max tile cache size=*/W * block_h * 3 * sizeof(float) * 2);
+			testAssert(tiled->getMapWidth() == W && tiled->getMapHeight() == H && tiled->numChannels() == 3);
+			ImageMapFloat region;
+			tiled->readRegion(0, 0, W, H, region);
+			testAssert(tiled->numTileReads() == num_blocks); // Each block of rows should be read once.
+			testAssert(tiled->cacheSizeB() <= tiled->maxCacheSizeB());
+			for(int y=0; y<H; ++y)
+			for(int x=0; x<W; ++x)
+				for(int c=0; c<3; ++c)
+					testAssert(region.getPixel(x, y)[c] == imagemap.getPixel(x, y)[c] * (1.f / 255.f));
+
+			// Read rows out of order, so that LibTiff has to restart decoding the strip.
+			for(int y=H-1; y>=0; y -= 37)
+			for(int x=0; x<W; x += 13)
+			{
+				ImageMapFloat pixel;
+				tiled->readRegion(x, y, 1, 1, pixel);
+				for(int c=0; c<3; ++c)
+					testAssert(pixel.getPixel(0, 0)[c] == imagemap.getPixel(x, y)[c] * (1.f / 255.f));
+			}
+		}
+
+		// Tiled file.  Use an image size that is not a multiple of the tile size, so there are padded tiles at the right and bottom.
+		{
+			const std::string path = tempdir + "/indigo_tiff_tiled_read_test_tiles.tiff";
+			const uint32 tile_size = 64;
+			{
+				TIFF* tif = TIFFOpen(path.c_str(), "w");
+				testAssert(tif != NULL);
+				TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32)W);
+				TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32)H);
+				TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16)8);
+				TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16)3);
+				TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+				TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+				TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+				TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+				TIFFSetField(tif, TIFFTAG_TILEWIDTH, tile_size);
+				TIFFSetField(tif, TIFFTAG_TILELENGTH, tile_size);
+
+				std::vector<uint8> tile_buf(tile_size * tile_size * 3);
+				for(uint32 ty=0; ty<(uint32)H; ty += tile_size)
+				for(uint32 tx=0; tx<(uint32)W; tx += tile_size)
+				{
+					for(uint32 y=0; y<tile_size; ++y)
+					for(uint32 x=0; x<tile_size; ++x)
+						for(uint32 c=0; c<3; ++c)
+							tile_buf[(y * tile_size + x) * 3 + c] = (tx + x < (uint32)W && ty + y < (uint32)H) ? imagemap.getPixel(tx + x, ty + y)[c] : 0;
+
+					testAssert(TIFFWriteEncodedTile(tif, TIFFComputeTile(tif, tx, ty, 0, 0), tile_buf.data(), (tsize_t)tile_buf.size()) != -1);
+				}
+				TIFFClose(tif);
+			}
+
+			Reference<TiledImageMap> tiled = openTiled(path, /*max tile cache size=*/tile_size * tile_size * 3 * sizeof(float) * 2);
+			testAssert(tiled->getMapWidth() == W && tiled->getMapHeight() == H && tiled->numChannels() == 3);
+			ImageMapFloat region;
+			tiled->readRegion(0, 0, W, H, region);
+			testAssert(tiled->numTileReads() == 5 * 4); // Each tile should be read once.
+			for(int y=0; y<H; ++y)
+			for(int x=0; x<W; ++x)
+				for(int c=0; c<3; ++c)
+					testAssert(region.getPixel(x, y)[c] == imagemap.getPixel(x, y)[c] * (1.f / 255.f));
+		}
+
+		// Try with an invalid path
+		try
+		{
+			openTiled(tempdir + "/NO_SUCH_FILE.tiff", 1 << 20);
+			failTest("Shouldn't get here.");
+		}
+		catch(ImFormatExcep&)
+		{}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+
 	try
 	{
 		Reference<Map2D> im = TIFFDecoder::decode(TestUtils::getTestReposDir() + "/testfiles/tiff/ColorChecker_sRGB_from_Ref_lzw.tiff");
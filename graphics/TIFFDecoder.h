@@ -11,6 +11,7 @@ File created by ClassTemplate on Fri May 02 16:51:32 2008
 #include "../graphics/ImageMap.h"
 #include <string>
 class Map2D;
+class TiledImageMap;
 
 
 /*=====================================================================
@@ -25,6 +26,11 @@ public:
 	// throws ImFormatExcep
 	static Reference<Map2D> decode(const std::string& path);
 
+	// Opens the TIFF file for reading a tile at a time (or a strip at a time for stripped files), for images too large to decode into memory.
+	// At most max_tile_cache_size_B bytes of decoded tiles are kept in memory.
+	// throws ImFormatExcep
+	static Reference<TiledImageMap> openTiled(const std::string& path, size_t max_tile_cache_size_B);
+
 	// throws ImFormatExcep
 	template <class T, class Traits>
 	static void write(const ImageMap<T, Traits>& bitmap, const std::string& path);
@@ -62,7 +62,11 @@ enum OpenGLTextureFormat
 	Format_Compressed_ETC2_RGB_Uint8,   // i.e. GL_COMPRESSED_RGB8_ETC2
 	Format_Compressed_ETC2_RGBA_Uint8,  // i.e. GL_COMPRESSED_RGBA8_ETC2_EAC 
 	Format_Compressed_ETC2_SRGB_Uint8,  // i.e. GL_COMPRESSED_SRGB8_ETC2
-	Format_Compressed_ETC2_SRGBA_Uint8  // i.e. GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC
+	Format_Compressed_ETC2_SRGBA_Uint8, // i.e. GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC
+	Format_Compressed_BC4_Uint8,        // BC4 / RGTC1, single channel, i.e. GL_COMPRESSED_RED_RGTC1
+	Format_Compressed_BC5_Uint8,        // BC5 / RGTC2, two channels, i.e. GL_COMPRESSED_RG_RGTC2
+	Format_Compressed_BC7_RGBA_Uint8,   // BC7, linear sRGB colour space, i.e. GL_COMPRESSED_RGBA_BPTC_UNORM
+	Format_Compressed_BC7_SRGBA_Uint8   // BC7, non-linear sRGB colour space, i.e. GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
 };
 
 
@@ -0,0 +1,452 @@
+/*=====================================================================
+TextureDataCache.cpp
+--------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#include "TextureDataCache.h"
+
+
+#include "KTXDecoder.h"
+#include "CompressedImage.h"
+#include "../utils/FileUtils.h"
+#include "../utils/MemMappedFile.h"
+#include "../utils/BufferOutStream.h"
+#include "../utils/Exception.h"
+#include "../utils/StringUtils.h"
+#include "../utils/ConPrint.h"
+#include "../utils/Lock.h"
+#include "../utils/IncludeXXHash.h"
+#include <unordered_set>
+#include <cstring>
+
+
+static const uint32 FORMAT_VERSION = 1; // Increment when the cache file contents or the texture processing code changes, to invalidate existing cache files.
+static const char* const CACHE_FILE_EXTENSION = "ktx2";
+static const char* const INDEX_FILENAME = "index.txt";
+
+
+// Gets the KTX2 format that texture data with the given format is stored as.
+// Only handles formats that decodeKTX2 maps back to the same format.  Returns false if the format can't be stored.
+static bool getKTXFormat(OpenGLTextureFormat format, KTXDecoder::Format& format_out)
+{
+	switch(format)
+	{
+	case OpenGLTextureFormat::Format_Compressed_DXT_SRGB_Uint8:  format_out = KTXDecoder::Format_BC1;  return true;
+	case OpenGLTextureFormat::Format_Compressed_DXT_SRGBA_Uint8: format_out = KTXDecoder::Format_BC3;  return true;
+	case OpenGLTextureFormat::Format_Compressed_BC6H:            format_out = KTXDecoder::Format_BC6H; return true;
+	case OpenGLTextureFormat::Format_Compressed_BC4_Uint8:       format_out = KTXDecoder::Format_BC4;  return true;
+	case OpenGLTextureFormat::Format_Compressed_BC5_Uint8:       format_out = KTXDecoder::Format_BC5;  return true;
+	case OpenGLTextureFormat::Format_Compressed_BC7_SRGBA_Uint8: format_out = KTXDecoder::Format_BC7;  return true;
+	default: return false;
+	}
+}
+
+
+TextureDataCache::TextureDataCache(const std::string& cache_dir_, size_t max_size_B_)
+:	cache_dir(cache_dir_),
+	max_size_B(max_size_B_)
+{
+	try
+	{
+		FileUtils::createDirIfDoesNotExist(cache_dir);
+
+		// Get the keys of the existing cache files
+		std::vector<uint64> file_keys;
+		const std::vector<std::string> filenames = FileUtils::getFilesInDir(cache_dir);
+		for(size_t i=0; i<filenames.size(); ++i)
+		{
+			if(hasExtension(filenames[i], CACHE_FILE_EXTENSION))
+			{
+				try
+				{
+					file_keys.push_back(hexStringToUInt64(filenames[i].substr(0, filenames[i].size() - 5))); // Remove the ".ktx2" extension.
+				}
+				catch(StringUtilsExcep&)
+				{} // Not a cache file, ignore it.
+			}
+			else if(filenames[i].find(std::string(".") + CACHE_FILE_EXTENSION + "_") != std::string::npos) // Temporary file left by an interrupted writeEntireFileAtomically():
+				FileUtils::deleteFile(FileUtils::join(cache_dir, filenames[i]));
+		}
+
+		// Read the saved LRU order, most recently used first.
+		std::vector<uint64> index_keys;
+		const std::string index_path = FileUtils::join(cache_dir, INDEX_FILENAME);
+		if(FileUtils::fileExists(index_path))
+		{
+			const std::vector<std::string> lines = ::split(FileUtils::readEntireFileTextMode(index_path), '\n');
+			for(size_t i=0; i<lines.size(); ++i)
+			{
+				try
+				{
+					index_keys.push_back(hexStringToUInt64(stripHeadAndTailWhitespace(lines[i])));
+				}
+				catch(StringUtilsExcep&)
+				{}
+			}
+		}
+
+		Lock lock(mutex);
+
+		// Insert the entries from least to most recently used, since LRUCache::insert() inserts at the most recently used end.
+		// Files not in the index were written after the index was last saved, so treat them as the most recently used.
+		std::unordered_set<uint64> file_key_set(file_keys.begin(), file_keys.end());
+		for(auto it = index_keys.rbegin(); it != index_keys.rend(); ++it)
+			if(file_key_set.count(*it) != 0)
+				entries.insert(*it, /*value=*/0, FileUtils::getFileSize(cacheFilePath(*it)));
+
+		for(size_t i=0; i<file_keys.size(); ++i)
+			if(!entries.isInserted(file_keys[i]))
+				entries.insert(file_keys[i], /*value=*/0, FileUtils::getFileSize(cacheFilePath(file_keys[i])));
+
+		removeLRUEntriesUntilWithinBudget();
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception("Failed to initialise texture data cache in '" + cache_dir + "': " + e.what());
+	}
+}
+
+
+TextureDataCache::~TextureDataCache()
+{
+	saveIndex();
+}
+
+
+uint64 TextureDataCache::computeKey(const void* source_data, size_t source_data_size, const ProcessingOptions& options)
+{
+	const uint32 option_vals[] = {
+		FORMAT_VERSION,
+		options.allow_compression ? 1u : 0u,
+		options.build_mipmaps ? 1u : 0u,
+		options.convert_float_to_half ? 1u : 0u,
+		(uint32)options.mipmap_filter,
+		options.compression_options.allow_BC4 ? 1u : 0u,
+		options.compression_options.allow_BC5 ? 1u : 0u,
+		options.compression_options.allow_BC7 ? 1u : 0u,
+		(uint32)options.compression_options.quality
+	};
+
+	return XXH64(option_vals, sizeof(option_vals), /*seed=*/XXH64(source_data, source_data_size, /*seed=*/1));
+}
+
+
+uint64 TextureDataCache::computeKeyForFile(const std::string& path, const ProcessingOptions& options)
+{
+	MemMappedFile file(path);
+	return computeKey(file.fileData(), file.fileSize(), options);
+}
+
+
+const std::string TextureDataCache::cacheFilePath(uint64 key) const
+{
+	return FileUtils::join(cache_dir, toHexString(key) + "." + CACHE_FILE_EXTENSION);
+}
+
+
+Reference<TextureData> TextureDataCache::lookup(uint64 key, glare::Allocator* mem_allocator)
+{
+	{
+		Lock lock(mutex);
+		if(!entries.isInserted(key))
+			return Reference<TextureData>();
+		entries.itemWasUsed(key);
+	}
+
+	try
+	{
+		MemMappedFile file(cacheFilePath(key));
+		Reference<Map2D> map = KTXDecoder::decodeKTX2FromBuffer(file.fileData(), file.fileSize(), mem_allocator);
+
+		const CompressedImage* compressed_image = dynamic_cast<const CompressedImage*>(map.ptr());
+		if(!compressed_image)
+			throw glare::Exception("Expected CompressedImage");
+		return compressed_image->texture_data;
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("TextureDataCache: failed to load cache file for key " + toHexString(key) + ": " + e.what());
+
+		// Remove the invalid entry.
+		Lock lock(mutex);
+		auto res = entries.find(key);
+		if(res != entries.end())
+			entries.erase(res);
+		try
+		{
+			FileUtils::deleteFile(cacheFilePath(key));
+		}
+		catch(FileUtils::FileUtilsExcep&)
+		{}
+
+		return Reference<TextureData>();
+	}
+}
+
+
+bool TextureDataCache::canCache(const TextureData& texture_data)
+{
+	KTXDecoder::Format ktx_format;
+	return getKTXFormat(texture_data.format, ktx_format) &&
+		!texture_data.isMultiFrame() &&
+		!texture_data.isArrayTexture() &&
+		texture_data.converted_image.isNull() && // Texture data must be in mipmap_data.
+		!texture_data.level_offsets.empty();
+}
+
+
+void TextureDataCache::insert(uint64 key, const TextureData& texture_data)
+{
+	KTXDecoder::Format ktx_format;
+	if(!canCache(texture_data) || !getKTXFormat(texture_data.format, ktx_format))
+		return;
+
+	std::vector<ArrayRef<uint8> > level_data;
+	for(size_t i=0; i<texture_data.level_offsets.size(); ++i)
+	{
+		const TextureData::LevelOffsetData& level = texture_data.level_offsets[i];
+		if(level.offset > texture_data.mipmap_data.size() || level.level_size > texture_data.mipmap_data.size() - level.offset)
+			throw glare::Exception("Invalid texture data level offsets");
+		level_data.push_back(ArrayRef<uint8>(texture_data.mipmap_data.data() + level.offset, level.level_size));
+	}
+
+	// Write the KTX2 file to a buffer first, so we know the file size, and can write the file atomically.
+	BufferOutStream buffer;
+	KTXDecoder::writeKTX2(ktx_format, /*supercompression=*/true, (int)texture_data.W, (int)texture_data.H, level_data, buffer);
+
+	if(buffer.buf.size() > max_size_B)
+		return; // Would be evicted immediately.
+
+	try
+	{
+		FileUtils::writeEntireFileAtomically(cacheFilePath(key), (const char*)buffer.buf.data(), buffer.buf.size());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception("Failed to write texture data cache file: " + e.what());
+	}
+
+	Lock lock(mutex);
+
+	// Another thread may have inserted the same key in the meantime, remove the old entry so the size is updated.
+	auto res = entries.find(key);
+	if(res != entries.end())
+		entries.erase(res);
+	entries.insert(key, /*value=*/0, buffer.buf.size());
+
+	removeLRUEntriesUntilWithinBudget();
+}
+
+
+void TextureDataCache::removeLRUEntriesUntilWithinBudget()
+{
+	while(entries.totalValueSizeB() > max_size_B)
+	{
+		uint64 removed_key, removed_value;
+		if(!entries.removeLRUItem(removed_key, removed_value))
+			break;
+
+		try
+		{
+			FileUtils::deleteFile(cacheFilePath(removed_key));
+		}
+		catch(FileUtils::FileUtilsExcep& e)
+		{
+			// The file may be memory-mapped by a lookup on another thread, which prevents deletion on Windows.  It will be removed next time the cache is initialised, if over budget.
+			conPrint("TextureDataCache: failed to delete cache file: " + e.what());
+		}
+	}
+}
+
+
+void TextureDataCache::saveIndex()
+{
+	try
+	{
+		std::string index;
+		{
+			Lock lock(mutex);
+			for(auto it = entries.item_list.begin(); it != entries.item_list.end(); ++it) // item_list is ordered from most to least recently used.
+				index += toHexString(*it) + "\n";
+		}
+
+		FileUtils::writeEntireFileAtomically(FileUtils::join(cache_dir, INDEX_FILENAME), index.data(), index.size());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("TextureDataCache: failed to save index: " + e.what());
+	}
+}
+
+
+size_t TextureDataCache::numEntries() const
+{
+	Lock lock(mutex);
+	return entries.size();
+}
+
+
+size_t TextureDataCache::totalSizeB() const
+{
+	Lock lock(mutex);
+	return entries.totalValueSizeB();
+}
+
+
+#if BUILD_TESTS
+
+
+#include "ImageMap.h"
+#include "../utils/TestUtils.h"
+#include "../utils/PlatformUtils.h"
+#include "../utils/TaskManager.h"
+
+
+static Reference<TextureData> buildTestTextureData(int W, int H, int N, int seed, bool allow_compression)
+{
+	ImageMapUInt8Ref map = new ImageMapUInt8(W, H, N);
+	for(int y=0; y<H; ++y)
+		for(int x=0; x<W; ++x)
+			for(int c=0; c<N; ++c)
+				map->getPixel(x, y)[c] = (uint8)((x * (c + 1) + y * 3 + seed * 17) % 256);
+
+	return TextureProcessing::buildTextureData(map.ptr(), /*mem allocator=*/NULL, /*task manager=*/NULL, allow_compression, /*build mipmaps=*/true, /*convert_float_to_half=*/true);
+}
+
+
+static void checkTextureDataEqual(const TextureData& a, const TextureData& b)
+{
+	testAssert(a.format == b.format);
+	testAssert(a.W == b.W && a.H == b.H);
+	testAssert(a.level_offsets.size() == b.level_offsets.size());
+	for(size_t i=0; i<a.level_offsets.size(); ++i)
+	{
+		testAssert(a.level_offsets[i].level_size == b.level_offsets[i].level_size);
+		testAssert(std::memcmp(a.mipmap_data.data() + a.level_offsets[i].offset, b.mipmap_data.data() + b.level_offsets[i].offset, a.level_offsets[i].level_size) == 0);
+	}
+}
+
+
+void TextureDataCache::test()
+{
+	conPrint("TextureDataCache::test()");
+
+	try
+	{
+		const std::string cache_dir = PlatformUtils::getTempDirPath() + "/texture_data_cache_test";
+		if(FileUtils::fileExists(cache_dir))
+			FileUtils::deleteDirectoryRecursive(cache_dir);
+
+		//-------------------- Test keys --------------------
+		{
+			const uint8 data[] = { 1, 2, 3, 4 };
+			ProcessingOptions options;
+			const uint64 key = computeKey(data, sizeof(data), options);
+			testAssert(computeKey(data, sizeof(data), options) == key);
+			testAssert(computeKey(data, 3, options) != key);
+
+			ProcessingOptions other_options;
+			other_options.compression_options.allow_BC7 = true;
+			testAssert(computeKey(data, sizeof(data), other_options) != key);
+			other_options = ProcessingOptions();
+			other_options.allow_compression = false;
+			testAssert(computeKey(data, sizeof(data), other_options) != key);
+		}
+
+		//-------------------- Test inserting and looking up --------------------
+		Reference<TextureData> rgb_tex_data  = buildTestTextureData(256, 200, 3, /*seed=*/0, /*allow compression=*/true);
+		Reference<TextureData> rgba_tex_data = buildTestTextureData(100, 37, 4, /*seed=*/1, /*allow compression=*/true);
+		testAssert(canCache(*rgb_tex_data) && canCache(*rgba_tex_data));
+		{
+			TextureDataCache cache(cache_dir, /*max size=*/100000000);
+			testAssert(cache.numEntries() == 0);
+			testAssert(cache.lookup(1).isNull());
+
+			cache.insert(1, *rgb_tex_data);
+			cache.insert(2, *rgba_tex_data);
+			testAssert(cache.numEntries() == 2);
+			testAssert(cache.totalSizeB() == FileUtils::getFileSize(cache.cacheFilePath(1)) + FileUtils::getFileSize(cache.cacheFilePath(2)));
+
+			Reference<TextureData> loaded = cache.lookup(1);
+			testAssert(loaded.nonNull());
+			checkTextureDataEqual(*loaded, *rgb_tex_data);
+
+			loaded = cache.lookup(2);
+			testAssert(loaded.nonNull());
+			checkTextureDataEqual(*loaded, *rgba_tex_data);
+
+			testAssert(cache.lookup(3).isNull());
+
+			// Uncompressed texture data is not cached.
+			Reference<TextureData> uncompressed_tex_data = buildTestTextureData(64, 64, 3, /*seed=*/2, /*allow compression=*/false);
+			testAssert(!canCache(*uncompressed_tex_data));
+			cache.insert(3, *uncompressed_tex_data);
+			testAssert(cache.lookup(3).isNull());
+			testAssert(cache.numEntries() == 2);
+
+			// Inserting an existing key replaces the entry.
+			cache.insert(1, *rgb_tex_data);
+			testAssert(cache.numEntries() == 2);
+		}
+
+		//-------------------- Test entries persist, with their LRU order --------------------
+		size_t size_1, size_2;
+		{
+			TextureDataCache cache(cache_dir, /*max size=*/100000000);
+			testAssert(cache.numEntries() == 2);
+			size_1 = FileUtils::getFileSize(cache.cacheFilePath(1));
+			size_2 = FileUtils::getFileSize(cache.cacheFilePath(2));
+			Reference<TextureData> loaded = cache.lookup(2);
+			testAssert(loaded.nonNull());
+			checkTextureDataEqual(*loaded, *rgba_tex_data);
+			// Key 2 is now the most recently used.
+		}
+		{
+			// Reduce the budget so only one entry fits.  Key 1 is least recently used so should be removed.
+			TextureDataCache cache(cache_dir, /*max size=*/myMax(size_1, size_2));
+			testAssert(cache.numEntries() == 1);
+			testAssert(cache.lookup(1).isNull());
+			testAssert(!FileUtils::fileExists(cache.cacheFilePath(1)));
+			testAssert(cache.lookup(2).nonNull());
+
+			// Inserting key 1 should evict key 2, since only one fits.
+			cache.insert(1, *rgb_tex_data);
+			testAssert(cache.numEntries() == 1);
+			testAssert(cache.lookup(2).isNull());
+			testAssert(cache.lookup(1).nonNull());
+			testAssert(cache.totalSizeB() <= cache.maxSizeB());
+		}
+
+		//-------------------- Test corrupt cache files are rejected and removed --------------------
+		{
+			TextureDataCache cache(cache_dir, /*max size=*/100000000);
+			cache.insert(5, *rgba_tex_data);
+			const std::string path = cache.cacheFilePath(5);
+			std::string contents;
+			FileUtils::readEntireFile(path, contents);
+			FileUtils::writeEntireFile(path, contents.substr(0, contents.size() / 2));
+
+			testAssert(cache.lookup(5).isNull());
+			testAssert(!FileUtils::fileExists(path));
+			testAssert(cache.lookup(5).isNull());
+		}
+
+		// Files in the cache dir that are not cache files should be ignored.
+		{
+			FileUtils::writeEntireFile(FileUtils::join(cache_dir, "notakey.ktx2"), "abc");
+			TextureDataCache cache(cache_dir, /*max size=*/100000000);
+			testAssert(cache.lookup(1).nonNull());
+		}
+
+		FileUtils::deleteDirectoryRecursive(cache_dir);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("TextureDataCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
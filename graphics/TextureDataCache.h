@@ -0,0 +1,100 @@
+/*=====================================================================
+TextureDataCache.h
+------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "TextureData.h"
+#include "TextureProcessing.h"
+#include "../utils/ThreadSafeRefCounted.h"
+#include "../utils/Reference.h"
+#include "../utils/Mutex.h"
+#include "../utils/LRUCache.h"
+#include <string>
+namespace glare { class Allocator; }
+
+
+/*=====================================================================
+TextureDataCache
+----------------
+On-disk cache of processed texture data (with mipmaps, block-compressed),
+so that textures that have been loaded before don't need to be decoded,
+mipmapped and compressed again.
+
+Entries are keyed by a hash of the source image file contents and the
+processing options.  Each entry is stored as a KTX2 file with zstd
+supercompression, and is loaded through a memory-mapped file.
+
+The total size of the cache files is kept within max_size_B by deleting
+the least recently used files.  The LRU order is written to an index file
+in the cache directory by saveIndex(), which is called by the destructor,
+so that it persists between runs.
+
+Only single-frame, non-array, block-compressed texture data can be
+cached, since that is what the KTX2 writer handles, and is the texture
+data that is expensive to build.
+
+Thread-safe.
+=====================================================================*/
+class TextureDataCache : public ThreadSafeRefCounted
+{
+public:
+	// Creates cache_dir if it doesn't exist, and adds any existing cache files in it to the cache.  Throws glare::Exception on failure.
+	TextureDataCache(const std::string& cache_dir, size_t max_size_B);
+	~TextureDataCache();
+
+	// The options the texture data is built with, e.g. the arguments to TextureProcessing::buildTextureData().
+	struct ProcessingOptions
+	{
+		ProcessingOptions() : allow_compression(true), build_mipmaps(true), convert_float_to_half(true), mipmap_filter(MipMapFilter_Box) {}
+
+		bool allow_compression;
+		bool build_mipmaps;
+		bool convert_float_to_half;
+		MipMapFilter mipmap_filter;
+		TextureCompressionOptions compression_options;
+	};
+
+	// Computes the key for texture data built from an image file with contents source_data, with the given options.
+	static uint64 computeKey(const void* source_data, size_t source_data_size, const ProcessingOptions& options);
+
+	// Computes the key for texture data built from the image file at path.  Throws glare::Exception if the file could not be read.
+	static uint64 computeKeyForFile(const std::string& path, const ProcessingOptions& options);
+
+	// Returns the cached texture data for key, or a null reference if there is none.
+	// Cache files that fail to load are removed from the cache.  Does not throw exceptions.
+	Reference<TextureData> lookup(uint64 key, glare::Allocator* mem_allocator = NULL);
+
+	// Returns true if texture_data is of a kind that can be stored in the cache.
+	static bool canCache(const TextureData& texture_data);
+
+	// Writes texture_data to the cache, then removes least recently used entries until the total size is <= max_size_B.
+	// Does nothing if canCache(texture_data) is false.  Throws glare::Exception if the cache file could not be written.
+	void insert(uint64 key, const TextureData& texture_data);
+
+	// Writes the LRU order of the entries to the index file.  Does not throw exceptions.
+	void saveIndex();
+
+	size_t numEntries() const;
+	size_t totalSizeB() const; // Total size of the cache files.
+	size_t maxSizeB() const { return max_size_B; }
+	const std::string& cacheDir() const { return cache_dir; }
+
+	const std::string cacheFilePath(uint64 key) const;
+
+	static void test();
+
+private:
+	void removeLRUEntriesUntilWithinBudget() REQUIRES(mutex);
+
+	std::string cache_dir;
+	size_t max_size_B;
+
+	mutable Mutex mutex;
+	LRUCache<uint64, uint64> entries GUARDED_BY(mutex); // Map from key to file size.  Item sizes are the file sizes.
+};
+
+
+typedef Reference<TextureDataCache> TextureDataCacheRef;
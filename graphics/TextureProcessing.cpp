@@ -18,370 +18,636 @@ Copyright Glare Technologies Limited 2022 -
 #include "../utils/ArrayRef.h"
 #include "../utils/RuntimeCheck.h"
 #include "../utils/IncludeHalf.h"
+#include "../utils/PlatformUtils.h"
+#include "../utils/Exception.h"
+#include "../maths/Vec4f.h"
 #include <vector>
+#include <cmath>
 #include <graphics/CompressedImage.h>
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 
-// Downsize previous mip level image to current mip level.
-// Just uses kinda crappy 2x2 pixel box filter.
-// alpha_coverage_out: frac of pixels with alpha >= 0.5, set if N == 4.
-// N = num components per pixel.
-void TextureProcessing::downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const uint8* prev_level_image_data, float alpha_scale, size_t level_W, size_t level_H,
-	uint8* data_out, float& alpha_coverage_out)
-{
-	Timer timer;
-	uint8* const dst_data = data_out;
-	const uint8* const src_data = prev_level_image_data;
-	const size_t src_W = prev_W;
-	const size_t src_H = prev_H;
-
-	// Because the new width is max(1, floor(old_width/2)), we have old_width >= new_width*2 in all cases apart from when old_width = 1.
-	// If old_width >= new_width*2, then 
-	// old_width >= (new_width-1)*2 + 2
-	// old_width > (new_width-1)*2 + 1
-	// (new_width-1)*2 + 1 < old_width
-	// in other words the support pixels of the box filter are guaranteed to be in range (< old_width)
-	// Likewise for old height etc..
-	assert((src_W == 1) || ((level_W - 1) * 2 + 1 < src_W));
-	assert((src_H == 1) || ((level_H - 1) * 2 + 1 < src_H));
+//=========================================== Mip-map downsampling ===========================================
+//
+// Each mip level is computed from the previous level, with width max(1, floor(old_width/2)) and height max(1, floor(old_height/2)).
+// Output pixel (x, y) is centred on the corner between source pixels (2x, 2y) and (2x+1, 2y+1).
+//
+// Because the new width is max(1, floor(old_width/2)), we have old_width >= new_width*2 in all cases apart from when old_width = 1.
+// If old_width >= new_width*2, then
+// old_width >= (new_width-1)*2 + 2
+// old_width > (new_width-1)*2 + 1
+// (new_width-1)*2 + 1 < old_width
+// in other words the support pixels of the box filter are guaranteed to be in range (< old_width)
+// Likewise for old height etc..
+//
+// When the old width (or height) is 1, the same source column (or row) is used for both pixels of the box filter.
+//
+// Output rows are computed in blocks, which are processed in parallel if a task manager is given.
+
+
+static const size_t MIPMAP_MIN_PIXELS_PER_BLOCK = 1 << 14; // Minimum number of output pixels per block of rows.
+
 
-	assert(N == 1 || N == 3 || N == 4);
-	if(N == 1)
+static inline size_t mipMapRowsPerBlock(size_t level_W)
+{
+	return myMax<size_t>(1, MIPMAP_MIN_PIXELS_PER_BLOCK / level_W);
+}
+
+
+static inline size_t mipMapNumRowBlocks(size_t level_W, size_t level_H)
+{
+	return Maths::roundedUpDivide(level_H, mipMapRowsPerBlock(level_W));
+}
+
+
+// Calls func(y_begin, y_end, block_index) for each block of output rows.
+// Blocks are processed in parallel on task_manager if it is non-null and there is more than one block.
+template <class BlockFunc>
+static void forEachMipMapRowBlock(size_t level_W, size_t level_H, glare::TaskManager* task_manager, const BlockFunc& func)
+{
+	const size_t rows_per_block = mipMapRowsPerBlock(level_W);
+	const size_t num_blocks = mipMapNumRowBlocks(level_W, level_H);
+
+	if(task_manager && num_blocks > 1)
 	{
-		if(src_W == 1)
+		task_manager->runParallelForDynamic([&](size_t block_begin, size_t block_end, size_t /*thread_index*/)
 		{
-			// This is 1xN texture being downsized to 1xfloor(N/2)
-			assert(level_W == 1 && src_H > 1);
-			assert((level_H - 1) * 2 + 1 < src_H);
+			for(size_t b=block_begin; b<block_end; ++b)
+				func(b * rows_per_block, myMin(level_H, (b + 1) * rows_per_block), b);
+		}, /*begin=*/0, /*end=*/num_blocks, /*grain_size=*/1);
+	}
+	else
+	{
+		for(size_t b=0; b<num_blocks; ++b)
+			func(b * rows_per_block, myMin(level_H, (b + 1) * rows_per_block), b);
+	}
+}
 
-			for(int y=0; y<(int)level_H; ++y)
-			{
-				int val[1] = { 0 };
-				size_t sx = 0;
-				size_t sy = y*2;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-				}
-				sy = y*2 + 1;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-				}
-				uint8* const dest_pixel = dst_data + (0 + level_W * y) * N;
-				dest_pixel[0] = (uint8)(val[0] / 2);
-			}
-		}
-		else if(src_H == 1)
-		{
-			// This is Nx1 texture being downsized to floor(N/2)x1
-			assert(level_H == 1 && src_W > 1);
-			assert((level_W - 1) * 2 + 1 < src_W);
 
-			for(int x=0; x<(int)level_W; ++x)
-			{
-				int val[1] = { 0 };
-				int sx = x*2;
-				int sy = 0;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-				}
-				sx = x*2 + 1;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-				}
-				uint8* const dest_pixel = dst_data + (x + level_W * 0) * N;
-				dest_pixel[0] = (uint8)(val[0] / 2);
-			}
+static bool isAVX2Supported()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	static bool checked = false;
+	static bool supported = false;
+	if(!checked)
+	{
+		try
+		{
+			PlatformUtils::CPUInfo cpu_info;
+			PlatformUtils::getCPUInfo(cpu_info);
+			supported = cpu_info.avx2 && cpu_info.fma;
 		}
-		else
+		catch(glare::Exception&)
 		{
-			assert(src_W >= 2 && src_H >= 2);
-			assert((level_W - 1) * 2 + 1 < src_W);
-			assert((level_H - 1) * 2 + 1 < src_H);
-
-			// In this case all reads should be in-bounds
-			for(int y=0; y<(int)level_H; ++y)
-				for(int x=0; x<(int)level_W; ++x)
-				{
-					int val[1] = { 0 };
-					int sx = x*2;
-					int sy = y*2;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-					}
-					sx = x*2 + 1;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-					}
-					sx = x*2;
-					sy = y*2 + 1;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-					}
-					sx = x*2 + 1;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-					}
-
-					uint8* const dest_pixel = dst_data + (x + level_W * y) * N;
-					dest_pixel[0] = (uint8)(val[0] / 4);
-				}
+			supported = false;
 		}
+		checked = true;
+	}
+	return supported;
+#else
+	return false;
+#endif
+}
+
+
+// Per-component-type operations used by the generic filter code.
+template <class T> struct MipMapComponentTraits;
+
+template <> struct MipMapComponentTraits<uint8>
+{
+	static GLARE_STRONG_INLINE uint8 boxAverage(uint8 a, uint8 b, uint8 c, uint8 d) { return (uint8)(((uint32)a + (uint32)b + (uint32)c + (uint32)d) >> 2); }
+	static GLARE_STRONG_INLINE float toFloat(uint8 x) { return (float)x; }
+	static GLARE_STRONG_INLINE uint8 fromFloat(float x) { return (uint8)myClamp(x + 0.5f, 0.f, 255.f); }
+};
+
+template <> struct MipMapComponentTraits<uint16>
+{
+	static GLARE_STRONG_INLINE uint16 boxAverage(uint16 a, uint16 b, uint16 c, uint16 d) { return (uint16)(((uint32)a + (uint32)b + (uint32)c + (uint32)d) >> 2); }
+	static GLARE_STRONG_INLINE float toFloat(uint16 x) { return (float)x; }
+	static GLARE_STRONG_INLINE uint16 fromFloat(float x) { return (uint16)myClamp(x + 0.5f, 0.f, 65535.f); }
+};
+
+template <> struct MipMapComponentTraits<half>
+{
+	static GLARE_STRONG_INLINE half boxAverage(half a, half b, half c, half d) { return half((((float)a + (float)b) + ((float)c + (float)d)) * 0.25f); }
+	static GLARE_STRONG_INLINE float toFloat(half x) { return (float)x; }
+	static GLARE_STRONG_INLINE half fromFloat(float x) { return half(x); }
+};
+
+template <> struct MipMapComponentTraits<float>
+{
+	static GLARE_STRONG_INLINE float boxAverage(float a, float b, float c, float d) { return ((a + b) + (c + d)) * 0.25f; }
+	static GLARE_STRONG_INLINE float toFloat(float x) { return x; }
+	static GLARE_STRONG_INLINE float fromFloat(float x) { return x; }
+};
+
+
+//------------------------------------------- Box filter row kernels -------------------------------------------
+// Each kernel computes a prefix of an output row from source rows row0 and row1, where the source image width is >= 2, and returns the number of output pixels written.
+// The rest of the row is done by boxFilterRows().
+
+
+// 4 output pixels per iteration.
+static size_t boxFilterRowUInt8RGBA(const uint8* row0, const uint8* row1, size_t level_W, uint8* dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t x = 0;
+	for(; x + 4 <= level_W; x += 4)
+	{
+		const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8)); // Source pixels 0-3
+		const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16)); // Source pixels 4-7
+		const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+		const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+
+		// Vertical sums of source pixels, as 16-bit values
+		const __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero)); // [s0, s1]
+		const __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero)); // [s2, s3]
+		const __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+		const __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+		// Horizontal sums
+		const __m128i o01 = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23)); // [s0 + s1, s2 + s3]
+		const __m128i o23 = _mm_add_epi16(_mm_unpacklo_epi64(s45, s67), _mm_unpackhi_epi64(s45, s67));
+
+		_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(_mm_srli_epi16(o01, 2), _mm_srli_epi16(o23, 2)));
+	}
+	return x;
+}
+
+
+// 16 output pixels per iteration.
+static size_t boxFilterRowUInt8Grey(const uint8* row0, const uint8* row1, size_t level_W, uint8* dst)
+{
+	const __m128i low_byte_mask = _mm_set1_epi16(0xFF);
+	size_t x = 0;
+	for(; x + 16 <= level_W; x += 16)
+	{
+		const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 2));
+		const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 2 + 16));
+		const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 2));
+		const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 2 + 16));
+
+		// Sum even and odd source pixels, as 16-bit values.
+		const __m128i o0 = _mm_add_epi16(
+			_mm_add_epi16(_mm_and_si128(a0, low_byte_mask), _mm_srli_epi16(a0, 8)),
+			_mm_add_epi16(_mm_and_si128(b0, low_byte_mask), _mm_srli_epi16(b0, 8))
+		);
+		const __m128i o1 = _mm_add_epi16(
+			_mm_add_epi16(_mm_and_si128(a1, low_byte_mask), _mm_srli_epi16(a1, 8)),
+			_mm_add_epi16(_mm_and_si128(b1, low_byte_mask), _mm_srli_epi16(b1, 8))
+		);
+
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(_mm_srli_epi16(o0, 2), _mm_srli_epi16(o1, 2)));
 	}
+	return x;
+}
+
+
+// 2 output pixels per iteration.  Each iteration reads 16 bytes (5 and a third source pixels) from each row, and writes 8 bytes, the last 2 of which are overwritten by the next iteration or the caller.
+static size_t boxFilterRowUInt8RGB(const uint8* row0, const uint8* row1, size_t level_W, uint8* dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i first_pixel_mask = _mm_setr_epi16(-1, -1, -1, 0, 0, 0, 0, 0);
+	size_t x = 0;
+	for(; x + 3 <= level_W; x += 2) // Reads up to source byte 6x + 16 <= 6 * level_W <= 3 * src_W, writes up to byte 3x + 8 <= 3 * level_W.
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 6));
+		const __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 6));
+
+		// Vertical sums of source pixels 0, 1 (and part of 2), and of source pixels 2, 3 (and part of 4), as 16-bit values.
+		const __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		const __m128i s23 = _mm_add_epi16(_mm_unpacklo_epi8(_mm_srli_si128(a, 6), zero), _mm_unpacklo_epi8(_mm_srli_si128(b, 6), zero));
+
+		// Horizontal sums, in the first 3 16-bit elements.
+		const __m128i o0 = _mm_add_epi16(s01, _mm_srli_si128(s01, 6));
+		const __m128i o1 = _mm_add_epi16(s23, _mm_srli_si128(s23, 6));
+
+		const __m128i o01 = _mm_or_si128(_mm_and_si128(o0, first_pixel_mask), _mm_slli_si128(_mm_and_si128(o1, first_pixel_mask), 6));
+
+		_mm_storel_epi64((__m128i*)(dst + x * 3), _mm_packus_epi16(_mm_srli_epi16(o01, 2), zero));
+	}
+	return x;
+}
+
+
+static size_t boxFilterRowFloatRGBA(const float* row0, const float* row1, size_t level_W, float* dst)
+{
+	const Vec4f quarter(0.25f);
+	for(size_t x=0; x<level_W; ++x)
+	{
+		const Vec4f sum = (loadUnalignedVec4f(row0 + x * 8) + loadUnalignedVec4f(row0 + x * 8 + 4)) + (loadUnalignedVec4f(row1 + x * 8) + loadUnalignedVec4f(row1 + x * 8 + 4));
+		storeVec4fUnaligned(sum * quarter, dst + x * 4);
+	}
+	return level_W;
+}
+
+
+// 4 output pixels per iteration.
+static size_t boxFilterRowFloatGrey(const float* row0, const float* row1, size_t level_W, float* dst)
+{
+	const Vec4f quarter(0.25f);
+	size_t x = 0;
+	for(; x + 4 <= level_W; x += 4)
+	{
+		const Vec4f a0 = loadUnalignedVec4f(row0 + x * 2);
+		const Vec4f a1 = loadUnalignedVec4f(row0 + x * 2 + 4);
+		const Vec4f b0 = loadUnalignedVec4f(row1 + x * 2);
+		const Vec4f b1 = loadUnalignedVec4f(row1 + x * 2 + 4);
+		const Vec4f a_sum = shuffle<0, 2, 0, 2>(a0, a1) + shuffle<1, 3, 1, 3>(a0, a1); // Sum even and odd source pixels
+		const Vec4f b_sum = shuffle<0, 2, 0, 2>(b0, b1) + shuffle<1, 3, 1, 3>(b0, b1);
+		storeVec4fUnaligned((a_sum + b_sum) * quarter, dst + x);
+	}
+	return x;
+}
+
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+// Same as boxFilterRowUInt8RGBA but with AVX2, 8 output pixels per iteration.
+// Only called if isAVX2Supported() returns true.
+GLARE_TARGET_AVX2 static size_t boxFilterRowUInt8RGBAAVX2(const uint8* row0, const uint8* row1, size_t level_W, uint8* dst)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	size_t x = 0;
+	for(; x + 8 <= level_W; x += 8)
+	{
+		const __m256i a0 = _mm256_loadu_si256((const __m256i*)(row0 + x * 8)); // Source pixels 0-7
+		const __m256i a1 = _mm256_loadu_si256((const __m256i*)(row0 + x * 8 + 32)); // Source pixels 8-15
+		const __m256i b0 = _mm256_loadu_si256((const __m256i*)(row1 + x * 8));
+		const __m256i b1 = _mm256_loadu_si256((const __m256i*)(row1 + x * 8 + 32));
+
+		// Unpacks work within 128-bit lanes, so these are [s0, s1 | s4, s5] and [s2, s3 | s6, s7].
+		const __m256i sa_lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a0, zero), _mm256_unpacklo_epi8(b0, zero));
+		const __m256i sa_hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a0, zero), _mm256_unpackhi_epi8(b0, zero));
+		const __m256i sb_lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a1, zero), _mm256_unpacklo_epi8(b1, zero));
+		const __m256i sb_hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a1, zero), _mm256_unpackhi_epi8(b1, zero));
+
+		const __m256i o_a = _mm256_add_epi16(_mm256_unpacklo_epi64(sa_lo, sa_hi), _mm256_unpackhi_epi64(sa_lo, sa_hi)); // [o0, o1 | o2, o3]
+		const __m256i o_b = _mm256_add_epi16(_mm256_unpacklo_epi64(sb_lo, sb_hi), _mm256_unpackhi_epi64(sb_lo, sb_hi)); // [o4, o5 | o6, o7]
+
+		const __m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(o_a, 2), _mm256_srli_epi16(o_b, 2)); // [o0, o1, o4, o5 | o2, o3, o6, o7]
+		_mm256_storeu_si256((__m256i*)(dst + x * 4), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	return x;
+}
+
+
+// Same as boxFilterRowUInt8Grey but with AVX2, 32 output pixels per iteration.
+// Only called if isAVX2Supported() returns true.
+GLARE_TARGET_AVX2 static size_t boxFilterRowUInt8GreyAVX2(const uint8* row0, const uint8* row1, size_t level_W, uint8* dst)
+{
+	const __m256i low_byte_mask = _mm256_set1_epi16(0xFF);
+	size_t x = 0;
+	for(; x + 32 <= level_W; x += 32)
+	{
+		const __m256i a0 = _mm256_loadu_si256((const __m256i*)(row0 + x * 2));
+		const __m256i a1 = _mm256_loadu_si256((const __m256i*)(row0 + x * 2 + 32));
+		const __m256i b0 = _mm256_loadu_si256((const __m256i*)(row1 + x * 2));
+		const __m256i b1 = _mm256_loadu_si256((const __m256i*)(row1 + x * 2 + 32));
+
+		const __m256i o0 = _mm256_add_epi16(
+			_mm256_add_epi16(_mm256_and_si256(a0, low_byte_mask), _mm256_srli_epi16(a0, 8)),
+			_mm256_add_epi16(_mm256_and_si256(b0, low_byte_mask), _mm256_srli_epi16(b0, 8))
+		);
+		const __m256i o1 = _mm256_add_epi16(
+			_mm256_add_epi16(_mm256_and_si256(a1, low_byte_mask), _mm256_srli_epi16(a1, 8)),
+			_mm256_add_epi16(_mm256_and_si256(b1, low_byte_mask), _mm256_srli_epi16(b1, 8))
+		);
+
+		const __m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(o0, 2), _mm256_srli_epi16(o1, 2)); // [o0-7, o16-23 | o8-15, o24-31]
+		_mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+	return x;
+}
+
+#endif // defined(_M_X64) || defined(__x86_64__)
+
+
+static size_t boxFilterRowSIMD(const uint8* row0, const uint8* row1, size_t N, size_t level_W, uint8* dst, bool use_avx2)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	if(use_avx2)
+	{
+		if(N == 4)
+			return boxFilterRowUInt8RGBAAVX2(row0, row1, level_W, dst);
+		else if(N == 1)
+			return boxFilterRowUInt8GreyAVX2(row0, row1, level_W, dst);
+	}
+#endif
+	if(N == 4)
+		return boxFilterRowUInt8RGBA(row0, row1, level_W, dst);
 	else if(N == 3)
+		return boxFilterRowUInt8RGB(row0, row1, level_W, dst);
+	else if(N == 1)
+		return boxFilterRowUInt8Grey(row0, row1, level_W, dst);
+	return 0;
+}
+
+static size_t boxFilterRowSIMD(const float* row0, const float* row1, size_t N, size_t level_W, float* dst, bool /*use_avx2*/)
+{
+	if(N == 4)
+		return boxFilterRowFloatRGBA(row0, row1, level_W, dst);
+	else if(N == 1)
+		return boxFilterRowFloatGrey(row0, row1, level_W, dst);
+	return 0;
+}
+
+// No SIMD kernels for 16-bit and half images, which aren't used for the mip-mapped texture formats currently.
+static size_t boxFilterRowSIMD(const uint16* /*row0*/, const uint16* /*row1*/, size_t /*N*/, size_t /*level_W*/, uint16* /*dst*/, bool /*use_avx2*/) { return 0; }
+static size_t boxFilterRowSIMD(const half* /*row0*/, const half* /*row1*/, size_t /*N*/, size_t /*level_W*/, half* /*dst*/, bool /*use_avx2*/) { return 0; }
+
+
+// Computes output rows [y_begin, y_end) with a 2x2 box filter.
+template <class T>
+static void boxFilterRows(const T* src, size_t src_W, size_t src_H, size_t N, size_t level_W, T* dst, size_t y_begin, size_t y_end, bool use_avx2)
+{
+	const size_t dx = (src_W == 1) ? 0 : N; // Offset of the second source pixel in each row.
+	for(size_t y=y_begin; y<y_end; ++y)
 	{
-		if(src_W == 1)
-		{
-			// This is 1xN texture being downsized to 1xfloor(N/2)
-			assert(level_W == 1 && src_H > 1);
-			assert((level_H - 1) * 2 + 1 < src_H);
+		const T* const row0 = src + src_W * N * ((src_H == 1) ? 0 : (y * 2));
+		const T* const row1 = src + src_W * N * ((src_H == 1) ? 0 : (y * 2 + 1));
+		T* const dst_row = dst + level_W * N * y;
 
-			for(int y=0; y<(int)level_H; ++y)
+		const size_t simd_end = (src_W >= 2) ? boxFilterRowSIMD(row0, row1, N, level_W, dst_row, use_avx2) : 0;
+
+		for(size_t x=simd_end; x<level_W; ++x)
+			for(size_t c=0; c<N; ++c)
 			{
-				int val[3] = { 0, 0, 0 };
-				size_t sx = 0;
-				size_t sy = y*2;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-					val[1] += src[1];
-					val[2] += src[2];
-				}
-				sy = y*2 + 1;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-					val[1] += src[1];
-					val[2] += src[2];
-				}
-				uint8* const dest_pixel = dst_data + (0 + level_W * y) * N;
-				dest_pixel[0] = (uint8)(val[0] / 2);
-				dest_pixel[1] = (uint8)(val[1] / 2);
-				dest_pixel[2] = (uint8)(val[2] / 2);
+				const size_t i = x * 2 * N + c;
+				dst_row[x * N + c] = MipMapComponentTraits<T>::boxAverage(row0[i], row0[i + dx], row1[i], row1[i + dx]);
 			}
-		}
-		else if(src_H == 1)
+	}
+}
+
+
+//------------------------------------------- Lanczos filter -------------------------------------------
+// Output pixel x is centred between source pixels 2x and 2x+1, so takes source pixels 2x-3 ... 2x+4, at offsets -3.5 ... 3.5 from the centre.
+// Source coordinates are clamped to the image edges.
+
+static const int LANCZOS_NUM_TAPS = 8;
+
+static inline double lanczosSinc(double x)
+{
+	return (x == 0) ? 1.0 : (std::sin(Maths::pi<double>() * x) / (Maths::pi<double>() * x));
+}
+
+struct LanczosWeights
+{
+	LanczosWeights()
+	{
+		// Lanczos-2 kernel, stretched by 2 for the 2x downsampling: w(d) = sinc(d/2) sinc(d/4) for |d| < 4.
+		double sum = 0;
+		double w_d[LANCZOS_NUM_TAPS];
+		for(int k=0; k<LANCZOS_NUM_TAPS; ++k)
 		{
-			// This is Nx1 texture being downsized to floor(N/2)x1
-			assert(level_H == 1 && src_W > 1);
-			assert((level_W - 1) * 2 + 1 < src_W);
+			const double d = k - 3.5;
+			w_d[k] = lanczosSinc(d / 2) * lanczosSinc(d / 4);
+			sum += w_d[k];
+		}
+		for(int k=0; k<LANCZOS_NUM_TAPS; ++k)
+			w[k] = (float)(w_d[k] / sum); // Normalise so that flat regions are unchanged.
+	}
+
+	float w[LANCZOS_NUM_TAPS];
+};
+
+static const LanczosWeights lanczos_weights;
+
+
+static GLARE_STRONG_INLINE const Vec4f loadPixelAsVec4f(const uint8* p)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int32 v;
+	std::memcpy(&v, p, 4);
+	return Vec4f(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero)));
+}
+static GLARE_STRONG_INLINE const Vec4f loadPixelAsVec4f(const uint16* p) { return Vec4f(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128()))); }
+static GLARE_STRONG_INLINE const Vec4f loadPixelAsVec4f(const half* p) { return Vec4f((float)p[0], (float)p[1], (float)p[2], (float)p[3]); }
+static GLARE_STRONG_INLINE const Vec4f loadPixelAsVec4f(const float* p) { return loadUnalignedVec4f(p); }
+
 
-			for(int x=0; x<(int)level_W; ++x)
+// Filters source row src_row horizontally, writing level_W * N floats to row_out.
+template <class T>
+static void lanczosFilterRowHorizontally(const T* src_row, size_t src_W, size_t N, size_t level_W, float* row_out)
+{
+	const float* const w = lanczos_weights.w;
+	for(size_t x=0; x<level_W; ++x)
+	{
+		const bool interior = (x * 2 >= 3) && (x * 2 + 4 < src_W); // If all taps are in the image
+		if(N == 4)
+		{
+			Vec4f sum(0.f);
+			for(int k=0; k<LANCZOS_NUM_TAPS; ++k)
 			{
-				int val[3] = { 0, 0, 0 };
-				int sx = x*2;
-				int sy = 0;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-					val[1] += src[1];
-					val[2] += src[2];
-				}
-				sx = x*2 + 1;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-					val[1] += src[1];
-					val[2] += src[2];
-				}
-				uint8* const dest_pixel = dst_data + (x + level_W * 0) * N;
-				dest_pixel[0] = (uint8)(val[0] / 2);
-				dest_pixel[1] = (uint8)(val[1] / 2);
-				dest_pixel[2] = (uint8)(val[2] / 2);
+				const size_t sx = interior ? (x * 2 - 3 + k) : (size_t)myClamp<ptrdiff_t>((ptrdiff_t)(x * 2) - 3 + k, 0, (ptrdiff_t)src_W - 1);
+				sum += Vec4f(w[k]) * loadPixelAsVec4f(src_row + sx * 4);
 			}
+			storeVec4fUnaligned(sum, row_out + x * 4);
 		}
 		else
 		{
-			assert(src_W >= 2 && src_H >= 2);
-			assert((level_W - 1) * 2 + 1 < src_W);
-			assert((level_H - 1) * 2 + 1 < src_H);
-
-			// In this case all reads should be in-bounds
-			for(int y=0; y<(int)level_H; ++y)
-				for(int x=0; x<(int)level_W; ++x)
+			for(size_t c=0; c<N; ++c)
+			{
+				float sum = 0;
+				for(int k=0; k<LANCZOS_NUM_TAPS; ++k)
 				{
-					int val[3] = { 0, 0, 0 };
-					int sx = x*2;
-					int sy = y*2;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-						val[1] += src[1];
-						val[2] += src[2];
-					}
-					sx = x*2 + 1;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-						val[1] += src[1];
-						val[2] += src[2];
-					}
-					sx = x*2;
-					sy = y*2 + 1;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-						val[1] += src[1];
-						val[2] += src[2];
-					}
-					sx = x*2 + 1;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-						val[1] += src[1];
-						val[2] += src[2];
-					}
-
-					uint8* const dest_pixel = dst_data + (x + level_W * y) * N;
-					dest_pixel[0] = (uint8)(val[0] / 4);
-					dest_pixel[1] = (uint8)(val[1] / 4);
-					dest_pixel[2] = (uint8)(val[2] / 4);
+					const size_t sx = interior ? (x * 2 - 3 + k) : (size_t)myClamp<ptrdiff_t>((ptrdiff_t)(x * 2) - 3 + k, 0, (ptrdiff_t)src_W - 1);
+					sum += w[k] * MipMapComponentTraits<T>::toFloat(src_row[sx * N + c]);
 				}
+				row_out[x * N + c] = sum;
+			}
 		}
 	}
-	else // else if(N == 4):
+}
+
+
+static void storeFilteredRow(const float* row, size_t n, uint8* dst)
+{
+	const Vec4f half_vec(0.5f);
+	const Vec4f max_val(255.f);
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8)
 	{
-		int num_opaque_px = 0;
-		if(src_W == 1)
-		{
-			// This is 1xN texture being downsized to 1xfloor(N/2)
-			assert(level_W == 1 && src_H > 1);
-			assert((level_H - 1) * 2 + 1 < src_H);
+		const __m128i v0 = _mm_cvttps_epi32(min(max(loadUnalignedVec4f(row + i    ) + half_vec, Vec4f(0.f)), max_val).v);
+		const __m128i v1 = _mm_cvttps_epi32(min(max(loadUnalignedVec4f(row + i + 4) + half_vec, Vec4f(0.f)), max_val).v);
+		_mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_setzero_si128()));
+	}
+	for(; i<n; ++i)
+		dst[i] = MipMapComponentTraits<uint8>::fromFloat(row[i]);
+}
 
-			for(int y=0; y<(int)level_H; ++y)
-			{
-				int val[4] = { 0, 0, 0, 0 };
-				int sx = 0;
-				int sy = y*2;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-					val[1] += src[1];
-					val[2] += src[2];
-					val[3] += src[3];
-				}
-				sy = y*2 + 1;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-					val[1] += src[1];
-					val[2] += src[2];
-					val[3] += src[3];
-				}
-				uint8* const dest_pixel = dst_data + (0 + level_W * y) * N;
-				dest_pixel[0] = (uint8)(val[0] / 2);
-				dest_pixel[1] = (uint8)(val[1] / 2);
-				dest_pixel[2] = (uint8)(val[2] / 2);
-				dest_pixel[3] = (uint8)(myMin(255.f, alpha_scale * (val[3] / 2)));
-
-				if(dest_pixel[3] >= 186)
-					num_opaque_px++;
-			}
+template <class T>
+static void storeFilteredRow(const float* row, size_t n, T* dst)
+{
+	for(size_t i=0; i<n; ++i)
+		dst[i] = MipMapComponentTraits<T>::fromFloat(row[i]);
+}
+
+
+// Computes output rows [y_begin, y_end) with the Lanczos filter.
+// Source rows are first filtered horizontally into temp_rows, then the output rows are computed by filtering those vertically.
+template <class T>
+static void lanczosFilterRows(const T* src, size_t src_W, size_t src_H, size_t N, size_t level_W, T* dst, size_t y_begin, size_t y_end, js::Vector<float, 16>& temp_rows)
+{
+	const size_t row_size = level_W * N;
+	const ptrdiff_t src_y_begin = (ptrdiff_t)(y_begin * 2) - 3; // First source row needed, may be out of bounds.
+	const ptrdiff_t src_y_end   = (ptrdiff_t)(y_end * 2) + 3; // One past last source row needed.
+	const size_t num_temp_rows = (size_t)(src_y_end - src_y_begin);
+
+	temp_rows.resizeNoCopy(num_temp_rows * row_size + row_size); // Extra row for the vertically filtered result.
+	float* const filtered_row = temp_rows.data() + num_temp_rows * row_size;
+
+	for(ptrdiff_t sy=src_y_begin; sy<src_y_end; ++sy)
+	{
+		const size_t clamped_sy = (size_t)myClamp<ptrdiff_t>(sy, 0, (ptrdiff_t)src_H - 1);
+		lanczosFilterRowHorizontally(src + clamped_sy * src_W * N, src_W, N, level_W, temp_rows.data() + (sy - src_y_begin) * row_size);
+	}
+
+	const float* const w = lanczos_weights.w;
+	for(size_t y=y_begin; y<y_end; ++y)
+	{
+		const float* const rows = temp_rows.data() + (y - y_begin) * 2 * row_size; // Horizontally filtered source row 2y - 3.
+
+		size_t i = 0;
+		for(; i + 4 <= row_size; i += 4)
+		{
+			Vec4f sum(0.f);
+			for(int k=0; k<LANCZOS_NUM_TAPS; ++k)
+				sum += Vec4f(w[k]) * loadUnalignedVec4f(rows + k * row_size + i);
+			storeVec4fUnaligned(sum, filtered_row + i);
 		}
-		else if(src_H == 1)
+		for(; i<row_size; ++i)
 		{
-			// This is Nx1 texture being downsized to floor(N/2)x1
-			assert(level_H == 1 && src_W > 1);
-			assert((level_W - 1) * 2 + 1 < src_W);
-
-			for(int x=0; x<(int)level_W; ++x)
-			{
-				int val[4] = { 0, 0, 0, 0 };
-				int sx = x*2;
-				int sy = 0;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-					val[1] += src[1];
-					val[2] += src[2];
-					val[3] += src[3];
-				}
-				sx = x*2 + 1;
-				{
-					const uint8* src = src_data + (sx + src_W * sy) * N;
-					val[0] += src[0];
-					val[1] += src[1];
-					val[2] += src[2];
-					val[3] += src[3];
-				}
-				uint8* const dest_pixel = dst_data + (x + level_W * 0) * N;
-				dest_pixel[0] = (uint8)(val[0] / 2);
-				dest_pixel[1] = (uint8)(val[1] / 2);
-				dest_pixel[2] = (uint8)(val[2] / 2);
-				dest_pixel[3] = (uint8)(myMin(255.f, alpha_scale * (val[3] / 2)));
-
-				if(dest_pixel[3] >= 186)
-					num_opaque_px++;
-			}
+			float sum = 0;
+			for(int k=0; k<LANCZOS_NUM_TAPS; ++k)
+				sum += w[k] * rows[k * row_size + i];
+			filtered_row[i] = sum;
 		}
+
+		storeFilteredRow(filtered_row, row_size, dst + y * row_size);
+	}
+}
+
+
+template <class T>
+static void downSampleImage(size_t src_W, size_t src_H, size_t N, const T* src, MipMapFilter filter, size_t level_W, size_t level_H, T* dst, glare::TaskManager* task_manager,
+	std::vector<uint32>* block_alpha_histograms)
+{
+	assert((src_W == 1) || ((level_W - 1) * 2 + 1 < src_W));
+	assert((src_H == 1) || ((level_H - 1) * 2 + 1 < src_H));
+	assert(level_W == myMax<size_t>(1, src_W / 2) && level_H == myMax<size_t>(1, src_H / 2));
+
+	const bool use_avx2 = isAVX2Supported();
+
+	forEachMipMapRowBlock(level_W, level_H, task_manager, [&](size_t y_begin, size_t y_end, size_t block_i)
+	{
+		if(filter == MipMapFilter_Box)
+			boxFilterRows(src, src_W, src_H, N, level_W, dst, y_begin, y_end, use_avx2);
 		else
 		{
-			assert(src_W >= 2 && src_H >= 2);
-			assert((level_W - 1) * 2 + 1 < src_W);
-			assert((level_H - 1) * 2 + 1 < src_H);
+			js::Vector<float, 16> temp_rows;
+			lanczosFilterRows(src, src_W, src_H, N, level_W, dst, y_begin, y_end, temp_rows);
+		}
 
-			// In this case all reads should be in-bounds
-			for(int y=0; y<(int)level_H; ++y)
-				for(int x=0; x<(int)level_W; ++x)
-				{
-					int val[4] = { 0, 0, 0, 0 };
-					int sx = x*2;
-					int sy = y*2;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-						val[1] += src[1];
-						val[2] += src[2];
-						val[3] += src[3];
-					}
-					sx = x*2 + 1;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-						val[1] += src[1];
-						val[2] += src[2];
-						val[3] += src[3];
-					}
-					sx = x*2;
-					sy = y*2 + 1;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-						val[1] += src[1];
-						val[2] += src[2];
-						val[3] += src[3];
-					}
-					sx = x*2 + 1;
-					{
-						const uint8* src = src_data + (sx + src_W * sy) * N;
-						val[0] += src[0];
-						val[1] += src[1];
-						val[2] += src[2];
-						val[3] += src[3];
-					}
-
-					uint8* const dest_pixel = dst_data + (x + level_W * y) * N;
-					dest_pixel[0] = (uint8)(val[0] / 4);
-					dest_pixel[1] = (uint8)(val[1] / 4);
-					dest_pixel[2] = (uint8)(val[2] / 4);
-					dest_pixel[3] = (uint8)(myMin(255.f, alpha_scale * (val[3] / 4)));
-
-					if(dest_pixel[3] >= 186) // 186 = floor(256 * (0.5 ^ (1/2.2))), e.g. the value that when divided by 256 and then raised to the power of 2.2 (~ sRGB gamma), is 0.5.
-						num_opaque_px++;
-				}
+		// Build histogram of alpha values for this block, if requested.
+		if(block_alpha_histograms)
+		{
+			uint32* const hist = block_alpha_histograms->data() + block_i * 256;
+			const uint8* const block_data = (const uint8*)(dst + y_begin * level_W * N);
+			const size_t num_block_px = (y_end - y_begin) * level_W;
+			for(size_t i=0; i<num_block_px; ++i)
+				hist[block_data[i * 4 + 3]]++;
 		}
+	});
+}
+
 
-		alpha_coverage_out = num_opaque_px / (float)(level_W * level_H);
+static GLARE_STRONG_INLINE uint8 scaleAlpha(uint8 alpha, float alpha_scale)
+{
+	return (uint8)(myMin(255.f, alpha_scale * alpha));
+}
+
+
+// Returns the alpha coverage, see computeAlphaCoverage(), after scaling the alpha values with the given histogram by alpha_scale.
+static float alphaCoverageForScale(const uint32* alpha_histogram, size_t num_px, float alpha_scale)
+{
+	size_t num_opaque_px = 0;
+	for(int a=0; a<256; ++a)
+		if(scaleAlpha((uint8)a, alpha_scale) >= 186)
+			num_opaque_px += alpha_histogram[a];
+	return num_opaque_px / (float)num_px;
+}
+
+
+void TextureProcessing::downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const uint8* prev_level_image_data, MipMapFilter filter, float target_alpha_coverage, size_t level_W, size_t level_H,
+	uint8* data_out, float& alpha_coverage_out, glare::TaskManager* task_manager)
+{
+	assert(N >= 1 && N <= 4);
+
+	if(N != 4)
+	{
+		downSampleImage(prev_W, prev_H, N, prev_level_image_data, filter, level_W, level_H, data_out, task_manager, /*block_alpha_histograms=*/NULL);
+		return;
+	}
+
+	// Filter the image, while building histograms of the unscaled alpha values.
+	const size_t num_blocks = mipMapNumRowBlocks(level_W, level_H);
+	std::vector<uint32> block_alpha_histograms(num_blocks * 256, 0);
+	downSampleImage(prev_W, prev_H, N, prev_level_image_data, filter, level_W, level_H, data_out, task_manager, &block_alpha_histograms);
+
+	uint32 alpha_histogram[256];
+	for(int a=0; a<256; ++a)
+	{
+		uint32 count = 0;
+		for(size_t b=0; b<num_blocks; ++b)
+			count += block_alpha_histograms[b * 256 + a];
+		alpha_histogram[a] = count;
+	}
+
+	// Increase alpha scale until we get the same alpha coverage as the base LOD level. (See computeAlphaCoverage())
+	// The alpha coverage for each scale is computed from the histogram, so the image only needs to be filtered once.
+	const size_t num_px = level_W * level_H;
+	float alpha_scale = 1.f;
+	for(int i=0; i<8; ++i) // Bound max number of iters
+	{
+		alpha_coverage_out = alphaCoverageForScale(alpha_histogram, num_px, alpha_scale);
+		if((alpha_coverage_out >= 0.9f * target_alpha_coverage) || (i == 7))
+			break;
+		alpha_scale *= 1.1f;
 	}
 
-	//conPrint("downSampleToNextMipMapLevel took " + timer.elapsedString());
+	if(alpha_scale != 1.f)
+	{
+		uint8 alpha_table[256];
+		for(int a=0; a<256; ++a)
+			alpha_table[a] = scaleAlpha((uint8)a, alpha_scale);
+
+		forEachMipMapRowBlock(level_W, level_H, task_manager, [&](size_t y_begin, size_t y_end, size_t /*block_i*/)
+		{
+			for(size_t i=y_begin * level_W; i<y_end * level_W; ++i)
+				data_out[i * 4 + 3] = alpha_table[data_out[i * 4 + 3]];
+		});
+	}
+}
+
+
+void TextureProcessing::downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const uint16* prev_level_image_data, MipMapFilter filter, size_t level_W, size_t level_H, uint16* data_out, glare::TaskManager* task_manager)
+{
+	downSampleImage(prev_W, prev_H, N, prev_level_image_data, filter, level_W, level_H, data_out, task_manager, /*block_alpha_histograms=*/NULL);
+}
+
+
+void TextureProcessing::downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const half* prev_level_image_data, MipMapFilter filter, size_t level_W, size_t level_H, half* data_out, glare::TaskManager* task_manager)
+{
+	downSampleImage(prev_W, prev_H, N, prev_level_image_data, filter, level_W, level_H, data_out, task_manager, /*block_alpha_histograms=*/NULL);
+}
+
+
+void TextureProcessing::downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const float* prev_level_image_data, MipMapFilter filter, size_t level_W, size_t level_H, float* data_out, glare::TaskManager* task_manager)
+{
+	downSampleImage(prev_W, prev_H, N, prev_level_image_data, filter, level_W, level_H, data_out, task_manager, /*block_alpha_histograms=*/NULL);
 }
 
 
@@ -402,6 +668,29 @@ int TextureProcessing::computeNumMIPLevels(size_t W, size_t H)
 }
 
 
+static DXTCompression::BlockFormat blockFormatForTextureFormat(OpenGLTextureFormat format)
+{
+	switch(format)
+	{
+	case OpenGLTextureFormat::Format_Compressed_DXT_RGB_Uint8:
+	case OpenGLTextureFormat::Format_Compressed_DXT_SRGB_Uint8:
+		return DXTCompression::BlockFormat_BC1;
+	case OpenGLTextureFormat::Format_Compressed_DXT_RGBA_Uint8:
+	case OpenGLTextureFormat::Format_Compressed_DXT_SRGBA_Uint8:
+		return DXTCompression::BlockFormat_BC3;
+	case OpenGLTextureFormat::Format_Compressed_BC4_Uint8:
+		return DXTCompression::BlockFormat_BC4;
+	case OpenGLTextureFormat::Format_Compressed_BC5_Uint8:
+		return DXTCompression::BlockFormat_BC5;
+	case OpenGLTextureFormat::Format_Compressed_BC7_RGBA_Uint8:
+	case OpenGLTextureFormat::Format_Compressed_BC7_SRGBA_Uint8:
+		return DXTCompression::BlockFormat_BC7;
+	default:
+		throw glare::Exception("Unhandled format for block compression: " + std::string(textureFormatString(format)));
+	}
+}
+
+
 // Work out number of MIP levels we need, also work out byte offsets for the compressed data for each level, as we will store the compressed data for all MIP levels in one buffer.
 // Store the offsets in texture_data->level_offsets.
 // Also work out the sizes needed for the two temporary buffers which we will use for ping-ponging downsized data:
@@ -438,7 +727,7 @@ static void computeMipLevelOffsets(TextureData* texture_data, bool do_compressio
 		else if(k == 2)
 			temp_tex_buf_b_size_out = level_uncompressed_tex_size;
 
-		const size_t result_level_compressed_size = do_compression ? DXTCompression::getCompressedSizeBytes(level_W, level_H, bytes_pp) : level_uncompressed_tex_size;
+		const size_t result_level_compressed_size = do_compression ? DXTCompression::getCompressedSizeBytes(level_W, level_H, blockFormatForTextureFormat(texture_data->format)) : level_uncompressed_tex_size;
 
 		texture_data->level_offsets.push_back(TextureData::LevelOffsetData(cur_offset, result_level_compressed_size));
 
@@ -454,17 +743,42 @@ static void computeMipLevelOffsets(TextureData* texture_data, bool do_compressio
 See http://the-witness.net/news/2010/09/computing-alpha-mipmaps/ for the alpha coverage technique.
 Basically we want to scale up the alpha values for mip levels such that the overall fraction of pixels with alpha > 0.5 is the same as in the base mip level.
 */
-static float computeAlphaCoverage(const uint8* level_image_data, size_t level_W, size_t level_H)
+static float computeAlphaCoverage(const uint8* level_image_data, size_t level_W, size_t level_H, glare::TaskManager* task_manager)
 {
-	const int N = 4;
-	int num_opaque_px = 0;
-	for(int y=0; y<(int)level_H; ++y)
-	for(int x=0; x<(int)level_W; ++x)
+	const size_t num_blocks = mipMapNumRowBlocks(level_W, level_H);
+	std::vector<size_t> block_num_opaque_px(num_blocks, 0);
+
+	forEachMipMapRowBlock(level_W, level_H, task_manager, [&](size_t y_begin, size_t y_end, size_t block_i)
 	{
-		const uint8 alpha = level_image_data[(x + level_W * y) * N + 3];
-		if(alpha >= 186) // 186 = floor(256 * (0.5 ^ (1/2.2))), e.g. the value that when divided by 256 and then raised to the power of 2.2 (~ sRGB gamma), is 0.5.
-			num_opaque_px++;
-	}
+		const size_t begin = y_begin * level_W;
+		const size_t end = y_end * level_W;
+		const uint8* const data = level_image_data + begin * 4;
+		const size_t num_px = end - begin;
+
+		// Count pixels with alpha >= 186, 4 pixels at a time: alpha >= 186 iff max(alpha, 186) == alpha.
+		const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+		const __m128i threshold = _mm_set1_epi32((int)0xBA000000); // 186 = 0xBA
+		__m128i counts = _mm_setzero_si128();
+		size_t i = 0;
+		for(; i + 4 <= num_px; i += 4)
+		{
+			const __m128i alpha = _mm_and_si128(_mm_loadu_si128((const __m128i*)(data + i * 4)), alpha_mask);
+			counts = _mm_sub_epi32(counts, _mm_cmpeq_epi32(_mm_max_epu8(alpha, threshold), alpha)); // Subtracting -1 for each opaque pixel
+		}
+		uint32 count_vals[4];
+		_mm_storeu_si128((__m128i*)count_vals, counts);
+		size_t num_opaque_px = (size_t)count_vals[0] + count_vals[1] + count_vals[2] + count_vals[3];
+
+		for(; i<num_px; ++i)
+			if(data[i * 4 + 3] >= 186) // 186 = floor(256 * (0.5 ^ (1/2.2))), e.g. the value that when divided by 256 and then raised to the power of 2.2 (~ sRGB gamma), is 0.5.
+				num_opaque_px++;
+
+		block_num_opaque_px[block_i] = num_opaque_px;
+	});
+
+	size_t num_opaque_px = 0;
+	for(size_t b=0; b<num_blocks; ++b)
+		num_opaque_px += block_num_opaque_px[b];
 	return num_opaque_px / (float)(level_W * level_H);
 }
 
@@ -473,7 +787,7 @@ static float computeAlphaCoverage(const uint8* level_image_data, size_t level_W,
 // Stores the possibly-DXT compressed image data in texture_data->frames[cur_frame_i].compressed_data.
 // Uses task_manager for multi-threading if non-null.
 // Called by buildUInt8MapTextureData() and buildUInt8MapSequenceTextureData() to do the actual downsizing and compression work.
-void TextureProcessing::buildMipMapDataForImageFrame(bool do_compression, js::Vector<uint8, 16>& temp_tex_buf_a, js::Vector<uint8, 16>& temp_tex_buf_b, 
+void TextureProcessing::buildMipMapDataForImageFrame(bool do_compression, MipMapFilter mipmap_filter, const TextureCompressionOptions& compression_options, js::Vector<uint8, 16>& temp_tex_buf_a, js::Vector<uint8, 16>& temp_tex_buf_b, 
 	DXTCompression::TempData& compress_temp_data, TextureData* texture_data, size_t cur_frame_i, const ImageMapUInt8* source_image, glare::TaskManager* task_manager)
 {
 	const size_t W			= texture_data->W;
@@ -497,7 +811,7 @@ void TextureProcessing::buildMipMapDataForImageFrame(bool do_compression, js::Ve
 			level_uncompressed_data_size = source_image->getDataSize();
 
 			if(bytes_pp == 4)
-				level_0_alpha_coverage = computeAlphaCoverage(level_uncompressed_data, level_W, level_H);
+				level_0_alpha_coverage = computeAlphaCoverage(level_uncompressed_data, level_W, level_H, task_manager);
 		}
 		else
 		{
@@ -534,29 +848,10 @@ void TextureProcessing::buildMipMapDataForImageFrame(bool do_compression, js::Ve
 			}
 
 
-			// Increase alpha scale until we get the same alpha coverage as the base LOD level. (See comment above)
-			float alpha_scale = 1.f;
-			if(bytes_pp == 4)
-			{
-				for(int i=0; i<8; ++i) // Bound max number of iters
-				{
-					float alpha_coverage;
-					downSampleToNextMipMapLevel(prev_level_W, prev_level_H, bytes_pp, prev_level_uncompressed_data, alpha_scale, level_W, level_H, level_uncompressed_data, alpha_coverage);
-
-					// conPrint("Mipmap level " + toString(k) + ": Using alpha scale of " + doubleToStringNSigFigs(alpha_scale, 4) + " resulted in a alpha_coverage of " + doubleToStringNSigFigs(alpha_coverage, 4) + 
-					//	" (level_0_alpha_coverage: " + doubleToStringNSigFigs(level_0_alpha_coverage, 4) + ")");
-
-					if(alpha_coverage >= 0.9f * level_0_alpha_coverage)
-						break;
-
-					alpha_scale *= 1.1f;
-				}
-			}
-			else
-			{
-				float alpha_coverage;
-				downSampleToNextMipMapLevel(prev_level_W, prev_level_H, bytes_pp, prev_level_uncompressed_data, alpha_scale, level_W, level_H, level_uncompressed_data, alpha_coverage);
-			}
+			// For RGBA images, the alpha values are scaled to preserve the alpha coverage of the base LOD level. (See comment above)
+			float alpha_coverage;
+			downSampleToNextMipMapLevel(prev_level_W, prev_level_H, bytes_pp, prev_level_uncompressed_data, mipmap_filter, /*target_alpha_coverage=*/level_0_alpha_coverage, level_W, level_H, level_uncompressed_data, 
+				alpha_coverage, task_manager);
 		}
 
 		const size_t frame_offset_B = texture_data->frame_size_B * cur_frame_i;
@@ -565,10 +860,12 @@ void TextureProcessing::buildMipMapDataForImageFrame(bool do_compression, js::Ve
 		const size_t level_size   = texture_data->level_offsets[k].level_size;
 		if(do_compression)
 		{
-			runtimeCheck((level_size == DXTCompression::getCompressedSizeBytes(level_W, level_H, bytes_pp)) && 
+			const DXTCompression::BlockFormat block_format = blockFormatForTextureFormat(texture_data->format);
+			runtimeCheck((level_size == DXTCompression::getCompressedSizeBytes(level_W, level_H, block_format)) && 
 				(level_offset + level_size <= texture_data->mipmap_data.size()));
 
-			DXTCompression::compress(task_manager, compress_temp_data, level_W, level_H, bytes_pp, /*src data=*/level_uncompressed_data,
+			const DXTCompression::CompressOptions compress_options(block_format, compression_options.quality);
+			DXTCompression::compress(task_manager, compress_temp_data, compress_options, level_W, level_H, bytes_pp, /*src data=*/level_uncompressed_data,
 				/*dst data=*/&texture_data->mipmap_data[level_offset], /*dst size=*/level_size);
 		}
 		else
@@ -593,26 +890,27 @@ static Reference<ImageMapUInt8> convertUInt16ToUInt8ImageMap(const ImageMap<uint
 }
 
 
-Reference<TextureData> TextureProcessing::buildTextureData(const Map2D* map, glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps, bool convert_float_to_half)
+Reference<TextureData> TextureProcessing::buildTextureData(const Map2D* map, glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps, bool convert_float_to_half, MipMapFilter mipmap_filter, 
+	const TextureCompressionOptions& compression_options)
 {
 	if(dynamic_cast<const ImageMapUInt8*>(map))
 	{
 		const ImageMapUInt8* imagemap = static_cast<const ImageMapUInt8*>(map);
 
-		return buildUInt8MapTextureData(imagemap, general_mem_allocator, task_manager, allow_compression, build_mipmaps);
+		return buildUInt8MapTextureData(imagemap, general_mem_allocator, task_manager, allow_compression, build_mipmaps, mipmap_filter, compression_options);
 	}
 	else if(dynamic_cast<const ImageMapSequenceUInt8*>(map))
 	{
 		const ImageMapSequenceUInt8* imagemapseq = static_cast<const ImageMapSequenceUInt8*>(map);
 
-		return buildUInt8MapSequenceTextureData(imagemapseq, general_mem_allocator, task_manager, allow_compression, build_mipmaps);
+		return buildUInt8MapSequenceTextureData(imagemapseq, general_mem_allocator, task_manager, allow_compression, build_mipmaps, mipmap_filter, compression_options);
 	}
 	else if(dynamic_cast<const ImageMap<uint16, UInt16ComponentValueTraits>*>(map))
 	{
 		// Convert to 8-bit
 		Reference<ImageMapUInt8> im_map_uint8 = convertUInt16ToUInt8ImageMap(static_cast<const ImageMap<uint16, UInt16ComponentValueTraits>&>(*map));
 
-		return buildUInt8MapTextureData(im_map_uint8.ptr(), general_mem_allocator, task_manager, allow_compression, build_mipmaps);
+		return buildUInt8MapTextureData(im_map_uint8.ptr(), general_mem_allocator, task_manager, allow_compression, build_mipmaps, mipmap_filter, compression_options);
 	}
 	else if(dynamic_cast<const CompressedImage*>(map))
 	{
@@ -679,7 +977,7 @@ Reference<TextureData> TextureProcessing::buildTextureData(const Map2D* map, gla
 
 
 Reference<TextureData> TextureProcessing::buildUInt8MapTextureData(const ImageMapUInt8* imagemap, glare::Allocator* general_mem_allocator, 
-	glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps)
+	glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps, MipMapFilter mipmap_filter, const TextureCompressionOptions& compression_options)
 {
 	if(imagemap->getWidth() == 0 || imagemap->getHeight() == 0 || imagemap->getN() == 0)
 		throw glare::Exception("zero sized image not allowed.");
@@ -690,10 +988,15 @@ Reference<TextureData> TextureProcessing::buildUInt8MapTextureData(const ImageMa
 	if(general_mem_allocator)
 		texture_data->mipmap_data.setAllocator(general_mem_allocator);
 
-	// If we have a 1 or 2 bytes per pixel texture, convert to 3 or 4.
+	const bool is_one_dim_col_lookup_tex = (imagemap->getWidth() == 1) || (imagemap->getHeight() == 1); // Special case for palette textures: don't compress, since we can lose colours that way.
+	const bool can_compress = allow_compression && build_mipmaps && !is_one_dim_col_lookup_tex;
+	const bool use_BC4 = can_compress && compression_options.allow_BC4 && (imagemap->getN() == 1);
+	const bool use_BC5 = can_compress && compression_options.allow_BC5 && (imagemap->getN() == 2);
+
+	// If we have a 1 or 2 bytes per pixel texture, convert to 3 or 4, unless it will be compressed to BC4 or BC5.
 	// Handling such textures without converting them here would have to be done in the shaders, which we don't do currently.
 	Reference<const ImageMapUInt8> converted_image;
-	if(allow_compression && (imagemap->getN() == 1))
+	if(allow_compression && (imagemap->getN() == 1) && !use_BC4)
 	{
 		// Convert to RGB:
 		ImageMapUInt8Ref new_image = new ImageMapUInt8(imagemap->getWidth(), imagemap->getHeight(), 3);
@@ -709,7 +1012,7 @@ Reference<TextureData> TextureProcessing::buildUInt8MapTextureData(const ImageMa
 		}
 		converted_image = new_image;
 	}
-	else if(imagemap->getN() == 2)
+	else if((imagemap->getN() == 2) && !use_BC5)
 	{
 		// Convert to RGBA:
 		ImageMapUInt8Ref new_image = new ImageMapUInt8(imagemap->getWidth(), imagemap->getHeight(), 4);
@@ -730,7 +1033,11 @@ Reference<TextureData> TextureProcessing::buildUInt8MapTextureData(const ImageMa
 	else
 		converted_image = imagemap;
 
-	if(allow_compression)
+	if(use_BC4 || use_BC5)
+	{
+		// Single or two-channel image, will be compressed to BC4 or BC5.
+	}
+	else if(allow_compression)
 	{
 		if(converted_image->getN() != 3 && converted_image->getN() != 4)
 			throw glare::Exception("Doing compression: texture has unhandled number of components: " + toString(converted_image->getN()));
@@ -744,14 +1051,22 @@ Reference<TextureData> TextureProcessing::buildUInt8MapTextureData(const ImageMa
 	// Try and load as a DXT texture compression
 	const size_t W = converted_image->getWidth();
 	const size_t H = converted_image->getHeight();
-	const bool is_one_dim_col_lookup_tex = (W == 1) || (H == 1); // Special case for palette textures: don't compress, since we can lose colours that way.
 	texture_data->W = W;
 	texture_data->H = H;
 	if(build_mipmaps)
 	{
 		const bool do_compression = allow_compression && !is_one_dim_col_lookup_tex;
 		if(do_compression)
-			texture_data->format = (converted_image->getN() == 3) ? OpenGLTextureFormat::Format_Compressed_DXT_SRGB_Uint8 : OpenGLTextureFormat::Format_Compressed_DXT_SRGBA_Uint8;
+		{
+			if(use_BC4)
+				texture_data->format = OpenGLTextureFormat::Format_Compressed_BC4_Uint8;
+			else if(use_BC5)
+				texture_data->format = OpenGLTextureFormat::Format_Compressed_BC5_Uint8;
+			else if(converted_image->getN() == 3)
+				texture_data->format = OpenGLTextureFormat::Format_Compressed_DXT_SRGB_Uint8;
+			else
+				texture_data->format = compression_options.allow_BC7 ? OpenGLTextureFormat::Format_Compressed_BC7_SRGBA_Uint8 : OpenGLTextureFormat::Format_Compressed_DXT_SRGBA_Uint8;
+		}
 		else
 			texture_data->format = (converted_image->getN() == 1) ? OpenGLTextureFormat::Format_Greyscale_Uint8 : ((converted_image->getN() == 3) ? OpenGLTextureFormat::Format_SRGB_Uint8 : OpenGLTextureFormat::Format_SRGBA_Uint8);
 
@@ -766,7 +1081,7 @@ Reference<TextureData> TextureProcessing::buildUInt8MapTextureData(const ImageMa
 		texture_data->mipmap_data.resize(total_compressed_size);
 		texture_data->frame_size_B = total_compressed_size;
 
-		buildMipMapDataForImageFrame(/*total_compressed_size, */do_compression, temp_tex_buf_a, temp_tex_buf_b, compress_temp_data, texture_data.ptr(), /*cur frame i=*/0, /*source image=*/converted_image.ptr(), task_manager);
+		buildMipMapDataForImageFrame(/*total_compressed_size, */do_compression, mipmap_filter, compression_options, temp_tex_buf_a, temp_tex_buf_b, compress_temp_data, texture_data.ptr(), /*cur frame i=*/0, /*source image=*/converted_image.ptr(), task_manager);
 	}
 	else
 	{
@@ -782,7 +1097,7 @@ Reference<TextureData> TextureProcessing::buildUInt8MapTextureData(const ImageMa
 
 
 Reference<TextureData> TextureProcessing::buildUInt8MapSequenceTextureData(const ImageMapSequenceUInt8* seq, 
-	glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps)
+	glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps, MipMapFilter mipmap_filter, const TextureCompressionOptions& compression_options)
 {
 	if(seq->images.empty())
 		throw glare::Exception("empty image sequence");
@@ -806,7 +1121,12 @@ Reference<TextureData> TextureProcessing::buildUInt8MapSequenceTextureData(const
 
 	OpenGLTextureFormat format;
 	if(do_compression)
-		format = (imagemap_0->getN() == 3) ? OpenGLTextureFormat::Format_Compressed_DXT_SRGB_Uint8 : OpenGLTextureFormat::Format_Compressed_DXT_SRGBA_Uint8;
+	{
+		if(imagemap_0->getN() == 3)
+			format = OpenGLTextureFormat::Format_Compressed_DXT_SRGB_Uint8;
+		else
+			format = compression_options.allow_BC7 ? OpenGLTextureFormat::Format_Compressed_BC7_SRGBA_Uint8 : OpenGLTextureFormat::Format_Compressed_DXT_SRGBA_Uint8;
+	}
 	else
 		format = (imagemap_0->getN() == 3) ? OpenGLTextureFormat::Format_SRGB_Uint8 : OpenGLTextureFormat::Format_SRGBA_Uint8;
 	texture_data->format = format;
@@ -831,7 +1151,7 @@ Reference<TextureData> TextureProcessing::buildUInt8MapSequenceTextureData(const
 
 		if(build_mipmaps)
 		{
-			buildMipMapDataForImageFrame(do_compression, temp_tex_buf_a, temp_tex_buf_b, compress_temp_data, texture_data.ptr(), /*cur frame i=*/frame_i, /*source image=*/imagemap, task_manager);
+			buildMipMapDataForImageFrame(do_compression, mipmap_filter, compression_options, temp_tex_buf_a, temp_tex_buf_b, compress_temp_data, texture_data.ptr(), /*cur frame i=*/frame_i, /*source image=*/imagemap, task_manager);
 		}
 		else
 		{
@@ -8,20 +8,42 @@ Copyright Glare Technologies Limited 2022 -
 
 #include "TextureData.h"
 #include "ImageMap.h"
+#include "DXTCompression.h"
 #include "ImageMapSequence.h"
 #include "../utils/RefCounted.h"
 #include "../utils/ThreadSafeRefCounted.h"
 #include "../utils/Reference.h"
 #include "../utils/Mutex.h"
 #include "../utils/Vector.h"
+#include "../utils/IncludeHalf.h"
 #include <map>
 
 
-namespace DXTCompression { struct TempData; }
 namespace glare { class TaskManager; }
 namespace glare { class Allocator; }
 
 
+// Filter used to compute each mip level from the previous level.
+enum MipMapFilter
+{
+	MipMapFilter_Box, // 2x2 box filter.  Fastest.
+	MipMapFilter_Lanczos // Separable 8x8 tap Lanczos-2 filter.  Sharper mip levels, but much slower than the box filter.
+};
+
+
+// Controls which block compression formats are used for 8-bit images, when compression is allowed.
+// By default RGB images are compressed to BC1, and all other images are converted to RGB or RGBA and compressed to BC1 or BC3.
+struct TextureCompressionOptions
+{
+	TextureCompressionOptions() : allow_BC4(false), allow_BC5(false), allow_BC7(false), quality(DXTCompression::Quality_High) {}
+
+	bool allow_BC4; // Compress single channel images to BC4, instead of converting to RGB.
+	bool allow_BC5; // Compress two channel images to BC5, with the channels as red and green, instead of converting to grey + alpha RGBA.  For data textures such as normal maps.
+	bool allow_BC7; // Compress RGBA images to BC7 instead of BC3.
+	DXTCompression::Quality quality;
+};
+
+
 /*=====================================================================
 TextureProcessing
 -----------------
@@ -39,17 +61,32 @@ public:
 	// Builds compressed, mip-map level data, if applicable.
 	// Uses task_manager for multi-threading if non-null.
 	// May return a reference to imagemap in the returned TextureData.
-	static Reference<TextureData> buildTextureData(const Map2D* map2d, glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps, bool convert_float_to_half);
+	static Reference<TextureData> buildTextureData(const Map2D* map2d, glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps, bool convert_float_to_half,
+		MipMapFilter mipmap_filter = MipMapFilter_Box, const TextureCompressionOptions& compression_options = TextureCompressionOptions());
+
+	// Downsizes an image with N components per pixel to the next mip level, for 16-bit, half and float images.
+	// level_W and level_H should be max(1, prev_W / 2) and max(1, prev_H / 2).
+	// Uses task_manager for multi-threading if non-null.
+	static void downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const uint16* prev_level_image_data, MipMapFilter filter, size_t level_W, size_t level_H, uint16* data_out, glare::TaskManager* task_manager);
+	static void downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const half* prev_level_image_data, MipMapFilter filter, size_t level_W, size_t level_H, half* data_out, glare::TaskManager* task_manager);
+	static void downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const float* prev_level_image_data, MipMapFilter filter, size_t level_W, size_t level_H, float* data_out, glare::TaskManager* task_manager);
 
 private:
-	static Reference<TextureData> buildUInt8MapTextureData(const ImageMapUInt8* imagemap, glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps);
+	static Reference<TextureData> buildUInt8MapTextureData(const ImageMapUInt8* imagemap, glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps, 
+		MipMapFilter mipmap_filter, const TextureCompressionOptions& compression_options = TextureCompressionOptions());
 
 	// Builds compressed, mip-map level data for a sequence of images (e.g. animated gif)
-	static Reference<TextureData> buildUInt8MapSequenceTextureData(const ImageMapSequenceUInt8* imagemap, glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps);
+	static Reference<TextureData> buildUInt8MapSequenceTextureData(const ImageMapSequenceUInt8* imagemap, glare::Allocator* general_mem_allocator, glare::TaskManager* task_manager, bool allow_compression, bool build_mipmaps, 
+		MipMapFilter mipmap_filter, const TextureCompressionOptions& compression_options = TextureCompressionOptions());
 
-	static void downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const uint8* prev_level_image_data, float alpha_scale, size_t level_W, size_t level_H, uint8* data_out, float& alpha_coverage_out);
+	// Downsizes an 8-bit image with N components per pixel to the next mip level.
+	// If N == 4, alpha values are scaled up (by at most 1.1^7) until the alpha coverage is at least 0.9 * target_alpha_coverage (see computeAlphaCoverage() in TextureProcessing.cpp), 
+	// and alpha_coverage_out is set to the alpha coverage of the result.
+	// Uses task_manager for multi-threading if non-null.
+	static void downSampleToNextMipMapLevel(size_t prev_W, size_t prev_H, size_t N, const uint8* prev_level_image_data, MipMapFilter filter, float target_alpha_coverage, size_t level_W, size_t level_H, 
+		uint8* data_out, float& alpha_coverage_out, glare::TaskManager* task_manager);
 
 	// Uses task_manager for multi-threading if non-null.
-	static void buildMipMapDataForImageFrame(bool do_compression, js::Vector<uint8, 16>& temp_tex_buf_a, js::Vector<uint8, 16>& temp_tex_buf_b, 
+	static void buildMipMapDataForImageFrame(bool do_compression, MipMapFilter mipmap_filter, const TextureCompressionOptions& compression_options, js::Vector<uint8, 16>& temp_tex_buf_a, js::Vector<uint8, 16>& temp_tex_buf_b, 
 		DXTCompression::TempData& compress_temp_data, TextureData* texture_data, size_t cur_frame_i, const ImageMapUInt8* source_image, glare::TaskManager* task_manager);
 };
@@ -16,6 +16,7 @@ Copyright Glare Technologies Limited 2022 -
 #include "TextureProcessing.h"
 #include "ImageMap.h"
 #include "../maths/mathstypes.h"
+#include "../maths/PCG32.h"
 #include "../utils/TestUtils.h"
 #include "../utils/Timer.h"
 #include "../utils/Task.h"
@@ -24,10 +25,12 @@ Copyright Glare Technologies Limited 2022 -
 #include "../utils/ConPrint.h"
 #include "../utils/ArrayRef.h"
 #include "../utils/GeneralMemAllocator.h"
+#include <cmath>
+#include <cstring>
 
 
 // Generate mipmaps for grey texture, check mipmaps are still same grey value.
-void TextureProcessingTests::testDownSamplingGreyTexture(unsigned int W, unsigned int H, unsigned int N)
+void TextureProcessingTests::testDownSamplingGreyTexture(unsigned int W, unsigned int H, unsigned int N, MipMapFilter filter, glare::TaskManager* task_manager)
 {
 	ImageMapUInt8Ref map = new ImageMapUInt8(W, H, N);
 	map->set(128);
@@ -41,7 +44,7 @@ void TextureProcessingTests::testDownSamplingGreyTexture(unsigned int W, unsigne
 		Reference<ImageMapUInt8> mip_level_image = new ImageMapUInt8(level_W, level_H, N);
 		float alpha_coverage;
 		TextureProcessing::downSampleToNextMipMapLevel(prev_mip_level_image->getWidth(), prev_mip_level_image->getHeight(), prev_mip_level_image->getN(), prev_mip_level_image->getData(),
-			/*alpha scale=*/1.f, level_W, level_H, mip_level_image->getData(), alpha_coverage);
+			filter, /*target alpha coverage=*/0.f, level_W, level_H, mip_level_image->getData(), alpha_coverage, task_manager);
 
 		for(size_t i=0; i<mip_level_image->numPixels(); ++i)
 			for(unsigned int c=0; c<N; ++c)
@@ -55,7 +58,242 @@ void TextureProcessingTests::testDownSamplingGreyTexture(unsigned int W, unsigne
 }
 
 
-void TextureProcessingTests::testBuildingTexDataForImage(glare::Allocator* allocator, unsigned int W, unsigned int H, unsigned int N)
+static void makeRandomValue(PCG32& rng, uint8& x)  { x = (uint8)rng.nextUInt(256); }
+static void makeRandomValue(PCG32& rng, uint16& x) { x = (uint16)rng.nextUInt(65536); }
+static void makeRandomValue(PCG32& rng, half& x)   { x = half(rng.unitRandom() * 4.f - 1.f); }
+static void makeRandomValue(PCG32& rng, float& x)  { x = rng.unitRandom() * 4.f - 1.f; }
+
+// Box filter reference results, computed the same way as the original scalar code.
+static uint8  refBoxAverage(uint8 a, uint8 b, uint8 c, uint8 d)     { return (uint8)(((int)a + (int)b + (int)c + (int)d) / 4); }
+static uint16 refBoxAverage(uint16 a, uint16 b, uint16 c, uint16 d) { return (uint16)(((int)a + (int)b + (int)c + (int)d) / 4); }
+static half   refBoxAverage(half a, half b, half c, half d)         { return half((((float)a + (float)b) + ((float)c + (float)d)) * 0.25f); }
+static float  refBoxAverage(float a, float b, float c, float d)     { return ((a + b) + (c + d)) * 0.25f; }
+
+// Lanczos filter results are converted the same way as in TextureProcessing.cpp.  Max allowed differences from the reference results are returned by lanczosTolerance().
+static double refFromDouble(double x, uint8)  { return (double)(uint8)myClamp(x + 0.5, 0.0, 255.0); }
+static double refFromDouble(double x, uint16) { return (double)(uint16)myClamp(x + 0.5, 0.0, 65535.0); }
+static double refFromDouble(double x, half)   { return x; }
+static double refFromDouble(double x, float)  { return x; }
+static double lanczosTolerance(uint8)  { return 1.0; }
+static double lanczosTolerance(uint16) { return 1.0; }
+static double lanczosTolerance(half)   { return 4.0e-3; }
+static double lanczosTolerance(float)  { return 1.0e-4; }
+
+
+static double refLanczosWeight(int k)
+{
+	double w[8];
+	double sum = 0;
+	for(int i=0; i<8; ++i)
+	{
+		const double d = i - 3.5;
+		const double a = Maths::pi<double>() * d / 2;
+		const double b = Maths::pi<double>() * d / 4;
+		w[i] = (std::sin(a) / a) * (std::sin(b) / b);
+		sum += w[i];
+	}
+	return w[k] / sum;
+}
+
+
+// Checks downsample_func gives the same results as a simple scalar implementation, and gives the same results with and without a task manager.
+template <class T, class DownSampleFunc>
+static void checkDownSamplingMatchesReference(size_t W, size_t H, size_t N, MipMapFilter filter, glare::TaskManager* task_manager, DownSampleFunc downsample_func)
+{
+	const size_t level_W = myMax<size_t>(1, W / 2);
+	const size_t level_H = myMax<size_t>(1, H / 2);
+
+	PCG32 rng(1);
+	std::vector<T> src(W * H * N);
+	for(size_t i=0; i<src.size(); ++i)
+		makeRandomValue(rng, src[i]);
+
+	std::vector<T> dst(level_W * level_H * N);
+	downsample_func(W, H, N, src.data(), filter, level_W, level_H, dst.data(), task_manager);
+
+	// Check results are the same with no task manager
+	std::vector<T> dst_single_threaded(level_W * level_H * N);
+	downsample_func(W, H, N, src.data(), filter, level_W, level_H, dst_single_threaded.data(), /*task_manager=*/NULL);
+	testAssert(std::memcmp(dst.data(), dst_single_threaded.data(), dst.size() * sizeof(T)) == 0);
+
+	for(size_t y=0; y<level_H; ++y)
+	for(size_t x=0; x<level_W; ++x)
+	for(size_t c=0; c<N; ++c)
+	{
+		const T result = dst[(y * level_W + x) * N + c];
+		if(filter == MipMapFilter_Box)
+		{
+			const size_t sx0 = x * 2;
+			const size_t sx1 = (W == 1) ? 0 : (x * 2 + 1);
+			const size_t sy0 = (H == 1) ? 0 : (y * 2);
+			const size_t sy1 = (H == 1) ? 0 : (y * 2 + 1);
+			const T ref = refBoxAverage(src[(sy0 * W + sx0) * N + c], src[(sy0 * W + sx1) * N + c], src[(sy1 * W + sx0) * N + c], src[(sy1 * W + sx1) * N + c]);
+			testAssert(std::memcmp(&ref, &result, sizeof(T)) == 0);
+		}
+		else
+		{
+			double sum = 0;
+			for(int j=0; j<8; ++j)
+			for(int i=0; i<8; ++i)
+			{
+				const size_t sx = (size_t)myClamp<ptrdiff_t>((ptrdiff_t)x * 2 - 3 + i, 0, (ptrdiff_t)W - 1);
+				const size_t sy = (size_t)myClamp<ptrdiff_t>((ptrdiff_t)y * 2 - 3 + j, 0, (ptrdiff_t)H - 1);
+				sum += refLanczosWeight(i) * refLanczosWeight(j) * (double)(float)src[(sy * W + sx) * N + c];
+			}
+			const double ref = refFromDouble(sum, T());
+			testAssert(std::fabs((double)(float)result - ref) <= lanczosTolerance(T()));
+		}
+	}
+}
+
+
+void TextureProcessingTests::testDownSamplingMatchesReference(size_t W, size_t H, size_t N, glare::TaskManager* task_manager)
+{
+	for(int f=0; f<2; ++f)
+	{
+		const MipMapFilter filter = (f == 0) ? MipMapFilter_Box : MipMapFilter_Lanczos;
+
+		checkDownSamplingMatchesReference<uint8>(W, H, N, filter, task_manager, 
+			[](size_t prev_W, size_t prev_H, size_t N_, const uint8* src, MipMapFilter filter_, size_t level_W, size_t level_H, uint8* dst, glare::TaskManager* task_manager_)
+			{
+				float alpha_coverage;
+				TextureProcessing::downSampleToNextMipMapLevel(prev_W, prev_H, N_, src, filter_, /*target alpha coverage=*/0.f, level_W, level_H, dst, alpha_coverage, task_manager_); // Alpha scale will be 1
+			});
+
+		checkDownSamplingMatchesReference<uint16>(W, H, N, filter, task_manager, 
+			[](size_t prev_W, size_t prev_H, size_t N_, const uint16* src, MipMapFilter filter_, size_t level_W, size_t level_H, uint16* dst, glare::TaskManager* task_manager_)
+			{
+				TextureProcessing::downSampleToNextMipMapLevel(prev_W, prev_H, N_, src, filter_, level_W, level_H, dst, task_manager_);
+			});
+
+		checkDownSamplingMatchesReference<half>(W, H, N, filter, task_manager, 
+			[](size_t prev_W, size_t prev_H, size_t N_, const half* src, MipMapFilter filter_, size_t level_W, size_t level_H, half* dst, glare::TaskManager* task_manager_)
+			{
+				TextureProcessing::downSampleToNextMipMapLevel(prev_W, prev_H, N_, src, filter_, level_W, level_H, dst, task_manager_);
+			});
+
+		checkDownSamplingMatchesReference<float>(W, H, N, filter, task_manager, 
+			[](size_t prev_W, size_t prev_H, size_t N_, const float* src, MipMapFilter filter_, size_t level_W, size_t level_H, float* dst, glare::TaskManager* task_manager_)
+			{
+				TextureProcessing::downSampleToNextMipMapLevel(prev_W, prev_H, N_, src, filter_, level_W, level_H, dst, task_manager_);
+			});
+	}
+}
+
+
+// Check that the alpha scale chosen from the alpha histogram, and the resulting image, are the same as with the original method
+// of downsampling repeatedly with increasing alpha scales.
+void TextureProcessingTests::testAlphaCoverageScaling(size_t W, size_t H, glare::TaskManager* task_manager)
+{
+	const size_t level_W = myMax<size_t>(1, W / 2);
+	const size_t level_H = myMax<size_t>(1, H / 2);
+
+	PCG32 rng(1);
+	std::vector<uint8> src(W * H * 4);
+	for(size_t i=0; i<W * H; ++i)
+	{
+		for(int c=0; c<3; ++c)
+			src[i * 4 + c] = (uint8)rng.nextUInt(256);
+		src[i * 4 + 3] = (rng.unitRandom() < 0.5f) ? 255 : (uint8)rng.nextUInt(256);
+	}
+
+	// Compute reference box-filtered image with unscaled alpha
+	std::vector<uint8> ref_unscaled(level_W * level_H * 4);
+	for(size_t y=0; y<level_H; ++y)
+	for(size_t x=0; x<level_W; ++x)
+	for(size_t c=0; c<4; ++c)
+	{
+		const size_t sx1 = (W == 1) ? 0 : (x * 2 + 1);
+		const size_t sy0 = (H == 1) ? 0 : (y * 2);
+		const size_t sy1 = (H == 1) ? 0 : (y * 2 + 1);
+		ref_unscaled[(y * level_W + x) * 4 + c] = refBoxAverage(src[(sy0 * W + x * 2) * 4 + c], src[(sy0 * W + sx1) * 4 + c], src[(sy1 * W + x * 2) * 4 + c], src[(sy1 * W + sx1) * 4 + c]);
+	}
+
+	const float target_alpha_coverages[] = { 0.f, 0.5f, 0.7f, 0.9f, 1.f };
+	for(size_t t=0; t<staticArrayNumElems(target_alpha_coverages); ++t)
+	{
+		const float target_alpha_coverage = target_alpha_coverages[t];
+
+		// Compute reference result by trying successively larger alpha scales
+		std::vector<uint8> ref(level_W * level_H * 4);
+		float ref_alpha_coverage = 0;
+		float alpha_scale = 1.f;
+		for(int i=0; i<8; ++i)
+		{
+			size_t num_opaque_px = 0;
+			for(size_t z=0; z<level_W * level_H; ++z)
+			{
+				for(int c=0; c<3; ++c)
+					ref[z * 4 + c] = ref_unscaled[z * 4 + c];
+				ref[z * 4 + 3] = (uint8)(myMin(255.f, alpha_scale * ref_unscaled[z * 4 + 3]));
+				if(ref[z * 4 + 3] >= 186)
+					num_opaque_px++;
+			}
+			ref_alpha_coverage = num_opaque_px / (float)(level_W * level_H);
+			if(ref_alpha_coverage >= 0.9f * target_alpha_coverage)
+				break;
+			alpha_scale *= 1.1f;
+		}
+
+		std::vector<uint8> dst(level_W * level_H * 4);
+		float alpha_coverage;
+		TextureProcessing::downSampleToNextMipMapLevel(W, H, /*N=*/4, src.data(), MipMapFilter_Box, target_alpha_coverage, level_W, level_H, dst.data(), alpha_coverage, task_manager);
+
+		testAssert(alpha_coverage == ref_alpha_coverage);
+		testAssert(dst == ref);
+	}
+}
+
+
+// Measures downsampling throughput, in source MPixels/s.
+void TextureProcessingTests::perfTestDownSampling(glare::TaskManager& task_manager)
+{
+	const size_t W = 2048;
+	const size_t H = 2048;
+	const size_t level_W = W / 2;
+	const size_t level_H = H / 2;
+	const int num_trials = 10;
+
+	PCG32 rng(1);
+	std::vector<uint8> src_uint8(W * H * 4);
+	for(size_t i=0; i<src_uint8.size(); ++i)
+		makeRandomValue(rng, src_uint8[i]);
+	std::vector<float> src_float(W * H * 4);
+	for(size_t i=0; i<src_float.size(); ++i)
+		makeRandomValue(rng, src_float[i]);
+
+	std::vector<uint8> dst_uint8(level_W * level_H * 4);
+	std::vector<float> dst_float(level_W * level_H * 4);
+
+	for(int f=0; f<2; ++f)
+	for(int z=0; z<3; ++z) // For uint8 RGB, uint8 RGBA, float RGBA:
+	for(int t=0; t<2; ++t)
+	{
+		const MipMapFilter filter = (f == 0) ? MipMapFilter_Box : MipMapFilter_Lanczos;
+		glare::TaskManager* use_task_manager = (t == 0) ? NULL : &task_manager;
+
+		double min_time = 1.0e10;
+		for(int trial=0; trial<num_trials; ++trial)
+		{
+			Timer timer;
+			if(z == 0 || z == 1)
+			{
+				float alpha_coverage;
+				TextureProcessing::downSampleToNextMipMapLevel(W, H, /*N=*/(z == 0) ? 3 : 4, src_uint8.data(), filter, /*target alpha coverage=*/0.5f, level_W, level_H, dst_uint8.data(), alpha_coverage, use_task_manager);
+			}
+			else
+				TextureProcessing::downSampleToNextMipMapLevel(W, H, /*N=*/4, src_float.data(), filter, level_W, level_H, dst_float.data(), use_task_manager);
+			min_time = myMin(min_time, timer.elapsed());
+		}
+
+		const char* const type_names[] = { "uint8 RGB", "uint8 RGBA", "float RGBA" };
+		conPrint(std::string((filter == MipMapFilter_Box) ? "Box" : "Lanczos") + " downsampling " + toString(W) + "x" + toString(H) + " " + type_names[z] + 
+			((t == 0) ? " (single-threaded)" : " (multi-threaded)") + ": " + doubleToStringNSigFigs(min_time * 1.0e3, 4) + " ms (" + doubleToStringNSigFigs((W * H) / min_time * 1.0e-6, 4) + " MPixels/s)");
+	}
+}
+
+
+void TextureProcessingTests::testBuildingTexDataForImage(glare::Allocator* allocator, unsigned int W, unsigned int H, unsigned int N, const TextureCompressionOptions& compression_options)
 {
 	for(int i=0; i<2; ++i)
 	{
@@ -65,7 +303,48 @@ void TextureProcessingTests::testBuildingTexDataForImage(glare::Allocator* alloc
 
 		ImageMapUInt8Ref map = new ImageMapUInt8(W, H, N);
 		map->set(128);
-		Reference<TextureData> tex_data = TextureProcessing::buildUInt8MapTextureData(map.getPointer(), allocator, /*task manager=*/NULL, /*allow compression=*/allow_compression, /*build mipmaps=*/true);
+		Reference<TextureData> tex_data = TextureProcessing::buildUInt8MapTextureData(map.getPointer(), allocator, /*task manager=*/NULL, /*allow compression=*/allow_compression, /*build mipmaps=*/true, MipMapFilter_Box, 
+			compression_options);
+
+		testAssert(tex_data->isCompressed() == result_should_be_compressed);
+		if(result_should_be_compressed)
+		{
+			// Check the expected block compression format was used
+			OpenGLTextureFormat expected_format;
+			DXTCompression::BlockFormat block_format;
+			if(N == 1 && compression_options.allow_BC4)
+			{
+				expected_format = OpenGLTextureFormat::Format_Compressed_BC4_Uint8;
+				block_format = DXTCompression::BlockFormat_BC4;
+			}
+			else if(N == 2 && compression_options.allow_BC5)
+			{
+				expected_format = OpenGLTextureFormat::Format_Compressed_BC5_Uint8;
+				block_format = DXTCompression::BlockFormat_BC5;
+			}
+			else if(N == 1 || N == 3)
+			{
+				expected_format = OpenGLTextureFormat::Format_Compressed_DXT_SRGB_Uint8;
+				block_format = DXTCompression::BlockFormat_BC1;
+			}
+			else if(compression_options.allow_BC7)
+			{
+				expected_format = OpenGLTextureFormat::Format_Compressed_BC7_SRGBA_Uint8;
+				block_format = DXTCompression::BlockFormat_BC7;
+			}
+			else
+			{
+				expected_format = OpenGLTextureFormat::Format_Compressed_DXT_SRGBA_Uint8;
+				block_format = DXTCompression::BlockFormat_BC3;
+			}
+			testAssert(tex_data->format == expected_format);
+
+			// Decode the first block, check values are close to the source value.
+			uint8 rgba[64];
+			testAssert(DXTCompression::decompressBlock(block_format, &tex_data->mipmap_data[tex_data->level_offsets[0].offset], rgba));
+			for(size_t c=0; c<tex_data->numChannels(); ++c)
+				testAssert(std::abs((int)rgba[c] - 128) <= 1);
+		}
 
 		// Check MIP level offsets are valid
 		for(size_t k=0; k<tex_data->level_offsets.size(); ++k)
@@ -78,7 +357,8 @@ void TextureProcessingTests::testBuildingTexDataForImage(glare::Allocator* alloc
 			// Compute the size of the compressed data for this level
 			const size_t level_W = myMax((size_t)1, tex_data->W / ((size_t)1 << k));
 			const size_t level_H = myMax((size_t)1, tex_data->H / ((size_t)1 << k));
-			const size_t level_size = result_should_be_compressed ? DXTCompression::getCompressedSizeBytes(level_W, level_H, N) : (level_W * level_H * N);
+			const size_t level_size = result_should_be_compressed ? (Maths::roundedUpDivide<size_t>(level_W, 4) * Maths::roundedUpDivide<size_t>(level_H, 4) * bytesPerBlock(tex_data->format)) : 
+				(level_W * level_H * tex_data->numChannels());
 
 			testAssert(tex_data->level_offsets[k].level_size == level_size);
 
@@ -165,7 +445,7 @@ void TextureProcessingTests::testLoadingAnimatedFile(const std::string& path, gl
 			//	testAssert(seq->images[i]->getBytesPerPixel() == 3);
 			//}
 
-			Reference<TextureData> texdata = TextureProcessing::buildUInt8MapSequenceTextureData(seq, allocator, &task_manager, allow_compression, /*build_mipmaps=*/true);
+			Reference<TextureData> texdata = TextureProcessing::buildUInt8MapSequenceTextureData(seq, allocator, &task_manager, allow_compression, /*build_mipmaps=*/true, MipMapFilter_Box);
 
 			testAssert(texdata->W == seq->images[0]->getMapWidth());
 			testAssert(texdata->H == seq->images[0]->getMapHeight());
@@ -221,20 +501,63 @@ void TextureProcessingTests::test()
 	testBuildingTexDataForImage(allocator.ptr(), 256, 256, /*num components=*/1);
 	testBuildingTexDataForImage(allocator.ptr(), 256, 256, /*num components=*/2);
 
+	// Test with BC4, BC5 and BC7 compression allowed
+	{
+		TextureCompressionOptions compression_options;
+		compression_options.allow_BC4 = true;
+		compression_options.allow_BC5 = true;
+		compression_options.allow_BC7 = true;
+		compression_options.quality = DXTCompression::Quality_Normal;
+		for(unsigned int N=1; N<=4; ++N)
+		{
+			testBuildingTexDataForImage(allocator.ptr(), 250, 250, N, compression_options);
+			testBuildingTexDataForImage(allocator.ptr(), 7, 250, N, compression_options);
+			testBuildingTexDataForImage(allocator.ptr(), 1, 1, N, compression_options);
+		}
+	}
+
+
 
 
+	for(int f=0; f<2; ++f)
+	{
+		const MipMapFilter filter = (f == 0) ? MipMapFilter_Box : MipMapFilter_Lanczos;
+
+		testDownSamplingGreyTexture(256, 256, 3, filter, /*task manager=*/NULL);
+		testDownSamplingGreyTexture(250, 250, 3, filter, /*task manager=*/NULL);
+		testDownSamplingGreyTexture(250, 7, 3, filter, /*task manager=*/NULL);
+		testDownSamplingGreyTexture(7, 250, 3, filter, /*task manager=*/NULL);
+		testDownSamplingGreyTexture(2, 2, 3, filter, /*task manager=*/NULL);
+
+		testDownSamplingGreyTexture(256, 256, 4, filter, /*task manager=*/NULL);
+		testDownSamplingGreyTexture(250, 250, 4, filter, /*task manager=*/NULL);
+		testDownSamplingGreyTexture(250, 7, 3, filter, /*task manager=*/NULL);
+		testDownSamplingGreyTexture(7, 250, 4, filter, /*task manager=*/NULL);
+		testDownSamplingGreyTexture(2, 2, 4, filter, /*task manager=*/NULL);
+
+		testDownSamplingGreyTexture(1024, 1024, 1, filter, &task_manager);
+		testDownSamplingGreyTexture(1024, 1000, 3, filter, &task_manager);
+		testDownSamplingGreyTexture(1000, 1024, 4, filter, &task_manager);
+	}
 
-	testDownSamplingGreyTexture(256, 256, 3);
-	testDownSamplingGreyTexture(250, 250, 3);
-	testDownSamplingGreyTexture(250, 7, 3);
-	testDownSamplingGreyTexture(7, 250, 3);
-	testDownSamplingGreyTexture(2, 2, 3);
+	// Test SIMD and multi-threaded downsampling against scalar reference code, for various sizes, including odd sizes and sizes where the SIMD loops don't run.
+	{
+		const size_t sizes[][2] = { { 2, 2 }, { 3, 3 }, { 1, 9 }, { 9, 1 }, { 1, 1 }, { 17, 5 }, { 70, 67 }, { 131, 2 }, { 2, 131 }, { 300, 301 }, { 1000, 300 } };
+		for(size_t i=0; i<staticArrayNumElems(sizes); ++i)
+			for(size_t N=1; N<=4; ++N)
+			{
+				testDownSamplingMatchesReference(sizes[i][0], sizes[i][1], N, /*task manager=*/NULL);
+				testDownSamplingMatchesReference(sizes[i][0], sizes[i][1], N, &task_manager);
+			}
+
+		for(size_t i=0; i<staticArrayNumElems(sizes); ++i)
+		{
+			testAlphaCoverageScaling(sizes[i][0], sizes[i][1], /*task manager=*/NULL);
+			testAlphaCoverageScaling(sizes[i][0], sizes[i][1], &task_manager);
+		}
+	}
 
-	testDownSamplingGreyTexture(256, 256, 4);
-	testDownSamplingGreyTexture(250, 250, 4);
-	testDownSamplingGreyTexture(250, 7, 3);
-	testDownSamplingGreyTexture(7, 250, 4);
-	testDownSamplingGreyTexture(2, 2, 4);
+	perfTestDownSampling(task_manager);
 
 	
 #if !defined(EMSCRIPTEN)
@@ -253,14 +576,14 @@ void TextureProcessingTests::test()
 		const ImageMapUInt8* map_imagemapuint8 = mip_level_image.downcastToPtr<ImageMapUInt8>();
 
 		Timer timer;
-		Reference<TextureData> tex_data = TextureProcessing::buildUInt8MapTextureData(map_imagemapuint8, allocator.ptr(), /*task manager=*/NULL, /*allow compression=*/true, /*build mipmaps=*/true);
+		Reference<TextureData> tex_data = TextureProcessing::buildUInt8MapTextureData(map_imagemapuint8, allocator.ptr(), /*task manager=*/NULL, /*allow compression=*/true, /*build mipmaps=*/true, MipMapFilter_Box);
 
 		conPrint("single-threaded buildUInt8MapTextureData() for 'parquet-diffuse.jpg' took " + timer.elapsedStringMSWIthNSigFigs(4));
 
 		timer.reset();
 
 		//for(int i=0; i<1000; ++i)
-			tex_data = TextureProcessing::buildUInt8MapTextureData(map_imagemapuint8, allocator.ptr(), &task_manager, /*allow compression=*/true, /*build mipmaps=*/true);
+			tex_data = TextureProcessing::buildUInt8MapTextureData(map_imagemapuint8, allocator.ptr(), &task_manager, /*allow compression=*/true, /*build mipmaps=*/true, MipMapFilter_Box);
 
 		conPrint("multi-threaded buildUInt8MapTextureData() for 'parquet-diffuse.jpg' took " + timer.elapsedStringMSWIthNSigFigs(4));
 	}
@@ -281,7 +604,7 @@ void TextureProcessingTests::test()
 			Reference<ImageMapUInt8> mip_level_image = new ImageMapUInt8(level_W, level_H, prev_mip_level_image->getN());
 			float alpha_coverage;
 			TextureProcessing::downSampleToNextMipMapLevel(prev_mip_level_image->getWidth(), prev_mip_level_image->getHeight(), prev_mip_level_image->getN(), prev_mip_level_image->getData(),
-				/*alpha scale=*/1.f, level_W, level_H, mip_level_image->getData(), alpha_coverage);
+				MipMapFilter_Box, /*target alpha coverage=*/0.f, level_W, level_H, mip_level_image->getData(), alpha_coverage, /*task manager=*/NULL);
 
 
 			PNGDecoder::write(*mip_level_image, "mipmap_level_" + toString(k) + ".png");
@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2022 -
 #pragma once
 
 
+#include "TextureProcessing.h"
 #include <string>
 namespace glare { class TaskManager; }
 namespace glare { class Allocator; }
@@ -16,7 +17,10 @@ public:
 	static void test();
 
 private:
-	static void testDownSamplingGreyTexture(unsigned int W, unsigned int H, unsigned int N);
-	static void testBuildingTexDataForImage(glare::Allocator* allocator, unsigned int W, unsigned int H, unsigned int N);
+	static void testDownSamplingGreyTexture(unsigned int W, unsigned int H, unsigned int N, MipMapFilter filter, glare::TaskManager* task_manager);
+	static void testDownSamplingMatchesReference(size_t W, size_t H, size_t N, glare::TaskManager* task_manager);
+	static void testAlphaCoverageScaling(size_t W, size_t H, glare::TaskManager* task_manager);
+	static void perfTestDownSampling(glare::TaskManager& task_manager);
+	static void testBuildingTexDataForImage(glare::Allocator* allocator, unsigned int W, unsigned int H, unsigned int N, const TextureCompressionOptions& compression_options = TextureCompressionOptions());
 	static void testLoadingAnimatedFile(const std::string& path, glare::Allocator* allocator, glare::TaskManager& task_manager);
 };
@@ -0,0 +1,658 @@
+/*=====================================================================
+TiledImageMap.cpp
+-----------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#include "TiledImageMap.h"
+
+
+#include "ImageRowDownsampler.h"
+#include "MitchellNetravali.h"
+#include "../utils/Lock.h"
+#include "../utils/Exception.h"
+#include "../utils/StringUtils.h"
+#include <cstring>
+
+
+TiledImageMap::TiledImageMap(const Reference<TiledImageSource>& source_, size_t max_cache_size_B_)
+:	max_cache_size_B(max_cache_size_B_),
+	source(source_),
+	num_tile_reads(0)
+{
+	width  = source_->getWidth();
+	height = source_->getHeight();
+	N      = source_->numChannels();
+	tile_w = source_->tileWidth();
+	tile_h = source_->tileHeight();
+	gamma  = source_->getGamma();
+	source_is_floating_point = source_->isFloatingPoint();
+	source_bits_per_channel = source_->uncompressedBitsPerChannel();
+
+	if(width == 0 || height == 0 || N == 0)
+		throw glare::Exception("Invalid tiled image dimensions: " + toString(width) + " x " + toString(height) + ", " + toString(N) + " channels");
+	if(tile_w == 0 || tile_h == 0)
+		throw glare::Exception("Invalid tile dimensions: " + toString(tile_w) + " x " + toString(tile_h));
+
+	num_tiles_x = (width + tile_w - 1) / tile_w;
+}
+
+
+TiledImageMap::~TiledImageMap()
+{
+}
+
+
+Reference<ImageMapFloat> TiledImageMap::getTile(size_t tile_x, size_t tile_y) const
+{
+	const uint64 key = (uint64)tile_y * num_tiles_x + tile_x;
+	{
+		Lock lock(mutex);
+		auto res = tile_cache.find(key);
+		if(res != tile_cache.end())
+		{
+			tile_cache.itemWasUsed(key);
+			return res->second.value;
+		}
+	}
+
+	// Tile is not in the cache, so read it from the source.
+	Lock source_lock(source_mutex);
+
+	// Another thread may have read the tile while we were waiting for source_mutex, so check again.
+	{
+		Lock lock(mutex);
+		auto res = tile_cache.find(key);
+		if(res != tile_cache.end())
+		{
+			tile_cache.itemWasUsed(key);
+			return res->second.value;
+		}
+	}
+
+	const size_t tile_begin_x = tile_x * tile_w;
+	const size_t tile_begin_y = tile_y * tile_h;
+	assert(tile_begin_x < width && tile_begin_y < height);
+	Reference<ImageMapFloat> tile = new ImageMapFloat(myMin(tile_w, width - tile_begin_x), myMin(tile_h, height - tile_begin_y), N);
+
+	source->readTile(tile_x, tile_y, *tile);
+	num_tile_reads++;
+
+	{
+		Lock lock(mutex);
+		tile_cache.insert(key, tile, tile->getByteSize());
+		tile_cache.removeLRUItemsUntilSizeLessEqualN(max_cache_size_B); // May remove the tile we just inserted, if the cache is very small.  That's fine since we hold a reference to it.
+	}
+
+	return tile;
+}
+
+
+void TiledImageMap::readRegion(size_t x, size_t y, size_t w, size_t h, ImageMapFloat& region_out) const
+{
+	region_out.resizeNoCopy(w, h, N);
+	if(w > 0 && h > 0)
+		readRegion(x, y, w, h, region_out.getData(), w * N);
+}
+
+
+void TiledImageMap::readRegion(size_t x, size_t y, size_t w, size_t h, float* out, size_t out_row_stride) const
+{
+	if(x + w > width || y + h > height)
+		throw glare::Exception("Region is outside of image");
+	if(w == 0 || h == 0)
+		return;
+
+	// Copy from each tile overlapping the region in turn.
+	for(size_t tile_y = y / tile_h; tile_y <= (y + h - 1) / tile_h; ++tile_y)
+	for(size_t tile_x = x / tile_w; tile_x <= (x + w - 1) / tile_w; ++tile_x)
+	{
+		const Reference<ImageMapFloat> tile = getTile(tile_x, tile_y);
+
+		const size_t tile_begin_x = tile_x * tile_w;
+		const size_t tile_begin_y = tile_y * tile_h;
+		const size_t copy_begin_x = myMax(x, tile_begin_x);
+		const size_t copy_end_x   = myMin(x + w, tile_begin_x + tile->getWidth());
+		const size_t copy_begin_y = myMax(y, tile_begin_y);
+		const size_t copy_end_y   = myMin(y + h, tile_begin_y + tile->getHeight());
+
+		for(size_t py=copy_begin_y; py<copy_end_y; ++py)
+			std::memcpy(out + (py - y) * out_row_stride + (copy_begin_x - x) * N, tile->getPixel(copy_begin_x - tile_begin_x, py - tile_begin_y), sizeof(float) * (copy_end_x - copy_begin_x) * N);
+	}
+}
+
+
+Reference<ImageMapFloat> TiledImageMap::downsample(int num_halvings) const
+{
+	const size_t factor = (size_t)1 << num_halvings;
+	Reference<ImageMapFloat> result = new ImageMapFloat((width + factor - 1) / factor, (height + factor - 1) / factor, N);
+	result->setGamma(gamma);
+
+	ImageRowDownsampler<float, FloatComponentValueTraits, float> downsampler(*result, width, height, num_halvings, /*mem allocator=*/NULL);
+
+	// Read bands of rows, with at most one row of tiles per band.
+	const size_t max_band_h = myMin<size_t>(tile_h, 64);
+	ImageMapFloat band;
+	for(size_t y=0; y<height; )
+	{
+		const size_t band_h = myMin(max_band_h, myMin(height, (y / tile_h + 1) * tile_h) - y); // Don't cross a tile row boundary.
+		readRegion(0, y, width, band_h, band);
+
+		for(size_t r=0; r<band_h; ++r)
+			downsampler.addRow(band.getPixel(0, r));
+
+		y += band_h;
+	}
+
+	return result;
+}
+
+
+int TiledImageMap::maxNumHalvingsForMinSize(size_t min_width, size_t min_height) const
+{
+	int num_halvings = 0;
+	while(num_halvings < 30)
+	{
+		const size_t factor = (size_t)1 << num_halvings;
+		if((width + factor - 1) / factor == 1 && (height + factor - 1) / factor == 1) // Stop if the reduced image is already 1 x 1.
+			break;
+
+		const size_t next_factor = factor * 2;
+		if((width + next_factor - 1) / next_factor < min_width || (height + next_factor - 1) / next_factor < min_height)
+			break;
+		num_halvings++;
+	}
+	return num_halvings;
+}
+
+
+size_t TiledImageMap::cacheSizeB() const
+{
+	Lock lock(mutex);
+	return tile_cache.totalValueSizeB();
+}
+
+
+size_t TiledImageMap::numTileReads() const
+{
+	Lock lock(source_mutex);
+	return num_tile_reads;
+}
+
+
+const Colour4f TiledImageMap::pixelColour(size_t x, size_t y) const
+{
+	CurrentTile current_tile;
+	const float* const pixel = getPixel(x, y, current_tile);
+	if(N < 3)
+		return Colour4f(pixel[0]);
+	else
+		return Colour4f(pixel[0], pixel[1], pixel[2], 0.f);
+}
+
+
+// Computes the pixel indices and the fractional pixel coordinate along one axis for bilinear filtering, in the same way as ImageMap::vec3Sample().
+// normed_coord is the normalised image coordinate, increasing with pixel index.
+static inline void getBilinearAxisPixels(float normed_coord, size_t dim, bool wrap, size_t& i_out, size_t& i_1_out, float& frac_out)
+{
+	const float normed_frac_part = normed_coord - std::floor(normed_coord); // Fractional part of normed coord, in [0, 1].
+	const float f_pixels = normed_frac_part * (float)dim; // In [0, dim]
+
+	// We check for >= 0 here because otherwise Inf or NaN texture coordinates can result in out of bounds reads.
+	const size_t i_clamped = (f_pixels >= 0) ? (size_t)f_pixels : 0;
+	const size_t i = myMin(i_clamped, dim - 1);
+	const size_t i_1 = i_clamped + 1; // Not wrapped yet.
+
+	i_out = i;
+	if(wrap)
+		i_1_out = (i_1 < dim) ? i_1 : 0;
+	else // else clamp:
+		i_1_out = myMin(i_1, dim - 1);
+	frac_out = f_pixels - (float)i;
+}
+
+
+const Colour4f TiledImageMap::vec3Sample(Coord u, Coord v, bool wrap) const
+{
+	size_t ut, ut_1, vt, vt_1;
+	Coord ufrac, vfrac;
+	getBilinearAxisPixels(u,       width,  wrap, ut, ut_1, ufrac);
+	getBilinearAxisPixels(1.f - v, height, wrap, vt, vt_1, vfrac); // Flip v, to go from +v up to +v down.
+
+	const Value a = (1 - ufrac) * (1 - vfrac); // Top left pixel weight
+	const Value b = ufrac * (1 - vfrac); // Top right pixel weight
+	const Value c = (1 - ufrac) * vfrac; // Bottom left pixel weight
+	const Value d = ufrac * vfrac; // Bottom right pixel weight
+
+	// Note that the pointer returned by getPixel() is only valid until the next getPixel() call, so read the values straight away.
+	CurrentTile current_tile;
+	const size_t use_N = (N < 3) ? 1 : 3; // If N < 3, this is either grey, alpha or grey with alpha.  Either way just use the zeroth channel.
+	float sum[3] = { 0, 0, 0 };
+	const float* pixel;
+	pixel = getPixel(ut,   vt,   current_tile);  for(size_t z=0; z<use_N; ++z) sum[z] += a * pixel[z];
+	pixel = getPixel(ut_1, vt,   current_tile);  for(size_t z=0; z<use_N; ++z) sum[z] += b * pixel[z];
+	pixel = getPixel(ut,   vt_1, current_tile);  for(size_t z=0; z<use_N; ++z) sum[z] += c * pixel[z];
+	pixel = getPixel(ut_1, vt_1, current_tile);  for(size_t z=0; z<use_N; ++z) sum[z] += d * pixel[z];
+
+	if(N < 3)
+		return Colour4f(sum[0]);
+	else
+		return Colour4f(sum[0], sum[1], sum[2], 0.f);
+}
+
+
+Map2D::Value TiledImageMap::sampleSingleChannelTiled(Coord u, Coord v, size_t channel) const
+{
+	assert(channel < N);
+
+	size_t ut, ut_1, vt, vt_1;
+	Coord ufrac, vfrac;
+	getBilinearAxisPixels(u,       width,  /*wrap=*/true, ut, ut_1, ufrac);
+	getBilinearAxisPixels(1.f - v, height, /*wrap=*/true, vt, vt_1, vfrac); // Flip v, to go from +v up to +v down.
+
+	CurrentTile current_tile;
+	const Value top_left  = getPixel(ut,   vt,   current_tile)[channel];
+	const Value top_right = getPixel(ut_1, vt,   current_tile)[channel];
+	const Value bot_left  = getPixel(ut,   vt_1, current_tile)[channel];
+	const Value bot_right = getPixel(ut_1, vt_1, current_tile)[channel];
+
+	return (1 - ufrac) * (1 - vfrac) * top_left + ufrac * (1 - vfrac) * top_right + (1 - ufrac) * vfrac * bot_left + ufrac * vfrac * bot_right;
+}
+
+
+// Uses the same Mitchell-Netravali filter as ImageMap::sampleSingleChannelHighQual(), see the comments there.
+Map2D::Value TiledImageMap::sampleSingleChannelHighQual(Coord u, Coord v, size_t channel, bool wrap) const
+{
+	assert(channel < N);
+
+	Coord normed_x = u;
+	Coord normed_y = 1.f - v; // Flip v, to go from +v up to +v down.
+	if(wrap)
+	{
+		normed_x -= std::floor(normed_x);
+		normed_y -= std::floor(normed_y);
+	}
+
+	Coord p_x = normed_x * (Coord)width;
+	Coord p_y = normed_y * (Coord)height;
+	if(!wrap)
+	{
+		p_x = myClamp(p_x, 0.f, (Coord)width);
+		p_y = myClamp(p_y, 0.f, (Coord)height);
+	}
+
+	// Inf or NaN texture coordinates can result in NaN pixel coordinates here, so replace them with zero to avoid out of bounds reads.
+	if(!(p_x >= 0))
+		p_x = 0;
+	if(!(p_y >= 0))
+		p_y = 0;
+
+	const int i_x = (int)p_x;
+	const int i_y = (int)p_y;
+
+	int px_indices[4];
+	int py_indices[4];
+	for(int k=0; k<4; ++k)
+	{
+		if(wrap)
+		{
+			px_indices[k] = Maths::intMod(i_x + k - 1, (int)width);
+			py_indices[k] = Maths::intMod(i_y + k - 1, (int)height);
+		}
+		else
+		{
+			px_indices[k] = myClamp(i_x + k - 1, 0, (int)width  - 1);
+			py_indices[k] = myClamp(i_y + k - 1, 0, (int)height - 1);
+		}
+	}
+
+	MitchellNetravali<float> mn(0.5f, 0.25f);
+
+	CurrentTile current_tile;
+	Value sum = 0;
+	Value filter_sum = 0;
+	for(int ky=0; ky<4; ++ky)
+	{
+		const float dy = p_y - (float)(i_y + ky - 1);
+		for(int kx=0; kx<4; ++kx)
+		{
+			const float dx = p_x - (float)(i_x + kx - 1);
+			const float w = mn.eval(std::sqrt(dx*dx + dy*dy));
+			sum += w * getPixel(px_indices[kx], py_indices[ky], current_tile)[channel];
+			filter_sum += w;
+		}
+	}
+
+	return sum / filter_sum;
+}
+
+
+// Returns the value of channel 0, with derivatives computed with central differences of bilinear samples one pixel apart.
+Map2D::Value TiledImageMap::getDerivs(Coord s, Coord t, Value& dv_ds_out, Value& dv_dt_out) const
+{
+	const Coord ds = 1 / (Coord)width;
+	const Coord dt = 1 / (Coord)height;
+
+	dv_ds_out = (sampleSingleChannelTiled(s + ds, t, 0) - sampleSingleChannelTiled(s - ds, t, 0)) * ((Coord)width  * 0.5f);
+	dv_dt_out = (sampleSingleChannelTiled(s, t + dt, 0) - sampleSingleChannelTiled(s, t - dt, 0)) * ((Coord)height * 0.5f);
+	return sampleSingleChannelTiled(s, t, 0);
+}
+
+
+Reference<ImageMapFloat> TiledImageMap::extractChannel(size_t channel, bool linearise) const
+{
+	assert(channel < N);
+
+	Reference<ImageMapFloat> new_map = new ImageMapFloat(width, height, 1);
+	new_map->setGamma(linearise ? 1.f : gamma);
+
+	ImageMapFloat band;
+	for(size_t y=0; y<height; y += tile_h)
+	{
+		const size_t band_h = myMin(tile_h, height - y);
+		readRegion(0, y, width, band_h, band);
+
+		for(size_t r=0; r<band_h; ++r)
+		for(size_t x=0; x<width; ++x)
+		{
+			const float val = band.getPixel(x, r)[channel];
+			new_map->getPixel(x, y + r)[0] = (linearise && !source_is_floating_point) ? std::pow(val, gamma) : val;
+		}
+	}
+
+	return new_map;
+}
+
+
+Reference<Map2D> TiledImageMap::extractAlphaChannel() const
+{
+	return extractChannel(N - 1, /*linearise=*/false);
+}
+
+
+bool TiledImageMap::isAlphaChannelAllWhite() const
+{
+	if(!hasAlphaChannel())
+		return true;
+
+	ImageMapFloat band;
+	for(size_t y=0; y<height; y += tile_h)
+	{
+		const size_t band_h = myMin(tile_h, height - y);
+		readRegion(0, y, width, band_h, band);
+
+		for(size_t r=0; r<band_h; ++r)
+		for(size_t x=0; x<width; ++x)
+			if(band.getPixel(x, r)[N-1] < 1.f - 1.0e-6f) // Allow for rounding error when scaling integer values.
+				return false;
+	}
+
+	return true;
+}
+
+
+Reference<Map2D> TiledImageMap::extractChannelZero() const
+{
+	return extractChannel(0, /*linearise=*/false);
+}
+
+
+Reference<ImageMapFloat> TiledImageMap::extractChannelZeroLinear() const
+{
+	return extractChannel(0, /*linearise=*/true);
+}
+
+
+#if IMAGE_CLASS_SUPPORT
+Reference<Image> TiledImageMap::convertToImage() const
+{
+	Reference<Image> image = new Image(width, height);
+
+	ImageMapFloat band;
+	for(size_t y=0; y<height; y += tile_h)
+	{
+		const size_t band_h = myMin(tile_h, height - y);
+		readRegion(0, y, width, band_h, band);
+
+		for(size_t r=0; r<band_h; ++r)
+		for(size_t x=0; x<width; ++x)
+		{
+			const float* pixel = band.getPixel(x, r);
+			Colour3f col = (N < 3) ? Colour3f(pixel[0]) : Colour3f(pixel[0], pixel[1], pixel[2]);
+			if(!source_is_floating_point)
+				col = Colour3f(std::pow(col.r, gamma), std::pow(col.g, gamma), std::pow(col.b, gamma));
+			image->setPixel(x, y + r, col);
+		}
+	}
+
+	return image;
+}
+#endif
+
+
+#if MAP2D_FILTERING_SUPPORT
+
+
+Reference<Map2D> TiledImageMap::getBlurredLinearGreyScaleImage(glare::TaskManager& task_manager) const
+{
+	// The blur standard deviation is 1% of the image size, so reduce the image until the largest dimension is about 1024 pixels first.
+	const int num_halvings = (width >= height) ? maxNumHalvingsForMinSize(myMin<size_t>(width, 1024), 1) : maxNumHalvingsForMinSize(1, myMin<size_t>(height, 1024));
+	const Reference<ImageMapFloat> reduced = downsample(num_halvings);
+	const size_t reduced_w = reduced->getWidth();
+	const size_t reduced_h = reduced->getHeight();
+
+	// We don't want to include the alpha channel in our blurred greyscale image.
+	const size_t use_N = (N < 3) ? 1 : 3; // Number of components to average over when computing the greyscale value.
+	const float N_scale = 1.f / (float)use_N;
+
+	ImageMapFloat img(reduced_w, reduced_h, 1);
+	for(size_t y=0; y<reduced_h; ++y)
+		for(size_t x=0; x<reduced_w; ++x)
+		{
+			float val = 0;
+			for(size_t c=0; c<use_N; ++c)
+				val += reduced->getPixel(x, y)[c];
+			val *= N_scale;
+
+			img.getPixel(x, y)[0] = source_is_floating_point ? val : std::pow(val, gamma);
+		}
+
+	// Blur the floating point image
+	Reference<ImageMapFloat> blurred_img = new ImageMapFloat(reduced_w, reduced_h, 1);
+	GaussianImageFilter::gaussianFilter(
+		img,
+		*blurred_img,
+		(float)myMax(reduced_w, reduced_h) * 0.01f, // standard dev in pixels
+		task_manager
+	);
+
+	return blurred_img;
+}
+
+
+Reference<ImageMap<float, FloatComponentValueTraits> > TiledImageMap::resizeToImageMapFloat(const int target_width, bool& is_linear_out) const
+{
+	// Box-filter the image down while its largest dimension stays >= target_width, then resize the reduced image.
+	const size_t target = (size_t)myMax(1, target_width);
+	const int num_halvings = (width >= height) ? maxNumHalvingsForMinSize(myMin(width, target), 1) : maxNumHalvingsForMinSize(1, myMin(height, target));
+
+	Reference<ImageMapFloat> resized = downsample(num_halvings)->resizeToImageMapFloat(target_width, is_linear_out);
+	is_linear_out = source_is_floating_point;
+	return resized;
+}
+
+
+Reference<Map2D> TiledImageMap::resizeMidQuality(const int new_width, const int new_height, glare::TaskManager* task_manager) const
+{
+	// Box-filter the image down while it stays at least as large as the new size, then resize the reduced image.
+	const int num_halvings = maxNumHalvingsForMinSize((size_t)myMax(1, new_width), (size_t)myMax(1, new_height));
+
+	return downsample(num_halvings)->resizeMidQuality(new_width, new_height, task_manager);
+}
+
+
+#endif // MAP2D_FILTERING_SUPPORT
+
+
+void ImageMapFloatTiledImageSource::readTile(size_t tile_x, size_t tile_y, ImageMapFloat& tile_out)
+{
+	const size_t N = image->getN();
+	for(size_t y=0; y<tile_out.getHeight(); ++y)
+		std::memcpy(tile_out.getPixel(0, y), image->getPixel(tile_x * tile_w, tile_y * tile_h + y), tile_out.getWidth() * N * sizeof(float));
+}
+
+
+#if BUILD_TESTS
+
+
+#include "../utils/TestUtils.h"
+#include "../utils/ConPrint.h"
+
+
+void TiledImageMap::test()
+{
+	conPrint("TiledImageMap::test()");
+
+	try
+	{
+		const size_t W = 75;
+		const size_t H = 43;
+		Reference<ImageMapFloat> image = new ImageMapFloat(W, H, 3);
+		for(size_t y=0; y<H; ++y)
+		for(size_t x=0; x<W; ++x)
+		{
+			image->getPixel(x, y)[0] = (float)x;
+			image->getPixel(x, y)[1] = (float)y;
+			image->getPixel(x, y)[2] = (float)((x * 7 + y * 13) % 17);
+		}
+
+		const size_t tile_size_B = 16 * 8 * 3 * sizeof(float);
+		const size_t max_cache_size_B = tile_size_B * 6;
+		TiledImageMapRef tiled = new TiledImageMap(new ImageMapFloatTiledImageSource(image, /*tile w=*/16, /*tile h=*/8), max_cache_size_B);
+		testAssert(tiled->getMapWidth() == W && tiled->getMapHeight() == H && tiled->numChannels() == 3);
+
+		//-------------------- Test readRegion --------------------
+		{
+			ImageMapFloat region;
+			tiled->readRegion(13, 5, 40, 20, region); // Crosses several tile boundaries.
+			testAssert(region.getWidth() == 40 && region.getHeight() == 20);
+			for(size_t y=0; y<20; ++y)
+			for(size_t x=0; x<40; ++x)
+			for(size_t c=0; c<3; ++c)
+				testAssert(region.getPixel(x, y)[c] == image->getPixel(13 + x, 5 + y)[c]);
+
+			tiled->readRegion(0, 0, W, H, region);
+			testAssert(region == *image);
+
+			try
+			{
+				tiled->readRegion(70, 0, 10, 1, region);
+				failTest("Shouldn't get here.");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		// The cache size should be bounded.
+		testAssert(tiled->cacheSizeB() <= max_cache_size_B);
+
+		//-------------------- Test sampling matches ImageMap sampling --------------------
+		for(int i=0; i<1000; ++i)
+		{
+			const float u = -1.5f + (float)i * 0.00371f;
+			const float v = 2.f - (float)i * 0.00293f;
+			for(int wrap=0; wrap<2; ++wrap)
+			{
+				const Colour4f a = tiled->vec3Sample(u, v, wrap != 0);
+				const Colour4f b = image->vec3Sample(u, v, wrap != 0);
+				for(int c=0; c<3; ++c)
+					testAssert(epsEqual(a[c], b[c], 1.0e-4f) || std::fabs(a[c] - b[c]) < 1.0e-4f);
+
+				testAssert(std::fabs(tiled->sampleSingleChannelHighQual(u, v, 2, wrap != 0) - image->sampleSingleChannelHighQual(u, v, 2, wrap != 0)) < 1.0e-3f);
+			}
+
+			for(size_t c=0; c<3; ++c)
+				testAssert(std::fabs(tiled->sampleSingleChannelTiled(u, v, c) - image->sampleSingleChannelTiled(u, v, c)) < 1.0e-4f);
+		}
+
+		testAssert(tiled->pixelColour(20, 30) == image->pixelColour(20, 30));
+
+		// Sampling with Inf or NaN coordinates shouldn't read out of bounds.
+		tiled->vec3Sample(std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN(), true);
+		tiled->sampleSingleChannelHighQual(std::numeric_limits<float>::quiet_NaN(), -std::numeric_limits<float>::infinity(), 0, false);
+
+		//-------------------- Test getDerivs --------------------
+		{
+			// Channel 0 is x, so over the interior of the image, dv/ds = W and dv/dt = 0.
+			float dv_ds, dv_dt;
+			tiled->getDerivs(0.5f, 0.5f, dv_ds, dv_dt);
+			testAssert(epsEqual(dv_ds, (float)W, 1.0e-3f));
+			testAssert(std::fabs(dv_dt) < 1.0e-3f);
+		}
+
+		//-------------------- Test extractChannelZero --------------------
+		{
+			Reference<Map2D> channel_0 = tiled->extractChannelZero();
+			testAssert(channel_0->getMapWidth() == W && channel_0->getMapHeight() == H && channel_0->numChannels() == 1);
+			testAssert(channel_0.downcastToPtr<ImageMapFloat>()->getPixel(31, 40)[0] == 31.f);
+		}
+
+		//-------------------- Test downsample --------------------
+		for(int num_halvings=0; num_halvings<4; ++num_halvings)
+		{
+			Reference<ImageMapFloat> reduced = tiled->downsample(num_halvings);
+
+			const size_t factor = (size_t)1 << num_halvings;
+			ImageMapFloat ref_reduced((W + factor - 1) / factor, (H + factor - 1) / factor, 3);
+			ImageRowDownsampler<float, FloatComponentValueTraits, float> downsampler(ref_reduced, W, H, num_halvings, NULL);
+			for(size_t y=0; y<H; ++y)
+				downsampler.addRow(image->getPixel(0, y));
+
+			testAssert(*reduced == ref_reduced);
+			testAssert(tiled->cacheSizeB() <= max_cache_size_B);
+		}
+
+		testAssert(tiled->maxNumHalvingsForMinSize(1, 1) == 7); // ceil(75 / 128) = 1, ceil(43 / 128) = 1
+		testAssert(tiled->maxNumHalvingsForMinSize(19, 1) == 2); // ceil(75 / 4) = 19, ceil(75 / 8) = 10
+		testAssert(tiled->maxNumHalvingsForMinSize(20, 1) == 1);
+		testAssert(tiled->maxNumHalvingsForMinSize(1, 43) == 0);
+
+#if MAP2D_FILTERING_SUPPORT
+		{
+			Reference<Map2D> resized = tiled->resizeMidQuality(30, 17, NULL);
+			testAssert(resized->getMapWidth() == 30 && resized->getMapHeight() == 17);
+
+			bool is_linear;
+			Reference<ImageMapFloat> resized_f = tiled->resizeToImageMapFloat(20, is_linear);
+			testAssert(resized_f->getWidth() == 20);
+			testAssert(is_linear);
+		}
+#endif
+
+		//-------------------- Test that tiles are re-read after being evicted, but not while cached --------------------
+		{
+			TiledImageMapRef map = new TiledImageMap(new ImageMapFloatTiledImageSource(image, 16, 8), /*max cache size=*/tile_size_B * 100);
+			ImageMapFloat region;
+			map->readRegion(0, 0, W, H, region);
+			const size_t num_tiles = 5 * 6;
+			testAssert(map->numTileReads() == num_tiles);
+			map->readRegion(0, 0, W, H, region);
+			testAssert(map->numTileReads() == num_tiles); // All tiles should still be cached.
+
+			TiledImageMapRef small_cache_map = new TiledImageMap(new ImageMapFloatTiledImageSource(image, 16, 8), /*max cache size=*/tile_size_B * 2);
+			small_cache_map->readRegion(0, 0, W, H, region);
+			small_cache_map->readRegion(0, 0, W, H, region);
+			testAssert(small_cache_map->numTileReads() == num_tiles * 2);
+			testAssert(small_cache_map->cacheSizeB() <= tile_size_B * 2);
+			testAssert(region == *image);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("TiledImageMap::test() done.");
+}
+
+
+#endif // BUILD_TESTS
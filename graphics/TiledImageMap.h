@@ -0,0 +1,238 @@
+/*=====================================================================
+TiledImageMap.h
+---------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "Map2D.h"
+#include "ImageMap.h"
+#include "../utils/Mutex.h"
+#include "../utils/LRUCache.h"
+
+
+/*=====================================================================
+TiledImageSource
+----------------
+An image file that can be read one tile at a time.
+The tiles form a regular grid over the image, with the tiles at the right
+and bottom edges clipped to the image.
+
+Implementations are in EXRDecoder.cpp (EXR tiles or blocks of scanlines)
+and TIFFDecoder.cpp (TIFF tiles or strips).
+
+Doesn't need to be thread-safe, TiledImageMap only calls readTile() from
+one thread at a time.
+=====================================================================*/
+class TiledImageSource : public ThreadSafeRefCounted
+{
+public:
+	virtual ~TiledImageSource() {}
+
+	virtual size_t getWidth() const = 0;
+	virtual size_t getHeight() const = 0;
+	virtual size_t numChannels() const = 0;
+
+	virtual size_t tileWidth() const = 0;
+	virtual size_t tileHeight() const = 0;
+
+	// Reads the tile with tile indices (tile_x, tile_y) into tile_out.
+	// tile_out has already been sized to the tile size clipped to the image, with numChannels() channels.
+	// Values from integer formats should be scaled to [0, 1].
+	// Throws glare::Exception on failure.
+	virtual void readTile(size_t tile_x, size_t tile_y, ImageMapFloat& tile_out) = 0;
+
+	virtual bool isFloatingPoint() const = 0; // Are the values in the file floating point, as opposed to normalised integers?
+	virtual double uncompressedBitsPerChannel() const = 0;
+	virtual float getGamma() const = 0;
+};
+
+
+/*=====================================================================
+ImageMapFloatTiledImageSource
+-----------------------------
+Serves tiles from an image in memory.  Used for testing the tiled code
+paths against the in-memory ones.
+=====================================================================*/
+class ImageMapFloatTiledImageSource final : public TiledImageSource
+{
+public:
+	ImageMapFloatTiledImageSource(const Reference<ImageMapFloat>& image_, size_t tile_w_, size_t tile_h_) : image(image_), tile_w(tile_w_), tile_h(tile_h_) {}
+
+	virtual size_t getWidth() const override { return image->getWidth(); }
+	virtual size_t getHeight() const override { return image->getHeight(); }
+	virtual size_t numChannels() const override { return image->getN(); }
+
+	virtual size_t tileWidth() const override { return tile_w; }
+	virtual size_t tileHeight() const override { return tile_h; }
+
+	virtual void readTile(size_t tile_x, size_t tile_y, ImageMapFloat& tile_out) override;
+
+	virtual bool isFloatingPoint() const override { return true; }
+	virtual double uncompressedBitsPerChannel() const override { return 32; }
+	virtual float getGamma() const override { return 1.f; }
+
+private:
+	Reference<ImageMapFloat> image;
+	size_t tile_w, tile_h;
+};
+
+
+/*=====================================================================
+TiledImageMap
+-------------
+A Map2D that reads the pixels of a (possibly very large) image file on
+demand, a tile at a time, instead of decoding the whole image into memory.
+
+Decoded tiles are kept in an LRU cache with a maximum total size, so that
+the memory used is bounded by the cache size, not the image size.
+For reasonable performance when streaming through the image in row order,
+as the resizing and filtering functions do, the cache should be able to
+hold at least a couple of rows of tiles.
+
+Pixel values are stored as floats, with values from integer formats scaled
+to [0, 1], so sampling gives the same results as the corresponding
+ImageMap.
+
+Methods that return images of the same size as this one, such as
+extractChannelZero() and convertToImage(), build the full resolution
+image in memory.  resizeMidQuality(), resizeToImageMapFloat() and
+getBlurredLinearGreyScaleImage() don't, they first box-filter the image
+down with downsample().
+
+Sampling and other methods that read pixels throw glare::Exception if a
+tile could not be read.
+
+Thread-safe.
+=====================================================================*/
+class TiledImageMap final : public Map2D
+{
+public:
+	// max_cache_size_B is the maximum total size of the decoded tiles kept in memory.
+	TiledImageMap(const Reference<TiledImageSource>& source, size_t max_cache_size_B);
+	virtual ~TiledImageMap();
+
+
+	//====================== Map2D interface ======================
+	virtual const Colour4f pixelColour(size_t x, size_t y) const override;
+
+	// X and Y are normalised image coordinates.
+	virtual const Colour4f vec3Sample(Coord x, Coord y, bool wrap) const override;
+
+	// X and Y are normalised image coordinates.
+	virtual Value sampleSingleChannelTiled(Coord x, Coord y, size_t channel) const override;
+
+	virtual Value sampleSingleChannelHighQual(Coord x, Coord y, size_t channel, bool wrap) const override;
+
+	virtual Value getDerivs(Coord s, Coord t, Value& dv_ds_out, Value& dv_dt_out) const override;
+
+	virtual size_t getMapWidth() const override { return width; }
+	virtual size_t getMapHeight() const override { return height; }
+	virtual size_t numChannels() const override { return N; }
+	virtual double uncompressedBitsPerChannel() const override { return source_bits_per_channel; }
+
+	virtual bool takesOnlyUnitIntervalValues() const override { return !source_is_floating_point; }
+
+	virtual bool hasAlphaChannel() const override { return N == 2 || N == 4; }
+	virtual Reference<Map2D> extractAlphaChannel() const override;
+	virtual bool isAlphaChannelAllWhite() const override;
+
+#if IMAGE_CLASS_SUPPORT
+	virtual Reference<Image> convertToImage() const override;
+#endif
+
+	virtual Reference<Map2D> extractChannelZero() const override;
+
+	virtual Reference<ImageMap<float, FloatComponentValueTraits> > extractChannelZeroLinear() const override;
+#if MAP2D_FILTERING_SUPPORT
+	// Returns an image with lower resolution than this one, since the blur removes the detail anyway.
+	virtual Reference<Map2D> getBlurredLinearGreyScaleImage(glare::TaskManager& task_manager) const override;
+
+	virtual Reference<ImageMap<float, FloatComponentValueTraits> > resizeToImageMapFloat(const int target_width, bool& is_linear) const override;
+
+	// task_manager may be NULL
+	virtual Reference<Map2D> resizeMidQuality(const int new_width, const int new_height, glare::TaskManager* task_manager) const override;
+#endif
+	virtual size_t getByteSize() const override { return cacheSizeB(); } // Returns the size of the cached tiles, since that is all that is stored in memory.
+
+	virtual ArrayRef<uint8> getDataArrayRef() const override { return ArrayRef<uint8>(); } // There is no contiguous pixel data.
+
+	virtual float getGamma() const override { return gamma; }
+	//====================== End Map2D interface ======================
+
+	inline size_t getWidth() const { return width; }
+	inline size_t getHeight() const { return height; }
+	inline size_t getN() const { return N; }
+
+	// Copies the pixels in the rectangle with top left (x, y) and size (w, h) to region_out, resizing it to (w, h, N).
+	// The rectangle must lie within the image.  Throws glare::Exception if a tile could not be read.
+	void readRegion(size_t x, size_t y, size_t w, size_t h, ImageMapFloat& region_out) const;
+
+	// As above, but writes to a buffer with rows of w * N floats, with rows starting out_row_stride floats apart.
+	void readRegion(size_t x, size_t y, size_t w, size_t h, float* out, size_t out_row_stride) const;
+
+	// Returns the image box-filtered down by a factor of 2^num_halvings in each dimension, see ImageRowDownsampler.
+	// Reads the image a row of tiles at a time, so apart from the result, only one row of tiles is stored at once (in addition to the tile cache).
+	Reference<ImageMapFloat> downsample(int num_halvings) const;
+
+	// Returns the largest number of halvings for which downsample() gives an image with width >= min_width and height >= min_height,
+	// not counting halvings past a 1 x 1 image.
+	int maxNumHalvingsForMinSize(size_t min_width, size_t min_height) const;
+
+	size_t maxCacheSizeB() const { return max_cache_size_B; }
+	size_t cacheSizeB() const; // Total size of the currently cached tiles.
+	size_t numTileReads() const; // Number of tiles read from the source so far.
+
+	static void test();
+
+private:
+	struct CurrentTile
+	{
+		CurrentTile() : tile_x(0), tile_y(0) {}
+
+		Reference<ImageMapFloat> tile;
+		size_t tile_x, tile_y;
+	};
+
+	// Returns a pointer to the N values of pixel (x, y).  current_tile is used to avoid a cache lookup if the pixel is in the same tile as the last lookup.
+	inline const float* getPixel(size_t x, size_t y, CurrentTile& current_tile) const;
+
+	Reference<ImageMapFloat> getTile(size_t tile_x, size_t tile_y) const;
+
+	Reference<ImageMapFloat> extractChannel(size_t channel, bool linearise) const;
+
+	size_t width, height, N;
+	size_t tile_w, tile_h, num_tiles_x;
+	float gamma;
+	bool source_is_floating_point;
+	double source_bits_per_channel;
+	size_t max_cache_size_B;
+
+	mutable Mutex source_mutex; // Acquired before mutex when both are held.
+	Reference<TiledImageSource> source GUARDED_BY(source_mutex);
+	mutable size_t num_tile_reads GUARDED_BY(source_mutex);
+
+	mutable Mutex mutex;
+	mutable LRUCache<uint64, Reference<ImageMapFloat> > tile_cache GUARDED_BY(mutex); // Map from tile index (tile_y * num_tiles_x + tile_x) to tile.
+};
+
+
+typedef Reference<TiledImageMap> TiledImageMapRef;
+
+
+const float* TiledImageMap::getPixel(size_t x, size_t y, CurrentTile& current_tile) const
+{
+	assert(x < width && y < height);
+
+	const size_t tile_x = x / tile_w;
+	const size_t tile_y = y / tile_h;
+	if(current_tile.tile.isNull() || current_tile.tile_x != tile_x || current_tile.tile_y != tile_y)
+	{
+		current_tile.tile = getTile(tile_x, tile_y);
+		current_tile.tile_x = tile_x;
+		current_tile.tile_y = tile_y;
+	}
+
+	return current_tile.tile->getPixel(x - tile_x * tile_w, y - tile_y * tile_h);
+}
@@ -33,16 +33,17 @@ Copyright Glare Technologies Limited 2021 -
 #include "BasisDecoder.h"
 #endif
 #include "../graphics/Map2D.h"
+#include "../graphics/TiledImageMap.h"
 
 
-Reference<Map2D> ImFormatDecoder::decodeImage(const std::string& indigo_base_dir, const std::string& path, const ImageDecodingOptions& options) // throws ImFormatExcep on failure
+Reference<Map2D> ImFormatDecoder::decodeImage(const std::string& indigo_base_dir, const std::string& path, const ImageDecodingOptions& options, glare::Allocator* mem_allocator) // throws ImFormatExcep on failure
 {
 	if(false)
 	{}
 #ifndef NO_JPG_SUPPORT
 	else if(hasExtension(path, "jpg") || hasExtension(path, "jpeg"))
 	{
-		return JPEGDecoder::decode(indigo_base_dir, path);
+		return JPEGDecoder::decode(indigo_base_dir, path, mem_allocator, options.target_max_dim);
 	}
 #endif
 #if IS_INDIGO
@@ -69,12 +70,12 @@ Reference<Map2D> ImFormatDecoder::decodeImage(const std::string& indigo_base_dir
 #endif
 	else if(hasExtension(path, "png"))
 	{
-		return PNGDecoder::decode(path);
+		return PNGDecoder::decode(path, mem_allocator, options.target_max_dim);
 	}
 #ifndef NO_EXR_SUPPORT
 	else if(hasExtension(path, "exr"))
 	{
-		return EXRDecoder::decode(path);
+		return EXRDecoder::decode(path, mem_allocator, options.target_max_dim);
 	}
 #endif
 #ifndef NO_GIF_SUPPORT
@@ -86,11 +87,11 @@ Reference<Map2D> ImFormatDecoder::decodeImage(const std::string& indigo_base_dir
 #ifndef NO_KTX_SUPPORT
 	else if(hasExtension(path, "ktx"))
 	{
-		return KTXDecoder::decode(path);
+		return KTXDecoder::decode(path, mem_allocator, options.target_max_dim);
 	}
 	else if(hasExtension(path, "ktx2"))
 	{
-		return KTXDecoder::decodeKTX2(path);
+		return KTXDecoder::decodeKTX2(path, mem_allocator, options.target_max_dim);
 	}
 #endif
 #if !IS_INDIGO
@@ -99,7 +100,8 @@ Reference<Map2D> ImFormatDecoder::decodeImage(const std::string& indigo_base_dir
 	{
 		BasisDecoder::BasisDecoderOptions basis_options;
 		basis_options.ETC_support = options.ETC_support;
-		return BasisDecoder::decode(path, /*mem allocator=*/nullptr, basis_options);
+		basis_options.target_max_dim = options.target_max_dim;
+		return BasisDecoder::decode(path, mem_allocator, basis_options);
 	}
 #endif
 #endif
@@ -110,6 +112,66 @@ Reference<Map2D> ImFormatDecoder::decodeImage(const std::string& indigo_base_dir
 }
 
 
+Reference<TiledImageMap> ImFormatDecoder::openTiledImage(const std::string& path, size_t max_tile_cache_size_B)
+{
+	if(false)
+	{}
+#ifndef NO_EXR_SUPPORT
+	else if(hasExtension(path, "exr"))
+	{
+		return EXRDecoder::openTiled(path, max_tile_cache_size_B);
+	}
+#endif
+#if IS_INDIGO
+	else if(hasExtension(path, "tif") || hasExtension(path, "tiff"))
+	{
+		return TIFFDecoder::openTiled(path, max_tile_cache_size_B);
+	}
+#endif
+	else
+	{
+		throw ImFormatExcep("Tiled reading is not supported for image format ('" + getExtension(path) + "')");
+	}
+}
+
+
+int ImFormatDecoder::numHalvingsForTargetDim(size_t W, size_t H, size_t target_max_dim, int max_num_halvings)
+{
+	if(target_max_dim == 0)
+		return 0;
+
+	const size_t max_dim = myMax(W, H);
+	int num_halvings = 0;
+	while(num_halvings < max_num_halvings && num_halvings < 30)
+	{
+		const size_t next_factor = (size_t)1 << (num_halvings + 1);
+		const size_t next_max_dim = (max_dim + next_factor - 1) / next_factor;
+		if(next_max_dim < target_max_dim)
+			break;
+		num_halvings++;
+	}
+	return num_halvings;
+}
+
+
+int ImFormatDecoder::numMipLevelsToSkipForTargetDim(size_t W, size_t H, size_t num_levels, size_t target_max_dim)
+{
+	if(target_max_dim == 0)
+		return 0;
+
+	const size_t max_dim = myMax(W, H);
+	int num_skipped = 0;
+	while((size_t)num_skipped + 1 < num_levels && num_skipped < 30)
+	{
+		const size_t next_level_max_dim = myMax<size_t>(1, max_dim >> (num_skipped + 1));
+		if(next_level_max_dim < target_max_dim)
+			break;
+		num_skipped++;
+	}
+	return num_skipped;
+}
+
+
 bool ImFormatDecoder::hasImageExtension(const std::string& path)
 {
 	return
@@ -125,3 +187,41 @@ bool ImFormatDecoder::hasImageExtension(const std::string& path)
 		hasExtension(path, "ktx") || 
 		hasExtension(path, "ktx2");
 }
+
+
+#if BUILD_TESTS
+
+
+#include "ImageRowDownsampler.h"
+#include "../utils/IncludeHalf.h"
+#include "../utils/TestUtils.h"
+
+
+void ImFormatDecoder::test()
+{
+	ImageRowDownsampler<uint8,  UInt8ComponentValueTraits,  uint64>::test();
+	ImageRowDownsampler<uint16, UInt16ComponentValueTraits, uint64>::test();
+	ImageRowDownsampler<half,   HalfComponentValueTraits,   float>::test();
+	ImageRowDownsampler<float,  FloatComponentValueTraits,  float>::test();
+
+	testAssert(numHalvingsForTargetDim(8192, 4096, /*target max dim=*/0, /*max num halvings=*/3) == 0);
+	testAssert(numHalvingsForTargetDim(8192, 4096, 256, 3) == 3); // Limited by max num halvings
+	testAssert(numHalvingsForTargetDim(8192, 4096, 256, 10) == 5); // 8192 / 32 = 256
+	testAssert(numHalvingsForTargetDim(8192, 4096, 257, 10) == 4);
+	testAssert(numHalvingsForTargetDim(4096, 8192, 256, 10) == 5); // Uses larger dimension
+	testAssert(numHalvingsForTargetDim(1000, 10, 250, 10) == 2); // 1000 / 4 = 250
+	testAssert(numHalvingsForTargetDim(1001, 10, 250, 10) == 2); // ceil(1001 / 4) = 251, ceil(1001 / 8) = 126
+	testAssert(numHalvingsForTargetDim(100, 100, 1000, 10) == 0); // Image already smaller than target.
+
+	testAssert(numMipLevelsToSkipForTargetDim(1024, 512, /*num levels=*/11, /*target max dim=*/0) == 0);
+	testAssert(numMipLevelsToSkipForTargetDim(1024, 512, 11, 256) == 2);
+	testAssert(numMipLevelsToSkipForTargetDim(1024, 512, 11, 255) == 2);
+	testAssert(numMipLevelsToSkipForTargetDim(1024, 512, 11, 257) == 1);
+	testAssert(numMipLevelsToSkipForTargetDim(1024, 512, 2, 256) == 1); // Limited by number of levels
+	testAssert(numMipLevelsToSkipForTargetDim(1024, 512, 1, 256) == 0);
+	testAssert(numMipLevelsToSkipForTargetDim(1000, 10, 10, 250) == 2); // 1000 >> 2 = 250
+	testAssert(numMipLevelsToSkipForTargetDim(1000, 10, 10, 1) == 9);
+}
+
+
+#endif // BUILD_TESTS
@@ -11,6 +11,8 @@ Copyright Glare Technologies Limited 2021 -
 #include <string>
 #include <vector>
 class Map2D;
+class TiledImageMap;
+namespace glare { class Allocator; }
 
 
 class ImFormatExcep : public glare::Exception
@@ -32,16 +34,38 @@ public:
 
 	struct ImageDecodingOptions
 	{
-		ImageDecodingOptions() : ETC_support(false) {}
+		ImageDecodingOptions() : ETC_support(false), target_max_dim(0) {}
 		bool ETC_support;
+
+		// If non-zero, the image may be decoded at a reduced resolution, by halving the width and height one or more times, 
+		// as long as the larger of the decoded width and height is >= target_max_dim.
+		// Used for low-LOD textures and thumbnails.
+		// Reduction is done with DCT scaling for JPEG, by skipping the larger mip levels for KTX and Basis, and by box-filtering rows as they are decoded for PNG and EXR.
+		// Other formats are decoded at full resolution.
+		size_t target_max_dim;
 	};
 
 	//static void decodeImage(const std::string& path, Bitmap& bitmap_out); // throws ImFormatExcep on failure
 
-	static Reference<Map2D> decodeImage(const std::string& indigo_base_dir, const std::string& path, const ImageDecodingOptions& options = ImageDecodingOptions());
+	// The decoded image, and intermediate buffers where the decoder supports it, are allocated with mem_allocator if it is non-NULL.
+	static Reference<Map2D> decodeImage(const std::string& indigo_base_dir, const std::string& path, const ImageDecodingOptions& options = ImageDecodingOptions(), glare::Allocator* mem_allocator = NULL);
+
+	// Opens the image for reading a tile at a time, for images too large to decode into memory.  See TiledImageMap.
+	// Supported for EXR, and TIFF in Indigo builds.  At most max_tile_cache_size_B bytes of decoded tiles are kept in memory.
+	// throws ImFormatExcep on failure, or if the format is not supported.
+	static Reference<TiledImageMap> openTiledImage(const std::string& path, size_t max_tile_cache_size_B);
+
+	// Returns the number of times the width and height of a W x H image can be halved (rounding up), up to max_num_halvings times, 
+	// while keeping the larger of the halved width and height >= target_max_dim.  Returns 0 if target_max_dim is 0.
+	static int numHalvingsForTargetDim(size_t W, size_t H, size_t target_max_dim, int max_num_halvings);
+
+	// Number of mip levels to skip so that the largest remaining level has max(level W, level H) >= target_max_dim.  Returns a value < num_levels.
+	static int numMipLevelsToSkipForTargetDim(size_t W, size_t H, size_t num_levels, size_t target_max_dim);
 
 	static bool hasImageExtension(const std::string& path);
 
+	static void test();
+
 private:
 	ImFormatDecoder();
 };
@@ -17,6 +17,7 @@ Copyright Glare Technologies Limited 2024 -
 #include "../utils/FileOutStream.h"
 #include "../utils/MemMappedFile.h"
 #include "../utils/Timer.h"
+#include "../utils/AllocatorVector.h"
 #include <jpeglib.h>
 #if !defined NO_LCMS_SUPPORT
 #include <lcms2.h>
@@ -86,12 +87,12 @@ public:
 };
 
 
-Reference<Map2D> JPEGDecoder::decode(const std::string& base_dir_path, const std::string& path, glare::Allocator* mem_allocator)
+Reference<Map2D> JPEGDecoder::decode(const std::string& base_dir_path, const std::string& path, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	try
 	{
 		MemMappedFile file(path);
-		return decodeFromBuffer(file.fileData(), file.fileSize(), base_dir_path, mem_allocator);
+		return decodeFromBuffer(file.fileData(), file.fileSize(), base_dir_path, mem_allocator, target_max_dim);
 	}
 	catch(glare::Exception& e)
 	{
@@ -100,7 +101,7 @@ Reference<Map2D> JPEGDecoder::decode(const std::string& base_dir_path, const std
 }
 
 
-Reference<Map2D> JPEGDecoder::decodeFromBuffer(const void* data, size_t size, const std::string& base_dir_path, glare::Allocator* mem_allocator)
+Reference<Map2D> JPEGDecoder::decodeFromBuffer(const void* data, size_t size, const std::string& base_dir_path, glare::Allocator* mem_allocator, size_t target_max_dim)
 {
 	try
 	{
@@ -175,6 +176,12 @@ Reference<Map2D> JPEGDecoder::decodeFromBuffer(const void* data, size_t size, co
 			cinfo.out_color_space = JCS_CMYK;
 #endif
 
+		// Decode at reduced resolution if requested.  libjpeg-turbo does the scaling in the inverse DCT, which makes decoding a lot faster as well.
+		// The output size is ceil(image_width / scale_denom) x ceil(image_height / scale_denom).
+		const int num_halvings = ImFormatDecoder::numHalvingsForTargetDim(cinfo.image_width, cinfo.image_height, target_max_dim, /*max num halvings=*/3);
+		cinfo.scale_num = 1;
+		cinfo.scale_denom = 1u << num_halvings;
+
 		jpeg_start_decompress(&cinfo);
 
 		if(!(cinfo.num_components == 1 || cinfo.num_components == 3 || cinfo.num_components == 4))
@@ -209,10 +216,12 @@ Reference<Map2D> JPEGDecoder::decodeFromBuffer(const void* data, size_t size, co
 		if(cinfo.out_color_space == JCS_CMYK)
 		{
 			// Make a one-row-high sample array that will go away when done with image
-			std::vector<uint8_t> buffer(row_stride);
+			glare::AllocatorVector<uint8_t, 16> buffer(mem_allocator);
+			buffer.resizeNoCopy(row_stride);
 			uint8_t* scanline_ptrs[1] = { &buffer[0] };
 
-			std::vector<uint8_t> modified_buffer(row_stride); // Used for storing inverted CMYK colours.
+			glare::AllocatorVector<uint8_t, 16> modified_buffer(mem_allocator); // Used for storing inverted CMYK colours.
+			modified_buffer.resizeNoCopy(row_stride);
 
 			// Make a little CMS transform
 			MemMappedFile in_profile_file(base_dir_path + "/data/ICC_profiles/USWebCoatedSWOP.icc");
@@ -625,6 +634,52 @@ void JPEGDecoder::test(const std::string& base_dir_path)
 			failTest(e.what());
 		}
 
+		// Test decoding at reduced resolution
+		conPrint("test reduced resolution decoding");
+		try
+		{
+			ImageMapUInt8Ref image = new ImageMapUInt8(100, 60, 3);
+			for(size_t y=0; y<image->getHeight(); ++y)
+			for(size_t x=0; x<image->getWidth(); ++x)
+			{
+				image->getPixel(x, y)[0] = (uint8)(x * 2);
+				image->getPixel(x, y)[1] = (uint8)(y * 4);
+				image->getPixel(x, y)[2] = 100;
+			}
+			JPEGDecoder::save(image, save_path, JPEGDecoder::SaveOptions());
+
+			Reference<Map2D> im = JPEGDecoder::decode(base_dir_path, save_path, /*mem allocator=*/NULL, /*target max dim=*/0);
+			testAssert(im->getMapWidth() == 100 && im->getMapHeight() == 60);
+
+			im = JPEGDecoder::decode(base_dir_path, save_path, /*mem allocator=*/NULL, /*target max dim=*/100);
+			testAssert(im->getMapWidth() == 100 && im->getMapHeight() == 60);
+
+			im = JPEGDecoder::decode(base_dir_path, save_path, /*mem allocator=*/NULL, /*target max dim=*/50);
+			testAssert(im->getMapWidth() == 50 && im->getMapHeight() == 30);
+
+			im = JPEGDecoder::decode(base_dir_path, save_path, /*mem allocator=*/NULL, /*target max dim=*/25);
+			testAssert(im->getMapWidth() == 25 && im->getMapHeight() == 15);
+			testAssert(im->numChannels() == 3);
+
+			// Check the reduced image looks like the original, downsized.
+			const ImageMapUInt8* reduced = im.downcastToPtr<ImageMapUInt8>();
+			for(size_t y=1; y+1<reduced->getHeight(); ++y)
+			for(size_t x=1; x+1<reduced->getWidth(); ++x)
+			{
+				testAssert(std::abs((int)reduced->getPixel(x, y)[0] - (int)(x * 8 + 3)) <= 8);
+				testAssert(std::abs((int)reduced->getPixel(x, y)[1] - (int)(y * 16 + 6)) <= 8);
+				testAssert(std::abs((int)reduced->getPixel(x, y)[2] - 100) <= 8);
+			}
+
+			// Smallest reduction supported is 1/8.
+			im = JPEGDecoder::decode(base_dir_path, save_path, /*mem allocator=*/NULL, /*target max dim=*/1);
+			testAssert(im->getMapWidth() == 13 && im->getMapHeight() == 8);
+		}
+		catch(ImFormatExcep& e)
+		{
+			failTest(e.what());
+		}
+
 		// Try loading an invalid file
 		conPrint("test 4");
 		try
@@ -34,9 +34,11 @@ public:
 	};
 
 
-	static Reference<Map2D> decode(const std::string& base_dir_path, const std::string& path, glare::Allocator* mem_allocator = NULL);
+	// If target_max_dim is non-zero, the image is decoded at 1/2, 1/4 or 1/8 resolution, using libjpeg-turbo DCT scaling, 
+	// if the larger of the reduced width and height is still >= target_max_dim.  See ImFormatDecoder::ImageDecodingOptions.
+	static Reference<Map2D> decode(const std::string& base_dir_path, const std::string& path, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
 
-	static Reference<Map2D> decodeFromBuffer(const void* data, size_t size, const std::string& base_dir_path, glare::Allocator* mem_allocator = NULL);
+	static Reference<Map2D> decodeFromBuffer(const void* data, size_t size, const std::string& base_dir_path, glare::Allocator* mem_allocator = NULL, size_t target_max_dim = 0);
 
 	static void saveToStream(const Reference<ImageMapUInt8>& image, const SaveOptions& options, OutStream& stream);
 	static void save(const Reference<ImageMapUInt8>& image, const std::string& path, const SaveOptions& options);
@@ -17,6 +17,8 @@ Copyright Glare Technologies Limited 2020 -
 #include "../utils/ConPrint.h"
 #include "../utils/BitUtils.h"
 #include "../utils/RuntimeCheck.h"
+#include "../utils/MemMappedFile.h"
+#include "../utils/FileHandle.h"
 #include <vector>
 #include <string.h>
 #include <algorithm>
@@ -34,9 +36,13 @@ Copyright Glare Technologies Limited 2020 -
 #include <sys/select.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h> // For writev
 #include <errno.h>
 #include <poll.h>
 #endif
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
 
 
 #if defined(_WIN32)
@@ -528,6 +534,119 @@ void MySocket::write(const void* data, size_t datalen, FractionListener* frac)
 }
 
 
+void MySocket::writeDataSlices(ArrayRef<ArrayRef<uint8>> slices)
+{
+#if defined(_WIN32)
+	SocketInterface::writeDataSlices(slices);
+#else
+	const size_t MAX_NUM_IOVECS = 64; // Well under IOV_MAX.
+	iovec iovecs[MAX_NUM_IOVECS];
+
+	size_t slice_i = 0; // Index of first slice with data remaining to be written
+	size_t slice_offset = 0; // Number of bytes of slices[slice_i] already written
+	while(1)
+	{
+		size_t num_iovecs = 0;
+		for(size_t i=slice_i; (i < slices.size()) && (num_iovecs < MAX_NUM_IOVECS); ++i)
+		{
+			const size_t offset = (i == slice_i) ? slice_offset : 0;
+			if(slices[i].size() > offset)
+			{
+				iovecs[num_iovecs].iov_base = (void*)(slices[i].data() + offset);
+				iovecs[num_iovecs].iov_len = myMin(MAX_READ_OR_WRITE_SIZE, slices[i].size() - offset);
+				num_iovecs++;
+			}
+		}
+		if(num_iovecs == 0) // If all data has been written:
+			return;
+
+		const ssize_t num_bytes_written = ::writev(sockethandle, iovecs, (int)num_iovecs);
+		if(num_bytes_written == SOCKET_ERROR)
+		{
+			if(errno == EINTR)
+				continue;
+			throw makeMySocketExcepFromLastErrorCode("write failed");
+		}
+
+		// Advance slice_i and slice_offset past the written bytes.
+		size_t remaining = (size_t)num_bytes_written;
+		while(slice_i < slices.size())
+		{
+			const size_t num_left_in_slice = slices[slice_i].size() - slice_offset;
+			if(remaining < num_left_in_slice)
+			{
+				slice_offset += remaining;
+				break;
+			}
+			remaining -= num_left_in_slice;
+			slice_i++;
+			slice_offset = 0;
+		}
+	}
+#endif
+}
+
+
+#if defined(__linux__)
+void MySocket::sendFile(ArrayRef<uint8> prefix, int file_descriptor, uint64 offset, uint64 num_bytes)
+{
+	// Send the prefix with MSG_MORE, so it gets coalesced with the start of the file data into full-sized packets, instead of being sent in its own packet.
+	const uint8* prefix_data = prefix.data();
+	size_t prefix_remaining = prefix.size();
+	while(prefix_remaining > 0)
+	{
+		const ssize_t num_bytes_written = send(sockethandle, prefix_data, prefix_remaining, (num_bytes > 0) ? MSG_MORE : 0);
+		if(num_bytes_written == SOCKET_ERROR)
+		{
+			if(errno == EINTR)
+				continue;
+			throw makeMySocketExcepFromLastErrorCode("write failed");
+		}
+		prefix_data += num_bytes_written;
+		prefix_remaining -= num_bytes_written;
+	}
+
+	off_t file_offset = (off_t)offset;
+	uint64 remaining = num_bytes;
+	while(remaining > 0)
+	{
+		const ssize_t num_bytes_written = sendfile(sockethandle, file_descriptor, &file_offset, (size_t)myMin<uint64>(remaining, MAX_READ_OR_WRITE_SIZE)); // Advances file_offset.
+		if(num_bytes_written == SOCKET_ERROR)
+		{
+			if(errno == EINTR)
+				continue;
+			throw makeMySocketExcepFromLastErrorCode("sendfile failed");
+		}
+		if(num_bytes_written == 0)
+			throw MySocketExcep("sendfile failed: unexpected end of file.");
+		remaining -= num_bytes_written;
+	}
+}
+#endif
+
+
+void MySocket::writeFileData(ArrayRef<uint8> prefix, const MemMappedFile& file, size_t offset, size_t num_bytes)
+{
+#if defined(__linux__)
+	runtimeCheck(offset <= file.fileSize() && num_bytes <= file.fileSize() - offset);
+
+	sendFile(prefix, file.getFileDescriptor(), offset, num_bytes);
+#else
+	SocketInterface::writeFileData(prefix, file, offset, num_bytes); // Writes from the mapped memory with writeDataSlices().
+#endif
+}
+
+
+void MySocket::writeFileData(ArrayRef<uint8> prefix, FileHandle& file, uint64 offset, uint64 num_bytes)
+{
+#if defined(__linux__)
+	sendFile(prefix, file.getFileDescriptor(), offset, num_bytes);
+#else
+	SocketInterface::writeFileData(prefix, file, offset, num_bytes);
+#endif
+}
+
+
 // Read 1 or more bytes from the socket, up to a maximum of max_num_bytes.  Returns number of bytes read.
 // Returns zero if connection was closed gracefully
 size_t MySocket::readSomeBytes(void* buffer, size_t max_num_bytes)
@@ -541,6 +660,30 @@ size_t MySocket::readSomeBytes(void* buffer, size_t max_num_bytes)
 }
 
 
+bool MySocket::tryReadSomeBytes(void* buffer, size_t max_num_bytes, size_t& num_bytes_read_out, bool& wait_for_writable_out)
+{
+	wait_for_writable_out = false;
+
+	const int numbytesread = recv(sockethandle, (char*)buffer, (int)myMin(MAX_READ_OR_WRITE_SIZE, max_num_bytes), 0);
+	if(numbytesread == SOCKET_ERROR)
+	{
+#if defined(_WIN32)
+		const int error_code = WSAGetLastError();
+		if(error_code == WSAEWOULDBLOCK)
+			return false;
+#else
+		const int error_code = errno;
+		if(error_code == EAGAIN || error_code == EWOULDBLOCK || error_code == EINTR)
+			return false;
+#endif
+		throw makeMySocketExcepFromLastErrorCode("Read failed");
+	}
+
+	num_bytes_read_out = (size_t)numbytesread;
+	return true;
+}
+
+
 void MySocket::readTo(void* buffer, size_t readlen)
 {
 	readTo(buffer, readlen, NULL);
@@ -921,6 +1064,20 @@ void MySocket::setTimeout(double timeout_s)
 
 
 
+void MySocket::setBlocking(bool blocking)
+{
+#if defined(_WIN32)
+	u_long nonblocking = blocking ? 0 : 1;
+	const int result = ioctlsocket(sockethandle, FIONBIO, &nonblocking);
+#else
+	int nonblocking = blocking ? 0 : 1;
+	const int result = ioctl(sockethandle, FIONBIO, &nonblocking);
+#endif
+	if(result != 0)
+		throw MySocketExcep("Failed to set socket blocking mode: " + Networking::getError());
+}
+
+
 void MySocket::initFDSetWithSocket(fd_set& sockset, SOCKETHANDLE_TYPE& sockhandle)
 {
 	FD_ZERO(&sockset);
@@ -148,6 +148,14 @@ public:
 
 	virtual void setTimeout(double timeout_s);
 
+	virtual void setBlocking(bool blocking);
+
+	virtual bool tryReadSomeBytes(void* buffer, size_t max_num_bytes, size_t& num_bytes_read_out, bool& wait_for_writable_out);
+
+	virtual void writeDataSlices(ArrayRef<ArrayRef<uint8>> slices);
+	virtual void writeFileData(ArrayRef<uint8> prefix, const MemMappedFile& file, size_t offset, size_t num_bytes);
+	virtual void writeFileData(ArrayRef<uint8> prefix, FileHandle& file, uint64 offset, uint64 num_bytes);
+
 	bool readable(double timeout_s); // Block until socket becomes readable, or the timeout is reached.
 	bool readable(EventFD& event_fd); // Block until either the socket is readable or the event_fd is signalled (becomes readable).
 	// Returns true if the socket was readable or an error occurred with the socket, false if the event_fd was signalled.
@@ -184,6 +192,9 @@ private:
 	static SOCKETHANDLE_TYPE nullSocketHandle();
 	static bool isSockHandleValid(SOCKETHANDLE_TYPE handle);
 	static void initFDSetWithSocket(fd_set& sockset, SOCKETHANDLE_TYPE& sockhandle);
+#if defined(__linux__)
+	void sendFile(ArrayRef<uint8> prefix, int file_descriptor, uint64 offset, uint64 num_bytes);
+#endif
 
 
 	SOCKETHANDLE_TYPE sockethandle;
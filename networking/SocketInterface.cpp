@@ -7,6 +7,11 @@ Copyright Glare Technologies Limited 2020 -
 
 
 #include "../utils/RuntimeCheck.h"
+#include "../utils/Exception.h"
+#include "../utils/MemMappedFile.h"
+#include "../utils/FileHandle.h"
+#include "../maths/mathstypes.h"
+#include <vector>
 
 
 SocketInterface::~SocketInterface()
@@ -27,3 +32,64 @@ size_t SocketInterface::readSomeBytesChecked(MutableArrayRef<uint8> buf, size_t
 	else
 		return 0;
 }
+
+
+void SocketInterface::setBlocking(bool blocking)
+{
+	if(!blocking)
+		throw glare::Exception("Non-blocking mode is not supported by this socket type.");
+}
+
+
+bool SocketInterface::tryReadSomeBytes(void* buffer, size_t max_num_bytes, size_t& num_bytes_read_out, bool& wait_for_writable_out)
+{
+	wait_for_writable_out = false;
+	num_bytes_read_out = readSomeBytes(buffer, max_num_bytes);
+	return true;
+}
+
+
+void SocketInterface::writeDataSlices(ArrayRef<ArrayRef<uint8>> slices)
+{
+	for(size_t i=0; i<slices.size(); ++i)
+		if(!slices[i].empty())
+			writeData(slices[i].data(), slices[i].size());
+}
+
+
+void SocketInterface::writeFileData(ArrayRef<uint8> prefix, const MemMappedFile& file, size_t offset, size_t num_bytes)
+{
+	runtimeCheck(offset <= file.fileSize() && num_bytes <= file.fileSize() - offset);
+
+	const ArrayRef<uint8> slices[2] = { prefix, (num_bytes > 0) ? ArrayRef<uint8>((const uint8*)file.fileData() + offset, num_bytes) : ArrayRef<uint8>() };
+	writeDataSlices(ArrayRef<ArrayRef<uint8>>(slices, 2));
+}
+
+
+void SocketInterface::writeFileData(ArrayRef<uint8> prefix, FileHandle& file, uint64 offset, uint64 num_bytes)
+{
+	if(!prefix.empty())
+		writeData(prefix.data(), prefix.size());
+
+	if(num_bytes == 0)
+		return;
+
+#if defined(_WIN32)
+	if(_fseeki64(file.getFile(), (int64)offset, SEEK_SET) != 0)
+#else
+	if(fseeko(file.getFile(), (off_t)offset, SEEK_SET) != 0)
+#endif
+		throw glare::Exception("Failed to seek in file.");
+
+	std::vector<uint8> buf((size_t)myMin<uint64>(num_bytes, 1 << 16));
+	uint64 remaining = num_bytes;
+	while(remaining > 0)
+	{
+		const size_t chunk_size = (size_t)myMin<uint64>(remaining, buf.size());
+		if(fread(buf.data(), 1, chunk_size, file.getFile()) != chunk_size)
+			throw glare::Exception("Failed to read from file.");
+
+		writeData(buf.data(), chunk_size);
+		remaining -= chunk_size;
+	}
+}
@@ -11,7 +11,10 @@ Copyright Glare Technologies Limited 2020 -
 #include "../utils/OutStream.h"
 #include "../utils/ThreadSafeRefCounted.h"
 #include "../utils/Reference.h"
+#include "../utils/ArrayRef.h"
 class EventFD;
+class MemMappedFile;
+class FileHandle;
 
 
 /*=====================================================================
@@ -59,6 +62,31 @@ public:
 	virtual bool readable(EventFD& event_fd) = 0; // Block until either the socket is readable or the event_fd is signalled (becomes readable).
 	// Returns true if the socket was readable, false if the event_fd was signalled.
 
+	// Sets the socket to blocking mode (the default) or non-blocking mode.
+	// The default implementation throws an exception if asked for non-blocking mode.
+	virtual void setBlocking(bool blocking);
+
+	// For sockets in non-blocking mode.  Reads up to max_num_bytes without blocking.
+	// Returns false if no data could be read without blocking.  In that case wait_for_writable_out is set to true if the
+	// socket needs to become writable before the read can make progress (can happen during a TLS handshake).
+	// Otherwise returns true and sets num_bytes_read_out, which will be zero if the connection was closed gracefully.
+	// The default implementation just calls readSomeBytes().
+	virtual bool tryReadSomeBytes(void* buffer, size_t max_num_bytes, size_t& num_bytes_read_out, bool& wait_for_writable_out);
+
+	// Writes the slices in order, as if writeData() was called on each one.
+	// MySocket does this with gather writes (writev), so e.g. a response header and body can be sent without copying them into one buffer, and without
+	// the header going out in its own packet.  The default implementation calls writeData() for each slice.
+	virtual void writeDataSlices(ArrayRef<ArrayRef<uint8>> slices);
+
+	// Writes prefix (may be empty), then num_bytes of the file starting at offset.
+	// MySocket uses sendfile() on Linux, so the file data goes from the page cache to the socket without passing through user space.
+	// The default implementation writes directly from the mapped file memory.
+	virtual void writeFileData(ArrayRef<uint8> prefix, const MemMappedFile& file, size_t offset, size_t num_bytes);
+
+	// As above, for a file opened with a FileHandle.  The file should not have any unflushed writes.
+	// The default implementation reads and writes the file in fixed-size chunks.
+	virtual void writeFileData(ArrayRef<uint8> prefix, FileHandle& file, uint64 offset, uint64 num_bytes);
+
 	virtual IPAddress getOtherEndIPAddress() const = 0;
 	virtual int getOtherEndPort() const = 0;
 
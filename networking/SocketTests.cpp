@@ -15,6 +15,9 @@ Copyright Glare Technologies Limited 2020 -
 #include "../utils/PlatformUtils.h"
 #include "../utils/SocketBufferOutStream.h"
 #include "../utils/Timer.h"
+#include "../utils/MemMappedFile.h"
+#include "../utils/FileHandle.h"
+#include "../utils/FileUtils.h"
 #include <cstring>
 
 
@@ -587,6 +590,108 @@ public:
 //==============================================================================================================
 
 
+// Writes slices and file data using writeDataSlices() and writeFileData(), as done by the web server.
+class TestGatherWriteServerThread : public MyThread
+{
+public:
+	TestGatherWriteServerThread(MySocketRef socket_, const std::vector<std::vector<uint8>>& slices_, const std::string& file_path_) : socket(socket_), slices(slices_), file_path(file_path_) {}
+
+	virtual void run()
+	{
+		try
+		{
+			std::vector<ArrayRef<uint8>> slice_refs;
+			for(size_t i=0; i<slices.size(); ++i)
+				slice_refs.push_back(ArrayRef<uint8>(slices[i]));
+			socket->writeDataSlices(slice_refs);
+
+			const std::string prefix = "prefix";
+			const ArrayRef<uint8> prefix_ref((const uint8*)prefix.data(), prefix.size());
+
+			MemMappedFile mem_mapped_file(file_path);
+			socket->writeFileData(prefix_ref, mem_mapped_file, /*offset=*/1000, /*num bytes=*/mem_mapped_file.fileSize() - 1000);
+			socket->writeFileData(prefix_ref, mem_mapped_file, /*offset=*/0, /*num bytes=*/0);
+
+			FileHandle file_handle(file_path, "rb");
+			socket->writeFileData(ArrayRef<uint8>(), file_handle, /*offset=*/10, /*num bytes=*/100000);
+
+			socket->waitForGracefulDisconnect(); // Wait for the client to close first, so the server port doesn't end up in TIME_WAIT.
+		}
+		catch(glare::Exception& e)
+		{
+			failTest("TestGatherWriteServerThread excep: " + e.what());
+		}
+	}
+
+	MySocketRef socket;
+	std::vector<std::vector<uint8>> slices;
+	std::string file_path;
+};
+
+
+static void testGatherAndFileWrites(int port)
+{
+	conPrint("testGatherAndFileWrites()");
+	try
+	{
+		// Make some slices, including empty ones, and more than fit in a single writev call.
+		std::vector<std::vector<uint8>> slices(200);
+		uint32 rng_state = 1;
+		for(size_t i=0; i<slices.size(); ++i)
+		{
+			slices[i].resize((i % 7 == 0) ? 0 : (i * 37) % 5000);
+			for(size_t z=0; z<slices[i].size(); ++z)
+			{
+				rng_state = rng_state * 1664525u + 1013904223u; // LCG
+				slices[i][z] = (uint8)(rng_state >> 24);
+			}
+		}
+
+		std::vector<uint8> file_contents(1 << 20);
+		for(size_t i=0; i<file_contents.size(); ++i)
+			file_contents[i] = (uint8)((i * 7) ^ (i >> 8));
+		const std::string file_path = PlatformUtils::getTempDirPath() + "/socket_tests_file_data.bin";
+		FileUtils::writeEntireFile(file_path, file_contents);
+
+		std::vector<uint8> expected;
+		for(size_t i=0; i<slices.size(); ++i)
+			expected.insert(expected.end(), slices[i].begin(), slices[i].end());
+		const std::string prefix = "prefix";
+		expected.insert(expected.end(), prefix.begin(), prefix.end());
+		expected.insert(expected.end(), file_contents.begin() + 1000, file_contents.end());
+		expected.insert(expected.end(), prefix.begin(), prefix.end());
+		expected.insert(expected.end(), file_contents.begin() + 10, file_contents.begin() + 10 + 100000);
+
+		MySocket listener;
+		listener.bindAndListen(port);
+		MySocketRef client_socket = new MySocket("localhost", port);
+		MySocketRef server_socket = listener.acceptConnection();
+
+		Reference<TestGatherWriteServerThread> server_thread = new TestGatherWriteServerThread(server_socket, slices, file_path);
+		server_thread->launch();
+
+		std::vector<uint8> received(expected.size());
+		client_socket->readData(received.data(), received.size());
+		testAssert(received == expected);
+
+		client_socket->startGracefulShutdown();
+		server_thread->join();
+		server_thread = NULL;
+		server_socket = NULL; // Closes the server side of the connection
+		client_socket->waitForGracefulDisconnect();
+
+		FileUtils::deleteFile(file_path);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+}
+
+
+//==============================================================================================================
+
+
 
 void SocketTests::test()
 {
@@ -596,6 +701,8 @@ void SocketTests::test()
 
 	const int port = 5000;
 
+	testGatherAndFileWrites(port);
+
 	//==================== Test timeout of a blocking read call. ========================
 	for(int i=0; i<2; ++i) // Test reading then writing in the client
 	{
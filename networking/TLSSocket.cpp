@@ -115,6 +115,7 @@ std::string getTLSConfigErrorString(struct tls_config* tls_config_)
 TLSSocket::TLSSocket(MySocketRef plain_socket_, tls_config* client_tls_config, const std::string& servername)
 {
 	plain_socket = plain_socket_;
+	timeout_s = 0;
 
 	tls_context = tls_client();
 	if(!tls_context)
@@ -140,6 +141,7 @@ TLSSocket::TLSSocket(MySocketRef plain_socket_, tls_config* client_tls_config, c
 TLSSocket::TLSSocket(MySocketRef plain_socket_, struct tls* tls_context_)
 {
 	plain_socket = plain_socket_;
+	timeout_s = 0;
 
 	tls_context = tls_context_;
 
@@ -170,6 +172,15 @@ void TLSSocket::initTLS()
 }
 
 
+// When a timeout is set on the plain socket, a blocking read or write that times out is reported by tls_read() or tls_write() as TLS_WANT_POLLIN or TLS_WANT_POLLOUT.
+// The blocking loops below retry on those, so throw once the timeout has elapsed, otherwise a stalled peer would block the loop forever.
+static void checkForTimeout(double timeout_s, const Timer& timer)
+{
+	if(timeout_s > 0 && timer.elapsed() >= timeout_s)
+		throw MySocketExcep("Timed out.");
+}
+
+
 void TLSSocket::write(const void* data, size_t datalen)
 {
 	write(data, datalen, NULL);
@@ -179,6 +190,7 @@ void TLSSocket::write(const void* data, size_t datalen)
 void TLSSocket::write(const void* data, size_t datalen, FractionListener* frac)
 {
 	const size_t total_num_bytes_to_write = datalen;
+	Timer timer;
 
 	while(datalen > 0) // while still bytes to write:
 	{
@@ -187,13 +199,17 @@ void TLSSocket::write(const void* data, size_t datalen, FractionListener* frac)
 
 		const ssize_t num_bytes_written = tls_write(tls_context, data, num_bytes_to_write);
 		if(num_bytes_written == TLS_WANT_POLLIN || num_bytes_written == TLS_WANT_POLLOUT)
+		{
+			checkForTimeout(timeout_s, timer);
 			continue;
+		}
 
 		if(num_bytes_written == SOCKET_ERROR)
 			throw MySocketExcep("write failed: " + getTLSErrorString(tls_context));
 
 		datalen -= num_bytes_written;
 		data = (void*)((uint8*)data + num_bytes_written); // Advance data pointer
+		timer.reset(); // The timeout applies to each blocked write, as with the plain socket.
 
 		if(frac)
 			frac->setFraction((float)(total_num_bytes_to_write - datalen) / (float)total_num_bytes_to_write);
@@ -201,13 +217,67 @@ void TLSSocket::write(const void* data, size_t datalen, FractionListener* frac)
 }
 
 
+// Each tls_write() call makes at least one TLS record, so copy small slices (e.g. an HTTP header) together into full-sized records.
+// Large slices are written directly from their own memory, so there is no intermediate copy of e.g. a whole response body.
+void TLSSocket::writeDataSlices(ArrayRef<ArrayRef<uint8>> slices)
+{
+	const size_t RECORD_SIZE = 16384; // Max TLS record plaintext size
+	uint8 record_buf[RECORD_SIZE];
+	size_t record_buf_size = 0;
+
+	for(size_t i=0; i<slices.size(); ++i)
+	{
+		const uint8* data = slices[i].data();
+		size_t size = slices[i].size();
+
+		// Append as much of the slice as fits to the record buffer, if the buffer is in use or the slice is small.
+		if(record_buf_size > 0 || size < RECORD_SIZE)
+		{
+			const size_t num_to_copy = myMin(size, RECORD_SIZE - record_buf_size);
+			if(num_to_copy > 0)
+				std::memcpy(record_buf + record_buf_size, data, num_to_copy);
+			record_buf_size += num_to_copy;
+			data += num_to_copy;
+			size -= num_to_copy;
+
+			if(record_buf_size == RECORD_SIZE)
+			{
+				write(record_buf, record_buf_size);
+				record_buf_size = 0;
+			}
+		}
+
+		// Write any remaining large part of the slice directly, apart from a small tail which is buffered.
+		if(size >= RECORD_SIZE)
+		{
+			const size_t direct_size = size - (size % RECORD_SIZE);
+			write(data, direct_size);
+			data += direct_size;
+			size -= direct_size;
+		}
+		if(size > 0)
+		{
+			std::memcpy(record_buf, data, size);
+			record_buf_size = size;
+		}
+	}
+
+	if(record_buf_size > 0)
+		write(record_buf, record_buf_size);
+}
+
+
 size_t TLSSocket::readSomeBytes(void* buffer, size_t max_num_bytes)
 {
+	Timer timer;
 	while(1)
 	{
 		const ssize_t num_bytes_read = tls_read(tls_context, buffer, max_num_bytes);
 		if(num_bytes_read == TLS_WANT_POLLIN || num_bytes_read == TLS_WANT_POLLOUT)
+		{
+			checkForTimeout(timeout_s, timer);
 			continue;
+		}
 
 		if(num_bytes_read == SOCKET_ERROR) // Connection was reset/broken
 			throw MySocketExcep("Read failed, error: " + getTLSErrorString(tls_context));
@@ -217,6 +287,24 @@ size_t TLSSocket::readSomeBytes(void* buffer, size_t max_num_bytes)
 }
 
 
+bool TLSSocket::tryReadSomeBytes(void* buffer, size_t max_num_bytes, size_t& num_bytes_read_out, bool& wait_for_writable_out)
+{
+	const ssize_t num_bytes_read = tls_read(tls_context, buffer, max_num_bytes);
+	if(num_bytes_read == TLS_WANT_POLLIN || num_bytes_read == TLS_WANT_POLLOUT)
+	{
+		wait_for_writable_out = num_bytes_read == TLS_WANT_POLLOUT;
+		return false;
+	}
+
+	if(num_bytes_read == SOCKET_ERROR) // Connection was reset/broken
+		throw MySocketExcep("Read failed, error: " + getTLSErrorString(tls_context));
+
+	wait_for_writable_out = false;
+	num_bytes_read_out = (size_t)num_bytes_read;
+	return true;
+}
+
+
 void TLSSocket::setNoDelayEnabled(bool enabled) // NoDelay option is off by default.
 {
 	plain_socket->setNoDelayEnabled(enabled);
@@ -238,6 +326,13 @@ void TLSSocket::setAddressReuseEnabled(bool enabled)
 void TLSSocket::setTimeout(double s)
 {
 	plain_socket->setTimeout(s);
+	timeout_s = s;
+}
+
+
+void TLSSocket::setBlocking(bool blocking)
+{
+	plain_socket->setBlocking(blocking);
 }
 
 
@@ -250,6 +345,7 @@ void TLSSocket::readTo(void* buffer, size_t readlen)
 void TLSSocket::readTo(void* buffer, size_t readlen, FractionListener* frac)
 {
 	const size_t total_num_bytes_to_read = readlen;
+	Timer timer;
 
 	while(readlen > 0) // While still bytes to read
 	{
@@ -261,7 +357,10 @@ void TLSSocket::readTo(void* buffer, size_t readlen, FractionListener* frac)
 		//------------------------------------------------------------------------
 		const ssize_t num_bytes_read = tls_read(tls_context, buffer, num_bytes_to_read);
 		if(num_bytes_read == TLS_WANT_POLLIN || num_bytes_read == TLS_WANT_POLLOUT)
+		{
+			checkForTimeout(timeout_s, timer);
 			continue;
+		}
 		else if(num_bytes_read == SOCKET_ERROR) // Connection was reset/broken
 			throw MySocketExcep("Read failed, error: " + getTLSErrorString(tls_context));
 		else if(num_bytes_read == 0) // Connection was closed gracefully
@@ -270,6 +369,7 @@ void TLSSocket::readTo(void* buffer, size_t readlen, FractionListener* frac)
 		assert(num_bytes_read <= (ssize_t)num_bytes_to_read);
 		readlen -= num_bytes_read;
 		buffer = (void*)((uint8*)buffer + num_bytes_read);
+		timer.reset();
 
 		if(frac)
 			frac->setFraction((float)(total_num_bytes_to_read - readlen) / (float)total_num_bytes_to_read);
@@ -116,6 +116,12 @@ public:
 
 	virtual void setTimeout(double s);
 
+	virtual void setBlocking(bool blocking);
+
+	virtual bool tryReadSomeBytes(void* buffer, size_t max_num_bytes, size_t& num_bytes_read_out, bool& wait_for_writable_out);
+
+	virtual void writeDataSlices(ArrayRef<ArrayRef<uint8>> slices);
+
 	virtual IPAddress getOtherEndIPAddress() const { return plain_socket->getOtherEndIPAddress(); }
 	virtual int getOtherEndPort() const { return plain_socket->getOtherEndPort(); }
 
@@ -155,6 +161,8 @@ private:
 	MySocketRef plain_socket;
 
 	struct tls* tls_context;
+
+	double timeout_s; // Timeout set with setTimeout(), or 0 if none.
 };
 
 
@@ -36,6 +36,8 @@ AsyncTextureLoader
 ------------------
 In Emscripten, downloads file asynchronously with emscripten_async_wget2, then creates an OpenGLTexture from it.
 In a desktop build, just loads the texture synchronously.
+Textures are loaded with OpenGLEngine::getTexture(), which uses the engine's
+TextureDataCache, if set, to avoid reprocessing textures loaded before.
 =====================================================================*/
 class AsyncTextureLoader : public ThreadSafeRefCounted
 {
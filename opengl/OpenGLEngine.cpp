@@ -21,6 +21,7 @@ Copyright Glare Technologies Limited 2023 -
 #include "TimestampQuery.h"
 #include "BufferedTimeElapsedQuery.h"
 #include "../graphics/TextureProcessing.h"
+#include "../graphics/TextureDataCache.h"
 #include "../graphics/ImageMap.h"
 #include "../graphics/SRGBUtils.h"
 #include "../graphics/PerlinNoise.h"
@@ -66,6 +67,7 @@ Copyright Glare Technologies Limited 2023 -
 // https://www.khronos.org/registry/OpenGL/extensions/EXT/EXT_texture_filter_anisotropic.txt
 #define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT				0x84FF
 #define GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT			0x8E8F
+#define GL_COMPRESSED_RED_RGTC1							0x8DBB
 
 // https://developer.download.nvidia.com/opengl/specs/GL_NVX_gpu_memory_info.txt
 #define GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX			0x9047
@@ -1768,6 +1770,11 @@ void OpenGLEngine::initialise(const std::string& data_dir_, Reference<TextureSer
 	this->texture_compression_BC6H_support = false; // Initial value, can be enabled by EXT_texture_compression_bptc detection below.
 #else
 	this->texture_compression_BC6H_support = true;
+#endif
+#if EMSCRIPTEN
+	this->texture_compression_RGTC_support = false; // Initial value, can be enabled by EXT_texture_compression_rgtc detection below.
+#else
+	this->texture_compression_RGTC_support = true; // RGTC is core in OpenGL 3.0
 #endif
 	this->GL_ARB_bindless_texture_support = false;
 	this->clip_control_support = false;
@@ -1807,6 +1814,7 @@ void OpenGLEngine::initialise(const std::string& data_dir_, Reference<TextureSer
 		if(stringEqual(ext, "EXT_clip_control")) this->clip_control_support = true;
 		if(stringEqual(ext, "OES_texture_float_linear")) this->float_texture_filtering_support = true;
 		if(stringEqual(ext, "EXT_texture_compression_bptc")) this->texture_compression_BC6H_support = true;
+		if(stringEqual(ext, "EXT_texture_compression_rgtc")) this->texture_compression_RGTC_support = true;
 		if(stringEqual(ext, "EXT_disjoint_timer_query_webgl2")) this->EXT_disjoint_timer_query_webgl2_support = true;
 #endif
 	}
@@ -4248,7 +4256,7 @@ static void checkMaterial(const OpenGLMaterial& mat)
 
 static int computeUniformFlagsForMat(const OpenGLMaterial& opengl_mat, const OpenGLMeshRenderData& mesh_data)
 {
-	const bool swizzle_albedo_tex_r_to_rgb = opengl_mat.albedo_texture && (opengl_mat.albedo_texture->getInternalFormat() == GL_R8);
+	const bool swizzle_albedo_tex_r_to_rgb = opengl_mat.albedo_texture && ((opengl_mat.albedo_texture->getInternalFormat() == GL_R8) || (opengl_mat.albedo_texture->getInternalFormat() == GL_COMPRESSED_RED_RGTC1));
 	
 	return
 		(mesh_data.has_shading_normals						? HAVE_SHADING_NORMALS_FLAG			: 0) |
@@ -5003,6 +5011,12 @@ void OpenGLEngine::objectBatchDataChanged(GLObject& object)
 }
 
 
+void OpenGLEngine::setTextureDataCache(const Reference<TextureDataCache>& cache)
+{
+	this->texture_data_cache = cache;
+}
+
+
 // Return an OpenGL texture based on tex_path.  Loads it from disk if needed.  Blocking.
 // Throws glare::Exception
 Reference<OpenGLTexture> OpenGLEngine::getTexture(const std::string& tex_path, const TextureParams& params)
@@ -5023,6 +5037,31 @@ Reference<OpenGLTexture> OpenGLEngine::getTexture(const std::string& tex_path, c
 			return res->second.value;
 		}
 
+		// If there is a texture data cache, and the texture data would be compressed (and so could be cached), try and load the processed texture data from the cache.
+		// This is done before decoding the image, or getting it from the texture server, so on a cache hit the image doesn't need to be decoded.
+		uint64 cache_key = 0;
+		bool use_cache = false;
+		if(texture_data_cache.nonNull() && params.allow_compression && params.use_mipmaps && DXTTextureCompressionSupportedAndEnabled())
+		{
+			TextureDataCache::ProcessingOptions cache_options;
+			cache_options.allow_compression = true;
+			cache_options.build_mipmaps = true;
+			cache_options.convert_float_to_half = params.convert_float_to_half;
+			try
+			{
+				cache_key = TextureDataCache::computeKeyForFile(tex_path, cache_options);
+				use_cache = true;
+			}
+			catch(glare::Exception&)
+			{} // Failed to read file.  Decoding below will fail with a more useful error message.
+
+			if(use_cache)
+			{
+				Reference<TextureData> texture_data = texture_data_cache->lookup(cache_key, this->mem_allocator.ptr());
+				if(texture_data.nonNull())
+					return loadOpenGLTextureForTextureData(texture_key, texture_data, params);
+			}
+		}
 		
 		Reference<Map2D> map;
 		if(texture_server.nonNull())
@@ -5034,7 +5073,21 @@ Reference<OpenGLTexture> OpenGLEngine::getTexture(const std::string& tex_path, c
 			ImFormatDecoder::ImageDecodingOptions options;
 			options.ETC_support = this->texture_compression_ETC_support;
 
-			map = ImFormatDecoder::decodeImage(".", tex_path, options);
+			map = ImFormatDecoder::decodeImage(".", tex_path, options, this->mem_allocator.ptr());
+		}
+
+		if(use_cache && !dynamic_cast<const CompressedImage*>(map.ptr())) // Images that are already compressed, e.g. KTX files, don't need processing, so don't cache them.
+		{
+			Reference<TextureData> texture_data = buildTextureDataForMap2D(*map, params);
+			try
+			{
+				texture_data_cache->insert(cache_key, *texture_data);
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("Warning: failed to insert texture data into cache: " + e.what());
+			}
+			return loadOpenGLTextureForTextureData(texture_key, texture_data, params);
 		}
 
 		Reference<OpenGLTexture> opengl_tex = this->getOrLoadOpenGLTextureForMap2D(texture_key, *map, params);
@@ -6227,107 +6280,73 @@ class ComputeAnimatedObJointMatricesTask : public glare::Task
 public:
 	virtual void run(size_t /*thread_index*/)
 	{
-		while(1)
+		// Keep claiming objects to process until there are none left, so that threads that get cheap objects process more objects.
+		size_t chunk_begin, chunk_end;
+		while(range->claimChunk(chunk_begin, chunk_end))
 		{
-			const int64 index_to_process = next_ob_i->increment();
-			if(index_to_process >= (int64)animated_obs_to_process->size())
-				break;
-
-			GLObject* const ob = (*animated_obs_to_process)[index_to_process];
-
-			const AnimationData& anim_data = ob->mesh_data->animation_data;
-
-			if(!anim_data.animations.empty())
+			for(size_t index_to_process = chunk_begin; index_to_process < chunk_end; ++index_to_process)
 			{
-				ob->anim_node_data.resize(anim_data.nodes.size());
-
-				const float DEBUG_SPEED_FACTOR = 1;
+				GLObject* const ob = (*animated_obs_to_process)[index_to_process];
 
-				const AnimationDatum& anim_datum_a                       = *anim_data.animations        [myClamp(ob->current_anim_i, 0, (int)anim_data.animations.size() - 1)];
-				const std::vector<PerAnimationNodeData>& anim_a_node_data = anim_data.per_anim_node_data[myClamp(ob->current_anim_i, 0, (int)anim_data.animations.size() - 1)];
+				const AnimationData& anim_data = ob->mesh_data->animation_data;
 
-				const int use_next_anim_i = (ob->next_anim_i == -1) ? ob->current_anim_i : ob->next_anim_i;
-				const AnimationDatum& anim_datum_b                        = *anim_data.animations       [myClamp(use_next_anim_i,    0, (int)anim_data.animations.size() - 1)];
-				const std::vector<PerAnimationNodeData>& anim_b_node_data = anim_data.per_anim_node_data[myClamp(use_next_anim_i,    0, (int)anim_data.animations.size() - 1)];
+				if(!anim_data.animations.empty())
+				{
+					ob->anim_node_data.resize(anim_data.nodes.size());
 
-				const float transition_frac = (float)Maths::smoothStep<double>(ob->transition_start_time, ob->transition_end_time, current_time);
+					const float DEBUG_SPEED_FACTOR = 1;
 
-				const float unwrapped_use_in_anim_time = (current_time + (float)ob->use_time_offset) * DEBUG_SPEED_FACTOR;
+					const AnimationDatum& anim_datum_a                       = *anim_data.animations        [myClamp(ob->current_anim_i, 0, (int)anim_data.animations.size() - 1)];
+					const std::vector<PerAnimationNodeData>& anim_a_node_data = anim_data.per_anim_node_data[myClamp(ob->current_anim_i, 0, (int)anim_data.animations.size() - 1)];
 
-				assert(anim_datum_a.anim_len > 0);
-				assert(anim_datum_b.anim_len > 0);
-				const float use_in_anim_time_a = Maths::floatMod(unwrapped_use_in_anim_time, anim_datum_a.anim_len);
-				const float use_in_anim_time_b = Maths::floatMod(unwrapped_use_in_anim_time, anim_datum_b.anim_len);
+					const int use_next_anim_i = (ob->next_anim_i == -1) ? ob->current_anim_i : ob->next_anim_i;
+					const AnimationDatum& anim_datum_b                        = *anim_data.animations       [myClamp(use_next_anim_i,    0, (int)anim_data.animations.size() - 1)];
+					const std::vector<PerAnimationNodeData>& anim_b_node_data = anim_data.per_anim_node_data[myClamp(use_next_anim_i,    0, (int)anim_data.animations.size() - 1)];
 
+					const float transition_frac = (float)Maths::smoothStep<double>(ob->transition_start_time, ob->transition_end_time, current_time);
 
-				// For each input accessor that the animation uses, we have an array of keyframe times.
-				// For each such array, find the current and next keyframe, and interpolation fraction, based on the current time.
-				// Store in a AnimationKeyFrameLocation in key_frame_locs.
-				//
-				// We are doing 2 important optimisations here:
-				// The first is that many nodes in a skeleton may use the same input accessor.  We don't want to search the keyframe times for the correct keyframe every time
-				// the input accessor is used by a node, so we do the search once for the input accessor, and store the results in key_frame_locs.
-				//
-				// The second optimisation is that a particular animation may only use 1 or a few input accessors.
-				// For example the avatar idle animation only uses input accessor 9, and there are 33 input accessors in total.
-				// So for the idle animation we only need to do the keyframe search for input accessor 9, not the 32 other accessors.
+					const float unwrapped_use_in_anim_time = (current_time + (float)ob->use_time_offset) * DEBUG_SPEED_FACTOR;
 
-				const size_t keyframe_times_size = myMax(anim_data.keyframe_times.size(), anim_datum_a.m_keyframe_times.size(), anim_datum_b.m_keyframe_times.size());
-				key_frame_locs.resizeNoCopy(keyframe_times_size * 2); // keyframe times for animation a are first, then keyframe times for animation b.
+					assert(anim_datum_a.anim_len > 0);
+					assert(anim_datum_b.anim_len > 0);
+					const float use_in_anim_time_a = Maths::floatMod(unwrapped_use_in_anim_time, anim_datum_a.anim_len);
+					const float use_in_anim_time_b = Maths::floatMod(unwrapped_use_in_anim_time, anim_datum_b.anim_len);
 
-				//------------------------ Compute keyframe times for animation a -------------------------
-				if(transition_frac < 1.f) // At transition_frac = 1, result is fully animation b, a is used if transition_frac < 1
-				{
-					const js::Vector<KeyFrameTimeInfo>& keyframe_times_a = (!anim_datum_a.m_keyframe_times.empty()) ? anim_datum_a.m_keyframe_times : anim_data.keyframe_times;
 
-					for(size_t q=0; q<anim_datum_a.used_input_accessor_indices.size(); ++q)
-					{
-						const int input_accessor_i = anim_datum_a.used_input_accessor_indices[q];
+					// For each input accessor that the animation uses, we have an array of keyframe times.
+					// For each such array, find the current and next keyframe, and interpolation fraction, based on the current time.
+					// Store in a AnimationKeyFrameLocation in key_frame_locs.
+					//
+					// We are doing 2 important optimisations here:
+					// The first is that many nodes in a skeleton may use the same input accessor.  We don't want to search the keyframe times for the correct keyframe every time
+					// the input accessor is used by a node, so we do the search once for the input accessor, and store the results in key_frame_locs.
+					//
+					// The second optimisation is that a particular animation may only use 1 or a few input accessors.
+					// For example the avatar idle animation only uses input accessor 9, and there are 33 input accessors in total.
+					// So for the idle animation we only need to do the keyframe search for input accessor 9, not the 32 other accessors.
 
-						const KeyFrameTimeInfo& keyframe_time_info = keyframe_times_a[input_accessor_i];
-						assert(keyframe_time_info.times_size == (int)keyframe_time_info.times.size());
+					const size_t keyframe_times_size = myMax(anim_data.keyframe_times.size(), anim_datum_a.m_keyframe_times.size(), anim_datum_b.m_keyframe_times.size());
+					key_frame_locs.resizeNoCopy(keyframe_times_size * 2); // keyframe times for animation a are first, then keyframe times for animation b.
 
-						const float in_anim_time = use_in_anim_time_a;
-						AnimationKeyFrameLocation& key_frame_loc = key_frame_locs[input_accessor_i];
+					//------------------------ Compute keyframe times for animation a -------------------------
+					if(transition_frac < 1.f) // At transition_frac = 1, result is fully animation b, a is used if transition_frac < 1
+					{
+						const js::Vector<KeyFrameTimeInfo>& keyframe_times_a = (!anim_datum_a.m_keyframe_times.empty()) ? anim_datum_a.m_keyframe_times : anim_data.keyframe_times;
 
-						// If keyframe times are equally spaced, we can skip the binary search stuff, and just compute the keyframes we are between directly.
-						if(keyframe_time_info.equally_spaced && (keyframe_time_info.t_back == anim_datum_a.anim_len))
+						for(size_t q=0; q<anim_datum_a.used_input_accessor_indices.size(); ++q)
 						{
-							if(use_in_anim_time_a < keyframe_time_info.t_0)
-							{
-								key_frame_loc.i_0 = 0;
-								key_frame_loc.i_1 = 0;
-								key_frame_loc.frac = 0;
-							}
-							else
-							{
-								const float t_minus_t_0 = use_in_anim_time_a - keyframe_time_info.t_0;
-								assert(t_minus_t_0 >= 0);
-
-								int index = (int)(t_minus_t_0 * keyframe_time_info.recip_spacing);
-
-								const float frac = (t_minus_t_0 - (float)index * keyframe_time_info.spacing) * keyframe_time_info.recip_spacing; // Fraction of way through frame
-								assert(frac >= -0.001f && frac < 1.001f);
+							const int input_accessor_i = anim_datum_a.used_input_accessor_indices[q];
 
-								if(index >= keyframe_time_info.times_size)
-									index = 0;
+							const KeyFrameTimeInfo& keyframe_time_info = keyframe_times_a[input_accessor_i];
+							assert(keyframe_time_info.times_size == (int)keyframe_time_info.times.size());
 
-								int next_index = index + 1;
-								if(next_index >= keyframe_time_info.times_size)
-									next_index = 0;
-
-								key_frame_loc.i_0 = index;
-								key_frame_loc.i_1 = next_index;
-								key_frame_loc.frac = frac;
-							}
-						}
-						else
-						{
-							const std::vector<float>& time_vals = keyframe_time_info.times;
+							const float in_anim_time = use_in_anim_time_a;
+							AnimationKeyFrameLocation& key_frame_loc = key_frame_locs[input_accessor_i];
 
-							if(keyframe_time_info.times_size != 0)
+							// If keyframe times are equally spaced, we can skip the binary search stuff, and just compute the keyframes we are between directly.
+							if(keyframe_time_info.equally_spaced && (keyframe_time_info.t_back == anim_datum_a.anim_len))
 							{
-								if(keyframe_time_info.times_size == 1)
+								if(use_in_anim_time_a < keyframe_time_info.t_0)
 								{
 									key_frame_loc.i_0 = 0;
 									key_frame_loc.i_1 = 0;
@@ -6335,29 +6354,33 @@ public:
 								}
 								else
 								{
-									assert(time_vals.size() >= 2);
+									const float t_minus_t_0 = use_in_anim_time_a - keyframe_time_info.t_0;
+									assert(t_minus_t_0 >= 0);
 
-									// TODO: use incremental search based on the position last frame, instead of using upper_bound.  (or combine)
+									int index = (int)(t_minus_t_0 * keyframe_time_info.recip_spacing);
 
-									/*
-									frame 0                     frame 1                        frame 2                      frame 3
-									|----------------------------|-----------------------------|-----------------------------|-------------------------> time
-									^                            ^            ^                ^
-									cur_frame_i                             in_anim_time
-									index                        next_index
-									*/
+									const float frac = (t_minus_t_0 - (float)index * keyframe_time_info.spacing) * keyframe_time_info.recip_spacing; // Fraction of way through frame
+									assert(frac >= -0.001f && frac < 1.001f);
 
-									// Find current frame
-									auto res = std::upper_bound(time_vals.begin(), time_vals.end(), in_anim_time); // "Finds the position of the first element in an ordered range that has a value that is greater than a specified value"
-									int next_index = (int)(res - time_vals.begin());
-									assert(next_index >= 0 && next_index <= (int)time_vals.size());
-									int index = next_index - 1;
-									assert(index >= -1 && index < (int)time_vals.size());
+									if(index >= keyframe_time_info.times_size)
+										index = 0;
 
-									next_index = myMin(next_index, keyframe_time_info.times_size - 1);
-									assert(next_index >= 0 && next_index < (int)time_vals.size());
+									int next_index = index + 1;
+									if(next_index >= keyframe_time_info.times_size)
+										next_index = 0;
 
-									if(index < 0) // This is the case when use_in_anim_time_a < t_0.  In this case we want to clamp the output values to the keyframe 0 values.
+									key_frame_loc.i_0 = index;
+									key_frame_loc.i_1 = next_index;
+									key_frame_loc.frac = frac;
+								}
+							}
+							else
+							{
+								const std::vector<float>& time_vals = keyframe_time_info.times;
+
+								if(keyframe_time_info.times_size != 0)
+								{
+									if(keyframe_time_info.times_size == 1)
 									{
 										key_frame_loc.i_0 = 0;
 										key_frame_loc.i_1 = 0;
@@ -6365,77 +6388,73 @@ public:
 									}
 									else
 									{
-										const float index_time = time_vals[index];
-
-										float frac;
-										frac = (in_anim_time - index_time) / (time_vals[next_index] - index_time);
-
-										if(!(frac >= 0 && frac <= 1)) // TEMP: handle NaNs
-											frac = 0;
-
-										key_frame_loc.i_0 = index;
-										key_frame_loc.i_1 = next_index;
-										key_frame_loc.frac = frac;
+										assert(time_vals.size() >= 2);
+
+										// TODO: use incremental search based on the position last frame, instead of using upper_bound.  (or combine)
+
+										/*
+										frame 0                     frame 1                        frame 2                      frame 3
+										|----------------------------|-----------------------------|-----------------------------|-------------------------> time
+										^                            ^            ^                ^
+										cur_frame_i                             in_anim_time
+										index                        next_index
+										*/
+
+										// Find current frame
+										auto res = std::upper_bound(time_vals.begin(), time_vals.end(), in_anim_time); // "Finds the position of the first element in an ordered range that has a value that is greater than a specified value"
+										int next_index = (int)(res - time_vals.begin());
+										assert(next_index >= 0 && next_index <= (int)time_vals.size());
+										int index = next_index - 1;
+										assert(index >= -1 && index < (int)time_vals.size());
+
+										next_index = myMin(next_index, keyframe_time_info.times_size - 1);
+										assert(next_index >= 0 && next_index < (int)time_vals.size());
+
+										if(index < 0) // This is the case when use_in_anim_time_a < t_0.  In this case we want to clamp the output values to the keyframe 0 values.
+										{
+											key_frame_loc.i_0 = 0;
+											key_frame_loc.i_1 = 0;
+											key_frame_loc.frac = 0;
+										}
+										else
+										{
+											const float index_time = time_vals[index];
+
+											float frac;
+											frac = (in_anim_time - index_time) / (time_vals[next_index] - index_time);
+
+											if(!(frac >= 0 && frac <= 1)) // TEMP: handle NaNs
+												frac = 0;
+
+											key_frame_loc.i_0 = index;
+											key_frame_loc.i_1 = next_index;
+											key_frame_loc.frac = frac;
+										}
 									}
 								}
 							}
 						}
 					}
-				}
-
-				//------------------------ Compute keyframe times for animation b -------------------------
-				if(transition_frac > 0.f) // At transition_frac = 0, result is fully animation a, b is used if transition_frac > 0
-				{
-					const js::Vector<KeyFrameTimeInfo>& keyframe_times_b = (!anim_datum_b.m_keyframe_times.empty()) ? anim_datum_b.m_keyframe_times : anim_data.keyframe_times;
 
-					for(size_t q=0; q<anim_datum_b.used_input_accessor_indices.size(); ++q)
+					//------------------------ Compute keyframe times for animation b -------------------------
+					if(transition_frac > 0.f) // At transition_frac = 0, result is fully animation a, b is used if transition_frac > 0
 					{
-						const int input_accessor_i = anim_datum_b.used_input_accessor_indices[q];
-
-						const KeyFrameTimeInfo& keyframe_time_info = keyframe_times_b[input_accessor_i];
-						assert(keyframe_time_info.times_size == (int)keyframe_time_info.times.size());
-
-						const float in_anim_time = use_in_anim_time_b;
-						AnimationKeyFrameLocation& key_frame_loc = key_frame_locs[keyframe_times_size + input_accessor_i]; // The keyframe_times_size offset is to get keyframe locations for animation b.
+						const js::Vector<KeyFrameTimeInfo>& keyframe_times_b = (!anim_datum_b.m_keyframe_times.empty()) ? anim_datum_b.m_keyframe_times : anim_data.keyframe_times;
 
-						// If keyframe times are equally spaced, we can skip the binary search stuff, and just compute the keyframes we are between directly.
-						if(keyframe_time_info.equally_spaced && (keyframe_time_info.t_back == anim_datum_b.anim_len))
+						for(size_t q=0; q<anim_datum_b.used_input_accessor_indices.size(); ++q)
 						{
-							if(in_anim_time < keyframe_time_info.t_0)
-							{
-								key_frame_loc.i_0 = 0;
-								key_frame_loc.i_1 = 0;
-								key_frame_loc.frac = 0;
-							}
-							else
-							{
-								const float t_minus_t_0 = in_anim_time - keyframe_time_info.t_0;
-								assert(t_minus_t_0 >= 0);
-
-								int index = (int)(t_minus_t_0 * keyframe_time_info.recip_spacing);
+							const int input_accessor_i = anim_datum_b.used_input_accessor_indices[q];
 
-								const float frac = (t_minus_t_0 - (float)index * keyframe_time_info.spacing) * keyframe_time_info.recip_spacing; // Fraction of way through frame
-								assert(frac >= -0.001f && frac < 1.001f);
+							const KeyFrameTimeInfo& keyframe_time_info = keyframe_times_b[input_accessor_i];
+							assert(keyframe_time_info.times_size == (int)keyframe_time_info.times.size());
 
-								if(index >= keyframe_time_info.times_size)
-									index = 0;
+							const float in_anim_time = use_in_anim_time_b;
+							AnimationKeyFrameLocation& key_frame_loc = key_frame_locs[keyframe_times_size + input_accessor_i]; // The keyframe_times_size offset is to get keyframe locations for animation b.
 
-								int next_index = index + 1;
-								if(next_index >= keyframe_time_info.times_size)
-									next_index = 0;
-
-								key_frame_loc.i_0 = index;
-								key_frame_loc.i_1 = next_index;
-								key_frame_loc.frac = frac;
-							}
-						}
-						else
-						{
-							const std::vector<float>& time_vals = keyframe_time_info.times;
-
-							if(keyframe_time_info.times_size != 0)
+							// If keyframe times are equally spaced, we can skip the binary search stuff, and just compute the keyframes we are between directly.
+							if(keyframe_time_info.equally_spaced && (keyframe_time_info.t_back == anim_datum_b.anim_len))
 							{
-								if(keyframe_time_info.times_size == 1)
+								if(in_anim_time < keyframe_time_info.t_0)
 								{
 									key_frame_loc.i_0 = 0;
 									key_frame_loc.i_1 = 0;
@@ -6443,19 +6462,33 @@ public:
 								}
 								else
 								{
-									assert(time_vals.size() >= 2);
+									const float t_minus_t_0 = in_anim_time - keyframe_time_info.t_0;
+									assert(t_minus_t_0 >= 0);
+
+									int index = (int)(t_minus_t_0 * keyframe_time_info.recip_spacing);
+
+									const float frac = (t_minus_t_0 - (float)index * keyframe_time_info.spacing) * keyframe_time_info.recip_spacing; // Fraction of way through frame
+									assert(frac >= -0.001f && frac < 1.001f);
 
-									// Find current frame
-									auto res = std::upper_bound(time_vals.begin(), time_vals.end(), in_anim_time); // "Finds the position of the first element in an ordered range that has a value that is greater than a specified value"
-									int next_index = (int)(res - time_vals.begin());
-									assert(next_index >= 0 && next_index <= (int)time_vals.size());
-									int index = next_index - 1;
-									assert(index >= -1 && index < (int)time_vals.size());
+									if(index >= keyframe_time_info.times_size)
+										index = 0;
 
-									next_index = myMin(next_index, keyframe_time_info.times_size - 1);
-									assert(next_index >= 0 && next_index < (int)time_vals.size());
+									int next_index = index + 1;
+									if(next_index >= keyframe_time_info.times_size)
+										next_index = 0;
+
+									key_frame_loc.i_0 = index;
+									key_frame_loc.i_1 = next_index;
+									key_frame_loc.frac = frac;
+								}
+							}
+							else
+							{
+								const std::vector<float>& time_vals = keyframe_time_info.times;
 
-									if(index < 0) // This is the case when use_in_anim_time_b < t_0.  In this case we want to clamp the output values to the keyframe 0 values.
+								if(keyframe_time_info.times_size != 0)
+								{
+									if(keyframe_time_info.times_size == 1)
 									{
 										key_frame_loc.i_0 = 0;
 										key_frame_loc.i_1 = 0;
@@ -6463,201 +6496,222 @@ public:
 									}
 									else
 									{
-										const float index_time = time_vals[index];
-
-										float frac;
-										frac = (in_anim_time - index_time) / (time_vals[next_index] - index_time);
-
-										if(!(frac >= 0 && frac <= 1)) // TEMP: handle NaNs
-											frac = 0;
-
-										key_frame_loc.i_0 = index;
-										key_frame_loc.i_1 = next_index;
-										key_frame_loc.frac = frac;
+										assert(time_vals.size() >= 2);
+
+										// Find current frame
+										auto res = std::upper_bound(time_vals.begin(), time_vals.end(), in_anim_time); // "Finds the position of the first element in an ordered range that has a value that is greater than a specified value"
+										int next_index = (int)(res - time_vals.begin());
+										assert(next_index >= 0 && next_index <= (int)time_vals.size());
+										int index = next_index - 1;
+										assert(index >= -1 && index < (int)time_vals.size());
+
+										next_index = myMin(next_index, keyframe_time_info.times_size - 1);
+										assert(next_index >= 0 && next_index < (int)time_vals.size());
+
+										if(index < 0) // This is the case when use_in_anim_time_b < t_0.  In this case we want to clamp the output values to the keyframe 0 values.
+										{
+											key_frame_loc.i_0 = 0;
+											key_frame_loc.i_1 = 0;
+											key_frame_loc.frac = 0;
+										}
+										else
+										{
+											const float index_time = time_vals[index];
+
+											float frac;
+											frac = (in_anim_time - index_time) / (time_vals[next_index] - index_time);
+
+											if(!(frac >= 0 && frac <= 1)) // TEMP: handle NaNs
+												frac = 0;
+
+											key_frame_loc.i_0 = index;
+											key_frame_loc.i_1 = next_index;
+											key_frame_loc.frac = frac;
+										}
 									}
 								}
 							}
 						}
 					}
-				}
-
-				node_matrices.resizeNoCopy(anim_data.sorted_nodes.size()); // A temp buffer to store node transforms that we can look up parent node transforms in.
 
-				const js::Vector<js::Vector<Vec4f, 16> >& output_data_a = (!anim_datum_a.m_output_data.empty()) ? anim_datum_a.m_output_data : anim_data.output_data;
-				const js::Vector<js::Vector<Vec4f, 16> >& output_data_b = (!anim_datum_b.m_output_data.empty()) ? anim_datum_b.m_output_data : anim_data.output_data;
+					node_matrices.resizeNoCopy(anim_data.sorted_nodes.size()); // A temp buffer to store node transforms that we can look up parent node transforms in.
 
-				for(size_t n=0; n<anim_data.sorted_nodes.size(); ++n)
-				{
-					const int node_i = anim_data.sorted_nodes[n];
-					const AnimationNodeData& node_data = anim_data.nodes[node_i];
-					const PerAnimationNodeData& node_a = anim_a_node_data[node_i];
-					const PerAnimationNodeData& node_b = anim_b_node_data[node_i];
-
-					Vec4f trans_a = node_data.trans;
-					Vec4f trans_b = node_data.trans;
-					Quatf rot_a   = node_data.rot;
-					Quatf rot_b   = node_data.rot;
-					Vec4f scale_a = node_data.scale;
-					Vec4f scale_b = node_data.scale;
+					const js::Vector<js::Vector<Vec4f, 16> >& output_data_a = (!anim_datum_a.m_output_data.empty()) ? anim_datum_a.m_output_data : anim_data.output_data;
+					const js::Vector<js::Vector<Vec4f, 16> >& output_data_b = (!anim_datum_b.m_output_data.empty()) ? anim_datum_b.m_output_data : anim_data.output_data;
 
-					if(transition_frac < 1.f) // At transition_frac = 1, result is fully animation b, a is used if transition_frac < 1
+					for(size_t n=0; n<anim_data.sorted_nodes.size(); ++n)
 					{
-						if(node_a.translation_input_accessor >= 0)
-						{
-							//conPrint("anim_datum_a: " + anim_datum_a.name + "," + toString(anim_data.keyframe_times[node_a.translation_input_accessor].back()));
-
-							const int i_0    = key_frame_locs[node_a.translation_input_accessor].i_0;
-							const int i_1    = key_frame_locs[node_a.translation_input_accessor].i_1;
-							const float frac = key_frame_locs[node_a.translation_input_accessor].frac;
+						const int node_i = anim_data.sorted_nodes[n];
+						const AnimationNodeData& node_data = anim_data.nodes[node_i];
+						const PerAnimationNodeData& node_a = anim_a_node_data[node_i];
+						const PerAnimationNodeData& node_b = anim_b_node_data[node_i];
 
-							// read translation values from output accessor.
-							const Vec4f trans_0 = (output_data_a[node_a.translation_output_accessor])[i_0];
-							const Vec4f trans_1 = (output_data_a[node_a.translation_output_accessor])[i_1];
-							trans_a = Maths::lerp(trans_0, trans_1, frac); // TODO: handle step interpolation, cubic lerp etc..
-						}
+						Vec4f trans_a = node_data.trans;
+						Vec4f trans_b = node_data.trans;
+						Quatf rot_a   = node_data.rot;
+						Quatf rot_b   = node_data.rot;
+						Vec4f scale_a = node_data.scale;
+						Vec4f scale_b = node_data.scale;
 
-						if(node_a.rotation_input_accessor >= 0)
+						if(transition_frac < 1.f) // At transition_frac = 1, result is fully animation b, a is used if transition_frac < 1
 						{
-							const int i_0    = key_frame_locs[node_a.rotation_input_accessor].i_0;
-							const int i_1    = key_frame_locs[node_a.rotation_input_accessor].i_1;
-							const float frac = key_frame_locs[node_a.rotation_input_accessor].frac;
-
-							// read rotation values from output accessor
-							const Quatf rot_0 = Quatf((output_data_a[node_a.rotation_output_accessor])[i_0]);
-							const Quatf rot_1 = Quatf((output_data_a[node_a.rotation_output_accessor])[i_1]);
-							rot_a = Quatf::nlerp(rot_0, rot_1, frac);
-						}
+							if(node_a.translation_input_accessor >= 0)
+							{
+								//conPrint("anim_datum_a: " + anim_datum_a.name + "," + toString(anim_data.keyframe_times[node_a.translation_input_accessor].back()));
 
-						if(node_a.scale_input_accessor >= 0)
-						{
-							const int i_0    = key_frame_locs[node_a.scale_input_accessor].i_0;
-							const int i_1    = key_frame_locs[node_a.scale_input_accessor].i_1;
-							const float frac = key_frame_locs[node_a.scale_input_accessor].frac;
-
-							// read scale values from output accessor
-							const Vec4f scale_0 = (output_data_a[node_a.scale_output_accessor])[i_0];
-							const Vec4f scale_1 = (output_data_a[node_a.scale_output_accessor])[i_1];
-							scale_a = Maths::lerp(scale_0, scale_1, frac);
-						}
-					}
+								const int i_0    = key_frame_locs[node_a.translation_input_accessor].i_0;
+								const int i_1    = key_frame_locs[node_a.translation_input_accessor].i_1;
+								const float frac = key_frame_locs[node_a.translation_input_accessor].frac;
 
-					if(transition_frac > 0.f) // At transition_frac = 0, result is fully animation a, b is used if transition_frac > 0
-					{
-						if(node_b.translation_input_accessor >= 0)
-						{
-							const int i_0    = key_frame_locs[keyframe_times_size + node_b.translation_input_accessor].i_0; // The keyframe_times_size offset is to get keyframe locations for animation b.
-							const int i_1    = key_frame_locs[keyframe_times_size + node_b.translation_input_accessor].i_1;
-							const float frac = key_frame_locs[keyframe_times_size + node_b.translation_input_accessor].frac;
-
-							// read translation values from output accessor.
-							const Vec4f trans_0 = (output_data_b[node_b.translation_output_accessor])[i_0];
-							const Vec4f trans_1 = (output_data_b[node_b.translation_output_accessor])[i_1];
-							trans_b = Maths::lerp(trans_0, trans_1, frac); // TODO: handle step interpolation, cubic lerp etc..
-						}
+								// read translation values from output accessor.
+								const Vec4f trans_0 = (output_data_a[node_a.translation_output_accessor])[i_0];
+								const Vec4f trans_1 = (output_data_a[node_a.translation_output_accessor])[i_1];
+								trans_a = Maths::lerp(trans_0, trans_1, frac); // TODO: handle step interpolation, cubic lerp etc..
+							}
 
-						if(node_b.rotation_input_accessor >= 0)
-						{
-							const int i_0    = key_frame_locs[keyframe_times_size + node_b.rotation_input_accessor].i_0;
-							const int i_1    = key_frame_locs[keyframe_times_size + node_b.rotation_input_accessor].i_1;
-							const float frac = key_frame_locs[keyframe_times_size + node_b.rotation_input_accessor].frac;
-
-							// read rotation values from output accessor
-							const Quatf rot_0 = Quatf((output_data_b[node_b.rotation_output_accessor])[i_0]);
-							const Quatf rot_1 = Quatf((output_data_b[node_b.rotation_output_accessor])[i_1]);
-							rot_b = Quatf::nlerp(rot_0, rot_1, frac);
-						}
+							if(node_a.rotation_input_accessor >= 0)
+							{
+								const int i_0    = key_frame_locs[node_a.rotation_input_accessor].i_0;
+								const int i_1    = key_frame_locs[node_a.rotation_input_accessor].i_1;
+								const float frac = key_frame_locs[node_a.rotation_input_accessor].frac;
+
+								// read rotation values from output accessor
+								const Quatf rot_0 = Quatf((output_data_a[node_a.rotation_output_accessor])[i_0]);
+								const Quatf rot_1 = Quatf((output_data_a[node_a.rotation_output_accessor])[i_1]);
+								rot_a = Quatf::nlerp(rot_0, rot_1, frac);
+							}
 
-						if(node_b.scale_input_accessor >= 0)
-						{
-							const int i_0    = key_frame_locs[keyframe_times_size + node_b.scale_input_accessor].i_0;
-							const int i_1    = key_frame_locs[keyframe_times_size + node_b.scale_input_accessor].i_1;
-							const float frac = key_frame_locs[keyframe_times_size + node_b.scale_input_accessor].frac;
-
-							// read scale values from output accessor
-							const Vec4f scale_0 = (output_data_b[node_b.scale_output_accessor])[i_0];
-							const Vec4f scale_1 = (output_data_b[node_b.scale_output_accessor])[i_1];
-							scale_b = Maths::lerp(scale_0, scale_1, frac);
+							if(node_a.scale_input_accessor >= 0)
+							{
+								const int i_0    = key_frame_locs[node_a.scale_input_accessor].i_0;
+								const int i_1    = key_frame_locs[node_a.scale_input_accessor].i_1;
+								const float frac = key_frame_locs[node_a.scale_input_accessor].frac;
+
+								// read scale values from output accessor
+								const Vec4f scale_0 = (output_data_a[node_a.scale_output_accessor])[i_0];
+								const Vec4f scale_1 = (output_data_a[node_a.scale_output_accessor])[i_1];
+								scale_a = Maths::lerp(scale_0, scale_1, frac);
+							}
 						}
-					}
-
-					GLObjectAnimNodeData& ob_anim_node_data_i = ob->anim_node_data[node_i];
 
-					const Vec4f trans = Maths::lerp(trans_a, trans_b, transition_frac);
-					const Quatf anim_rot = Quatf::nlerp(rot_a, rot_b, transition_frac);
-					const Quatf rot = select(ob_anim_node_data_i.procedural_rot, anim_rot, bitcastToVec4f(Vec4i(ob_anim_node_data_i.procedural_rot_mask)));
-					const Vec4f scale = Maths::lerp(scale_a, scale_b, transition_frac);
-
-					const Matrix4f rot_mat = rot.toMatrix();
-
-					const Matrix4f TRS(
-						rot_mat.getColumn(0) * copyToAll<0>(scale),
-						rot_mat.getColumn(1) * copyToAll<1>(scale),
-						rot_mat.getColumn(2) * copyToAll<2>(scale),
-						setWToOne(trans));
+						if(transition_frac > 0.f) // At transition_frac = 0, result is fully animation a, b is used if transition_frac > 0
+						{
+							if(node_b.translation_input_accessor >= 0)
+							{
+								const int i_0    = key_frame_locs[keyframe_times_size + node_b.translation_input_accessor].i_0; // The keyframe_times_size offset is to get keyframe locations for animation b.
+								const int i_1    = key_frame_locs[keyframe_times_size + node_b.translation_input_accessor].i_1;
+								const float frac = key_frame_locs[keyframe_times_size + node_b.translation_input_accessor].frac;
+
+								// read translation values from output accessor.
+								const Vec4f trans_0 = (output_data_b[node_b.translation_output_accessor])[i_0];
+								const Vec4f trans_1 = (output_data_b[node_b.translation_output_accessor])[i_1];
+								trans_b = Maths::lerp(trans_0, trans_1, frac); // TODO: handle step interpolation, cubic lerp etc..
+							}
 
-					const Matrix4f last_pre_proc_to_object = (node_data.parent_index == -1) ? TRS : (node_matrices[node_data.parent_index] * node_data.retarget_adjustment * TRS); // Transform without procedural_transform applied
-					const Matrix4f node_transform = last_pre_proc_to_object * ob->anim_node_data[node_i].procedural_transform;
+							if(node_b.rotation_input_accessor >= 0)
+							{
+								const int i_0    = key_frame_locs[keyframe_times_size + node_b.rotation_input_accessor].i_0;
+								const int i_1    = key_frame_locs[keyframe_times_size + node_b.rotation_input_accessor].i_1;
+								const float frac = key_frame_locs[keyframe_times_size + node_b.rotation_input_accessor].frac;
+
+								// read rotation values from output accessor
+								const Quatf rot_0 = Quatf((output_data_b[node_b.rotation_output_accessor])[i_0]);
+								const Quatf rot_1 = Quatf((output_data_b[node_b.rotation_output_accessor])[i_1]);
+								rot_b = Quatf::nlerp(rot_0, rot_1, frac);
+							}
 
-					node_matrices[node_i] = node_transform;
+							if(node_b.scale_input_accessor >= 0)
+							{
+								const int i_0    = key_frame_locs[keyframe_times_size + node_b.scale_input_accessor].i_0;
+								const int i_1    = key_frame_locs[keyframe_times_size + node_b.scale_input_accessor].i_1;
+								const float frac = key_frame_locs[keyframe_times_size + node_b.scale_input_accessor].frac;
+
+								// read scale values from output accessor
+								const Vec4f scale_0 = (output_data_b[node_b.scale_output_accessor])[i_0];
+								const Vec4f scale_1 = (output_data_b[node_b.scale_output_accessor])[i_1];
+								scale_b = Maths::lerp(scale_0, scale_1, frac);
+							}
+						}
 
-					ob_anim_node_data_i.last_pre_proc_to_object = last_pre_proc_to_object;
-					ob_anim_node_data_i.last_rot = rot;
-					ob_anim_node_data_i.node_hierarchical_to_object = node_transform;
-				}
-			}
-			else // else if anim_data.animations.empty():
-			{
-				if(!anim_data.joint_nodes.empty()) // If we have a skin, but no animations, just use the default trans, rot, scales.
-				{
-					const size_t num_nodes = anim_data.nodes.size();
-					node_matrices.resizeNoCopy(num_nodes);
-					ob->anim_node_data.resize(num_nodes);
+						GLObjectAnimNodeData& ob_anim_node_data_i = ob->anim_node_data[node_i];
 
-					for(size_t n=0; n<anim_data.sorted_nodes.size(); ++n)
-					{
-						const int node_i = anim_data.sorted_nodes[n];
-						const AnimationNodeData& node_data = anim_data.nodes[node_i];
-						const Vec4f trans = node_data.trans;
-						const Quatf rot = node_data.rot;
-						const Vec4f scale = node_data.scale;
+						const Vec4f trans = Maths::lerp(trans_a, trans_b, transition_frac);
+						const Quatf anim_rot = Quatf::nlerp(rot_a, rot_b, transition_frac);
+						const Quatf rot = select(ob_anim_node_data_i.procedural_rot, anim_rot, bitcastToVec4f(Vec4i(ob_anim_node_data_i.procedural_rot_mask)));
+						const Vec4f scale = Maths::lerp(scale_a, scale_b, transition_frac);
 
 						const Matrix4f rot_mat = rot.toMatrix();
+
 						const Matrix4f TRS(
 							rot_mat.getColumn(0) * copyToAll<0>(scale),
 							rot_mat.getColumn(1) * copyToAll<1>(scale),
 							rot_mat.getColumn(2) * copyToAll<2>(scale),
 							setWToOne(trans));
 
-						const Matrix4f last_pre_proc_to_object = (node_data.parent_index == -1) ? TRS : (node_matrices[node_data.parent_index] * TRS);
+						const Matrix4f last_pre_proc_to_object = (node_data.parent_index == -1) ? TRS : (node_matrices[node_data.parent_index] * node_data.retarget_adjustment * TRS); // Transform without procedural_transform applied
 						const Matrix4f node_transform = last_pre_proc_to_object * ob->anim_node_data[node_i].procedural_transform;
 
 						node_matrices[node_i] = node_transform;
 
-						ob->anim_node_data[node_i].node_hierarchical_to_object = node_transform;
+						ob_anim_node_data_i.last_pre_proc_to_object = last_pre_proc_to_object;
+						ob_anim_node_data_i.last_rot = rot;
+						ob_anim_node_data_i.node_hierarchical_to_object = node_transform;
 					}
 				}
-			}
+				else // else if anim_data.animations.empty():
+				{
+					if(!anim_data.joint_nodes.empty()) // If we have a skin, but no animations, just use the default trans, rot, scales.
+					{
+						const size_t num_nodes = anim_data.nodes.size();
+						node_matrices.resizeNoCopy(num_nodes);
+						ob->anim_node_data.resize(num_nodes);
 
-			const size_t joint_nodes_size = anim_data.joint_nodes.size();
-			if(!anim_data.animations.empty() || (joint_nodes_size > 0))
-			{
-				ob->joint_matrices.resizeNoCopy(joint_nodes_size);
+						for(size_t n=0; n<anim_data.sorted_nodes.size(); ++n)
+						{
+							const int node_i = anim_data.sorted_nodes[n];
+							const AnimationNodeData& node_data = anim_data.nodes[node_i];
+							const Vec4f trans = node_data.trans;
+							const Quatf rot = node_data.rot;
+							const Vec4f scale = node_data.scale;
+
+							const Matrix4f rot_mat = rot.toMatrix();
+							const Matrix4f TRS(
+								rot_mat.getColumn(0) * copyToAll<0>(scale),
+								rot_mat.getColumn(1) * copyToAll<1>(scale),
+								rot_mat.getColumn(2) * copyToAll<2>(scale),
+								setWToOne(trans));
+
+							const Matrix4f last_pre_proc_to_object = (node_data.parent_index == -1) ? TRS : (node_matrices[node_data.parent_index] * TRS);
+							const Matrix4f node_transform = last_pre_proc_to_object * ob->anim_node_data[node_i].procedural_transform;
+
+							node_matrices[node_i] = node_transform;
+
+							ob->anim_node_data[node_i].node_hierarchical_to_object = node_transform;
+						}
+					}
+				}
 
-				for(size_t i=0; i<joint_nodes_size; ++i)
+				const size_t joint_nodes_size = anim_data.joint_nodes.size();
+				if(!anim_data.animations.empty() || (joint_nodes_size > 0))
 				{
-					const int node_i = anim_data.joint_nodes[i];
+					ob->joint_matrices.resizeNoCopy(joint_nodes_size);
+
+					for(size_t i=0; i<joint_nodes_size; ++i)
+					{
+						const int node_i = anim_data.joint_nodes[i];
 
-					ob->joint_matrices[i] = node_matrices[node_i] * anim_data.nodes[node_i].inverse_bind_matrix;
+						ob->joint_matrices[i] = node_matrices[node_i] * anim_data.nodes[node_i].inverse_bind_matrix;
 
-					//conPrint("joint_matrices[" + toString(i) + "]: (joint node: " + toString(node_i) + ", '" + anim_data.nodes[node_i].name + "')");
-					//conPrint(ob->joint_matrices[i].toString());
+						//conPrint("joint_matrices[" + toString(i) + "]: (joint node: " + toString(node_i) + ", '" + anim_data.nodes[node_i].name + "')");
+						//conPrint(ob->joint_matrices[i].toString());
+					}
 				}
 			}
 		}
 	}
 
 	float current_time;
-	glare::AtomicInt* next_ob_i;
+	glare::ParallelForRange* range; // Range of indices into animated_obs_to_process, shared between tasks.
 	js::Vector<GLObject*, 16>* animated_obs_to_process;
 
 	// Some temporary vectors:
@@ -7111,14 +7165,14 @@ void OpenGLEngine::draw()
 
 			animated_objects_task_group->tasks.resize(num_animated_ob_tasks);
 
-			glare::AtomicInt next_ob_i(0);
+			glare::ParallelForRange range(/*begin=*/0, /*end=*/animated_obs_to_process.size(), /*grain_size=*/1, num_animated_ob_tasks);
 
 			for(size_t t=0; t<num_animated_ob_tasks; ++t)
 			{
 				ComputeAnimatedObJointMatricesTask* task = animated_objects_tasks[t].downcastToPtr<ComputeAnimatedObJointMatricesTask>();
 				//task->processed = 0;
 				task->current_time = this->current_time;
-				task->next_ob_i = &next_ob_i;
+				task->range = &range;
 				task->animated_obs_to_process = &animated_obs_to_process;
 
 				animated_objects_task_group->tasks[t] = task;
@@ -12156,6 +12210,14 @@ Reference<OpenGLTexture> OpenGLEngine::getOrLoadOpenGLTextureForMap2D(const Open
 		return res->second.value;
 	}
 
+	Reference<TextureData> texture_data = buildTextureDataForMap2D(map2d, params);
+
+	return loadOpenGLTextureForTextureData(key, texture_data, params);
+}
+
+
+Reference<TextureData> OpenGLEngine::buildTextureDataForMap2D(const Map2D& map2d, const TextureParams& params)
+{
 	if(params.allow_compression)
 	{
 		assert(params.use_mipmaps);
@@ -12167,17 +12229,21 @@ Reference<OpenGLTexture> OpenGLEngine::getOrLoadOpenGLTextureForMap2D(const Open
 	}
 
 	// Build or get texture data
-	Reference<TextureData> texture_data;
 	if(const CompressedImage* compressed_img = dynamic_cast<const CompressedImage*>(&map2d))
 	{
-		texture_data = compressed_img->texture_data; // If the image map just holds already compressed data, use it.
+		return compressed_img->texture_data; // If the image map just holds already compressed data, use it.
 	}
 	else
 	{
 		const bool use_compression = params.allow_compression && this->DXTTextureCompressionSupportedAndEnabled() && params.use_mipmaps && OpenGLTexture::areTextureDimensionsValidForCompression(map2d); // The non mip-mapping code-path doesn't allow compression
-		texture_data = TextureProcessing::buildTextureData(&map2d, this->mem_allocator.ptr(), this->main_task_manager, use_compression, params.use_mipmaps, params.convert_float_to_half);
+		return TextureProcessing::buildTextureData(&map2d, this->mem_allocator.ptr(), this->main_task_manager, use_compression, params.use_mipmaps, params.convert_float_to_half);
 	}
+}
 
+
+// Loads texture_data into a new OpenGL texture immediately, and adds it to opengl_textures.
+Reference<OpenGLTexture> OpenGLEngine::loadOpenGLTextureForTextureData(const OpenGLTextureKey& key, const Reference<TextureData>& texture_data, const TextureParams& params)
+{
 	OpenGLTextureLoadingProgress loading_progress;
 	TextureLoading::initialiseTextureLoadingProgress(this, key, params, texture_data, loading_progress);
 
@@ -12913,6 +12979,8 @@ std::string OpenGLEngine::getDiagnostics() const
 	s += "Textures: " + toString(opengl_textures.numUsedItems()) + " / " + toString(opengl_textures.numUnusedItems()) + " / " + toString(opengl_textures.size()) + " (active / cached / total)\n";
 	s += "Textures CPU mem: " + getMBSizeString(tex_usage_CPU_active) + " / " + getMBSizeString(mem_usage.sum_unused_tex_cpu_usage) + " / " + getMBSizeString(mem_usage.texture_cpu_usage) + " (active / cached / total)\n";
 	s += "Textures GPU mem: " + getMBSizeString(tex_usage_GPU_active) + " / " + getMBSizeString(mem_usage.sum_unused_tex_gpu_usage) + " / " + getMBSizeString(mem_usage.texture_gpu_usage) + " (active / cached / total)\n";
+	if(texture_data_cache.nonNull())
+		s += "Texture data cache: " + toString(texture_data_cache->numEntries()) + " entries, " + getMBSizeString(texture_data_cache->totalSizeB()) + " / " + getMBSizeString(texture_data_cache->maxSizeB()) + "\n";
 
 	
 	if(false)
@@ -12949,6 +13017,7 @@ std::string OpenGLEngine::getDiagnostics() const
 	s += "texture s3tc support: " + boolToString(texture_compression_s3tc_support) + "\n";
 	s += "texture ETC support: " + boolToString(texture_compression_ETC_support) + "\n";
 	s += "texture BC6H support: " + boolToString(texture_compression_BC6H_support) + "\n";
+	s += "texture RGTC support: " + boolToString(texture_compression_RGTC_support) + "\n";
 	s += "GL_KHR_parallel_shader_compile: " + boolToString(parallel_shader_compile_support) + "\n";
 #if EMSCRIPTEN
 	s += "EXT_color_buffer_float_support: " + boolToString(EXT_color_buffer_float_support) + "\n";
@@ -59,6 +59,7 @@ namespace Indigo { class Mesh; }
 namespace glare { class TaskManager; }
 class Map2D;
 class TextureServer;
+class TextureDataCache;
 class UInt8ComponentValueTraits;
 class TerrainSystem;
 class RenderBuffer;
@@ -1143,6 +1144,10 @@ public:
 
 	Reference<TextureServer>& getTextureServer() { return texture_server; } // May be NULL
 
+	// Sets the on-disk cache of processed texture data used by getTexture().  cache may be NULL, which disables caching.
+	void setTextureDataCache(const Reference<TextureDataCache>& cache);
+	Reference<TextureDataCache>& getTextureDataCache() { return texture_data_cache; } // May be NULL
+
 	bool DXTTextureCompressionSupportedAndEnabled() const { return texture_compression_s3tc_support && settings.compress_textures; }
 
 	TextureAllocator& getTextureAllocator() { return texture_allocator; }
@@ -1369,6 +1374,8 @@ public:
 	GLuint allocTextureName();
 
 private:
+	Reference<TextureData> buildTextureDataForMap2D(const Map2D& map2d, const TextureParams& params);
+	Reference<OpenGLTexture> loadOpenGLTextureForTextureData(const OpenGLTextureKey& key, const Reference<TextureData>& texture_data, const TextureParams& params);
 	void trimTextureUsage();
 	void bindMeshData(const OpenGLMeshRenderData& mesh_data);
 	void bindMeshData(const GLObject& ob);
@@ -1550,6 +1557,7 @@ private:
 	float current_time;
 
 	Reference<TextureServer> texture_server;
+	Reference<TextureDataCache> texture_data_cache; // May be NULL
 
 	Reference<FrameBuffer> target_frame_buffer;
 
@@ -1563,7 +1571,8 @@ public:
 
 	bool texture_compression_s3tc_support;
 	bool texture_compression_ETC_support;
-	bool texture_compression_BC6H_support;
+	bool texture_compression_BC6H_support; // Also indicates BC7 support, as they are both from the BPTC extension.
+	bool texture_compression_RGTC_support; // BC4 and BC5
 	bool GL_ARB_bindless_texture_support;
 	bool clip_control_support;
 	bool GL_ARB_shader_storage_buffer_object_support;
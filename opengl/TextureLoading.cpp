@@ -53,6 +53,9 @@ Reference<OpenGLTexture> TextureLoading::createUninitialisedOpenGLTexture(const
 				format = OpenGLTextureFormat::Format_Compressed_ETC2_RGB_Uint8;
 			else if(format == OpenGLTextureFormat::Format_Compressed_ETC2_SRGBA_Uint8)
 				format = OpenGLTextureFormat::Format_Compressed_ETC2_RGBA_Uint8;
+
+			else if(format == OpenGLTextureFormat::Format_Compressed_BC7_SRGBA_Uint8)
+				format = OpenGLTextureFormat::Format_Compressed_BC7_RGBA_Uint8;
 		}
 		else
 		{
@@ -70,6 +73,9 @@ Reference<OpenGLTexture> TextureLoading::createUninitialisedOpenGLTexture(const
 				format = OpenGLTextureFormat::Format_Compressed_ETC2_SRGB_Uint8;
 			else if(format == OpenGLTextureFormat::Format_Compressed_ETC2_RGBA_Uint8)
 				format = OpenGLTextureFormat::Format_Compressed_ETC2_SRGBA_Uint8;
+
+			else if(format == OpenGLTextureFormat::Format_Compressed_BC7_RGBA_Uint8)
+				format = OpenGLTextureFormat::Format_Compressed_BC7_SRGBA_Uint8;
 		}
 
 		/*OpenGLTextureFormat format;
@@ -7,6 +7,11 @@ Copyright Glare Technologies Limited 2020 -
 
 
 #include "BinningBVHBuilder.h"
+#include "MortonBVHBuilder.h"
+#include "BVHPacketTraversal.h"
+#include "BVHCache.h"
+#include "BVHBuilderUtils.h"
+#include "BVHSphereBatchTraversal.h"
 #include "jscol_boundingsphere.h"
 #include "../simpleraytracer/raymesh.h"
 #include "../utils/PrintOutput.h"
@@ -20,7 +25,13 @@ namespace js
 
 
 BVH::BVH(const RayMesh* const raymesh_)
-:	raymesh(raymesh_)
+:	raymesh(raymesh_),
+	root_node_index(0),
+	node_data(NULL),
+	leaf_tri_index_data(NULL),
+	num_nodes(0),
+	num_leaf_tri_indices(0),
+	use_morton_builder(false)
 {
 	assert(raymesh);
 	
@@ -37,29 +48,32 @@ void BVH::build(PrintOutput& print_output, ShouldCancelCallback& should_cancel_c
 {
 	Timer timer;
 
-	const RayMesh::TriangleVectorType& raymesh_tris = raymesh->getTriangles();
-	const int raymesh_tris_size = (int)raymesh_tris.size();
-	const RayMesh::VertexVectorType& raymesh_verts = raymesh->getVertices();
+	const int raymesh_tris_size = (int)raymesh->getTriangles().size();
 
-	Reference<BinningBVHBuilder> builder = new BinningBVHBuilder(
-		1, // leaf_num_object_threshold.
-		31, // max_num_objects_per_leaf
-		64, // max_depth
-		1.f, // intersection_cost
-		raymesh_tris_size
-	);
-
-	for(int i=0; i<raymesh_tris_size; ++i)
+	BVHBuilderRef builder;
+	if(use_morton_builder)
 	{
-		const RayMeshTriangle& tri = raymesh_tris[i];
-		const Vec4f v0 = raymesh_verts[tri.vertex_indices[0]].pos.toVec4fPoint();
-		const Vec4f v1 = raymesh_verts[tri.vertex_indices[1]].pos.toVec4fPoint();
-		const Vec4f v2 = raymesh_verts[tri.vertex_indices[2]].pos.toVec4fPoint();
-		js::AABBox tri_aabb(v0, v0);
-		tri_aabb.enlargeToHoldPoint(v1);
-		tri_aabb.enlargeToHoldPoint(v2);
-
-		builder->setObjectAABB(i, tri_aabb);
+		Reference<MortonBVHBuilder> morton_builder = new MortonBVHBuilder(
+			1, // leaf_num_object_threshold.
+			31, // max_num_objects_per_leaf
+			64, // max_depth
+			1.f, // intersection_cost
+			raymesh_tris_size
+		);
+		BVHBuilderUtils::setTriAABBs(*morton_builder, *raymesh, task_manager);
+		builder = morton_builder;
+	}
+	else
+	{
+		Reference<BinningBVHBuilder> binning_builder = new BinningBVHBuilder(
+			1, // leaf_num_object_threshold.
+			31, // max_num_objects_per_leaf
+			64, // max_depth
+			1.f, // intersection_cost
+			raymesh_tris_size
+		);
+		BVHBuilderUtils::setTriAABBs(*binning_builder, *raymesh, task_manager);
+		builder = binning_builder;
 	}
 	
 	js::Vector<ResultNode, 64> result_nodes;
@@ -73,100 +87,17 @@ void BVH::build(PrintOutput& print_output, ShouldCancelCallback& should_cancel_c
 
 	root_aabb = builder->getRootAABB();
 
-	if(result_nodes.size() == 1)
-	{
-		// Special case where the root node is a leaf.  
-		const int num = result_nodes[0].right - result_nodes[0].left;
-		const int offset = result_nodes[0].left;
-		assert(num < 32);
-		int c = 0x80000000 | num | (offset << 5);
-		this->root_node_index = c;
-	}
-	else
-	{
-		this->root_node_index = 0;
-
-		// Convert result_nodes to BVHNodes.
-		// Indices will change, since we will not explicitly store leaf nodes in the BVH object tree.  Rather leaf geometry references are put into the child references of the node above.
-		const size_t result_nodes_size = result_nodes.size();
-		js::Vector<int, 16> new_node_indices(result_nodes_size); // For each old node, store the new index.
-		int new_index = 0;
-		for(size_t i=0; i<result_nodes_size; ++i)
-			if(result_nodes[i].interior)
-				new_node_indices[i] = new_index++;
-
-		const int new_num_nodes = new_index;
-		this->nodes.resizeNoCopy(new_num_nodes);
-
-		new_index = 0;
-		for(size_t i=0; i<result_nodes_size; ++i)
-		{
-			const ResultNode& result_node = result_nodes[i];
-			if(result_node.interior)
-			{
-				BVHNode& node = this->nodes[new_index++];
-
-				const ResultNode& result_left_child  = result_nodes[result_node.left];
-				const ResultNode& result_right_child = result_nodes[result_node.right];
-
-				Vec4f mins = shuffle<0, 1, 0, 1>(result_left_child.aabb.min_, result_right_child.aabb.min_); // (left_min_x, left_min_y, right_min_x, right_min_y)
-				Vec4f maxs = shuffle<0, 1, 0, 1>(result_left_child.aabb.max_, result_right_child.aabb.max_); // (left_max_x, left_max_y, right_max_x, right_max_y)
-
-				node.x = shuffle<0, 2, 0, 2>(mins, maxs); // (left_min_x, right_min_x, left_max_x, right_max_x)
-				node.y = shuffle<1, 3, 1, 3>(mins, maxs); // (left_min_y, right_min_y, left_max_y, right_max_y)
-
-				mins = shuffle<2, 2, 2, 2>(result_left_child.aabb.min_, result_right_child.aabb.min_); // (left_min_z, left_min_z, right_min_z, right_min_z)
-				maxs = shuffle<2, 2, 2, 2>(result_left_child.aabb.max_, result_right_child.aabb.max_); // (left_max_z, left_max_z, right_max_z, right_max_z)
-
-				node.z = shuffle<0, 2, 0, 2>(mins, maxs); // (left_min_z, right_min_z, left_max_z, right_max_z)
-
-				assert(node.x[0] == result_left_child.aabb.min_[0] && node.x[1] == result_right_child.aabb.min_[0] && node.x[2] == result_left_child.aabb.max_[0] && node.x[3] == result_right_child.aabb.max_[0]);
-				assert(node.y[0] == result_left_child.aabb.min_[1] && node.y[1] == result_right_child.aabb.min_[1] && node.y[2] == result_left_child.aabb.max_[1] && node.y[3] == result_right_child.aabb.max_[1]);
-				assert(node.z[0] == result_left_child.aabb.min_[2] && node.z[1] == result_right_child.aabb.min_[2] && node.z[2] == result_left_child.aabb.max_[2] && node.z[3] == result_right_child.aabb.max_[2]);
-
-				//node.x = Vec4f(result_left_child.aabb.min_.x[0], result_right_child.aabb.min_.x[0], result_left_child.aabb.max_.x[0], result_right_child.aabb.max_.x[0]);
-				//node.y = Vec4f(result_left_child.aabb.min_.x[1], result_right_child.aabb.min_.x[1], result_left_child.aabb.max_.x[1], result_right_child.aabb.max_.x[1]);
-				//node.z = Vec4f(result_left_child.aabb.min_.x[2], result_right_child.aabb.min_.x[2], result_left_child.aabb.max_.x[2], result_right_child.aabb.max_.x[2]);
-
-				// Set node.child[0] and node.child[1]
-				if(result_left_child.interior)
-				{
-					node.child[0] = new_node_indices[result_node.left];
-					assert(node.child[0] >= 0 && node.child[0] < new_num_nodes);
-				}
-				else
-				{
-					// Number of objects is in lower 6 bits.  Set sign bit to 1.
-					const int num = result_left_child.right - result_left_child.left;
-					const int offset = result_left_child.left;
-					assert(num < 32);
-					int c = 0x80000000 | num | (offset << 5);
-					node.child[0] = c;
-				}
-
-				if(result_right_child.interior)
-				{
-					node.child[1] = new_node_indices[result_node.right];
-					assert(node.child[1] >= 0 && node.child[1] < new_num_nodes);
-				}
-				else
-				{
-					// Number of objects is in lower 6 bits.  Set sign bit to 1.
-					const int num = result_right_child.right - result_right_child.left;
-					const int offset = result_right_child.left;
-					assert(num < 32);
-					int c = 0x80000000 | num | (offset << 5);
-					node.child[1] = c;
-				}
-			}
-		}
-	}
+	// Convert result_nodes to BVHNodes, with leaf geometry references stored in the child references of the node above.
+	this->root_node_index = BVHBuilderUtils::convertResultNodes<BVHNode, 5>(result_nodes, this->nodes, task_manager);
 
 	// Build leaf_tri_indices
-	const size_t result_ob_ind_size = result_ob_indices.size();
-	leaf_tri_indices.resizeNoCopy(result_ob_ind_size);
-	for(size_t i=0; i<result_ob_ind_size; ++i)
-		leaf_tri_indices[i] = result_ob_indices[i];
+	BVHBuilderUtils::copyLeafObIndices(result_ob_indices, leaf_tri_indices, task_manager);
+
+	node_data = nodes.data();
+	leaf_tri_index_data = leaf_tri_indices.data();
+	num_nodes = nodes.size();
+	num_leaf_tri_indices = leaf_tri_indices.size();
+	cache_file = NULL;
 
 	// We will access the RayMesh tri data directly for now instead of copying to intersect_tris.
 	
@@ -238,7 +169,7 @@ stack_pop:
 
 		while(cur >= 0) // While this is a proper interior node:
 		{
-			const BVHNode& node = nodes[cur];
+			const BVHNode& node = node_data[cur];
 
 			// Intersect with the node bounding boxes
 
@@ -307,7 +238,7 @@ stack_pop:
 		const size_t num = size_t(cur) & 0x1F;
 		for(size_t i=ofs; i<ofs+num; i++)
 		{
-			const uint32 tri_index = leaf_tri_indices[i];
+			const uint32 tri_index = leaf_tri_index_data[i];
 
 			MollerTrumboreTri tri;
 			tri.set(raymesh->triVertPos(tri_index, 0), raymesh->triVertPos(tri_index, 1), raymesh->triVertPos(tri_index, 2)); // TODO: use unaligned loads here for speed etc..
@@ -334,13 +265,12 @@ stack_pop:
 }
 
 
-BVH::DistType BVH::traceSphere(const Ray& ray_ws_, const Matrix4f& to_object, const Matrix4f& to_world, float radius_ws, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const
+// Computes the AABB of the path traced by the sphere in object space.
+static inline const js::AABBox spherePathAABBOS(const Ray& ray_ws, float radius_ws, const Matrix4f& to_object)
 {
-	Ray ray_ws = ray_ws_;
-	const Vec4f start_ws = ray_ws_.startPos();
-	const Vec4f end_ws   = ray_ws_.pointf(ray_ws_.maxT());
+	const Vec4f start_ws = ray_ws.startPos();
+	const Vec4f end_ws   = ray_ws.pointf(ray_ws.maxT());
 
-	// Compute the path traced by the sphere in object space.
 	// To do this we will compute the start and end path AABBs in world space, transform those to object space, then take the union of the object-space end AABBs.
 	const js::AABBox start_aabb_ws(start_ws - Vec4f(radius_ws, radius_ws, radius_ws, 0), start_ws + Vec4f(radius_ws, radius_ws, radius_ws, 0));
 	const js::AABBox end_aabb_ws  (end_ws   - Vec4f(radius_ws, radius_ws, radius_ws, 0), end_ws   + Vec4f(radius_ws, radius_ws, radius_ws, 0));
@@ -348,7 +278,24 @@ BVH::DistType BVH::traceSphere(const Ray& ray_ws_, const Matrix4f& to_object, co
 	const js::AABBox start_aabb_os = start_aabb_ws.transformedAABBFast(to_object);
 	const js::AABBox end_aabb_os =   end_aabb_ws  .transformedAABBFast(to_object);
 
-	const js::AABBox spherepath_aabb_os = AABBUnion(start_aabb_os, end_aabb_os);
+	return AABBUnion(start_aabb_os, end_aabb_os);
+}
+
+
+// Computes the AABB of the sphere in object space.
+static inline const js::AABBox sphereAABBOS(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_object)
+{
+	const js::AABBox sphere_aabb_ws(sphere_pos_ws - Vec4f(radius_ws, radius_ws, radius_ws, 0), sphere_pos_ws + Vec4f(radius_ws, radius_ws, radius_ws, 0));
+	return sphere_aabb_ws.transformedAABBFast(to_object);
+}
+
+
+BVH::DistType BVH::traceSphere(const Ray& ray_ws_, const Matrix4f& to_object, const Matrix4f& to_world, float radius_ws, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const
+{
+	Ray ray_ws = ray_ws_;
+
+	// Compute the path traced by the sphere in object space.
+	const js::AABBox spherepath_aabb_os = spherePathAABBOS(ray_ws_, radius_ws, to_object);
 
 	int stack[64];
 	int stack_top = 0;
@@ -361,7 +308,7 @@ stack_pop:
 
 		while(cur >= 0) // While this is a proper interior node:
 		{
-			const BVHNode& node = nodes[cur];
+			const BVHNode& node = node_data[cur];
 
 			// Intersect with the node bounding boxes
 
@@ -421,7 +368,7 @@ stack_pop:
 		const size_t num = size_t(cur) & 0x1F;
 		for(size_t i=ofs; i<ofs+num; i++)
 		{
-			const uint32 tri_index = leaf_tri_indices[i];
+			const uint32 tri_index = leaf_tri_index_data[i];
 			intersectSphereAgainstLeafTri(ray_ws, to_world, radius_ws, tri_index, hit_pos_ws_out, hit_normal_ws_out, point_in_tri_out);
 		}
 	}
@@ -459,9 +406,6 @@ static inline float traceRayAgainstSphere(const Vec4f& ray_origin, const Vec4f&
 
 void BVH::intersectSphereAgainstLeafTri(Ray& ray_ws, const Matrix4f& to_world, float radius_ws, TRI_INDEX tri_index, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const
 {
-	const Vec4f sourcePoint3_ws(ray_ws.startPos());
-	const Vec4f unitdir3_ws(ray_ws.unitDir());
-
 	MollerTrumboreTri tri;
 	tri.set(raymesh->triVertPos(tri_index, 0), raymesh->triVertPos(tri_index, 1), raymesh->triVertPos(tri_index, 2));
 
@@ -469,14 +413,63 @@ void BVH::intersectSphereAgainstLeafTri(Ray& ray_ws, const Matrix4f& to_world, f
 	const Vec4f e1_os(tri.data[3], tri.data[4], tri.data[5], 0.f);
 	const Vec4f e2_os(tri.data[6], tri.data[7], tri.data[8], 0.f);
 
-	const Vec4f v0_ws = to_world.mul3Point(v0_os);
-	const Vec4f e1_ws = to_world.mul3Vector(e1_os);
-	const Vec4f e2_ws = to_world.mul3Vector(e2_os);
+	intersectSphereAgainstTri(ray_ws, to_world, radius_ws, v0_os, e1_os, e2_os, hit_pos_ws_out, hit_normal_ws_out, point_in_tri_out);
+}
+
+
+// A triangle transformed to world space, so it can be intersected with multiple spheres.
+struct WorldSpaceTri
+{
+	Vec4f v0_ws;
+	Vec4f e1_ws;
+	Vec4f e2_ws;
+	Vec4f normal; // Unit length
+};
+
+
+static GLARE_STRONG_INLINE void getWorldSpaceTri(const Matrix4f& to_world, const Vec4f& v0_os, const Vec4f& e1_os, const Vec4f& e2_os, WorldSpaceTri& tri_out)
+{
+	tri_out.v0_ws = to_world.mul3Point(v0_os);
+	tri_out.e1_ws = to_world.mul3Vector(e1_os);
+	tri_out.e2_ws = to_world.mul3Vector(e2_os);
+	tri_out.normal = normalise(crossProduct(tri_out.e1_ws, tri_out.e2_ws));
+}
+
 
-	// The rest of the intersection will take place in world space.
-	const Vec4f normal = normalise(crossProduct(e1_ws, e2_ws));
+static GLARE_STRONG_INLINE void getLeafTriObjectSpace(const RayMesh* raymesh, uint32 tri_index, Vec4f& v0_os_out, Vec4f& e1_os_out, Vec4f& e2_os_out)
+{
+	MollerTrumboreTri tri;
+	tri.set(raymesh->triVertPos(tri_index, 0), raymesh->triVertPos(tri_index, 1), raymesh->triVertPos(tri_index, 2));
 
-	const js::Triangle js_tri(v0_ws, e1_ws, e2_ws, normal);
+	v0_os_out = Vec4f(tri.data[0], tri.data[1], tri.data[2], 0.f); // W-coord should be 1, but can leave as zero due to using mul3Point().
+	e1_os_out = Vec4f(tri.data[3], tri.data[4], tri.data[5], 0.f);
+	e2_os_out = Vec4f(tri.data[6], tri.data[7], tri.data[8], 0.f);
+}
+
+
+static void intersectSphereAgainstWorldSpaceTri(Ray& ray_ws, float radius_ws, const WorldSpaceTri& tri, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out);
+static void appendCollPointsForWorldSpaceTri(const Vec4f& sphere_pos_ws, float radius_ws, const WorldSpaceTri& tri, std::vector<Vec4f>& points_ws_in_out);
+
+
+void BVH::intersectSphereAgainstTri(Ray& ray_ws, const Matrix4f& to_world, float radius_ws, const Vec4f& v0_os, const Vec4f& e1_os, const Vec4f& e2_os, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out)
+{
+	WorldSpaceTri tri;
+	getWorldSpaceTri(to_world, v0_os, e1_os, e2_os, tri);
+
+	intersectSphereAgainstWorldSpaceTri(ray_ws, radius_ws, tri, hit_pos_ws_out, hit_normal_ws_out, point_in_tri_out);
+}
+
+
+// The intersection takes place in world space.
+static void intersectSphereAgainstWorldSpaceTri(Ray& ray_ws, float radius_ws, const WorldSpaceTri& tri, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out)
+{
+	const Vec4f sourcePoint3_ws(ray_ws.startPos());
+	const Vec4f unitdir3_ws(ray_ws.unitDir());
+
+	const Vec4f& v0_ws = tri.v0_ws;
+	const Vec4f& normal = tri.normal;
+
+	const js::Triangle js_tri(v0_ws, tri.e1_ws, tri.e2_ws, normal);
 
 	const Planef tri_plane(v0_ws, normal);
 
@@ -580,9 +573,7 @@ void BVH::intersectSphereAgainstLeafTri(Ray& ray_ws, const Matrix4f& to_world, f
 
 void BVH::appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_object, const Matrix4f& to_world, std::vector<Vec4f>& points_ws_in_out) const
 {
-	const float radius_ws2 = radius_ws*radius_ws;
-	const js::AABBox sphere_aabb_ws(sphere_pos_ws - Vec4f(radius_ws, radius_ws, radius_ws, 0), sphere_pos_ws + Vec4f(radius_ws, radius_ws, radius_ws, 0));
-	const js::AABBox sphere_aabb_os = sphere_aabb_ws.transformedAABBFast(to_object);
+	const js::AABBox sphere_aabb_os = sphereAABBOS(sphere_pos_ws, radius_ws, to_object);
 
 	int stack[64];
 	int stack_top = 0;
@@ -595,7 +586,7 @@ stack_pop:
 
 		while(cur >= 0) // While this is a proper interior node:
 		{
-			const BVHNode& node = nodes[cur];
+			const BVHNode& node = node_data[cur];
 
 			// Intersect with the node bounding boxes
 
@@ -655,7 +646,7 @@ stack_pop:
 		const size_t num = size_t(cur) & 0x1F;
 		for(size_t i=ofs; i<ofs+num; i++)
 		{
-			const uint32 tri_index = leaf_tri_indices[i];
+			const uint32 tri_index = leaf_tri_index_data[i];
 
 			MollerTrumboreTri moller_tri;
 			moller_tri.set(raymesh->triVertPos(tri_index, 0), raymesh->triVertPos(tri_index, 1), raymesh->triVertPos(tri_index, 2));
@@ -664,31 +655,141 @@ stack_pop:
 			const Vec4f e1_os(moller_tri.data[3], moller_tri.data[4], moller_tri.data[5], 0.f);
 			const Vec4f e2_os(moller_tri.data[6], moller_tri.data[7], moller_tri.data[8], 0.f);
 
-			const Vec4f v0_ws = to_world.mul3Point(v0_os);
-			const Vec4f e1_ws = to_world.mul3Vector(e1_os);
-			const Vec4f e2_ws = to_world.mul3Vector(e2_os);
+			appendCollPointsForTri(sphere_pos_ws, radius_ws, to_world, v0_os, e1_os, e2_os, points_ws_in_out);
+		}
+	}
+}
+
+
+void BVH::appendCollPointsForTri(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_world, const Vec4f& v0_os, const Vec4f& e1_os, const Vec4f& e2_os, std::vector<Vec4f>& points_ws_in_out)
+{
+	WorldSpaceTri ws_tri;
+	getWorldSpaceTri(to_world, v0_os, e1_os, e2_os, ws_tri);
+
+	appendCollPointsForWorldSpaceTri(sphere_pos_ws, radius_ws, ws_tri, points_ws_in_out);
+}
+
 
-			// The rest of the intersection will take place in world space.
-			const Vec4f normal = normalise(crossProduct(e1_ws, e2_ws));
-			const js::Triangle tri(v0_ws, e1_ws, e2_ws, normal);
+// The intersection takes place in world space.
+static void appendCollPointsForWorldSpaceTri(const Vec4f& sphere_pos_ws, float radius_ws, const WorldSpaceTri& ws_tri, std::vector<Vec4f>& points_ws_in_out)
+{
+	const js::Triangle tri(ws_tri.v0_ws, ws_tri.e1_ws, ws_tri.e2_ws, ws_tri.normal);
+
+	// See if sphere is touching plane
+	const Planef tri_plane(ws_tri.v0_ws, ws_tri.normal);
+	const float disttoplane = tri_plane.signedDistToPoint(sphere_pos_ws);
+	if(fabs(disttoplane) > radius_ws)
+		return;
+
+	// Get closest point on plane to sphere center
+	Vec4f planepoint = tri_plane.closestPointOnPlane(sphere_pos_ws);
+
+	// Restrict point to inside tri
+	if(!tri.pointInTri(planepoint))
+		planepoint = tri.closestPointOnTriangle(planepoint);
+
+	if(planepoint.getDist2(sphere_pos_ws) <= radius_ws*radius_ws)
+		points_ws_in_out.push_back(planepoint);
+}
 
-			// See if sphere is touching plane
-			const Planef tri_plane(v0_ws, normal);
-			const float disttoplane = tri_plane.signedDistToPoint(sphere_pos_ws);
-			if(fabs(disttoplane) > radius_ws)
-				continue;
 
-			// Get closest point on plane to sphere center
-			Vec4f planepoint = tri_plane.closestPointOnPlane(sphere_pos_ws);
+void BVH::traceSpheres(const SphereSweepQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, SphereSweepResult* results_out, glare::TaskManager* task_manager) const
+{
+	// Compute the path traced by each sphere in object space.
+	js::Vector<js::AABBox, 16> query_aabbs_os(num_queries);
+	for(size_t i=0; i<num_queries; ++i)
+		query_aabbs_os[i] = spherePathAABBOS(queries[i].ray_ws, queries[i].radius_ws, to_object);
 
-			// Restrict point to inside tri
-			if(!tri.pointInTri(planepoint))
-				planepoint = tri.closestPointOnTriangle(planepoint);
+	std::vector<uint32> order;
+	BVHSphereBatchTraversal::computeQueryOrder(query_aabbs_os.data(), num_queries, order);
 
-			if(planepoint.getDist2(sphere_pos_ws) <= radius_ws2)
-				points_ws_in_out.push_back(planepoint);
+	BVHSphereBatchTraversal::forEachGroup(order, task_manager, [&](size_t /*group_index*/, const uint32* group_query_indices, int group_size)
+	{
+		BVHSphereBatchTraversal::QueryGroupAABBs group_aabbs;
+		Ray rays[BVHSphereBatchTraversal::GROUP_SIZE];
+		for(int l=0; l<group_size; ++l)
+		{
+			group_aabbs.set(l, query_aabbs_os[group_query_indices[l]]);
+			rays[l] = queries[group_query_indices[l]].ray_ws;
 		}
-	}
+
+		auto leaf_func = [&](size_t leaf_i, uint32 mask)
+		{
+			// Transform the triangle to world space once, for all the queries in the mask.
+			Vec4f v0_os, e1_os, e2_os;
+			getLeafTriObjectSpace(raymesh, leaf_tri_index_data[leaf_i], v0_os, e1_os, e2_os);
+			WorldSpaceTri tri;
+			getWorldSpaceTri(to_world, v0_os, e1_os, e2_os, tri);
+
+			while(mask != 0)
+			{
+				const uint32 l = BitUtils::lowestSetBitIndex(mask);
+				mask &= mask - 1; // Clear lowest set bit
+
+				SphereSweepResult& result = results_out[group_query_indices[l]];
+				intersectSphereAgainstWorldSpaceTri(rays[l], queries[group_query_indices[l]].radius_ws, tri, result.hit_pos_ws, result.hit_normal_ws, result.point_in_tri);
+			}
+		};
+
+		BVHSphereBatchTraversal::traverse<BVHNode, /*LEAF_NUM_BITS=*/5>(node_data, root_node_index, group_aabbs, BVHSphereBatchTraversal::groupMask(group_size), leaf_func);
+
+		for(int l=0; l<group_size; ++l)
+		{
+			const Ray& query_ray = queries[group_query_indices[l]].ray_ws;
+			results_out[group_query_indices[l]].dist = (rays[l].maxT() < query_ray.maxT()) ? rays[l].maxT() : -1.f;
+		}
+	});
+}
+
+
+void BVH::getCollPointsBatch(const SphereOverlapQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, BatchQueryResults<Vec4f>& results_out, glare::TaskManager* task_manager) const
+{
+	js::Vector<js::AABBox, 16> query_aabbs_os(num_queries);
+	for(size_t i=0; i<num_queries; ++i)
+		query_aabbs_os[i] = sphereAABBOS(queries[i].centre_ws, queries[i].radius_ws, to_object);
+
+	std::vector<uint32> order;
+	BVHSphereBatchTraversal::computeQueryOrder(query_aabbs_os.data(), num_queries, order);
+
+	std::vector<BVHSphereBatchTraversal::GroupResults<Vec4f> > group_results((num_queries + BVHSphereBatchTraversal::GROUP_SIZE - 1) / BVHSphereBatchTraversal::GROUP_SIZE);
+
+	BVHSphereBatchTraversal::forEachGroup(order, task_manager, [&](size_t group_index, const uint32* group_query_indices, int group_size)
+	{
+		BVHSphereBatchTraversal::QueryGroupAABBs group_aabbs;
+		for(int l=0; l<group_size; ++l)
+			group_aabbs.set(l, query_aabbs_os[group_query_indices[l]]);
+
+		BVHSphereBatchTraversal::GroupResults<Vec4f>& results = group_results[group_index];
+
+		auto leaf_func = [&](size_t leaf_i, uint32 mask)
+		{
+			// Transform the triangle to world space once, for all the queries in the mask.
+			Vec4f v0_os, e1_os, e2_os;
+			getLeafTriObjectSpace(raymesh, leaf_tri_index_data[leaf_i], v0_os, e1_os, e2_os);
+			WorldSpaceTri tri;
+			getWorldSpaceTri(to_world, v0_os, e1_os, e2_os, tri);
+
+			while(mask != 0)
+			{
+				const uint32 l = BitUtils::lowestSetBitIndex(mask);
+				mask &= mask - 1; // Clear lowest set bit
+
+				const SphereOverlapQuery& query = queries[group_query_indices[l]];
+				appendCollPointsForWorldSpaceTri(query.centre_ws, query.radius_ws, tri, results.items);
+				results.item_queries.resize(results.items.size(), (uint8)l);
+			}
+		};
+
+		BVHSphereBatchTraversal::traverse<BVHNode, /*LEAF_NUM_BITS=*/5>(node_data, root_node_index, group_aabbs, BVHSphereBatchTraversal::groupMask(group_size), leaf_func);
+	});
+
+	BVHSphereBatchTraversal::combineGroupResults(order, group_results, results_out);
+}
+
+
+void BVH::traceRays(const RayBatch& rays, HitInfo* hitinfos_out, DistType* dists_out) const
+{
+	BVHPacketTraversal::traceRays<BVHNode, /*LEAF_NUM_BITS=*/5>(*this, node_data, root_node_index, leaf_tri_index_data, raymesh, rays, hitinfos_out, dists_out);
 }
 
 
@@ -700,7 +801,40 @@ const js::AABBox& BVH::getAABBox() const
 
 size_t BVH::getTotalMemUsage() const
 {
-	return sizeof(root_aabb) + nodes.capacitySizeBytes() + leaf_tri_indices.capacitySizeBytes();
+	return sizeof(root_aabb) + nodes.capacitySizeBytes() + leaf_tri_indices.capacitySizeBytes() + (cache_file.nonNull() ? cache_file->fileSize() : 0);
+}
+
+
+bool BVH::loadFromCache(const std::string& cache_dir, uint64 mesh_hash)
+{
+	BVHCache::CachedTreeData data;
+	if(!BVHCache::loadCacheFile(cache_dir, mesh_hash, raymesh->getNumTris(), BVHCache::TreeType_BVH, sizeof(BVHNode), sizeof(TRI_INDEX), data))
+		return false;
+
+	// Use the node and leaf data directly from the memory-mapped file.
+	nodes.clearAndFreeMem();
+	leaf_tri_indices.clearAndFreeMem();
+	root_aabb = data.root_aabb;
+	root_node_index = data.root_node_index;
+	node_data = (const BVHNode*)data.nodes;
+	leaf_tri_index_data = (const TRI_INDEX*)data.leaf_data;
+	num_nodes = data.num_nodes;
+	num_leaf_tri_indices = data.num_leaf_elems;
+	cache_file = data.file;
+	return true;
+}
+
+
+void BVH::writeToCache(const std::string& cache_dir, uint64 mesh_hash) const
+{
+	BVHCache::CachedTreeData data;
+	data.root_aabb = root_aabb;
+	data.root_node_index = root_node_index;
+	data.nodes = node_data;
+	data.num_nodes = num_nodes;
+	data.leaf_data = leaf_tri_index_data;
+	data.num_leaf_elems = num_leaf_tri_indices;
+	BVHCache::writeCacheFile(cache_dir, mesh_hash, raymesh->getNumTris(), BVHCache::TreeType_BVH, sizeof(BVHNode), sizeof(TRI_INDEX), data);
 }
 
 
@@ -784,6 +918,14 @@ static void testOnAllIGMeshes(bool comprehensive_tests)
 			bvh.build(print_output, should_cancel_callback, task_manager);
 		
 			testTracingRays(bvh, raymesh);
+
+			// Test a BVH built with MortonBVHBuilder
+			js::BVH morton_bvh(&raymesh);
+			morton_bvh.setUseMortonBuilder(true);
+			morton_bvh.build(print_output, should_cancel_callback, task_manager);
+			testAssert(morton_bvh.getAABBox() == bvh.getAABBox());
+
+			testTracingRays(morton_bvh, raymesh);
 		}
 		catch(Indigo::IndigoException& e)
 		{
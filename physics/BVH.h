@@ -12,9 +12,11 @@ Copyright Glare Technologies Limited 2020 -
 #include "../maths/vec3.h"
 #include "../utils/MemAlloc.h"
 #include "../utils/Vector.h"
+#include "../utils/Reference.h"
 
 
 class RayMesh;
+class SharedMemMappedFile;
 
 
 namespace js
@@ -53,16 +55,32 @@ public:
 	virtual void build(PrintOutput& print_output, ShouldCancelCallback& should_cancel_callback, glare::TaskManager& task_manager); // throws glare::Exception
 
 	virtual DistType traceRay(const Ray& ray, HitInfo& hitinfo_out) const;
+	virtual void traceRays(const RayBatch& rays, HitInfo* hitinfos_out, DistType* dists_out) const; // Traces rays in packets of 4 where they are coherent.  See BVHPacketTraversal.h
 	virtual DistType traceSphere(const Ray& ray_ws, const Matrix4f& to_object, const Matrix4f& to_world, float radius_ws, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const;
 	virtual void appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_object, const Matrix4f& to_world, std::vector<Vec4f>& points_ws_in_out) const;
+	virtual void traceSpheres(const SphereSweepQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, SphereSweepResult* results_out, glare::TaskManager* task_manager) const; // See BVHSphereBatchTraversal.h
+	virtual void getCollPointsBatch(const SphereOverlapQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, BatchQueryResults<Vec4f>& results_out, glare::TaskManager* task_manager) const; // See BVHSphereBatchTraversal.h
 	virtual const js::AABBox& getAABBox() const;
 
 	virtual void printStats() const {}
 	virtual void printTraceStats() const {}
 	virtual size_t getTotalMemUsage() const;
 
+	virtual bool loadFromCache(const std::string& cache_dir, uint64 mesh_hash);
+	virtual void writeToCache(const std::string& cache_dir, uint64 mesh_hash) const; // throws glare::Exception
+
+	// If true, build() uses MortonBVHBuilder instead of BinningBVHBuilder.  Builds are much faster but the tree is of lower quality.  For per-frame rebuilds of deforming meshes.
+	void setUseMortonBuilder(bool use_morton_builder_) { use_morton_builder = use_morton_builder_; }
+
 	static void test(bool comprehensive_tests);
 
+	// Sphere tracing and collision point functions for a single triangle.  Also used by BVH8.
+	// v0_os, e1_os and e2_os are the object space triangle vertex 0 and edges (v1 - v0, v2 - v0), with W = 0.
+	static void intersectSphereAgainstTri(Ray& ray_ws, const Matrix4f& to_world, float radius_ws, const Vec4f& v0_os, const Vec4f& e1_os, const Vec4f& e2_os, 
+		Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out);
+	static void appendCollPointsForTri(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_world, const Vec4f& v0_os, const Vec4f& e1_os, const Vec4f& e2_os, 
+		std::vector<Vec4f>& points_ws_in_out);
+
 	typedef uint32 TRI_INDEX;
 private:
 	inline void intersectSphereAgainstLeafTri(Ray& ray_ws, const Matrix4f& to_world, float radius_ws,
@@ -76,6 +94,14 @@ private:
 	js::Vector<TRI_INDEX, 64> leaf_tri_indices; // Indices into the intersect_tris array.
 	const RayMesh* const raymesh;
 	int32 root_node_index;
+
+	// The node and leaf tri index data used for traversal.  These point into nodes and leaf_tri_indices, or into cache_file if the tree was loaded from the BVH cache.
+	const BVHNode* node_data;
+	const TRI_INDEX* leaf_tri_index_data;
+	size_t num_nodes;
+	size_t num_leaf_tri_indices;
+	Reference<SharedMemMappedFile> cache_file;
+	bool use_morton_builder;
 };
 
 
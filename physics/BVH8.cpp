@@ -0,0 +1,855 @@
+/*=====================================================================
+BVH8.cpp
+--------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#include "BVH8.h"
+
+
+#include "BVH.h"
+#include "BinningBVHBuilder.h"
+#include "../simpleraytracer/raymesh.h"
+#include "../utils/PlatformUtils.h"
+#include "../utils/BitUtils.h"
+#include "../utils/Exception.h"
+#include "../utils/PrintOutput.h"
+#include "../utils/Timer.h"
+#include "../utils/ConPrint.h"
+#include "../utils/StringUtils.h"
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+
+namespace js
+{
+
+
+// Each interior node adds at most 7 entries to the stack, and the tree depth is at most the builder max_depth of 64.
+static const int STACK_SIZE = 7 * 64 + 1;
+
+
+BVH8::BVH8(const RayMesh* const raymesh_)
+:	raymesh(raymesh_),
+	root_node_index(0)
+{
+	assert(raymesh);
+
+	static_assert(sizeof(BVH8Node) == 224, "sizeof(BVH8Node) == 224");
+	static_assert(sizeof(BVH8LeafTris) == 160, "sizeof(BVH8LeafTris) == 160");
+
+	use_avx2 = isAVX2Supported();
+}
+
+
+BVH8::~BVH8()
+{}
+
+
+bool BVH8::isAVX2Supported()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	static bool checked = false;
+	static bool supported = false;
+	if(!checked)
+	{
+		try
+		{
+			PlatformUtils::CPUInfo cpu_info;
+			PlatformUtils::getCPUInfo(cpu_info);
+			supported = cpu_info.avx2 && cpu_info.fma;
+		}
+		catch(glare::Exception&)
+		{
+			supported = false;
+		}
+		checked = true;
+	}
+	return supported;
+#else
+	return false;
+#endif
+}
+
+
+// Throws glare::CancelledException if cancelled.
+void BVH8::build(PrintOutput& print_output, ShouldCancelCallback& should_cancel_callback, glare::TaskManager& task_manager)
+{
+	const RayMesh::TriangleVectorType& raymesh_tris = raymesh->getTriangles();
+	const int raymesh_tris_size = (int)raymesh_tris.size();
+	const RayMesh::VertexVectorType& raymesh_verts = raymesh->getVertices();
+
+	Reference<BinningBVHBuilder> builder = new BinningBVHBuilder(
+		4, // leaf_num_object_threshold.  Leaf tris are intersected 4 at a time, so don't split below that.
+		31, // max_num_objects_per_leaf
+		64, // max_depth
+		1.f, // intersection_cost
+		raymesh_tris_size
+	);
+
+	for(int i=0; i<raymesh_tris_size; ++i)
+	{
+		const RayMeshTriangle& tri = raymesh_tris[i];
+		const Vec4f v0 = raymesh_verts[tri.vertex_indices[0]].pos.toVec4fPoint();
+		const Vec4f v1 = raymesh_verts[tri.vertex_indices[1]].pos.toVec4fPoint();
+		const Vec4f v2 = raymesh_verts[tri.vertex_indices[2]].pos.toVec4fPoint();
+		js::AABBox tri_aabb(v0, v0);
+		tri_aabb.enlargeToHoldPoint(v1);
+		tri_aabb.enlargeToHoldPoint(v2);
+
+		builder->setObjectAABB(i, tri_aabb);
+	}
+
+	js::Vector<ResultNode, 64> result_nodes;
+	builder->build(
+		task_manager,
+		should_cancel_callback,
+		print_output,
+		result_nodes
+	);
+	const BVHBuilder::ResultObIndicesVec& result_ob_indices = builder->getResultObjectIndices();
+
+	root_aabb = builder->getRootAABB();
+
+	// Count the number of leaf triangle blocks, so we can allocate leaf_tris once.
+	size_t num_blocks = 0;
+	for(size_t i=0; i<result_nodes.size(); ++i)
+		if(!result_nodes[i].interior)
+			num_blocks += (result_nodes[i].right - result_nodes[i].left + 3) / 4;
+	if(num_blocks >= (1u << 27))
+		throw glare::Exception("Too many triangles for BVH8.");
+
+	leaf_tris.clear();
+	leaf_tris.reserve(num_blocks);
+	nodes.clear();
+
+	if(result_nodes.size() == 1)
+	{
+		// Special case where the root node is a leaf.
+		this->root_node_index = makeLeaf(result_ob_indices, result_nodes[0].left, result_nodes[0].right);
+	}
+	else
+	{
+		this->root_node_index = 0;
+		nodes.resize(1);
+
+		// Stack of (result node index, BVH8 node index) pairs for interior nodes still to be converted.
+		std::vector<std::pair<int, int>> todo;
+		todo.push_back(std::make_pair(0, 0));
+
+		while(!todo.empty())
+		{
+			const int result_node_index = todo.back().first;
+			const int node_index = todo.back().second;
+			todo.pop_back();
+
+			// Collapse the binary subtree: repeatedly replace the interior child with the largest surface area with its two children.
+			int children[8];
+			int num_children = 2;
+			children[0] = result_nodes[result_node_index].left;
+			children[1] = result_nodes[result_node_index].right;
+			while(num_children < 8)
+			{
+				int best = -1;
+				float best_area = -1;
+				for(int i=0; i<num_children; ++i)
+				{
+					const ResultNode& child = result_nodes[children[i]];
+					if(child.interior && child.aabb.getSurfaceArea() > best_area)
+					{
+						best = i;
+						best_area = child.aabb.getSurfaceArea();
+					}
+				}
+				if(best == -1) // If all children are leaves:
+					break;
+
+				const ResultNode& expanded = result_nodes[children[best]];
+				children[best] = expanded.left;
+				children[num_children++] = expanded.right;
+			}
+
+			// Build the node in a local, as nodes may be reallocated by push_back below.
+			BVH8Node node;
+			for(int i=0; i<8; ++i)
+			{
+				if(i < num_children)
+				{
+					const ResultNode& child = result_nodes[children[i]];
+					node.min_x[i] = child.aabb.min_[0];
+					node.min_y[i] = child.aabb.min_[1];
+					node.min_z[i] = child.aabb.min_[2];
+					node.max_x[i] = child.aabb.max_[0];
+					node.max_y[i] = child.aabb.max_[1];
+					node.max_z[i] = child.aabb.max_[2];
+
+					if(child.interior)
+					{
+						const int child_node_index = (int)nodes.size();
+						nodes.push_back(BVH8Node());
+						todo.push_back(std::make_pair(children[i], child_node_index));
+						node.child[i] = child_node_index;
+					}
+					else
+						node.child[i] = makeLeaf(result_ob_indices, child.left, child.right);
+				}
+				else
+				{
+					// Empty slot.  Use empty bounds so it is never hit.
+					node.min_x[i] = node.min_y[i] = node.min_z[i] =  std::numeric_limits<float>::infinity();
+					node.max_x[i] = node.max_y[i] = node.max_z[i] = -std::numeric_limits<float>::infinity();
+					node.child[i] = 0;
+				}
+			}
+
+			nodes[node_index] = node;
+		}
+	}
+
+	assert(leaf_tris.size() == num_blocks);
+}
+
+
+// Copies the triangles result_ob_indices[begin] ... result_ob_indices[end - 1] into leaf triangle blocks, and returns the encoded leaf child reference.
+int BVH8::makeLeaf(const js::Vector<uint32, 16>& result_ob_indices, int begin, int end)
+{
+	const int num_tris = end - begin;
+	assert(num_tris >= 1);
+	const int num_blocks = (num_tris + 3) / 4;
+	assert(num_blocks < 16);
+
+	const size_t block_offset = leaf_tris.size();
+	leaf_tris.resize(block_offset + num_blocks);
+
+	for(int b=0; b<num_blocks; ++b)
+	{
+		BVH8LeafTris& block = leaf_tris[block_offset + b];
+		for(int z=0; z<4; ++z)
+		{
+			const uint32 tri_index = result_ob_indices[myMin(begin + b*4 + z, end - 1)]; // Pad with copies of the last triangle.
+			const Vec3f& v0 = raymesh->triVertPos(tri_index, 0);
+			const Vec3f e1 = raymesh->triVertPos(tri_index, 1) - v0;
+			const Vec3f e2 = raymesh->triVertPos(tri_index, 2) - v0;
+
+			block.v0_x[z] = v0.x;
+			block.v0_y[z] = v0.y;
+			block.v0_z[z] = v0.z;
+			block.e1_x[z] = e1.x;
+			block.e1_y[z] = e1.y;
+			block.e1_z[z] = e1.z;
+			block.e2_x[z] = e2.x;
+			block.e2_y[z] = e2.y;
+			block.e2_z[z] = e2.z;
+			block.tri_index[z] = tri_index;
+		}
+	}
+
+	return (int)(0x80000000u | ((uint32)block_offset << 4) | (uint32)num_blocks);
+}
+
+
+static GLARE_STRONG_INLINE const Vec4f condMov(const Vec4f& a, const Vec4f& b, const Vec4f& mask)
+{
+	return Vec4f(_mm_or_ps(_mm_and_ps(mask.v, b.v), _mm_andnot_ps(mask.v, a.v)));
+}
+
+
+// Pushes the children in hit_mask onto the stack, sorted so that the closest child is on top, then pops the closest child and returns it.
+static GLARE_STRONG_INLINE int pushHitChildren(const BVH8Node& node, uint32 hit_mask, const float* near_d, int* stack, float* dist_stack, int& stack_top)
+{
+	if((hit_mask & (hit_mask - 1)) == 0) // If only one child was hit, just traverse to it.
+		return node.child[BitUtils::lowestSetBitIndex(hit_mask)];
+
+	const int first = stack_top + 1;
+	while(hit_mask != 0)
+	{
+		const uint32 i = BitUtils::lowestSetBitIndex(hit_mask);
+		hit_mask &= hit_mask - 1; // Clear lowest set bit
+
+		// Insertion sort, keeping near distances decreasing from bottom to top of stack.
+		const float d = near_d[i];
+		int z = ++stack_top;
+		assert(stack_top < STACK_SIZE);
+		while(z > first && dist_stack[z - 1] < d)
+		{
+			stack[z] = stack[z - 1];
+			dist_stack[z] = dist_stack[z - 1];
+			z--;
+		}
+		stack[z] = node.child[i];
+		dist_stack[z] = d;
+	}
+
+	return stack[stack_top--];
+}
+
+
+// Intersects the ray against all the triangles in a leaf, 4 at a time.  Updates max_t and hitinfo_out if a closer hit is found.
+// Same computation as MollerTrumboreTri::referenceIntersect().
+static GLARE_STRONG_INLINE void intersectLeafTris(const BVH8LeafTris* blocks, uint32 leaf, const Vec4f& orig_x, const Vec4f& orig_y, const Vec4f& orig_z,
+	const Vec4f& dir_x, const Vec4f& dir_y, const Vec4f& dir_z, float min_t, float& max_t, HitInfo& hitinfo_out)
+{
+	const size_t block_offset = (leaf & 0x7FFFFFFF) >> 4;
+	const size_t num_blocks = leaf & 0xF;
+
+	const Vec4f zero(0.f);
+	const Vec4f one(1.f);
+	const Vec4f min_t_v(min_t);
+
+	for(size_t b=block_offset; b<block_offset + num_blocks; ++b)
+	{
+		const BVH8LeafTris& block = blocks[b];
+		const Vec4f e1_x = loadVec4f(block.e1_x);
+		const Vec4f e1_y = loadVec4f(block.e1_y);
+		const Vec4f e1_z = loadVec4f(block.e1_z);
+		const Vec4f e2_x = loadVec4f(block.e2_x);
+		const Vec4f e2_y = loadVec4f(block.e2_y);
+		const Vec4f e2_z = loadVec4f(block.e2_z);
+
+		// pvec = cross(dir, e2)
+		const Vec4f pvec_x = dir_y * e2_z - dir_z * e2_y;
+		const Vec4f pvec_y = dir_z * e2_x - dir_x * e2_z;
+		const Vec4f pvec_z = dir_x * e2_y - dir_y * e2_x;
+
+		const Vec4f det = e1_x * pvec_x + e1_y * pvec_y + e1_z * pvec_z;
+		const Vec4f inv_det = div(one, det);
+
+		const Vec4f tvec_x = orig_x - loadVec4f(block.v0_x);
+		const Vec4f tvec_y = orig_y - loadVec4f(block.v0_y);
+		const Vec4f tvec_z = orig_z - loadVec4f(block.v0_z);
+
+		const Vec4f u = (tvec_x * pvec_x + tvec_y * pvec_y + tvec_z * pvec_z) * inv_det;
+
+		// qvec = cross(tvec, e1)
+		const Vec4f qvec_x = tvec_y * e1_z - tvec_z * e1_y;
+		const Vec4f qvec_y = tvec_z * e1_x - tvec_x * e1_z;
+		const Vec4f qvec_z = tvec_x * e1_y - tvec_y * e1_x;
+
+		const Vec4f v = (dir_x * qvec_x + dir_y * qvec_y + dir_z * qvec_z) * inv_det;
+		const Vec4f t = (e2_x * qvec_x + e2_y * qvec_y + e2_z * qvec_z) * inv_det;
+
+		const Vec4f hit = parallelAnd(
+			parallelAnd(
+				parallelAnd(parallelGreaterEqual(u, zero), parallelLessEqual(u, one)), // u >= 0 && u <= 1
+				parallelAnd(parallelGreaterEqual(v, zero), parallelLessEqual(u + v, one)) // v >= 0 && u + v <= 1
+			),
+			parallelAnd(
+				parallelAnd(parallelGreaterEqual(t, zero), parallelGreaterEqual(t, min_t_v)), // t >= 0 && t >= min_t
+				parallelLessThan(t, Vec4f(max_t)) // t < max_t
+			)
+		);
+
+		const int hit_mask = _mm_movemask_ps(hit.v);
+		if(hit_mask != 0)
+		{
+			// Find the closest hit lane.
+			const Vec4f hit_t = condMov(Vec4f(std::numeric_limits<float>::infinity()), t, hit);
+			const float closest_t = horizontalMin(hit_t.v);
+			const uint32 lane = BitUtils::lowestSetBitIndex((uint32)(_mm_movemask_ps(parallelEq(hit_t, Vec4f(closest_t)).v) & hit_mask));
+
+			max_t = closest_t;
+			hitinfo_out.sub_elem_index = block.tri_index[lane];
+			hitinfo_out.sub_elem_coords.set(u[lane], v[lane]);
+		}
+	}
+}
+
+
+BVH8::DistType BVH8::traceRay(const Ray& ray, HitInfo& hitinfo_out) const
+{
+#if defined(_M_X64) || defined(__x86_64__)
+	if(use_avx2)
+		return traceRayAVX2(ray, hitinfo_out);
+#endif
+	return traceRaySSE(ray, hitinfo_out);
+}
+
+
+// Traversal with two 4-wide SSE box tests per node.
+BVH8::DistType BVH8::traceRaySSE(const Ray& ray, HitInfo& hitinfo_out) const
+{
+	int stack[STACK_SIZE];
+	float dist_stack[STACK_SIZE];
+	int stack_top = 0;
+	stack[0] = root_node_index; // Push root node onto stack
+	dist_stack[0] = -std::numeric_limits<float>::infinity(); // Near distances to nodes on the stack.
+
+	const float min_t = ray.minT();
+	float max_t = ray.maxT();
+
+	const Vec4f r_x = copyToAll<0>(ray.startPosF());
+	const Vec4f r_y = copyToAll<1>(ray.startPosF());
+	const Vec4f r_z = copyToAll<2>(ray.startPosF());
+	const Vec4f d_x = copyToAll<0>(ray.unitDirF());
+	const Vec4f d_y = copyToAll<1>(ray.unitDirF());
+	const Vec4f d_z = copyToAll<2>(ray.unitDirF());
+	const Vec4f rdir_x = copyToAll<0>(ray.getRecipRayDirF());
+	const Vec4f rdir_y = copyToAll<1>(ray.getRecipRayDirF());
+	const Vec4f rdir_z = copyToAll<2>(ray.getRecipRayDirF());
+
+	// Offsets (in floats) from the min bounds to the near planes for each axis.  The max bounds follow the min bounds in BVH8Node.
+	// Note that we avoid FMA-style (bound * rdir - o * rdir) here, as that can give NaNs for the infinite bounds of empty slots.
+	const int near_x_ofs = ray.getRecipRayDirF()[0] >= 0 ? 0 : 8;
+	const int near_y_ofs = ray.getRecipRayDirF()[1] >= 0 ? 0 : 8;
+	const int near_z_ofs = ray.getRecipRayDirF()[2] >= 0 ? 0 : 8;
+	const int far_x_ofs = 8 - near_x_ofs;
+	const int far_y_ofs = 8 - near_y_ofs;
+	const int far_z_ofs = 8 - near_z_ofs;
+
+	while(stack_top >= 0) // While still one or more nodes on the stack:
+	{
+		int cur = stack[stack_top]; // Pop node off top of stack.
+		const float popped_node_near = dist_stack[stack_top];
+		stack_top--;
+		if(popped_node_near > max_t) // If we have found a hit closer than this node, we don't need to process it.
+			continue;
+
+		while(cur >= 0) // While this is a proper interior node:
+		{
+			const BVH8Node& node = nodes[cur];
+
+			SSE_ALIGN float near_d[8];
+			uint32 hit_mask = 0;
+			for(int h=0; h<8; h += 4)
+			{
+				const Vec4f near_x = (loadVec4f(node.min_x + near_x_ofs + h) - r_x) * rdir_x;
+				const Vec4f near_y = (loadVec4f(node.min_y + near_y_ofs + h) - r_y) * rdir_y;
+				const Vec4f near_z = (loadVec4f(node.min_z + near_z_ofs + h) - r_z) * rdir_z;
+				const Vec4f far_x  = (loadVec4f(node.min_x + far_x_ofs  + h) - r_x) * rdir_x;
+				const Vec4f far_y  = (loadVec4f(node.min_y + far_y_ofs  + h) - r_y) * rdir_y;
+				const Vec4f far_z  = (loadVec4f(node.min_z + far_z_ofs  + h) - r_z) * rdir_z;
+
+				const Vec4f near_t = max(max(near_x, near_y), max(near_z, Vec4f(min_t)));
+				const Vec4f far_t  = min(min(far_x,  far_y),  min(far_z,  Vec4f(max_t)));
+				storeVec4f(near_t, near_d + h);
+				hit_mask |= (uint32)_mm_movemask_ps(parallelLessEqual(near_t, far_t).v) << h;
+			}
+
+			if(hit_mask == 0) // Hit zero children, pop node off stack
+				break;
+
+			cur = pushHitChildren(node, hit_mask, near_d, stack, dist_stack, stack_top);
+		}
+
+		if(cur < 0) // If current node is a leaf, intersect triangles.
+			intersectLeafTris(leaf_tris.data(), (uint32)cur, r_x, r_y, r_z, d_x, d_y, d_z, min_t, max_t, hitinfo_out);
+	}
+
+	return (max_t < ray.maxT()) ? max_t : -1.f;
+}
+
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+// Same as traceRaySSE, but tests all 8 child boxes of a node at once with AVX.
+// Only called if isAVX2Supported() returns true.
+GLARE_TARGET_AVX2 BVH8::DistType BVH8::traceRayAVX2(const Ray& ray, HitInfo& hitinfo_out) const
+{
+	int stack[STACK_SIZE];
+	float dist_stack[STACK_SIZE];
+	int stack_top = 0;
+	stack[0] = root_node_index; // Push root node onto stack
+	dist_stack[0] = -std::numeric_limits<float>::infinity(); // Near distances to nodes on the stack.
+
+	const float min_t = ray.minT();
+	float max_t = ray.maxT();
+
+	const Vec4f r_x = copyToAll<0>(ray.startPosF());
+	const Vec4f r_y = copyToAll<1>(ray.startPosF());
+	const Vec4f r_z = copyToAll<2>(ray.startPosF());
+	const Vec4f d_x = copyToAll<0>(ray.unitDirF());
+	const Vec4f d_y = copyToAll<1>(ray.unitDirF());
+	const Vec4f d_z = copyToAll<2>(ray.unitDirF());
+
+	const __m256 r_x8 = _mm256_set1_ps(ray.startPosF()[0]);
+	const __m256 r_y8 = _mm256_set1_ps(ray.startPosF()[1]);
+	const __m256 r_z8 = _mm256_set1_ps(ray.startPosF()[2]);
+	const __m256 rdir_x8 = _mm256_set1_ps(ray.getRecipRayDirF()[0]);
+	const __m256 rdir_y8 = _mm256_set1_ps(ray.getRecipRayDirF()[1]);
+	const __m256 rdir_z8 = _mm256_set1_ps(ray.getRecipRayDirF()[2]);
+	const __m256 min_t8 = _mm256_set1_ps(min_t);
+
+	const int near_x_ofs = ray.getRecipRayDirF()[0] >= 0 ? 0 : 8;
+	const int near_y_ofs = ray.getRecipRayDirF()[1] >= 0 ? 0 : 8;
+	const int near_z_ofs = ray.getRecipRayDirF()[2] >= 0 ? 0 : 8;
+	const int far_x_ofs = 8 - near_x_ofs;
+	const int far_y_ofs = 8 - near_y_ofs;
+	const int far_z_ofs = 8 - near_z_ofs;
+
+	while(stack_top >= 0) // While still one or more nodes on the stack:
+	{
+		int cur = stack[stack_top]; // Pop node off top of stack.
+		const float popped_node_near = dist_stack[stack_top];
+		stack_top--;
+		if(popped_node_near > max_t) // If we have found a hit closer than this node, we don't need to process it.
+			continue;
+
+		while(cur >= 0) // While this is a proper interior node:
+		{
+			const BVH8Node& node = nodes[cur];
+
+			const __m256 near_x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_x + near_x_ofs), r_x8), rdir_x8);
+			const __m256 near_y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_y + near_y_ofs), r_y8), rdir_y8);
+			const __m256 near_z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_z + near_z_ofs), r_z8), rdir_z8);
+			const __m256 far_x  = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_x + far_x_ofs),  r_x8), rdir_x8);
+			const __m256 far_y  = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_y + far_y_ofs),  r_y8), rdir_y8);
+			const __m256 far_z  = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_z + far_z_ofs),  r_z8), rdir_z8);
+
+			const __m256 near_t = _mm256_max_ps(_mm256_max_ps(near_x, near_y), _mm256_max_ps(near_z, min_t8));
+			const __m256 far_t  = _mm256_min_ps(_mm256_min_ps(far_x,  far_y),  _mm256_min_ps(far_z,  _mm256_set1_ps(max_t)));
+
+			const uint32 hit_mask = (uint32)_mm256_movemask_ps(_mm256_cmp_ps(near_t, far_t, _CMP_LE_OQ));
+			if(hit_mask == 0) // Hit zero children, pop node off stack
+				break;
+
+			AVX_ALIGN float near_d[8];
+			_mm256_store_ps(near_d, near_t);
+
+			cur = pushHitChildren(node, hit_mask, near_d, stack, dist_stack, stack_top);
+		}
+
+		if(cur < 0) // If current node is a leaf, intersect triangles.
+			intersectLeafTris(leaf_tris.data(), (uint32)cur, r_x, r_y, r_z, d_x, d_y, d_z, min_t, max_t, hitinfo_out);
+	}
+
+	return (max_t < ray.maxT()) ? max_t : -1.f;
+}
+
+#else
+
+BVH8::DistType BVH8::traceRayAVX2(const Ray& ray, HitInfo& hitinfo_out) const
+{
+	return traceRaySSE(ray, hitinfo_out);
+}
+
+#endif
+
+
+// Returns a bit mask of the children of the node whose AABBs overlap aabb.
+int BVH8::getOverlappingChildren(const BVH8Node& node, const js::AABBox& aabb) const
+{
+	const Vec4f q_min_x = copyToAll<0>(aabb.min_);
+	const Vec4f q_min_y = copyToAll<1>(aabb.min_);
+	const Vec4f q_min_z = copyToAll<2>(aabb.min_);
+	const Vec4f q_max_x = copyToAll<0>(aabb.max_);
+	const Vec4f q_max_y = copyToAll<1>(aabb.max_);
+	const Vec4f q_max_z = copyToAll<2>(aabb.max_);
+
+	int mask = 0;
+	for(int h=0; h<8; h += 4)
+	{
+		const Vec4f overlap = parallelAnd(
+			parallelAnd(
+				parallelAnd(parallelLessEqual(loadVec4f(node.min_x + h), q_max_x), parallelGreaterEqual(loadVec4f(node.max_x + h), q_min_x)),
+				parallelAnd(parallelLessEqual(loadVec4f(node.min_y + h), q_max_y), parallelGreaterEqual(loadVec4f(node.max_y + h), q_min_y))
+			),
+			parallelAnd(parallelLessEqual(loadVec4f(node.min_z + h), q_max_z), parallelGreaterEqual(loadVec4f(node.max_z + h), q_min_z))
+		);
+		mask |= _mm_movemask_ps(overlap.v) << h;
+	}
+	return mask;
+}
+
+
+BVH8::DistType BVH8::traceSphere(const Ray& ray_ws_, const Matrix4f& to_object, const Matrix4f& to_world, float radius_ws, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const
+{
+	Ray ray_ws = ray_ws_;
+	const Vec4f start_ws = ray_ws_.startPos();
+	const Vec4f end_ws   = ray_ws_.pointf(ray_ws_.maxT());
+
+	// Compute the path traced by the sphere in object space.  See BVH::traceSphere().
+	const js::AABBox start_aabb_ws(start_ws - Vec4f(radius_ws, radius_ws, radius_ws, 0), start_ws + Vec4f(radius_ws, radius_ws, radius_ws, 0));
+	const js::AABBox end_aabb_ws  (end_ws   - Vec4f(radius_ws, radius_ws, radius_ws, 0), end_ws   + Vec4f(radius_ws, radius_ws, radius_ws, 0));
+
+	const js::AABBox spherepath_aabb_os = AABBUnion(start_aabb_ws.transformedAABBFast(to_object), end_aabb_ws.transformedAABBFast(to_object));
+
+	int stack[STACK_SIZE];
+	int stack_top = 0;
+	stack[0] = root_node_index; // Push root node onto stack
+
+	while(stack_top >= 0) // While still one or more nodes on the stack:
+	{
+		const int cur = stack[stack_top--]; // Pop node off top of stack.
+
+		if(cur >= 0) // If this is an interior node, push overlapping children onto the stack.
+		{
+			const BVH8Node& node = nodes[cur];
+			int mask = getOverlappingChildren(node, spherepath_aabb_os);
+			while(mask != 0)
+			{
+				stack[++stack_top] = node.child[BitUtils::lowestSetBitIndex((uint32)mask)];
+				assert(stack_top < STACK_SIZE);
+				mask &= mask - 1;
+			}
+		}
+		else
+		{
+			// Leaf node.  Intersect triangles.
+			const size_t block_offset = ((uint32)cur & 0x7FFFFFFF) >> 4;
+			const size_t num_blocks = (uint32)cur & 0xF;
+			for(size_t b=block_offset; b<block_offset + num_blocks; ++b)
+			{
+				const BVH8LeafTris& block = leaf_tris[b];
+				for(int z=0; z<4; ++z)
+				{
+					if(z > 0 && block.tri_index[z] == block.tri_index[z - 1]) // Skip padding
+						break;
+					BVH::intersectSphereAgainstTri(ray_ws, to_world, radius_ws,
+						Vec4f(block.v0_x[z], block.v0_y[z], block.v0_z[z], 0.f), // W-coord should be 1, but can leave as zero due to using mul3Point().
+						Vec4f(block.e1_x[z], block.e1_y[z], block.e1_z[z], 0.f),
+						Vec4f(block.e2_x[z], block.e2_y[z], block.e2_z[z], 0.f),
+						hit_pos_ws_out, hit_normal_ws_out, point_in_tri_out);
+				}
+			}
+		}
+	}
+
+	return (ray_ws.maxT() < ray_ws_.maxT()) ? ray_ws.maxT() : -1.f;
+}
+
+
+void BVH8::appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_object, const Matrix4f& to_world, std::vector<Vec4f>& points_ws_in_out) const
+{
+	const js::AABBox sphere_aabb_ws(sphere_pos_ws - Vec4f(radius_ws, radius_ws, radius_ws, 0), sphere_pos_ws + Vec4f(radius_ws, radius_ws, radius_ws, 0));
+	const js::AABBox sphere_aabb_os = sphere_aabb_ws.transformedAABBFast(to_object);
+
+	int stack[STACK_SIZE];
+	int stack_top = 0;
+	stack[0] = root_node_index; // Push root node onto stack
+
+	while(stack_top >= 0) // While still one or more nodes on the stack:
+	{
+		const int cur = stack[stack_top--]; // Pop node off top of stack.
+
+		if(cur >= 0) // If this is an interior node, push overlapping children onto the stack.
+		{
+			const BVH8Node& node = nodes[cur];
+			int mask = getOverlappingChildren(node, sphere_aabb_os);
+			while(mask != 0)
+			{
+				stack[++stack_top] = node.child[BitUtils::lowestSetBitIndex((uint32)mask)];
+				assert(stack_top < STACK_SIZE);
+				mask &= mask - 1;
+			}
+		}
+		else
+		{
+			// Leaf node.  Intersect triangles.
+			const size_t block_offset = ((uint32)cur & 0x7FFFFFFF) >> 4;
+			const size_t num_blocks = (uint32)cur & 0xF;
+			for(size_t b=block_offset; b<block_offset + num_blocks; ++b)
+			{
+				const BVH8LeafTris& block = leaf_tris[b];
+				for(int z=0; z<4; ++z)
+				{
+					if(z > 0 && block.tri_index[z] == block.tri_index[z - 1]) // Skip padding
+						break;
+					BVH::appendCollPointsForTri(sphere_pos_ws, radius_ws, to_world,
+						Vec4f(block.v0_x[z], block.v0_y[z], block.v0_z[z], 0.f),
+						Vec4f(block.e1_x[z], block.e1_y[z], block.e1_z[z], 0.f),
+						Vec4f(block.e2_x[z], block.e2_y[z], block.e2_z[z], 0.f),
+						points_ws_in_out);
+				}
+			}
+		}
+	}
+}
+
+
+const js::AABBox& BVH8::getAABBox() const
+{
+	return root_aabb;
+}
+
+
+size_t BVH8::getTotalMemUsage() const
+{
+	return sizeof(root_aabb) + nodes.capacitySizeBytes() + leaf_tris.capacitySizeBytes();
+}
+
+
+} // end namespace js
+
+
+#if BUILD_TESTS
+
+
+#include "../utils/TestUtils.h"
+#include "../maths/PCG32.h"
+#include "../utils/StandardPrintOutput.h"
+#include "../utils/TaskManager.h"
+#include "../utils/ShouldCancelCallback.h"
+
+
+// Makes a mesh of num_tris random small triangles in the unit cube.
+static void makeRandomMesh(RayMesh& raymesh, int num_tris, PCG32& rng)
+{
+	for(int i=0; i<num_tris; ++i)
+	{
+		const Vec3f p(rng.unitRandom(), rng.unitRandom(), rng.unitRandom());
+		const unsigned int v_start = (unsigned int)raymesh.getNumVerts();
+		raymesh.addVertex(p);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.05f);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.05f);
+		const unsigned int vertex_indices[] = { v_start, v_start + 1, v_start + 2 };
+		const unsigned int uv_indices[] = { 0, 0, 0 };
+		raymesh.addTriangle(vertex_indices, uv_indices, 0);
+	}
+}
+
+
+static const Ray makeRandomRay(PCG32& rng)
+{
+	return Ray(
+		Vec4f(-0.5f + rng.unitRandom() * 2.f, -0.5f + rng.unitRandom() * 2.f, -0.5f + rng.unitRandom() * 2.f, 1.f),
+		normalise(Vec4f(-1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, 0)),
+		0.f, // min_t
+		1.0e20f // max_t
+	);
+}
+
+
+// Checks that BVH8 gives the same results as BVH for the given mesh.
+static void testAgainstBVH(RayMesh& raymesh, int num_rays)
+{
+	glare::TaskManager task_manager;
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+
+	js::BVH bvh(&raymesh);
+	bvh.build(print_output, should_cancel_callback, task_manager);
+
+	js::BVH8 bvh8(&raymesh);
+	bvh8.build(print_output, should_cancel_callback, task_manager);
+
+	testAssert(bvh8.getAABBox() == bvh.getAABBox());
+
+	PCG32 rng(1);
+	for(int i=0; i<num_rays; ++i)
+	{
+		const Ray ray = makeRandomRay(rng);
+
+		HitInfo ref_hitinfo;
+		const float ref_dist = bvh.traceRay(ray, ref_hitinfo);
+
+		for(int use_avx2=0; use_avx2<2; ++use_avx2)
+		{
+			if(use_avx2 && !js::BVH8::isAVX2Supported())
+				continue;
+			bvh8.setUseAVX2(use_avx2 != 0);
+
+			HitInfo hitinfo;
+			const float dist = bvh8.traceRay(ray, hitinfo);
+			testAssert(dist == ref_dist);
+			if(ref_dist >= 0)
+			{
+				testAssert(hitinfo.sub_elem_index == ref_hitinfo.sub_elem_index);
+				testEpsEqual(hitinfo.sub_elem_coords, ref_hitinfo.sub_elem_coords);
+			}
+		}
+	}
+
+	// Test sphere tracing and collision points
+	const Matrix4f to_world = Matrix4f::translationMatrix(1, 2, 3);
+	Matrix4f to_object;
+	to_world.getInverseForAffine3Matrix(to_object);
+	for(int i=0; i<num_rays / 10; ++i)
+	{
+		const Ray ray_os = makeRandomRay(rng);
+		const Ray ray_ws(to_world * ray_os.startPos(), ray_os.unitDir(), 0.f, 2.f);
+		const float radius_ws = 0.02f;
+
+		Vec4f ref_hit_pos, ref_hit_normal, hit_pos, hit_normal;
+		bool ref_point_in_tri = false, point_in_tri = false;
+		const float ref_dist = bvh.traceSphere(ray_ws, to_object, to_world, radius_ws, ref_hit_pos, ref_hit_normal, ref_point_in_tri);
+		const float dist = bvh8.traceSphere(ray_ws, to_object, to_world, radius_ws, hit_pos, hit_normal, point_in_tri);
+		testAssert(dist == ref_dist);
+		if(ref_dist > 0) // If dist is 0, several triangles may tie, and which one is returned depends on traversal order.
+			testAssert(point_in_tri == ref_point_in_tri);
+
+		std::vector<Vec4f> ref_points, points;
+		bvh.appendCollPoints(ray_ws.startPos(), 0.1f, to_object, to_world, ref_points);
+		bvh8.appendCollPoints(ray_ws.startPos(), 0.1f, to_object, to_world, points);
+		testAssert(points.size() == ref_points.size());
+	}
+}
+
+
+static void testTracingSpeed(RayMesh& raymesh)
+{
+	glare::TaskManager task_manager;
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+
+	js::BVH bvh(&raymesh);
+	bvh.build(print_output, should_cancel_callback, task_manager);
+
+	js::BVH8 bvh8(&raymesh);
+	bvh8.build(print_output, should_cancel_callback, task_manager);
+
+	const int N = 100000;
+	std::vector<Ray> rays;
+	PCG32 rng(1);
+	for(int i=0; i<N; ++i)
+		rays.push_back(makeRandomRay(rng));
+
+	for(int tree=0; tree<3; ++tree)
+	{
+		if(tree == 2 && !js::BVH8::isAVX2Supported())
+			continue;
+		bvh8.setUseAVX2(tree == 2);
+
+		Timer timer;
+		int num_hit = 0;
+		for(int i=0; i<N; ++i)
+		{
+			HitInfo hitinfo;
+			const float dist = (tree == 0) ? bvh.traceRay(rays[i], hitinfo) : bvh8.traceRay(rays[i], hitinfo);
+			if(dist >= 0)
+				num_hit++;
+		}
+		const char* names[] = { "BVH", "BVH8 (SSE)", "BVH8 (AVX2)" };
+		conPrint(std::string(names[tree]) + ": frac rays hit: " + toString((double)num_hit / N) + ", tracing speed: " + doubleToStringNSigFigs(N / timer.elapsed(), 4) + " rays/s");
+	}
+
+	conPrint("BVH mem usage: " + getNiceByteSize(bvh.getTotalMemUsage()) + ", BVH8 mem usage: " + getNiceByteSize(bvh8.getTotalMemUsage()));
+}
+
+
+void js::BVH8::test()
+{
+	conPrint("js::BVH8::test()");
+
+	conPrint("AVX2 supported: " + boolToString(isAVX2Supported()));
+
+	// Test with a single triangle, where the root node is a leaf.
+	{
+		PCG32 rng(1);
+		RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+		makeRandomMesh(raymesh, 1, rng);
+		testAgainstBVH(raymesh, 1000);
+	}
+
+	// Test with a few triangles, where leaves need padding.
+	for(int num_tris=2; num_tris<40; num_tris += 3)
+	{
+		PCG32 rng(num_tris);
+		RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+		makeRandomMesh(raymesh, num_tris, rng);
+		testAgainstBVH(raymesh, 1000);
+	}
+
+	{
+		PCG32 rng(1);
+		RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+		makeRandomMesh(raymesh, 20000, rng);
+		testAgainstBVH(raymesh, 10000);
+
+		testTracingSpeed(raymesh);
+	}
+
+	conPrint("js::BVH8::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,118 @@
+/*=====================================================================
+BVH8.h
+------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "jscol_Tree.h"
+#include "jscol_aabbox.h"
+#include "../maths/vec3.h"
+#include "../utils/MemAlloc.h"
+#include "../utils/Vector.h"
+
+
+class RayMesh;
+
+
+namespace js
+{
+
+
+// 8-wide node.  Child bounds are stored in SoA form so they can be loaded directly into 8-wide AVX registers.
+// The max bounds for each axis directly follow the min bounds, so the near and far planes for a ray can be selected with an offset based on the ray direction sign.
+// Unused child slots have empty bounds (min = +inf, max = -inf), so are never hit.
+class BVH8Node
+{
+public:
+	float min_x[8];
+	float max_x[8];
+	float min_y[8];
+	float max_y[8];
+	float min_z[8];
+	float max_z[8];
+
+	int32 child[8]; // bit 31 (sign bit): leaf.  If interior, bits 0...30 are the child node index.  If leaf, bits 4...30 are the index of the first leaf triangle block, bits 0...3 are the number of blocks.
+};
+
+
+// 4 triangles stored in SoA form, for intersecting a ray against all 4 at once.
+// Leaves with a number of triangles that is not a multiple of 4 are padded with copies of the last triangle.
+class BVH8LeafTris
+{
+public:
+	float v0_x[4];
+	float v0_y[4];
+	float v0_z[4];
+	float e1_x[4]; // e1 = v1 - v0
+	float e1_y[4];
+	float e1_z[4];
+	float e2_x[4]; // e2 = v2 - v0
+	float e2_y[4];
+	float e2_z[4];
+	uint32 tri_index[4];
+};
+
+
+/*=====================================================================
+BVH8
+----
+Triangle mesh acceleration structure with 8-wide nodes.
+
+Built by collapsing the binary tree from BinningBVHBuilder: each node
+repeatedly replaces the interior child with the largest surface area with
+that child's two children, until it has 8 children.
+The resulting tree is about a third of the depth of the binary tree, so
+fewer dependent node fetches are needed per ray.
+
+Leaf triangles are copied into BVH8LeafTris blocks, so tracing does not
+need to fetch vertices through the RayMesh.
+
+Traversal tests all 8 child boxes at once with AVX2 when the CPU supports it
+(checked at runtime), otherwise with two SSE 4-wide tests.
+=====================================================================*/
+class BVH8 : public Tree
+{
+public:
+	GLARE_ALIGNED_16_NEW_DELETE
+
+	BVH8(const RayMesh* const raymesh);
+	virtual ~BVH8();
+
+	// Throws glare::CancelledException if cancelled.
+	virtual void build(PrintOutput& print_output, ShouldCancelCallback& should_cancel_callback, glare::TaskManager& task_manager); // throws glare::Exception
+
+	virtual DistType traceRay(const Ray& ray, HitInfo& hitinfo_out) const;
+	virtual DistType traceSphere(const Ray& ray_ws, const Matrix4f& to_object, const Matrix4f& to_world, float radius_ws, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const;
+	virtual void appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_object, const Matrix4f& to_world, std::vector<Vec4f>& points_ws_in_out) const;
+	virtual const js::AABBox& getAABBox() const;
+
+	virtual void printStats() const {}
+	virtual void printTraceStats() const {}
+	virtual size_t getTotalMemUsage() const;
+
+	// Used for testing the SSE traversal on CPUs that support AVX2.
+	void setUseAVX2(bool use_avx2_) { use_avx2 = use_avx2_; }
+	bool usingAVX2() const { return use_avx2; }
+
+	static bool isAVX2Supported();
+
+	static void test();
+
+private:
+	DistType traceRaySSE(const Ray& ray, HitInfo& hitinfo_out) const;
+	DistType traceRayAVX2(const Ray& ray, HitInfo& hitinfo_out) const;
+	int makeLeaf(const js::Vector<uint32, 16>& result_ob_indices, int begin, int end);
+	int getOverlappingChildren(const BVH8Node& node, const js::AABBox& aabb) const;
+
+	AABBox root_aabb; // AABB of whole thing
+	js::Vector<BVH8Node, 64> nodes; // Nodes of the tree.
+	js::Vector<BVH8LeafTris, 64> leaf_tris;
+	const RayMesh* const raymesh;
+	int32 root_node_index;
+	bool use_avx2;
+};
+
+
+} //end namespace js
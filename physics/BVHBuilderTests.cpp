@@ -11,8 +11,13 @@ Generated at 2015-09-28 16:25:21 +0100
 #include "NonBinningBVHBuilder.h"
 #include "BinningBVHBuilder.h"
 #include "SBVHBuilder.h"
+#include "MortonBVHBuilder.h"
 #include "EmbreeBVHBuilder.h"
+#include "BVHBuilderUtils.h"
+#include "BVH.h"
+#include "QuantizedBVH.h"
 #include "jscol_aabbox.h"
+#include "../simpleraytracer/raymesh.h"
 #include "../utils/TestUtils.h"
 #include "../maths/PCG32.h"
 #include "../utils/ShouldCancelCallback.h"
@@ -101,6 +106,272 @@ static void buildBuilders(const js::Vector<js::AABBox, 16>& aabbs, int num_objec
 		builder->new_task_num_ob_threshold = 32;
 		builders.push_back(builder);
 	}
+
+	for(int do_treelets=0; do_treelets<2; ++do_treelets)
+	{
+		Reference<MortonBVHBuilder> builder = new MortonBVHBuilder(1, max_num_objects_per_leaf, /*max_depth=*/60, 4.0f,
+			num_objects // num objects
+		);
+
+		for(size_t z=0; z<tris.size(); ++z)
+			builder->setObjectAABB((int)z, aabbs[z]);
+
+		builder->do_treelet_optimisation = do_treelets != 0;
+		builders.push_back(builder);
+	}
+}
+
+
+// Compares build time and SAH cost of the LBVH builder against the binning builder.
+static void testMortonBuilderBuildTimeAndSAHCost(glare::TaskManager& task_manager, int num_objects)
+{
+	PCG32 rng(1);
+	js::Vector<js::AABBox, 16> aabbs(num_objects);
+	for(int z=0; z<num_objects; ++z)
+	{
+		const Vec4f v0(rng.unitRandom() * 0.8f, rng.unitRandom() * 0.8f, rng.unitRandom() * 0.8f, 1);
+		aabbs[z] = js::AABBox(v0, v0);
+		aabbs[z].enlargeToHoldPoint(v0 + Vec4f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom(), 0) * 0.02f);
+		aabbs[z].enlargeToHoldPoint(v0 + Vec4f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom(), 0) * 0.02f);
+	}
+
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+	const int max_num_objects_per_leaf = 31;
+	const float intersection_cost = 1.f;
+	const int NUM_ITERS = 5;
+
+	float binning_sah_cost;
+	{
+		double min_time = 1.0e100;
+		js::Vector<ResultNode, 64> result_nodes;
+		for(int q=0; q<NUM_ITERS; ++q)
+		{
+			BinningBVHBuilder builder(1, max_num_objects_per_leaf, /*max_depth=*/60, intersection_cost, num_objects);
+			for(int z=0; z<num_objects; ++z)
+				builder.setObjectAABB(z, aabbs[z]);
+
+			Timer timer;
+			builder.build(task_manager, should_cancel_callback, print_output, result_nodes);
+			min_time = myMin(min_time, timer.elapsed());
+		}
+		binning_sah_cost = BVHBuilder::getSAHCost(result_nodes, intersection_cost);
+		conPrint("BinningBVHBuilder: " + toString(num_objects) + " objects: build time: " + doubleToStringNSigFigs(min_time * 1.0e3, 4) + " ms, SAH cost: " + toString(binning_sah_cost));
+	}
+
+	float sah_cost_no_treelets = 0;
+	for(int do_treelets=0; do_treelets<2; ++do_treelets)
+	{
+		double min_time = 1.0e100;
+		js::Vector<ResultNode, 64> result_nodes;
+		for(int q=0; q<NUM_ITERS; ++q)
+		{
+			MortonBVHBuilder builder(1, max_num_objects_per_leaf, /*max_depth=*/60, intersection_cost, num_objects);
+			for(int z=0; z<num_objects; ++z)
+				builder.setObjectAABB(z, aabbs[z]);
+			builder.do_treelet_optimisation = do_treelets != 0;
+
+			Timer timer;
+			builder.build(task_manager, should_cancel_callback, print_output, result_nodes);
+			const double elapsed = timer.elapsed();
+			if(elapsed < min_time)
+			{
+				min_time = elapsed;
+				if(q == NUM_ITERS - 1 || num_objects >= 1000000)
+					conPrint("    morton codes: " + doubleToStringNSigFigs(builder.morton_code_time * 1.0e3, 3) + " ms, sort: " + doubleToStringNSigFigs(builder.sort_time * 1.0e3, 3) + 
+						" ms, hierarchy: " + doubleToStringNSigFigs(builder.hierarchy_time * 1.0e3, 3) + " ms, bottom-up: " + doubleToStringNSigFigs(builder.bottom_up_time * 1.0e3, 3) + 
+						" ms, emit: " + doubleToStringNSigFigs(builder.emit_time * 1.0e3, 3) + " ms");
+			}
+
+			BVHBuilderTestUtils::testResultsValid(builder.getResultObjectIndices(), result_nodes, num_objects, /*duplicate_prims_allowed=*/false);
+			testAssert(builder.getMaxLeafDepth() <= 60);
+		}
+
+		const float sah_cost = BVHBuilder::getSAHCost(result_nodes, intersection_cost);
+		conPrint("MortonBVHBuilder" + std::string(do_treelets ? " (treelets)" : "") + ": " + toString(num_objects) + " objects: build time: " + doubleToStringNSigFigs(min_time * 1.0e3, 4) + 
+			" ms, SAH cost: " + toString(sah_cost) + " (" + doubleToStringNSigFigs(sah_cost / binning_sah_cost, 3) + "x binning)");
+
+		testAssert(sah_cost < binning_sah_cost * 2.f);
+		if(do_treelets)
+			testAssert(sah_cost <= sah_cost_no_treelets * 1.001f);
+		else
+			sah_cost_no_treelets = sah_cost;
+	}
+}
+
+
+// Times each phase of a BVH build on a random triangle mesh: triangle AABB setup, the builder itself, node conversion and leaf index copying.
+// Also checks the parallel setup gives the same results as serial setup with setObjectAABB().
+static void testBVHBuildPhaseTimes(glare::TaskManager& task_manager, int num_tris)
+{
+	PCG32 rng(1);
+	RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+	for(int i=0; i<num_tris; ++i)
+	{
+		const Vec3f p(rng.unitRandom(), rng.unitRandom(), rng.unitRandom());
+		const unsigned int v = raymesh.getNumVerts();
+		raymesh.addVertex(p);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.01f);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.01f);
+		const unsigned int vertex_indices[] = { v, v + 1, v + 2 };
+		const unsigned int uv_indices[] = { 0, 0, 0 };
+		raymesh.addTriangle(vertex_indices, uv_indices, 0);
+	}
+
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+
+	// Serial setup, as a reference
+	BinningBVHBuilder ref_builder(1, 31, 64, 1.f, num_tris);
+	Timer timer;
+	for(int i=0; i<num_tris; ++i)
+		ref_builder.setObjectAABB(i, BVHBuilderUtils::triAABB(raymesh.getVertices(), raymesh.getTriangles()[i]));
+	const double serial_setup_time = timer.elapsed();
+
+	js::Vector<ResultNode, 64> ref_result_nodes;
+	ref_builder.build(task_manager, should_cancel_callback, print_output, ref_result_nodes);
+
+	BinningBVHBuilder builder(1, 31, 64, 1.f, num_tris);
+	timer.reset();
+	BVHBuilderUtils::setTriAABBs(builder, raymesh, task_manager);
+	const double setup_time = timer.elapsed();
+
+	timer.reset();
+	js::Vector<ResultNode, 64> result_nodes;
+	builder.build(task_manager, should_cancel_callback, print_output, result_nodes);
+	const double build_time = timer.elapsed();
+
+	timer.reset();
+	js::Vector<js::BVHNode, 64> nodes;
+	const int32 root_node_index = BVHBuilderUtils::convertResultNodes<js::BVHNode, 5>(result_nodes, nodes, task_manager);
+	const double convert_time = timer.elapsed();
+
+	timer.reset();
+	js::Vector<uint32, 64> leaf_tri_indices;
+	BVHBuilderUtils::copyLeafObIndices(builder.getResultObjectIndices(), leaf_tri_indices, task_manager);
+	const double copy_leaf_indices_time = timer.elapsed();
+
+	conPrint("BVH build phases, " + toString(num_tris) + " tris: tri AABBs: " + doubleToStringNSigFigs(setup_time * 1.0e3, 3) + " ms (serial: " + doubleToStringNSigFigs(serial_setup_time * 1.0e3, 3) + 
+		" ms), builder: " + doubleToStringNSigFigs(build_time * 1.0e3, 3) + " ms, node conversion: " + doubleToStringNSigFigs(convert_time * 1.0e3, 3) + 
+		" ms, leaf indices: " + doubleToStringNSigFigs(copy_leaf_indices_time * 1.0e3, 3) + " ms");
+
+	// Check the parallel setup gave the same tree as the serial setup.
+	testAssert(builder.getRootAABB() == ref_builder.getRootAABB());
+	testAssert(result_nodes.size() == ref_result_nodes.size());
+	for(size_t i=0; i<result_nodes.size(); ++i)
+	{
+		testAssert(result_nodes[i].aabb == ref_result_nodes[i].aabb);
+		testAssert(result_nodes[i].interior == ref_result_nodes[i].interior);
+		testAssert(result_nodes[i].left == ref_result_nodes[i].left);
+		testAssert(result_nodes[i].right == ref_result_nodes[i].right);
+	}
+	testAssert(builder.getResultObjectIndices().size() == ref_builder.getResultObjectIndices().size());
+	for(size_t i=0; i<builder.getResultObjectIndices().size(); ++i)
+		testAssert(builder.getResultObjectIndices()[i] == ref_builder.getResultObjectIndices()[i]);
+
+	// Check the converted nodes.  Each result node apart from the root is referenced exactly once by a child reference.
+	testAssert(leaf_tri_indices.size() == builder.getResultObjectIndices().size());
+	for(size_t i=0; i<leaf_tri_indices.size(); ++i)
+		testAssert(leaf_tri_indices[i] == builder.getResultObjectIndices()[i]);
+
+	size_t num_interior_result_nodes = 0;
+	for(size_t i=0; i<result_nodes.size(); ++i)
+		num_interior_result_nodes += result_nodes[i].interior ? 1 : 0;
+	testAssert(nodes.size() == num_interior_result_nodes);
+
+	if(result_nodes.size() > 1)
+	{
+		testAssert(root_node_index == 0);
+		size_t num_leaf_tris = 0;
+		std::vector<int> ref_counts(nodes.size(), 0);
+		for(size_t i=0; i<nodes.size(); ++i)
+			for(int c=0; c<2; ++c)
+			{
+				if(nodes[i].child[c] < 0)
+					num_leaf_tris += nodes[i].child[c] & 31;
+				else
+					ref_counts[nodes[i].child[c]]++;
+			}
+		testAssert(num_leaf_tris == leaf_tri_indices.size());
+		testAssert(ref_counts[0] == 0);
+		for(size_t i=1; i<nodes.size(); ++i)
+			testAssert(ref_counts[i] == 1);
+	}
+}
+
+
+// Compares tracing speed and memory usage of QuantizedBVH, with 8 and 16 bit quantization, against BVH, on a random triangle mesh.
+// Also checks the trees give the same hits.
+static void testQuantizedBVHTraceSpeedAndMemory(glare::TaskManager& task_manager, int num_tris)
+{
+	PCG32 rng(1);
+	RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+	for(int i=0; i<num_tris; ++i)
+	{
+		const Vec3f p(rng.unitRandom(), rng.unitRandom(), rng.unitRandom());
+		const unsigned int v = raymesh.getNumVerts();
+		raymesh.addVertex(p);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.01f);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.01f);
+		const unsigned int vertex_indices[] = { v, v + 1, v + 2 };
+		const unsigned int uv_indices[] = { 0, 0, 0 };
+		raymesh.addTriangle(vertex_indices, uv_indices, 0);
+	}
+
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+
+	js::BVH bvh(&raymesh);
+	bvh.build(print_output, should_cancel_callback, task_manager);
+	js::QuantizedBVH<uint8> qbvh8(&raymesh);
+	qbvh8.build(print_output, should_cancel_callback, task_manager);
+	js::QuantizedBVH<uint16> qbvh16(&raymesh);
+	qbvh16.build(print_output, should_cancel_callback, task_manager);
+
+	const js::Tree* trees[] = { &bvh, &qbvh8, &qbvh16 };
+	const char* tree_names[] = { "BVH", "QuantizedBVH<uint8>", "QuantizedBVH<uint16>" };
+	const size_t node_sizes[] = { sizeof(js::BVHNode), sizeof(js::QuantizedBVHNode<uint8>), sizeof(js::QuantizedBVHNode<uint16>) };
+
+	// Incoherent rays: random origins and directions.
+	const int NUM_RAYS = 100000;
+	std::vector<Ray> rays;
+	for(int i=0; i<NUM_RAYS; ++i)
+		rays.push_back(Ray(Vec4f(-0.5f + rng.unitRandom()*2, -0.5f + rng.unitRandom()*2, -0.5f + rng.unitRandom()*2, 1),
+			normalise(Vec4f(-1 + rng.unitRandom()*2, -1 + rng.unitRandom()*2, -1 + rng.unitRandom()*2, 0)), 0.f, 1.0e20f));
+
+	std::vector<float> ref_dists(NUM_RAYS);
+	std::vector<unsigned int> ref_tri_indices(NUM_RAYS);
+	for(int t=0; t<3; ++t)
+	{
+		double trace_time = 1.0e100;
+		for(int q=0; q<3; ++q)
+		{
+			Timer timer;
+			for(int i=0; i<NUM_RAYS; ++i)
+			{
+				HitInfo hitinfo;
+				const float dist = (float)trees[t]->traceRay(rays[i], hitinfo);
+				if(t == 0)
+				{
+					ref_dists[i] = dist;
+					ref_tri_indices[i] = hitinfo.sub_elem_index;
+				}
+				else
+				{
+					testAssert(dist == ref_dists[i]);
+					if(dist >= 0)
+						testAssert(hitinfo.sub_elem_index == ref_tri_indices[i]);
+				}
+			}
+			trace_time = myMin(trace_time, timer.elapsed());
+		}
+
+		conPrint(std::string(tree_names[t]) + ", " + toString(num_tris) + " tris: node size: " + toString(node_sizes[t]) + " B, total mem usage: " + getNiceByteSize(trees[t]->getTotalMemUsage()) + 
+			", tracing speed: " + doubleToStringNSigFigs(NUM_RAYS / trace_time * 1.0e-6, 4) + " M rays/s");
+	}
+
+	testAssert(qbvh8.getTotalMemUsage() < bvh.getTotalMemUsage());
+	testAssert(qbvh16.getTotalMemUsage() < bvh.getTotalMemUsage());
 }
 
 
@@ -657,6 +928,18 @@ void test()
 
 
 	//==================== Do a stress test with a reasonably large amount of objects ====================
+	testMortonBuilderBuildTimeAndSAHCost(task_manager, 10000);
+	testMortonBuilderBuildTimeAndSAHCost(task_manager, 100000);
+
+	testBVHBuildPhaseTimes(task_manager, 1);
+	testBVHBuildPhaseTimes(task_manager, 1000);
+	testBVHBuildPhaseTimes(task_manager, 100000);
+
+	js::QuantizedBVH<uint8>::test();
+	js::QuantizedBVH<uint16>::test();
+	testQuantizedBVHTraceSpeedAndMemory(task_manager, 100000);
+
+
 	{
 		conPrint("StressTest...");
 		testBVHBuildersWithNRandomObjects(task_manager,
@@ -0,0 +1,239 @@
+/*=====================================================================
+BVHBuilderUtils.h
+-----------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "BVHBuilder.h"
+#include "jscol_aabbox.h"
+#include "../simpleraytracer/raymesh.h"
+#include "../utils/TaskManager.h"
+#include "../utils/Vector.h"
+#include "../utils/Platform.h"
+#include <cstring>
+
+
+/*=====================================================================
+BVHBuilderUtils
+---------------
+Parallel setup and finalisation code shared by the triangle mesh trees (BVH, SmallBVH).
+
+The front end computes the triangle AABBs and sets them in the builder.
+The back end converts the builder result nodes into 2-wide tree nodes, and copies the leaf object indices.
+
+Work is split into fixed-size blocks, with per-block reductions that are then combined serially,
+so results don't depend on the number of threads or on scheduling.
+=====================================================================*/
+namespace BVHBuilderUtils
+{
+
+
+static const size_t PARALLEL_BLOCK_SIZE = 1 << 14; // Number of objects or nodes processed per block.
+
+
+inline size_t numBlocks(size_t n) { return (n + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE; }
+
+
+GLARE_STRONG_INLINE const js::AABBox triAABB(const RayMesh::VertexVectorType& verts, const RayMeshTriangle& tri)
+{
+	const Vec4f v0 = setWToOne(loadUnalignedVec4f(&verts[tri.vertex_indices[0]].pos.x));
+	const Vec4f v1 = setWToOne(loadUnalignedVec4f(&verts[tri.vertex_indices[1]].pos.x));
+	const Vec4f v2 = setWToOne(loadUnalignedVec4f(&verts[tri.vertex_indices[2]].pos.x));
+	return js::AABBox(min(v0, min(v1, v2)), max(v0, max(v1, v2)));
+}
+
+
+/*
+Computes the AABB of each triangle in the mesh, and sets it as the object AABB in the builder.
+The root AABB and root centroid AABB are computed with per-block reductions, then set in the builder.
+
+BuilderType must provide setObjectAABBNoRootUpdate() and setRootAABBs().
+*/
+template <class BuilderType>
+void setTriAABBs(BuilderType& builder, const RayMesh& mesh, glare::TaskManager& task_manager)
+{
+	const RayMesh::TriangleVectorType& tris = mesh.getTriangles();
+	const RayMesh::VertexVectorType& verts = mesh.getVertices();
+	const size_t num_tris = tris.size();
+	const size_t num_blocks = numBlocks(num_tris);
+
+	js::Vector<js::AABBox, 16> block_aabbs(num_blocks);
+	js::Vector<js::AABBox, 16> block_centroid_aabbs(num_blocks);
+
+	task_manager.runParallelForDynamic([&](size_t block_begin, size_t block_end, size_t /*thread_index*/)
+	{
+		for(size_t b=block_begin; b<block_end; ++b)
+		{
+			const size_t begin = b * PARALLEL_BLOCK_SIZE;
+			const size_t end = myMin(begin + PARALLEL_BLOCK_SIZE, num_tris);
+
+			js::AABBox aabb = js::AABBox::emptyAABBox();
+			js::AABBox centroid_aabb = js::AABBox::emptyAABBox();
+			for(size_t i=begin; i<end; ++i)
+			{
+				const js::AABBox tri_aabb = triAABB(verts, tris[i]);
+				aabb.enlargeToHoldAABBox(tri_aabb);
+				centroid_aabb.enlargeToHoldPoint(tri_aabb.centroid());
+
+				builder.setObjectAABBNoRootUpdate((int)i, tri_aabb);
+			}
+
+			block_aabbs[b] = aabb;
+			block_centroid_aabbs[b] = centroid_aabb;
+		}
+	}, /*begin=*/0, /*end=*/num_blocks, /*grain_size=*/1);
+
+	js::AABBox root_aabb = js::AABBox::emptyAABBox();
+	js::AABBox root_centroid_aabb = js::AABBox::emptyAABBox();
+	for(size_t b=0; b<num_blocks; ++b)
+	{
+		root_aabb.enlargeToHoldAABBox(block_aabbs[b]);
+		root_centroid_aabb.enlargeToHoldAABBox(block_centroid_aabbs[b]);
+	}
+
+	builder.setRootAABBs(root_aabb, root_centroid_aabb);
+}
+
+
+/*
+Converts result_nodes to 2-wide nodes, which are written to nodes_out.
+Indices change, since leaf nodes are not stored explicitly.  Rather leaf geometry references are put into the child references of the node above,
+as 0x80000000 | num | (offset << NUM_LEAF_BITS).
+
+Returns the encoded root reference: 0 if the root is an interior node, or a leaf reference if the root is a leaf.
+
+The new interior node indices are computed with a parallel count per block of result nodes, a serial prefix sum over blocks, then a parallel write.
+NodeType must have Vec4f x, y, z members and an int32 child[2] member.
+*/
+template <class NodeType, int NUM_LEAF_BITS>
+int32 convertResultNodes(const js::Vector<ResultNode, 64>& result_nodes, js::Vector<NodeType, 64>& nodes_out, glare::TaskManager& task_manager)
+{
+	if(result_nodes.size() == 1)
+	{
+		// Special case where the root node is a leaf.
+		const int num = result_nodes[0].right - result_nodes[0].left;
+		const int offset = result_nodes[0].left;
+		assert(num < (1 << NUM_LEAF_BITS));
+		nodes_out.clear();
+		return (int32)(0x80000000 | num | (offset << NUM_LEAF_BITS));
+	}
+
+	const size_t result_nodes_size = result_nodes.size();
+	const size_t num_blocks = numBlocks(result_nodes_size);
+
+	// Count interior nodes in each block
+	js::Vector<int, 16> block_offsets(num_blocks + 1);
+	task_manager.runParallelForDynamic([&](size_t block_begin, size_t block_end, size_t /*thread_index*/)
+	{
+		for(size_t b=block_begin; b<block_end; ++b)
+		{
+			const size_t end = myMin((b + 1) * PARALLEL_BLOCK_SIZE, result_nodes_size);
+			int count = 0;
+			for(size_t i=b * PARALLEL_BLOCK_SIZE; i<end; ++i)
+				count += result_nodes[i].interior ? 1 : 0;
+			block_offsets[b] = count;
+		}
+	}, /*begin=*/0, /*end=*/num_blocks, /*grain_size=*/1);
+
+	// Exclusive prefix sum over blocks
+	int sum = 0;
+	for(size_t b=0; b<num_blocks; ++b)
+	{
+		const int count = block_offsets[b];
+		block_offsets[b] = sum;
+		sum += count;
+	}
+	block_offsets[num_blocks] = sum;
+
+	const int new_num_nodes = sum;
+
+	// For each old node, store the new index.
+	js::Vector<int, 16> new_node_indices(result_nodes_size);
+	task_manager.runParallelForDynamic([&](size_t block_begin, size_t block_end, size_t /*thread_index*/)
+	{
+		for(size_t b=block_begin; b<block_end; ++b)
+		{
+			const size_t end = myMin((b + 1) * PARALLEL_BLOCK_SIZE, result_nodes_size);
+			int new_index = block_offsets[b];
+			for(size_t i=b * PARALLEL_BLOCK_SIZE; i<end; ++i)
+				if(result_nodes[i].interior)
+					new_node_indices[i] = new_index++;
+		}
+	}, /*begin=*/0, /*end=*/num_blocks, /*grain_size=*/1);
+
+	nodes_out.resizeNoCopy(new_num_nodes);
+
+	task_manager.runParallelForDynamic([&](size_t block_begin, size_t block_end, size_t /*thread_index*/)
+	{
+		for(size_t i=block_begin; i<block_end; ++i)
+		{
+			const ResultNode& result_node = result_nodes[i];
+			if(!result_node.interior)
+				continue;
+
+			NodeType& node = nodes_out[new_node_indices[i]];
+
+			const ResultNode& result_left_child  = result_nodes[result_node.left];
+			const ResultNode& result_right_child = result_nodes[result_node.right];
+
+			Vec4f mins = shuffle<0, 1, 0, 1>(result_left_child.aabb.min_, result_right_child.aabb.min_); // (left_min_x, left_min_y, right_min_x, right_min_y)
+			Vec4f maxs = shuffle<0, 1, 0, 1>(result_left_child.aabb.max_, result_right_child.aabb.max_); // (left_max_x, left_max_y, right_max_x, right_max_y)
+
+			node.x = shuffle<0, 2, 0, 2>(mins, maxs); // (left_min_x, right_min_x, left_max_x, right_max_x)
+			node.y = shuffle<1, 3, 1, 3>(mins, maxs); // (left_min_y, right_min_y, left_max_y, right_max_y)
+
+			mins = shuffle<2, 2, 2, 2>(result_left_child.aabb.min_, result_right_child.aabb.min_); // (left_min_z, left_min_z, right_min_z, right_min_z)
+			maxs = shuffle<2, 2, 2, 2>(result_left_child.aabb.max_, result_right_child.aabb.max_); // (left_max_z, left_max_z, right_max_z, right_max_z)
+
+			node.z = shuffle<0, 2, 0, 2>(mins, maxs); // (left_min_z, right_min_z, left_max_z, right_max_z)
+
+			assert(node.x[0] == result_left_child.aabb.min_[0] && node.x[1] == result_right_child.aabb.min_[0] && node.x[2] == result_left_child.aabb.max_[0] && node.x[3] == result_right_child.aabb.max_[0]);
+			assert(node.y[0] == result_left_child.aabb.min_[1] && node.y[1] == result_right_child.aabb.min_[1] && node.y[2] == result_left_child.aabb.max_[1] && node.y[3] == result_right_child.aabb.max_[1]);
+			assert(node.z[0] == result_left_child.aabb.min_[2] && node.z[1] == result_right_child.aabb.min_[2] && node.z[2] == result_left_child.aabb.max_[2] && node.z[3] == result_right_child.aabb.max_[2]);
+
+			// Set node.child[0] and node.child[1]
+			for(int c=0; c<2; ++c)
+			{
+				const int result_child_index = (c == 0) ? result_node.left : result_node.right;
+				const ResultNode& result_child = result_nodes[result_child_index];
+				if(result_child.interior)
+				{
+					node.child[c] = new_node_indices[result_child_index];
+					assert(node.child[c] >= 0 && node.child[c] < new_num_nodes);
+				}
+				else
+				{
+					// Number of objects is in lower NUM_LEAF_BITS bits.  Set sign bit to 1.
+					const int num = result_child.right - result_child.left;
+					const int offset = result_child.left;
+					assert(num < (1 << NUM_LEAF_BITS));
+					node.child[c] = (int32)(0x80000000 | num | (offset << NUM_LEAF_BITS));
+				}
+			}
+		}
+	}, /*begin=*/0, /*end=*/result_nodes_size, /*grain_size=*/PARALLEL_BLOCK_SIZE);
+
+	return 0;
+}
+
+
+// Copies the builder result object indices to leaf_indices_out, in parallel.
+template <class IndexType>
+void copyLeafObIndices(const BVHBuilder::ResultObIndicesVec& result_ob_indices, js::Vector<IndexType, 64>& leaf_indices_out, glare::TaskManager& task_manager)
+{
+	static_assert(sizeof(IndexType) == sizeof(uint32), "sizeof(IndexType) == sizeof(uint32)");
+
+	const size_t num = result_ob_indices.size();
+	leaf_indices_out.resizeNoCopy(num);
+
+	task_manager.runParallelForDynamic([&](size_t begin, size_t end, size_t /*thread_index*/)
+	{
+		if(end > begin)
+			std::memcpy(&leaf_indices_out[begin], &result_ob_indices[begin], (end - begin) * sizeof(IndexType));
+	}, /*begin=*/0, /*end=*/num, /*grain_size=*/PARALLEL_BLOCK_SIZE * 4);
+}
+
+
+} // end namespace BVHBuilderUtils
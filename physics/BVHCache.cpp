@@ -0,0 +1,360 @@
+/*=====================================================================
+BVHCache.cpp
+------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#include "BVHCache.h"
+
+
+#include "../simpleraytracer/raymesh.h"
+#include "../utils/FileUtils.h"
+#include "../utils/Exception.h"
+#include "../utils/StringUtils.h"
+#include "../utils/IncludeXXHash.h"
+#include <cstring>
+
+
+namespace BVHCache
+{
+
+
+static const uint32 MAGIC_NUMBER = 0x48564247; // "GBVH" in little-endian byte order.
+static const uint32 FORMAT_VERSION = 1; // Increment when the file format or any cached node layout changes.
+static const size_t ARRAY_ALIGNMENT = 64;
+
+
+static inline size_t roundUpToAlignment(size_t x)
+{
+	return (x + ARRAY_ALIGNMENT - 1) & ~(ARRAY_ALIGNMENT - 1);
+}
+
+
+static uint64 computePayloadHash(const void* nodes, size_t nodes_size_B, const void* leaf_data, size_t leaf_data_size_B)
+{
+	return XXH64(leaf_data, leaf_data_size_B, XXH64(nodes, nodes_size_B, 1));
+}
+
+
+uint64 computeMeshHash(const RayMesh& mesh)
+{
+	const RayMesh::VertexVectorType& verts = mesh.getVertices();
+	const RayMesh::TriangleVectorType& tris = mesh.getTriangles();
+
+	XXH64_state_t* state = XXH64_createState();
+	XXH64_reset(state, 1);
+
+	// Hash only the fields that the trees depend on, in batches, so that we don't hash struct padding or other vertex and triangle data.
+	const size_t BATCH_SIZE = 1024;
+	uint32 batch[BATCH_SIZE * 3];
+
+	const uint64 counts[2] = { (uint64)verts.size(), (uint64)tris.size() };
+	XXH64_update(state, counts, sizeof(counts));
+
+	for(size_t begin=0; begin<verts.size(); begin += BATCH_SIZE)
+	{
+		const size_t end = myMin(begin + BATCH_SIZE, verts.size());
+		for(size_t i=begin; i<end; ++i)
+			std::memcpy(&batch[(i - begin) * 3], &verts[i].pos.x, sizeof(float) * 3);
+		XXH64_update(state, batch, sizeof(uint32) * 3 * (end - begin));
+	}
+
+	for(size_t begin=0; begin<tris.size(); begin += BATCH_SIZE)
+	{
+		const size_t end = myMin(begin + BATCH_SIZE, tris.size());
+		for(size_t i=begin; i<end; ++i)
+			for(int c=0; c<3; ++c)
+				batch[(i - begin) * 3 + c] = tris[i].vertex_indices[c];
+		XXH64_update(state, batch, sizeof(uint32) * 3 * (end - begin));
+	}
+
+	const uint64 hash = XXH64_digest(state);
+	XXH64_freeState(state);
+	return hash;
+}
+
+
+const std::string cacheFilePath(const std::string& cache_dir, uint64 mesh_hash, TreeType tree_type)
+{
+	return FileUtils::join(cache_dir, toHexString(mesh_hash) + "_" + toString((int)tree_type) + ".bvhcache");
+}
+
+
+void writeCacheFile(const std::string& cache_dir, uint64 mesh_hash, uint32 num_tris, TreeType tree_type, size_t node_size, size_t leaf_elem_size, const CachedTreeData& data)
+{
+	const size_t nodes_size_B = node_size * data.num_nodes;
+	const size_t leaf_data_size_B = leaf_elem_size * data.num_leaf_elems;
+
+	BVHCacheFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic_number = MAGIC_NUMBER;
+	header.format_version = FORMAT_VERSION;
+	header.tree_type = (uint32)tree_type;
+	header.num_tris = num_tris;
+	header.mesh_hash = mesh_hash;
+	header.payload_hash = computePayloadHash(data.nodes, nodes_size_B, data.leaf_data, leaf_data_size_B);
+	header.node_size = (uint32)node_size;
+	header.leaf_elem_size = (uint32)leaf_elem_size;
+	header.num_nodes = data.num_nodes;
+	header.nodes_offset = roundUpToAlignment(sizeof(BVHCacheFileHeader));
+	header.num_leaf_elems = data.num_leaf_elems;
+	header.leaf_data_offset = roundUpToAlignment(header.nodes_offset + nodes_size_B);
+	header.root_node_index = data.root_node_index;
+	storeVec4fUnaligned(data.root_aabb.min_, header.root_aabb_min);
+	storeVec4fUnaligned(data.root_aabb.max_, header.root_aabb_max);
+
+	std::vector<char> buf(header.leaf_data_offset + leaf_data_size_B, 0);
+	std::memcpy(buf.data(), &header, sizeof(header));
+	if(nodes_size_B > 0)
+		std::memcpy(buf.data() + header.nodes_offset, data.nodes, nodes_size_B);
+	if(leaf_data_size_B > 0)
+		std::memcpy(buf.data() + header.leaf_data_offset, data.leaf_data, leaf_data_size_B);
+
+	try
+	{
+		FileUtils::createDirIfDoesNotExist(cache_dir);
+		FileUtils::writeEntireFileAtomically(cacheFilePath(cache_dir, mesh_hash, tree_type), buf.data(), buf.size());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception("Failed to write BVH cache file: " + e.what());
+	}
+}
+
+
+bool loadCacheFile(const std::string& cache_dir, uint64 mesh_hash, uint32 num_tris, TreeType tree_type, size_t node_size, size_t leaf_elem_size, CachedTreeData& data_out)
+{
+	const std::string path = cacheFilePath(cache_dir, mesh_hash, tree_type);
+	if(!FileUtils::fileExists(path))
+		return false;
+
+	SharedMemMappedFileRef file;
+	try
+	{
+		file = new SharedMemMappedFile(path);
+	}
+	catch(glare::Exception&)
+	{
+		return false;
+	}
+
+	const size_t file_size = file->fileSize();
+	if(file_size < sizeof(BVHCacheFileHeader))
+		return false;
+
+	const uint8* const file_data = (const uint8*)file->fileData();
+	BVHCacheFileHeader header;
+	std::memcpy(&header, file_data, sizeof(header));
+
+	if(header.magic_number != MAGIC_NUMBER ||
+		header.format_version != FORMAT_VERSION ||
+		header.tree_type != (uint32)tree_type ||
+		header.num_tris != num_tris ||
+		header.mesh_hash != mesh_hash ||
+		header.node_size != node_size ||
+		header.leaf_elem_size != leaf_elem_size)
+		return false;
+
+	// Check the arrays are aligned and lie within the file.  Check counts before multiplying to avoid overflow.
+	if(header.nodes_offset % ARRAY_ALIGNMENT != 0 || header.leaf_data_offset % ARRAY_ALIGNMENT != 0)
+		return false;
+	if(header.nodes_offset > file_size || header.num_nodes > (file_size - header.nodes_offset) / node_size)
+		return false;
+	if(header.leaf_data_offset > file_size || header.num_leaf_elems > (file_size - header.leaf_data_offset) / leaf_elem_size)
+		return false;
+	if(header.root_node_index >= 0 && (uint64)header.root_node_index >= header.num_nodes)
+		return false;
+
+	const size_t nodes_size_B = node_size * header.num_nodes;
+	const size_t leaf_data_size_B = leaf_elem_size * header.num_leaf_elems;
+	if(computePayloadHash(file_data + header.nodes_offset, nodes_size_B, file_data + header.leaf_data_offset, leaf_data_size_B) != header.payload_hash)
+		return false;
+
+	data_out.root_aabb = js::AABBox(loadUnalignedVec4f(header.root_aabb_min), loadUnalignedVec4f(header.root_aabb_max));
+	data_out.root_node_index = header.root_node_index;
+	data_out.nodes = file_data + header.nodes_offset;
+	data_out.num_nodes = header.num_nodes;
+	data_out.leaf_data = file_data + header.leaf_data_offset;
+	data_out.num_leaf_elems = header.num_leaf_elems;
+	data_out.file = file;
+	return true;
+}
+
+
+} // end namespace BVHCache
+
+
+#if BUILD_TESTS
+
+
+#include "BVH.h"
+#include "SmallBVH.h"
+#include "../simpleraytracer/ray.h"
+#include "../utils/TestUtils.h"
+#include "../utils/PlatformUtils.h"
+#include "../utils/ConPrint.h"
+#include "../utils/StandardPrintOutput.h"
+#include "../utils/TaskManager.h"
+#include "../utils/ShouldCancelCallback.h"
+#include "../maths/PCG32.h"
+
+
+static void makeRandomMesh(RayMesh& raymesh, int num_tris, PCG32& rng)
+{
+	for(int i=0; i<num_tris; ++i)
+	{
+		const Vec3f p(rng.unitRandom(), rng.unitRandom(), rng.unitRandom());
+		const unsigned int v_start = (unsigned int)raymesh.getNumVerts();
+		raymesh.addVertex(p);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.05f);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.05f);
+		const unsigned int vertex_indices[] = { v_start, v_start + 1, v_start + 2 };
+		const unsigned int uv_indices[] = { 0, 0, 0 };
+		raymesh.addTriangle(vertex_indices, uv_indices, 0);
+	}
+}
+
+
+// Checks that built_tree and loaded_tree give the same results.
+static void checkTreesTraceSame(const js::Tree& built_tree, const js::Tree& loaded_tree)
+{
+	testAssert(loaded_tree.getAABBox() == built_tree.getAABBox());
+
+	PCG32 rng(1);
+	for(int i=0; i<10000; ++i)
+	{
+		const Ray ray(
+			Vec4f(-0.5f + rng.unitRandom() * 2.f, -0.5f + rng.unitRandom() * 2.f, -0.5f + rng.unitRandom() * 2.f, 1.f),
+			normalise(Vec4f(-1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, 0)),
+			0.f, // min_t
+			1.0e20f // max_t
+		);
+
+		HitInfo ref_hitinfo, hitinfo;
+		const double ref_dist = built_tree.traceRay(ray, ref_hitinfo);
+		const double dist = loaded_tree.traceRay(ray, hitinfo);
+		testAssert(dist == ref_dist);
+		if(ref_dist >= 0)
+			testAssert(hitinfo.sub_elem_index == ref_hitinfo.sub_elem_index);
+	}
+}
+
+
+template <class TreeType>
+static void testCachingTree(RayMesh& raymesh, const std::string& cache_dir)
+{
+	glare::TaskManager task_manager;
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+
+	const uint64 mesh_hash = BVHCache::computeMeshHash(raymesh);
+
+	// Nothing cached yet
+	{
+		TreeType tree(&raymesh);
+		testAssert(!tree.loadFromCache(cache_dir, mesh_hash));
+	}
+
+	TreeType built_tree(&raymesh);
+	built_tree.build(print_output, should_cancel_callback, task_manager);
+	built_tree.writeToCache(cache_dir, mesh_hash);
+
+	{
+		TreeType loaded_tree(&raymesh);
+		testAssert(loaded_tree.loadFromCache(cache_dir, mesh_hash));
+		checkTreesTraceSame(built_tree, loaded_tree);
+
+		// A loaded tree can be written to the cache again.
+		loaded_tree.writeToCache(cache_dir, mesh_hash);
+	}
+
+	// A different mesh hash should not load the cached tree.
+	{
+		TreeType tree(&raymesh);
+		testAssert(!tree.loadFromCache(cache_dir, mesh_hash + 1));
+	}
+}
+
+
+static void testCorruptFileRejected(RayMesh& raymesh, const std::string& cache_dir)
+{
+	const uint64 mesh_hash = BVHCache::computeMeshHash(raymesh);
+	const std::string path = BVHCache::cacheFilePath(cache_dir, mesh_hash, BVHCache::TreeType_BVH);
+
+	std::string contents;
+	FileUtils::readEntireFile(path, contents);
+
+	// Flip a byte in the node data.
+	{
+		std::string corrupted = contents;
+		corrupted[corrupted.size() / 2] ^= 0x1;
+		FileUtils::writeEntireFile(path, corrupted);
+		js::BVH tree(&raymesh);
+		testAssert(!tree.loadFromCache(cache_dir, mesh_hash));
+	}
+
+	// Truncate the file.
+	for(size_t len=0; len<contents.size(); len += 1 + contents.size() / 16)
+	{
+		FileUtils::writeEntireFile(path, contents.substr(0, len));
+		js::BVH tree(&raymesh);
+		testAssert(!tree.loadFromCache(cache_dir, mesh_hash));
+	}
+
+	FileUtils::writeEntireFile(path, contents);
+	js::BVH tree(&raymesh);
+	testAssert(tree.loadFromCache(cache_dir, mesh_hash));
+}
+
+
+void BVHCache::test()
+{
+	conPrint("BVHCache::test()");
+
+	try
+	{
+		const std::string cache_dir = PlatformUtils::getTempDirPath() + "/bvh_cache_test";
+		if(FileUtils::fileExists(cache_dir))
+			FileUtils::deleteDirectoryRecursive(cache_dir);
+
+		PCG32 rng(1);
+		RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+		makeRandomMesh(raymesh, 3000, rng);
+
+		//-------------------- Test mesh hash --------------------
+		{
+			const uint64 hash = computeMeshHash(raymesh);
+			testAssert(computeMeshHash(raymesh) == hash);
+
+			RayMesh other_mesh("other_mesh", /*enable_shading_normals=*/false);
+			PCG32 other_rng(1);
+			makeRandomMesh(other_mesh, 3000, other_rng);
+			testAssert(computeMeshHash(other_mesh) == hash);
+
+			other_mesh.getVertices()[10].pos.x += 0.001f;
+			testAssert(computeMeshHash(other_mesh) != hash);
+		}
+
+		testCachingTree<js::BVH>(raymesh, cache_dir);
+		testCachingTree<js::SmallBVH>(raymesh, cache_dir);
+		testCorruptFileRejected(raymesh, cache_dir);
+
+		// Test caching a mesh with a single triangle, where the root is a leaf.
+		{
+			RayMesh small_mesh("small_mesh", /*enable_shading_normals=*/false);
+			makeRandomMesh(small_mesh, 1, rng);
+			testCachingTree<js::BVH>(small_mesh, cache_dir);
+			testCachingTree<js::SmallBVH>(small_mesh, cache_dir);
+		}
+
+		FileUtils::deleteDirectoryRecursive(cache_dir);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("BVHCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
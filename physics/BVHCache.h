@@ -0,0 +1,99 @@
+/*=====================================================================
+BVHCache.h
+----------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "jscol_aabbox.h"
+#include "../utils/Platform.h"
+#include "../utils/MemMappedFile.h"
+#include <string>
+
+
+class RayMesh;
+
+
+/*=====================================================================
+BVHCache
+--------
+On-disk cache of built triangle mesh trees (BVH, SmallBVH), so that
+meshes that have been loaded before don't need their tree rebuilt.
+
+Cache files are keyed by a hash of the mesh vertex positions and
+triangle vertex indices.  The file layout is a BVHCacheFileHeader,
+followed by the node array and then the leaf data array, each starting
+at a 64-byte aligned offset.  The layout matches the in-memory layout,
+so trees can use the node and leaf data directly from a memory-mapped
+file, without any parsing or copying.
+
+On load the header is checked against the mesh and tree type, and the
+payload is checked against the hash stored in the header.
+=====================================================================*/
+namespace BVHCache
+{
+
+
+enum TreeType
+{
+	TreeType_BVH		= 1,
+	TreeType_SmallBVH	= 2
+};
+
+
+struct BVHCacheFileHeader
+{
+	uint32 magic_number;
+	uint32 format_version;
+	uint32 tree_type; // A TreeType value
+	uint32 num_tris; // Number of triangles in the mesh the tree was built for.
+
+	uint64 mesh_hash; // Hash of the mesh data, as computed by computeMeshHash().
+	uint64 payload_hash; // Hash of the node and leaf data.
+
+	uint32 node_size; // sizeof() a node, in bytes.
+	uint32 leaf_elem_size; // sizeof() a leaf data element, in bytes.
+	uint64 num_nodes;
+	uint64 nodes_offset; // Offset of the node array from the start of the file, in bytes.
+	uint64 num_leaf_elems;
+	uint64 leaf_data_offset; // Offset of the leaf data array from the start of the file, in bytes.
+
+	int32 root_node_index;
+	int32 padding;
+	float root_aabb_min[4];
+	float root_aabb_max[4];
+};
+
+
+// The tree data, either to be written to a cache file, or as loaded from one.
+struct CachedTreeData
+{
+	js::AABBox root_aabb;
+	int32 root_node_index;
+
+	const void* nodes;
+	size_t num_nodes;
+	const void* leaf_data;
+	size_t num_leaf_elems;
+
+	SharedMemMappedFileRef file; // The memory-mapped file that nodes and leaf_data point into, if loaded from a cache file.
+};
+
+
+// Computes a hash of the vertex positions and triangle vertex indices of the mesh.
+uint64 computeMeshHash(const RayMesh& mesh);
+
+const std::string cacheFilePath(const std::string& cache_dir, uint64 mesh_hash, TreeType tree_type);
+
+// Writes the tree data to the cache file for the mesh.  The file is written atomically, so a concurrent reader will never see a partially written file.
+void writeCacheFile(const std::string& cache_dir, uint64 mesh_hash, uint32 num_tris, TreeType tree_type, size_t node_size, size_t leaf_elem_size, const CachedTreeData& data); // throws glare::Exception
+
+// Tries to load the cache file for the mesh.  Returns false if there is no cache file for the mesh, or if it is invalid or doesn't match.  Does not throw exceptions.
+bool loadCacheFile(const std::string& cache_dir, uint64 mesh_hash, uint32 num_tris, TreeType tree_type, size_t node_size, size_t leaf_elem_size, CachedTreeData& data_out);
+
+
+void test();
+
+
+} // end namespace BVHCache
@@ -8,13 +8,22 @@ Generated at 2012-11-10 19:47:32 +0000
 
 
 #include "NonBinningBVHBuilder.h"
+#include "BVHSphereBatchTraversal.h"
 #include "../indigo/object.h"
 #include "../simpleraytracer/ray.h"
 #include "../maths/Vec4i.h"
 #include "../utils/PrintOutput.h"
+#include "../utils/BufferedPrintOutput.h"
 #include "../utils/StringUtils.h"
 #include "../utils/ConPrint.h"
 #include "../utils/Timer.h"
+#include "../utils/Exception.h"
+#include "../utils/RuntimeCheck.h"
+#include "../utils/ShouldCancelCallback.h"
+#include "../utils/TaskManager.h"
+#include "../utils/Task.h"
+#include "../utils/AtomicInt.h"
+#include "../utils/ThreadSafeRefCounted.h"
 #include <limits>
 
 
@@ -26,8 +35,88 @@ Generated at 2012-11-10 19:47:32 +0000
 #endif
 
 
+static const float TRAVERSAL_COST = 1.f;
+static const float INTERSECTION_COST = 100.f; // Set this quite high, since intersecting objects is probably quite expensive.
+
+
+static inline int32 makeLeafRef(size_t offset, size_t num)
+{
+	assert(num < 32);
+	return (int32)(0x80000000u | (uint32)num | ((uint32)offset << 5));
+}
+
+static inline size_t leafOffset(int32 leaf_ref) { return ((uint32)leaf_ref & 0x7FFFFFFFu) >> 5; }
+static inline size_t leafNum(int32 leaf_ref) { return (uint32)leaf_ref & 0x1F; }
+
+
+// Holds the inputs and results of a background rebuild.
+class BVHObjectTreeRebuildResult : public ThreadSafeRefCounted
+{
+public:
+	js::Vector<js::AABBox, 32> aabbs;
+	js::Vector<ResultNode, 64> result_nodes;
+	BVHBuilder::ResultObIndicesVec result_ob_indices;
+	bool succeeded; // Written before done is set.
+	glare::AtomicInt done;
+};
+
+
+// The builder waits for all the tasks in its task manager to complete with waitForTasksToComplete(), so it can't use the task manager that the 
+// rebuild task is running on.  Instead each BVHObjectTree keeps one of these for its background rebuilds.
+// Reference counted, as a rebuild task may still be running when the BVHObjectTree is destroyed.
+class BVHObjectTreeRebuildTaskManager : public ThreadSafeRefCounted
+{
+public:
+	BVHObjectTreeRebuildTaskManager() : task_manager("BVHObjectTree rebuild task manager", 1) {}
+
+	glare::TaskManager task_manager;
+};
+
+
+class BVHObjectTreeRebuildTask : public glare::Task
+{
+public:
+	BVHObjectTreeRebuildTask(const Reference<BVHObjectTreeRebuildResult>& result_, const Reference<BVHObjectTreeRebuildTaskManager>& rebuild_task_manager_) 
+	:	result(result_), rebuild_task_manager(rebuild_task_manager_) {}
+
+	virtual void run(size_t /*thread_index*/)
+	{
+		result->succeeded = false;
+		try
+		{
+			DummyShouldCancelCallback should_cancel_callback;
+			BufferedPrintOutput print_output;
+
+			BVHBuilderRef builder = new NonBinningBVHBuilder(
+				1, // leaf_num_object_threshold
+				31, // max_num_objects_per_leaf (2^5 - 1)
+				INTERSECTION_COST,
+				result->aabbs.data(),
+				(int)result->aabbs.size()
+			);
+			builder->build(rebuild_task_manager->task_manager, should_cancel_callback, print_output, result->result_nodes);
+			result->result_ob_indices = builder->getResultObjectIndices();
+			result->succeeded = true;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("BVHObjectTree background rebuild failed: " + e.what());
+		}
+		result->done = 1;
+	}
+
+	Reference<BVHObjectTreeRebuildResult> result;
+	Reference<BVHObjectTreeRebuildTaskManager> rebuild_task_manager;
+};
+
+
 BVHObjectTree::BVHObjectTree()
-:	root_node_index(0)
+:	root_node_index(makeLeafRef(0, 0)), // Empty leaf
+	num_unused_leaf_entries(0),
+	built_sah_cost(0),
+	rebuild_sah_cost_factor(1.25f),
+	structure_version(0),
+	pending_rebuild_version(0)
 {
 	static_assert(sizeof(BVHObjectTreeNode) == 64, "sizeof(BVHObjectTreeNode) == 64");
 
@@ -249,6 +338,87 @@ stack_pop:
 }
 
 
+// Gets the objects in leaves overlapped by each query AABB, for which object_test_func(query_index, object_aabb) returns true.
+template <class ObjectTestFunc>
+void BVHObjectTree::getObjectsBatch(const js::AABBox* query_aabbs, size_t num_queries, const ObjectTestFunc& object_test_func, BatchQueryResults<const Object*>& results_out, glare::TaskManager* task_manager) const
+{
+	std::vector<uint32> order;
+	BVHSphereBatchTraversal::computeQueryOrder(query_aabbs, num_queries, order);
+
+	std::vector<BVHSphereBatchTraversal::GroupResults<const Object*> > group_results((num_queries + BVHSphereBatchTraversal::GROUP_SIZE - 1) / BVHSphereBatchTraversal::GROUP_SIZE);
+
+	BVHSphereBatchTraversal::forEachGroup(order, task_manager, [&](size_t group_index, const uint32* group_query_indices, int group_size)
+	{
+		BVHSphereBatchTraversal::QueryGroupAABBs group_aabbs;
+		for(int l=0; l<group_size; ++l)
+			group_aabbs.set(l, query_aabbs[group_query_indices[l]]);
+
+		BVHSphereBatchTraversal::GroupResults<const Object*>& results = group_results[group_index];
+
+		auto leaf_func = [&](size_t leaf_i, uint32 mask)
+		{
+			const Object* const ob = leaf_objects[leaf_i];
+			if(!ob) // Skip entries removed by removeObject().
+				return;
+
+			while(mask != 0)
+			{
+				const uint32 l = BitUtils::lowestSetBitIndex(mask);
+				mask &= mask - 1; // Clear lowest set bit
+
+				if(object_test_func(group_query_indices[l], leaf_object_aabbs[leaf_i]))
+				{
+					results.items.push_back(ob);
+					results.item_queries.push_back((uint8)l);
+				}
+			}
+		};
+
+		BVHSphereBatchTraversal::traverse<BVHObjectTreeNode, /*LEAF_NUM_BITS=*/5>(nodes.data(), root_node_index, group_aabbs, BVHSphereBatchTraversal::groupMask(group_size), leaf_func);
+	});
+
+	BVHSphereBatchTraversal::combineGroupResults(order, group_results, results_out);
+}
+
+
+void BVHObjectTree::getSphereOverlapObjects(const SphereOverlapQuery* queries, size_t num_queries, BatchQueryResults<const Object*>& results_out, glare::TaskManager* task_manager) const
+{
+	js::Vector<js::AABBox, 16> query_aabbs(num_queries);
+	for(size_t i=0; i<num_queries; ++i)
+	{
+		const Vec4f r(queries[i].radius_ws, queries[i].radius_ws, queries[i].radius_ws, 0);
+		query_aabbs[i] = js::AABBox(queries[i].centre_ws - r, queries[i].centre_ws + r);
+	}
+
+	getObjectsBatch(query_aabbs.data(), num_queries, [&](size_t query_i, const js::AABBox& ob_aabb)
+	{
+		// Test the sphere against the object AABB: get the distance from the sphere centre to the closest point in the AABB.
+		const Vec4f centre = queries[query_i].centre_ws;
+		const Vec4f closest = max(ob_aabb.min_, min(centre, ob_aabb.max_));
+		const Vec4f d = maskWToZero(centre - closest);
+		return dot(d, d) <= queries[query_i].radius_ws * queries[query_i].radius_ws;
+	}, results_out, task_manager);
+}
+
+
+void BVHObjectTree::getSphereSweepObjects(const SphereSweepQuery* queries, size_t num_queries, BatchQueryResults<const Object*>& results_out, glare::TaskManager* task_manager) const
+{
+	js::Vector<js::AABBox, 16> query_aabbs(num_queries);
+	for(size_t i=0; i<num_queries; ++i)
+	{
+		const Vec4f r(queries[i].radius_ws, queries[i].radius_ws, queries[i].radius_ws, 0);
+		const Vec4f start = queries[i].ray_ws.startPos();
+		const Vec4f end = queries[i].ray_ws.pointf(queries[i].ray_ws.maxT());
+		query_aabbs[i] = js::AABBox(min(start, end) - r, max(start, end) + r);
+	}
+
+	getObjectsBatch(query_aabbs.data(), num_queries, [&](size_t query_i, const js::AABBox& ob_aabb)
+	{
+		return (ob_aabb.disjoint(query_aabbs[query_i]) & 0x7) == 0; // Ignore W bit of movemask result
+	}, results_out, task_manager);
+}
+
+
 // Throws glare::CancelledException if cancelled.
 void BVHObjectTree::build(glare::TaskManager& task_manager, ShouldCancelCallback& should_cancel_callback, PrintOutput& print_output)
 {
@@ -264,7 +434,7 @@ void BVHObjectTree::build(glare::TaskManager& task_manager, ShouldCancelCallback
 	BVHBuilderRef builder = new NonBinningBVHBuilder(
 		1, // leaf_num_object_threshold
 		31, // max_num_objects_per_leaf (2^5 - 1)
-		100, // intersection_cost.  Set this quite high, since intersecting objects is probably quite expensive.
+		INTERSECTION_COST,
 		aabbs.data(),
 		(int)objects.size()
 	);
@@ -280,11 +450,37 @@ void BVHObjectTree::build(glare::TaskManager& task_manager, ShouldCancelCallback
 
 	//builder.printResultNodes(result_nodes);//TEMP
 
+	setFromBuildResult(result_nodes, result_ob_indices, objects.data(), aabbs.data());
+
+	// Don't need objects array any more.
+	objects.clearAndFreeMem();
+
+	//conPrint("BVHObjectTree::build done  (Elapsed: " + timer.elapsedStringNPlaces(4) + ")");
+	//print_output.print("\tNum objects: " + toString(objects_size));
+		
+	print_output.print("Object tree build done. (Time Taken: " + timer.elapsedStringNPlaces(3) + ")");
+}
+
+
+// Replaces the tree with the result of a BVH build over the objects obs, with AABBs aabbs.
+void BVHObjectTree::setFromBuildResult(const js::Vector<ResultNode, 64>& result_nodes, const BVHBuilder::ResultObIndicesVec& result_ob_indices, const Object* const* obs, const js::AABBox* aabbs)
+{
 	// Make leaf_objects from leaf object indices.
 	const size_t result_ob_ind_size = result_ob_indices.size();
 	leaf_objects.resizeNoCopy(result_ob_ind_size);
+	leaf_object_aabbs.resizeNoCopy(result_ob_ind_size);
+	leaf_object_parents.resizeNoCopy(result_ob_ind_size);
+	object_leaf_indices.clear();
+	object_leaf_indices.reserve(result_ob_ind_size);
 	for(size_t i=0; i<result_ob_ind_size; ++i)
-		leaf_objects[i] = objects[result_ob_indices[i]];
+	{
+		leaf_objects[i] = obs[result_ob_indices[i]];
+		leaf_object_aabbs[i] = aabbs[result_ob_indices[i]];
+		object_leaf_indices[leaf_objects[i]] = (uint32)i;
+	}
+
+	free_nodes.clear();
+	num_unused_leaf_entries = 0;
 
 	if(result_nodes.size() == 1)
 	{
@@ -294,10 +490,14 @@ void BVHObjectTree::build(glare::TaskManager& task_manager, ShouldCancelCallback
 		assert(num < 32);
 		int c = 0x80000000 | num | (offset << 5);
 		this->root_node_index = c;
+		for(int i=offset; i<offset+num; ++i)
+			leaf_object_parents[i] = -1;
+		this->nodes.clear();
 	}
 	else
 	{
 		//Timer timer2;
+		this->root_node_index = 0;
 
 		// Convert result_nodes to BVHObjectTreeNodes.
 		// Indices will change, since we will not explicitly store leaf nodes in the BVH object tree.  Rather leaf geometry references are put into the child references of the node above.
@@ -317,7 +517,10 @@ void BVHObjectTree::build(glare::TaskManager& task_manager, ShouldCancelCallback
 			const ResultNode& result_node = result_nodes[i];
 			if(result_node.interior)
 			{
-				BVHObjectTreeNode& node = this->nodes[new_index++];
+				const int node_index = new_index++;
+				BVHObjectTreeNode& node = this->nodes[node_index];
+				if(node_index == 0)
+					node.parent = -1;
 
 				const ResultNode& result_left_child  = result_nodes[result_node.left];
 				const ResultNode& result_right_child = result_nodes[result_node.right];
@@ -331,6 +534,7 @@ void BVHObjectTree::build(glare::TaskManager& task_manager, ShouldCancelCallback
 				{
 					node.child[0] = new_node_indices[result_node.left];
 					assert(node.child[0] >= 0 && node.child[0] < new_num_nodes);
+					this->nodes[node.child[0]].parent = node_index;
 				}
 				else
 				{
@@ -340,12 +544,15 @@ void BVHObjectTree::build(glare::TaskManager& task_manager, ShouldCancelCallback
 					assert(num < 32);
 					int c = 0x80000000 | num | (offset << 5);
 					node.child[0] = c;
+					for(int z=offset; z<offset+num; ++z)
+						leaf_object_parents[z] = node_index;
 				}
 
 				if(result_right_child.interior)
 				{
 					node.child[1] = new_node_indices[result_node.right];
 					assert(node.child[1] >= 0 && node.child[1] < new_num_nodes);
+					this->nodes[node.child[1]].parent = node_index;
 				}
 				else
 				{
@@ -355,21 +562,537 @@ void BVHObjectTree::build(glare::TaskManager& task_manager, ShouldCancelCallback
 					assert(num < 32);
 					int c = 0x80000000 | num | (offset << 5);
 					node.child[1] = c;
+					for(int z=offset; z<offset+num; ++z)
+						leaf_object_parents[z] = node_index;
 				}
 			}
 		}
 	}
 
-	//conPrint("\tBVHObjectTree conversion done  (Elapsed: " + timer2.elapsedStringNPlaces(4) + ")");
+	// Set node heights.  This also recomputes the child bounds from aabbs, which matters after a background rebuild, as objects may have moved while it was running.
+	refitSubtree(root_node_index);
 
+	built_sah_cost = getSAHCost();
+	structure_version++;
+}
 
-	// Don't need objects array any more.
-	objects.clearAndFreeMem();
 
-	//conPrint("BVHObjectTree::build done  (Elapsed: " + timer.elapsedStringNPlaces(4) + ")");
-	//print_output.print("\tNum objects: " + toString(objects_size));
-		
-	print_output.print("Object tree build done. (Time Taken: " + timer.elapsedStringNPlaces(3) + ")");
+// Gets the objects in the tree, in leaf order, and their AABBs.
+void BVHObjectTree::getObjectsAndAABBs(std::vector<const Object*>& obs_out, js::Vector<js::AABBox, 32>& aabbs_out) const
+{
+	obs_out.resize(0);
+	obs_out.reserve(object_leaf_indices.size());
+	aabbs_out.resizeNoCopy(object_leaf_indices.size());
+	for(size_t i=0; i<leaf_objects.size(); ++i)
+		if(leaf_objects[i])
+		{
+			aabbs_out[obs_out.size()] = leaf_object_aabbs[i];
+			obs_out.push_back(leaf_objects[i]);
+		}
+	assert(obs_out.size() == object_leaf_indices.size());
+}
+
+
+const js::AABBox BVHObjectTree::getChildAABB(int node_index, int slot) const
+{
+	const BVHObjectTreeNode& node = nodes[node_index];
+	return js::AABBox(
+		Vec4f(node.x.x[slot],     node.y.x[slot],     node.z.x[slot],     1.f),
+		Vec4f(node.x.x[2 + slot], node.y.x[2 + slot], node.z.x[2 + slot], 1.f)
+	);
+}
+
+
+void BVHObjectTree::setChildAABB(int node_index, int slot, const js::AABBox& aabb)
+{
+	BVHObjectTreeNode& node = nodes[node_index];
+	node.x.x[slot] = aabb.min_[0];
+	node.y.x[slot] = aabb.min_[1];
+	node.z.x[slot] = aabb.min_[2];
+	node.x.x[2 + slot] = aabb.max_[0];
+	node.y.x[2 + slot] = aabb.max_[1];
+	node.z.x[2 + slot] = aabb.max_[2];
+}
+
+
+void BVHObjectTree::setChild(int node_index, int slot, int32 child_ref)
+{
+	if(node_index == -1)
+		root_node_index = child_ref;
+	else
+		nodes[node_index].child[slot] = child_ref;
+
+	if(child_ref >= 0)
+		nodes[child_ref].parent = node_index;
+	else
+	{
+		const size_t ofs = leafOffset(child_ref);
+		const size_t num = leafNum(child_ref);
+		for(size_t i=ofs; i<ofs+num; ++i)
+			leaf_object_parents[i] = node_index;
+	}
+}
+
+
+const js::AABBox BVHObjectTree::getNodeAABB(int node_index) const
+{
+	return AABBUnion(getChildAABB(node_index, 0), getChildAABB(node_index, 1));
+}
+
+
+const js::AABBox BVHObjectTree::computeLeafAABB(int32 leaf_ref) const
+{
+	const size_t ofs = leafOffset(leaf_ref);
+	const size_t num = leafNum(leaf_ref);
+	js::AABBox aabb = js::AABBox::emptyAABBox();
+	for(size_t i=ofs; i<ofs+num; ++i)
+		aabb = AABBUnion(aabb, leaf_object_aabbs[i]);
+	return aabb;
+}
+
+
+int BVHObjectTree::getSlotInParent(int node_index) const
+{
+	const int parent = nodes[node_index].parent;
+	assert(parent != -1);
+	return (nodes[parent].child[0] == node_index) ? 0 : 1;
+}
+
+
+// Returns the child slot of the parent node that references the leaf containing leaf_objects[leaf_index].
+int BVHObjectTree::getLeafSlot(int parent_node_index, uint32 leaf_index) const
+{
+	const int32 left = nodes[parent_node_index].child[0];
+	if(left < 0 && leaf_index >= leafOffset(left) && leaf_index < leafOffset(left) + leafNum(left))
+		return 0;
+	assert(nodes[parent_node_index].child[1] < 0);
+	return 1;
+}
+
+
+int BVHObjectTree::childHeight(int32 child_ref) const
+{
+	return (child_ref >= 0) ? nodes[child_ref].height : 0;
+}
+
+
+int BVHObjectTree::allocNode()
+{
+	int node_index;
+	if(!free_nodes.empty())
+	{
+		node_index = free_nodes.back();
+		free_nodes.pop_back();
+	}
+	else
+	{
+		node_index = (int)nodes.size();
+		nodes.push_back_uninitialised();
+	}
+	nodes[node_index].parent = -1;
+	nodes[node_index].height = 0;
+	return node_index;
+}
+
+
+void BVHObjectTree::freeNode(int node_index)
+{
+	nodes[node_index].height = -1;
+	free_nodes.push_back(node_index);
+}
+
+
+// Rotates the interior child of node a in slot up_slot up into the place of a, moving a down a level.
+// The taller child of the rotated-up node stays with it, the other child moves to a.
+// Returns the index of the node now in the place of a.
+int BVHObjectTree::rotateUp(int a, int up_slot)
+{
+	const int c = nodes[a].child[up_slot];
+	assert(c >= 0);
+	const int parent = nodes[a].parent;
+	const int parent_slot = (parent != -1) ? getSlotInParent(a) : 0;
+
+	const int32 b = nodes[a].child[1 - up_slot];
+	const js::AABBox b_aabb = getChildAABB(a, 1 - up_slot);
+
+	const int keep_slot = (childHeight(nodes[c].child[0]) > childHeight(nodes[c].child[1])) ? 0 : 1;
+	const int32 keep = nodes[c].child[keep_slot];
+	const int32 move = nodes[c].child[1 - keep_slot];
+	const js::AABBox keep_aabb = getChildAABB(c, keep_slot);
+	const js::AABBox move_aabb = getChildAABB(c, 1 - keep_slot);
+
+	const js::AABBox new_a_aabb = AABBUnion(b_aabb, move_aabb);
+
+	setChild(a, up_slot, move);
+	setChildAABB(a, up_slot, move_aabb);
+	nodes[a].height = 1 + myMax(childHeight(b), childHeight(move));
+
+	setChild(c, 0, a);
+	setChildAABB(c, 0, new_a_aabb);
+	setChild(c, 1, keep);
+	setChildAABB(c, 1, keep_aabb);
+	nodes[c].height = 1 + myMax(nodes[a].height, childHeight(keep));
+
+	setChild(parent, parent_slot, c);
+	if(parent != -1)
+		setChildAABB(parent, parent_slot, AABBUnion(new_a_aabb, keep_aabb));
+	return c;
+}
+
+
+// Updates the bounds stored for node_index and its ancestors, after the bounds of a child of node_index changed.
+// Stops early once the bounds stop changing.
+void BVHObjectTree::refitAncestors(int node_index)
+{
+	while(nodes[node_index].parent != -1)
+	{
+		const int parent = nodes[node_index].parent;
+		const int slot = getSlotInParent(node_index);
+		const js::AABBox aabb = getNodeAABB(node_index);
+		if(aabb == getChildAABB(parent, slot)) // If the bounds haven't changed, the ancestor bounds won't change either.
+			break;
+		setChildAABB(parent, slot, aabb);
+		node_index = parent;
+	}
+}
+
+
+// Updates the heights and bounds of node_index and its ancestors after a change in structure below node_index, rotating unbalanced nodes.
+void BVHObjectTree::refitAndBalanceAncestors(int node_index)
+{
+	while(node_index != -1)
+	{
+		const int h0 = childHeight(nodes[node_index].child[0]);
+		const int h1 = childHeight(nodes[node_index].child[1]);
+		if(h1 - h0 > 1)
+			node_index = rotateUp(node_index, 1);
+		else if(h0 - h1 > 1)
+			node_index = rotateUp(node_index, 0);
+		else
+			nodes[node_index].height = 1 + myMax(h0, h1);
+
+		const int parent = nodes[node_index].parent;
+		if(parent != -1)
+			setChildAABB(parent, getSlotInParent(node_index), getNodeAABB(node_index));
+		node_index = parent;
+	}
+}
+
+
+// Recomputes the child bounds and heights of the nodes in the subtree from leaf_object_aabbs.  Returns the bounds of the subtree.
+const js::AABBox BVHObjectTree::refitSubtree(int32 child_ref)
+{
+	if(child_ref < 0)
+		return computeLeafAABB(child_ref);
+
+	const js::AABBox left_aabb  = refitSubtree(nodes[child_ref].child[0]);
+	const js::AABBox right_aabb = refitSubtree(nodes[child_ref].child[1]);
+	setChildAABB(child_ref, 0, left_aabb);
+	setChildAABB(child_ref, 1, right_aabb);
+	nodes[child_ref].height = 1 + myMax(childHeight(nodes[child_ref].child[0]), childHeight(nodes[child_ref].child[1]));
+	return AABBUnion(left_aabb, right_aabb);
+}
+
+
+void BVHObjectTree::insertObject(const Object* ob, const js::AABBox& aabb_ws)
+{
+	assert(object_leaf_indices.count(ob) == 0);
+
+	const size_t leaf_index = leaf_objects.size();
+	if(leaf_index >= (1u << 26))
+		throw glare::Exception("Too many objects in BVHObjectTree.");
+
+	structure_version++;
+
+	// Add a new single-object leaf
+	leaf_objects.push_back(ob);
+	leaf_object_aabbs.push_back(aabb_ws);
+	leaf_object_parents.push_back(-1);
+	object_leaf_indices[ob] = (uint32)leaf_index;
+	const int32 new_leaf = makeLeafRef(leaf_index, 1);
+
+	if(root_node_index < 0 && leafNum(root_node_index) == 0) // If the tree is empty:
+	{
+		setChild(-1, 0, new_leaf);
+		return;
+	}
+
+	// Find the sibling for the new leaf.  Walk down from the root, at each node choosing between making the new leaf a sibling of the node,
+	// or descending to the child which would give the smallest increase in surface area, including the growth of the bounds of the ancestors.
+	int sibling_parent = -1;
+	int sibling_slot = 0;
+	int32 sibling = root_node_index;
+	js::AABBox sibling_aabb = (root_node_index >= 0) ? getNodeAABB(root_node_index) : computeLeafAABB(root_node_index);
+	float inheritance_cost = 0;
+	while(sibling >= 0)
+	{
+		const float combined_area = AABBUnion(sibling_aabb, aabb_ws).getSurfaceArea();
+		const float cost_here = inheritance_cost + combined_area; // Area of the new parent node, if we insert here.
+		const float child_inheritance_cost = inheritance_cost + combined_area - sibling_aabb.getSurfaceArea();
+
+		float child_costs[2];
+		for(int c=0; c<2; ++c)
+		{
+			const js::AABBox child_aabb = getChildAABB(sibling, c);
+			const float union_area = AABBUnion(child_aabb, aabb_ws).getSurfaceArea();
+			// For an interior child, this is a lower bound on the cost of inserting below it.
+			child_costs[c] = child_inheritance_cost + ((nodes[sibling].child[c] >= 0) ? (union_area - child_aabb.getSurfaceArea()) : union_area);
+		}
+
+		if(cost_here <= child_costs[0] && cost_here <= child_costs[1])
+			break;
+
+		const int best = (child_costs[0] <= child_costs[1]) ? 0 : 1;
+		sibling_parent = sibling;
+		sibling_slot = best;
+		sibling_aabb = getChildAABB(sibling, best);
+		sibling = nodes[sibling].child[best];
+		inheritance_cost = child_inheritance_cost;
+	}
+
+	// Make a new node with the sibling and the new leaf as children, in the place of the sibling.
+	const int new_node = allocNode();
+	setChild(new_node, 0, sibling);
+	setChildAABB(new_node, 0, sibling_aabb);
+	setChild(new_node, 1, new_leaf);
+	setChildAABB(new_node, 1, aabb_ws);
+	setChild(sibling_parent, sibling_slot, new_node);
+
+	refitAndBalanceAncestors(new_node);
+}
+
+
+void BVHObjectTree::removeObject(const Object* ob)
+{
+	const auto res = object_leaf_indices.find(ob);
+	assert(res != object_leaf_indices.end());
+	if(res == object_leaf_indices.end())
+		return;
+
+	const uint32 leaf_index = res->second;
+	object_leaf_indices.erase(res);
+	structure_version++;
+
+	const int parent = leaf_object_parents[leaf_index];
+	const int slot = (parent != -1) ? getLeafSlot(parent, leaf_index) : 0;
+	const int32 leaf_ref = (parent != -1) ? nodes[parent].child[slot] : root_node_index;
+	const size_t ofs = leafOffset(leaf_ref);
+	const size_t num = leafNum(leaf_ref);
+
+	// Move the last object in the leaf into the entry of the removed object, and shrink the leaf by one.
+	const size_t last = ofs + num - 1;
+	if(leaf_index != last)
+	{
+		leaf_objects[leaf_index] = leaf_objects[last];
+		leaf_object_aabbs[leaf_index] = leaf_object_aabbs[last];
+		object_leaf_indices[leaf_objects[leaf_index]] = leaf_index;
+	}
+	leaf_objects[last] = NULL;
+	num_unused_leaf_entries++;
+
+	if(num > 1 || parent == -1)
+	{
+		const int32 new_leaf_ref = makeLeafRef(ofs, num - 1);
+		setChild(parent, slot, new_leaf_ref);
+		if(parent != -1)
+		{
+			setChildAABB(parent, slot, computeLeafAABB(new_leaf_ref));
+			refitAncestors(parent);
+		}
+	}
+	else
+	{
+		// The leaf is now empty, so replace its parent node with its sibling.
+		const int32 sibling = nodes[parent].child[1 - slot];
+		const js::AABBox sibling_aabb = getChildAABB(parent, 1 - slot);
+		const int grandparent = nodes[parent].parent;
+		const int parent_slot = (grandparent != -1) ? getSlotInParent(parent) : 0;
+
+		setChild(grandparent, parent_slot, sibling);
+		freeNode(parent);
+
+		if(grandparent != -1)
+		{
+			setChildAABB(grandparent, parent_slot, sibling_aabb);
+			refitAndBalanceAncestors(grandparent);
+		}
+	}
+}
+
+
+void BVHObjectTree::updateObjectAABB(const Object* ob, const js::AABBox& aabb_ws)
+{
+	const auto res = object_leaf_indices.find(ob);
+	assert(res != object_leaf_indices.end());
+	if(res == object_leaf_indices.end())
+		return;
+
+	const uint32 leaf_index = res->second;
+	leaf_object_aabbs[leaf_index] = aabb_ws;
+
+	const int parent = leaf_object_parents[leaf_index];
+	if(parent == -1) // If the root is a leaf, there are no bounds to update.
+		return;
+
+	const int slot = getLeafSlot(parent, leaf_index);
+	setChildAABB(parent, slot, computeLeafAABB(nodes[parent].child[slot]));
+	refitAncestors(parent);
+}
+
+
+void BVHObjectTree::refit(const std::vector<const Object*>& changed_objects)
+{
+	for(size_t i=0; i<changed_objects.size(); ++i)
+		updateObjectAABB(changed_objects[i], changed_objects[i]->getAABBoxWS());
+}
+
+
+float BVHObjectTree::getSAHCost() const
+{
+	if(root_node_index < 0) // If root is a leaf:
+		return leafNum(root_node_index) * INTERSECTION_COST;
+
+	const float root_area = getNodeAABB(root_node_index).getSurfaceArea();
+	if(!(root_area > 0))
+		return 0;
+
+	double sum = root_area * TRAVERSAL_COST;
+	for(size_t i=0; i<nodes.size(); ++i)
+		if(nodes[i].height >= 0) // If the node is not on the free list:
+			for(int c=0; c<2; ++c)
+			{
+				const int32 child = nodes[i].child[c];
+				sum += getChildAABB((int)i, c).getSurfaceArea() * ((child >= 0) ? TRAVERSAL_COST : leafNum(child) * INTERSECTION_COST);
+			}
+
+	return (float)(sum / root_area);
+}
+
+
+bool BVHObjectTree::checkForRebuild(glare::TaskManager& task_manager)
+{
+	if(pending_rebuild.nonNull())
+	{
+		if(pending_rebuild->done == 0) // If still running:
+			return false;
+
+		Reference<BVHObjectTreeRebuildResult> result = pending_rebuild;
+		pending_rebuild = NULL;
+
+		// If objects were inserted or removed while the rebuild was running, the result is out of date, so discard it.
+		if(result->succeeded && (pending_rebuild_version == structure_version))
+		{
+			// Objects may have moved while the rebuild was running, so use their current AABBs.
+			js::Vector<js::AABBox, 32> current_aabbs(pending_rebuild_objects.size());
+			for(size_t i=0; i<pending_rebuild_objects.size(); ++i)
+				current_aabbs[i] = leaf_object_aabbs[object_leaf_indices[pending_rebuild_objects[i]]];
+
+			setFromBuildResult(result->result_nodes, result->result_ob_indices, pending_rebuild_objects.data(), current_aabbs.data());
+			pending_rebuild_objects.clear();
+			return true;
+		}
+		pending_rebuild_objects.clear();
+	}
+
+	const size_t num_obs = object_leaf_indices.size();
+	if(num_obs > 0 && ((getSAHCost() > built_sah_cost * rebuild_sah_cost_factor) || (num_unused_leaf_entries > num_obs)))
+	{
+		pending_rebuild = new BVHObjectTreeRebuildResult();
+		getObjectsAndAABBs(pending_rebuild_objects, pending_rebuild->aabbs);
+		pending_rebuild_version = structure_version;
+
+		if(rebuild_task_manager.isNull())
+			rebuild_task_manager = new BVHObjectTreeRebuildTaskManager();
+
+		task_manager.addTask(new BVHObjectTreeRebuildTask(pending_rebuild, rebuild_task_manager));
+	}
+	return false;
+}
+
+
+// Throws glare::CancelledException if cancelled.
+void BVHObjectTree::rebuild(glare::TaskManager& task_manager, ShouldCancelCallback& should_cancel_callback, PrintOutput& print_output)
+{
+	std::vector<const Object*> obs;
+	js::Vector<js::AABBox, 32> aabbs;
+	getObjectsAndAABBs(obs, aabbs);
+
+	BVHBuilderRef builder = new NonBinningBVHBuilder(
+		1, // leaf_num_object_threshold
+		31, // max_num_objects_per_leaf (2^5 - 1)
+		INTERSECTION_COST,
+		aabbs.data(),
+		(int)aabbs.size()
+	);
+
+	js::Vector<ResultNode, 64> result_nodes;
+	builder->build(
+		task_manager,
+		should_cancel_callback,
+		print_output,
+		result_nodes
+	);
+
+	setFromBuildResult(result_nodes, builder->getResultObjectIndices(), obs.data(), aabbs.data()); // Also makes any background rebuild in progress out of date.
+}
+
+
+static bool boundsEqual(const js::AABBox& a, const js::AABBox& b)
+{
+	return a.min_[0] == b.min_[0] && a.min_[1] == b.min_[1] && a.min_[2] == b.min_[2] &&
+		a.max_[0] == b.max_[0] && a.max_[1] == b.max_[1] && a.max_[2] == b.max_[2];
+}
+
+
+void BVHObjectTree::checkInvariants() const
+{
+	size_t num_leaf_obs = 0;
+
+	std::vector<std::pair<int32, int> > stack; // (child reference, parent node index)
+	stack.push_back(std::make_pair(root_node_index, -1));
+	while(!stack.empty())
+	{
+		const int32 ref = stack.back().first;
+		const int parent = stack.back().second;
+		stack.pop_back();
+
+		if(ref >= 0)
+		{
+			runtimeCheck(ref < (int32)nodes.size());
+			const BVHObjectTreeNode& node = nodes[ref];
+			runtimeCheck(node.parent == parent);
+			runtimeCheck(node.height == 1 + myMax(childHeight(node.child[0]), childHeight(node.child[1])));
+			for(int c=0; c<2; ++c)
+			{
+				const int32 child = node.child[c];
+				if(child >= 0)
+					runtimeCheck(boundsEqual(getChildAABB(ref, c), getNodeAABB(child)));
+				else
+				{
+					runtimeCheck(leafNum(child) > 0);
+					runtimeCheck(boundsEqual(getChildAABB(ref, c), computeLeafAABB(child)));
+				}
+				stack.push_back(std::make_pair(child, (int)ref));
+			}
+		}
+		else
+		{
+			const size_t ofs = leafOffset(ref);
+			const size_t num = leafNum(ref);
+			runtimeCheck(ofs + num <= leaf_objects.size());
+			for(size_t i=ofs; i<ofs+num; ++i)
+			{
+				runtimeCheck(leaf_objects[i] != NULL);
+				runtimeCheck(leaf_object_parents[i] == parent);
+				const auto res = object_leaf_indices.find(leaf_objects[i]);
+				runtimeCheck(res != object_leaf_indices.end() && res->second == i);
+			}
+			num_leaf_obs += num;
+		}
+	}
+
+	runtimeCheck(num_leaf_obs == object_leaf_indices.size());
+	runtimeCheck(num_leaf_obs + num_unused_leaf_entries == leaf_objects.size());
 }
 
 
@@ -7,16 +7,24 @@ Generated at 2012-11-10 19:47:31 +0000
 #pragma once
 
 
+#include "BVHBuilder.h"
 #include "../maths/Vec4f.h"
 #include "../utils/Platform.h"
 #include "../utils/Vector.h"
+#include "../utils/Reference.h"
 #include <vector>
+#include <unordered_map>
 namespace glare { class TaskManager; }
 class Object;
 class PrintOutput;
 class ShouldCancelCallback;
 class HitInfo;
 class Ray;
+class BVHObjectTreeRebuildResult;
+class BVHObjectTreeRebuildTaskManager;
+struct SphereSweepQuery;
+struct SphereOverlapQuery;
+template <class T> struct BatchQueryResults;
 
 
 class BVHObjectTreeNode
@@ -27,14 +35,30 @@ public:
 	Vec4f z; // (left_min_z, right_min_z, left_max_z, right_max_z)
 
 	int32 child[2];
-	int32 padding[2]; // Pad to 64 bytes.
+	int32 parent; // Index of the parent node, or -1 if this is the root node.
+	int32 height; // Height of the subtree rooted at this node, where leaves have height 0.  -1 if this node is on the free list.
 };
 
 
 /*=====================================================================
 BVHObjectTree
 -------------------
-
+Can be built in one go with build(), and then updated incrementally:
+refit with updateObjectAABB() or refit() when objects move, and add and
+remove objects with insertObject() and removeObject().
+
+Insertion puts the new object next to the node that gives the smallest
+increase in bounds surface area.  Nodes above an insertion or removal
+are rebalanced with rotations, as in Box2D's b2DynamicTree, so the tree
+depth stays logarithmic.
+
+Updates degrade the tree quality over time, so checkForRebuild() should
+be called after each batch of updates.  It tracks the SAH cost of the
+tree, and when it gets too much worse than the cost after the last full
+build, does a full rebuild in a background task.
+
+The tree keeps its own copy of each object's world-space AABB, so the
+background rebuild doesn't touch the objects.
 =====================================================================*/
 class BVHObjectTree
 {
@@ -47,12 +71,47 @@ public:
 	typedef float Real;
 
 
-	//void insertObject(const Object* object);
+	// Inserts an object that is not already in the tree.
+	void insertObject(const Object* ob, const js::AABBox& aabb_ws);
+
+	// Removes an object from the tree.  The object must be in the tree.
+	void removeObject(const Object* ob);
+
+	// Sets the AABB of an object that has moved, and refits the bounds of the nodes above it.
+	void updateObjectAABB(const Object* ob, const js::AABBox& aabb_ws);
+
+	// Calls updateObjectAABB() for each object, with the object's current getAABBoxWS().
+	void refit(const std::vector<const Object*>& changed_objects);
+
+	// Call after a batch of updates, e.g. once per frame.
+	// If a background rebuild has finished, replaces the tree with the rebuilt one and returns true.
+	// Otherwise starts a background rebuild on task_manager if the SAH cost has risen past rebuild_sah_cost_factor times the cost after the last full build.
+	bool checkForRebuild(glare::TaskManager& task_manager);
+
+	// Rebuilds the whole tree from the current object AABBs, on this thread.
+	// Throws glare::CancelledException if cancelled.
+	void rebuild(glare::TaskManager& task_manager, ShouldCancelCallback& should_cancel_callback, PrintOutput& print_output);
+
+	// SAH cost of the tree, relative to the surface area of the root bounds.
+	float getSAHCost() const;
+
+	bool isRebuildInProgress() const { return pending_rebuild.nonNull(); }
+
+	size_t numObjects() const { return object_leaf_indices.size(); }
+
+	// Throws glare::Exception if the tree structure or bounds are not consistent.  For testing.
+	void checkInvariants() const;
 	
 	// hitob_out will be set to a non-null value if the ray hit somethig in the interval, and null otherwise.
 	Real traceRay(const Ray& ray, float time,
 		const Object*& hitob_out, HitInfo& hitinfo_out) const;
 
+	// Broadphase queries for batches of spheres, see BVHSphereBatchTraversal.h.  Large batches are split across task_manager if it is non-null.
+	// Gets, for each query, the objects whose AABB overlaps the sphere.
+	void getSphereOverlapObjects(const SphereOverlapQuery* queries, size_t num_queries, BatchQueryResults<const Object*>& results_out, glare::TaskManager* task_manager) const;
+	// Gets, for each query, the objects whose AABB overlaps the AABB of the path swept by the sphere.
+	void getSphereSweepObjects(const SphereSweepQuery* queries, size_t num_queries, BatchQueryResults<const Object*>& results_out, glare::TaskManager* task_manager) const;
+
 	// Throws glare::CancelledException if cancelled.
 	void build(glare::TaskManager& task_manager, ShouldCancelCallback& should_cancel_callback, PrintOutput& print_output);
 
@@ -62,7 +121,22 @@ public:
 	int32 root_node_index;
 	js::Vector<const Object*, 16> objects;
 	js::Vector<BVHObjectTreeNode, 64> nodes;
-	js::Vector<const Object*, 16> leaf_objects;
+	js::Vector<const Object*, 16> leaf_objects; // NULL for entries no longer referenced by a leaf, after removals.
+
+	js::Vector<js::AABBox, 32> leaf_object_aabbs; // World-space AABB of each object in leaf_objects.
+	js::Vector<int32, 16> leaf_object_parents; // For each entry in leaf_objects, the node whose child references the leaf containing it, or -1 if the root is a leaf.
+	std::unordered_map<const Object*, uint32> object_leaf_indices; // Index in leaf_objects of each object in the tree.
+	js::Vector<int32, 16> free_nodes; // Indices of nodes freed by removals, for reuse.
+	size_t num_unused_leaf_entries; // Number of NULL entries in leaf_objects.
+
+	float built_sah_cost; // SAH cost after the last full build.
+	float rebuild_sah_cost_factor; // A background rebuild is started when the SAH cost exceeds built_sah_cost times this.  Default 1.25.
+
+	uint64 structure_version; // Incremented by insertObject() and removeObject().  A background rebuild is discarded if the structure changed while it was running.
+	Reference<BVHObjectTreeRebuildResult> pending_rebuild; // Non-null while a background rebuild is in progress.
+	std::vector<const Object*> pending_rebuild_objects; // Objects the pending rebuild was started with.
+	uint64 pending_rebuild_version;
+	Reference<BVHObjectTreeRebuildTaskManager> rebuild_task_manager; // Runs the builder for background rebuilds.  Made on the first background rebuild and then reused.
 
 
 	// stats
@@ -71,4 +145,25 @@ public:
 	mutable uint64 num_leaf_nodes_traversed;
 	mutable uint64 num_object_traceray_calls;
 	mutable uint64 num_hit_opaque_ob_early_outs;
+
+private:
+	void setFromBuildResult(const js::Vector<ResultNode, 64>& result_nodes, const BVHBuilder::ResultObIndicesVec& result_ob_indices, const Object* const* obs, const js::AABBox* aabbs);
+	void getObjectsAndAABBs(std::vector<const Object*>& obs_out, js::Vector<js::AABBox, 32>& aabbs_out) const;
+	template <class ObjectTestFunc>
+	void getObjectsBatch(const js::AABBox* query_aabbs, size_t num_queries, const ObjectTestFunc& object_test_func, BatchQueryResults<const Object*>& results_out, glare::TaskManager* task_manager) const;
+
+	const js::AABBox getChildAABB(int node_index, int slot) const;
+	void setChildAABB(int node_index, int slot, const js::AABBox& aabb);
+	void setChild(int node_index, int slot, int32 child_ref); // node_index = -1 sets the root.  Updates the parent references of the child.
+	const js::AABBox getNodeAABB(int node_index) const;
+	const js::AABBox computeLeafAABB(int32 leaf_ref) const;
+	int getSlotInParent(int node_index) const;
+	int getLeafSlot(int parent_node_index, uint32 leaf_index) const;
+	int childHeight(int32 child_ref) const;
+	int allocNode();
+	void freeNode(int node_index);
+	int rotateUp(int node_index, int up_slot);
+	void refitAncestors(int node_index);
+	void refitAndBalanceAncestors(int node_index);
+	const js::AABBox refitSubtree(int32 child_ref);
 };
@@ -0,0 +1,381 @@
+/*=====================================================================
+BVHPacketTraversal.h
+--------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "jscol_Tree.h"
+#include "jscol_aabbox.h"
+#include "../simpleraytracer/RayBatch.h"
+#include "../simpleraytracer/raymesh.h"
+#include "../simpleraytracer/hitinfo.h"
+#include "../maths/SSE.h"
+#include <vector>
+
+
+namespace js
+{
+
+
+/*=====================================================================
+BVHPacketTraversal
+------------------
+Ray packet traversal for BVH and SmallBVH, used by their traceRays() methods.
+
+The rays in the batch are first sorted into a stream per direction octant.
+Consecutive rays in each stream are then grouped into packets of 4, which
+are traced together with SSE, one ray per lane, through the existing
+2-wide nodes.  A child node is visited if any active ray in the packet
+hits it, and triangles in leaves are intersected with all active rays at once.
+
+Packets whose ray directions diverge, or whose ray origins are far apart, are filtered out, and their rays are
+traced one at a time with traceRay() instead, as packet traversal would just
+end up visiting the union of the nodes visited by each ray.
+
+NodeType should be BVHNode or SmallBVHNode.  LEAF_NUM_BITS is the number of
+bits used to store the number of triangles in a leaf.
+=====================================================================*/
+namespace BVHPacketTraversal
+{
+
+
+// Rays in a packet are only traced together if the cosine of the angle between the direction of the first ray and each other ray is at least this,
+static const float MIN_PACKET_COS_ANGLE = 0.9f;
+// and the distance between the origin of the first ray and each other ray is at most this fraction of the diagonal of the root AABB.
+static const float MAX_PACKET_ORIGIN_DIST_FRACTION = 0.02f;
+
+
+// returns mask ? b : a
+static GLARE_STRONG_INLINE const Vec4f condMov(const Vec4f& a, const Vec4f& b, const Vec4f& mask)
+{
+	return Vec4f(_mm_or_ps(_mm_and_ps(mask.v, b.v), _mm_andnot_ps(mask.v, a.v)));
+}
+
+
+// Converts a lane bit mask (bit i = lane i) to a Vec4f mask.
+static GLARE_STRONG_INLINE const Vec4f laneMaskToVec4f(int mask)
+{
+	const Vec4i lane_bits(1, 2, 4, 8);
+	return bitcastToVec4f(Vec4i(_mm_cmpeq_epi32((Vec4i(mask) & lane_bits).v, lane_bits.v)));
+}
+
+
+struct RayPacket
+{
+	Vec4f orig_x, orig_y, orig_z;
+	Vec4f dir_x, dir_y, dir_z;
+	Vec4f recip_dir_x, recip_dir_y, recip_dir_z;
+	Vec4f min_t;
+	Vec4f max_t; // Initially the max_t of each ray, decreased as hits are found.
+};
+
+
+// Computes 1/d, with infinities replaced by the max float value, as in the Ray constructor.
+static GLARE_STRONG_INLINE const Vec4f recipDir(const Vec4f& d)
+{
+	const Vec4f raw_recip_dir = div(Vec4f(1.f), d);
+	return condMov(raw_recip_dir, Vec4f(std::numeric_limits<float>::max()),
+		parallelOr(
+			parallelEq(raw_recip_dir, Vec4f(std::numeric_limits<float>::infinity())),
+			parallelEq(raw_recip_dir, Vec4f(-std::numeric_limits<float>::infinity()))
+		)
+	);
+}
+
+
+// Intersects the rays in the packet with a single child AABB.
+// Returns a mask of the rays that hit the box within their [min_t, max_t] interval, and the near distances to the box.
+static GLARE_STRONG_INLINE const Vec4f intersectBox(const RayPacket& p, const Vec4f& min_x, const Vec4f& min_y, const Vec4f& min_z, const Vec4f& max_x, const Vec4f& max_y, const Vec4f& max_z, Vec4f& near_out)
+{
+	const Vec4f t0_x = (min_x - p.orig_x) * p.recip_dir_x;
+	const Vec4f t1_x = (max_x - p.orig_x) * p.recip_dir_x;
+	const Vec4f t0_y = (min_y - p.orig_y) * p.recip_dir_y;
+	const Vec4f t1_y = (max_y - p.orig_y) * p.recip_dir_y;
+	const Vec4f t0_z = (min_z - p.orig_z) * p.recip_dir_z;
+	const Vec4f t1_z = (max_z - p.orig_z) * p.recip_dir_z;
+
+	const Vec4f near_t = max(max(min(t0_x, t1_x), min(t0_y, t1_y)), max(min(t0_z, t1_z), p.min_t));
+	const Vec4f far_t  = min(min(max(t0_x, t1_x), max(t0_y, t1_y)), min(max(t0_z, t1_z), p.max_t));
+	near_out = near_t;
+	return parallelLessEqual(near_t, far_t);
+}
+
+
+// Traces a packet of up to 4 rays.  The lanes set in active_mask (bit i = lane i) are traced, the others are ignored.
+// Returns a mask of the lanes that hit something.
+template <class NodeType, int LEAF_NUM_BITS>
+static int tracePacket(const NodeType* nodes, int32 root_node_index, const uint32* leaf_tri_indices, const RayMesh* raymesh, RayPacket& p, int active_mask,
+	Vec4f& hit_u_out, Vec4f& hit_v_out, Vec4i& hit_tri_out)
+{
+	int node_stack[64];
+	int mask_stack[64];
+	Vec4f near_stack[64]; // Near distances of each ray to the nodes on the stack.
+	int stack_top = 0;
+	node_stack[0] = root_node_index;
+	mask_stack[0] = active_mask;
+	near_stack[0] = Vec4f(-std::numeric_limits<float>::infinity());
+
+	int hit_mask = 0;
+	Vec4f hit_u(0.f);
+	Vec4f hit_v(0.f);
+	Vec4i hit_tri(0);
+
+	const Vec4f zero(0.f);
+	const Vec4f one(1.f);
+
+	while(stack_top >= 0)
+	{
+		int cur = node_stack[stack_top];
+		// Drop rays that have found a hit closer than their near distance to the node.
+		int mask = mask_stack[stack_top] & _mm_movemask_ps(parallelLessEqual(near_stack[stack_top], p.max_t).v);
+		stack_top--;
+		if(mask == 0)
+			continue;
+
+		while(cur >= 0) // While this is an interior node:
+		{
+			const NodeType& node = nodes[cur];
+			const Vec4f active = laneMaskToVec4f(mask);
+
+			// node.x = (left_min_x, right_min_x, left_max_x, right_max_x) etc.
+			Vec4f left_near, right_near;
+			const Vec4f left_hit  = parallelAnd(active, intersectBox(p, copyToAll<0>(node.x), copyToAll<0>(node.y), copyToAll<0>(node.z), copyToAll<2>(node.x), copyToAll<2>(node.y), copyToAll<2>(node.z), left_near));
+			const Vec4f right_hit = parallelAnd(active, intersectBox(p, copyToAll<1>(node.x), copyToAll<1>(node.y), copyToAll<1>(node.z), copyToAll<3>(node.x), copyToAll<3>(node.y), copyToAll<3>(node.z), right_near));
+			const int left_mask  = _mm_movemask_ps(left_hit.v);
+			const int right_mask = _mm_movemask_ps(right_hit.v);
+
+			if(left_mask != 0)
+			{
+				if(right_mask != 0) // If some rays hit both children:
+				{
+					// Visit the child with the closest near distance over the packet first, push the other one.
+					const float left_min_near  = horizontalMin(condMov(Vec4f(std::numeric_limits<float>::infinity()), left_near,  left_hit).v);
+					const float right_min_near = horizontalMin(condMov(Vec4f(std::numeric_limits<float>::infinity()), right_near, right_hit).v);
+					stack_top++;
+					assert(stack_top < 64);
+					if(left_min_near <= right_min_near)
+					{
+						node_stack[stack_top] = node.child[1];
+						mask_stack[stack_top] = right_mask;
+						near_stack[stack_top] = right_near;
+						cur = node.child[0];
+						mask = left_mask;
+					}
+					else
+					{
+						node_stack[stack_top] = node.child[0];
+						mask_stack[stack_top] = left_mask;
+						near_stack[stack_top] = left_near;
+						cur = node.child[1];
+						mask = right_mask;
+					}
+				}
+				else
+				{
+					cur = node.child[0];
+					mask = left_mask;
+				}
+			}
+			else if(right_mask != 0)
+			{
+				cur = node.child[1];
+				mask = right_mask;
+			}
+			else
+				goto next_stack_entry;
+		}
+
+		{
+			// Current node is a leaf.  Intersect the active rays with each triangle in the leaf.
+			const Vec4f active = laneMaskToVec4f(mask);
+
+			cur ^= 0x80000000; // Zero sign bit
+			const size_t ofs = size_t(cur) >> LEAF_NUM_BITS;
+			const size_t num = size_t(cur) & ((1 << LEAF_NUM_BITS) - 1);
+			for(size_t i=ofs; i<ofs+num; i++)
+			{
+				const uint32 tri_index = leaf_tri_indices[i];
+				const Vec3f& v0 = raymesh->triVertPos(tri_index, 0);
+				const Vec3f& v1 = raymesh->triVertPos(tri_index, 1);
+				const Vec3f& v2 = raymesh->triVertPos(tri_index, 2);
+				const Vec3f e1_ = v1 - v0;
+				const Vec3f e2_ = v2 - v0;
+				const Vec4f e1_x(e1_.x), e1_y(e1_.y), e1_z(e1_.z);
+				const Vec4f e2_x(e2_.x), e2_y(e2_.y), e2_z(e2_.z);
+
+				// Same computation as MollerTrumboreTri::referenceIntersect(), for 4 rays at once.
+				// pvec = cross(dir, e2)
+				const Vec4f pvec_x = p.dir_y * e2_z - p.dir_z * e2_y;
+				const Vec4f pvec_y = p.dir_z * e2_x - p.dir_x * e2_z;
+				const Vec4f pvec_z = p.dir_x * e2_y - p.dir_y * e2_x;
+
+				const Vec4f det = e1_x * pvec_x + e1_y * pvec_y + e1_z * pvec_z;
+				const Vec4f inv_det = div(one, det);
+
+				const Vec4f tvec_x = p.orig_x - Vec4f(v0.x);
+				const Vec4f tvec_y = p.orig_y - Vec4f(v0.y);
+				const Vec4f tvec_z = p.orig_z - Vec4f(v0.z);
+
+				const Vec4f u = (tvec_x * pvec_x + tvec_y * pvec_y + tvec_z * pvec_z) * inv_det;
+
+				// qvec = cross(tvec, e1)
+				const Vec4f qvec_x = tvec_y * e1_z - tvec_z * e1_y;
+				const Vec4f qvec_y = tvec_z * e1_x - tvec_x * e1_z;
+				const Vec4f qvec_z = tvec_x * e1_y - tvec_y * e1_x;
+
+				const Vec4f v = (p.dir_x * qvec_x + p.dir_y * qvec_y + p.dir_z * qvec_z) * inv_det;
+				const Vec4f t = (e2_x * qvec_x + e2_y * qvec_y + e2_z * qvec_z) * inv_det;
+
+				const Vec4f hit = parallelAnd(
+					parallelAnd(
+						parallelAnd(parallelGreaterEqual(u, zero), parallelLessEqual(u, one)), // u >= 0 && u <= 1
+						parallelAnd(parallelGreaterEqual(v, zero), parallelLessEqual(u + v, one)) // v >= 0 && u + v <= 1
+					),
+					parallelAnd(
+						parallelAnd(parallelGreaterEqual(t, zero), parallelGreaterEqual(t, p.min_t)), // t >= 0 && t >= min_t
+						parallelAnd(parallelLessThan(t, p.max_t), active) // t < max_t
+					)
+				);
+
+				const int tri_hit_mask = _mm_movemask_ps(hit.v);
+				if(tri_hit_mask != 0)
+				{
+					p.max_t = condMov(p.max_t, t, hit);
+					hit_u   = condMov(hit_u, u, hit);
+					hit_v   = condMov(hit_v, v, hit);
+					hit_tri = bitcastToVec4i(condMov(bitcastToVec4f(hit_tri), bitcastToVec4f(Vec4i((int)tri_index)), hit));
+					hit_mask |= tri_hit_mask;
+				}
+			}
+		}
+next_stack_entry:;
+	}
+
+	hit_u_out = hit_u;
+	hit_v_out = hit_v;
+	hit_tri_out = hit_tri;
+	return hit_mask;
+}
+
+
+// See description at top of file.
+template <class NodeType, int LEAF_NUM_BITS>
+void traceRays(const Tree& tree, const NodeType* nodes, int32 root_node_index, const uint32* leaf_tri_indices, const RayMesh* raymesh,
+	const RayBatch& rays, HitInfo* hitinfos_out, Tree::DistType* dists_out)
+{
+	const size_t N = rays.size();
+
+	const Vec4f root_diagonal = tree.getAABBox().max_ - tree.getAABBox().min_;
+	const float max_origin_dist2 = dot(root_diagonal, root_diagonal) * (MAX_PACKET_ORIGIN_DIST_FRACTION * MAX_PACKET_ORIGIN_DIST_FRACTION);
+
+	// Sort the ray indices into a stream per direction octant, so that rays in a packet have the same direction signs.
+	size_t octant_counts[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	std::vector<uint8> octants(N);
+	for(size_t i=0; i<N; ++i)
+	{
+		const uint8 octant = (uint8)((rays.dir_x[i] < 0 ? 1 : 0) | (rays.dir_y[i] < 0 ? 2 : 0) | (rays.dir_z[i] < 0 ? 4 : 0));
+		octants[i] = octant;
+		octant_counts[octant]++;
+	}
+
+	size_t octant_begin[9];
+	octant_begin[0] = 0;
+	for(int i=0; i<8; ++i)
+		octant_begin[i + 1] = octant_begin[i] + octant_counts[i];
+
+	std::vector<uint32> order(N);
+	{
+		size_t write_i[8];
+		for(int i=0; i<8; ++i)
+			write_i[i] = octant_begin[i];
+		for(size_t i=0; i<N; ++i)
+			order[write_i[octants[i]]++] = (uint32)i;
+	}
+
+	for(int octant=0; octant<8; ++octant)
+	{
+		for(size_t z=octant_begin[octant]; z<octant_begin[octant + 1]; z += 4)
+		{
+			const size_t num_lanes = myMin<size_t>(4, octant_begin[octant + 1] - z);
+			const uint32* const lane_ray_indices = &order[z];
+
+			// Decide if the rays are coherent enough to trace as a packet.
+			bool coherent = num_lanes > 1;
+			const uint32 r0 = lane_ray_indices[0];
+			for(size_t l=1; l<num_lanes; ++l)
+			{
+				const uint32 ri = lane_ray_indices[l];
+				const float dx = rays.orig_x[ri] - rays.orig_x[r0];
+				const float dy = rays.orig_y[ri] - rays.orig_y[r0];
+				const float dz = rays.orig_z[ri] - rays.orig_z[r0];
+				if((rays.dir_x[r0] * rays.dir_x[ri] + rays.dir_y[r0] * rays.dir_y[ri] + rays.dir_z[r0] * rays.dir_z[ri] < MIN_PACKET_COS_ANGLE) ||
+					(dx * dx + dy * dy + dz * dz > max_origin_dist2))
+					coherent = false;
+			}
+
+			if(!coherent)
+			{
+				for(size_t l=0; l<num_lanes; ++l)
+				{
+					const uint32 ri = lane_ray_indices[l];
+					dists_out[ri] = tree.traceRay(rays.getRay(ri), hitinfos_out[ri]);
+				}
+				continue;
+			}
+
+			// Gather rays into the packet.  Unused lanes are filled with copies of the first ray, and are masked out.
+			SSE_ALIGN float data[8][4];
+			for(int l=0; l<4; ++l)
+			{
+				const uint32 ri = lane_ray_indices[(size_t)l < num_lanes ? l : 0];
+				data[0][l] = rays.orig_x[ri];
+				data[1][l] = rays.orig_y[ri];
+				data[2][l] = rays.orig_z[ri];
+				data[3][l] = rays.dir_x[ri];
+				data[4][l] = rays.dir_y[ri];
+				data[5][l] = rays.dir_z[ri];
+				data[6][l] = rays.min_t[ri];
+				data[7][l] = rays.max_t[ri];
+			}
+
+			RayPacket packet;
+			packet.orig_x = loadVec4f(data[0]);
+			packet.orig_y = loadVec4f(data[1]);
+			packet.orig_z = loadVec4f(data[2]);
+			packet.dir_x = loadVec4f(data[3]);
+			packet.dir_y = loadVec4f(data[4]);
+			packet.dir_z = loadVec4f(data[5]);
+			packet.recip_dir_x = recipDir(packet.dir_x);
+			packet.recip_dir_y = recipDir(packet.dir_y);
+			packet.recip_dir_z = recipDir(packet.dir_z);
+			packet.min_t = loadVec4f(data[6]);
+			packet.max_t = loadVec4f(data[7]);
+
+			Vec4f hit_u, hit_v;
+			Vec4i hit_tri;
+			const int hit_mask = tracePacket<NodeType, LEAF_NUM_BITS>(nodes, root_node_index, leaf_tri_indices, raymesh, packet, /*active_mask=*/(1 << num_lanes) - 1, hit_u, hit_v, hit_tri);
+
+			for(size_t l=0; l<num_lanes; ++l)
+			{
+				const uint32 ri = lane_ray_indices[l];
+				if(hit_mask & (1 << l))
+				{
+					dists_out[ri] = packet.max_t[(unsigned int)l];
+					hitinfos_out[ri].sub_elem_index = (unsigned int)hit_tri[(unsigned int)l];
+					hitinfos_out[ri].sub_elem_coords.x = hit_u[(unsigned int)l];
+					hitinfos_out[ri].sub_elem_coords.y = hit_v[(unsigned int)l];
+				}
+				else
+					dists_out[ri] = -1;
+			}
+		}
+	}
+}
+
+
+} // end namespace BVHPacketTraversal
+
+
+} // end namespace js
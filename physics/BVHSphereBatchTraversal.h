@@ -0,0 +1,283 @@
+/*=====================================================================
+BVHSphereBatchTraversal.h
+-------------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "SphereQueryBatch.h"
+#include "jscol_aabbox.h"
+#include "../maths/SSE.h"
+#include "../utils/BitUtils.h"
+#include "../utils/TaskManager.h"
+#include <vector>
+#include <algorithm>
+
+
+/*=====================================================================
+BVHSphereBatchTraversal
+-----------------------
+Batched traversal of 2-wide BVHs (BVH, BVHObjectTree) for sphere sweep
+and sphere overlap queries.
+
+Each query is reduced to an AABB: the bounds of the swept sphere, or of
+the static sphere.  Queries are sorted by the Morton code of their AABB
+centroid, then processed in groups of up to GROUP_SIZE.  Each group
+traverses the tree once, with a bit mask of the queries whose AABB
+overlaps each node on the stack.  A child node is visited if any query
+in the mask overlaps it, so nearby queries share node fetches and
+leaf setup work, such as triangle transforms.
+
+The query AABBs of a group are stored in structure-of-arrays form, and
+tested against each child AABB 4 queries at a time with SSE.
+
+Groups are independent, so large batches are split across a TaskManager.
+
+NodeType should have Vec4f x, y, z members, in the
+(left_min, right_min, left_max, right_max) layout, and an int32 child[2] member.
+LEAF_NUM_BITS is the number of bits used to store the number of elements in a leaf.
+=====================================================================*/
+namespace BVHSphereBatchTraversal
+{
+
+
+static const int GROUP_SIZE = 32; // Max number of queries traversing the tree together.  One bit per query in the node masks.
+static const size_t MIN_PARALLEL_NUM_QUERIES = 256; // Batches with fewer queries than this are run on the calling thread.
+
+
+// Query AABBs of a group, in structure-of-arrays form.  Entries past the number of queries in the group are never in a mask, so their values don't matter.
+struct QueryGroupAABBs
+{
+	SSE_ALIGN float min_x[GROUP_SIZE];
+	SSE_ALIGN float min_y[GROUP_SIZE];
+	SSE_ALIGN float min_z[GROUP_SIZE];
+	SSE_ALIGN float max_x[GROUP_SIZE];
+	SSE_ALIGN float max_y[GROUP_SIZE];
+	SSE_ALIGN float max_z[GROUP_SIZE];
+
+	void set(int i, const js::AABBox& aabb)
+	{
+		min_x[i] = aabb.min_[0]; min_y[i] = aabb.min_[1]; min_z[i] = aabb.min_[2];
+		max_x[i] = aabb.max_[0]; max_y[i] = aabb.max_[1]; max_z[i] = aabb.max_[2];
+	}
+};
+
+
+// Returns the mask with a bit set for each query in a group of size group_size.
+static GLARE_STRONG_INLINE uint32 groupMask(int group_size)
+{
+	return (group_size >= 32) ? 0xFFFFFFFFu : ((1u << group_size) - 1);
+}
+
+
+// Returns the mask of queries in query_mask whose AABB overlaps the child AABB with the given min and max coords.
+static GLARE_STRONG_INLINE uint32 childOverlapMask(const QueryGroupAABBs& q, uint32 query_mask, float c_min_x, float c_min_y, float c_min_z, float c_max_x, float c_max_y, float c_max_z)
+{
+	const Vec4f min_x(c_min_x), min_y(c_min_y), min_z(c_min_z);
+	const Vec4f max_x(c_max_x), max_y(c_max_y), max_z(c_max_z);
+
+	uint32 overlap_mask = 0;
+	for(int b=0; b<GROUP_SIZE/4; ++b)
+	{
+		if(((query_mask >> (b * 4)) & 0xF) == 0) // Skip blocks of 4 with no active queries.
+			continue;
+
+		// Same test as AABBox::disjoint(): overlapping if not separated on any axis.
+		const Vec4f sep = parallelOr(
+			parallelOr(parallelLessThan(loadVec4f(&q.max_x[b * 4]), min_x), parallelLessThan(max_x, loadVec4f(&q.min_x[b * 4]))),
+			parallelOr(
+				parallelOr(parallelLessThan(loadVec4f(&q.max_y[b * 4]), min_y), parallelLessThan(max_y, loadVec4f(&q.min_y[b * 4]))),
+				parallelOr(parallelLessThan(loadVec4f(&q.max_z[b * 4]), min_z), parallelLessThan(max_z, loadVec4f(&q.min_z[b * 4])))
+			)
+		);
+		overlap_mask |= (uint32)(~_mm_movemask_ps(sep.v) & 0xF) << (b * 4);
+	}
+	return overlap_mask & query_mask;
+}
+
+
+/*
+Traverses the tree once for a group of queries.
+For each element of each leaf reached, calls leaf_func(leaf_elem_index, mask), where mask is the mask of queries in query_mask whose AABB overlaps the leaf.
+Leaves are reached in the same order as with single query traversal, restricted to the leaves each query overlaps.
+*/
+template <class NodeType, int LEAF_NUM_BITS, class LeafFunc>
+void traverse(const NodeType* nodes, int32 root_node_index, const QueryGroupAABBs& q, uint32 query_mask, LeafFunc& leaf_func)
+{
+	int32 stack[64];
+	uint32 mask_stack[64];
+	int stack_top = 0;
+	stack[0] = root_node_index; // Push root node onto stack
+	mask_stack[0] = query_mask;
+
+stack_pop:
+	while(stack_top >= 0) // While still one or more nodes on the stack:
+	{
+		int32 cur = stack[stack_top];
+		uint32 mask = mask_stack[stack_top];
+		stack_top--;
+
+		while(cur >= 0) // While this is a proper interior node:
+		{
+			const NodeType& node = nodes[cur];
+
+			const uint32 left_mask  = childOverlapMask(q, mask, node.x[0], node.y[0], node.z[0], node.x[2], node.y[2], node.z[2]);
+			const uint32 right_mask = childOverlapMask(q, mask, node.x[1], node.y[1], node.z[1], node.x[3], node.y[3], node.z[3]);
+
+			if(left_mask != 0) // If some queries overlap left
+			{
+				if(right_mask != 0) // If some queries overlap right as well:
+				{
+					// Push left child onto stack
+					assert(stack_top + 1 < 64);
+					stack_top++;
+					stack[stack_top] = node.child[0];
+					mask_stack[stack_top] = left_mask;
+
+					cur = node.child[1];
+					mask = right_mask;
+				}
+				else
+				{
+					cur = node.child[0];
+					mask = left_mask;
+				}
+			}
+			else
+			{
+				if(right_mask != 0)
+				{
+					cur = node.child[1];
+					mask = right_mask;
+				}
+				else
+					goto stack_pop; // No queries overlap either child, pop node off stack
+			}
+		}
+
+		// current node is a leaf.
+		const uint32 leaf = (uint32)cur & 0x7FFFFFFFu; // Zero sign bit
+		const size_t ofs = leaf >> LEAF_NUM_BITS;
+		const size_t num = leaf & ((1u << LEAF_NUM_BITS) - 1);
+		for(size_t i=ofs; i<ofs+num; i++)
+			leaf_func(i, mask);
+	}
+}
+
+
+// Spread the lowest 10 bits of v out so that there are 2 zero bits between each bit.
+static inline uint32 expandBits10(uint32 v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+
+// Computes an order of the queries in which queries close to each other are mostly next to each other, by sorting by the Morton code of the query AABB centroids.
+inline void computeQueryOrder(const js::AABBox* query_aabbs, size_t num_queries, std::vector<uint32>& order_out)
+{
+	order_out.resize(num_queries);
+	if(num_queries <= (size_t)GROUP_SIZE)
+	{
+		// All the queries fit in one group, so the order doesn't matter.
+		for(size_t i=0; i<num_queries; ++i)
+			order_out[i] = (uint32)i;
+		return;
+	}
+
+	js::AABBox centroid_aabb = js::AABBox::emptyAABBox();
+	for(size_t i=0; i<num_queries; ++i)
+		centroid_aabb.enlargeToHoldPoint(query_aabbs[i].centroid());
+
+	const Vec4f scale = div(Vec4f(1023.99f), max(centroid_aabb.max_ - centroid_aabb.min_, Vec4f(1.0e-30f)));
+
+	std::vector<uint64> keys(num_queries);
+	for(size_t i=0; i<num_queries; ++i)
+	{
+		const Vec4f p = max(Vec4f(0.f), min((query_aabbs[i].centroid() - centroid_aabb.min_) * scale, Vec4f(1023.f)));
+		const uint32 code = (expandBits10((uint32)p[0]) << 2) | (expandBits10((uint32)p[1]) << 1) | expandBits10((uint32)p[2]);
+		keys[i] = ((uint64)code << 32) | (uint64)i;
+	}
+
+	std::sort(keys.begin(), keys.end());
+
+	for(size_t i=0; i<num_queries; ++i)
+		order_out[i] = (uint32)keys[i];
+}
+
+
+/*
+Calls group_func(group_index, group_query_indices, group_size) for each group of up to GROUP_SIZE queries, with the query indices of the group taken from order.
+Groups are run in parallel on task_manager if it is non-null and the batch is large enough, otherwise on the calling thread.
+group_func may be called concurrently from different threads.
+*/
+template <class GroupFunc>
+void forEachGroup(const std::vector<uint32>& order, glare::TaskManager* task_manager, const GroupFunc& group_func)
+{
+	const size_t num_queries = order.size();
+	const size_t num_groups = (num_queries + GROUP_SIZE - 1) / GROUP_SIZE;
+
+	if(task_manager && num_queries >= MIN_PARALLEL_NUM_QUERIES)
+	{
+		task_manager->runParallelForDynamic([&](size_t group_begin, size_t group_end, size_t /*thread_index*/)
+		{
+			for(size_t g=group_begin; g<group_end; ++g)
+				group_func(g, &order[g * GROUP_SIZE], (int)myMin<size_t>(GROUP_SIZE, num_queries - g * GROUP_SIZE));
+		}, /*begin=*/0, /*end=*/num_groups, /*grain_size=*/1);
+	}
+	else
+	{
+		for(size_t g=0; g<num_groups; ++g)
+			group_func(g, &order[g * GROUP_SIZE], (int)myMin<size_t>(GROUP_SIZE, num_queries - g * GROUP_SIZE));
+	}
+}
+
+
+// Results of the queries in a group that return a variable number of results, in the order they were found.
+template <class T>
+struct GroupResults
+{
+	std::vector<T> items;
+	std::vector<uint8> item_queries; // Index of the query in the group, for each item.
+};
+
+
+/*
+Combines the per-group results into results_out.
+The results for each query are stored in the order they were found.
+*/
+template <class T>
+void combineGroupResults(const std::vector<uint32>& order, const std::vector<GroupResults<T> >& group_results, BatchQueryResults<T>& results_out)
+{
+	const size_t num_queries = order.size();
+
+	// Count the results for each query
+	results_out.offsets.assign(num_queries + 1, 0);
+	for(size_t g=0; g<group_results.size(); ++g)
+	{
+		const GroupResults<T>& group = group_results[g];
+		for(size_t i=0; i<group.item_queries.size(); ++i)
+			results_out.offsets[order[g * GROUP_SIZE + group.item_queries[i]] + 1]++;
+	}
+
+	// Prefix sum to get offsets
+	for(size_t i=0; i<num_queries; ++i)
+		results_out.offsets[i + 1] += results_out.offsets[i];
+
+	results_out.results.resize(results_out.offsets[num_queries]);
+
+	std::vector<uint32> write_i(results_out.offsets.begin(), results_out.offsets.end() - 1);
+	for(size_t g=0; g<group_results.size(); ++g)
+	{
+		const GroupResults<T>& group = group_results[g];
+		for(size_t i=0; i<group.items.size(); ++i)
+			results_out.results[write_i[order[g * GROUP_SIZE + group.item_queries[i]]]++] = group.items[i];
+	}
+}
+
+
+} // end namespace BVHSphereBatchTraversal
@@ -98,6 +98,13 @@ BinningBVHBuilder::~BinningBVHBuilder()
 }
 
 
+void BinningBVHBuilder::setRootAABBs(const js::AABBox& root_aabb_, const js::AABBox& root_centroid_aabb_)
+{
+	root_aabb = root_aabb_;
+	root_centroid_aabb = root_centroid_aabb_;
+}
+
+
 BinningBVHBuildStats::BinningBVHBuildStats()
 {
 	num_maxdepth_leaves = 0;
@@ -311,14 +318,15 @@ void BinningBVHBuilder::build(
 	//timer.reset();
 	//Timer timer;
 
-	js::Vector<uint32, 16> final_node_indices(result_chunks.size() * BinningResultChunk::MAX_RESULT_CHUNK_SIZE);
+	// Nodes in chunk c are at final positions chunk_final_offsets[c], chunk_final_offsets[c] + 1, ...
+	// Node indices in the chunks are of the form c * MAX_RESULT_CHUNK_SIZE + i, so the final index of such a node is chunk_final_offsets[c] + i.
+	const size_t num_chunks = result_chunks.size();
+	js::Vector<uint32, 16> chunk_final_offsets(num_chunks);
 	uint32 write_i = 0;
-	for(size_t c=0; c<result_chunks.size(); ++c)
+	for(size_t c=0; c<num_chunks; ++c)
 	{
-		for(size_t i=0; i<result_chunks[c]->size; ++i)
-		{
-			final_node_indices[c * BinningResultChunk::MAX_RESULT_CHUNK_SIZE + i] = write_i++;
-		}
+		chunk_final_offsets[c] = write_i;
+		write_i += (uint32)result_chunks[c]->size;
 	}
 
 #ifndef NDEBUG
@@ -326,32 +334,35 @@ void BinningBVHBuilder::build(
 #endif
 	result_nodes_out.resizeNoCopy(write_i);
 
-	for(size_t c=0; c<result_chunks.size(); ++c)
+	// Copy the chunks to the final array in parallel, one chunk per work item.
+	task_manager->runParallelForDynamic([&](size_t chunk_begin, size_t chunk_end, size_t /*thread_index*/)
 	{
-		const BinningResultChunk& chunk = *result_chunks[c];
-		size_t src_node_i = c * BinningResultChunk::MAX_RESULT_CHUNK_SIZE;
-
-		for(size_t i=0; i<chunk.size; ++i)
+		for(size_t c=chunk_begin; c<chunk_end; ++c)
 		{
-			ResultNode chunk_node = chunk.nodes[i];
+			const BinningResultChunk& chunk = *result_chunks[c];
+			ResultNode* const final_nodes = &result_nodes_out[chunk_final_offsets[c]];
 
-			// If this is an interior node, we need to fix up some links.
-			if(chunk_node.interior)
+			for(size_t i=0; i<chunk.size; ++i)
 			{
-				chunk_node.left  = final_node_indices[chunk_node.left];
-				chunk_node.right = final_node_indices[chunk_node.right];
+				ResultNode chunk_node = chunk.nodes[i];
 
-				assert(chunk_node.left  >= 0 && chunk_node.left  < total_num_nodes);
-				assert(chunk_node.right >= 0 && chunk_node.right < total_num_nodes);
-			}
+				// If this is an interior node, we need to fix up some links.
+				if(chunk_node.interior)
+				{
+					chunk_node.left  = (int)(chunk_final_offsets[chunk_node.left  / BinningResultChunk::MAX_RESULT_CHUNK_SIZE] + chunk_node.left  % BinningResultChunk::MAX_RESULT_CHUNK_SIZE);
+					chunk_node.right = (int)(chunk_final_offsets[chunk_node.right / BinningResultChunk::MAX_RESULT_CHUNK_SIZE] + chunk_node.right % BinningResultChunk::MAX_RESULT_CHUNK_SIZE);
+
+					assert(chunk_node.left  >= 0 && chunk_node.left  < total_num_nodes);
+					assert(chunk_node.right >= 0 && chunk_node.right < total_num_nodes);
+				}
 
-			const uint32 final_pos = final_node_indices[src_node_i];
-			result_nodes_out[final_pos] = chunk_node; // Copy node to final array
-			src_node_i++;
+				final_nodes[i] = chunk_node; // Copy node to final array
+			}
 		}
+	}, /*begin=*/0, /*end=*/num_chunks, /*grain_size=*/1);
 
+	for(size_t c=0; c<num_chunks; ++c)
 		delete result_chunks[c];
-	}
 	result_chunks.clear();
 
 
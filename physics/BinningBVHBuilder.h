@@ -107,6 +107,10 @@ public:
 
 	inline void setObjectAABB(int ob_i, const js::AABBox& aabb); // ob_i should be < num_objects constructor arg.
 
+	// For setting object AABBs from multiple threads: doesn't update the root AABB.  setRootAABBs() must be called once all object AABBs are set.
+	inline void setObjectAABBNoRootUpdate(int ob_i, const js::AABBox& aabb);
+	void setRootAABBs(const js::AABBox& root_aabb, const js::AABBox& root_centroid_aabb);
+
 	// Throws glare::CancelledException if cancelled.
 	virtual void build(
 		glare::TaskManager& task_manager,
@@ -179,3 +183,9 @@ void BinningBVHBuilder::setObjectAABB(int ob_i, const js::AABBox& aabb)
 
 	objects[ob_i].set(aabb, ob_i);
 }
+
+
+void BinningBVHBuilder::setObjectAABBNoRootUpdate(int ob_i, const js::AABBox& aabb)
+{
+	objects[ob_i].set(aabb, ob_i);
+}
@@ -0,0 +1,676 @@
+/*=====================================================================
+MortonBVHBuilder.cpp
+--------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#include "MortonBVHBuilder.h"
+
+
+#include "../utils/TaskManager.h"
+#include "../utils/ShouldCancelCallback.h"
+#include "../utils/Sort.h"
+#include "../utils/BitUtils.h"
+#include "../utils/Timer.h"
+#include "../utils/Exception.h"
+#include <algorithm>
+
+
+static const js::AABBox empty_aabb = js::AABBox::emptyAABBox();
+
+static const int MAX_TREELET_LEAVES = 5;
+static const int PARALLEL_SORT_MIN_NUM_OBS = 1 << 16; // Use a serial radix sort for fewer objects than this.
+static const int SORT_BUCKET_SHIFT = 19; // The parallel sort first partitions objects into buckets by the top 11 bits of their 30-bit codes.
+
+
+MortonBVHBuilder::MortonBVHBuilder(int leaf_num_object_threshold_, int max_num_objects_per_leaf_, int max_depth_, float intersection_cost_,
+		const int num_objects_)
+:	leaf_num_object_threshold(leaf_num_object_threshold_),
+	max_num_objects_per_leaf(max_num_objects_per_leaf_),
+	max_depth(max_depth_),
+	intersection_cost(intersection_cost_),
+	max_leaf_depth(0),
+	do_treelet_optimisation(false),
+	morton_code_time(0),
+	sort_time(0),
+	hierarchy_time(0),
+	bottom_up_time(0),
+	emit_time(0)
+{
+	assert(intersection_cost > 0.f);
+	assert(leaf_num_object_threshold >= 1);
+	assert(max_num_objects_per_leaf >= leaf_num_object_threshold);
+
+	m_num_objects = num_objects_;
+	root_aabb = empty_aabb;
+	root_centroid_aabb = empty_aabb;
+
+	ob_aabbs.resizeNoCopy(myMax(num_objects_, 0));
+}
+
+
+MortonBVHBuilder::~MortonBVHBuilder()
+{}
+
+
+void MortonBVHBuilder::setRootAABBs(const js::AABBox& root_aabb_, const js::AABBox& root_centroid_aabb_)
+{
+	root_aabb = root_aabb_;
+	root_centroid_aabb = root_centroid_aabb_;
+}
+
+
+// Spread the lowest 10 bits of v out so that there are 2 zero bits between each bit.
+static inline uint32 expandBits10(uint32 v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+
+void MortonBVHBuilder::computeMortonCodes(glare::TaskManager& task_manager)
+{
+	const Vec4f centroid_min = root_centroid_aabb.min_;
+	const Vec4f extent = root_centroid_aabb.max_ - root_centroid_aabb.min_;
+	const Vec4f scale(
+		extent[0] > 0 ? 1024.f / extent[0] : 0.f,
+		extent[1] > 0 ? 1024.f / extent[1] : 0.f,
+		extent[2] > 0 ? 1024.f / extent[2] : 0.f,
+		0.f
+	);
+
+	const js::AABBox* const aabbs = ob_aabbs.data();
+	MortonOb* const obs = temp_obs.data();
+
+	task_manager.runParallelForDynamic([&](size_t begin, size_t end, size_t /*thread_index*/)
+	{
+		for(size_t i=begin; i<end; ++i)
+		{
+			const Vec4f q = min(mul(aabbs[i].centroid() - centroid_min, scale), Vec4f(1023.f));
+			const Vec4i qi = truncateToVec4i(q); // Integer cell coordinates in [0, 1023].
+			obs[i].code = (expandBits10((uint32)qi[0]) << 2) | (expandBits10((uint32)qi[1]) << 1) | expandBits10((uint32)qi[2]);
+			obs[i].ob_index = (uint32)i;
+		}
+	}, 0, m_num_objects, /*grain_size=*/4096);
+}
+
+
+struct MortonObCode
+{
+	inline uint32 operator() (const MortonOb& ob) const { return ob.code; }
+};
+
+struct MortonObBucket
+{
+	inline size_t operator() (const MortonOb& ob) const { return ob.code >> SORT_BUCKET_SHIFT; }
+};
+
+
+// Sorts temp_obs by Morton code into sorted_obs.  The sort is stable, so the result is deterministic.
+void MortonBVHBuilder::sortObjects(glare::TaskManager& task_manager)
+{
+	const size_t num_obs = m_num_objects;
+
+	if(num_obs < PARALLEL_SORT_MIN_NUM_OBS)
+	{
+		js::Vector<uint32, 16> temp_counts(6144);
+		std::memcpy(sorted_obs.data(), temp_obs.data(), num_obs * sizeof(MortonOb));
+		Sort::radixSort32BitKey(sorted_obs.data(), temp_obs.data(), num_obs, MortonObCode(), temp_counts.data(), temp_counts.size());
+		return;
+	}
+
+	// Partition by the top bits of the codes in parallel, then radix sort each bucket in parallel.
+	Sort::parallelCountingSort(task_manager, temp_obs.data(), sorted_obs.data(), num_obs, MortonObBucket());
+
+	const size_t num_buckets = (size_t)1 << (30 - SORT_BUCKET_SHIFT);
+	js::Vector<size_t, 16> bucket_begin(num_buckets + 1);
+	for(size_t b=0; b<=num_buckets; ++b)
+		bucket_begin[b] = std::lower_bound(sorted_obs.data(), sorted_obs.data() + num_obs, (uint32)(b << SORT_BUCKET_SHIFT),
+			[](const MortonOb& ob, uint32 code) { return ob.code < code; }) - sorted_obs.data();
+
+	MortonOb* const sorted = sorted_obs.data();
+	MortonOb* const working = temp_obs.data();
+	task_manager.runParallelForDynamic([&](size_t begin, size_t end, size_t /*thread_index*/)
+	{
+		uint32 temp_counts[6144];
+		for(size_t b=begin; b<end; ++b)
+		{
+			const size_t bucket_size = bucket_begin[b + 1] - bucket_begin[b];
+			if(bucket_size > 1)
+				Sort::radixSort32BitKey(sorted + bucket_begin[b], working + bucket_begin[b], bucket_size, MortonObCode(), temp_counts, 6144);
+		}
+	}, 0, num_buckets, /*grain_size=*/16);
+}
+
+
+// Returns the length of the longest common prefix of the keys of sorted objects i and j, or -1 if j is out of range.
+// The key is the Morton code with the sorted position appended, which makes keys unique.
+static inline int commonPrefixLength(const MortonOb* obs, int64 num_obs, int64 i, int64 j)
+{
+	if(j < 0 || j >= num_obs)
+		return -1;
+	const uint32 a = obs[i].code;
+	const uint32 b = obs[j].code;
+	if(a == b)
+		return 32 + (31 - (int)BitUtils::highestSetBitIndex((uint32)(i ^ j)));
+	else
+		return 31 - (int)BitUtils::highestSetBitIndex(a ^ b);
+}
+
+
+// Computes the children of every interior node, in parallel.  Interior node i covers a range of sorted objects with one end at i.  See Karras 2012.
+void MortonBVHBuilder::emitHierarchy(glare::TaskManager& task_manager)
+{
+	const int64 num_obs = m_num_objects;
+	const MortonOb* const obs = sorted_obs.data();
+	MortonBuildNode* const nodes_ = nodes.data();
+	int32* const ob_parents_ = ob_parents.data();
+
+	nodes_[0].parent = -1;
+
+	task_manager.runParallelForDynamic([&](size_t begin, size_t end, size_t /*thread_index*/)
+	{
+		for(int64 i=(int64)begin; i<(int64)end; ++i)
+		{
+			// Determine direction of the range
+			const int d = (commonPrefixLength(obs, num_obs, i, i + 1) - commonPrefixLength(obs, num_obs, i, i - 1)) >= 0 ? 1 : -1;
+
+			// Compute upper bound for the length of the range
+			const int delta_min = commonPrefixLength(obs, num_obs, i, i - d);
+			int64 l_max = 2;
+			while(commonPrefixLength(obs, num_obs, i, i + l_max * d) > delta_min)
+				l_max *= 2;
+
+			// Find the other end using binary search
+			int64 l = 0;
+			for(int64 t = l_max / 2; t >= 1; t /= 2)
+				if(commonPrefixLength(obs, num_obs, i, i + (l + t) * d) > delta_min)
+					l += t;
+			const int64 j = i + l * d;
+
+			// Find the split position using binary search
+			const int delta_node = commonPrefixLength(obs, num_obs, i, j);
+			int64 s = 0;
+			int64 t = l;
+			do
+			{
+				t = (t + 1) / 2;
+				if(commonPrefixLength(obs, num_obs, i, i + (s + t) * d) > delta_node)
+					s += t;
+			}
+			while(t > 1);
+			const int64 split = i + s * d + myMin(d, 0);
+
+			MortonBuildNode& node = nodes_[i];
+			if(myMin(i, j) == split)
+			{
+				node.child[0] = ~(int32)split;
+				ob_parents_[split] = (int32)i;
+			}
+			else
+			{
+				node.child[0] = (int32)split;
+				nodes_[split].parent = (int32)i;
+			}
+
+			if(myMax(i, j) == split + 1)
+			{
+				node.child[1] = ~(int32)(split + 1);
+				ob_parents_[split + 1] = (int32)i;
+			}
+			else
+			{
+				node.child[1] = (int32)(split + 1);
+				nodes_[split + 1].parent = (int32)i;
+			}
+		}
+	}, 0, num_obs - 1, /*grain_size=*/1024);
+}
+
+
+// Computes the AABB, SAH cost etc. of an interior node from its children, and decides if the subtree should be collapsed into a leaf.
+void MortonBVHBuilder::computeNodeFromChildren(int node_index)
+{
+	MortonBuildNode& node = nodes[node_index];
+
+	js::AABBox aabb = empty_aabb;
+	float child_cost_sum = 0;
+	int num_obs = 0;
+	int num_result_nodes = 1;
+	int height = 0;
+	for(int c=0; c<2; ++c)
+	{
+		const int32 child = node.child[c];
+		if(child >= 0)
+		{
+			const MortonBuildNode& child_node = nodes[child];
+			aabb.enlargeToHoldAABBox(child_node.aabb);
+			child_cost_sum += child_node.cost;
+			num_obs += child_node.num_obs;
+			num_result_nodes += child_node.num_result_nodes;
+			height = myMax(height, child_node.height + 1);
+		}
+		else
+		{
+			const js::AABBox& ob_aabb = sorted_aabbs[~child];
+			aabb.enlargeToHoldAABBox(ob_aabb);
+			child_cost_sum += ob_aabb.getHalfSurfaceArea() * intersection_cost;
+			num_obs += 1;
+			num_result_nodes += 1;
+			height = myMax(height, 1);
+		}
+	}
+
+	const float area = aabb.getHalfSurfaceArea();
+	const float interior_cost = area + child_cost_sum; // Traversal cost is 1.
+	const float leaf_cost = area * (float)num_obs * intersection_cost;
+	const bool make_leaf = (num_obs <= leaf_num_object_threshold) || (num_obs <= max_num_objects_per_leaf && leaf_cost <= interior_cost);
+
+	node.aabb = aabb;
+	node.num_obs = num_obs;
+	node.make_leaf = make_leaf;
+	if(make_leaf)
+	{
+		node.cost = leaf_cost;
+		node.num_result_nodes = 1;
+		node.height = 0;
+	}
+	else
+	{
+		node.cost = interior_cost;
+		node.num_result_nodes = num_result_nodes;
+		node.height = height;
+	}
+}
+
+
+// Restructures the treelet rooted at root_index to the topology with the lowest SAH cost, if that is lower than the current cost.
+// The treelet is formed by repeatedly expanding the treelet leaf with the largest surface area, up to MAX_TREELET_LEAVES leaves.
+// The optimal topology is found by dynamic programming over all subsets of treelet leaves.  See Karras and Aila 2013.
+void MortonBVHBuilder::optimiseTreelet(int root_index)
+{
+	int32 leaves[MAX_TREELET_LEAVES];
+	int32 interior[MAX_TREELET_LEAVES - 1]; // Treelet interior node indices, which will be reused for the new topology.
+	leaves[0] = nodes[root_index].child[0];
+	leaves[1] = nodes[root_index].child[1];
+	interior[0] = root_index;
+	int num_leaves = 2;
+	int num_interior = 1;
+
+	while(num_leaves < MAX_TREELET_LEAVES)
+	{
+		int best = -1;
+		float best_area = -1;
+		for(int i=0; i<num_leaves; ++i)
+			if(leaves[i] >= 0)
+			{
+				const float area = nodes[leaves[i]].aabb.getHalfSurfaceArea();
+				if(area > best_area)
+				{
+					best_area = area;
+					best = i;
+				}
+			}
+		if(best < 0)
+			break;
+
+		const int32 expanded = leaves[best];
+		interior[num_interior++] = expanded;
+		leaves[best] = nodes[expanded].child[0];
+		leaves[num_leaves++] = nodes[expanded].child[1];
+	}
+
+	if(num_leaves < 3)
+		return;
+
+	const uint32 num_subsets = 1u << num_leaves;
+	js::AABBox subset_aabb[1 << MAX_TREELET_LEAVES];
+	float subset_cost[1 << MAX_TREELET_LEAVES];
+	int subset_num_obs[1 << MAX_TREELET_LEAVES];
+	uint8 subset_partition[1 << MAX_TREELET_LEAVES];
+
+	for(int i=0; i<num_leaves; ++i)
+	{
+		const uint32 s = 1u << i;
+		if(leaves[i] >= 0)
+		{
+			const MortonBuildNode& leaf = nodes[leaves[i]];
+			subset_aabb[s] = leaf.aabb;
+			subset_cost[s] = leaf.cost;
+			subset_num_obs[s] = leaf.num_obs;
+		}
+		else
+		{
+			subset_aabb[s] = sorted_aabbs[~leaves[i]];
+			subset_cost[s] = subset_aabb[s].getHalfSurfaceArea() * intersection_cost;
+			subset_num_obs[s] = 1;
+		}
+	}
+
+	// Proper subsets of s are numerically less than s, so processing subsets in increasing order means costs of all proper subsets are known.
+	for(uint32 s=1; s<num_subsets; ++s)
+	{
+		const uint32 lowest_bit = s & (~s + 1);
+		if(s == lowest_bit) // If s is a single leaf:
+			continue;
+
+		const uint32 rest = s ^ lowest_bit;
+		subset_aabb[s] = AABBUnion(subset_aabb[lowest_bit], subset_aabb[rest]);
+		subset_num_obs[s] = subset_num_obs[lowest_bit] + subset_num_obs[rest];
+
+		// Find the best partition of s into two non-empty subsets.  Only consider partitions where the first subset contains the lowest bit, to skip mirrored partitions.
+		float best_cost = std::numeric_limits<float>::infinity();
+		uint32 best_partition = lowest_bit;
+		for(uint32 p = (s - 1) & s; p != 0; p = (p - 1) & s)
+			if(p & lowest_bit)
+			{
+				const float cost = subset_cost[p] + subset_cost[s ^ p];
+				if(cost < best_cost)
+				{
+					best_cost = cost;
+					best_partition = p;
+				}
+			}
+
+		const float area = subset_aabb[s].getHalfSurfaceArea();
+		const float interior_cost = area + best_cost;
+		const float leaf_cost = area * (float)subset_num_obs[s] * intersection_cost;
+		const bool make_leaf = (subset_num_obs[s] <= leaf_num_object_threshold) || (subset_num_obs[s] <= max_num_objects_per_leaf && leaf_cost <= interior_cost);
+		subset_cost[s] = make_leaf ? leaf_cost : interior_cost;
+		subset_partition[s] = (uint8)best_partition;
+	}
+
+	if(!(subset_cost[num_subsets - 1] < nodes[root_index].cost * 0.9999f))
+		return; // Not a significant improvement.
+
+	// Rebuild the treelet with the optimal topology.  The root node keeps its index.
+	// Work on the subsets with an explicit stack, then compute the nodes from their children in reverse order, so children are computed before parents.
+	int32 subset_node[1 << MAX_TREELET_LEAVES];
+	uint32 stack[MAX_TREELET_LEAVES];
+	uint32 order[MAX_TREELET_LEAVES];
+	int stack_size = 0;
+	int order_size = 0;
+	int next_interior = 1;
+	subset_node[num_subsets - 1] = root_index;
+	stack[stack_size++] = num_subsets - 1;
+	while(stack_size > 0)
+	{
+		const uint32 s = stack[--stack_size];
+		order[order_size++] = s;
+		const int32 node_index = subset_node[s];
+
+		const uint32 parts[2] = { subset_partition[s], s ^ subset_partition[s] };
+		for(int c=0; c<2; ++c)
+		{
+			const uint32 part = parts[c];
+			int32 child;
+			if((part & (part - 1)) == 0) // If part is a single leaf:
+			{
+				child = leaves[BitUtils::lowestSetBitIndex(part)];
+			}
+			else
+			{
+				child = interior[next_interior++];
+				subset_node[part] = child;
+				stack[stack_size++] = part;
+			}
+
+			nodes[node_index].child[c] = child;
+			if(child >= 0)
+				nodes[child].parent = node_index;
+			else
+				ob_parents[~child] = node_index;
+		}
+	}
+	assert(next_interior == num_interior);
+
+	for(int i=order_size-1; i>=0; --i)
+		computeNodeFromChildren(subset_node[order[i]]);
+}
+
+
+void MortonBVHBuilder::processNodeBottomUp(int node_index, bool do_treelets)
+{
+	computeNodeFromChildren(node_index);
+
+	if(do_treelets && nodes[node_index].num_obs >= MAX_TREELET_LEAVES)
+		optimiseTreelet(node_index);
+}
+
+
+// Computes node AABBs and costs in a parallel bottom-up pass.  For each object, walks up the tree from the object.
+// The first walk to reach an interior node stops there, the second one processes the node, as both children of the node are then done.
+void MortonBVHBuilder::computeNodeAABBsAndCosts(glare::TaskManager& task_manager, bool do_treelets)
+{
+	const size_t num_interior_nodes = m_num_objects - 1;
+	if(node_visit_counts.size() < num_interior_nodes)
+		node_visit_counts.resize(num_interior_nodes);
+
+	task_manager.runParallelForDynamic([&](size_t begin, size_t end, size_t /*thread_index*/)
+	{
+		for(size_t i=begin; i<end; ++i)
+			node_visit_counts[i] = 0;
+	}, 0, num_interior_nodes, /*grain_size=*/16384);
+
+	task_manager.runParallelForDynamic([&](size_t begin, size_t end, size_t /*thread_index*/)
+	{
+		for(size_t i=begin; i<end; ++i)
+		{
+			int node_index = ob_parents[i];
+			while(node_index >= 0)
+			{
+				if(node_visit_counts[node_index].increment() == 0)
+					break; // Other child is not done yet.
+
+				processNodeBottomUp(node_index, do_treelets);
+
+				node_index = nodes[node_index].parent; // NOTE: treelet restructuring doesn't change the parent of the treelet root.
+			}
+		}
+	}, 0, m_num_objects, /*grain_size=*/1024);
+}
+
+
+void MortonBVHBuilder::writeSubtreeObIndices(int32 node_ref, uint32& write_i)
+{
+	if(node_ref < 0)
+	{
+		result_indices[write_i++] = sorted_obs[~node_ref].ob_index;
+	}
+	else
+	{
+		writeSubtreeObIndices(nodes[node_ref].child[0], write_i);
+		writeSubtreeObIndices(nodes[node_ref].child[1], write_i);
+	}
+}
+
+
+// Converts the subtree to ResultNodes starting at result_index, with objects starting at ob_begin in result_indices.
+void MortonBVHBuilder::emitSubtree(int32 node_ref, uint32 result_index, uint32 ob_begin, int depth, js::Vector<ResultNode, 64>& result_nodes_out)
+{
+	ResultNode& result_node = result_nodes_out[result_index];
+	result_node.right_child_chunk_index = -1;
+	result_node.depth = (uint8)depth;
+
+	if(node_ref < 0 || nodes[node_ref].make_leaf)
+	{
+		uint32 write_i = ob_begin;
+		writeSubtreeObIndices(node_ref, write_i);
+
+		result_node.aabb = (node_ref < 0) ? sorted_aabbs[~node_ref] : nodes[node_ref].aabb;
+		result_node.interior = false;
+		result_node.left = (int)ob_begin;
+		result_node.right = (int)write_i;
+	}
+	else
+	{
+		const MortonBuildNode& node = nodes[node_ref];
+		const int32 left = node.child[0];
+		const uint32 left_num_result_nodes = (left < 0) ? 1 : nodes[left].num_result_nodes;
+		const uint32 left_num_obs          = (left < 0) ? 1 : nodes[left].num_obs;
+
+		result_node.aabb = node.aabb;
+		result_node.interior = true;
+		result_node.left = (int)(result_index + 1);
+		result_node.right = (int)(result_index + 1 + left_num_result_nodes);
+
+		emitSubtree(left,          result_index + 1,                         ob_begin,                depth + 1, result_nodes_out);
+		emitSubtree(node.child[1], result_index + 1 + left_num_result_nodes, ob_begin + left_num_obs, depth + 1, result_nodes_out);
+	}
+}
+
+
+struct MortonEmitWorkItem
+{
+	int32 node_ref;
+	uint32 result_index;
+	uint32 ob_begin;
+	int depth;
+};
+
+
+// Converts the tree to ResultNodes.  Since we know the number of result nodes and objects in each subtree, the position of each subtree
+// in result_nodes_out and result_indices is known in advance, so subtrees can be converted in parallel.
+void MortonBVHBuilder::emitResultNodes(glare::TaskManager& task_manager, js::Vector<ResultNode, 64>& result_nodes_out)
+{
+	result_nodes_out.resizeNoCopy(nodes[0].num_result_nodes);
+	result_indices.resizeNoCopy(m_num_objects);
+
+	const int task_num_obs_threshold = myMax(1024, m_num_objects / (int)(task_manager.getConcurrency() * 8));
+
+	// Convert the top of the tree serially, splitting off subtrees with few enough objects as work items.
+	std::vector<MortonEmitWorkItem> work_items;
+	std::vector<MortonEmitWorkItem> stack(1);
+	stack[0].node_ref = 0;
+	stack[0].result_index = 0;
+	stack[0].ob_begin = 0;
+	stack[0].depth = 0;
+	while(!stack.empty())
+	{
+		const MortonEmitWorkItem item = stack.back();
+		stack.pop_back();
+
+		const MortonBuildNode& node = nodes[item.node_ref];
+		if(node.num_obs <= task_num_obs_threshold || node.make_leaf)
+		{
+			work_items.push_back(item);
+			continue;
+		}
+
+		ResultNode& result_node = result_nodes_out[item.result_index];
+		const int32 left = node.child[0];
+		const int32 right = node.child[1];
+		const uint32 left_num_result_nodes = (left < 0) ? 1 : nodes[left].num_result_nodes;
+		const uint32 left_num_obs          = (left < 0) ? 1 : nodes[left].num_obs;
+
+		result_node.aabb = node.aabb;
+		result_node.interior = true;
+		result_node.left = (int)(item.result_index + 1);
+		result_node.right = (int)(item.result_index + 1 + left_num_result_nodes);
+		result_node.right_child_chunk_index = -1;
+		result_node.depth = (uint8)item.depth;
+
+		const MortonEmitWorkItem left_item  = { left,  item.result_index + 1,                         item.ob_begin,                item.depth + 1 };
+		const MortonEmitWorkItem right_item = { right, item.result_index + 1 + left_num_result_nodes, item.ob_begin + left_num_obs, item.depth + 1 };
+		if(left < 0)
+			work_items.push_back(left_item);
+		else
+			stack.push_back(left_item);
+		if(right < 0)
+			work_items.push_back(right_item);
+		else
+			stack.push_back(right_item);
+	}
+
+	task_manager.runParallelForDynamic([&](size_t begin, size_t end, size_t /*thread_index*/)
+	{
+		for(size_t i=begin; i<end; ++i)
+			emitSubtree(work_items[i].node_ref, work_items[i].result_index, work_items[i].ob_begin, work_items[i].depth, result_nodes_out);
+	}, 0, work_items.size(), /*grain_size=*/1);
+}
+
+
+void MortonBVHBuilder::build(
+		glare::TaskManager& task_manager,
+		ShouldCancelCallback& should_cancel_callback,
+		PrintOutput& print_output,
+		js::Vector<ResultNode, 64>& result_nodes_out
+	)
+{
+	// Flush denormals to zero.  This is important otherwise w values storing low integer values get interpreted as denormals, which drastically reduces performance.
+	SetFlushDenormsMode flusher;
+
+	morton_code_time = sort_time = hierarchy_time = bottom_up_time = emit_time = 0;
+
+	const int num_objects = m_num_objects;
+	if(num_objects <= 1)
+	{
+		// Create root node, and mark it as a leaf.
+		result_nodes_out.resizeNoCopy(1);
+		result_nodes_out[0].aabb = (num_objects == 1) ? ob_aabbs[0] : empty_aabb;
+		result_nodes_out[0].interior = false;
+		result_nodes_out[0].left = 0;
+		result_nodes_out[0].right = myMax(num_objects, 0);
+		result_nodes_out[0].right_child_chunk_index = -1;
+		result_nodes_out[0].depth = 0;
+
+		result_indices.resizeNoCopy(myMax(num_objects, 0));
+		if(num_objects == 1)
+			result_indices[0] = 0;
+		max_leaf_depth = 0;
+		return;
+	}
+
+	Timer timer;
+	temp_obs.resizeNoCopy(num_objects);
+	sorted_obs.resizeNoCopy(num_objects);
+	computeMortonCodes(task_manager);
+	morton_code_time = timer.elapsed();
+
+	timer.reset();
+	sortObjects(task_manager);
+	sort_time = timer.elapsed();
+
+	if(should_cancel_callback.shouldCancel())
+		throw glare::CancelledException();
+
+	sorted_aabbs.resizeNoCopy(num_objects);
+	task_manager.runParallelForDynamic([&](size_t begin, size_t end, size_t /*thread_index*/)
+	{
+		for(size_t i=begin; i<end; ++i)
+			sorted_aabbs[i] = ob_aabbs[sorted_obs[i].ob_index];
+	}, 0, num_objects, /*grain_size=*/4096);
+
+	nodes.resizeNoCopy(num_objects - 1);
+	ob_parents.resizeNoCopy(num_objects);
+
+	bool do_treelets = do_treelet_optimisation;
+	while(1)
+	{
+		timer.reset();
+		emitHierarchy(task_manager);
+		hierarchy_time = timer.elapsed();
+
+		timer.reset();
+		computeNodeAABBsAndCosts(task_manager, do_treelets);
+		bottom_up_time = timer.elapsed();
+
+		if(should_cancel_callback.shouldCancel())
+			throw glare::CancelledException();
+
+		// Treelet restructuring can increase the tree height.  If the tree is too deep, build it again without restructuring.
+		if(nodes[0].height <= max_depth)
+			break;
+		if(!do_treelets)
+			throw glare::Exception("Build failed: max depth exceeded.");
+		do_treelets = false;
+	}
+
+	max_leaf_depth = nodes[0].height;
+
+	timer.reset();
+	emitResultNodes(task_manager, result_nodes_out);
+	emit_time = timer.elapsed();
+}
@@ -0,0 +1,145 @@
+/*=====================================================================
+MortonBVHBuilder.h
+------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "BVHBuilder.h"
+#include "jscol_aabbox.h"
+#include "../utils/Platform.h"
+#include "../utils/Vector.h"
+#include "../utils/AtomicInt.h"
+#include <vector>
+namespace glare { class TaskManager; }
+class PrintOutput;
+
+
+struct MortonOb
+{
+	uint32 code; // 30-bit Morton code of the object AABB centroid.
+	uint32 ob_index; // Index of the source object.
+};
+
+
+struct MortonBuildNode
+{
+	GLARE_ALIGNED_16_NEW_DELETE
+
+	js::AABBox aabb;
+	int32 child[2]; // If >= 0, index of the child interior node.  Otherwise the child is the single object at sorted position ~child.
+	int32 parent; // -1 for the root node.
+	int32 num_obs; // Number of objects in the subtree.
+	float cost; // SAH cost of the subtree, multiplied by the node surface area.
+	int32 num_result_nodes; // Number of ResultNodes the subtree will be converted to.
+	int32 height; // Max depth of a leaf in the result subtree, relative to this node.
+	int32 make_leaf; // Non-zero if the subtree will be converted to a single leaf.
+};
+
+
+/*=====================================================================
+MortonBVHBuilder
+----------------
+Linear BVH builder (LBVH), for very fast rebuilds, e.g. per-frame rebuilds of deforming meshes.
+Trees are lower quality than those of the SAH builders.
+
+Objects are sorted by the 30-bit Morton code of their AABB centroid, then the hierarchy is
+emitted in parallel, one interior node per sorted position, as in
+'Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees', Karras 2012.
+
+Node AABBs and SAH costs are then computed in a parallel bottom-up pass, which also decides which subtrees
+are collapsed into leaves.  If do_treelet_optimisation is true, small treelets are restructured to the SAH-optimal
+topology during the same pass, as in 'Fast Parallel Construction of High-Quality Bounding Volume Hierarchies', Karras and Aila 2013.
+=====================================================================*/
+class MortonBVHBuilder : public BVHBuilder
+{
+public:
+	GLARE_ALIGNED_16_NEW_DELETE
+
+	// leaf_num_object_threshold - if there are <= leaf_num_object_threshold objects assigned to a subtree, a leaf will be made out of them.  Should be >= 1.
+	// max_num_objects_per_leaf - maximum num objects per leaf node.  Should be >= leaf_num_object_threshold.
+	// intersection_cost - cost of ray-object intersection for SAH computation.  Relative to traversal cost which is assumed to be 1.
+	MortonBVHBuilder(int leaf_num_object_threshold, int max_num_objects_per_leaf, int max_depth, float intersection_cost,
+		const int num_objects
+	);
+	~MortonBVHBuilder();
+
+	inline void setObjectAABB(int ob_i, const js::AABBox& aabb); // ob_i should be < num_objects constructor arg.
+
+	// For setting object AABBs from multiple threads: doesn't update the root AABB.  setRootAABBs() must be called once all object AABBs are set.
+	inline void setObjectAABBNoRootUpdate(int ob_i, const js::AABBox& aabb);
+	void setRootAABBs(const js::AABBox& root_aabb, const js::AABBox& root_centroid_aabb);
+
+	// Throws glare::CancelledException if cancelled.
+	virtual void build(
+		glare::TaskManager& task_manager,
+		ShouldCancelCallback& should_cancel_callback,
+		PrintOutput& print_output,
+		js::Vector<ResultNode, 64>& result_nodes_out
+	);
+
+	virtual const js::AABBox getRootAABB() const { return root_aabb; }
+
+	const BVHBuilder::ResultObIndicesVec& getResultObjectIndices() const { return result_indices; }
+
+	int getMaxLeafDepth() const { return max_leaf_depth; } // Root node is considered to have depth 0.
+
+private:
+	void computeMortonCodes(glare::TaskManager& task_manager);
+	void sortObjects(glare::TaskManager& task_manager);
+	void emitHierarchy(glare::TaskManager& task_manager);
+	void computeNodeAABBsAndCosts(glare::TaskManager& task_manager, bool do_treelets);
+	void emitResultNodes(glare::TaskManager& task_manager, js::Vector<ResultNode, 64>& result_nodes_out);
+
+	void processNodeBottomUp(int node_index, bool do_treelets);
+	void computeNodeFromChildren(int node_index);
+	void optimiseTreelet(int root_index);
+	void emitSubtree(int32 node_ref, uint32 result_index, uint32 ob_begin, int depth, js::Vector<ResultNode, 64>& result_nodes_out);
+	void writeSubtreeObIndices(int32 node_ref, uint32& write_i);
+
+	js::AABBox root_aabb;
+	js::AABBox root_centroid_aabb;
+
+	js::Vector<js::AABBox, 16> ob_aabbs;
+	js::Vector<MortonOb, 16> sorted_obs;
+	js::Vector<MortonOb, 16> temp_obs;
+	js::Vector<js::AABBox, 16> sorted_aabbs;
+	js::Vector<MortonBuildNode, 64> nodes; // num objects - 1 interior nodes.  The root is node 0.
+	js::Vector<int32, 16> ob_parents; // Parent interior node for each sorted object.
+	std::vector<glare::AtomicInt> node_visit_counts;
+
+	int m_num_objects;
+	int leaf_num_object_threshold;
+	int max_num_objects_per_leaf;
+	int max_depth;
+	float intersection_cost; // Relative to BVH node traversal cost.
+	int max_leaf_depth;
+
+	js::Vector<uint32, 16> result_indices;
+
+public:
+	bool do_treelet_optimisation; // Restructure treelets for a higher quality tree, at roughly twice the build time.  False by default.
+
+	// Time taken for each build phase, in seconds.
+	double morton_code_time;
+	double sort_time;
+	double hierarchy_time;
+	double bottom_up_time;
+	double emit_time;
+};
+
+
+void MortonBVHBuilder::setObjectAABB(int ob_i, const js::AABBox& aabb)
+{
+	root_aabb.enlargeToHoldAABBox(aabb);
+	root_centroid_aabb.enlargeToHoldPoint(aabb.centroid());
+
+	ob_aabbs[ob_i] = aabb;
+}
+
+
+void MortonBVHBuilder::setObjectAABBNoRootUpdate(int ob_i, const js::AABBox& aabb)
+{
+	ob_aabbs[ob_i] = aabb;
+}
@@ -26,12 +26,272 @@ Code By Nicholas Chapman.
 #include "../indigo/MeshLoader.h"
 #include "../graphics/Map2D.h"
 #include "../utils/StandardPrintOutput.h"
+#include "../utils/ShouldCancelCallback.h"
+#include "BVHObjectTree.h"
+#include "SphereQueryBatch.h"
+#include <algorithm>
 
 
-// Disabled due to removal of ObjectTree.  TODO: port tests over to test BVHObjectTree?
+#if BUILD_TESTS
+
+
+static const js::AABBox randomObjectAABB(PCG32& rng)
+{
+	const Vec4f centre(rng.unitRandom() * 100, rng.unitRandom() * 100, rng.unitRandom() * 100, 1);
+	const Vec4f half_size(0.5f + rng.unitRandom(), 0.5f + rng.unitRandom(), 0.5f + rng.unitRandom(), 0);
+	return js::AABBox(centre - half_size, centre + half_size);
+}
+
+
+// The object tree only uses objects as keys when inserting, removing, refitting and rebuilding, so we can use fake object pointers to test those.
+static const Object* fakeObject(size_t i)
+{
+	return (const Object*)(uintptr_t)(16 * (i + 1));
+}
+
+
+static void testBVHObjectTreeIncrementalUpdates()
+{
+	conPrint("testBVHObjectTreeIncrementalUpdates()");
+
+	glare::TaskManager task_manager;
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+	PCG32 rng(1);
+
+	//------------------------------- Test insertion and removal -------------------------------
+	{
+		BVHObjectTree tree;
+		tree.checkInvariants();
+		testAssert(tree.getSAHCost() == 0);
+
+		const size_t N = 1000;
+		for(size_t i=0; i<N; ++i)
+		{
+			tree.insertObject(fakeObject(i), randomObjectAABB(rng));
+			if(i < 10 || i % 97 == 0)
+				tree.checkInvariants();
+		}
+		tree.checkInvariants();
+		testAssert(tree.numObjects() == N);
+		testAssert(tree.nodes[tree.root_node_index].height <= 20); // Check tree is reasonably balanced.  A perfectly balanced tree would have height 10.
+
+		// Remove every other object
+		for(size_t i=0; i<N; i += 2)
+		{
+			tree.removeObject(fakeObject(i));
+			if(i % 97 == 0)
+				tree.checkInvariants();
+		}
+		tree.checkInvariants();
+		testAssert(tree.numObjects() == N / 2);
+
+		tree.rebuild(task_manager, should_cancel_callback, print_output);
+		tree.checkInvariants();
+		testAssert(tree.numObjects() == N / 2);
+
+		// Remove the remaining objects
+		for(size_t i=1; i<N; i += 2)
+			tree.removeObject(fakeObject(i));
+		tree.checkInvariants();
+		testAssert(tree.numObjects() == 0);
+
+		// Insert into the empty tree
+		tree.insertObject(fakeObject(0), randomObjectAABB(rng));
+		tree.insertObject(fakeObject(1), randomObjectAABB(rng));
+		tree.checkInvariants();
+		testAssert(tree.numObjects() == 2);
+	}
+
+	//------------------------------- Measure refit throughput against full rebuild cost -------------------------------
+	{
+		const size_t N = 20000;
+		std::vector<js::AABBox> aabbs(N);
+		BVHObjectTree tree;
+		for(size_t i=0; i<N; ++i)
+		{
+			aabbs[i] = randomObjectAABB(rng);
+			tree.insertObject(fakeObject(i), aabbs[i]);
+		}
+
+		Timer rebuild_timer;
+		tree.rebuild(task_manager, should_cancel_callback, print_output);
+		const double rebuild_time = rebuild_timer.elapsed();
+		tree.checkInvariants();
+
+		const int num_frames = 100;
+		const int num_moved_per_frame = 300;
+		double refit_time = 0;
+		for(int f=0; f<num_frames; ++f)
+		{
+			Timer refit_timer;
+			for(int z=0; z<num_moved_per_frame; ++z)
+			{
+				const size_t i = rng.nextUInt((uint32)N);
+				const Vec4f translation(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, 0);
+				aabbs[i] = js::AABBox(aabbs[i].min_ + translation, aabbs[i].max_ + translation);
+				tree.updateObjectAABB(fakeObject(i), aabbs[i]);
+			}
+			refit_time += refit_timer.elapsed();
+		}
+		tree.checkInvariants();
+
+		const double av_refit_time = refit_time / num_frames;
+		conPrint("Full rebuild of " + toString(N) + " objects: " + doubleToStringNSigFigs(rebuild_time * 1.0e3, 4) + " ms, refit of " + toString(num_moved_per_frame) + " moved objects: " + 
+			doubleToStringNSigFigs(av_refit_time * 1.0e3, 4) + " ms (" + doubleToStringNSigFigs(num_moved_per_frame / av_refit_time, 4) + " objects/s)");
+	}
+
+	//------------------------------- Test background rebuild when the SAH cost degrades -------------------------------
+	{
+		const size_t N = 5000;
+		BVHObjectTree tree;
+		for(size_t i=0; i<N; ++i)
+			tree.insertObject(fakeObject(i), randomObjectAABB(rng));
+		tree.rebuild(task_manager, should_cancel_callback, print_output);
+
+		testAssert(!tree.checkForRebuild(task_manager));
+		testAssert(!tree.isRebuildInProgress());
+
+		// Move every object to a new random position, which makes the node bounds much looser.
+		for(size_t i=0; i<N; ++i)
+			tree.updateObjectAABB(fakeObject(i), randomObjectAABB(rng));
+		tree.checkInvariants();
+		const float scattered_sah_cost = tree.getSAHCost();
+		testAssert(scattered_sah_cost > tree.built_sah_cost * tree.rebuild_sah_cost_factor);
+
+		testAssert(!tree.checkForRebuild(task_manager));
+		testAssert(tree.isRebuildInProgress());
+
+		// Move some objects while the rebuild is running.  The rebuilt tree should use their new AABBs.
+		for(size_t i=0; i<100; ++i)
+			tree.updateObjectAABB(fakeObject(i), randomObjectAABB(rng));
+
+		task_manager.waitForTasksToComplete();
+		testAssert(tree.checkForRebuild(task_manager));
+		testAssert(!tree.isRebuildInProgress());
+		tree.checkInvariants();
+		testAssert(tree.getSAHCost() < scattered_sah_cost);
+
+		// Test that the rebuild result is discarded if an object is inserted while the rebuild is running.
+		for(size_t i=0; i<N; ++i)
+			tree.updateObjectAABB(fakeObject(i), randomObjectAABB(rng));
+		testAssert(!tree.checkForRebuild(task_manager));
+		testAssert(tree.isRebuildInProgress());
+		tree.insertObject(fakeObject(N), randomObjectAABB(rng));
+		task_manager.waitForTasksToComplete();
+
+		testAssert(!tree.checkForRebuild(task_manager)); // Discards the result, and starts a new rebuild since the SAH cost is still high.
+		testAssert(tree.isRebuildInProgress());
+		task_manager.waitForTasksToComplete();
+		testAssert(tree.checkForRebuild(task_manager));
+		tree.checkInvariants();
+		testAssert(tree.numObjects() == N + 1);
+	}
+
+	conPrint("testBVHObjectTreeIncrementalUpdates() done.");
+}
+
+
+// Checks the batched broadphase sphere queries against a brute force test of each query against each object AABB.
+static void testBVHObjectTreeSphereBatchQueries()
+{
+	conPrint("testBVHObjectTreeSphereBatchQueries()");
+
+	glare::TaskManager task_manager;
+	PCG32 rng(1);
+
+	const size_t N = 2000;
+	std::vector<js::AABBox> aabbs(N);
+	std::vector<bool> in_tree(N, true);
+	BVHObjectTree tree;
+	for(size_t i=0; i<N; ++i)
+	{
+		aabbs[i] = randomObjectAABB(rng);
+		tree.insertObject(fakeObject(i), aabbs[i]);
+	}
+
+	// Remove some objects, so that there are removed leaf entries.
+	for(size_t i=0; i<N; i += 7)
+	{
+		tree.removeObject(fakeObject(i));
+		in_tree[i] = false;
+	}
+
+	const size_t NUM_QUERIES = 1000;
+	std::vector<SphereOverlapQuery> overlap_queries(NUM_QUERIES);
+	std::vector<SphereSweepQuery> sweep_queries(NUM_QUERIES);
+	for(size_t q=0; q<NUM_QUERIES; ++q)
+	{
+		const Vec4f centre(rng.unitRandom() * 100, rng.unitRandom() * 100, rng.unitRandom() * 100, 1);
+		overlap_queries[q].centre_ws = centre;
+		overlap_queries[q].radius_ws = 0.1f + rng.unitRandom() * 5;
+
+		sweep_queries[q].ray_ws = Ray(centre, normalise(Vec4f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, 0)), 0.f, rng.unitRandom() * 20);
+		sweep_queries[q].radius_ws = 0.1f + rng.unitRandom() * 2;
+	}
+
+	for(int use_task_manager=0; use_task_manager<2; ++use_task_manager)
+	{
+		BatchQueryResults<const Object*> overlap_results, sweep_results;
+		tree.getSphereOverlapObjects(overlap_queries.data(), NUM_QUERIES, overlap_results, use_task_manager ? &task_manager : NULL);
+		tree.getSphereSweepObjects(sweep_queries.data(), NUM_QUERIES, sweep_results, use_task_manager ? &task_manager : NULL);
+		testAssert(overlap_results.numQueries() == NUM_QUERIES);
+		testAssert(sweep_results.numQueries() == NUM_QUERIES);
+
+		size_t total_num_results = 0;
+		for(size_t q=0; q<NUM_QUERIES; ++q)
+		{
+			const Vec4f r(sweep_queries[q].radius_ws, sweep_queries[q].radius_ws, sweep_queries[q].radius_ws, 0);
+			const Vec4f start = sweep_queries[q].ray_ws.startPos();
+			const Vec4f end = sweep_queries[q].ray_ws.pointf(sweep_queries[q].ray_ws.maxT());
+			const js::AABBox sweep_aabb(min(start, end) - r, max(start, end) + r);
+
+			std::vector<const Object*> expected_overlap_obs, expected_sweep_obs;
+			for(size_t i=0; i<N; ++i)
+				if(in_tree[i])
+				{
+					const Vec4f centre = overlap_queries[q].centre_ws;
+					const Vec4f d = maskWToZero(centre - max(aabbs[i].min_, min(centre, aabbs[i].max_)));
+					if(dot(d, d) <= overlap_queries[q].radius_ws * overlap_queries[q].radius_ws)
+						expected_overlap_obs.push_back(fakeObject(i));
+
+					if((aabbs[i].disjoint(sweep_aabb) & 0x7) == 0)
+						expected_sweep_obs.push_back(fakeObject(i));
+				}
+
+			std::vector<const Object*> overlap_obs(overlap_results.queryResults(q), overlap_results.queryResults(q) + overlap_results.numResults(q));
+			std::vector<const Object*> sweep_obs(sweep_results.queryResults(q), sweep_results.queryResults(q) + sweep_results.numResults(q));
+			std::sort(overlap_obs.begin(), overlap_obs.end());
+			std::sort(sweep_obs.begin(), sweep_obs.end());
+			testAssert(overlap_obs == expected_overlap_obs);
+			testAssert(sweep_obs == expected_sweep_obs);
+
+			total_num_results += overlap_obs.size() + sweep_obs.size();
+		}
+		testAssert(total_num_results > 0);
+	}
+
+	// Test an empty batch
+	BatchQueryResults<const Object*> results;
+	tree.getSphereOverlapObjects(NULL, 0, results, &task_manager);
+	testAssert(results.numQueries() == 0);
+
+	conPrint("testBVHObjectTreeSphereBatchQueries() done.");
+}
+
+
+#endif // BUILD_TESTS
+
 
 void js::ObjectTreeTest::doTests()
-{}
+{
+#if BUILD_TESTS
+	testBVHObjectTreeIncrementalUpdates();
+	testBVHObjectTreeSphereBatchQueries();
+#endif
+
+	// Other tests disabled due to removal of ObjectTree.  TODO: port tests over to test BVHObjectTree?
+}
 
 #if 0
 
@@ -0,0 +1,729 @@
+/*=====================================================================
+QuantizedBVH.cpp
+----------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#include "QuantizedBVH.h"
+
+
+#include "BVH.h"
+#include "BinningBVHBuilder.h"
+#include "BVHBuilderUtils.h"
+#include "MollerTrumboreTri.h"
+#include "../simpleraytracer/raymesh.h"
+#include "../maths/Vec4i.h"
+#include "../utils/PrintOutput.h"
+#include "../utils/Timer.h"
+#include "../utils/ConPrint.h"
+#include "../utils/StringUtils.h"
+#include <cstring>
+#include <limits>
+#include <cmath>
+
+
+namespace js
+{
+
+
+template <class QuantType>
+QuantizedBVH<QuantType>::QuantizedBVH(const RayMesh* const raymesh_)
+:	raymesh(raymesh_),
+	root_node_index(0)
+{
+	assert(raymesh);
+
+	static_assert(sizeof(QuantizedBVHNode<uint8>) == 20, "sizeof(QuantizedBVHNode<uint8>) == 20");
+	static_assert(sizeof(QuantizedBVHNode<uint16>) == 32, "sizeof(QuantizedBVHNode<uint16>) == 32");
+}
+
+
+template <class QuantType>
+QuantizedBVH<QuantType>::~QuantizedBVH()
+{}
+
+
+// Loads 4 quantized values and converts them to floats.  SSE 2.
+static GLARE_STRONG_INLINE const Vec4f loadQuantized(const uint8* q)
+{
+	int32 bits;
+	std::memcpy(&bits, q, sizeof(int32));
+	const __m128i zero = _mm_setzero_si128();
+	return toVec4f(Vec4i(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero), zero)));
+}
+
+
+static GLARE_STRONG_INLINE const Vec4f loadQuantized(const uint16* q)
+{
+	return toVec4f(Vec4i(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)q), _mm_setzero_si128())));
+}
+
+
+// Decodes the child bounds on one axis.
+// frame is the node bounds on the axis, as (frame_min, frame_min, frame_max, frame_max).
+// Returns (left_min, right_min, left_max, right_max).
+// This is used for both building and traversal, so that the quantized bounds are conservative for exactly the values computed during traversal.
+template <class QuantType>
+static GLARE_STRONG_INLINE const Vec4f decodeAxis(const QuantType* q, const Vec4f& frame)
+{
+	const Vec4f signed_extent = shuffle<2, 3, 0, 1>(frame, frame) - frame; // (frame_max - frame_min, frame_max - frame_min, frame_min - frame_max, frame_min - frame_max)
+	return frame + loadQuantized(q) * (signed_extent * Vec4f(1.f / (float)std::numeric_limits<QuantType>::max()));
+}
+
+
+// Quantizes the exact child bounds on one axis, bounds = (left_min, right_min, left_max, right_max), relative to frame.
+template <class QuantType>
+static void quantizeAxis(const Vec4f& bounds, const Vec4f& frame, QuantType* q_out)
+{
+	const float max_q = (float)std::numeric_limits<QuantType>::max();
+	const Vec4f signed_step = (shuffle<2, 3, 0, 1>(frame, frame) - frame) * Vec4f(1.f / max_q);
+
+	for(int i=0; i<4; ++i)
+	{
+		const float q = (signed_step[i] != 0) ? std::floor((bounds[i] - frame[i]) / signed_step[i]) : 0.f;
+		q_out[i] = (QuantType)myClamp(q, 0.f, max_q);
+	}
+
+	// Decoding rounds, so step the quantized values back towards the frame bounds until the decoded bounds contain the exact bounds.
+	// A quantized value of 0 decodes to the frame bound exactly, which always contains the exact bound.
+	while(1)
+	{
+		const Vec4f decoded = decodeAxis(q_out, frame);
+		bool conservative = true;
+		for(int i=0; i<4; ++i)
+			if((i < 2) ? (decoded[i] > bounds[i]) : (decoded[i] < bounds[i]))
+			{
+				assert(q_out[i] > 0);
+				q_out[i]--;
+				conservative = false;
+			}
+		if(conservative)
+			break;
+	}
+}
+
+
+// Returns the node bounds on each axis in frame form, (min, min, max, max).
+static GLARE_STRONG_INLINE void rootFrames(const js::AABBox& aabb, Vec4f& frame_x_out, Vec4f& frame_y_out, Vec4f& frame_z_out)
+{
+	frame_x_out = shuffle<0, 0, 0, 0>(aabb.min_, aabb.max_);
+	frame_y_out = shuffle<1, 1, 1, 1>(aabb.min_, aabb.max_);
+	frame_z_out = shuffle<2, 2, 2, 2>(aabb.min_, aabb.max_);
+}
+
+
+// Child frames on an axis, from the decoded child bounds (left_min, right_min, left_max, right_max).
+static GLARE_STRONG_INLINE const Vec4f leftFrame (const Vec4f& decoded) { return shuffle<0, 0, 2, 2>(decoded, decoded); }
+static GLARE_STRONG_INLINE const Vec4f rightFrame(const Vec4f& decoded) { return shuffle<1, 1, 3, 3>(decoded, decoded); }
+
+
+struct QuantizeStackEntry
+{
+	Vec4f frame_x, frame_y, frame_z;
+	int32 node_index;
+};
+
+
+// Quantizes exact_nodes top-down.  Node indices are unchanged.
+template <class QuantType>
+static void quantizeNodes(const js::Vector<BVHNode, 64>& exact_nodes, const js::AABBox& root_aabb, js::Vector<QuantizedBVHNode<QuantType>, 16>& nodes_out)
+{
+	nodes_out.resizeNoCopy(exact_nodes.size());
+	if(exact_nodes.empty())
+		return;
+
+	js::Vector<QuantizeStackEntry, 16> stack;
+	stack.resize(1);
+	rootFrames(root_aabb, stack[0].frame_x, stack[0].frame_y, stack[0].frame_z);
+	stack[0].node_index = 0;
+
+	while(!stack.empty())
+	{
+		const QuantizeStackEntry entry = stack.back();
+		stack.pop_back();
+
+		const BVHNode& exact_node = exact_nodes[entry.node_index];
+		QuantizedBVHNode<QuantType>& node = nodes_out[entry.node_index];
+
+		quantizeAxis(exact_node.x, entry.frame_x, node.x);
+		quantizeAxis(exact_node.y, entry.frame_y, node.y);
+		quantizeAxis(exact_node.z, entry.frame_z, node.z);
+		node.child[0] = exact_node.child[0];
+		node.child[1] = exact_node.child[1];
+
+		const Vec4f decoded_x = decodeAxis(node.x, entry.frame_x);
+		const Vec4f decoded_y = decodeAxis(node.y, entry.frame_y);
+		const Vec4f decoded_z = decodeAxis(node.z, entry.frame_z);
+
+		for(int c=0; c<2; ++c)
+			if(node.child[c] >= 0) // If child is an interior node:
+			{
+				QuantizeStackEntry child_entry;
+				child_entry.frame_x = (c == 0) ? leftFrame(decoded_x) : rightFrame(decoded_x);
+				child_entry.frame_y = (c == 0) ? leftFrame(decoded_y) : rightFrame(decoded_y);
+				child_entry.frame_z = (c == 0) ? leftFrame(decoded_z) : rightFrame(decoded_z);
+				child_entry.node_index = node.child[c];
+				stack.push_back(child_entry);
+			}
+	}
+}
+
+
+// Throws glare::CancelledException if cancelled.
+template <class QuantType>
+void QuantizedBVH<QuantType>::build(PrintOutput& print_output, ShouldCancelCallback& should_cancel_callback, glare::TaskManager& task_manager)
+{
+	const int raymesh_tris_size = (int)raymesh->getTriangles().size();
+
+	Reference<BinningBVHBuilder> builder = new BinningBVHBuilder(
+		1, // leaf_num_object_threshold.
+		31, // max_num_objects_per_leaf
+		64, // max_depth
+		1.f, // intersection_cost
+		raymesh_tris_size
+	);
+	BVHBuilderUtils::setTriAABBs(*builder, *raymesh, task_manager);
+
+	js::Vector<ResultNode, 64> result_nodes;
+	builder->build(
+		task_manager,
+		should_cancel_callback,
+		print_output,
+		result_nodes
+	);
+
+	root_aabb = builder->getRootAABB();
+
+	// Convert result_nodes to BVHNodes with exact bounds, then quantize the bounds.
+	js::Vector<BVHNode, 64> exact_nodes;
+	this->root_node_index = BVHBuilderUtils::convertResultNodes<BVHNode, 5>(result_nodes, exact_nodes, task_manager);
+	quantizeNodes(exact_nodes, root_aabb, nodes);
+
+	// Build leaf_tri_indices
+	BVHBuilderUtils::copyLeafObIndices(builder->getResultObjectIndices(), leaf_tri_indices, task_manager);
+}
+
+
+// NOTE: Uses SEE3 instruction _mm_shuffle_epi8.
+static GLARE_STRONG_INLINE const Vec4f shuffle8(const Vec4f& a, const Vec4i& shuf) { return _mm_castsi128_ps(_mm_shuffle_epi8(_mm_castps_si128(a.v), shuf.v)); }
+static GLARE_STRONG_INLINE const Vec4f vec4XOR(const Vec4f& a, const Vec4i& b) { return _mm_castsi128_ps(_mm_xor_si128(_mm_castps_si128(a.v), b.v)); }
+
+
+template <class QuantType>
+typename QuantizedBVH<QuantType>::DistType QuantizedBVH<QuantType>::traceRay(const Ray& ray_, HitInfo& hitinfo_out) const
+{
+	Ray ray = ray_;
+	HitInfo ob_hit_info;
+
+	int stack[64];
+	float dist_stack[64];
+	Vec4f frame_x_stack[64]; // Decoded bounds of the nodes on the stack.
+	Vec4f frame_y_stack[64];
+	Vec4f frame_z_stack[64];
+	int stack_top = 0;
+	stack[0] = root_node_index; // Push root node onto stack
+	dist_stack[0] = -std::numeric_limits<float>::infinity(); // Near distances to nodes on the stack.
+	rootFrames(root_aabb, frame_x_stack[0], frame_y_stack[0], frame_z_stack[0]);
+
+	const Vec4f r_x(ray.startPos().x[0]); // (r_x, r_x, r_x, r_x)
+	const Vec4f r_y(ray.startPos().x[1]); // (r_y, r_y, r_y, r_y)
+	const Vec4f r_z(ray.startPos().x[2]); // (r_z, r_z, r_z, r_z)
+
+	const Vec4i negate(0x00000000, 0x00000000, 0x80000000, 0x80000000); // To flip sign bits on floats 2 and 3.
+	const Vec4f rdir_x = vec4XOR(Vec4f(ray.getRecipRayDirF().x[0]), negate); // (1/d_x, 1/d_x, -1/d_x, -1/d_x)
+	const Vec4f rdir_y = vec4XOR(Vec4f(ray.getRecipRayDirF().x[1]), negate); // (1/d_y, 1/d_y, -1/d_y, -1/d_y)
+	const Vec4f rdir_z = vec4XOR(Vec4f(ray.getRecipRayDirF().x[2]), negate); // (1/d_z, 1/d_z, -1/d_z, -1/d_z)
+
+	// Near_far will store current ray segment as (near, near, -far, -far)
+	Vec4f near_far(ray.minT(), ray.minT(), -ray.maxT(), -ray.maxT());
+
+	const Vec4i identity(_mm_set_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+	const Vec4i swap(_mm_set_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+
+	const Vec4i x_shuffle = ray.getRecipRayDirF().x[0] > 0 ? identity : swap;
+	const Vec4i y_shuffle = ray.getRecipRayDirF().x[1] > 0 ? identity : swap;
+	const Vec4i z_shuffle = ray.getRecipRayDirF().x[2] > 0 ? identity : swap;
+
+stack_pop:
+	while(stack_top >= 0) // While still one or more nodes on the stack:
+	{
+		int cur = stack[stack_top]; // Pop node off top of stack.
+		float popped_node_near = dist_stack[stack_top];
+		Vec4f frame_x = frame_x_stack[stack_top];
+		Vec4f frame_y = frame_y_stack[stack_top];
+		Vec4f frame_z = frame_z_stack[stack_top];
+		stack_top--;
+		// If current interval far < popped near, then we don't need to process this node.
+		// far < popped_near = -far > -popped_near
+		if(near_far.x[2] > -popped_node_near)
+			goto stack_pop; // Pop another node.
+
+		while(cur >= 0) // While this is a proper interior node:
+		{
+			const QuantizedBVHNode<QuantType>& node = nodes[cur];
+
+			// Decode the child bounding boxes
+			const Vec4f node_x = decodeAxis(node.x, frame_x); // (left_min_x, right_min_x, left_max_x, right_max_x)
+			const Vec4f node_y = decodeAxis(node.y, frame_y);
+			const Vec4f node_z = decodeAxis(node.z, frame_z);
+
+			// Intersect with the node bounding boxes.  See BVH::traceRay().
+
+			// Get signed distance from ray origin to near and far planes
+			const Vec4f near_far_x = shuffle8(node_x, x_shuffle) - r_x; // (left_near_delta_x, right_near_delta_x, left_far_delta_x, right_far_delta_x)
+			const Vec4f near_far_y = shuffle8(node_y, y_shuffle) - r_y;
+			const Vec4f near_far_z = shuffle8(node_z, z_shuffle) - r_z;
+
+			// Get dist along ray to planes.  Far distances will be negated due to negated rdir components 2 and 3.
+			const __m128 minmax_d_x = _mm_mul_ps(near_far_x.v, rdir_x.v); // (min_left_d_x, min_right_d_x, -max_left_d_x, -max_right_d_x)
+			const __m128 minmax_d_y = _mm_mul_ps(near_far_y.v, rdir_y.v);
+			const __m128 minmax_d_z = _mm_mul_ps(near_far_z.v, rdir_z.v);
+
+			const Vec4f new_near_far(_mm_max_ps(_mm_max_ps(minmax_d_x, minmax_d_y), _mm_max_ps(near_far.v, minmax_d_z))); // (near_left, near_right, -far_left, -far_right)
+			const Vec4f non_negated_near_far(vec4XOR(new_near_far, negate)); // (near_left, near_right, far_left, far_right)
+			const Vec4f shuffled_near_far(shuffle8(non_negated_near_far, swap)); // (far_left, far_right, near_left, near_right)
+			const Vec4i near_le_far(_mm_castps_si128(_mm_cmple_ps(new_near_far.v, shuffled_near_far.v))); // (near_left <= far_left, near_right <= far_right, ., .)
+
+			if(near_le_far.x[0] != 0) // If hit left
+			{
+				if(near_le_far.x[1] != 0) // If hit right as well, then ray has hit both:
+				{
+					stack_top++;
+					assert(stack_top < 64);
+					if(new_near_far.x[0] < new_near_far.x[1]) // If left child is closer
+					{
+						// Push right child onto stack
+						stack[stack_top] = node.child[1];
+						dist_stack[stack_top] = new_near_far.x[1]; // push near_right
+						frame_x_stack[stack_top] = rightFrame(node_x);
+						frame_y_stack[stack_top] = rightFrame(node_y);
+						frame_z_stack[stack_top] = rightFrame(node_z);
+
+						cur = node.child[0];
+						frame_x = leftFrame(node_x);
+						frame_y = leftFrame(node_y);
+						frame_z = leftFrame(node_z);
+					}
+					else
+					{
+						// Push left child onto stack
+						stack[stack_top] = node.child[0];
+						dist_stack[stack_top] = new_near_far.x[0]; // push near_left
+						frame_x_stack[stack_top] = leftFrame(node_x);
+						frame_y_stack[stack_top] = leftFrame(node_y);
+						frame_z_stack[stack_top] = leftFrame(node_z);
+
+						cur = node.child[1];
+						frame_x = rightFrame(node_x);
+						frame_y = rightFrame(node_y);
+						frame_z = rightFrame(node_z);
+					}
+				}
+				else // Else not hit right, so just hit left.  Traverse to left child.
+				{
+					cur = node.child[0];
+					frame_x = leftFrame(node_x);
+					frame_y = leftFrame(node_y);
+					frame_z = leftFrame(node_z);
+				}
+			}
+			else // Else if not hit left:
+			{
+				if(near_le_far.x[1] != 0) // If hit right child:
+				{
+					cur = node.child[1];
+					frame_x = rightFrame(node_x);
+					frame_y = rightFrame(node_y);
+					frame_z = rightFrame(node_z);
+				}
+				else
+					goto stack_pop; // Hit zero children, pop node off stack
+			}
+		}
+
+		// current node is a leaf.  Intersect objects.
+		cur ^= 0x80000000; // Zero sign bit
+		const size_t ofs = size_t(cur) >> 5;
+		const size_t num = size_t(cur) & 0x1F;
+		for(size_t i=ofs; i<ofs+num; i++)
+		{
+			const uint32 tri_index = leaf_tri_indices[i];
+
+			MollerTrumboreTri tri;
+			tri.set(raymesh->triVertPos(tri_index, 0), raymesh->triVertPos(tri_index, 1), raymesh->triVertPos(tri_index, 2));
+
+			Real dist;
+			if(tri.referenceIntersect(ray, &ob_hit_info.sub_elem_coords.x, &ob_hit_info.sub_elem_coords.y, &dist))
+			{
+				if(dist >= ray.minT() && dist < ray.maxT())
+				{
+					ray.setMaxT(dist);
+
+					hitinfo_out.sub_elem_coords = ob_hit_info.sub_elem_coords;
+					hitinfo_out.sub_elem_index = tri_index;
+
+					// Update far to min(dist, far)
+					const Vec4f new_neg_far = Vec4f(_mm_max_ps(Vec4f(-dist).v, near_far.v)); // (., ., -min(far, dist), -min(far, dist))
+					near_far = _mm_shuffle_ps(near_far.v, new_neg_far.v, _MM_SHUFFLE(3, 2, 1, 0)); // (near, near, -far, -far)
+				}
+			}
+		}
+	}
+
+	return (ray.maxT() < ray_.maxT()) ? ray.maxT() : -1.f;
+}
+
+
+// Calls leaf_func(tri_index) for each triangle in the leaves whose decoded bounds overlap aabb.
+template <class QuantType>
+template <class LeafFunc>
+void QuantizedBVH<QuantType>::traverseOverlappingLeaves(const js::AABBox& aabb, LeafFunc& leaf_func) const
+{
+	int stack[64];
+	Vec4f frame_x_stack[64];
+	Vec4f frame_y_stack[64];
+	Vec4f frame_z_stack[64];
+	int stack_top = 0;
+	stack[0] = root_node_index; // Push root node onto stack
+	rootFrames(root_aabb, frame_x_stack[0], frame_y_stack[0], frame_z_stack[0]);
+
+	// A child overlaps aabb on an axis if child_min <= aabb_max and aabb_min <= child_max.
+	const Vec4f aabb_min_x = copyToAll<0>(aabb.min_);
+	const Vec4f aabb_min_y = copyToAll<1>(aabb.min_);
+	const Vec4f aabb_min_z = copyToAll<2>(aabb.min_);
+	const Vec4f aabb_max_x = copyToAll<0>(aabb.max_);
+	const Vec4f aabb_max_y = copyToAll<1>(aabb.max_);
+	const Vec4f aabb_max_z = copyToAll<2>(aabb.max_);
+
+stack_pop:
+	while(stack_top >= 0) // While still one or more nodes on the stack:
+	{
+		int cur = stack[stack_top];
+		Vec4f frame_x = frame_x_stack[stack_top];
+		Vec4f frame_y = frame_y_stack[stack_top];
+		Vec4f frame_z = frame_z_stack[stack_top];
+		stack_top--;
+
+		while(cur >= 0) // While this is a proper interior node:
+		{
+			const QuantizedBVHNode<QuantType>& node = nodes[cur];
+
+			const Vec4f node_x = decodeAxis(node.x, frame_x); // (left_min_x, right_min_x, left_max_x, right_max_x)
+			const Vec4f node_y = decodeAxis(node.y, frame_y);
+			const Vec4f node_z = decodeAxis(node.z, frame_z);
+
+			// For each axis, compare (left_min, right_min, aabb_min, aabb_min) <= (aabb_max, aabb_max, left_max, right_max)
+			const Vec4f overlap_x = parallelLessEqual(shuffle<0, 1, 0, 1>(node_x, aabb_min_x), shuffle<0, 1, 2, 3>(aabb_max_x, node_x));
+			const Vec4f overlap_y = parallelLessEqual(shuffle<0, 1, 0, 1>(node_y, aabb_min_y), shuffle<0, 1, 2, 3>(aabb_max_y, node_y));
+			const Vec4f overlap_z = parallelLessEqual(shuffle<0, 1, 0, 1>(node_z, aabb_min_z), shuffle<0, 1, 2, 3>(aabb_max_z, node_z));
+			const int overlap_bits = _mm_movemask_ps(parallelAnd(overlap_x, parallelAnd(overlap_y, overlap_z)).v);
+			const bool overlap_left  = (overlap_bits & 0x5) == 0x5;
+			const bool overlap_right = (overlap_bits & 0xA) == 0xA;
+
+			if(overlap_left)
+			{
+				if(overlap_right)
+				{
+					// Push left child onto stack
+					stack_top++;
+					assert(stack_top < 64);
+					stack[stack_top] = node.child[0];
+					frame_x_stack[stack_top] = leftFrame(node_x);
+					frame_y_stack[stack_top] = leftFrame(node_y);
+					frame_z_stack[stack_top] = leftFrame(node_z);
+				}
+				else
+				{
+					cur = node.child[0];
+					frame_x = leftFrame(node_x);
+					frame_y = leftFrame(node_y);
+					frame_z = leftFrame(node_z);
+					continue;
+				}
+			}
+			else if(!overlap_right)
+				goto stack_pop; // Overlaps zero children, pop node off stack
+
+			cur = node.child[1];
+			frame_x = rightFrame(node_x);
+			frame_y = rightFrame(node_y);
+			frame_z = rightFrame(node_z);
+		}
+
+		// current node is a leaf.
+		cur ^= 0x80000000; // Zero sign bit
+		const size_t ofs = size_t(cur) >> 5;
+		const size_t num = size_t(cur) & 0x1F;
+		for(size_t i=ofs; i<ofs+num; i++)
+			leaf_func(leaf_tri_indices[i]);
+	}
+}
+
+
+static GLARE_STRONG_INLINE void getTriObjectSpace(const RayMesh* raymesh, uint32 tri_index, Vec4f& v0_os_out, Vec4f& e1_os_out, Vec4f& e2_os_out)
+{
+	MollerTrumboreTri tri;
+	tri.set(raymesh->triVertPos(tri_index, 0), raymesh->triVertPos(tri_index, 1), raymesh->triVertPos(tri_index, 2));
+
+	v0_os_out = Vec4f(tri.data[0], tri.data[1], tri.data[2], 0.f); // W-coord should be 1, but can leave as zero due to using mul3Point().
+	e1_os_out = Vec4f(tri.data[3], tri.data[4], tri.data[5], 0.f);
+	e2_os_out = Vec4f(tri.data[6], tri.data[7], tri.data[8], 0.f);
+}
+
+
+template <class QuantType>
+typename QuantizedBVH<QuantType>::DistType QuantizedBVH<QuantType>::traceSphere(const Ray& ray_ws_, const Matrix4f& to_object, const Matrix4f& to_world, float radius_ws,
+	Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const
+{
+	Ray ray_ws = ray_ws_;
+
+	// Compute the path traced by the sphere in object space.  See BVH::traceSphere().
+	const Vec4f start_ws = ray_ws_.startPos();
+	const Vec4f end_ws   = ray_ws_.pointf(ray_ws_.maxT());
+	const js::AABBox start_aabb_ws(start_ws - Vec4f(radius_ws, radius_ws, radius_ws, 0), start_ws + Vec4f(radius_ws, radius_ws, radius_ws, 0));
+	const js::AABBox end_aabb_ws  (end_ws   - Vec4f(radius_ws, radius_ws, radius_ws, 0), end_ws   + Vec4f(radius_ws, radius_ws, radius_ws, 0));
+	const js::AABBox spherepath_aabb_os = AABBUnion(start_aabb_ws.transformedAABBFast(to_object), end_aabb_ws.transformedAABBFast(to_object));
+
+	auto leaf_func = [&](uint32 tri_index)
+	{
+		Vec4f v0_os, e1_os, e2_os;
+		getTriObjectSpace(raymesh, tri_index, v0_os, e1_os, e2_os);
+		BVH::intersectSphereAgainstTri(ray_ws, to_world, radius_ws, v0_os, e1_os, e2_os, hit_pos_ws_out, hit_normal_ws_out, point_in_tri_out);
+	};
+	traverseOverlappingLeaves(spherepath_aabb_os, leaf_func);
+
+	return (ray_ws.maxT() < ray_ws_.maxT()) ? ray_ws.maxT() : -1.f;
+}
+
+
+template <class QuantType>
+void QuantizedBVH<QuantType>::appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_object, const Matrix4f& to_world, std::vector<Vec4f>& points_ws_in_out) const
+{
+	const js::AABBox sphere_aabb_ws(sphere_pos_ws - Vec4f(radius_ws, radius_ws, radius_ws, 0), sphere_pos_ws + Vec4f(radius_ws, radius_ws, radius_ws, 0));
+	const js::AABBox sphere_aabb_os = sphere_aabb_ws.transformedAABBFast(to_object);
+
+	auto leaf_func = [&](uint32 tri_index)
+	{
+		Vec4f v0_os, e1_os, e2_os;
+		getTriObjectSpace(raymesh, tri_index, v0_os, e1_os, e2_os);
+		BVH::appendCollPointsForTri(sphere_pos_ws, radius_ws, to_world, v0_os, e1_os, e2_os, points_ws_in_out);
+	};
+	traverseOverlappingLeaves(sphere_aabb_os, leaf_func);
+}
+
+
+template <class QuantType>
+const js::AABBox& QuantizedBVH<QuantType>::getAABBox() const
+{
+	return root_aabb;
+}
+
+
+template <class QuantType>
+size_t QuantizedBVH<QuantType>::getTotalMemUsage() const
+{
+	return sizeof(root_aabb) + nodes.capacitySizeBytes() + leaf_tri_indices.capacitySizeBytes();
+}
+
+
+} // end namespace js
+
+
+#if BUILD_TESTS
+
+
+#include "../utils/TestUtils.h"
+#include "../maths/PCG32.h"
+#include "../utils/StandardPrintOutput.h"
+#include "../utils/TaskManager.h"
+#include "../utils/ShouldCancelCallback.h"
+
+
+template <class QuantType>
+void js::QuantizedBVH<QuantType>::checkBoundsConservative() const
+{
+	// Each stack entry is a node reference, and the decoded bounds of the node.
+	std::vector<int32> stack(1, root_node_index);
+	js::Vector<js::AABBox, 16> aabb_stack(1, root_aabb);
+
+	while(!stack.empty())
+	{
+		const int32 cur = stack.back();
+		const js::AABBox aabb = aabb_stack.back();
+		stack.pop_back();
+		aabb_stack.pop_back();
+
+		if(cur >= 0)
+		{
+			const QuantizedBVHNode<QuantType>& node = nodes[cur];
+			Vec4f frame_x, frame_y, frame_z;
+			rootFrames(aabb, frame_x, frame_y, frame_z);
+			const Vec4f node_x = decodeAxis(node.x, frame_x);
+			const Vec4f node_y = decodeAxis(node.y, frame_y);
+			const Vec4f node_z = decodeAxis(node.z, frame_z);
+			for(int c=0; c<2; ++c)
+			{
+				const js::AABBox child_aabb(Vec4f(node_x[c], node_y[c], node_z[c], 1.f), Vec4f(node_x[2 + c], node_y[2 + c], node_z[2 + c], 1.f));
+				testAssert(aabb.containsAABBox(child_aabb));
+				stack.push_back(node.child[c]);
+				aabb_stack.push_back(child_aabb);
+			}
+		}
+		else
+		{
+			const uint32 leaf = (uint32)cur & 0x7FFFFFFF;
+			for(size_t i=leaf >> 5; i<(leaf >> 5) + (leaf & 0x1F); ++i)
+			{
+				const js::AABBox tri_aabb = BVHBuilderUtils::triAABB(raymesh->getVertices(), raymesh->getTriangles()[leaf_tri_indices[i]]);
+				testAssert(aabb.containsAABBox(tri_aabb));
+			}
+		}
+	}
+}
+
+
+// Makes a mesh of num_tris random small triangles, in a cube of width 'scale' at 'offset'.
+static void makeRandomMesh(RayMesh& raymesh, int num_tris, float scale, const Vec3f& offset, PCG32& rng)
+{
+	for(int i=0; i<num_tris; ++i)
+	{
+		const Vec3f p = offset + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * scale;
+		const unsigned int v_start = (unsigned int)raymesh.getNumVerts();
+		raymesh.addVertex(p);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.05f * scale);
+		raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom()) * 0.05f * scale);
+		const unsigned int vertex_indices[] = { v_start, v_start + 1, v_start + 2 };
+		const unsigned int uv_indices[] = { 0, 0, 0 };
+		raymesh.addTriangle(vertex_indices, uv_indices, 0);
+	}
+}
+
+
+// Checks that QuantizedBVH gives the same results as BVH for the given mesh.
+template <class QuantType>
+static void testAgainstBVH(RayMesh& raymesh, int num_rays)
+{
+	glare::TaskManager task_manager;
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+
+	js::BVH bvh(&raymesh);
+	bvh.build(print_output, should_cancel_callback, task_manager);
+
+	js::QuantizedBVH<QuantType> qbvh(&raymesh);
+	qbvh.build(print_output, should_cancel_callback, task_manager);
+
+	testAssert(qbvh.getAABBox() == bvh.getAABBox());
+	qbvh.checkBoundsConservative();
+
+	const js::AABBox aabb = bvh.getAABBox();
+	const Vec4f centre = (raymesh.getNumTris() == 0) ? Vec4f(0, 0, 0, 1) : aabb.centroid();
+	const float size = (raymesh.getNumTris() == 0) ? 1.f : aabb.axisLength(aabb.longestAxis());
+
+	PCG32 rng(1);
+	for(int i=0; i<num_rays; ++i)
+	{
+		const Ray ray(
+			centre + Vec4f(-1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, 0) * size,
+			normalise(Vec4f(-1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, 0)),
+			0.f, // min_t
+			1.0e20f // max_t
+		);
+
+		HitInfo ref_hitinfo, hitinfo;
+		const float ref_dist = (float)bvh.traceRay(ray, ref_hitinfo);
+		const float dist = (float)qbvh.traceRay(ray, hitinfo);
+		testAssert(dist == ref_dist);
+		if(ref_dist >= 0)
+		{
+			testAssert(hitinfo.sub_elem_index == ref_hitinfo.sub_elem_index);
+			testEpsEqual(hitinfo.sub_elem_coords, ref_hitinfo.sub_elem_coords);
+		}
+	}
+
+	// Test sphere tracing and collision points
+	const Matrix4f to_world = Matrix4f::translationMatrix(1, 2, 3);
+	Matrix4f to_object;
+	to_world.getInverseForAffine3Matrix(to_object);
+	for(int i=0; i<num_rays / 10; ++i)
+	{
+		const Vec4f start_os = centre + Vec4f(-1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, 0) * size * 0.5f;
+		const Ray ray_ws(to_world * start_os, normalise(Vec4f(-1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, -1.f + rng.unitRandom()*2, 0)), 0.f, size * 0.5f);
+		const float radius_ws = size * 0.02f;
+
+		Vec4f ref_hit_pos, ref_hit_normal, hit_pos, hit_normal;
+		bool ref_point_in_tri = false, point_in_tri = false;
+		const float ref_dist = (float)bvh.traceSphere(ray_ws, to_object, to_world, radius_ws, ref_hit_pos, ref_hit_normal, ref_point_in_tri);
+		const float dist = (float)qbvh.traceSphere(ray_ws, to_object, to_world, radius_ws, hit_pos, hit_normal, point_in_tri);
+		testAssert(dist == ref_dist);
+
+		std::vector<Vec4f> ref_points, points;
+		bvh.appendCollPoints(ray_ws.startPos(), size * 0.1f, to_object, to_world, ref_points);
+		qbvh.appendCollPoints(ray_ws.startPos(), size * 0.1f, to_object, to_world, points);
+		testAssert(points.size() == ref_points.size());
+	}
+}
+
+
+template <class QuantType>
+void js::QuantizedBVH<QuantType>::test()
+{
+	conPrint("js::QuantizedBVH::test() (" + toString((int)sizeof(QuantType) * 8) + " bit)");
+
+	// Test with an empty mesh, and with a single triangle, where the root node is a leaf.
+	for(int num_tris=0; num_tris<2; ++num_tris)
+	{
+		PCG32 rng(1);
+		RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+		makeRandomMesh(raymesh, num_tris, 1.f, Vec3f(0.f), rng);
+		testAgainstBVH<QuantType>(raymesh, 100);
+	}
+
+	// Test with meshes far from the origin, and at very different scales, where decoding rounding error is larger.
+	for(int i=0; i<3; ++i)
+	{
+		PCG32 rng(i);
+		RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+		const float scales[] = { 1.0e-3f, 1.f, 1.0e4f };
+		makeRandomMesh(raymesh, 3000, scales[i], Vec3f(1.0e3f, -2.0e3f, 5.0e2f), rng);
+		testAgainstBVH<QuantType>(raymesh, 3000);
+	}
+
+	// Test with a flat mesh, so that one axis of the frames has zero extent.
+	{
+		RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+		PCG32 rng(1);
+		for(int i=0; i<1000; ++i)
+		{
+			const Vec3f p(rng.unitRandom(), rng.unitRandom(), 0.5f);
+			const unsigned int v_start = (unsigned int)raymesh.getNumVerts();
+			raymesh.addVertex(p);
+			raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), 0) * 0.05f);
+			raymesh.addVertex(p + Vec3f(rng.unitRandom(), rng.unitRandom(), 0) * 0.05f);
+			const unsigned int vertex_indices[] = { v_start, v_start + 1, v_start + 2 };
+			const unsigned int uv_indices[] = { 0, 0, 0 };
+			raymesh.addTriangle(vertex_indices, uv_indices, 0);
+		}
+		testAgainstBVH<QuantType>(raymesh, 3000);
+	}
+
+	{
+		PCG32 rng(1);
+		RayMesh raymesh("raymesh", /*enable_shading_normals=*/false);
+		makeRandomMesh(raymesh, 20000, 1.f, Vec3f(0.f), rng);
+		testAgainstBVH<QuantType>(raymesh, 10000);
+	}
+
+	conPrint("js::QuantizedBVH::test() done.");
+}
+
+
+#endif // BUILD_TESTS
+
+
+namespace js
+{
+
+template class QuantizedBVH<uint8>;
+template class QuantizedBVH<uint16>;
+
+} // end namespace js
@@ -0,0 +1,98 @@
+/*=====================================================================
+QuantizedBVH.h
+--------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "jscol_Tree.h"
+#include "jscol_aabbox.h"
+#include "../maths/vec3.h"
+#include "../utils/MemAlloc.h"
+#include "../utils/Vector.h"
+
+
+class RayMesh;
+
+
+namespace js
+{
+
+
+// 2-wide node with the child bounds quantized relative to the bounds of the node itself, which are decoded from the parent node during traversal.
+// The root node bounds are the tree root AABB.
+// For an axis with node bounds [frame_min, frame_max], and step = (frame_max - frame_min) / max quantized value, the child bounds on that axis are
+// (frame_min + q[0]*step, frame_min + q[1]*step, frame_max - q[2]*step, frame_max - q[3]*step).
+// Quantized values are rounded so that the decoded child bounds always contain the exact child bounds.
+//
+// QuantType is uint8 (20 byte nodes) or uint16 (32 byte nodes), compared to 64 byte BVHNodes.
+template <class QuantType>
+class QuantizedBVHNode
+{
+public:
+	QuantType x[4]; // (left_min_x, right_min_x, left_max_x, right_max_x)
+	QuantType y[4]; // (left_min_y, right_min_y, left_max_y, right_max_y)
+	QuantType z[4]; // (left_min_z, right_min_z, left_max_z, right_max_z)
+
+	int32 child[2]; // Same encoding as BVHNode::child.
+};
+
+
+/*=====================================================================
+QuantizedBVH
+------------
+Triangle mesh acceleration structure with compressed nodes, for very large
+meshes where the tree is memory bound.
+
+Built with BinningBVHBuilder like BVH, with the same tree topology.
+The child bounds of each node are then quantized top-down, relative to the
+conservatively decoded bounds of the node.
+
+Traversal keeps the decoded bounds of the nodes on the stack, and decodes
+the child bounds of each node visited with SSE, then does the same ray-box
+tests as BVH.  The decoded bounds are slightly larger than the exact
+bounds, so a few more nodes are visited, but about 2-3x fewer bytes are
+fetched per node.
+=====================================================================*/
+template <class QuantType>
+class QuantizedBVH : public Tree
+{
+public:
+	GLARE_ALIGNED_16_NEW_DELETE
+
+	QuantizedBVH(const RayMesh* const raymesh);
+	virtual ~QuantizedBVH();
+
+	// Throws glare::CancelledException if cancelled.
+	virtual void build(PrintOutput& print_output, ShouldCancelCallback& should_cancel_callback, glare::TaskManager& task_manager); // throws glare::Exception
+
+	virtual DistType traceRay(const Ray& ray, HitInfo& hitinfo_out) const;
+	virtual DistType traceSphere(const Ray& ray_ws, const Matrix4f& to_object, const Matrix4f& to_world, float radius_ws, Vec4f& hit_pos_ws_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const;
+	virtual void appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_object, const Matrix4f& to_world, std::vector<Vec4f>& points_ws_in_out) const;
+	virtual const js::AABBox& getAABBox() const;
+
+	virtual void printStats() const {}
+	virtual void printTraceStats() const {}
+	virtual size_t getTotalMemUsage() const;
+
+	size_t getNumNodes() const { return nodes.size(); }
+
+	// Checks that the decoded bounds of each node contain the bounds of the triangles below it.
+	void checkBoundsConservative() const;
+
+	static void test();
+
+private:
+	template <class LeafFunc>
+	void traverseOverlappingLeaves(const js::AABBox& aabb, LeafFunc& leaf_func) const;
+
+	AABBox root_aabb; // AABB of whole thing
+	js::Vector<QuantizedBVHNode<QuantType>, 16> nodes; // Nodes of the tree.
+	js::Vector<uint32, 64> leaf_tri_indices; // Indices into the raymesh triangles array.
+	const RayMesh* const raymesh;
+	int32 root_node_index;
+};
+
+
+} //end namespace js
@@ -0,0 +1,917 @@
+/*=====================================================================
+RayTracingBenchmark.cpp
+-----------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#include "RayTracingBenchmark.h"
+
+
+#include "BVH.h"
+#include "SmallBVH.h"
+#include "BVH8.h"
+#include "QuantizedBVH.h"
+#include "BinningBVHBuilder.h"
+#include "SBVHBuilder.h"
+#include "MortonBVHBuilder.h"
+#include "EmbreeBVHBuilder.h"
+#include "BVHBuilderUtils.h"
+#include "jscol_aabbox.h"
+#ifndef NO_EMBREE
+#include "../indigo/EmbreeAccel.h"
+#include "EmbreeDeviceHandle.h"
+#endif
+#include "../simpleraytracer/raymesh.h"
+#include "../simpleraytracer/hitinfo.h"
+#include "../simpleraytracer/ray.h"
+#include "../maths/PCG32.h"
+#include "../maths/mathstypes.h"
+#include "../utils/ShouldCancelCallback.h"
+#include "../utils/PrintOutput.h"
+#include "../utils/StandardPrintOutput.h"
+#include "../utils/ArgumentParser.h"
+#include "../utils/StringUtils.h"
+#include "../utils/ConPrint.h"
+#include "../utils/FileUtils.h"
+#include "../utils/TaskManager.h"
+#include "../utils/Timer.h"
+#include "../utils/UniqueRef.h"
+#include "../utils/Vector.h"
+#include "../utils/Exception.h"
+#include "../dll/include/IndigoMesh.h"
+#include "../dll/include/IndigoException.h"
+#include "../dll/IndigoStringUtils.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+
+namespace RayTracingBenchmark
+{
+
+
+// Builder settings, the same as used by js::BVH.
+static const int BUILDER_MAX_NUM_OBJECTS_PER_LEAF = 31;
+static const int BUILDER_MAX_DEPTH = 64;
+static const float BUILDER_INTERSECTION_COST = 1.f;
+
+
+BenchmarkOptions::BenchmarkOptions()
+:	num_warmup_iters(1),
+	num_iters(5),
+	num_primary_rays(512 * 512),
+	num_incoherent_rays(200000),
+	mesh_scale(1.0),
+	use_generated_meshes(true)
+{}
+
+
+//=========================================== Statistics ===========================================
+
+
+struct Stats
+{
+	double min, max, mean, median, std_dev;
+};
+
+
+static Stats computeStats(const std::vector<double>& values)
+{
+	Stats stats;
+	if(values.empty())
+	{
+		stats.min = stats.max = stats.mean = stats.median = stats.std_dev = 0;
+		return stats;
+	}
+
+	std::vector<double> sorted = values;
+	std::sort(sorted.begin(), sorted.end());
+
+	const size_t n = sorted.size();
+	double sum = 0;
+	for(size_t i=0; i<n; ++i)
+		sum += sorted[i];
+	const double mean = sum / n;
+
+	double sum_sqr_diff = 0;
+	for(size_t i=0; i<n; ++i)
+		sum_sqr_diff += Maths::square(sorted[i] - mean);
+
+	stats.min = sorted[0];
+	stats.max = sorted[n - 1];
+	stats.mean = mean;
+	stats.median = (n % 2 == 1) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+	stats.std_dev = std::sqrt(sum_sqr_diff / n);
+	return stats;
+}
+
+
+//=========================================== JSON output ===========================================
+
+
+// Formats a number as a JSON value.  Non-finite values, which JSON can't represent, are written as null.
+static const std::string jsonNumber(double x)
+{
+	return isFinite(x) ? doubleToStringNSigFigs(x, 6) : std::string("null");
+}
+
+
+static const std::string jsonString(const std::string& s)
+{
+	std::string res = "\"";
+	for(size_t i=0; i<s.size(); ++i)
+	{
+		const unsigned char c = (unsigned char)s[i];
+		if(c == '"')
+			res += "\\\"";
+		else if(c == '\\')
+			res += "\\\\";
+		else if(c == '\n')
+			res += "\\n";
+		else if(c == '\r')
+			res += "\\r";
+		else if(c == '\t')
+			res += "\\t";
+		else if(c < 0x20)
+		{
+			const char* hex = "0123456789abcdef";
+			res += "\\u00";
+			res.push_back(hex[c >> 4]);
+			res.push_back(hex[c & 0xF]);
+		}
+		else
+			res.push_back((char)c);
+	}
+	res += "\"";
+	return res;
+}
+
+
+static const std::string jsonStats(const Stats& stats)
+{
+	return "{\"min\": " + jsonNumber(stats.min) + ", \"max\": " + jsonNumber(stats.max) + ", \"mean\": " + jsonNumber(stats.mean) +
+		", \"median\": " + jsonNumber(stats.median) + ", \"std_dev\": " + jsonNumber(stats.std_dev) + "}";
+}
+
+
+//=========================================== Meshes ===========================================
+
+
+struct BenchmarkMesh
+{
+	std::string name;
+	RayMeshRef mesh;
+};
+
+
+static void addTri(RayMesh& mesh, unsigned int v0, unsigned int v1, unsigned int v2)
+{
+	const unsigned int vertex_indices[] = { v0, v1, v2 };
+	const unsigned int uv_indices[] = { 0, 0, 0 };
+	mesh.addTriangle(vertex_indices, uv_indices, 0);
+}
+
+
+// Small randomly oriented triangles, scattered uniformly through the unit cube.
+static RayMeshRef makeRandomTrisMesh(int num_tris)
+{
+	PCG32 rng(1);
+	RayMeshRef mesh = new RayMesh("random_tris", /*enable_shading_normals=*/false);
+	for(int i=0; i<num_tris; ++i)
+	{
+		const Vec3f p(rng.unitRandom(), rng.unitRandom(), rng.unitRandom());
+		const unsigned int v = mesh->getNumVerts();
+		mesh->addVertex(p);
+		mesh->addVertex(p + Vec3f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f) * 0.02f);
+		mesh->addVertex(p + Vec3f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f) * 0.02f);
+		addTri(*mesh, v, v + 1, v + 2);
+	}
+	return mesh;
+}
+
+
+// Closed UV sphere of radius 1 with num_lat latitude bands and num_lon longitude segments.
+static RayMeshRef makeSphereMesh(int num_lat, int num_lon)
+{
+	RayMeshRef mesh = new RayMesh("sphere", /*enable_shading_normals=*/false);
+
+	// Pole vertices, then rings of num_lon vertices for latitudes 1 .. num_lat-1.
+	mesh->addVertex(Vec3f(0, 0, 1)); // Vertex 0: north pole
+	mesh->addVertex(Vec3f(0, 0, -1)); // Vertex 1: south pole
+	for(int y=1; y<num_lat; ++y)
+	{
+		const float theta = Maths::pi<float>() * y / num_lat;
+		for(int x=0; x<num_lon; ++x)
+		{
+			const float phi = Maths::get2Pi<float>() * x / num_lon;
+			mesh->addVertex(Vec3f(std::cos(phi) * std::sin(theta), std::sin(phi) * std::sin(theta), std::cos(theta)));
+		}
+	}
+
+	const unsigned int num_rings = (unsigned int)num_lat - 1;
+	for(unsigned int x=0; x<(unsigned int)num_lon; ++x)
+	{
+		const unsigned int next_x = (x + 1) % num_lon;
+		addTri(*mesh, 0, 2 + x, 2 + next_x); // Cap triangle at north pole
+		for(unsigned int r=0; r+1<num_rings; ++r)
+		{
+			const unsigned int a = 2 + r * num_lon;
+			const unsigned int b = 2 + (r + 1) * num_lon;
+			addTri(*mesh, a + x, b + x, b + next_x);
+			addTri(*mesh, a + x, b + next_x, a + next_x);
+		}
+		const unsigned int last = 2 + (num_rings - 1) * num_lon;
+		addTri(*mesh, 1, last + next_x, last + x); // Cap triangle at south pole
+	}
+	return mesh;
+}
+
+
+// Heightfield over the unit square in the x-y plane, made from a few sine waves plus some noise.
+static RayMeshRef makeTerrainMesh(int res)
+{
+	PCG32 rng(2);
+	RayMeshRef mesh = new RayMesh("terrain", /*enable_shading_normals=*/false);
+	for(int y=0; y<res; ++y)
+	for(int x=0; x<res; ++x)
+	{
+		const float fx = (float)x / (res - 1);
+		const float fy = (float)y / (res - 1);
+		const float h = 0.1f * std::sin(fx * 13.f) * std::cos(fy * 11.f) + 0.03f * std::sin((fx + fy) * 37.f) + 0.005f * rng.unitRandom();
+		mesh->addVertex(Vec3f(fx, fy, h));
+	}
+
+	for(int y=0; y+1<res; ++y)
+	for(int x=0; x+1<res; ++x)
+	{
+		const unsigned int v = (unsigned int)(y * res + x);
+		addTri(*mesh, v, v + 1, v + res + 1);
+		addTri(*mesh, v, v + res + 1, v + res);
+	}
+	return mesh;
+}
+
+
+// Long thin triangles with random orientations in the unit cube.  These have large, mostly empty AABBs, which is a bad case for object splitting.
+static RayMeshRef makeLongThinTrisMesh(int num_tris)
+{
+	PCG32 rng(3);
+	RayMeshRef mesh = new RayMesh("long_thin_tris", /*enable_shading_normals=*/false);
+	for(int i=0; i<num_tris; ++i)
+	{
+		const Vec3f p(rng.unitRandom(), rng.unitRandom(), rng.unitRandom());
+		const Vec3f dir = normalise(Vec3f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f) + Vec3f(1.0e-4f));
+		const Vec3f offset = Vec3f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f) * 0.002f;
+		const unsigned int v = mesh->getNumVerts();
+		mesh->addVertex(p - dir * 0.25f);
+		mesh->addVertex(p + dir * 0.25f);
+		mesh->addVertex(p + offset);
+		addTri(*mesh, v, v + 1, v + 2);
+	}
+	return mesh;
+}
+
+
+static RayMeshRef loadMesh(const std::string& path)
+{
+	try
+	{
+		Indigo::Mesh indigo_mesh;
+		Indigo::Mesh::readFromFile(toIndigoString(path), indigo_mesh);
+
+		RayMeshRef mesh = new RayMesh(FileUtils::getFilename(path), /*enable_shading_normals=*/false);
+		mesh->fromIndigoMesh(indigo_mesh);
+		mesh->buildTrisFromQuads();
+		return mesh;
+	}
+	catch(Indigo::IndigoException& e)
+	{
+		throw glare::Exception("Failed to load mesh '" + path + "': " + toStdString(e.what()));
+	}
+}
+
+
+static void makeMeshes(const BenchmarkOptions& options, std::vector<BenchmarkMesh>& meshes_out)
+{
+	if(options.use_generated_meshes)
+	{
+		const double s = options.mesh_scale;
+		const double sqrt_s = std::sqrt(s);
+
+		BenchmarkMesh m;
+		m.name = "random_tris";
+		m.mesh = makeRandomTrisMesh(myMax(16, (int)(200000 * s)));
+		meshes_out.push_back(m);
+
+		m.name = "sphere";
+		m.mesh = makeSphereMesh(myMax(4, (int)(256 * sqrt_s)), myMax(4, (int)(512 * sqrt_s)));
+		meshes_out.push_back(m);
+
+		m.name = "terrain";
+		m.mesh = makeTerrainMesh(myMax(4, (int)(256 * sqrt_s)));
+		meshes_out.push_back(m);
+
+		m.name = "long_thin_tris";
+		m.mesh = makeLongThinTrisMesh(myMax(16, (int)(100000 * s)));
+		meshes_out.push_back(m);
+	}
+
+	for(size_t i=0; i<options.mesh_paths.size(); ++i)
+	{
+		BenchmarkMesh m;
+		m.name = FileUtils::getFilename(options.mesh_paths[i]);
+		m.mesh = loadMesh(options.mesh_paths[i]);
+		meshes_out.push_back(m);
+	}
+}
+
+
+static const js::AABBox meshAABB(const RayMesh& mesh)
+{
+	js::AABBox aabb = js::AABBox::emptyAABBox();
+	const RayMesh::TriangleVectorType& tris = mesh.getTriangles();
+	for(size_t i=0; i<tris.size(); ++i)
+		aabb.enlargeToHoldAABBox(BVHBuilderUtils::triAABB(mesh.getVertices(), tris[i]));
+	return aabb;
+}
+
+
+//=========================================== Rays ===========================================
+
+
+// Coherent rays from a pinhole camera outside the mesh AABB, looking at the AABB centre, in scanline order.
+static void makePrimaryRays(const js::AABBox& aabb, int num_rays, std::vector<Ray>& rays_out)
+{
+	const int res = myMax(1, (int)std::sqrt((double)num_rays));
+
+	const Vec3f centre(aabb.centroid()[0], aabb.centroid()[1], aabb.centroid()[2]);
+	const float radius = myMax(1.0e-6f, aabb.axisLength(0) * 0.5f + aabb.axisLength(1) * 0.5f + aabb.axisLength(2) * 0.5f) * 0.6f;
+
+	const Vec3f forwards = normalise(Vec3f(0.4f, 1.f, -0.5f));
+	const Vec3f right = normalise(crossProduct(forwards, Vec3f(0, 0, 1)));
+	const Vec3f up = crossProduct(right, forwards);
+	const Vec3f cam_pos = centre - forwards * (radius * 2.f);
+	const float tan_half_fov = 0.6f;
+
+	rays_out.resize(0);
+	rays_out.reserve((size_t)res * res);
+	for(int y=0; y<res; ++y)
+	for(int x=0; x<res; ++x)
+	{
+		const float sx = ((x + 0.5f) / res * 2.f - 1.f) * tan_half_fov;
+		const float sy = (1.f - (y + 0.5f) / res * 2.f) * tan_half_fov;
+		const Vec3f dir = normalise(forwards + right * sx + up * sy);
+		rays_out.push_back(Ray(Vec4f(cam_pos.x, cam_pos.y, cam_pos.z, 1.f), Vec4f(dir.x, dir.y, dir.z, 0.f), 0.f, 1.0e20f));
+	}
+}
+
+
+// Rays with origins uniformly distributed in the mesh AABB, and uniformly distributed directions.
+static void makeIncoherentRays(const js::AABBox& aabb, int num_rays, std::vector<Ray>& rays_out)
+{
+	PCG32 rng(4);
+	rays_out.resize(0);
+	rays_out.reserve(num_rays);
+	for(int i=0; i<num_rays; ++i)
+	{
+		const Vec4f pos = aabb.min_ + (aabb.max_ - aabb.min_) * Vec4f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom(), 0.f);
+
+		// Pick a direction by rejection sampling the unit ball.
+		Vec4f dir;
+		while(1)
+		{
+			dir = Vec4f(rng.unitRandom() * 2 - 1, rng.unitRandom() * 2 - 1, rng.unitRandom() * 2 - 1, 0.f);
+			const float len2 = dir.length2();
+			if(len2 > 1.0e-4f && len2 <= 1.f)
+				break;
+		}
+
+		rays_out.push_back(Ray(setWToOne(pos), normalise(dir), 0.f, 1.0e20f));
+	}
+}
+
+
+struct TraceResults
+{
+	Stats mrays_per_sec;
+	size_t num_hits;
+};
+
+
+static TraceResults traceRays(const js::Tree& tree, const std::vector<Ray>& rays, const BenchmarkOptions& options)
+{
+	TraceResults results;
+	results.num_hits = 0;
+
+	std::vector<double> mrays_per_sec;
+	for(int i=0; i<options.num_warmup_iters + options.num_iters; ++i)
+	{
+		size_t num_hits = 0;
+		Timer timer;
+		for(size_t r=0; r<rays.size(); ++r)
+		{
+			HitInfo hitinfo;
+			if(tree.traceRay(rays[r], hitinfo) >= 0)
+				num_hits++;
+		}
+		const double elapsed = timer.elapsed();
+
+		if(i >= options.num_warmup_iters)
+			mrays_per_sec.push_back(rays.size() / myMax(elapsed, 1.0e-9) * 1.0e-6);
+		results.num_hits = num_hits;
+	}
+
+	results.mrays_per_sec = computeStats(mrays_per_sec);
+	return results;
+}
+
+
+//=========================================== Trees ===========================================
+
+
+// State shared by all the trees made during a benchmark run.
+struct TreeCreationContext
+{
+#ifndef NO_EMBREE
+	RTCDeviceTy* embree_device; // Passed to EmbreeAccel, as RayMesh::build() does.
+#endif
+};
+
+
+static js::Tree* createBVH(const RayMesh* mesh, const TreeCreationContext& /*context*/) { return new js::BVH(mesh); }
+static js::Tree* createMortonBVH(const RayMesh* mesh, const TreeCreationContext& /*context*/) { js::BVH* bvh = new js::BVH(mesh); bvh->setUseMortonBuilder(true); return bvh; }
+static js::Tree* createSmallBVH(const RayMesh* mesh, const TreeCreationContext& /*context*/) { return new js::SmallBVH(mesh); }
+static js::Tree* createBVH8(const RayMesh* mesh, const TreeCreationContext& /*context*/) { return new js::BVH8(mesh); }
+static js::Tree* createQuantizedBVH8(const RayMesh* mesh, const TreeCreationContext& /*context*/) { return new js::QuantizedBVH<uint8>(mesh); }
+static js::Tree* createQuantizedBVH16(const RayMesh* mesh, const TreeCreationContext& /*context*/) { return new js::QuantizedBVH<uint16>(mesh); }
+#ifndef NO_EMBREE
+static js::Tree* createEmbreeAccel(const RayMesh* mesh, const TreeCreationContext& context) { return new EmbreeAccel(context.embree_device, mesh, /*do_fast_low_quality_build=*/false); }
+#endif
+
+
+struct TreeType
+{
+	const char* name;
+	js::Tree* (*create)(const RayMesh* mesh, const TreeCreationContext& context);
+};
+
+
+static const TreeType tree_types[] = {
+	{ "BVH",						createBVH },
+	{ "BVH (MortonBVHBuilder)",		createMortonBVH },
+	{ "SmallBVH",					createSmallBVH },
+	{ "BVH8",						createBVH8 },
+	{ "QuantizedBVH<uint8>",		createQuantizedBVH8 },
+	{ "QuantizedBVH<uint16>",		createQuantizedBVH16 },
+#ifndef NO_EMBREE
+	{ "EmbreeAccel",				createEmbreeAccel },
+#endif
+};
+
+
+static const std::string benchmarkTree(const TreeType& tree_type, const TreeCreationContext& context, const RayMesh& mesh, const std::vector<Ray>& primary_rays, const std::vector<Ray>& incoherent_rays,
+	const BenchmarkOptions& options, glare::TaskManager& task_manager, PrintOutput& print_output)
+{
+	StandardPrintOutput null_print_output; // Not used by the trees in practice, but don't interleave any tree output with our progress output.
+	DummyShouldCancelCallback should_cancel_callback;
+
+	// Build the tree warmup + iters times, keeping the last one built for tracing.
+	UniqueRef<js::Tree> tree;
+	std::vector<double> build_times;
+	for(int i=0; i<options.num_warmup_iters + options.num_iters; ++i)
+	{
+		tree.set(NULL); // Free the previous tree before building the next one.
+
+		Timer timer;
+		tree.set(tree_type.create(&mesh, context));
+		tree->build(null_print_output, should_cancel_callback, task_manager);
+		const double elapsed = timer.elapsed();
+
+		if(i >= options.num_warmup_iters)
+			build_times.push_back(elapsed);
+	}
+
+	const TraceResults primary    = traceRays(*tree.ptr(), primary_rays,    options);
+	const TraceResults incoherent = traceRays(*tree.ptr(), incoherent_rays, options);
+
+	const Stats build_time_stats = computeStats(build_times);
+	print_output.print("    " + std::string(tree_type.name) + ": build " + doubleToStringNSigFigs(build_time_stats.median * 1.0e3, 4) + " ms, mem " + getNiceByteSize(tree->getTotalMemUsage()) +
+		", primary " + doubleToStringNSigFigs(primary.mrays_per_sec.median, 4) + " Mrays/s, incoherent " + doubleToStringNSigFigs(incoherent.mrays_per_sec.median, 4) + " Mrays/s");
+
+	return "\t\t\t\t{\n"
+		"\t\t\t\t\t\"name\": " + jsonString(tree_type.name) + ",\n"
+		"\t\t\t\t\t\"build_time_s\": " + jsonStats(build_time_stats) + ",\n"
+		"\t\t\t\t\t\"mem_usage_B\": " + toString((uint64)tree->getTotalMemUsage()) + ",\n"
+		"\t\t\t\t\t\"primary_mrays_per_s\": " + jsonStats(primary.mrays_per_sec) + ",\n"
+		"\t\t\t\t\t\"primary_num_hits\": " + toString((uint64)primary.num_hits) + ",\n"
+		"\t\t\t\t\t\"incoherent_mrays_per_s\": " + jsonStats(incoherent.mrays_per_sec) + ",\n"
+		"\t\t\t\t\t\"incoherent_num_hits\": " + toString((uint64)incoherent.num_hits) + "\n"
+		"\t\t\t\t}";
+}
+
+
+//=========================================== Builders ===========================================
+
+
+struct BuilderResults
+{
+	double build_time;
+	float sah_cost;
+	size_t num_nodes;
+	size_t num_leaf_refs; // Number of object references in leaves.  Can be greater than the number of objects with spatial splits.
+	size_t mem_usage; // Size of the result nodes and leaf object indices.
+};
+
+
+static void runBinningBuilder(const RayMesh& mesh, const js::Vector<BVHBuilderTri, 16>& /*tris*/, glare::TaskManager& task_manager, BuilderResults& results_out)
+{
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+	js::Vector<ResultNode, 64> result_nodes;
+
+	Timer timer;
+	Reference<BinningBVHBuilder> builder = new BinningBVHBuilder(/*leaf_num_object_threshold=*/1, BUILDER_MAX_NUM_OBJECTS_PER_LEAF, BUILDER_MAX_DEPTH, BUILDER_INTERSECTION_COST, (int)mesh.getNumTris());
+	BVHBuilderUtils::setTriAABBs(*builder, mesh, task_manager);
+	builder->build(task_manager, should_cancel_callback, print_output, result_nodes);
+	results_out.build_time = timer.elapsed();
+
+	results_out.sah_cost = BVHBuilder::getSAHCost(result_nodes, BUILDER_INTERSECTION_COST);
+	results_out.num_nodes = result_nodes.size();
+	results_out.num_leaf_refs = builder->getResultObjectIndices().size();
+	results_out.mem_usage = result_nodes.dataSizeBytes() + builder->getResultObjectIndices().dataSizeBytes();
+}
+
+
+static void runSBVHBuilder(const RayMesh& mesh, const js::Vector<BVHBuilderTri, 16>& tris, glare::TaskManager& task_manager, BuilderResults& results_out)
+{
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+	js::Vector<ResultNode, 64> result_nodes;
+
+	Timer timer;
+	Reference<SBVHBuilder> builder = new SBVHBuilder(/*leaf_num_object_threshold=*/1, BUILDER_MAX_NUM_OBJECTS_PER_LEAF, BUILDER_MAX_DEPTH, BUILDER_INTERSECTION_COST, tris.data(), (int)mesh.getNumTris());
+	builder->build(task_manager, should_cancel_callback, print_output, result_nodes);
+	results_out.build_time = timer.elapsed();
+
+	results_out.sah_cost = BVHBuilder::getSAHCost(result_nodes, BUILDER_INTERSECTION_COST);
+	results_out.num_nodes = result_nodes.size();
+	results_out.num_leaf_refs = builder->getResultObjectIndices().size();
+	results_out.mem_usage = result_nodes.dataSizeBytes() + builder->getResultObjectIndices().dataSizeBytes();
+}
+
+
+static void runMortonBuilder(const RayMesh& mesh, const js::Vector<BVHBuilderTri, 16>& /*tris*/, glare::TaskManager& task_manager, BuilderResults& results_out)
+{
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+	js::Vector<ResultNode, 64> result_nodes;
+
+	Timer timer;
+	Reference<MortonBVHBuilder> builder = new MortonBVHBuilder(/*leaf_num_object_threshold=*/1, BUILDER_MAX_NUM_OBJECTS_PER_LEAF, BUILDER_MAX_DEPTH, BUILDER_INTERSECTION_COST, (int)mesh.getNumTris());
+	BVHBuilderUtils::setTriAABBs(*builder, mesh, task_manager);
+	builder->build(task_manager, should_cancel_callback, print_output, result_nodes);
+	results_out.build_time = timer.elapsed();
+
+	results_out.sah_cost = BVHBuilder::getSAHCost(result_nodes, BUILDER_INTERSECTION_COST);
+	results_out.num_nodes = result_nodes.size();
+	results_out.num_leaf_refs = builder->getResultObjectIndices().size();
+	results_out.mem_usage = result_nodes.dataSizeBytes() + builder->getResultObjectIndices().dataSizeBytes();
+}
+
+
+#ifndef NO_EMBREE
+
+// Same cost model as BVHBuilder::getSAHCost(), for the Embree builder result nodes, which store the child AABBs in the parent node.
+static float embreeSubtreeSAHCost(const js::Vector<ResultInteriorNode, 64>& nodes, const ResultInteriorNode& node, float node_surface_area)
+{
+	float cost = 1.f; // Traversal cost
+	for(int c=0; c<2; ++c)
+	{
+		const float prob = node.child_aabbs[c].getSurfaceArea() / node_surface_area;
+		const int child = (c == 0) ? node.left : node.right;
+		const int num_prims = (c == 0) ? node.left_num_prims : node.right_num_prims;
+		if(num_prims == -1)
+			cost += prob * embreeSubtreeSAHCost(nodes, nodes[child], node.child_aabbs[c].getSurfaceArea());
+		else
+			cost += prob * BUILDER_INTERSECTION_COST * num_prims;
+	}
+	return cost;
+}
+
+
+static void runEmbreeBuilder(const RayMesh& mesh, const js::Vector<BVHBuilderTri, 16>& tris, glare::TaskManager& task_manager, BuilderResults& results_out)
+{
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+	js::Vector<ResultInteriorNode, 64> result_nodes;
+
+	Timer timer;
+	EmbreeBVHBuilder builder(/*do_high_quality_build=*/false, BUILDER_MAX_NUM_OBJECTS_PER_LEAF, BUILDER_INTERSECTION_COST, tris.data(), (int)mesh.getNumTris());
+	builder.doBuild(task_manager, should_cancel_callback, print_output, result_nodes);
+	results_out.build_time = timer.elapsed();
+
+	if(result_nodes.empty())
+		results_out.sah_cost = BUILDER_INTERSECTION_COST * builder.getResultObjectIndices().size(); // Single leaf
+	else
+	{
+		js::AABBox root_aabb = result_nodes[0].child_aabbs[0];
+		root_aabb.enlargeToHoldAABBox(result_nodes[0].child_aabbs[1]);
+		results_out.sah_cost = embreeSubtreeSAHCost(result_nodes, result_nodes[0], root_aabb.getSurfaceArea());
+	}
+	results_out.num_nodes = result_nodes.size();
+	results_out.num_leaf_refs = builder.getResultObjectIndices().size();
+	results_out.mem_usage = result_nodes.dataSizeBytes() + builder.getResultObjectIndices().dataSizeBytes();
+}
+
+#endif // NO_EMBREE
+
+
+struct BuilderType
+{
+	const char* name;
+	void (*run)(const RayMesh& mesh, const js::Vector<BVHBuilderTri, 16>& tris, glare::TaskManager& task_manager, BuilderResults& results_out);
+};
+
+
+static const BuilderType builder_types[] = {
+	{ "BinningBVHBuilder",			runBinningBuilder },
+	{ "SBVHBuilder",				runSBVHBuilder },
+	{ "MortonBVHBuilder",			runMortonBuilder },
+#ifndef NO_EMBREE
+	{ "EmbreeBVHBuilder",			runEmbreeBuilder },
+#endif
+};
+
+
+static const std::string benchmarkBuilder(const BuilderType& builder_type, const RayMesh& mesh, const js::Vector<BVHBuilderTri, 16>& tris,
+	const BenchmarkOptions& options, glare::TaskManager& task_manager, PrintOutput& print_output)
+{
+	BuilderResults results;
+	std::vector<double> build_times;
+	for(int i=0; i<options.num_warmup_iters + options.num_iters; ++i)
+	{
+		builder_type.run(mesh, tris, task_manager, results);
+		if(i >= options.num_warmup_iters)
+			build_times.push_back(results.build_time);
+	}
+
+	const Stats build_time_stats = computeStats(build_times);
+	print_output.print("    " + std::string(builder_type.name) + ": build " + doubleToStringNSigFigs(build_time_stats.median * 1.0e3, 4) + " ms, SAH cost " + doubleToStringNSigFigs(results.sah_cost, 6) +
+		", nodes " + toString((uint64)results.num_nodes) + ", leaf refs " + toString((uint64)results.num_leaf_refs));
+
+	return "\t\t\t\t{\n"
+		"\t\t\t\t\t\"name\": " + jsonString(builder_type.name) + ",\n"
+		"\t\t\t\t\t\"build_time_s\": " + jsonStats(build_time_stats) + ",\n"
+		"\t\t\t\t\t\"sah_cost\": " + jsonNumber(results.sah_cost) + ",\n"
+		"\t\t\t\t\t\"num_nodes\": " + toString((uint64)results.num_nodes) + ",\n"
+		"\t\t\t\t\t\"num_leaf_refs\": " + toString((uint64)results.num_leaf_refs) + ",\n"
+		"\t\t\t\t\t\"mem_usage_B\": " + toString((uint64)results.mem_usage) + "\n"
+		"\t\t\t\t}";
+}
+
+
+//=========================================== Benchmark ===========================================
+
+
+const std::string run(const BenchmarkOptions& options, glare::TaskManager& task_manager, PrintOutput& print_output)
+{
+	if(options.num_iters < 1)
+		throw glare::Exception("num_iters must be >= 1");
+	if(options.num_warmup_iters < 0)
+		throw glare::Exception("num_warmup_iters must be >= 0");
+
+	std::vector<BenchmarkMesh> meshes;
+	makeMeshes(options, meshes);
+
+	TreeCreationContext tree_creation_context;
+#ifndef NO_EMBREE
+	// Create the Embree device once for all the EmbreeAccel builds.  Released when this function returns, after the trees have been freed.
+	EmbreeDeviceHandle embree_device(rtcNewDevice("verbose=0"));
+	if(!embree_device.ptr())
+		throw glare::Exception("rtcNewDevice failed.");
+	tree_creation_context.embree_device = embree_device.ptr();
+#endif
+
+	std::string json = "{\n"
+		"\t\"config\": {\n"
+		"\t\t\"num_warmup_iters\": " + toString(options.num_warmup_iters) + ",\n"
+		"\t\t\"num_iters\": " + toString(options.num_iters) + ",\n"
+		"\t\t\"num_primary_rays\": " + toString(options.num_primary_rays) + ",\n"
+		"\t\t\"num_incoherent_rays\": " + toString(options.num_incoherent_rays) + ",\n"
+		"\t\t\"mesh_scale\": " + jsonNumber(options.mesh_scale) + ",\n"
+		"\t\t\"num_build_threads\": " + toString((uint64)task_manager.getNumThreads()) + ",\n"
+#ifdef NDEBUG
+		"\t\t\"debug_build\": false,\n"
+#else
+		"\t\t\"debug_build\": true,\n"
+#endif
+#ifdef NO_EMBREE
+		"\t\t\"embree\": false\n"
+#else
+		"\t\t\"embree\": true\n"
+#endif
+		"\t},\n"
+		"\t\"meshes\": [\n";
+
+	for(size_t m=0; m<meshes.size(); ++m)
+	{
+		const RayMesh& mesh = *meshes[m].mesh;
+		print_output.print("Mesh '" + meshes[m].name + "' (" + toString(mesh.getNumTris()) + " tris)...");
+
+		const js::AABBox aabb = meshAABB(mesh);
+
+		std::vector<Ray> primary_rays, incoherent_rays;
+		makePrimaryRays(aabb, options.num_primary_rays, primary_rays);
+		makeIncoherentRays(aabb, options.num_incoherent_rays, incoherent_rays);
+
+		js::Vector<BVHBuilderTri, 16> tris(mesh.getNumTris());
+		for(size_t i=0; i<tris.size(); ++i)
+			for(int v=0; v<3; ++v)
+			{
+				const Vec3f& p = mesh.getVertices()[mesh.getTriangles()[i].vertex_indices[v]].pos;
+				tris[i].v[v] = Vec4f(p.x, p.y, p.z, 1.f);
+			}
+
+		json += "\t\t{\n"
+			"\t\t\t\"name\": " + jsonString(meshes[m].name) + ",\n"
+			"\t\t\t\"num_tris\": " + toString(mesh.getNumTris()) + ",\n"
+			"\t\t\t\"num_verts\": " + toString(mesh.getNumVerts()) + ",\n"
+			"\t\t\t\"trees\": [\n";
+
+		const size_t num_tree_types = sizeof(tree_types) / sizeof(TreeType);
+		for(size_t t=0; t<num_tree_types; ++t)
+			json += benchmarkTree(tree_types[t], tree_creation_context, mesh, primary_rays, incoherent_rays, options, task_manager, print_output) + ((t + 1 < num_tree_types) ? ",\n" : "\n");
+
+		json += "\t\t\t],\n"
+			"\t\t\t\"builders\": [\n";
+
+		const size_t num_builder_types = sizeof(builder_types) / sizeof(BuilderType);
+		for(size_t b=0; b<num_builder_types; ++b)
+			json += benchmarkBuilder(builder_types[b], mesh, tris, options, task_manager, print_output) + ((b + 1 < num_builder_types) ? ",\n" : "\n");
+
+		json += "\t\t\t]\n"
+			"\t\t}" + std::string((m + 1 < meshes.size()) ? ",\n" : "\n");
+	}
+
+	json += "\t]\n"
+		"}\n";
+	return json;
+}
+
+
+// Prints progress to stderr, so that the JSON can be written to stdout.
+class StdErrPrintOutput : public PrintOutput
+{
+public:
+	virtual void print(const std::string& s) { stdErrPrint(s); }
+	virtual void printStr(const std::string& s) { stdErrPrint(s); }
+};
+
+
+int runFromCommandLine(int argc, char** argv)
+{
+	try
+	{
+		std::map<std::string, std::vector<ArgumentParser::ArgumentType> > syntax;
+		syntax["--iters"]				= std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_int);
+		syntax["--warmup"]				= std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_int);
+		syntax["--scale"]				= std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_double);
+		syntax["--primary-rays"]		= std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_int);
+		syntax["--incoherent-rays"]		= std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_int);
+		syntax["--meshes"]				= std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // Comma-separated list of igmesh paths
+		syntax["--no-generated-meshes"]	= std::vector<ArgumentParser::ArgumentType>();
+		syntax["--threads"]				= std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_int);
+		syntax["--out"]					= std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--help"]				= std::vector<ArgumentParser::ArgumentType>();
+
+		std::vector<std::string> args;
+		for(int i=0; i<argc; ++i)
+			args.push_back(argv[i]);
+
+		ArgumentParser parser(args, syntax, /*allow_unnamed_arg=*/false);
+
+		if(parser.isArgPresent("--help"))
+		{
+			conPrint("Usage: physics_benchmark [--iters N] [--warmup N] [--scale S] [--primary-rays N] [--incoherent-rays N] [--meshes a.igmesh,b.igmesh] [--no-generated-meshes] [--threads N] [--out results.json]");
+			return 0;
+		}
+
+		BenchmarkOptions options;
+		if(parser.isArgPresent("--iters"))				options.num_iters = parser.getArgIntValue("--iters");
+		if(parser.isArgPresent("--warmup"))				options.num_warmup_iters = parser.getArgIntValue("--warmup");
+		if(parser.isArgPresent("--scale"))				options.mesh_scale = parser.getArgDoubleValue("--scale");
+		if(parser.isArgPresent("--primary-rays"))		options.num_primary_rays = parser.getArgIntValue("--primary-rays");
+		if(parser.isArgPresent("--incoherent-rays"))	options.num_incoherent_rays = parser.getArgIntValue("--incoherent-rays");
+		if(parser.isArgPresent("--meshes"))				options.mesh_paths = split(parser.getArgStringValue("--meshes"), ',');
+		if(parser.isArgPresent("--no-generated-meshes"))	options.use_generated_meshes = false;
+
+		UniqueRef<glare::TaskManager> task_manager(parser.isArgPresent("--threads") ?
+			new glare::TaskManager(myMax(1, parser.getArgIntValue("--threads"))) :
+			new glare::TaskManager());
+
+		StdErrPrintOutput print_output;
+		const std::string json = run(options, *task_manager.ptr(), print_output);
+
+		if(parser.isArgPresent("--out"))
+			FileUtils::writeEntireFile(parser.getArgStringValue("--out"), json);
+		else
+			std::cout << json;
+
+		return 0;
+	}
+	catch(ArgumentParserExcep& e)
+	{
+		stdErrPrint("Error parsing arguments: " + e.what());
+		return 1;
+	}
+	catch(glare::Exception& e)
+	{
+		stdErrPrint("Error: " + e.what());
+		return 1;
+	}
+}
+
+
+} // end namespace RayTracingBenchmark
+
+
+#if BUILD_TESTS
+
+
+#include "../utils/TestUtils.h"
+#include "../utils/JSONParser.h"
+
+
+void RayTracingBenchmark::test()
+{
+	conPrint("RayTracingBenchmark::test()");
+
+	glare::TaskManager task_manager(4);
+	StdErrPrintOutput print_output;
+
+	BenchmarkOptions options;
+	options.num_warmup_iters = 0;
+	options.num_iters = 2;
+	options.num_primary_rays = 32 * 32;
+	options.num_incoherent_rays = 1000;
+	options.mesh_scale = 0.005;
+
+	const std::string json = run(options, task_manager, print_output);
+
+	// Check the output is valid JSON with the expected structure, and that all trees hit the same number of triangles for each mesh.
+	JSONParser parser;
+	parser.parseBuffer(json.data(), json.size());
+
+	const JSONNode& root = parser.nodes[0];
+	testAssert(root.getChildObject(parser, "config").getChildIntValue(parser, "num_iters") == 2);
+
+	const JSONNode& meshes = root.getChildArray(parser, "meshes");
+	testAssert(meshes.child_indices.size() == 4);
+	for(size_t m=0; m<meshes.child_indices.size(); ++m)
+	{
+		const JSONNode& mesh = parser.nodes[meshes.child_indices[m]];
+		testAssert(mesh.getChildIntValue(parser, "num_tris") > 0);
+
+		const JSONNode& trees = mesh.getChildArray(parser, "trees");
+		testAssert(trees.child_indices.size() == sizeof(tree_types) / sizeof(TreeType));
+		const int64 ref_primary_hits = parser.nodes[trees.child_indices[0]].getChildIntValue(parser, "primary_num_hits");
+		testAssert(ref_primary_hits > 0);
+		for(size_t t=0; t<trees.child_indices.size(); ++t)
+		{
+			const JSONNode& tree = parser.nodes[trees.child_indices[t]];
+			testAssert(tree.getChildIntValue(parser, "mem_usage_B") > 0);
+			testAssert(tree.getChildObject(parser, "primary_mrays_per_s").getChildDoubleValue(parser, "min") > 0);
+			testAssert(tree.getChildIntValue(parser, "primary_num_hits") == ref_primary_hits);
+		}
+
+		const JSONNode& builders = mesh.getChildArray(parser, "builders");
+		testAssert(builders.child_indices.size() == sizeof(builder_types) / sizeof(BuilderType));
+		for(size_t b=0; b<builders.child_indices.size(); ++b)
+		{
+			const JSONNode& builder = parser.nodes[builders.child_indices[b]];
+			testAssert(builder.getChildDoubleValue(parser, "sah_cost") > 0);
+			testAssert(builder.getChildIntValue(parser, "num_leaf_refs") >= mesh.getChildIntValue(parser, "num_tris"));
+		}
+	}
+
+	// Test computeStats()
+	{
+		std::vector<double> values;
+		values.push_back(4);
+		values.push_back(1);
+		values.push_back(3);
+		values.push_back(2);
+		const Stats stats = computeStats(values);
+		testAssert(stats.min == 1 && stats.max == 4);
+		testEpsEqual(stats.mean, 2.5);
+		testEpsEqual(stats.median, 2.5);
+		testEpsEqual(stats.std_dev, std::sqrt(1.25));
+	}
+
+	testStringsEqual(jsonString("a\"b\\c\n"), "\"a\\\"b\\\\c\\n\"");
+	testStringsEqual(jsonNumber(std::numeric_limits<double>::infinity()), "null");
+
+	conPrint("RayTracingBenchmark::test() done.");
+}
+
+
+#endif // BUILD_TESTS
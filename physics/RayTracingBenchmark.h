@@ -0,0 +1,70 @@
+/*=====================================================================
+RayTracingBenchmark.h
+---------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include <string>
+#include <vector>
+
+
+namespace glare { class TaskManager; }
+class PrintOutput;
+
+
+/*=====================================================================
+RayTracingBenchmark
+-------------------
+Reproducible benchmark of the triangle mesh trees (BVH, SmallBVH, BVH8,
+QuantizedBVH, EmbreeAccel) and the BVH builders (BinningBVHBuilder,
+SBVHBuilder, MortonBVHBuilder, EmbreeBVHBuilder) in the physics module.
+
+A fixed set of meshes is generated procedurally with fixed random seeds,
+and other meshes can be loaded from igmesh files.  For each mesh and tree,
+the build time, memory usage and primary and incoherent ray throughput are
+measured.  For each builder, the build time, SAH cost and result size are
+measured.
+
+Each timed measurement is done num_warmup_iters times untimed, then
+num_iters times, and the min, max, mean, median and standard deviation are
+reported.  Rays are traced on a single thread, builds use the task manager.
+
+Results are returned as JSON, with a stable layout, so that results from
+different commits can be diffed.  Ray hit counts are included, which should
+be the same for all trees for a given mesh.
+
+See physics/benchmark/physics_benchmark.cpp for the command line program.
+=====================================================================*/
+namespace RayTracingBenchmark
+{
+
+
+struct BenchmarkOptions
+{
+	BenchmarkOptions();
+
+	int num_warmup_iters; // Number of untimed runs of each measurement, done before the timed runs.
+	int num_iters; // Number of timed runs of each measurement.
+	int num_primary_rays; // Number of coherent camera rays traced per run.
+	int num_incoherent_rays; // Number of rays with random origins and directions traced per run.
+	double mesh_scale; // Scales the number of triangles in the generated meshes.
+	bool use_generated_meshes; // If false, only meshes in mesh_paths are benchmarked.
+	std::vector<std::string> mesh_paths; // Paths to igmesh files to benchmark.
+};
+
+
+// Runs the benchmark and returns the results as JSON.
+// Progress is printed to print_output.  Throws glare::Exception if a mesh could not be loaded, or on other failure.
+const std::string run(const BenchmarkOptions& options, glare::TaskManager& task_manager, PrintOutput& print_output);
+
+// Parses the command line arguments, runs the benchmark, and writes the results to the file given with --out, or to stdout.
+// Returns the process exit code.
+int runFromCommandLine(int argc, char** argv);
+
+
+void test();
+
+
+} // end namespace RayTracingBenchmark
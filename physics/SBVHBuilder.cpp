@@ -32,8 +32,6 @@ TODO
 
 * Try precomputing reciprocal tri edge vectors - should make clipping faster.  (see edge recip distances precomputed.patch)
 
-* Do binning in tasks in SBVHBuilder as well as in BinningBVHBuilder? (doesn't seem to measurably speed up)
-
 * Can definitely get better builds lowering alpha. (threshold for spatial splits search)
 
 * prefetch tri in partition as well as search? (doesn't seem to measurably speed up)
@@ -160,6 +158,8 @@ SBVHBuilder::SBVHBuilder(int leaf_num_object_threshold_, int max_num_objects_per
 	// See /wiki/index.php?title=BVH_Building for results on varying this settings.
 	new_task_num_ob_threshold = 1 << 9;
 
+	parallel_split_num_ob_threshold = 1 << 15;
+
 	static_assert(sizeof(ResultNode) == 48, "sizeof(ResultNode) == 48");
 }
 
@@ -673,6 +673,170 @@ void SBVHBuilder::build(
 }
 
 
+/*
+Parallel split search and partitioning
+--------------------------------------
+At nodes with at least parallel_split_num_ob_threshold objects, the object and spatial split binning, the reference unsplitting passes
+and the partitioning are done over blocks of objects in parallel on the task manager.
+
+Each block bins into its own bins, which are then merged.  Bucket AABBs and counts merge exactly, so the split found is the same as with serial binning.
+
+Partitioning first counts the objects going left and right in each block, computes the write positions of each block with a prefix sum,
+then each block writes its objects, and the clipped references of triangles straddling a spatial split, to temp_obs.
+Objects end up in the same order as with serial partitioning, so the built tree does not depend on the number of threads.
+*/
+static const int max_B = 32; // Max number of object split buckets per axis
+static const int num_spatial_buckets = 16; // Number of spatial split buckets per axis
+
+static const int MIN_PARALLEL_BLOCK_SIZE = 1 << 12; // Min number of objects per block
+static const int MAX_NUM_PARALLEL_BLOCKS = 64;
+
+
+static inline int numParallelBlocks(int num_objects)
+{
+	return myClamp(num_objects / MIN_PARALLEL_BLOCK_SIZE, 1, MAX_NUM_PARALLEL_BLOCKS);
+}
+
+
+// Block b covers objects [blockBegin(b), blockBegin(b + 1))
+static GLARE_STRONG_INLINE int blockBegin(int begin, int end, int num_blocks, int b)
+{
+	return begin + (int)(((int64)(end - begin) * b) / num_blocks);
+}
+
+
+// Calls block_func(b) for each block b in [0, num_blocks), in parallel.
+template <class BlockFunc>
+static void runForBlocks(glare::TaskManager& task_manager, int num_blocks, const BlockFunc& block_func)
+{
+	task_manager.runParallelForDynamic([&](size_t block_begin, size_t block_end, size_t /*thread_index*/)
+	{
+		for(size_t b=block_begin; b<block_end; ++b)
+			block_func((int)b);
+	}, /*begin=*/0, /*end=*/(size_t)num_blocks, /*grain_size=*/1);
+}
+
+
+// For each axis, the AABBs of the objects whose centroids fall in each object split bucket, and the number of objects in each bucket.
+struct SBVHObjectBins
+{
+	js::AABBox bucket_aabbs[max_B * 3]; // Bucket b for axis a is at bucket_aabbs[a*max_B + b]
+	Vec4i counts[max_B]; // counts[b][a] is the count for bucket b on axis a.
+
+	void init(int num_buckets)
+	{
+		for(int i=0; i<num_buckets; ++i)
+		{
+			for(int z=0; z<3; ++z)
+				bucket_aabbs[z*max_B + i] = empty_aabb;
+			counts[i] = Vec4i(0);
+		}
+	}
+
+	void accum(const SBVHObjectBins& other, int num_buckets)
+	{
+		for(int i=0; i<num_buckets; ++i)
+		{
+			for(int z=0; z<3; ++z)
+				bucket_aabbs[z*max_B + i].enlargeToHoldAABBox(other.bucket_aabbs[z*max_B + i]);
+			counts[i] = counts[i] + other.counts[i];
+		}
+	}
+};
+
+
+// For each axis, the AABBs of the triangles clipped to each spatial split bucket, and the number of triangles entering and exiting each bucket.
+struct SBVHSpatialBins
+{
+	js::AABBox bucket_aabbs[num_spatial_buckets * 3]; // Bucket b for axis a is at bucket_aabbs[a*num_spatial_buckets + b]
+	Vec4i entry_counts[num_spatial_buckets];
+	Vec4i exit_counts[num_spatial_buckets];
+
+	void init(int /*num_buckets*/)
+	{
+		for(int i=0; i<num_spatial_buckets; ++i)
+		{
+			for(int z=0; z<3; ++z)
+				bucket_aabbs[z*num_spatial_buckets + i] = empty_aabb;
+			entry_counts[i] = Vec4i(0);
+			exit_counts [i] = Vec4i(0);
+		}
+	}
+
+	void accum(const SBVHSpatialBins& other, int /*num_buckets*/)
+	{
+		for(int i=0; i<num_spatial_buckets; ++i)
+		{
+			for(int z=0; z<3; ++z)
+				bucket_aabbs[z*num_spatial_buckets + i].enlargeToHoldAABBox(other.bucket_aabbs[z*num_spatial_buckets + i]);
+			entry_counts[i] = entry_counts[i] + other.entry_counts[i];
+			exit_counts [i] = exit_counts [i] + other.exit_counts[i];
+		}
+	}
+};
+
+
+// Bins the objects [begin, end) into bins_out.  bin_func(range_begin, range_end, bins) should initialise bins and bin the objects [range_begin, range_end) into it.
+// If parallel_task_manager is non-null, bins blocks of objects in parallel, then merges the block bins.
+template <class BinsType, class BinFunc>
+static void binObjectsInBlocks(glare::TaskManager* parallel_task_manager, int begin, int end, int num_buckets, const BinFunc& bin_func, BinsType& bins_out)
+{
+	if(!parallel_task_manager)
+	{
+		bin_func(begin, end, bins_out);
+		return;
+	}
+
+	const int num_blocks = numParallelBlocks(end - begin);
+	js::Vector<BinsType, 16> block_bins(num_blocks);
+
+	runForBlocks(*parallel_task_manager, num_blocks, [&](int b)
+	{
+		bin_func(blockBegin(begin, end, num_blocks, b), blockBegin(begin, end, num_blocks, b + 1), block_bins[b]);
+	});
+
+	bins_out.init(num_buckets);
+	for(int b=0; b<num_blocks; ++b)
+		bins_out.accum(block_bins[b], num_buckets);
+}
+
+
+// Which child (or children) an object goes to when partitioning.
+enum PartitionSide
+{
+	PartitionSide_Left,
+	PartitionSide_Right,
+	PartitionSide_Both // For triangles straddling a spatial split plane, that are clipped and referenced from both children.
+};
+
+
+static GLARE_STRONG_INLINE PartitionSide objectSplitSide(const SBVHOb& ob, const js::AABBox& centroid_aabb, const Vec4f& scale, int num_buckets, int best_axis, int best_bucket)
+{
+	const Vec4i bucket_i = clamp(truncateToVec4i((ob.aabb.centroid() - centroid_aabb.min_) * scale), Vec4i(0), Vec4i(num_buckets-1));
+	return (bucket_i[best_axis] <= best_bucket) ? PartitionSide_Left : PartitionSide_Right;
+}
+
+
+static GLARE_STRONG_INLINE PartitionSide spatialSplitSide(const SBVHOb& ob, const js::AABBox& parent_aabb, const Vec4f& spatial_scale, int best_axis, int best_bucket)
+{
+	const Vec4i entry_bucket_i = clamp(truncateToVec4i((ob.aabb.min_ - parent_aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
+	const Vec4i exit_bucket_i  = clamp(truncateToVec4i((ob.aabb.max_ - parent_aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
+
+	if(entry_bucket_i[best_axis] <= best_bucket && exit_bucket_i[best_axis] > best_bucket) // If triangle straddles split plane:
+	{
+		const uint32 unsplit_tri = ob.getUnsplit();
+		if(unsplit_tri == 1)
+			return PartitionSide_Left;
+		else if(unsplit_tri == 2)
+			return PartitionSide_Right;
+		else
+			return PartitionSide_Both;
+	}
+	else // Else if triangle does not straddle clip plane:  then triangle bounds are completely in left or right side.
+		return (exit_bucket_i[best_axis] <= best_bucket) ? PartitionSide_Left : PartitionSide_Right;
+}
+
+
 // Parition objects in cur_objects for the given axis, based on best_div_val of best_axis.
 // Places the paritioned objects in left_obs_out and right_obs_out.
 struct PartitionRes
@@ -688,6 +852,23 @@ struct PartitionRes
 };
 
 
+// Combines the AABBs and counts of the partition results of each block into res_out.  Doesn't set res_out.left_capacity.
+static void mergeBlockPartitionResults(const js::Vector<PartitionRes, 16>& block_res, PartitionRes& res_out)
+{
+	res_out.left_aabb = res_out.left_centroid_aabb = res_out.right_aabb = res_out.right_centroid_aabb = empty_aabb;
+	res_out.num_left = res_out.num_right = 0;
+	for(size_t b=0; b<block_res.size(); ++b)
+	{
+		res_out.left_aabb          .enlargeToHoldAABBox(block_res[b].left_aabb);
+		res_out.left_centroid_aabb .enlargeToHoldAABBox(block_res[b].left_centroid_aabb);
+		res_out.right_aabb         .enlargeToHoldAABBox(block_res[b].right_aabb);
+		res_out.right_centroid_aabb.enlargeToHoldAABBox(block_res[b].right_centroid_aabb);
+		res_out.num_left  += block_res[b].num_left;
+		res_out.num_right += block_res[b].num_right;
+	}
+}
+
+
 // Partition half the list left and half right.
 static void arbitraryPartition(const std::vector<SBVHOb>& objects_, int begin, int end, int capacity, PartitionRes& res_out)
 {
@@ -730,24 +911,15 @@ static void arbitraryPartition(const std::vector<SBVHOb>& objects_, int begin, i
 }
 
 
-static void partition(std::vector<SBVHOb>& objects_, std::vector<SBVHOb>& temp_obs, int begin, int end, int capacity, const BVHBuilderTri* triangles, const js::AABBox& parent_aabb, 
-	const js::AABBox& centroid_aabb,
+// Partitions objects [range_begin, range_end) into temp_obs.  Left objects are written from left_write_begin, right objects from right_write_begin.
+// Sets the AABBs, num_left and num_right of res_out.
+static void partitionRange(const SBVHOb* const objects, SBVHOb* const temp_obs, int range_begin, int range_end, int left_write_begin, int right_write_begin, const BVHBuilderTri* triangles, 
+	const js::AABBox& parent_aabb, const js::AABBox& centroid_aabb, int num_buckets,
 	float best_div_val, int best_axis, bool best_split_was_spatial, int best_bucket,
-	int best_num_left, int best_num_right, 
 	PartitionRes& res_out
 	)
 {
-	SBVHOb* const objects = objects_.data();
-
-	const int num_left  = best_num_left;
-	const int num_right = best_num_right;
-
-	// Split the capacity proportially to num_left and num_right
-	const int max_left_capacity = capacity - num_right;
-	const int left_capacity = myClamp((int)(0.5f + capacity * (float)num_left / (num_left + num_right)), num_left, max_left_capacity); // Add 0.5 to round-to-nearest int
-
-	int left_write = begin;
-	const int right_write_begin = begin + left_capacity;
+	int left_write = left_write_begin;
 	int right_write = right_write_begin;
 
 	js::AABBox left_aabb = empty_aabb;
@@ -757,161 +929,242 @@ static void partition(std::vector<SBVHOb>& objects_, std::vector<SBVHOb>& temp_o
 
 	if(best_split_was_spatial)
 	{
-		const int num_spatial_buckets = 16;
 		const Vec4f spatial_scale = div(Vec4f((float)num_spatial_buckets), (parent_aabb.max_ - parent_aabb.min_));
 
-		for(int cur = begin; cur < end; ++cur)
+		for(int cur = range_begin; cur < range_end; ++cur)
 		{
-			const int ob_i = objects[cur].getIndex();
-			const BVHBuilderTri& tri = triangles[ob_i];
 			const js::AABBox aabb = objects[cur].aabb;
 			assert(parent_aabb.containsAABBox(setWCoordsToOne(aabb)));
-			const Vec4i entry_bucket_i = clamp(truncateToVec4i((aabb.min_ - parent_aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
-			const Vec4i exit_bucket_i  = clamp(truncateToVec4i((aabb.max_ - parent_aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
 
-			if(entry_bucket_i[best_axis] <= best_bucket && exit_bucket_i[best_axis] > best_bucket) // If triangle straddles split plane:
+			const PartitionSide side = spatialSplitSide(objects[cur], parent_aabb, spatial_scale, best_axis, best_bucket);
+			if(side == PartitionSide_Left) // If object should go on Left side, either because it is entirely left of the split plane, or it was unsplit to the left:
 			{
-				const uint32 unsplit_tri = objects[cur].getUnsplit();
-				if(unsplit_tri == 1)
-				{
-					temp_obs[left_write++] = objects[cur];
-					left_aabb.enlargeToHoldAABBox(aabb);
-					left_centroid_aabb.enlargeToHoldPoint(aabb.centroid());
-				}
-				else if(unsplit_tri == 2)
-				{
-					temp_obs[right_write++] = objects[cur];
-					right_aabb.enlargeToHoldAABBox(aabb);
-					right_centroid_aabb.enlargeToHoldPoint(aabb.centroid());
-				}
-				else
+				temp_obs[left_write++] = objects[cur];
+				left_aabb.enlargeToHoldAABBox(aabb);
+				left_centroid_aabb.enlargeToHoldPoint(aabb.centroid());
+			}
+			else if(side == PartitionSide_Right)
+			{
+				temp_obs[right_write++] = objects[cur];
+				right_aabb.enlargeToHoldAABBox(aabb);
+				right_centroid_aabb.enlargeToHoldPoint(aabb.centroid());
+			}
+			else // Else triangle straddles the split plane:
+			{
+				const int ob_i = objects[cur].getIndex();
+				const BVHBuilderTri& tri = triangles[ob_i];
+
+				// Clip triangle with splitting plane
+				js::AABBox tri_left_aabb  = empty_aabb;
+				js::AABBox tri_right_aabb = empty_aabb;
+				Vec4f v = tri.v[2]; // current vert, start with v2 so first edge processed is v2 -> v0
+				for(int i=0; i<3; ++i) // For each triangle vertex:
 				{
-					// Clip triangle with splitting plane
-					js::AABBox tri_left_aabb  = empty_aabb;
-					js::AABBox tri_right_aabb = empty_aabb;
-					Vec4f v = tri.v[2]; // current vert, start with v2 so first edge processed is v2 -> v0
-					for(int i=0; i<3; ++i) // For each triangle vertex:
+					const Vec4f prev_v = v;
+					v = tri.v[i];
+					if((prev_v[best_axis] < best_div_val && v[best_axis] > best_div_val) || (prev_v[best_axis] > best_div_val && v[best_axis] < best_div_val)) // If edge from prev_v to v straddles clip plane:
 					{
-						const Vec4f prev_v = v;
-						v = tri.v[i];
-						if((prev_v[best_axis] < best_div_val && v[best_axis] > best_div_val) || (prev_v[best_axis] > best_div_val && v[best_axis] < best_div_val)) // If edge from prev_v to v straddles clip plane:
-						{
-							const float t = (best_div_val - prev_v[best_axis]) / (v[best_axis] - prev_v[best_axis]); // Solve for fraction along edge of position on split plane.
-							const Vec4f p = prev_v * (1 - t) + v * t;
-							tri_left_aabb .enlargeToHoldPoint(p);
-							tri_right_aabb.enlargeToHoldPoint(p);
-						}
-
-						if(v[best_axis] <= best_div_val) tri_left_aabb .enlargeToHoldPoint(v);
-						if(v[best_axis] >= best_div_val) tri_right_aabb.enlargeToHoldPoint(v);
+						const float t = (best_div_val - prev_v[best_axis]) / (v[best_axis] - prev_v[best_axis]); // Solve for fraction along edge of position on split plane.
+						const Vec4f p = prev_v * (1 - t) + v * t;
+						tri_left_aabb .enlargeToHoldPoint(p);
+						tri_right_aabb.enlargeToHoldPoint(p);
 					}
 
-					assert(tri_left_aabb.invariant());
-					assert(tri_right_aabb.invariant());
-
-					// Make sure AABBs of clipped triangle don't extend past the bounds of the triangle clipped to the current AABB.
-					tri_left_aabb  = intersection(tri_left_aabb,  aabb);
-					tri_right_aabb = intersection(tri_right_aabb, aabb);
-
-					// Force AABB to be valid.
-					// Fixes partitioning failing due to max of AABB being < min of AABB, resuling in entry bin being > exit bin.
-					tri_left_aabb.min_  = min(tri_left_aabb.min_,  tri_left_aabb.max_);
-					tri_right_aabb.min_ = min(tri_right_aabb.min_, tri_right_aabb.max_);
-
-					// Check tri_left_aabb, tri_right_aabb
-				//	assert(parent_aabb.containsAABBox(tri_left_aabb));
-				//	assert(parent_aabb.containsAABBox(tri_right_aabb));
-					assert(tri_left_aabb .max_[best_axis] <= best_div_val + 1.0e-5f);
-					assert(tri_right_aabb.min_[best_axis] >= best_div_val - 1.0e-5f);
-
-					assert(tri_left_aabb.invariant());
-					assert(tri_right_aabb.invariant());
+					if(v[best_axis] <= best_div_val) tri_left_aabb .enlargeToHoldPoint(v);
+					if(v[best_axis] >= best_div_val) tri_right_aabb.enlargeToHoldPoint(v);
+				}
 
-					SBVHOb left_ob;
-					left_ob.aabb.min_ = setW(tri_left_aabb.min_, ob_i); // Store ob index in min_.w
-					left_ob.aabb.max_ = tri_left_aabb.max_;
-					assert(left_ob.getIndex() == ob_i);
-					temp_obs[left_write++] = left_ob;
+				assert(tri_left_aabb.invariant());
+				assert(tri_right_aabb.invariant());
 
-					SBVHOb right_ob;
-					right_ob.aabb.min_ = setW(tri_right_aabb.min_, ob_i); // Store ob index in min_.w
-					right_ob.aabb.max_ = tri_right_aabb.max_;
-					assert(right_ob.getIndex() == ob_i);
-					temp_obs[right_write++] = right_ob;
+				// Make sure AABBs of clipped triangle don't extend past the bounds of the triangle clipped to the current AABB.
+				tri_left_aabb  = intersection(tri_left_aabb,  aabb);
+				tri_right_aabb = intersection(tri_right_aabb, aabb);
 
-					left_centroid_aabb .enlargeToHoldPoint(tri_left_aabb.centroid()); // Get centroid of the part of the triangle clipped to left child volume, add to left centroid aabb.
-					right_centroid_aabb.enlargeToHoldPoint(tri_right_aabb.centroid());
+				// Force AABB to be valid.
+				// Fixes partitioning failing due to max of AABB being < min of AABB, resuling in entry bin being > exit bin.
+				tri_left_aabb.min_  = min(tri_left_aabb.min_,  tri_left_aabb.max_);
+				tri_right_aabb.min_ = min(tri_right_aabb.min_, tri_right_aabb.max_);
 
-					left_aabb .enlargeToHoldAABBox(tri_left_aabb);
-					right_aabb.enlargeToHoldAABBox(tri_right_aabb);
-				}
-			}
-			else // Else if triangle does not straddle clip plane:  then triangle bounds are completely in left or right side. Send triangle left or right based on triangle centroid.
-			{
-				const Vec4f centroid = aabb.centroid();
-				if(exit_bucket_i[best_axis] <= best_bucket) // If object should go on Left side:
-				{
-					temp_obs[left_write++] = objects[cur];
-					left_aabb.enlargeToHoldAABBox(aabb);
-					left_centroid_aabb.enlargeToHoldPoint(centroid);
-				}
-				else // else if cur object should go on Right side:
-				{
-					temp_obs[right_write++] = objects[cur];
-					right_aabb.enlargeToHoldAABBox(aabb);
-					right_centroid_aabb.enlargeToHoldPoint(centroid);
-				}
+				// Check tri_left_aabb, tri_right_aabb
+			//	assert(parent_aabb.containsAABBox(tri_left_aabb));
+			//	assert(parent_aabb.containsAABBox(tri_right_aabb));
+				assert(tri_left_aabb .max_[best_axis] <= best_div_val + 1.0e-5f);
+				assert(tri_right_aabb.min_[best_axis] >= best_div_val - 1.0e-5f);
+
+				assert(tri_left_aabb.invariant());
+				assert(tri_right_aabb.invariant());
+
+				SBVHOb left_ob;
+				left_ob.aabb.min_ = setW(tri_left_aabb.min_, ob_i); // Store ob index in min_.w
+				left_ob.aabb.max_ = tri_left_aabb.max_;
+				assert(left_ob.getIndex() == ob_i);
+				temp_obs[left_write++] = left_ob;
+
+				SBVHOb right_ob;
+				right_ob.aabb.min_ = setW(tri_right_aabb.min_, ob_i); // Store ob index in min_.w
+				right_ob.aabb.max_ = tri_right_aabb.max_;
+				assert(right_ob.getIndex() == ob_i);
+				temp_obs[right_write++] = right_ob;
+
+				left_centroid_aabb .enlargeToHoldPoint(tri_left_aabb.centroid()); // Get centroid of the part of the triangle clipped to left child volume, add to left centroid aabb.
+				right_centroid_aabb.enlargeToHoldPoint(tri_right_aabb.centroid());
+
+				left_aabb .enlargeToHoldAABBox(tri_left_aabb);
+				right_aabb.enlargeToHoldAABBox(tri_right_aabb);
 			}
 		}
 	}
 	else // Else if best split was just an object split:
 	{
 		// Code to do the partition exactly how the search was done:
-		const int max_B = 32;
-		const int num_buckets = myMin(max_B, (int)(4 + 0.05f * (end - begin))); // buckets per axis
 		const Vec4f scale = div(Vec4f((float)num_buckets), (centroid_aabb.max_ - centroid_aabb.min_));
 
-		for(int cur = begin; cur < end; ++cur)
+		for(int cur = range_begin; cur < range_end; ++cur)
 		{
 			const js::AABBox aabb = objects[cur].aabb;
 			const Vec4f centroid = aabb.centroid();
 
-			const Vec4i bucket_i = clamp(truncateToVec4i((centroid - centroid_aabb.min_) * scale), Vec4i(0), Vec4i(num_buckets-1));
-			if(bucket_i[best_axis] <= best_bucket) // If object should go on left side:
+			if(objectSplitSide(objects[cur], centroid_aabb, scale, num_buckets, best_axis, best_bucket) == PartitionSide_Left) // If object should go on left side:
 			{
 				left_aabb.enlargeToHoldAABBox(aabb);
 				left_centroid_aabb.enlargeToHoldPoint(centroid);
-
-				assert(left_write < begin + num_left);
-				assert(left_write < right_write_begin);
 				temp_obs[left_write++] = objects[cur];
 			}
 			else // else if cur object should go on right side:
 			{
 				right_aabb.enlargeToHoldAABBox(aabb);
 				right_centroid_aabb.enlargeToHoldPoint(centroid);
-
-				assert(right_write < right_write_begin + num_right);
-				assert(right_write < begin + capacity);
 				temp_obs[right_write++] = objects[cur];
 			}
 		}
 	}
 
-	assert(left_write - begin              == num_left ); // Check the number of objects we partitioned left was equal to the num left computed by the search.
-	assert(right_write - right_write_begin == num_right); // Check the number of objects we partitioned right was equal to the num left computed by the search.
-
-	// Copy from temp_obs back to obs
-	for(int i = begin; i != left_write; ++i)
-		objects[i] = temp_obs[i];
-
-	for(int i = begin + left_capacity; i != right_write; ++i)
-		objects[i] = temp_obs[i];
-
 	res_out.left_aabb = left_aabb;
 	res_out.left_centroid_aabb = left_centroid_aabb;
 	res_out.right_aabb = right_aabb;
 	res_out.right_centroid_aabb = right_centroid_aabb;
+	res_out.num_left  = left_write  - left_write_begin;
+	res_out.num_right = right_write - right_write_begin;
+}
+
+
+// Counts the objects in [range_begin, range_end) that partitionRange() will write left and right.  Straddling triangles that are clipped are counted on both sides.
+static void countPartitionRange(const SBVHOb* const objects, int range_begin, int range_end, const js::AABBox& parent_aabb, const js::AABBox& centroid_aabb, int num_buckets,
+	int best_axis, bool best_split_was_spatial, int best_bucket, int& num_left_out, int& num_right_out)
+{
+	int num_left = 0;
+	int num_right = 0;
+	if(best_split_was_spatial)
+	{
+		const Vec4f spatial_scale = div(Vec4f((float)num_spatial_buckets), (parent_aabb.max_ - parent_aabb.min_));
+		for(int cur = range_begin; cur < range_end; ++cur)
+		{
+			const PartitionSide side = spatialSplitSide(objects[cur], parent_aabb, spatial_scale, best_axis, best_bucket);
+			num_left  += (side != PartitionSide_Right) ? 1 : 0;
+			num_right += (side != PartitionSide_Left)  ? 1 : 0;
+		}
+	}
+	else
+	{
+		const Vec4f scale = div(Vec4f((float)num_buckets), (centroid_aabb.max_ - centroid_aabb.min_));
+		for(int cur = range_begin; cur < range_end; ++cur)
+			num_left += (objectSplitSide(objects[cur], centroid_aabb, scale, num_buckets, best_axis, best_bucket) == PartitionSide_Left) ? 1 : 0;
+		num_right = (range_end - range_begin) - num_left;
+	}
+	num_left_out  = num_left;
+	num_right_out = num_right;
+}
+
+
+static void partition(glare::TaskManager* parallel_task_manager, std::vector<SBVHOb>& objects_, std::vector<SBVHOb>& temp_obs_, int begin, int end, int capacity, const BVHBuilderTri* triangles, const js::AABBox& parent_aabb, 
+	const js::AABBox& centroid_aabb,
+	float best_div_val, int best_axis, bool best_split_was_spatial, int best_bucket,
+	int best_num_left, int best_num_right, 
+	PartitionRes& res_out
+	)
+{
+	SBVHOb* const objects = objects_.data();
+	SBVHOb* const temp_obs = temp_obs_.data();
+
+	const int num_left  = best_num_left;
+	const int num_right = best_num_right;
+
+	// Split the capacity proportially to num_left and num_right
+	const int max_left_capacity = capacity - num_right;
+	const int left_capacity = myClamp((int)(0.5f + capacity * (float)num_left / (num_left + num_right)), num_left, max_left_capacity); // Add 0.5 to round-to-nearest int
+
+	const int right_write_begin = begin + left_capacity;
+
+	// Number of object split buckets, the same as in the search.
+	const int num_buckets = myMin(max_B, (int)(4 + 0.05f * (end - begin)));
+
+	if(!parallel_task_manager)
+	{
+		partitionRange(objects, temp_obs, begin, end, /*left_write_begin=*/begin, right_write_begin, triangles, parent_aabb, centroid_aabb, num_buckets, 
+			best_div_val, best_axis, best_split_was_spatial, best_bucket, res_out);
+	}
+	else
+	{
+		const int num_blocks = numParallelBlocks(end - begin);
+		js::Vector<PartitionRes, 16> block_res(num_blocks);
+
+		// Count the number of objects each block writes left and right
+		runForBlocks(*parallel_task_manager, num_blocks, [&](int b)
+		{
+			countPartitionRange(objects, blockBegin(begin, end, num_blocks, b), blockBegin(begin, end, num_blocks, b + 1), parent_aabb, centroid_aabb, num_buckets, 
+				best_axis, best_split_was_spatial, best_bucket, block_res[b].num_left, block_res[b].num_right);
+		});
+
+		// Compute the left and right write positions for each block
+		js::Vector<int, 16> block_left_write(num_blocks);
+		js::Vector<int, 16> block_right_write(num_blocks);
+		int left_write = begin;
+		int right_write = right_write_begin;
+		for(int b=0; b<num_blocks; ++b)
+		{
+			block_left_write[b] = left_write;
+			block_right_write[b] = right_write;
+			left_write  += block_res[b].num_left;
+			right_write += block_res[b].num_right;
+		}
+		assert(left_write - begin              == num_left);
+		assert(right_write - right_write_begin == num_right);
+
+		runForBlocks(*parallel_task_manager, num_blocks, [&](int b)
+		{
+			partitionRange(objects, temp_obs, blockBegin(begin, end, num_blocks, b), blockBegin(begin, end, num_blocks, b + 1), block_left_write[b], block_right_write[b], triangles, parent_aabb, centroid_aabb, num_buckets, 
+				best_div_val, best_axis, best_split_was_spatial, best_bucket, block_res[b]);
+		});
+
+		mergeBlockPartitionResults(block_res, res_out);
+	}
+
+	assert(res_out.num_left  == num_left ); // Check the number of objects we partitioned left was equal to the num left computed by the search.
+	assert(res_out.num_right == num_right); // Check the number of objects we partitioned right was equal to the num left computed by the search.
+	assert(num_left <= left_capacity && right_write_begin + num_right <= begin + capacity);
+
+	// Copy from temp_obs back to obs
+	if(!parallel_task_manager)
+	{
+		for(int i = begin; i != begin + num_left; ++i)
+			objects[i] = temp_obs[i];
+
+		for(int i = right_write_begin; i != right_write_begin + num_right; ++i)
+			objects[i] = temp_obs[i];
+	}
+	else
+	{
+		parallel_task_manager->runParallelForDynamic([&](size_t range_begin, size_t range_end, size_t /*thread_index*/)
+		{
+			for(size_t z=range_begin; z<range_end; ++z)
+			{
+				const size_t i = (z < (size_t)num_left) ? (begin + z) : (right_write_begin + z - num_left); // Left objects, then right objects
+				objects[i] = temp_obs[i];
+			}
+		}, /*begin=*/0, /*end=*/(size_t)(num_left + num_right), /*grain_size=*/MIN_PARALLEL_BLOCK_SIZE);
+	}
+
 	res_out.num_left = num_left;
 	res_out.num_right = num_right;
 	res_out.left_capacity = left_capacity;
@@ -919,13 +1172,11 @@ static void partition(std::vector<SBVHOb>& objects_, std::vector<SBVHOb>& temp_o
 
 
 // Compute AABBs of objects partitioned left and right, and the number partioned left and right, for a spatial split with unsplitting, without doing any actual partitioning.
-static void spatialPartitionResultWithUnsplitting(const std::vector<SBVHOb>& objects_, const BVHBuilderTri* triangles, const js::AABBox& parent_aabb, int begin, int end, 
+// Considers the objects [range_begin, range_end).
+static void spatialPartitionResultWithUnsplittingForRange(const SBVHOb* const objects, const BVHBuilderTri* triangles, const js::AABBox& parent_aabb, int range_begin, int range_end, 
 	float best_div_val, int best_axis, int best_bucket,
 	PartitionRes& res_out)
 {
-	const SBVHOb* const objects = objects_.data();
-
-	const int num_spatial_buckets = 16;
 	const Vec4f spatial_scale = div(Vec4f((float)num_spatial_buckets), (parent_aabb.max_ - parent_aabb.min_));
 
 	int num_left  = 0;
@@ -933,90 +1184,98 @@ static void spatialPartitionResultWithUnsplitting(const std::vector<SBVHOb>& obj
 	js::AABBox left_aabb  = empty_aabb;
 	js::AABBox right_aabb = empty_aabb;
 
-	for(int cur = begin; cur < end; ++cur)
+	for(int cur = range_begin; cur < range_end; ++cur)
 	{
-		const int ob_i = objects[cur].getIndex();
-		const BVHBuilderTri& tri = triangles[ob_i];
 		const js::AABBox aabb = objects[cur].aabb;
 		assert(parent_aabb.containsAABBox(setWCoordsToOne(aabb)));
 
-		const Vec4i entry_bucket_i = clamp(truncateToVec4i((aabb.min_ - parent_aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
-		const Vec4i exit_bucket_i  = clamp(truncateToVec4i((aabb.max_ - parent_aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
-
-		if(entry_bucket_i[best_axis] <= best_bucket && exit_bucket_i[best_axis] > best_bucket) // If triangle straddles split plane:
+		const PartitionSide side = spatialSplitSide(objects[cur], parent_aabb, spatial_scale, best_axis, best_bucket);
+		if(side == PartitionSide_Left)
 		{
-			const uint32 unsplit_tri = objects[cur].getUnsplit();
-			if(unsplit_tri == 1)
-			{
-				left_aabb.enlargeToHoldAABBox(aabb);
-				num_left++;
-			}
-			else if(unsplit_tri == 2)
-			{
-				right_aabb.enlargeToHoldAABBox(aabb);
-				num_right++;
-			}
-			else
+			left_aabb.enlargeToHoldAABBox(aabb);
+			num_left++;
+		}
+		else if(side == PartitionSide_Right)
+		{
+			right_aabb.enlargeToHoldAABBox(aabb);
+			num_right++;
+		}
+		else // Else triangle straddles the split plane:
+		{
+			const BVHBuilderTri& tri = triangles[objects[cur].getIndex()];
+
+			// Clip
+			js::AABBox tri_left_aabb  = empty_aabb;
+			js::AABBox tri_right_aabb = empty_aabb;
+			Vec4f v = tri.v[2]; // current vert
+			for(int i=0; i<3; ++i) // For each triangle vertex:
 			{
-				// Clip
-				js::AABBox tri_left_aabb  = empty_aabb;
-				js::AABBox tri_right_aabb = empty_aabb;
-				Vec4f v = tri.v[2]; // current vert
-				for(int i=0; i<3; ++i) // For each triangle vertex:
+				const Vec4f prev_v = v;
+				v = tri.v[i];
+				if((prev_v[best_axis] < best_div_val && v[best_axis] > best_div_val) || (prev_v[best_axis] > best_div_val && v[best_axis] < best_div_val)) // If edge from prev_v to v straddles clip plane:
 				{
-					const Vec4f prev_v = v;
-					v = tri.v[i];
-					if((prev_v[best_axis] < best_div_val && v[best_axis] > best_div_val) || (prev_v[best_axis] > best_div_val && v[best_axis] < best_div_val)) // If edge from prev_v to v straddles clip plane:
-					{
-						const float t = (best_div_val - prev_v[best_axis]) / (v[best_axis] - prev_v[best_axis]); // Solve for fraction along edge of position on split plane.
-						const Vec4f p = prev_v * (1 - t) + v * t;
-						tri_left_aabb.enlargeToHoldPoint(p);
-						tri_right_aabb.enlargeToHoldPoint(p);
-					}
-
-					if(v[best_axis] <= best_div_val) tri_left_aabb.enlargeToHoldPoint(v);
-					if(v[best_axis] >= best_div_val) tri_right_aabb.enlargeToHoldPoint(v);
+					const float t = (best_div_val - prev_v[best_axis]) / (v[best_axis] - prev_v[best_axis]); // Solve for fraction along edge of position on split plane.
+					const Vec4f p = prev_v * (1 - t) + v * t;
+					tri_left_aabb.enlargeToHoldPoint(p);
+					tri_right_aabb.enlargeToHoldPoint(p);
 				}
 
-				// Make sure AABBs of clipped triangles don't extend past the current node AABB.
-				tri_left_aabb  = intersection(tri_left_aabb, aabb);
-				tri_right_aabb = intersection(tri_right_aabb, aabb);
+				if(v[best_axis] <= best_div_val) tri_left_aabb.enlargeToHoldPoint(v);
+				if(v[best_axis] >= best_div_val) tri_right_aabb.enlargeToHoldPoint(v);
+			}
 
-				// Check tri_left_aabb, tri_right_aabb
-				assert(parent_aabb.containsAABBox(tri_left_aabb));
-				assert(parent_aabb.containsAABBox(tri_right_aabb));
-				assert(tri_left_aabb .max_[best_axis] <= best_div_val + (1.0e-4f * std::fabs(best_div_val)) + 1.0e-5f); // Take into account numerical inaccuracy in the clipping. 
-				assert(tri_right_aabb.min_[best_axis] >= best_div_val - (1.0e-4f * std::fabs(best_div_val)) - 1.0e-5f);
+			// Make sure AABBs of clipped triangles don't extend past the current node AABB.
+			tri_left_aabb  = intersection(tri_left_aabb, aabb);
+			tri_right_aabb = intersection(tri_right_aabb, aabb);
 
-				left_aabb.enlargeToHoldAABBox(tri_left_aabb);
-				right_aabb.enlargeToHoldAABBox(tri_right_aabb);
+			// Check tri_left_aabb, tri_right_aabb
+			assert(parent_aabb.containsAABBox(tri_left_aabb));
+			assert(parent_aabb.containsAABBox(tri_right_aabb));
+			assert(tri_left_aabb .max_[best_axis] <= best_div_val + (1.0e-4f * std::fabs(best_div_val)) + 1.0e-5f); // Take into account numerical inaccuracy in the clipping. 
+			assert(tri_right_aabb.min_[best_axis] >= best_div_val - (1.0e-4f * std::fabs(best_div_val)) - 1.0e-5f);
 
-				num_left++;
-				num_right++;
-			}
-		}
-		else // Else if triangle does not straddle clip plane:  then triangle bounds are completely in left or right side. Send triangle left or right based on triangle centroid.
-		{
-			if(exit_bucket_i[best_axis] <= best_bucket) // If object should go on Left side:
-			{
-				left_aabb.enlargeToHoldAABBox(aabb);
-				num_left++;
-			}
-			else // else if cur object should go on Right side:
-			{
-				right_aabb.enlargeToHoldAABBox(aabb);
-				num_right++;
-			}
+			left_aabb.enlargeToHoldAABBox(tri_left_aabb);
+			right_aabb.enlargeToHoldAABBox(tri_right_aabb);
+
+			num_left++;
+			num_right++;
 		}
 	}
 
 	res_out.left_aabb  = left_aabb;
 	res_out.right_aabb = right_aabb;
+	res_out.left_centroid_aabb  = empty_aabb; // Centroid AABBs are not computed.
+	res_out.right_centroid_aabb = empty_aabb;
 	res_out.num_left  = num_left;
 	res_out.num_right = num_right;
 }
 
 
+static void spatialPartitionResultWithUnsplitting(glare::TaskManager* parallel_task_manager, const std::vector<SBVHOb>& objects_, const BVHBuilderTri* triangles, const js::AABBox& parent_aabb, int begin, int end, 
+	float best_div_val, int best_axis, int best_bucket,
+	PartitionRes& res_out)
+{
+	const SBVHOb* const objects = objects_.data();
+
+	if(!parallel_task_manager)
+	{
+		spatialPartitionResultWithUnsplittingForRange(objects, triangles, parent_aabb, begin, end, best_div_val, best_axis, best_bucket, res_out);
+		return;
+	}
+
+	const int num_blocks = numParallelBlocks(end - begin);
+	js::Vector<PartitionRes, 16> block_res(num_blocks);
+
+	runForBlocks(*parallel_task_manager, num_blocks, [&](int b)
+	{
+		spatialPartitionResultWithUnsplittingForRange(objects, triangles, parent_aabb, blockBegin(begin, end, num_blocks, b), blockBegin(begin, end, num_blocks, b + 1), 
+			best_div_val, best_axis, best_bucket, block_res[b]);
+	});
+
+	mergeBlockPartitionResults(block_res, res_out);
+}
+
+
 static GLARE_STRONG_INLINE void addIntersectedEdgeVert(const Vec4f& v_a, const Vec4f& v_b, const float d_a, const float d_b, float split_coord, js::AABBox& left_aabb, js::AABBox& right_aabb)
 {
 	const float t = (split_coord - d_a) / (d_b - d_a); // Solve for fraction along edge of position on split plane.
@@ -1152,7 +1411,7 @@ static GLARE_STRONG_INLINE void clipTri(const js::AABBox& ob_aabb, const BVHBuil
 }
 
 
-static void searchForBestSplit(const js::AABBox& aabb, const js::AABBox& centroid_aabb_, const std::vector<uint64>& max_obs_at_depth, int depth, std::vector<SBVHOb>& objects_, const BVHBuilderTri* triangles, SBVHBuildStats& stats, int begin, int end, int capacity, float recip_root_node_aabb_area,
+static void searchForBestSplit(glare::TaskManager* parallel_task_manager, const js::AABBox& aabb, const js::AABBox& centroid_aabb_, const std::vector<uint64>& max_obs_at_depth, int depth, std::vector<SBVHOb>& objects_, const BVHBuilderTri* triangles, SBVHBuildStats& stats, int begin, int end, int capacity, float recip_root_node_aabb_area,
 	int& best_axis_out, float& best_div_val_out,
 	float& smallest_split_cost_factor_out, bool& best_split_is_spatial_out,
 	int& best_num_left_out, int& best_num_right_out, 
@@ -1176,46 +1435,45 @@ static void searchForBestSplit(const js::AABBox& aabb, const js::AABBox& centroi
 	// Look for object-partitioning splits - where the objects/triangles are partitioned left or right based on the object centroid.
 	// Objects are not clipped to the splitting plane, but instead the left or right AABBs are extended to enclose the objects.
 
-	const int max_B = 32;
 	const int N = end - begin;
 	const int num_buckets = myMin(max_B, (int)(4 + 0.05f * N)); // buckets per axis
-	js::AABBox bucket_aabbs[max_B * 3]; // For each axis, holds AABBs of tris whose centroids fall in the bucket.
-	Vec4i counts[max_B];
-	for(int i=0; i<num_buckets; ++i)
-	{
-		for(int z=0; z<3; ++z)
-			bucket_aabbs[z*max_B + i] = empty_aabb;
-		counts[i] = Vec4i(0);
-	}
 
-	// Compute bucket_aabbs
+	// Compute object_bins
 	const Vec4f scale = div(Vec4f((float)num_buckets), (centroid_aabb.max_ - centroid_aabb.min_));
-	for(int i=begin; i<end; ++i)
+	SBVHObjectBins object_bins;
+	binObjectsInBlocks(parallel_task_manager, begin, end, num_buckets, [&](int range_begin, int range_end, SBVHObjectBins& bins)
 	{
-		const js::AABBox ob_aabb = objects[i].aabb;
-		const Vec4f centroid = ob_aabb.centroid();
-		assert(centroid_aabb.contains(setWToOne(centroid)));
-		const Vec4i bucket_i = clamp(truncateToVec4i((centroid - centroid_aabb.min_) * scale), Vec4i(0), Vec4i(num_buckets-1));
-
-		assert(bucket_i[0] >= 0 && bucket_i[0] < num_buckets);
-		assert(bucket_i[1] >= 0 && bucket_i[1] < num_buckets);
-		assert(bucket_i[2] >= 0 && bucket_i[2] < num_buckets);
-
-		// X axis:
-		const int b_x = elem<0>(bucket_i);
-		bucket_aabbs[b_x].enlargeToHoldAABBox(ob_aabb);
-		(counts[b_x])[0]++;
-
-		// Y axis:
-		const int b_y = elem<1>(bucket_i);
-		bucket_aabbs[max_B + b_y].enlargeToHoldAABBox(ob_aabb);
-		(counts[b_y])[1]++;
-
-		// Z axis:
-		const int b_z = elem<2>(bucket_i);
-		bucket_aabbs[max_B*2 + b_z].enlargeToHoldAABBox(ob_aabb);
-		(counts[b_z])[2]++;
-	}
+		bins.init(num_buckets);
+		for(int i=range_begin; i<range_end; ++i)
+		{
+			const js::AABBox ob_aabb = objects[i].aabb;
+			const Vec4f centroid = ob_aabb.centroid();
+			assert(centroid_aabb.contains(setWToOne(centroid)));
+			const Vec4i bucket_i = clamp(truncateToVec4i((centroid - centroid_aabb.min_) * scale), Vec4i(0), Vec4i(num_buckets-1));
+
+			assert(bucket_i[0] >= 0 && bucket_i[0] < num_buckets);
+			assert(bucket_i[1] >= 0 && bucket_i[1] < num_buckets);
+			assert(bucket_i[2] >= 0 && bucket_i[2] < num_buckets);
+
+			// X axis:
+			const int b_x = elem<0>(bucket_i);
+			bins.bucket_aabbs[b_x].enlargeToHoldAABBox(ob_aabb);
+			(bins.counts[b_x])[0]++;
+
+			// Y axis:
+			const int b_y = elem<1>(bucket_i);
+			bins.bucket_aabbs[max_B + b_y].enlargeToHoldAABBox(ob_aabb);
+			(bins.counts[b_y])[1]++;
+
+			// Z axis:
+			const int b_z = elem<2>(bucket_i);
+			bins.bucket_aabbs[max_B*2 + b_z].enlargeToHoldAABBox(ob_aabb);
+			(bins.counts[b_z])[2]++;
+		}
+	}, object_bins);
+
+	const js::AABBox* const bucket_aabbs = object_bins.bucket_aabbs; // For each axis, holds AABBs of tris whose centroids fall in the bucket.
+	const Vec4i* const counts = object_bins.counts;
 
 	const Vec4f axis_len_over_num_buckets = div(centroid_aabb.max_ - centroid_aabb.min_, Vec4f((float)num_buckets));
 	Vec4f right_area[max_B];
@@ -1416,77 +1674,69 @@ static void searchForBestSplit(const js::AABBox& aabb, const js::AABBox& centroi
 	const float alpha = 1.0e-5f;
 	if(lambda_over_sa_root_bound > alpha) // If should do search for a spatial split:
 	{
-		const int num_spatial_buckets = 16;
-		assert(num_spatial_buckets <= max_B);
-		
 		// We will store in each bucket, the AABBs of all triangles in [begin, end) clipped to the bucket bounds.
-		Vec4i entry_counts[max_B];
-		Vec4i exit_counts[max_B];
-		for(int i=0; i<num_spatial_buckets; ++i)
-		{
-			for(int z=0; z<3; ++z)
-				bucket_aabbs[z*max_B + i] = empty_aabb;
-			entry_counts[i] = Vec4i(0);
-			exit_counts [i] = Vec4i(0);
-		}
-
 		const Vec4f spatial_scale = div(Vec4f((float)num_spatial_buckets), (aabb.max_ - aabb.min_));
 		const Vec4f spatial_axis_len_over_num_buckets = div(aabb.max_ - aabb.min_, Vec4f((float)num_spatial_buckets));
 
-		for(int i=begin; i<end; ++i)
+		SBVHSpatialBins spatial_bins;
+		binObjectsInBlocks(parallel_task_manager, begin, end, num_spatial_buckets, [&](int range_begin, int range_end, SBVHSpatialBins& bins)
 		{
-			const int ob_i = objects[i].getIndex();
-			const js::AABBox ob_aabb = objects[i].aabb;
-			assert(aabb.containsAABBox(setWCoordsToOne(ob_aabb)));
-			const BVHBuilderTri& tri = triangles[ob_i];
-			
-			// Pre-fetch a triangle.  This helps because it's an indirect memory access to get the triangle.
-			const int PREFETCH_DIST = 8;
-			if(i + PREFETCH_DIST < end)
-				_mm_prefetch((const char*)(triangles + (objects[i + PREFETCH_DIST].getIndex())), _MM_HINT_T0);
-
-			const Vec4i entry_bucket_i = clamp(truncateToVec4i((ob_aabb.min_ - aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
-			const Vec4i exit_bucket_i  = clamp(truncateToVec4i((ob_aabb.max_ - aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
-
-			assert(entry_bucket_i[0] >= 0 && entry_bucket_i[0] < num_spatial_buckets);
-			assert(entry_bucket_i[1] >= 0 && entry_bucket_i[1] < num_spatial_buckets);
-			assert(entry_bucket_i[2] >= 0 && entry_bucket_i[2] < num_spatial_buckets);
-			assert(exit_bucket_i[0] >= 0 && exit_bucket_i[0] < num_spatial_buckets);
-			assert(exit_bucket_i[1] >= 0 && exit_bucket_i[1] < num_spatial_buckets);
-			assert(exit_bucket_i[2] >= 0 && exit_bucket_i[2] < num_spatial_buckets);
-			assert((entry_bucket_i[0] <= exit_bucket_i[0]) && (entry_bucket_i[1] <= exit_bucket_i[1]) && (entry_bucket_i[2] <= exit_bucket_i[2]));
-
-			// Increase bucket AABBs for x axis
-			for(int axis=0; axis<3; ++axis)
+			bins.init(num_spatial_buckets);
+			for(int i=range_begin; i<range_end; ++i)
 			{
-				if(aabb_span[axis] > 0)
+				const int ob_i = objects[i].getIndex();
+				const js::AABBox ob_aabb = objects[i].aabb;
+				assert(aabb.containsAABBox(setWCoordsToOne(ob_aabb)));
+				const BVHBuilderTri& tri = triangles[ob_i];
+			
+				// Pre-fetch a triangle.  This helps because it's an indirect memory access to get the triangle.
+				const int PREFETCH_DIST = 8;
+				if(i + PREFETCH_DIST < range_end)
+					_mm_prefetch((const char*)(triangles + (objects[i + PREFETCH_DIST].getIndex())), _MM_HINT_T0);
+
+				const Vec4i entry_bucket_i = clamp(truncateToVec4i((ob_aabb.min_ - aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
+				const Vec4i exit_bucket_i  = clamp(truncateToVec4i((ob_aabb.max_ - aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
+
+				assert(entry_bucket_i[0] >= 0 && entry_bucket_i[0] < num_spatial_buckets);
+				assert(entry_bucket_i[1] >= 0 && entry_bucket_i[1] < num_spatial_buckets);
+				assert(entry_bucket_i[2] >= 0 && entry_bucket_i[2] < num_spatial_buckets);
+				assert(exit_bucket_i[0] >= 0 && exit_bucket_i[0] < num_spatial_buckets);
+				assert(exit_bucket_i[1] >= 0 && exit_bucket_i[1] < num_spatial_buckets);
+				assert(exit_bucket_i[2] >= 0 && exit_bucket_i[2] < num_spatial_buckets);
+				assert((entry_bucket_i[0] <= exit_bucket_i[0]) && (entry_bucket_i[1] <= exit_bucket_i[1]) && (entry_bucket_i[2] <= exit_bucket_i[2]));
+
+				// Increase bucket AABBs for x axis
+				for(int axis=0; axis<3; ++axis)
 				{
-					const int entry_b = entry_bucket_i[axis];
-					const int exit_b  = exit_bucket_i[axis];
-					if(entry_b == exit_b) // Special case for when triangle is completely in one bucket - no clipping is needed
-						bucket_aabbs[entry_b + axis*max_B].enlargeToHoldAABBox(ob_aabb);
-					else
+					if(aabb_span[axis] > 0)
 					{
-						js::AABBox last_to_right_aabb = ob_aabb; // bounds of triangle to the right of last clip plane.  Starts with the full bounds of the triangle (as clipped to current node AABB)
-						for(int b=entry_b; b<exit_b; ++b)
+						const int entry_b = entry_bucket_i[axis];
+						const int exit_b  = exit_bucket_i[axis];
+						if(entry_b == exit_b) // Special case for when triangle is completely in one bucket - no clipping is needed
+							bins.bucket_aabbs[entry_b + axis*num_spatial_buckets].enlargeToHoldAABBox(ob_aabb);
+						else
 						{
-							// Clip triangle against current clip plane, taking the intersection of the results with last_to_right_aabb as well.
-							js::AABBox to_left_aabb;
-							js::AABBox to_right_aabb;
-							clipTri(last_to_right_aabb, tri, axis, aabb.min_[axis] + spatial_axis_len_over_num_buckets[axis] * (b + 1), to_left_aabb, to_right_aabb);
-							last_to_right_aabb = to_right_aabb;
-
-							bucket_aabbs[b + axis*max_B].enlargeToHoldAABBox(to_left_aabb);
+							js::AABBox last_to_right_aabb = ob_aabb; // bounds of triangle to the right of last clip plane.  Starts with the full bounds of the triangle (as clipped to current node AABB)
+							for(int b=entry_b; b<exit_b; ++b)
+							{
+								// Clip triangle against current clip plane, taking the intersection of the results with last_to_right_aabb as well.
+								js::AABBox to_left_aabb;
+								js::AABBox to_right_aabb;
+								clipTri(last_to_right_aabb, tri, axis, aabb.min_[axis] + spatial_axis_len_over_num_buckets[axis] * (b + 1), to_left_aabb, to_right_aabb);
+								last_to_right_aabb = to_right_aabb;
+
+								bins.bucket_aabbs[b + axis*num_spatial_buckets].enlargeToHoldAABBox(to_left_aabb);
+							}
+
+							bins.bucket_aabbs[exit_b + axis*num_spatial_buckets].enlargeToHoldAABBox(last_to_right_aabb);
 						}
 
-						bucket_aabbs[exit_b + axis*max_B].enlargeToHoldAABBox(last_to_right_aabb);
+						(bins.entry_counts[entry_b])[axis]++;
+						(bins.exit_counts[exit_b])  [axis]++;
 					}
-
-					(entry_counts[entry_b])[axis]++;
-					(exit_counts[exit_b])  [axis]++;
 				}
 			}
-		}
+		}, spatial_bins);
 
 		// Sweep right to left, computing exclusive prefix surface areas and counts
 		// right_area[b] = sum_{i=(b+1)}^{num_spatial_buckets} bucket_aabb[b].getHalfSurfaceArea()
@@ -1500,7 +1750,7 @@ static void searchForBestSplit(const js::AABBox& aabb, const js::AABBox& centroi
 		for(int b=num_spatial_buckets-1; b>=0; --b)
 		{
 			right_prefix_counts[b] = count;
-			count = count + exit_counts[b];
+			count = count + spatial_bins.exit_counts[b];
 
 			float A0 = right_aabb[0].getHalfSurfaceArea();
 			float A1 = right_aabb[1].getHalfSurfaceArea();
@@ -1511,9 +1761,9 @@ static void searchForBestSplit(const js::AABBox& aabb, const js::AABBox& centroi
 			right_aabbs[b + num_spatial_buckets*1] = right_aabb[1];
 			right_aabbs[b + num_spatial_buckets*2] = right_aabb[2];
 
-			right_aabb[0].enlargeToHoldAABBox(bucket_aabbs[b]);
-			right_aabb[1].enlargeToHoldAABBox(bucket_aabbs[b +   max_B]);
-			right_aabb[2].enlargeToHoldAABBox(bucket_aabbs[b + 2*max_B]);
+			right_aabb[0].enlargeToHoldAABBox(spatial_bins.bucket_aabbs[b]);
+			right_aabb[1].enlargeToHoldAABBox(spatial_bins.bucket_aabbs[b +   num_spatial_buckets]);
+			right_aabb[2].enlargeToHoldAABBox(spatial_bins.bucket_aabbs[b + 2*num_spatial_buckets]);
 
 			assert(aabb.containsAABBox(setWCoordsToOne(right_aabb[0])));
 		}
@@ -1525,11 +1775,11 @@ static void searchForBestSplit(const js::AABBox& aabb, const js::AABBox& centroi
 
 		for(int b=0; b<num_spatial_buckets-1; ++b)
 		{
-			count = count + entry_counts[b];
+			count = count + spatial_bins.entry_counts[b];
 
-			left_aabb[0].enlargeToHoldAABBox(bucket_aabbs[b]);
-			left_aabb[1].enlargeToHoldAABBox(bucket_aabbs[b +   max_B]);
-			left_aabb[2].enlargeToHoldAABBox(bucket_aabbs[b + 2*max_B]);
+			left_aabb[0].enlargeToHoldAABBox(spatial_bins.bucket_aabbs[b]);
+			left_aabb[1].enlargeToHoldAABBox(spatial_bins.bucket_aabbs[b +   num_spatial_buckets]);
+			left_aabb[2].enlargeToHoldAABBox(spatial_bins.bucket_aabbs[b + 2*num_spatial_buckets]);
 
 			assert(aabb.containsAABBox(setWCoordsToOne(left_aabb[0])));
 
@@ -1598,35 +1848,56 @@ static void searchForBestSplit(const js::AABBox& aabb, const js::AABBox& centroi
 			const float C_split = spatial_smallest_split_cost_factor;
 			const float left_reduced_cost  = left_half_area  * (best_spatial_left_num  - 1);
 			const float right_reduced_cost = right_half_area * (best_spatial_right_num - 1);
-			bool unsplit_a_tri = false; // Did we unsplit 1 or more triangles?
-			for(int i=begin; i<end; ++i)
+
+			// Decides whether to unsplit each triangle straddling the split plane in [range_begin, range_end).  Returns true if there were any straddling triangles.
+			auto chooseUnsplits = [&](int range_begin, int range_end) -> bool
 			{
-				const js::AABBox ob_aabb = objects[i].aabb;
-				assert(aabb.containsAABBox(setWCoordsToOne(ob_aabb)));
+				bool straddling_tri_in_range = false;
+				for(int i=range_begin; i<range_end; ++i)
+				{
+					const js::AABBox ob_aabb = objects[i].aabb;
+					assert(aabb.containsAABBox(setWCoordsToOne(ob_aabb)));
 
-				const Vec4i entry_bucket_i = clamp(truncateToVec4i((ob_aabb.min_ - aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
-				const Vec4i exit_bucket_i  = clamp(truncateToVec4i((ob_aabb.max_ - aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
+					const Vec4i entry_bucket_i = clamp(truncateToVec4i((ob_aabb.min_ - aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
+					const Vec4i exit_bucket_i  = clamp(truncateToVec4i((ob_aabb.max_ - aabb.min_) * spatial_scale), Vec4i(0), Vec4i(num_spatial_buckets-1));
 
-				uint32 unsplit = 0;
+					uint32 unsplit = 0;
 
-				if(entry_bucket_i[spatial_best_axis] <= spatial_best_bucket && exit_bucket_i[spatial_best_axis] > spatial_best_bucket) // If triangle straddles split plane:
-				{
-					// Compute C_1: the cost when putting object i entirely in the left child, and C_2: the cost when putting object i entirely in the right child.
-					// These are conservative costs, e.g. >= the true cost (because we don't shrink the AABB of the side the object was removed from)
-					const js::AABBox expanded_left_aabb  = AABBUnion(best_spatial_left_aabb, ob_aabb);
-					const js::AABBox expanded_right_aabb = AABBUnion(best_spatial_right_aabb, ob_aabb);
-					const float C_1 = expanded_left_aabb.getHalfSurfaceArea() * best_spatial_left_num + right_reduced_cost;
-					const float C_2 = left_reduced_cost + expanded_right_aabb.getHalfSurfaceArea() * best_spatial_right_num;
-
-					if(C_1 < C_split && C_1 <= C_2) // Only place this tri in the left child:
-						unsplit = 1;
-					else if(C_2 < C_split && C_2 < C_1) // Else if only place this tri in the right child:
-						unsplit = 2;
-					unsplit_a_tri = true;
+					if(entry_bucket_i[spatial_best_axis] <= spatial_best_bucket && exit_bucket_i[spatial_best_axis] > spatial_best_bucket) // If triangle straddles split plane:
+					{
+						// Compute C_1: the cost when putting object i entirely in the left child, and C_2: the cost when putting object i entirely in the right child.
+						// These are conservative costs, e.g. >= the true cost (because we don't shrink the AABB of the side the object was removed from)
+						const js::AABBox expanded_left_aabb  = AABBUnion(best_spatial_left_aabb, ob_aabb);
+						const js::AABBox expanded_right_aabb = AABBUnion(best_spatial_right_aabb, ob_aabb);
+						const float C_1 = expanded_left_aabb.getHalfSurfaceArea() * best_spatial_left_num + right_reduced_cost;
+						const float C_2 = left_reduced_cost + expanded_right_aabb.getHalfSurfaceArea() * best_spatial_right_num;
+
+						if(C_1 < C_split && C_1 <= C_2) // Only place this tri in the left child:
+							unsplit = 1;
+						else if(C_2 < C_split && C_2 < C_1) // Else if only place this tri in the right child:
+							unsplit = 2;
+						straddling_tri_in_range = true;
+					}
+
+					objects[i].setUnsplit(unsplit);
 				}
+				return straddling_tri_in_range;
+			};
 
-				objects[i].setUnsplit(unsplit);
+			bool unsplit_a_tri = false; // Did we unsplit 1 or more triangles?
+			if(parallel_task_manager)
+			{
+				const int num_blocks = numParallelBlocks(N);
+				js::Vector<int, 16> block_unsplit_a_tri(num_blocks);
+				runForBlocks(*parallel_task_manager, num_blocks, [&](int b)
+				{
+					block_unsplit_a_tri[b] = chooseUnsplits(blockBegin(begin, end, num_blocks, b), blockBegin(begin, end, num_blocks, b + 1)) ? 1 : 0;
+				});
+				for(int b=0; b<num_blocks; ++b)
+					unsplit_a_tri = unsplit_a_tri || (block_unsplit_a_tri[b] != 0);
 			}
+			else
+				unsplit_a_tri = chooseUnsplits(begin, end);
 
 			// Do another pass to get the final cost given our unsplitting decisions.  This is not a conservative estimate of the cost, but an accurate calculation of the 
 			// cost, that may be smaller than the conservative unsplit cost.  We want to do this pass because, even though we know the cost will be <= spatial_smallest_split_cost_factor,
@@ -1634,7 +1905,7 @@ static void searchForBestSplit(const js::AABBox& aabb, const js::AABBox& centroi
 			if(unsplit_a_tri) // Cost will only have changed if we actually unsplit something.
 			{
 				PartitionRes res;
-				spatialPartitionResultWithUnsplitting(objects_, triangles, aabb, begin, end, spatial_best_div_val, spatial_best_axis, spatial_best_bucket, res);
+				spatialPartitionResultWithUnsplitting(parallel_task_manager, objects_, triangles, aabb, begin, end, spatial_best_div_val, spatial_best_axis, spatial_best_bucket, res);
 
 				if(res.num_left > 0 && res.num_right > 0) // If valid partition: (might end up with everything left or right due to numerical innaccuracy)
 				{
@@ -1764,9 +2035,12 @@ void SBVHBuilder::doBuild(
 	bool best_split_was_spatial;
 	int best_num_left, best_num_right, best_bucket;
 
+	// Do the split search and partitioning for large nodes in parallel.  These are the top levels of the tree, which are built before there are enough subtree tasks to keep all threads busy.
+	glare::TaskManager* const parallel_task_manager = (num_objects >= parallel_split_num_ob_threshold) ? task_manager : NULL;
+
 	//conPrint("Looking for best split...");
 	//Timer timer;
-	searchForBestSplit(aabb, centroid_aabb, max_obs_at_depth, depth, this->top_level_objects, triangles, thread_temp_info.stats, begin, end, capacity, recip_root_node_aabb_area, best_axis, best_div_val, smallest_split_cost_factor, best_split_was_spatial,
+	searchForBestSplit(parallel_task_manager, aabb, centroid_aabb, max_obs_at_depth, depth, this->top_level_objects, triangles, thread_temp_info.stats, begin, end, capacity, recip_root_node_aabb_area, best_axis, best_div_val, smallest_split_cost_factor, best_split_was_spatial,
 		best_num_left, best_num_right, best_bucket
 	);
 	//conPrint("Looking for best split done.  elapsed: " + timer.elapsedString());
@@ -1819,7 +2093,7 @@ void SBVHBuilder::doBuild(
 #endif
 
 		//timer.reset();
-		partition(this->top_level_objects, this->temp_obs, begin, end, capacity, triangles, aabb, centroid_aabb, best_div_val, best_axis, best_split_was_spatial, best_bucket, best_num_left, best_num_right, res);
+		partition(parallel_task_manager, this->top_level_objects, this->temp_obs, begin, end, capacity, triangles, aabb, centroid_aabb, best_div_val, best_axis, best_split_was_spatial, best_bucket, best_num_left, best_num_right, res);
 		//partition_time += timer.elapsed();
 		//conPrint("Partition done.  elapsed: " + timer.elapsedString());
 	}
@@ -2021,6 +2295,80 @@ static void testSBVHWithNumObsAndMaxDepth(int num_objects, int max_depth, int ma
 }
 
 
+// Builds the tree for tris, with the split search and partitioning done in parallel at nodes with at least parallel_split_num_ob_threshold objects.
+static void buildWithParallelSplitThreshold(glare::TaskManager& task_manager, const js::Vector<BVHBuilderTri, 16>& tris, int parallel_split_num_ob_threshold, 
+	js::Vector<ResultNode, 64>& result_nodes_out, js::Vector<uint32, 16>& result_indices_out)
+{
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+
+	SBVHBuilder builder(1, /*max_num_objects_per_leaf=*/16, /*max depth=*/60, /*intersection_cost=*/1.f, tris.data(), (int)tris.size());
+	builder.parallel_split_num_ob_threshold = parallel_split_num_ob_threshold;
+	builder.build(task_manager, should_cancel_callback, print_output, result_nodes_out);
+
+	BVHBuilderTestUtils::testResultsValid(builder.getResultObjectIndices(), result_nodes_out, tris.size(), /*duplicate_prims_allowed=*/true);
+
+	result_indices_out = builder.getResultObjectIndices();
+	testAssert(builder.stats.num_spatial_splits > 0);
+}
+
+
+// Check that doing the split search and partitioning in parallel gives the same tree as doing it serially.
+// Result nodes are in breadth-first order, so should be the same, apart from the positions of the leaf object ranges, which depend on the order subtree tasks were run in.
+static void testParallelSplitSearchMatchesSerial()
+{
+	conPrint("testParallelSplitSearchMatchesSerial()");
+
+	glare::TaskManager task_manager(/*num threads=*/4);
+
+	// Make a mix of small and long thin triangles, so that there are spatial splits.
+	const int num_objects = 40000;
+	PCG32 rng(1);
+	js::Vector<BVHBuilderTri, 16> tris(num_objects);
+	for(int z=0; z<num_objects; ++z)
+	{
+		const float size = (z % 8 == 0) ? 0.3f : 0.01f;
+		const Vec4f v0(rng.unitRandom(), rng.unitRandom(), rng.unitRandom(), 1);
+		tris[z].v[0] = v0;
+		tris[z].v[1] = v0 + Vec4f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom(), 0) * size;
+		tris[z].v[2] = v0 + Vec4f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom(), 0) * 0.01f;
+	}
+
+	js::Vector<ResultNode, 64> serial_nodes;
+	js::Vector<uint32, 16> serial_indices;
+	buildWithParallelSplitThreshold(task_manager, tris, /*parallel_split_num_ob_threshold=*/std::numeric_limits<int>::max(), serial_nodes, serial_indices);
+
+	const int thresholds[] = { 0, 1 << 13 };
+	for(int t=0; t<2; ++t)
+	{
+		js::Vector<ResultNode, 64> nodes;
+		js::Vector<uint32, 16> indices;
+		buildWithParallelSplitThreshold(task_manager, tris, thresholds[t], nodes, indices);
+
+		testAssert(nodes.size() == serial_nodes.size());
+		testAssert(indices.size() == serial_indices.size());
+		for(size_t i=0; i<nodes.size(); ++i)
+		{
+			testAssert(nodes[i].interior == serial_nodes[i].interior);
+			testAssert(nodes[i].aabb == serial_nodes[i].aabb);
+			if(nodes[i].interior)
+			{
+				testAssert(nodes[i].left  == serial_nodes[i].left);
+				testAssert(nodes[i].right == serial_nodes[i].right);
+			}
+			else
+			{
+				testAssert(nodes[i].right - nodes[i].left == serial_nodes[i].right - serial_nodes[i].left);
+				for(int z=0; z<nodes[i].right - nodes[i].left; ++z)
+					testAssert(indices[nodes[i].left + z] == serial_indices[serial_nodes[i].left + z]);
+			}
+		}
+	}
+
+	conPrint("testParallelSplitSearchMatchesSerial() done");
+}
+
+
 void SBVHBuilder::test(bool comprehensive_tests)
 {
 	conPrint("SBVHBuilder::test()");
@@ -2047,6 +2395,8 @@ void SBVHBuilder::test(bool comprehensive_tests)
 	testSBVHWithNumObsAndMaxDepth(/*num obs=*/9,    /*max depth=*/3,  /*max_num_objects_per_leaf=*/1, /*failure_expected=*/true);
 	testSBVHWithNumObsAndMaxDepth(/*num obs=*/1025, /*max depth=*/10, /*max_num_objects_per_leaf=*/1, /*failure_expected=*/true);
 
+	testParallelSplitSearchMatchesSerial();
+
 
 	//==================== Test building on every igmesh we can find ====================
 	if(true)
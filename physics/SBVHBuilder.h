@@ -202,6 +202,7 @@ private:
 	ShouldCancelCallback* should_cancel_callback;
 public:
 	int new_task_num_ob_threshold;
+	int parallel_split_num_ob_threshold; // Nodes with at least this many objects have their split search and partitioning done in parallel on the task manager.
 
 	SBVHBuildStats stats;
 
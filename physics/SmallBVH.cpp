@@ -7,6 +7,9 @@ Copyright Glare Technologies Limited 2020 -
 
 
 #include "BinningBVHBuilder.h"
+#include "BVHPacketTraversal.h"
+#include "BVHCache.h"
+#include "BVHBuilderUtils.h"
 #include "MollerTrumboreTri.h"
 #include "../simpleraytracer/raymesh.h"
 #include "../utils/PrintOutput.h"
@@ -20,7 +23,12 @@ namespace js
 
 
 SmallBVH::SmallBVH(const RayMesh* const raymesh_)
-:	raymesh(raymesh_)
+:	raymesh(raymesh_),
+	root_node_index(0),
+	node_data(NULL),
+	leaf_tri_index_data(NULL),
+	num_nodes(0),
+	num_leaf_tri_indices(0)
 {
 	assert(raymesh);
 	
@@ -37,9 +45,7 @@ void SmallBVH::build(PrintOutput& print_output, ShouldCancelCallback& should_can
 {
 	// Timer timer;
 
-	const RayMesh::TriangleVectorType& raymesh_tris = raymesh->getTriangles();
-	const int raymesh_tris_size = (int)raymesh_tris.size();
-	const RayMesh::VertexVectorType& raymesh_verts = raymesh->getVertices();
+	const int raymesh_tris_size = (int)raymesh->getTriangles().size();
 
 	Reference<BinningBVHBuilder> builder = new BinningBVHBuilder(
 		63, // leaf_num_object_threshold. As soon as we get down to this number of tris, make a leaf.
@@ -49,18 +55,7 @@ void SmallBVH::build(PrintOutput& print_output, ShouldCancelCallback& should_can
 		raymesh_tris_size
 	);
 
-	for(int i=0; i<raymesh_tris_size; ++i)
-	{
-		const RayMeshTriangle& tri = raymesh_tris[i];
-		const Vec4f v0 = setWToOne(loadUnalignedVec4f(&raymesh_verts[tri.vertex_indices[0]].pos.x));
-		const Vec4f v1 = setWToOne(loadUnalignedVec4f(&raymesh_verts[tri.vertex_indices[1]].pos.x));
-		const Vec4f v2 = setWToOne(loadUnalignedVec4f(&raymesh_verts[tri.vertex_indices[2]].pos.x));
-		js::AABBox tri_aabb(v0, v0);
-		tri_aabb.enlargeToHoldPoint(v1);
-		tri_aabb.enlargeToHoldPoint(v2);
-
-		builder->setObjectAABB(i, tri_aabb);
-	}
+	BVHBuilderUtils::setTriAABBs(*builder, *raymesh, task_manager);
 
 	js::Vector<ResultNode, 64> result_nodes;
 	builder->build(
@@ -73,100 +68,17 @@ void SmallBVH::build(PrintOutput& print_output, ShouldCancelCallback& should_can
 
 	root_aabb = builder->getRootAABB();
 
-	if(result_nodes.size() == 1)
-	{
-		// Special case where the root node is a leaf.  
-		const int num = result_nodes[0].right - result_nodes[0].left;
-		const int offset = result_nodes[0].left;
-		assert(num < 64);
-		int c = 0x80000000 | num | (offset << 6);
-		this->root_node_index = c;
-	}
-	else
-	{
-		this->root_node_index = 0;
-
-		// Convert result_nodes to BVHObjectTreeNodes.
-		// Indices will change, since we will not explicitly store leaf nodes in the BVH object tree.  Rather leaf geometry references are put into the child references of the node above.
-		const size_t result_nodes_size = result_nodes.size();
-		js::Vector<int, 16> new_node_indices(result_nodes_size); // For each old node, store the new index.
-		int new_index = 0;
-		for(size_t i=0; i<result_nodes_size; ++i)
-			if(result_nodes[i].interior)
-				new_node_indices[i] = new_index++;
-
-		const int new_num_nodes = new_index;
-		this->nodes.resizeNoCopy(new_num_nodes);
-
-		new_index = 0;
-		for(size_t i=0; i<result_nodes_size; ++i)
-		{
-			const ResultNode& result_node = result_nodes[i];
-			if(result_node.interior)
-			{
-				SmallBVHNode& node = this->nodes[new_index++];
-
-				const ResultNode& result_left_child  = result_nodes[result_node.left];
-				const ResultNode& result_right_child = result_nodes[result_node.right];
-
-				Vec4f mins = shuffle<0, 1, 0, 1>(result_left_child.aabb.min_, result_right_child.aabb.min_); // (left_min_x, left_min_y, right_min_x, right_min_y)
-				Vec4f maxs = shuffle<0, 1, 0, 1>(result_left_child.aabb.max_, result_right_child.aabb.max_); // (left_max_x, left_max_y, right_max_x, right_max_y)
-				
-				node.x = shuffle<0, 2, 0, 2>(mins, maxs); // (left_min_x, right_min_x, left_max_x, right_max_x)
-				node.y = shuffle<1, 3, 1, 3>(mins, maxs); // (left_min_y, right_min_y, left_max_y, right_max_y)
-				
-				mins = shuffle<2, 2, 2, 2>(result_left_child.aabb.min_, result_right_child.aabb.min_); // (left_min_z, left_min_z, right_min_z, right_min_z)
-				maxs = shuffle<2, 2, 2, 2>(result_left_child.aabb.max_, result_right_child.aabb.max_); // (left_max_z, left_max_z, right_max_z, right_max_z)
-				
-				node.z = shuffle<0, 2, 0, 2>(mins, maxs); // (left_min_z, right_min_z, left_max_z, right_max_z)
-				
-				assert(node.x[0] == result_left_child.aabb.min_[0] && node.x[1] == result_right_child.aabb.min_[0] && node.x[2] == result_left_child.aabb.max_[0] && node.x[3] == result_right_child.aabb.max_[0]);
-				assert(node.y[0] == result_left_child.aabb.min_[1] && node.y[1] == result_right_child.aabb.min_[1] && node.y[2] == result_left_child.aabb.max_[1] && node.y[3] == result_right_child.aabb.max_[1]);
-				assert(node.z[0] == result_left_child.aabb.min_[2] && node.z[1] == result_right_child.aabb.min_[2] && node.z[2] == result_left_child.aabb.max_[2] && node.z[3] == result_right_child.aabb.max_[2]);
-
-				//node.x = Vec4f(result_left_child.aabb.min_.x[0], result_right_child.aabb.min_.x[0], result_left_child.aabb.max_.x[0], result_right_child.aabb.max_.x[0]);
-				//node.y = Vec4f(result_left_child.aabb.min_.x[1], result_right_child.aabb.min_.x[1], result_left_child.aabb.max_.x[1], result_right_child.aabb.max_.x[1]);
-				//node.z = Vec4f(result_left_child.aabb.min_.x[2], result_right_child.aabb.min_.x[2], result_left_child.aabb.max_.x[2], result_right_child.aabb.max_.x[2]);
-
-				// Set node.child[0] and node.child[1]
-				if(result_left_child.interior)
-				{
-					node.child[0] = new_node_indices[result_node.left];
-					assert(node.child[0] >= 0 && node.child[0] < new_num_nodes);
-				}
-				else
-				{
-					// Number of objects is in lower 6 bits.  Set sign bit to 1.
-					const int num = result_left_child.right - result_left_child.left;
-					const int offset = result_left_child.left;
-					assert(num < 64);
-					int c = 0x80000000 | num | (offset << 6);
-					node.child[0] = c;
-				}
-
-				if(result_right_child.interior)
-				{
-					node.child[1] = new_node_indices[result_node.right];
-					assert(node.child[1] >= 0 && node.child[1] < new_num_nodes);
-				}
-				else
-				{
-					// Number of objects is in lower 6 bits.  Set sign bit to 1.
-					const int num = result_right_child.right - result_right_child.left;
-					const int offset = result_right_child.left;
-					assert(num < 64);
-					int c = 0x80000000 | num | (offset << 6);
-					node.child[1] = c;
-				}
-			}
-		}
-	}
+	// Convert result_nodes to SmallBVHNodes, with leaf geometry references stored in the child references of the node above.
+	this->root_node_index = BVHBuilderUtils::convertResultNodes<SmallBVHNode, 6>(result_nodes, this->nodes, task_manager);
 
 	// Build leaf_tri_indices
-	const size_t result_ob_ind_size = result_ob_indices.size();
-	leaf_tri_indices.resizeNoCopy(result_ob_ind_size);
-	for(size_t i=0; i<result_ob_ind_size; ++i)
-		leaf_tri_indices[i] = result_ob_indices[i];
+	BVHBuilderUtils::copyLeafObIndices(result_ob_indices, leaf_tri_indices, task_manager);
+
+	node_data = nodes.data();
+	leaf_tri_index_data = leaf_tri_indices.data();
+	num_nodes = nodes.size();
+	num_leaf_tri_indices = leaf_tri_indices.size();
+	cache_file = NULL;
 
 	// conPrint("SmallBVH total build took " + timer.elapsedString());
 }
@@ -222,7 +134,7 @@ stack_pop:
 
 		while(cur >= 0) // While this is a proper interior node:
 		{
-			const SmallBVHNode& node = nodes[cur];
+			const SmallBVHNode& node = node_data[cur];
 
 			// Intersect with the node bounding boxes
 
@@ -290,7 +202,7 @@ stack_pop:
 		const size_t num = size_t(cur) & 0x3F;
 		for(size_t i=ofs; i<ofs+num; i++)
 		{
-			const uint32 tri_index = leaf_tri_indices[i];
+			const uint32 tri_index = leaf_tri_index_data[i];
 			
 			MollerTrumboreTri tri;
 			tri.set(raymesh->triVertPos(tri_index, 0), raymesh->triVertPos(tri_index, 1), raymesh->triVertPos(tri_index, 2));
@@ -317,6 +229,12 @@ stack_pop:
 }
 
 
+void SmallBVH::traceRays(const RayBatch& rays, HitInfo* hitinfos_out, DistType* dists_out) const
+{
+	BVHPacketTraversal::traceRays<SmallBVHNode, /*LEAF_NUM_BITS=*/6>(*this, node_data, root_node_index, leaf_tri_index_data, raymesh, rays, hitinfos_out, dists_out);
+}
+
+
 const js::AABBox& SmallBVH::getAABBox() const
 {
 	return root_aabb;
@@ -325,7 +243,40 @@ const js::AABBox& SmallBVH::getAABBox() const
 
 size_t SmallBVH::getTotalMemUsage() const
 {
-	return nodes.dataSizeBytes() + leaf_tri_indices.dataSizeBytes();
+	return nodes.dataSizeBytes() + leaf_tri_indices.dataSizeBytes() + (cache_file.nonNull() ? cache_file->fileSize() : 0);
+}
+
+
+bool SmallBVH::loadFromCache(const std::string& cache_dir, uint64 mesh_hash)
+{
+	BVHCache::CachedTreeData data;
+	if(!BVHCache::loadCacheFile(cache_dir, mesh_hash, raymesh->getNumTris(), BVHCache::TreeType_SmallBVH, sizeof(SmallBVHNode), sizeof(uint32), data))
+		return false;
+
+	// Use the node and leaf data directly from the memory-mapped file.
+	nodes.clearAndFreeMem();
+	leaf_tri_indices.clearAndFreeMem();
+	root_aabb = data.root_aabb;
+	root_node_index = data.root_node_index;
+	node_data = (const SmallBVHNode*)data.nodes;
+	leaf_tri_index_data = (const uint32*)data.leaf_data;
+	num_nodes = data.num_nodes;
+	num_leaf_tri_indices = data.num_leaf_elems;
+	cache_file = data.file;
+	return true;
+}
+
+
+void SmallBVH::writeToCache(const std::string& cache_dir, uint64 mesh_hash) const
+{
+	BVHCache::CachedTreeData data;
+	data.root_aabb = root_aabb;
+	data.root_node_index = root_node_index;
+	data.nodes = node_data;
+	data.num_nodes = num_nodes;
+	data.leaf_data = leaf_tri_index_data;
+	data.num_leaf_elems = num_leaf_tri_indices;
+	BVHCache::writeCacheFile(cache_dir, mesh_hash, raymesh->getNumTris(), BVHCache::TreeType_SmallBVH, sizeof(SmallBVHNode), sizeof(uint32), data);
 }
 
 
@@ -11,9 +11,11 @@ Copyright Glare Technologies Limited 2020 -
 #include "../maths/vec3.h"
 #include "../utils/MemAlloc.h"
 #include "../utils/Vector.h"
+#include "../utils/Reference.h"
 
 
 class RayMesh;
+class SharedMemMappedFile;
 
 
 namespace js
@@ -62,12 +64,16 @@ public:
 	virtual void build(PrintOutput& print_output, ShouldCancelCallback& should_cancel_callback, glare::TaskManager& task_manager); // throws glare::Exception
 
 	virtual DistType traceRay(const Ray& ray, HitInfo& hitinfo_out) const;
+	virtual void traceRays(const RayBatch& rays, HitInfo* hitinfos_out, DistType* dists_out) const; // Traces rays in packets of 4 where they are coherent.  See BVHPacketTraversal.h
 	virtual const js::AABBox& getAABBox() const;
 
 	virtual void printStats() const {}
 	virtual void printTraceStats() const {}
 	virtual size_t getTotalMemUsage() const;
 
+	virtual bool loadFromCache(const std::string& cache_dir, uint64 mesh_hash);
+	virtual void writeToCache(const std::string& cache_dir, uint64 mesh_hash) const; // throws glare::Exception
+
 	static void test(bool comprehensive_tests);
 private:
 	AABBox root_aabb; // AABB of whole thing
@@ -75,6 +81,13 @@ private:
 	js::Vector<uint32, 64> leaf_tri_indices; // Indices into the raymesh triangles array.
 	const RayMesh* const raymesh;
 	int32 root_node_index;
+
+	// The node and leaf tri index data used for traversal.  These point into nodes and leaf_tri_indices, or into cache_file if the tree was loaded from the BVH cache.
+	const SmallBVHNode* node_data;
+	const uint32* leaf_tri_index_data;
+	size_t num_nodes;
+	size_t num_leaf_tri_indices;
+	Reference<SharedMemMappedFile> cache_file;
 };
 
 
@@ -0,0 +1,63 @@
+/*=====================================================================
+SphereQueryBatch.h
+------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "../simpleraytracer/ray.h"
+#include "../maths/Vec4f.h"
+#include "../utils/Platform.h"
+#include <vector>
+
+
+// A sphere moving along a ray, as traced by Tree::traceSphere().
+// The sphere centre moves from ray_ws.startPos() to ray_ws.pointf(ray_ws.maxT()).
+struct SphereSweepQuery
+{
+	GLARE_ALIGNED_16_NEW_DELETE
+
+	Ray ray_ws;
+	float radius_ws;
+};
+
+
+// The result of tracing a SphereSweepQuery.  hit_pos_ws, hit_normal_ws and point_in_tri are only valid if dist >= 0.
+struct SphereSweepResult
+{
+	GLARE_ALIGNED_16_NEW_DELETE
+
+	Vec4f hit_pos_ws;
+	Vec4f hit_normal_ws;
+	double dist; // Distance the sphere moved before hitting something, or -1 if it didn't hit anything.
+	bool point_in_tri;
+};
+
+
+// A static sphere, for overlap queries such as Tree::appendCollPoints().
+struct SphereOverlapQuery
+{
+	GLARE_ALIGNED_16_NEW_DELETE
+
+	Vec4f centre_ws;
+	float radius_ws;
+};
+
+
+/*=====================================================================
+BatchQueryResults
+-----------------
+A variable number of results for each query in a batch, stored contiguously.
+The results for query i are results[offsets[i]] ... results[offsets[i + 1] - 1].
+=====================================================================*/
+template <class T>
+struct BatchQueryResults
+{
+	size_t numQueries() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+	size_t numResults(size_t query_i) const { return offsets[query_i + 1] - offsets[query_i]; }
+	const T* queryResults(size_t query_i) const { return results.data() + offsets[query_i]; }
+
+	std::vector<T> results;
+	std::vector<uint32> offsets; // Has num queries + 1 entries.
+};
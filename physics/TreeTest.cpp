@@ -11,11 +11,14 @@ Code By Nicholas Chapman.
 #include "../indigo/EmbreeAccel.h"
 #endif
 #include "BVH.h"
+#include "SmallBVH.h"
 #include "MollerTrumboreTri.h"
 #include "jscol_boundingsphere.h"
 #include "../simpleraytracer/raymesh.h"
 #include "../maths/PCG32.h"
 #include "../simpleraytracer/hitinfo.h"
+#include "../simpleraytracer/RayBatch.h"
+#include "SphereQueryBatch.h"
 #include "../indigo/FullHitInfo.h"
 #include "../indigo/DistanceHitInfo.h"
 #include "../indigo/RendererSettings.h"
@@ -1233,6 +1236,328 @@ void TreeTest::doAppendCollPointsTests(const std::string& appdata_path)
 }
 
 
+// Checks that traceRays() returns the same results as traceRay() for each ray in the batch.
+static void checkTraceRaysMatchesTraceRay(const Tree& tree, const RayBatch& rays)
+{
+	std::vector<HitInfo> hitinfos(rays.size());
+	std::vector<Tree::DistType> dists(rays.size());
+	tree.traceRays(rays, hitinfos.data(), dists.data());
+
+	for(size_t i=0; i<rays.size(); ++i)
+	{
+		HitInfo hitinfo;
+		const Tree::DistType dist = tree.traceRay(rays.getRay(i), hitinfo);
+
+		testAssert((dist >= 0) == (dists[i] >= 0));
+		if(dist >= 0)
+		{
+			testAssert(hitinfos[i].sub_elem_index == hitinfo.sub_elem_index);
+			testEpsEqualWithEps((float)dists[i], (float)dist, 1.0e-4f);
+			testEpsEqualWithEps(hitinfos[i].sub_elem_coords.x, hitinfo.sub_elem_coords.x, 1.0e-4f);
+			testEpsEqualWithEps(hitinfos[i].sub_elem_coords.y, hitinfo.sub_elem_coords.y, 1.0e-4f);
+		}
+		else
+			testAssert(dists[i] == -1);
+	}
+}
+
+
+// Prints the tracing speed of traceRays() compared to calling traceRay() for each ray.
+static void benchmarkTraceRays(const Tree& tree, const RayBatch& rays, const std::string& desc)
+{
+	std::vector<HitInfo> hitinfos(rays.size());
+	std::vector<Tree::DistType> dists(rays.size());
+
+	const int NUM_ITERS = 3;
+	double single_ray_time = 1.0e100;
+	double batch_time = 1.0e100;
+	for(int q=0; q<NUM_ITERS; ++q)
+	{
+		{
+			Timer timer;
+			for(size_t i=0; i<rays.size(); ++i)
+				dists[i] = tree.traceRay(rays.getRay(i), hitinfos[i]);
+			single_ray_time = myMin(single_ray_time, timer.elapsed());
+		}
+		{
+			Timer timer;
+			tree.traceRays(rays, hitinfos.data(), dists.data());
+			batch_time = myMin(batch_time, timer.elapsed());
+		}
+	}
+
+	conPrint(desc + ": traceRay(): " + doubleToStringNSigFigs(rays.size() / single_ray_time * 1.0e-6, 4) + " M rays/s, traceRays(): " + 
+		doubleToStringNSigFigs(rays.size() / batch_time * 1.0e-6, 4) + " M rays/s (speedup: " + doubleToStringNSigFigs(single_ray_time / batch_time, 3) + "x)");
+}
+
+
+void TreeTest::doRayBatchTests()
+{
+	conPrint("TreeTest::doRayBatchTests()");
+
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+	glare::TaskManager task_manager;
+	PCG32 rng(1);
+
+	// Make a mesh of random small triangles
+	RayMesh raymesh("raymesh", false);
+	const unsigned int NUM_TRIS = 20000;
+	for(unsigned int i=0; i<NUM_TRIS; ++i)
+	{
+		const Vec3f pos(-1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f);
+		for(int v=0; v<3; ++v)
+			raymesh.addVertex(pos + Vec3f(-1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f)*0.05f);
+		const unsigned int vertex_indices[] = { i*3, i*3+1, i*3+2 };
+		const unsigned int uv_indices[] = { 0, 0, 0 };
+		raymesh.addTriangle(vertex_indices, uv_indices, 0);
+	}
+
+	BVH bvh(&raymesh);
+	bvh.build(print_output, should_cancel_callback, task_manager);
+	SmallBVH small_bvh(&raymesh);
+	small_bvh.build(print_output, should_cancel_callback, task_manager);
+	const Tree* trees[] = { &bvh, &small_bvh };
+	const char* tree_names[] = { "BVH", "SmallBVH" };
+
+	// Coherent rays: rays from a pinhole camera looking at the mesh, in row order.
+	const int W = 256;
+	RayBatch camera_rays;
+	camera_rays.resize(W * W);
+	for(int y=0; y<W; ++y)
+	for(int x=0; x<W; ++x)
+		camera_rays.setRay(y * W + x, Vec4f(0, 0, 4, 1), normalise(Vec4f(-0.3f + 0.6f * x / W, -0.3f + 0.6f * y / W, -1, 0)), 0.f, std::numeric_limits<float>::max());
+
+	// Incoherent rays: random origins and directions.
+	const int NUM_RANDOM_RAYS = 16384;
+	RayBatch random_rays;
+	random_rays.resize(NUM_RANDOM_RAYS);
+	for(int i=0; i<NUM_RANDOM_RAYS; ++i)
+		random_rays.setRay(i, 
+			Vec4f(-1.5f + rng.unitRandom()*3.0f, -1.5f + rng.unitRandom()*3.0f, -1.5f + rng.unitRandom()*3.0f, 1),
+			normalise(Vec4f(-1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, 0)),
+			1.0e-5f, std::numeric_limits<float>::max());
+
+	// Rays with limited [min_t, max_t] intervals, and an axis-aligned direction.  7 rays, so there is a partially filled packet.
+	RayBatch limited_rays;
+	limited_rays.resize(7);
+	for(int i=0; i<7; ++i)
+		limited_rays.setRay(i, Vec4f(0.01f * i, 0.02f * i, 4, 1), normalise(Vec4f(0.001f * i, 0, -1, 0)), 3.f + 0.1f * i, 4.5f);
+	limited_rays.setRay(6, Vec4f(0.2f, 0.1f, 4, 1), Vec4f(0, 0, -1, 0), 0.f, 10.f);
+
+	for(int t=0; t<2; ++t)
+	{
+		checkTraceRaysMatchesTraceRay(*trees[t], camera_rays);
+		checkTraceRaysMatchesTraceRay(*trees[t], random_rays);
+		checkTraceRaysMatchesTraceRay(*trees[t], limited_rays);
+		checkTraceRaysMatchesTraceRay(*trees[t], RayBatch()); // Empty batch
+
+		benchmarkTraceRays(*trees[t], camera_rays, std::string(tree_names[t]) + ", camera rays");
+		benchmarkTraceRays(*trees[t], random_rays, std::string(tree_names[t]) + ", random rays");
+	}
+
+	conPrint("TreeTest::doRayBatchTests() done.");
+}
+
+
+// Checks that traceSpheres() returns the same results as traceSphere() for each query in the batch.
+static void checkTraceSpheresMatchesTraceSphere(const Tree& tree, const Matrix4f& to_object, const Matrix4f& to_world, const std::vector<SphereSweepQuery>& queries, glare::TaskManager* task_manager)
+{
+	std::vector<SphereSweepResult> results(queries.size());
+	tree.traceSpheres(queries.data(), queries.size(), to_object, to_world, results.data(), task_manager);
+
+	for(size_t i=0; i<queries.size(); ++i)
+	{
+		Vec4f hit_pos_ws, hit_normal_ws;
+		bool point_in_tri;
+		const Tree::DistType dist = tree.traceSphere(queries[i].ray_ws, to_object, to_world, queries[i].radius_ws, hit_pos_ws, hit_normal_ws, point_in_tri);
+
+		testAssert(results[i].dist == dist);
+		if(dist >= 0)
+		{
+			testAssert(results[i].hit_pos_ws == hit_pos_ws);
+			testAssert(results[i].hit_normal_ws == hit_normal_ws);
+			testAssert(results[i].point_in_tri == point_in_tri);
+		}
+	}
+}
+
+
+// Checks that getCollPointsBatch() returns the same points, in the same order, as appendCollPoints() for each query in the batch.
+static void checkGetCollPointsBatchMatchesAppendCollPoints(const Tree& tree, const Matrix4f& to_object, const Matrix4f& to_world, const std::vector<SphereOverlapQuery>& queries, glare::TaskManager* task_manager)
+{
+	BatchQueryResults<Vec4f> results;
+	tree.getCollPointsBatch(queries.data(), queries.size(), to_object, to_world, results, task_manager);
+	testAssert(results.numQueries() == queries.size());
+
+	std::vector<Vec4f> points;
+	for(size_t i=0; i<queries.size(); ++i)
+	{
+		points.clear();
+		tree.appendCollPoints(queries[i].centre_ws, queries[i].radius_ws, to_object, to_world, points);
+
+		testAssert(results.numResults(i) == points.size());
+		for(size_t z=0; z<points.size(); ++z)
+			testAssert(results.queryResults(i)[z] == points[z]);
+	}
+}
+
+
+// Prints the speed of the batched sphere queries compared to calling the single query versions for each query.
+static void benchmarkSphereBatches(const Tree& tree, const Matrix4f& to_object, const Matrix4f& to_world, const std::vector<SphereSweepQuery>& sweep_queries,
+	const std::vector<SphereOverlapQuery>& overlap_queries, glare::TaskManager& task_manager, const std::string& desc)
+{
+	std::vector<SphereSweepResult> sweep_results(sweep_queries.size());
+	BatchQueryResults<Vec4f> overlap_results;
+	std::vector<Vec4f> points;
+
+	const int NUM_ITERS = 3;
+	double single_sweep_time = 1.0e100, batch_sweep_time = 1.0e100, parallel_batch_sweep_time = 1.0e100;
+	double single_overlap_time = 1.0e100, batch_overlap_time = 1.0e100, parallel_batch_overlap_time = 1.0e100;
+	for(int q=0; q<NUM_ITERS; ++q)
+	{
+		{
+			Timer timer;
+			for(size_t i=0; i<sweep_queries.size(); ++i)
+				sweep_results[i].dist = tree.traceSphere(sweep_queries[i].ray_ws, to_object, to_world, sweep_queries[i].radius_ws, sweep_results[i].hit_pos_ws, sweep_results[i].hit_normal_ws, sweep_results[i].point_in_tri);
+			single_sweep_time = myMin(single_sweep_time, timer.elapsed());
+		}
+		{
+			Timer timer;
+			tree.traceSpheres(sweep_queries.data(), sweep_queries.size(), to_object, to_world, sweep_results.data(), NULL);
+			batch_sweep_time = myMin(batch_sweep_time, timer.elapsed());
+		}
+		{
+			Timer timer;
+			tree.traceSpheres(sweep_queries.data(), sweep_queries.size(), to_object, to_world, sweep_results.data(), &task_manager);
+			parallel_batch_sweep_time = myMin(parallel_batch_sweep_time, timer.elapsed());
+		}
+		{
+			Timer timer;
+			for(size_t i=0; i<overlap_queries.size(); ++i)
+			{
+				points.clear();
+				tree.appendCollPoints(overlap_queries[i].centre_ws, overlap_queries[i].radius_ws, to_object, to_world, points);
+			}
+			single_overlap_time = myMin(single_overlap_time, timer.elapsed());
+		}
+		{
+			Timer timer;
+			tree.getCollPointsBatch(overlap_queries.data(), overlap_queries.size(), to_object, to_world, overlap_results, NULL);
+			batch_overlap_time = myMin(batch_overlap_time, timer.elapsed());
+		}
+		{
+			Timer timer;
+			tree.getCollPointsBatch(overlap_queries.data(), overlap_queries.size(), to_object, to_world, overlap_results, &task_manager);
+			parallel_batch_overlap_time = myMin(parallel_batch_overlap_time, timer.elapsed());
+		}
+	}
+
+	conPrint(desc + ": traceSphere(): " + doubleToStringNSigFigs(sweep_queries.size() / single_sweep_time * 1.0e-6, 4) + " M queries/s, traceSpheres(): " + 
+		doubleToStringNSigFigs(sweep_queries.size() / batch_sweep_time * 1.0e-6, 4) + " M queries/s (speedup: " + doubleToStringNSigFigs(single_sweep_time / batch_sweep_time, 3) + "x), with task manager: " +
+		doubleToStringNSigFigs(sweep_queries.size() / parallel_batch_sweep_time * 1.0e-6, 4) + " M queries/s");
+	conPrint(desc + ": appendCollPoints(): " + doubleToStringNSigFigs(overlap_queries.size() / single_overlap_time * 1.0e-6, 4) + " M queries/s, getCollPointsBatch(): " + 
+		doubleToStringNSigFigs(overlap_queries.size() / batch_overlap_time * 1.0e-6, 4) + " M queries/s (speedup: " + doubleToStringNSigFigs(single_overlap_time / batch_overlap_time, 3) + "x), with task manager: " +
+		doubleToStringNSigFigs(overlap_queries.size() / parallel_batch_overlap_time * 1.0e-6, 4) + " M queries/s");
+}
+
+
+static void makeSphereQueries(PCG32& rng, int num_clusters, int num_queries_per_cluster, float cluster_radius, const Matrix4f& to_world,
+	std::vector<SphereSweepQuery>& sweep_queries_out, std::vector<SphereOverlapQuery>& overlap_queries_out)
+{
+	sweep_queries_out.resize(num_clusters * num_queries_per_cluster);
+	overlap_queries_out.resize(num_clusters * num_queries_per_cluster);
+	for(int c=0; c<num_clusters; ++c)
+	{
+		const Vec4f cluster_centre(-1.2f + rng.unitRandom()*2.4f, -1.2f + rng.unitRandom()*2.4f, -1.2f + rng.unitRandom()*2.4f, 1);
+		for(int z=0; z<num_queries_per_cluster; ++z)
+		{
+			const size_t i = c * num_queries_per_cluster + z;
+			const Vec4f centre_os = cluster_centre + Vec4f(-1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, 0) * cluster_radius;
+			const Vec4f centre_ws = to_world * centre_os;
+			const Vec4f dir_ws = normalise(Vec4f(-1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, 0));
+
+			sweep_queries_out[i].ray_ws = Ray(centre_ws, dir_ws, 0.f, rng.unitRandom() * 0.5f);
+			sweep_queries_out[i].radius_ws = 0.01f + rng.unitRandom() * 0.1f;
+
+			overlap_queries_out[i].centre_ws = centre_ws;
+			overlap_queries_out[i].radius_ws = 0.01f + rng.unitRandom() * 0.1f;
+		}
+	}
+}
+
+
+void TreeTest::doSphereBatchTests()
+{
+	conPrint("TreeTest::doSphereBatchTests()");
+
+	StandardPrintOutput print_output;
+	DummyShouldCancelCallback should_cancel_callback;
+	glare::TaskManager task_manager;
+	PCG32 rng(1);
+
+	// Make a mesh of random small triangles
+	RayMesh raymesh("raymesh", false);
+	const unsigned int NUM_TRIS = 20000;
+	for(unsigned int i=0; i<NUM_TRIS; ++i)
+	{
+		const Vec3f pos(-1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f);
+		for(int v=0; v<3; ++v)
+			raymesh.addVertex(pos + Vec3f(-1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f, -1.0f + rng.unitRandom()*2.0f)*0.05f);
+		const unsigned int vertex_indices[] = { i*3, i*3+1, i*3+2 };
+		const unsigned int uv_indices[] = { 0, 0, 0 };
+		raymesh.addTriangle(vertex_indices, uv_indices, 0);
+	}
+
+	BVH bvh(&raymesh);
+	bvh.build(print_output, should_cancel_callback, task_manager);
+
+	// Test with an identity transform, and with a rotation, translation and scale.
+	const Matrix4f transforms[] = {
+		Matrix4f::identity(),
+		Matrix4f::translationMatrix(3, -1, 2) * Matrix4f::rotationMatrix(normalise(Vec4f(1, 1, 0, 0)), 0.7f) * Matrix4f::uniformScaleMatrix(1.5f)
+	};
+
+	for(int t=0; t<2; ++t)
+	{
+		const Matrix4f& to_world = transforms[t];
+		Matrix4f to_object;
+		testAssert(to_world.getInverseForAffine3Matrix(to_object));
+
+		std::vector<SphereSweepQuery> sweep_queries;
+		std::vector<SphereOverlapQuery> overlap_queries;
+
+		// Clustered queries, e.g. particles or characters near each other.
+		makeSphereQueries(rng, /*num_clusters=*/64, /*num_queries_per_cluster=*/64, /*cluster_radius=*/0.1f, to_world, sweep_queries, overlap_queries);
+		for(int use_task_manager=0; use_task_manager<2; ++use_task_manager)
+		{
+			checkTraceSpheresMatchesTraceSphere(bvh, to_object, to_world, sweep_queries, use_task_manager ? &task_manager : NULL);
+			checkGetCollPointsBatchMatchesAppendCollPoints(bvh, to_object, to_world, overlap_queries, use_task_manager ? &task_manager : NULL);
+		}
+		benchmarkSphereBatches(bvh, to_object, to_world, sweep_queries, overlap_queries, task_manager, "BVH, clustered queries, transform " + toString(t));
+
+		// Incoherent queries spread over the whole mesh
+		makeSphereQueries(rng, /*num_clusters=*/4096, /*num_queries_per_cluster=*/1, /*cluster_radius=*/0.f, to_world, sweep_queries, overlap_queries);
+		for(int use_task_manager=0; use_task_manager<2; ++use_task_manager)
+		{
+			checkTraceSpheresMatchesTraceSphere(bvh, to_object, to_world, sweep_queries, use_task_manager ? &task_manager : NULL);
+			checkGetCollPointsBatchMatchesAppendCollPoints(bvh, to_object, to_world, overlap_queries, use_task_manager ? &task_manager : NULL);
+		}
+		benchmarkSphereBatches(bvh, to_object, to_world, sweep_queries, overlap_queries, task_manager, "BVH, random queries, transform " + toString(t));
+
+		// Small batches, with a partially filled group
+		for(int num_queries=0; num_queries<70; num_queries += 23)
+		{
+			makeSphereQueries(rng, /*num_clusters=*/1, /*num_queries_per_cluster=*/num_queries, /*cluster_radius=*/0.3f, to_world, sweep_queries, overlap_queries);
+			checkTraceSpheresMatchesTraceSphere(bvh, to_object, to_world, sweep_queries, &task_manager);
+			checkGetCollPointsBatchMatchesAppendCollPoints(bvh, to_object, to_world, overlap_queries, &task_manager);
+		}
+	}
+
+	conPrint("TreeTest::doSphereBatchTests() done.");
+}
+
+
 void TreeTest::doTests(const std::string& appdata_path)
 {
 	conPrint("TreeTest::doTests()");
@@ -1247,6 +1572,10 @@ void TreeTest::doTests(const std::string& appdata_path)
 
 	doEdgeCaseTests();
 
+	doRayBatchTests();
+
+	doSphereBatchTests();
+
 	
 
 	Geometry::BuildOptions options;
@@ -30,6 +30,8 @@ public:
 	static void doRayTests();
 	static void doSphereTracingTests(const std::string& appdata_path);
 	static void doAppendCollPointsTests(const std::string& appdata_path);
+	static void doRayBatchTests();
+	static void doSphereBatchTests();
 };
 
 
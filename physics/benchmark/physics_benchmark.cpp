@@ -0,0 +1,21 @@
+/*=====================================================================
+physics_benchmark.cpp
+---------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+
+
+// Command line program for RayTracingBenchmark.  Writes the results as JSON to stdout, or to the file given with --out.
+// Example: physics_benchmark --iters 10 --out results.json
+
+
+#include "../RayTracingBenchmark.h"
+#include "../../utils/Clock.h"
+
+
+int main(int argc, char** argv)
+{
+	Clock::init();
+
+	return RayTracingBenchmark::runFromCommandLine(argc, argv);
+}
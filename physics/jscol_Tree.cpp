@@ -6,6 +6,9 @@ Copyright Glare Technologies Limited 2020 -
 #include "jscol_Tree.h"
 
 
+#include "../simpleraytracer/RayBatch.h"
+#include "../simpleraytracer/hitinfo.h"
+#include "SphereQueryBatch.h"
 #include <assert.h>
 
 
@@ -21,6 +24,13 @@ Tree::~Tree()
 {}
 
 
+void Tree::traceRays(const RayBatch& rays, HitInfo* hitinfos_out, DistType* dists_out) const
+{
+	for(size_t i=0; i<rays.size(); ++i)
+		dists_out[i] = traceRay(rays.getRay(i), hitinfos_out[i]);
+}
+
+
 Tree::DistType Tree::traceSphere(const Ray& ray_dir_ws, const Matrix4f& to_object, const Matrix4f& to_world, float radius_ws, Vec4f& hit_pos_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const
 {
 	assert(0);
@@ -34,4 +44,34 @@ void Tree::appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, const M
 }
 
 
+void Tree::traceSpheres(const SphereSweepQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, SphereSweepResult* results_out, glare::TaskManager* /*task_manager*/) const
+{
+	for(size_t i=0; i<num_queries; ++i)
+		results_out[i].dist = traceSphere(queries[i].ray_ws, to_object, to_world, queries[i].radius_ws, results_out[i].hit_pos_ws, results_out[i].hit_normal_ws, results_out[i].point_in_tri);
+}
+
+
+void Tree::getCollPointsBatch(const SphereOverlapQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, BatchQueryResults<Vec4f>& results_out, glare::TaskManager* /*task_manager*/) const
+{
+	results_out.results.clear();
+	results_out.offsets.resize(num_queries + 1);
+	results_out.offsets[0] = 0;
+	for(size_t i=0; i<num_queries; ++i)
+	{
+		appendCollPoints(queries[i].centre_ws, queries[i].radius_ws, to_object, to_world, results_out.results);
+		results_out.offsets[i + 1] = (uint32)results_out.results.size();
+	}
+}
+
+
+bool Tree::loadFromCache(const std::string& cache_dir, uint64 mesh_hash)
+{
+	return false;
+}
+
+
+void Tree::writeToCache(const std::string& cache_dir, uint64 mesh_hash) const
+{}
+
+
 } // end namespace js
@@ -8,14 +8,20 @@ Copyright Glare Technologies Limited 2020 -
 
 #include "../utils/Platform.h"
 #include <vector>
+#include <string>
 #include <cstddef> // For size_t
 class HitInfo;
 class DistanceHitInfo;
 class PrintOutput;
 class ShouldCancelCallback;
 class Ray;
+class RayBatch;
 class Vec4f;
 class Matrix4f;
+struct SphereSweepQuery;
+struct SphereSweepResult;
+struct SphereOverlapQuery;
+template <class T> struct BatchQueryResults;
 namespace js { class AABBox; };
 namespace glare { class TaskManager; }
 
@@ -42,9 +48,23 @@ public:
 
 	virtual DistType traceRay(const Ray& ray, HitInfo& hitinfo_out) const = 0;
 
+	// Traces all rays in the batch.  dists_out[i] is set to what traceRay() would return for ray i, hitinfos_out[i] is only written if ray i hit something.
+	// The default implementation just calls traceRay() for each ray.
+	virtual void traceRays(const RayBatch& rays, HitInfo* hitinfos_out, DistType* dists_out) const;
+
 	virtual DistType traceSphere(const Ray& ray_ws, const Matrix4f& to_object, const Matrix4f& to_world, float radius_ws, Vec4f& hit_pos_out, Vec4f& hit_normal_ws_out, bool& point_in_tri_out) const;
 
 	virtual void appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_object, const Matrix4f& to_world, std::vector<Vec4f>& points_ws_in_out) const;
+
+	// Traces a batch of sphere sweeps.  results_out[i] is set to what traceSphere() would compute for query i.
+	// Large batches are split across task_manager if it is non-null.
+	// The default implementation just calls traceSphere() for each query.
+	virtual void traceSpheres(const SphereSweepQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, SphereSweepResult* results_out, glare::TaskManager* task_manager) const;
+
+	// Gets the collision points for a batch of spheres.  The results for query i are the points appendCollPoints() would append for sphere i.
+	// Large batches are split across task_manager if it is non-null.
+	// The default implementation just calls appendCollPoints() for each query.
+	virtual void getCollPointsBatch(const SphereOverlapQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, BatchQueryResults<Vec4f>& results_out, glare::TaskManager* task_manager) const;
 	
 	virtual const js::AABBox& getAABBox() const = 0;
 
@@ -52,6 +72,14 @@ public:
 	virtual void printTraceStats() const = 0;
 		
 	virtual size_t getTotalMemUsage() const = 0;
+
+	// Tries to load the tree from the BVH cache in cache_dir, instead of building it.  See BVHCache.h.
+	// Returns false if there is no valid cached tree for the mesh, in which case build() needs to be called.
+	// The default implementation, for trees that can't be cached, just returns false.
+	virtual bool loadFromCache(const std::string& cache_dir, uint64 mesh_hash);
+
+	// Writes the built tree to the BVH cache in cache_dir.  The default implementation does nothing.
+	virtual void writeToCache(const std::string& cache_dir, uint64 mesh_hash) const; // throws glare::Exception
 };
 
 
@@ -0,0 +1,79 @@
+/*=====================================================================
+RayBatch.h
+----------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "ray.h"
+#include "../utils/Vector.h"
+
+
+/*=====================================================================
+RayBatch
+--------
+A batch of rays stored in structure-of-arrays form, for tracing many
+rays at once with Tree::traceRays().
+
+Directions should be unit length, as with Ray.
+=====================================================================*/
+class RayBatch
+{
+public:
+	inline void resize(size_t n);
+	inline size_t size() const { return orig_x.size(); }
+
+	inline void setRay(size_t i, const Ray& ray);
+	inline void setRay(size_t i, const Vec4f& startpos, const Vec4f& unitdir, float min_t, float max_t);
+	inline const Ray getRay(size_t i) const;
+
+	js::Vector<float, 16> orig_x;
+	js::Vector<float, 16> orig_y;
+	js::Vector<float, 16> orig_z;
+	js::Vector<float, 16> dir_x;
+	js::Vector<float, 16> dir_y;
+	js::Vector<float, 16> dir_z;
+	js::Vector<float, 16> min_t;
+	js::Vector<float, 16> max_t;
+};
+
+
+void RayBatch::resize(size_t n)
+{
+	orig_x.resize(n);
+	orig_y.resize(n);
+	orig_z.resize(n);
+	dir_x.resize(n);
+	dir_y.resize(n);
+	dir_z.resize(n);
+	min_t.resize(n);
+	max_t.resize(n);
+}
+
+
+void RayBatch::setRay(size_t i, const Ray& ray)
+{
+	setRay(i, ray.startPos(), ray.unitDir(), ray.minT(), ray.maxT());
+}
+
+
+void RayBatch::setRay(size_t i, const Vec4f& startpos, const Vec4f& unitdir, float min_t_, float max_t_)
+{
+	assert(i < size());
+	orig_x[i] = startpos[0];
+	orig_y[i] = startpos[1];
+	orig_z[i] = startpos[2];
+	dir_x[i] = unitdir[0];
+	dir_y[i] = unitdir[1];
+	dir_z[i] = unitdir[2];
+	min_t[i] = min_t_;
+	max_t[i] = max_t_;
+}
+
+
+const Ray RayBatch::getRay(size_t i) const
+{
+	assert(i < size());
+	return Ray(Vec4f(orig_x[i], orig_y[i], orig_z[i], 1.f), Vec4f(dir_x[i], dir_y[i], dir_z[i], 0.f), min_t[i], max_t[i]);
+}
@@ -17,6 +17,7 @@ Copyright Glare Technologies Limited 2023 -
 #include "../utils/Reference.h"
 #include "../utils/ArrayRef.h"
 #include <vector>
+#include <string>
 class Ray;
 class World;
 class HitInfo;
@@ -122,9 +123,13 @@ public:
 #ifndef GEOMETRY_NO_TREE_BUILD_SUPPORT
 	struct BuildOptions
 	{
-		BuildOptions() : build_small_bvh(false), compute_is_planar(true), embree_device(NULL) {}
+		BuildOptions() : build_small_bvh(false), compute_is_planar(true), use_bvh8(false), use_fast_bvh_builder(false), use_quantized_bvh(false), embree_device(NULL) {}
 		bool build_small_bvh;
 		bool compute_is_planar; // If true, computes planar and planar_normal in RayMesh::build()
+		bool use_bvh8; // If true, RayMesh::build() uses js::BVH8 instead of js::BVH.  Only used with NO_EMBREE.
+		bool use_fast_bvh_builder; // If true, js::BVH is built with MortonBVHBuilder, for fast rebuilds of deforming meshes.  Only used with NO_EMBREE.
+		bool use_quantized_bvh; // If true, RayMesh::build() uses js::QuantizedBVH<uint8>, which uses about a third of the node memory of js::BVH, for very large meshes.  Only used with NO_EMBREE.
+		std::string bvh_cache_dir; // If non-empty, RayMesh::build() loads built trees from this directory instead of building them where possible, and writes newly built trees to it.  See BVHCache.h.
 		RTCDeviceTy* embree_device; // Used in EmbreeAccel::build()
 	};
 	virtual void build(const BuildOptions& options, ShouldCancelCallback& should_cancel_callback, PrintOutput& print_output, bool verbose, glare::TaskManager& task_manager) = 0; // throws glare::Exception
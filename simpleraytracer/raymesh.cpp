@@ -10,6 +10,9 @@ Copyright Glare Technologies Limited 2022 -
 #include "../utils/TestUtils.h"
 #include "../graphics/BatchedMesh.h"
 #include "../physics/BVH.h"
+#include "../physics/BVH8.h"
+#include "../physics/QuantizedBVH.h"
+#include "../physics/BVHCache.h"
 #include "../physics/SmallBVH.h"
 #if IS_INDIGO
 #include "../indigo/material.h"
@@ -134,6 +137,18 @@ void RayMesh::appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, cons
 }
 
 
+void RayMesh::traceSpheres(const SphereSweepQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, SphereSweepResult* results_out, glare::TaskManager* task_manager) const
+{
+	tritree->traceSpheres(queries, num_queries, to_object, to_world, results_out, task_manager);
+}
+
+
+void RayMesh::getCollPointsBatch(const SphereOverlapQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, BatchQueryResults<Vec4f>& results_out, glare::TaskManager* task_manager) const
+{
+	tritree->getCollPointsBatch(queries, num_queries, to_object, to_world, results_out, task_manager);
+}
+
+
 const js::AABBox RayMesh::getAABBox() const
 {
 	if(tritree)
@@ -878,7 +893,16 @@ void RayMesh::build(const BuildOptions& options, ShouldCancelCallback& should_ca
 	{
 #ifdef NO_EMBREE
 		// NO_EMBREE is used in substrata
-		tritree = new js::BVH(this);
+		if(options.use_bvh8)
+			tritree = new js::BVH8(this);
+		else if(options.use_quantized_bvh)
+			tritree = new js::QuantizedBVH<uint8>(this);
+		else
+		{
+			js::BVH* bvh = new js::BVH(this);
+			bvh->setUseMortonBuilder(options.use_fast_bvh_builder);
+			tritree = bvh;
+		}
 #else
 		assert(options.embree_device);
 		tritree = new EmbreeAccel(options.embree_device, this, /*do_fast_low_quality_build=*/options.build_small_bvh);
@@ -900,9 +924,34 @@ void RayMesh::build(const BuildOptions& options, ShouldCancelCallback& should_ca
 
 	try
 	{
-		//Timer timer;
-		tritree->build(print_output, should_cancel_callback, task_manager);
-		//conPrint("tritree->build: " + timer.elapsedString());
+		if(!options.bvh_cache_dir.empty())
+		{
+			const uint64 mesh_hash = BVHCache::computeMeshHash(*this);
+			if(tritree->loadFromCache(options.bvh_cache_dir, mesh_hash))
+			{
+				if(verbose) print_output.print("\tLoaded tree from BVH cache.");
+			}
+			else
+			{
+				tritree->build(print_output, should_cancel_callback, task_manager);
+
+				try
+				{
+					tritree->writeToCache(options.bvh_cache_dir, mesh_hash);
+				}
+				catch(glare::Exception& e)
+				{
+					// Failing to write the cache file is not fatal, the tree will just be built again next time.
+					print_output.print("Warning: " + e.what());
+				}
+			}
+		}
+		else
+		{
+			//Timer timer;
+			tritree->build(print_output, should_cancel_callback, task_manager);
+			//conPrint("tritree->build: " + timer.elapsedString());
+		}
 	}
 	catch(glare::CancelledException&)
 	{
@@ -162,6 +162,10 @@ public:
 	////////////////////// Geometry interface ///////////////////
 	virtual DistType traceRay(const Ray& ray, HitInfo& hitinfo_out) const;
 	void appendCollPoints(const Vec4f& sphere_pos_ws, float radius_ws, const Matrix4f& to_object, const Matrix4f& to_world, std::vector<Vec4f>& points_ws_in_out) const;
+
+	// Batched versions of traceSphere() and appendCollPoints().  See js::Tree::traceSpheres() and js::Tree::getCollPointsBatch().
+	void traceSpheres(const SphereSweepQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, SphereSweepResult* results_out, glare::TaskManager* task_manager) const;
+	void getCollPointsBatch(const SphereOverlapQuery* queries, size_t num_queries, const Matrix4f& to_object, const Matrix4f& to_world, BatchQueryResults<Vec4f>& results_out, glare::TaskManager* task_manager) const;
 	virtual const js::AABBox getAABBox() const;
 	virtual const js::AABBox getTightAABBoxWS(const TransformPath& transform_path) const;
 	
@@ -9,9 +9,14 @@ Copyright Glare Technologies Limited 2021 -
 #include "FileUtils.h"
 #include "FileInStream.h"
 #include "FileOutStream.h"
+#include "FileHandle.h"
+#include "MemMappedFile.h"
+#include "TaskManager.h"
 #include "Exception.h"
 #include "StringUtils.h"
+#include "IncludeXXHash.h"
 #include "../maths/mathstypes.h"
+#include <algorithm>
 
 
 
@@ -27,7 +32,7 @@ key -> record byte offset
 
 Record layout on disk
 ----------------------
-key (uint64), invalid key if record is empty
+key (uint64), invalid key (std::numeric_limits<uint64>::max()) if the record is a free block
 record len (uint32)   (len = std::numeric_limits<uint32>::max() if record has been deleted, otherwise have len <= capacity)
 record capacity (uint32)
 seq_num (uint32)
@@ -42,48 +47,132 @@ arguments: key, and new data buffer (with known size)
 
 Lookup record by key from index.
 
-If record len >= new data buffer size:
+If record capacity >= new data buffer size:
 	overwrite existing record
 else:
-	read seq num from existing record
-	Find a new empty record with sufficient size
+	Find a free block with sufficient size, or append a new record at the end of the file if there is none.
 	write into new record with seq_num + 1
+	Mark the old record as a free block.
 
 
 Storing a new object:
 --------------------
-Currently writes a new record at the end of the existing records.
-
-Todo:
-Find a new empty record with sufficient size
+Find a free block with sufficient size, or append a new record at the end of the file if there is none.
 write new record with seq_num 0
 
 
 Deleting an object
 --------------------
 Lookup record by key
-Set record len to std::numeric_limits<uint32>::max().
+Mark the record as a free block.
+
+
+Free blocks
+-----------
+A free block has the invalid key and len = std::numeric_limits<uint32>::max().
+When a free block is reused for a smaller record, the remainder is split off into a new free block, if it is big enough.
+Adjacent free blocks are merged in the in-memory free block index, but not on disk.  The header of a record written into a merged 
+block just has a capacity that spans the merged blocks.
+
+Older versions of the database code didn't mark moved records as free, and marked deleted records by just setting len = std::numeric_limits<uint32>::max().
+When loading, such superseded and deleted records are added to the free block index, and marked as free blocks on disk before the first write.
+The superseded records that still have a valid length are marked first, since a deleted record may be what hides an older version of the same key.
+
+
+
+WAL layout on disk
+------------------
+magic number (uint32)
+version (uint32)
+frames:
+	frame type (uint32)   (update, delete or commit)
+	data len (uint32)
+	transaction id (uint64)
+	key (uint64)          (for a commit frame, the number of update and delete frames in the transaction)
+	checksum (uint64)     (xxhash of the data, seeded with the xxhash of the preceding frame header fields)
+	data (array of data len bytes)
+
+A transaction is a run of update and delete frames with the same transaction id, followed by a commit frame.
+Recovery replays transactions up to the first frame that is truncated or fails its checksum.
+Replaying a transaction that was already (partially or fully) applied to the database file is harmless, as it just writes the same records again.
 */
 
 
+static const uint32 DATABASE_MAGIC_NUMBER = 287173871;
+static const uint32 DATABASE_SERIALISATION_VERSION = 1;
+
+static const size_t RECORD_HEADER_SIZE = sizeof(uint64) + sizeof(uint32) * 3;
+
+static const uint64 FREE_BLOCK_KEY = std::numeric_limits<uint64>::max();
+static const uint32 MIN_SPLIT_FREE_BLOCK_CAPACITY = 64; // Don't split off free blocks smaller than this.
+static const uint32 MAX_MERGED_FREE_BLOCK_CAPACITY = 1u << 30;
+
+static const uint32 WAL_MAGIC_NUMBER = 3717458231u;
+static const uint32 WAL_SERIALISATION_VERSION = 1;
+static const size_t WAL_HEADER_SIZE = sizeof(uint32) * 2;
+static const size_t WAL_FRAME_HEADER_SIZE = sizeof(uint32) * 2 + sizeof(uint64) * 3;
+
+static const uint32 WAL_FRAME_TYPE_UPDATE = 1;
+static const uint32 WAL_FRAME_TYPE_DELETE = 2;
+static const uint32 WAL_FRAME_TYPE_COMMIT = 3;
+
+
 Database::Database()
-:	file_in(NULL), file_out(NULL), next_unused_key(0), append_offset(std::numeric_limits<size_t>::max())
+:	key_to_info_map(/*empty key=*/DatabaseKey::invalidkey()), file_in(NULL), file_out(NULL), next_unused_key(0), append_offset(std::numeric_limits<size_t>::max()),
+	in_transaction(false), next_txn_id(0), wal_file(NULL), wal_size(0), wal_checkpoint_threshold(16 * 1024 * 1024), free_bytes(0)
 {}
 
 
+static inline size_t recordSize(uint32 capacity)
+{
+	return Maths::roundUpToMultipleOfPowerOf2(RECORD_HEADER_SIZE + capacity, (size_t)4);
+}
+
+
+static inline int sizeClassForCapacity(uint32 capacity)
+{
+	return (capacity == 0) ? 0 : (int)Maths::intLogBase2(capacity);
+}
+
+
 Database::~Database()
 {
+	// Any uncommitted transaction is discarded.
+
+	if(wal_file || (wal_size > WAL_HEADER_SIZE))
+	{
+		try
+		{
+			checkpoint();
+
+			delete wal_file;
+			wal_file = NULL;
+			FileUtils::deleteFile(getWALPath(db_path));
+		}
+		catch(glare::Exception&)
+		{
+			// Committed transactions are still in the WAL, and will be replayed the next time the database is opened.
+		}
+	}
+
+	delete wal_file;
 	delete file_in;
 	delete file_out;
 }
 
 
-static const uint32 DATABASE_MAGIC_NUMBER = 287173871;
-static const uint32 DATABASE_SERIALISATION_VERSION = 1;
+static void deleteWALIfPresent(const std::string& db_path)
+{
+	const std::string wal_path = Database::getWALPath(db_path);
+	if(FileUtils::fileExists(wal_path))
+		FileUtils::deleteFile(wal_path);
+}
 
 
 void Database::makeOrClearDatabase(const std::string& path)
 {
+	deleteWALIfPresent(path); // Don't want a stale WAL to be replayed onto the new database.
+
 	FileOutStream file(path, std::ios::binary | std::ios::trunc);
 
 	file.writeUInt32(DATABASE_MAGIC_NUMBER);
@@ -95,6 +184,8 @@ void Database::openAndMakeOrClearDatabase(const std::string& path)
 {
 	this->db_path = path;
 
+	deleteWALIfPresent(path);
+
 	FileOutStream file(path, std::ios::binary | std::ios::trunc);
 
 	file.writeUInt32(DATABASE_MAGIC_NUMBER);
@@ -104,95 +195,382 @@ void Database::openAndMakeOrClearDatabase(const std::string& path)
 }
 
 
-void Database::startReadingFromDisk(const std::string& path)
+void Database::startReadingFromDisk(const std::string& path, glare::TaskManager* task_manager)
 {
 	this->db_path = path;
 
 	try
 	{
+		recoverFromWAL(path, task_manager);
+
 		file_in = new FileInStream(path);
 
-		// Read magic number
-		const uint32 magic_num = file_in->readUInt32();
-		if(magic_num != DATABASE_MAGIC_NUMBER)
-			throw glare::Exception("invalid magic number: not a valid database file.");
+		readRecordIndex(/*stop_at_torn_record=*/false, task_manager);
+	}
+	catch(glare::Exception& e)
+	{
+		throw glare::Exception("Error while reading database from '" + path + "': " + e.what());
+	}
+}
+
+
+// Reads a byte from each page in a range of pages of the file, so that the page faults (and reads from disk) happen in parallel, 
+// instead of during the sequential walk over the record headers.
+struct TouchFilePagesFunc
+{
+	void operator() (size_t begin, size_t end, size_t /*thread_index*/) const
+	{
+		uint8 x = 0;
+		for(size_t i=begin; i<end; ++i)
+			x ^= file_data[i * page_size];
+		(void)x;
+	}
+
+	const volatile uint8* file_data;
+	size_t page_size;
+};
+
+
+// Does record 'info' supersede 'existing', a record with the same key earlier in the file?  The record with the greatest sequence number wins.
+// Deleted records (with invalid len) are kept in the index while loading so that they can hide older records for the same key.
+static inline bool recordSupersedes(const Database::RecordInfo& info, const Database::RecordInfo& existing)
+{
+	return (info.seq_num > existing.seq_num) || ((info.seq_num == existing.seq_num) && info.isRecordValid() && !existing.isRecordValid());
+}
+
+
+// Adds a record to an index, resolving a record with the same key already in the index.  The superseded record is added to stale_records_out.
+static inline void addRecordToIndex(Database::RecordMap& index, const DatabaseKey& key, const Database::RecordInfo& info, std::vector<Database::RecordInfo>& stale_records_out)
+{
+	auto res = index.insert(std::make_pair(key, info));
+	if(!res.second) // If key was already present in map:
+	{
+		Database::RecordInfo& existing = res.first->second;
+		if(recordSupersedes(info, existing))
+		{
+			stale_records_out.push_back(existing);
+			existing = info;
+		}
+		else
+			stale_records_out.push_back(info);
+	}
+}
+
+
+// The index built from a contiguous range of records in the file.
+struct RecordRangeIndex
+{
+	RecordRangeIndex() : index(/*empty key=*/DatabaseKey::invalidkey()), max_used_key(0), invalid_len(false) {}
+
+	Database::RecordMap index;
+	std::vector<Database::RecordInfo> stale_records; // Records superseded by a later record for the same key in the range.
+	std::vector<Database::RecordInfo> free_block_records;
+	uint64 max_used_key;
+	bool invalid_len; // Was there a record with len > capacity?
+};
+
+
+// Decodes the headers of the records with offsets record_offsets[begin] to record_offsets[end-1], and adds the records to range_index.
+static void indexRecordRange(const uint8* file_data, const size_t* record_offsets, size_t begin, size_t end, RecordRangeIndex& range_index)
+{
+	for(size_t i=begin; i<end; ++i)
+	{
+		const uint8* header = file_data + record_offsets[i];
+		DatabaseKey key;
+		Database::RecordInfo info;
+		std::memcpy(&key.val,       header + 0,  sizeof(uint64));
+		std::memcpy(&info.len,      header + 8,  sizeof(uint32));
+		std::memcpy(&info.capacity, header + 12, sizeof(uint32));
+		std::memcpy(&info.seq_num,  header + 16, sizeof(uint32));
+		info.offset = record_offsets[i];
+
+		if(key.val == FREE_BLOCK_KEY)
+		{
+			range_index.free_block_records.push_back(info);
+			continue;
+		}
+
+		if(info.isRecordValid() && (info.len > info.capacity))
+			range_index.invalid_len = true;
+
+		addRecordToIndex(range_index.index, key, info, range_index.stale_records);
+
+		range_index.max_used_key = myMax(range_index.max_used_key, key.val);
+	}
+}
+
+
+struct IndexRecordRangesFunc
+{
+	void operator() (size_t begin, size_t end, size_t /*thread_index*/) const
+	{
+		for(size_t r=begin; r<end; ++r)
+		{
+			const size_t range_begin = r * records_per_range;
+			const size_t range_end = myMin(num_records, range_begin + records_per_range);
+			range_indices[r].index.reserve(range_end - range_begin);
+			indexRecordRange(file_data, record_offsets, range_begin, range_end, range_indices[r]);
+		}
+	}
+
+	const uint8* file_data;
+	const size_t* record_offsets;
+	size_t num_records;
+	size_t records_per_range;
+	RecordRangeIndex* range_indices;
+};
+
+
+// Reads the record headers from file_in, building key_to_info_map.
+// If stop_at_torn_record is true, then a record at the end of the file that extends past the end of the file, e.g. due to a crash while it was being appended, is treated as the end of the file.
+// Otherwise an exception is thrown.
+//
+// Loading is done in passes:
+// 1) Touch all pages of the file in parallel (if we have a task manager).
+// 2) Walk the chain of record headers to get the record offsets.  Each header gives the size of the record, so this has to be done sequentially.
+//    It only reads one field per record, from pages that are already resident.
+// 3) Split the records into contiguous ranges, and for each range decode the record headers and build an index of the range, resolving records with the 
+//    same key within the range.  The ranges are done in parallel if we have a task manager.
+// 4) Merge the range indices into key_to_info_map in file order, resolving records with the same key in different ranges.
+//    Since the winner for a key is the first record with the greatest (seq_num, is valid), merging in file order gives the same result as inserting all records in file order.
+// 5) Add superseded and deleted records as free blocks, in order of file offset.
+void Database::readRecordIndex(bool stop_at_torn_record, glare::TaskManager* task_manager)
+{
+	// Read magic number
+	const uint32 magic_num = file_in->readUInt32();
+	if(magic_num != DATABASE_MAGIC_NUMBER)
+		throw glare::Exception("invalid magic number: not a valid database file.");
 		
-		// Read version
-		const uint32 version = file_in->readUInt32();
-		if(version != DATABASE_SERIALISATION_VERSION)
-			throw glare::Exception("invalid version: " + toString(version));
+	// Read version
+	const uint32 version = file_in->readUInt32();
+	if(version != DATABASE_SERIALISATION_VERSION)
+		throw glare::Exception("invalid version: " + toString(version));
+
+	free_blocks.clear();
+	for(int i=0; i<NUM_FREE_BLOCK_SIZE_CLASSES; ++i)
+		free_block_size_classes[i].clear();
+	free_bytes = 0;
+	stale_records.clear();
+
+	const uint8* const file_data = (const uint8*)file_in->fileData();
+	const size_t file_size = file_in->fileSize();
+
+	const size_t page_size = 4096;
+	const size_t num_pages = Maths::roundedUpDivide(file_size, page_size);
+	if(task_manager && (num_pages >= 256))
+	{
+		TouchFilePagesFunc touch_func;
+		touch_func.file_data = file_data;
+		touch_func.page_size = page_size;
+		task_manager->runParallelForDynamic(touch_func, /*begin=*/0, /*end=*/num_pages, /*grain_size=*/64);
+	}
+
+	// Walk the record headers
+	std::vector<size_t> record_offsets;
+	record_offsets.reserve(file_size / 256); // Guess at the number of records from the file size.
 
-		uint64 max_used_key = 0;
-		while(!file_in->endOfStream())
+	size_t offset = file_in->getReadIndex();
+	while(offset < file_size)
+	{
+		if(file_size - offset < RECORD_HEADER_SIZE)
+		{
+			if(stop_at_torn_record)
+				break;
+			throw glare::Exception("Record header went past end of file.");
+		}
+
+		uint32 capacity;
+		std::memcpy(&capacity, file_data + offset + 12, sizeof(uint32));
+
+		if(capacity > file_size - offset - RECORD_HEADER_SIZE)
 		{
-			const size_t record_offset = file_in->getReadIndex();
+			if(stop_at_torn_record)
+				break;
+			throw glare::Exception("Invalid file capacity, went past end of file.");
+		}
+
+		record_offsets.push_back(offset);
+
+		offset = Maths::roundUpToMultipleOfPowerOf2(offset + RECORD_HEADER_SIZE + capacity, (size_t)4); // Skip over data
+	}
+
+	// Build the indices of the record ranges
+	const size_t num_records = record_offsets.size();
+	const size_t records_per_range = 1 << 16;
+	const size_t num_ranges = (task_manager && (num_records >= 2 * records_per_range)) ? Maths::roundedUpDivide(num_records, records_per_range) : 1;
+
+	std::vector<RecordRangeIndex> range_indices(num_ranges);
+
+	IndexRecordRangesFunc index_func;
+	index_func.file_data = file_data;
+	index_func.record_offsets = record_offsets.data();
+	index_func.num_records = num_records;
+	index_func.records_per_range = (num_ranges == 1) ? num_records : records_per_range;
+	index_func.range_indices = range_indices.data();
+	if(num_ranges > 1)
+		task_manager->runParallelForDynamic(index_func, /*begin=*/0, /*end=*/num_ranges, /*grain_size=*/1);
+	else
+		index_func(0, 1, 0);
+
+	// Merge the range indices into key_to_info_map
+	std::vector<RecordInfo> records_to_free;
+	uint64 max_used_key = 0;
+	if(num_ranges == 1 && key_to_info_map.empty())
+	{
+		key_to_info_map.swap(range_indices[0].index); // Avoid copying when there is only one range.
+	}
+	else
+	{
+		size_t total_num_keys = 0;
+		for(size_t r=0; r<num_ranges; ++r)
+			total_num_keys += range_indices[r].index.size();
+		key_to_info_map.reserve(key_to_info_map.size() + total_num_keys);
+
+		for(size_t r=0; r<num_ranges; ++r)
+			for(auto it = range_indices[r].index.begin(); it != range_indices[r].index.end(); ++it)
+				addRecordToIndex(key_to_info_map, it->first, it->second, records_to_free);
+	}
 
-			// Read key
-			DatabaseKey key;
-			key.val = file_in->readUInt64();
+	for(size_t r=0; r<num_ranges; ++r)
+	{
+		const RecordRangeIndex& range_index = range_indices[r];
+		if(range_index.invalid_len)
+			throw glare::Exception("Invalid length, was > capacity.");
 
-			// Read record len
-			const uint32 len      = file_in->readUInt32();
-			const uint32 capacity = file_in->readUInt32();
-			const uint32 seq_num  = file_in->readUInt32();
+		records_to_free.insert(records_to_free.end(), range_index.stale_records.begin(), range_index.stale_records.end());
+		max_used_key = myMax(max_used_key, range_index.max_used_key);
+	}
 
-			if(!file_in->canReadNBytes(capacity))
-				throw glare::Exception("Invalid file capacity, went past end of file.");
+	stale_records = records_to_free;
 
-			// Advance past this record data.
-			const size_t new_unaligned_index = file_in->getReadIndex() + capacity;
-			const size_t new_read_index = Maths::roundUpToMultipleOfPowerOf2(new_unaligned_index, (size_t)4);
-			file_in->setReadIndex(new_read_index); // Skip over data
+	// Remove deleted records from the index, they are now free blocks.
+	std::vector<DatabaseKey> deleted_keys;
+	for(auto it = key_to_info_map.begin(); it != key_to_info_map.end(); ++it)
+	{
+		if(!it->second.isRecordValid())
+		{
+			stale_records.push_back(it->second);
+			records_to_free.push_back(it->second);
+			deleted_keys.push_back(it->first);
+		}
+	}
+	for(size_t i=0; i<deleted_keys.size(); ++i)
+		key_to_info_map.erase(deleted_keys[i]);
 
-			// Add it to the index
-			RecordInfo info;
-			info.offset = record_offset;
-			info.len = len;
-			info.capacity = capacity;
-			info.seq_num = seq_num;
+	for(size_t r=0; r<num_ranges; ++r)
+		records_to_free.insert(records_to_free.end(), range_indices[r].free_block_records.begin(), range_indices[r].free_block_records.end());
 
-			if(len == std::numeric_limits<uint32>::max()) // If an invalid length, this means the record is deleted
+	// Add the free blocks in order of file offset, so that adjacent blocks are merged the same way regardless of how the records were split into ranges.
+	std::sort(records_to_free.begin(), records_to_free.end(), [](const RecordInfo& a, const RecordInfo& b) { return a.offset < b.offset; });
+	for(size_t i=0; i<records_to_free.size(); ++i)
+		addFreeBlock(records_to_free[i].offset, records_to_free[i].capacity);
+
+	file_in->setReadIndex(myMin(offset, file_size));
+	append_offset = offset;
+	next_unused_key = max_used_key + 1;
+}
+
+
+static uint64 computeWALFrameChecksum(const uint8* frame_header, const uint8* data, size_t data_len)
+{
+	const uint64 header_hash = XXH64(frame_header, WAL_FRAME_HEADER_SIZE - sizeof(uint64), /*seed=*/1);
+	return XXH64(data, data_len, /*seed=*/header_hash);
+}
+
+
+// Replay any committed transactions in the WAL onto the database file, then remove the WAL.
+void Database::recoverFromWAL(const std::string& path, glare::TaskManager* task_manager)
+{
+	const std::string wal_path = getWALPath(path);
+	if(!FileUtils::fileExists(wal_path))
+		return;
+
+	std::vector<unsigned char> wal_data;
+	FileUtils::readEntireFile(wal_path, wal_data);
+
+	std::vector<WALOp> committed_ops;
+	if(wal_data.size() >= WAL_HEADER_SIZE)
+	{
+		uint32 magic_num, version;
+		std::memcpy(&magic_num, &wal_data[0], sizeof(uint32));
+		std::memcpy(&version,   &wal_data[4], sizeof(uint32));
+		if(magic_num != WAL_MAGIC_NUMBER)
+			throw glare::Exception("invalid WAL magic number.");
+		if(version != WAL_SERIALISATION_VERSION)
+			throw glare::Exception("invalid WAL version: " + toString(version));
+
+		std::vector<WALOp> txn_ops;
+		uint64 txn_id = 0;
+		size_t i = WAL_HEADER_SIZE;
+		while(wal_data.size() - i >= WAL_FRAME_HEADER_SIZE)
+		{
+			const uint8* frame = &wal_data[i];
+			uint32 frame_type, data_len;
+			uint64 frame_txn_id, key_val, checksum;
+			std::memcpy(&frame_type,   frame + 0,  sizeof(uint32));
+			std::memcpy(&data_len,     frame + 4,  sizeof(uint32));
+			std::memcpy(&frame_txn_id, frame + 8,  sizeof(uint64));
+			std::memcpy(&key_val,      frame + 16, sizeof(uint64));
+			std::memcpy(&checksum,     frame + 24, sizeof(uint64));
+
+			if(data_len > wal_data.size() - i - WAL_FRAME_HEADER_SIZE) // If frame is truncated:
+				break;
+			if(computeWALFrameChecksum(frame, frame + WAL_FRAME_HEADER_SIZE, data_len) != checksum)
+				break;
+			if(!txn_ops.empty() && (frame_txn_id != txn_id)) // Frames of an uncommitted transaction, followed by frames of another transaction.
+				break;
+			txn_id = frame_txn_id;
+
+			if(frame_type == WAL_FRAME_TYPE_UPDATE || frame_type == WAL_FRAME_TYPE_DELETE)
 			{
-				auto res = key_to_info_map.find(key);
-				if(res != key_to_info_map.end())
-				{
-					if(seq_num > res->second.seq_num)
-					{
-						// This record has a greater sequence num, overwrite in index.  Note that the length will be invalid
-						key_to_info_map[key] = info;
-					}
-				}
+				WALOp op;
+				op.key = DatabaseKey(key_val);
+				op.frame_type = frame_type;
+				op.data_len = data_len;
+				op.data_offset = i + WAL_FRAME_HEADER_SIZE;
+				txn_ops.push_back(op);
 			}
-			else
+			else if(frame_type == WAL_FRAME_TYPE_COMMIT)
 			{
-				if(len > capacity)
-					throw glare::Exception("Invalid length, was > capacity.");
-
-				auto res = key_to_info_map.find(key);
-				if(res == key_to_info_map.end()) // If not already present in map:
-				{
-					key_to_info_map.insert(std::make_pair(key, info));
-				}
-				else
-				{
-					if(seq_num > res->second.seq_num)
-					{
-						// This record has a greater sequence num, overwrite in index.
-						key_to_info_map[key] = info;
-					}
-				}
+				if(key_val != (uint64)txn_ops.size())
+					break;
+				committed_ops.insert(committed_ops.end(), txn_ops.begin(), txn_ops.end());
+				txn_ops.clear();
 			}
+			else
+				break;
 
-			max_used_key = myMax(max_used_key, key.val);
+			i += WAL_FRAME_HEADER_SIZE + data_len;
 		}
-
-		append_offset = file_in->getReadIndex();
-		next_unused_key = max_used_key + 1;
 	}
-	catch(glare::Exception& e)
+
+	if(!committed_ops.empty())
 	{
-		throw glare::Exception("Error while reading database from '" + path + "': " + e.what());
+		// Build the index for the database file.  A crash may have left a partially appended record at the end of the file, which we will remove.
+		file_in = new FileInStream(path);
+		readRecordIndex(/*stop_at_torn_record=*/true, task_manager);
+		const size_t valid_file_size = append_offset;
+		const size_t file_size = file_in->fileSize();
+		finishReadingFromDisk();
+
+		if(valid_file_size < file_size)
+			truncateDatabaseFile(valid_file_size);
+
+		for(size_t z=0; z<committed_ops.size(); ++z)
+		{
+			const WALOp& op = committed_ops[z];
+			if(op.frame_type == WAL_FRAME_TYPE_UPDATE)
+				writeRecordUpdate(op.key, ArrayRef<uint8>(wal_data.data() + op.data_offset, op.data_len));
+			else
+				writeRecordDeletion(op.key);
+		}
+
+		syncDatabaseFile();
+
+		key_to_info_map.clear();
 	}
+
+	FileUtils::deleteFile(wal_path);
 }
 
 
@@ -256,46 +634,203 @@ DatabaseKey Database::allocUnusedKey()
 }
 
 
-void Database::allocRecordSpace(uint32 data_size, size_t& offset_out, uint32& capacity_out)
+void Database::addFreeBlock(size_t offset, uint32 capacity)
 {
-	//TEMP: just alloc at end of DB for now.
-	offset_out = this->append_offset;
+	size_t block_offset = offset;
+	size_t block_end = offset + recordSize(capacity);
+
+	// Merge with the following free block, if adjacent
+	auto next = free_blocks.find(block_end);
+	if(next != free_blocks.end())
+	{
+		const size_t next_end = next->first + recordSize(next->second);
+		if(next_end - block_offset - RECORD_HEADER_SIZE <= MAX_MERGED_FREE_BLOCK_CAPACITY)
+		{
+			removeFreeBlock(next->first);
+			block_end = next_end;
+		}
+	}
+
+	// Merge with the preceding free block, if adjacent
+	auto prev = free_blocks.lower_bound(block_offset);
+	if(prev != free_blocks.begin())
+	{
+		--prev;
+		if((prev->first + recordSize(prev->second) == block_offset) && (block_end - prev->first - RECORD_HEADER_SIZE <= MAX_MERGED_FREE_BLOCK_CAPACITY))
+		{
+			block_offset = prev->first;
+			removeFreeBlock(prev->first);
+		}
+	}
+
+	const uint32 block_capacity = (uint32)(block_end - block_offset - RECORD_HEADER_SIZE);
+	free_blocks[block_offset] = block_capacity;
+	free_block_size_classes[sizeClassForCapacity(block_capacity)].insert(block_offset);
+	free_bytes += block_end - block_offset;
+}
+
+
+void Database::removeFreeBlock(size_t offset)
+{
+	auto res = free_blocks.find(offset);
+	assert(res != free_blocks.end());
+
+	free_block_size_classes[sizeClassForCapacity(res->second)].erase(offset);
+	free_bytes -= recordSize(res->second);
+	free_blocks.erase(res);
+}
+
+
+// Finds a free block with at least the given capacity, that starts before max_offset.
+// Splits off the remainder of the block into a new free block if it is large enough.
+bool Database::allocFromFreeList(uint32 capacity, size_t max_offset, size_t& offset_out, uint32& capacity_out)
+{
+	for(int c = sizeClassForCapacity(capacity); c < NUM_FREE_BLOCK_SIZE_CLASSES; ++c)
+	{
+		// Take the lowest offset block in the size class that is large enough.  Blocks in the lowest class we look at may be too small,
+		// so limit the number we check.
+		const std::set<size_t>& size_class = free_block_size_classes[c];
+		int num_checked = 0;
+		for(auto it = size_class.begin(); (it != size_class.end()) && (*it < max_offset) && (num_checked < 16); ++it, ++num_checked)
+		{
+			const size_t block_offset = *it;
+			const uint32 block_capacity = free_blocks[block_offset];
+			if(block_capacity >= capacity)
+			{
+				removeFreeBlock(block_offset);
+
+				const size_t block_end = block_offset + recordSize(block_capacity);
+				const size_t remainder_offset = block_offset + recordSize(capacity);
+				if(block_end - remainder_offset >= RECORD_HEADER_SIZE + MIN_SPLIT_FREE_BLOCK_CAPACITY)
+				{
+					// Write the header of the remainder block before the caller writes the record header, so that the file stays parseable.
+					const uint32 remainder_capacity = (uint32)(block_end - remainder_offset - RECORD_HEADER_SIZE);
+					writeFreeBlockHeader(remainder_offset, remainder_capacity);
+					addFreeBlock(remainder_offset, remainder_capacity);
+
+					capacity_out = capacity;
+				}
+				else
+					capacity_out = block_capacity;
+
+				offset_out = block_offset;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+// Removes free blocks at the end of the file from the free block index, and moves append_offset back.  The caller is responsible for truncating the file.
+void Database::trimFreeBlocksAtEnd()
+{
+	while(!free_blocks.empty())
+	{
+		auto last = std::prev(free_blocks.end());
+		if(last->first + recordSize(last->second) != append_offset)
+			break;
 
+		append_offset = last->first;
+		removeFreeBlock(last->first);
+	}
+}
+
+
+void Database::allocRecordSpace(uint32 data_size, size_t& offset_out, uint32& capacity_out)
+{
 	const uint32 capacity = Maths::roundUpToMultipleOfPowerOf2(data_size + 64, (uint32)4);
+
+	if(allocFromFreeList(capacity, /*max_offset=*/std::numeric_limits<size_t>::max(), offset_out, capacity_out))
+		return;
+
+	// Else no suitable free block, append at end of DB.
+	offset_out = this->append_offset;
 	capacity_out = capacity;
 
-	const size_t record_size = sizeof(uint64) + sizeof(uint32) * 3 + capacity; // Record size including header.
+	this->append_offset = this->append_offset + recordSize(capacity);
+}
+
+
+void Database::openOutFileIfNeeded()
+{
+	if(file_out == NULL)
+	{
+		file_out = new FileOutStream(db_path, std::ios::binary | std::ios::in | std::ios::out); // Although we are not actually doing reads, std::ios::in seems to be necessary or we end up with zeros in the file after updating.
 
-	this->append_offset = this->append_offset + record_size;
+		if(!stale_records.empty())
+			convertStaleRecordsToFreeBlocks();
+	}
 }
 
-//
-//void Database::writeDataToNewRecord(RecordInfo& info, const DatabaseKey& key, ArrayRef<uint8> data)
-//{
-//	size_t new_record_offset;
-//	uint32 new_record_capacity;
-//	allocRecordSpace((uint32)data.size(), new_record_offset, new_record_capacity);
-//
-//	info.offset = new_record_offset;
-//	info.len = (uint32)data.size();
-//	info.capacity = new_record_capacity;
-//	info.seq_num++;
-//
-//	temp_buf.resizeNoCopy(sizeof(uint64) + sizeof(uint32) * 3 + new_record_capacity); // Resize temp_buf to make room for record header and capacity
-//
-//	std::memcpy(&temp_buf[0], &key.val, sizeof(uint64));
-//	std::memcpy(&temp_buf[8], &info.len, sizeof(uint32)); // len
-//	std::memcpy(&temp_buf[12], &info.capacity, sizeof(uint32)); // capacity
-//	std::memcpy(&temp_buf[16], &info.seq_num, sizeof(uint32)); // seq_num
-//
-//	std::memcpy(&temp_buf[20], data.data(), data.size());
-//	std::memset(&temp_buf[20] + data.size(), 0, new_record_capacity - data.size()); // Zero out unused part of buffer.
-//
-//	// Update the record in the DB file
-//	FileOutStream file(db_path, std::ios::binary | std::ios::in | std::ios::out);
-//	file.seek(new_record_offset); // Skip past key, len, capacity, seq_num
-//	file.writeData(temp_buf.data(), temp_buf.size());
-//}
+
+void Database::convertStaleRecordsToFreeBlocks()
+{
+	std::vector<RecordInfo> records;
+	records.swap(stale_records);
+
+	// Mark superseded records that still have a valid length first.  Deleted records may be hiding older versions of the same key, 
+	// so make sure the superseded records are marked on disk before we mark any deleted records.
+	bool marked_valid_record = false;
+	for(size_t i=0; i<records.size(); ++i)
+		if(records[i].isRecordValid())
+		{
+			writeFreeBlockHeader(records[i].offset, records[i].capacity);
+			marked_valid_record = true;
+		}
+
+	if(marked_valid_record)
+	{
+		syncDatabaseFile();
+		openOutFileIfNeeded();
+	}
+
+	for(size_t i=0; i<records.size(); ++i)
+		if(!records[i].isRecordValid())
+			writeFreeBlockHeader(records[i].offset, records[i].capacity);
+}
+
+
+void Database::writeRecord(size_t offset, const DatabaseKey& key, const RecordInfo& info, ArrayRef<uint8> data)
+{
+	temp_buf.resizeNoCopy(RECORD_HEADER_SIZE + info.capacity); // Resize temp_buf to make room for record header and capacity
+
+	std::memcpy(&temp_buf[0], &key.val, sizeof(uint64));
+	std::memcpy(&temp_buf[8], &info.len, sizeof(uint32)); // len
+	std::memcpy(&temp_buf[12], &info.capacity, sizeof(uint32)); // capacity
+	std::memcpy(&temp_buf[16], &info.seq_num, sizeof(uint32)); // seq_num
+
+	if(data.size() > 0)
+		std::memcpy(&temp_buf[20], data.data(), data.size());
+	std::memset(&temp_buf[20] + data.size(), 0, info.capacity - data.size()); // Zero out unused part of buffer.
+
+	// Update the record in the DB file
+	file_out->seek(offset);
+	file_out->writeData(temp_buf.data(), temp_buf.size());
+}
+
+
+void Database::writeFreeBlockHeader(size_t offset, uint32 capacity)
+{
+	const uint32 invalid_len = std::numeric_limits<uint32>::max();
+	const uint32 seq_num = 0;
+
+	uint8 header[RECORD_HEADER_SIZE];
+	std::memcpy(&header[0], &FREE_BLOCK_KEY, sizeof(uint64));
+	std::memcpy(&header[8], &invalid_len, sizeof(uint32)); // len
+	std::memcpy(&header[12], &capacity, sizeof(uint32)); // capacity
+	std::memcpy(&header[16], &seq_num, sizeof(uint32)); // seq_num
+
+	file_out->seek(offset);
+	file_out->writeData(header, RECORD_HEADER_SIZE);
+}
+
+
+void Database::freeRecordSpace(size_t offset, uint32 capacity)
+{
+	writeFreeBlockHeader(offset, capacity);
+	addFreeBlock(offset, capacity);
+}
 
 
 void Database::updateRecord(const DatabaseKey& key, ArrayRef<uint8> data)
@@ -303,8 +838,24 @@ void Database::updateRecord(const DatabaseKey& key, ArrayRef<uint8> data)
 	if(data.size() >= (size_t)std::numeric_limits<uint32>::max() - 1) // Data size must be 32-bit, and also != std::numeric_limits<uint32>::max(), which we use as a sentinel value.
 		throw glare::Exception("data too large.");
 
-	if(file_out == NULL)
-		file_out = new FileOutStream(db_path, std::ios::binary | std::ios::in | std::ios::out); // Although we are not actually doing reads, std::ios::in seems to be necessary or we end up with zeros in the file after updating.
+	if(in_transaction)
+	{
+		appendWALFrame(WAL_FRAME_TYPE_UPDATE, key, data);
+		return;
+	}
+
+	// If the WAL holds committed transactions that have not been made durable in the database file, then checkpoint first, 
+	// otherwise this write could be overwritten by an older value if the WAL is replayed after a crash.
+	if(wal_size > WAL_HEADER_SIZE)
+		checkpoint();
+
+	writeRecordUpdate(key, data);
+}
+
+
+void Database::writeRecordUpdate(const DatabaseKey& key, ArrayRef<uint8> data)
+{
+	openOutFileIfNeeded();
 
 	auto res = key_to_info_map.find(key);
 	if(res != key_to_info_map.end())
@@ -341,26 +892,19 @@ void Database::updateRecord(const DatabaseKey& key, ArrayRef<uint8> data)
 			size_t new_record_offset;
 			uint32 new_record_capacity;
 			allocRecordSpace((uint32)data.size(), new_record_offset, new_record_capacity);
+
+			const size_t old_record_offset = info.offset;
+			const uint32 old_record_capacity = info.capacity;
 			
 			info.offset = new_record_offset;
 			info.len = (uint32)data.size();
 			info.capacity = new_record_capacity;
 			info.seq_num++;
 
-			temp_buf.resizeNoCopy(sizeof(uint64) + sizeof(uint32) * 3 + new_record_capacity); // Resize temp_buf to make room for record header and capacity
+			writeRecord(new_record_offset, key, info, data);
 
-			std::memcpy(&temp_buf[0], &key.val, sizeof(uint64));
-			std::memcpy(&temp_buf[8], &info.len, sizeof(uint32)); // len
-			std::memcpy(&temp_buf[12], &info.capacity, sizeof(uint32)); // capacity
-			std::memcpy(&temp_buf[16], &info.seq_num, sizeof(uint32)); // seq_num
-
-			if(data.size() > 0)
-				std::memcpy(&temp_buf[20], data.data(), data.size());
-			std::memset(&temp_buf[20] + data.size(), 0, new_record_capacity - data.size()); // Zero out unused part of buffer.
-
-			// Update the record in the DB file
-			file_out->seek(new_record_offset);
-			file_out->writeData(temp_buf.data(), temp_buf.size());
+			// Now that the new record is written, mark the old record as free.
+			freeRecordSpace(old_record_offset, old_record_capacity);
 		}
 	}
 	else
@@ -378,61 +922,207 @@ void Database::updateRecord(const DatabaseKey& key, ArrayRef<uint8> data)
 		info.seq_num = 0;
 		key_to_info_map.insert(std::make_pair(key, info));
 
-		temp_buf.resizeNoCopy(sizeof(uint64) + sizeof(uint32) * 3 + new_record_capacity); // Resize temp_buf to make room for record header and capacity
-		std::memcpy(&temp_buf[0], &key.val, sizeof(uint64));
-		std::memcpy(&temp_buf[8], &info.len, sizeof(uint32)); // len
-		std::memcpy(&temp_buf[12], &info.capacity, sizeof(uint32)); // capacity
-		std::memcpy(&temp_buf[16], &info.seq_num, sizeof(uint32)); // seq_num
+		writeRecord(new_record_offset, key, info, data);
+	}
+}
 
-		if(data.size() > 0)
-			std::memcpy(&temp_buf[20], data.data(), data.size());
-		std::memset(&temp_buf[20] + data.size(), 0, new_record_capacity - data.size()); // Zero out unused part of buffer.
 
-		// Update the record in the DB file
-		file_out->seek(new_record_offset);
-		file_out->writeData(temp_buf.data(), temp_buf.size());
+void Database::deleteRecord(const DatabaseKey& key)
+{
+	if(in_transaction)
+	{
+		appendWALFrame(WAL_FRAME_TYPE_DELETE, key, ArrayRef<uint8>(NULL, 0));
+		return;
 	}
+
+	if(wal_size > WAL_HEADER_SIZE)
+		checkpoint();
+
+	writeRecordDeletion(key);
 }
 
 
-void Database::deleteRecord(const DatabaseKey& key)
+void Database::writeRecordDeletion(const DatabaseKey& key)
 {
-	if(file_out == NULL)
-		file_out = new FileOutStream(db_path, std::ios::binary | std::ios::in | std::ios::out);
+	openOutFileIfNeeded();
 
 	auto res = key_to_info_map.find(key);
 
 	if(res != key_to_info_map.end())
 	{
-		RecordInfo& info = res->second;
+		// Mark the record as a free block on disk.  All older records for this key have already been marked as free, 
+		// so nothing with this key remains in the file.
+		freeRecordSpace(res->second.offset, res->second.capacity);
 
-		// Update the record header on disk with an invalid length field, to mark the record as deleted.
-		// We will leave the capacity field as it was, so the record can be skipped over.
+		key_to_info_map.erase(key);
+	}
+}
 
-		const uint32 invalid_len = std::numeric_limits<uint32>::max();
 
-		temp_buf.resizeNoCopy(sizeof(uint64) + sizeof(uint32) * 3);
-		std::memcpy(&temp_buf[0], &key.val, sizeof(uint64));
-		std::memcpy(&temp_buf[8], &invalid_len, sizeof(uint32)); // len
-		std::memcpy(&temp_buf[12], &info.capacity, sizeof(uint32)); // capacity
-		std::memcpy(&temp_buf[16], &info.seq_num, sizeof(uint32)); // seq_num
+void Database::appendWALFrame(uint32 frame_type, const DatabaseKey& key, ArrayRef<uint8> data)
+{
+	const size_t frame_offset = wal_buf.size();
+	wal_buf.resize(frame_offset + WAL_FRAME_HEADER_SIZE + data.size());
+
+	uint8* frame = &wal_buf[frame_offset];
+	const uint32 data_len = (uint32)data.size();
+	std::memcpy(frame + 0,  &frame_type,  sizeof(uint32));
+	std::memcpy(frame + 4,  &data_len,    sizeof(uint32));
+	std::memcpy(frame + 8,  &next_txn_id, sizeof(uint64));
+	std::memcpy(frame + 16, &key.val,     sizeof(uint64));
+	if(data.size() > 0)
+		std::memcpy(frame + WAL_FRAME_HEADER_SIZE, data.data(), data.size());
+
+	const uint64 checksum = computeWALFrameChecksum(frame, frame + WAL_FRAME_HEADER_SIZE, data.size());
+	std::memcpy(frame + 24, &checksum, sizeof(uint64));
+
+	if(frame_type != WAL_FRAME_TYPE_COMMIT)
+	{
+		WALOp op;
+		op.key = key;
+		op.frame_type = frame_type;
+		op.data_len = data_len;
+		op.data_offset = frame_offset + WAL_FRAME_HEADER_SIZE;
+		pending_ops.push_back(op);
+	}
+}
 
-		// Update the record in the DB file
-		file_out->seek(info.offset);
-		file_out->writeData(temp_buf.data(), temp_buf.size());
 
-		// If seq_num > 0, We need to keep in key_to_info_map, so that we have the seq number for the key handy.
-		// That way if an item with the same key gets re-added, the record with the new item will have a sufficiently high seq num.
-		if(info.seq_num == 0)
-		{
-			// If the seq num is zero, then we know there are no other records using this key in the file.  So we can remove this info from the key_to_info_map.
-			key_to_info_map.erase(res);
-		}
+void Database::beginTransaction()
+{
+	if(in_transaction)
+		throw glare::Exception("beginTransaction(): already in a transaction.");
+
+	in_transaction = true;
+	pending_ops.clear();
+	wal_buf.clear();
+}
+
+
+void Database::abortTransaction()
+{
+	in_transaction = false;
+	pending_ops.clear();
+	wal_buf.clear();
+}
+
+
+void Database::commitTransaction()
+{
+	if(!in_transaction)
+		throw glare::Exception("commitTransaction(): not in a transaction.");
+
+	in_transaction = false;
+
+	if(pending_ops.empty())
+	{
+		wal_buf.clear();
+		return;
+	}
+
+	appendWALFrame(WAL_FRAME_TYPE_COMMIT, DatabaseKey(pending_ops.size()), ArrayRef<uint8>(NULL, 0));
+	next_txn_id++;
+
+	try
+	{
+		if(wal_file == NULL)
+			resetWAL();
+
+		// Write all frames of the transaction with a single write and a single fsync.  The transaction is durable once this returns.
+		if(fwrite(wal_buf.data(), 1, wal_buf.size(), wal_file->getFile()) != wal_buf.size())
+			throw glare::Exception("Write to WAL failed.");
+		wal_file->flushToDisk();
+		wal_size += wal_buf.size();
+	}
+	catch(glare::Exception& e)
+	{
+		// The WAL may now end with a partial frame, which would stop recovery from reading any frames after it, so we will start a new WAL for the next transaction.
+		delete wal_file;
+		wal_file = NULL;
+		pending_ops.clear();
+		wal_buf.clear();
+		throw glare::Exception("commitTransaction(): " + e.what());
+	}
+
+	// Apply the transaction to the database file.  If this fails, the transaction will be replayed from the WAL on the next open.
+	for(size_t i=0; i<pending_ops.size(); ++i)
+	{
+		const WALOp& op = pending_ops[i];
+		if(op.frame_type == WAL_FRAME_TYPE_UPDATE)
+			writeRecordUpdate(op.key, ArrayRef<uint8>(wal_buf.data() + op.data_offset, op.data_len));
 		else
-		{
-			info.len = invalid_len;
-		}
+			writeRecordDeletion(op.key);
 	}
+
+	pending_ops.clear();
+	wal_buf.clear();
+
+	if(wal_size >= wal_checkpoint_threshold)
+		checkpoint();
+}
+
+
+// Makes the database file durable, then truncates the WAL.
+void Database::checkpoint()
+{
+	if(wal_size > WAL_HEADER_SIZE)
+		resetWAL();
+}
+
+
+// Starts a new, empty WAL.  If the existing WAL has committed transactions, the database file is synced to disk first.
+void Database::resetWAL()
+{
+	if(wal_size > WAL_HEADER_SIZE)
+		syncDatabaseFile();
+
+	delete wal_file;
+	wal_file = NULL;
+	wal_size = 0;
+
+	wal_file = new FileHandle(getWALPath(db_path), "wb");
+
+	const uint32 header[2] = { WAL_MAGIC_NUMBER, WAL_SERIALISATION_VERSION };
+	if(fwrite(header, 1, sizeof(header), wal_file->getFile()) != sizeof(header))
+		throw glare::Exception("Write to WAL failed.");
+	if(fflush(wal_file->getFile()) != 0)
+		throw glare::Exception("Write to WAL failed.");
+	wal_size = WAL_HEADER_SIZE;
+}
+
+
+void Database::closeOutFile()
+{
+	if(file_out)
+	{
+		FileOutStream* file = file_out;
+		file_out = NULL;
+		file->close(); // Checks for errors
+		delete file;
+	}
+}
+
+
+void Database::syncDatabaseFile()
+{
+	// std::ofstream doesn't give us a way to fsync, so close it, and sync via another handle to the same file.  
+	// (Closing also means we don't have two handles open on the file at once, which Windows may not allow)
+	// file_out will be reopened on the next write.
+	closeOutFile();
+
+	FileHandle file(db_path, "rb+");
+	file.flushToDisk();
+}
+
+
+void Database::truncateDatabaseFile(size_t new_size)
+{
+	closeOutFile();
+
+	FileHandle file(db_path, "rb+");
+	file.flushToDisk(); // Make sure records written before the truncation are on disk before the space they were moved from is removed.
+	file.truncate(new_size);
+	file.flushToDisk();
 }
 
 
@@ -440,6 +1130,101 @@ void Database::flush()
 {
 	if(file_out)
 		file_out->flush();
+
+	checkpoint();
+}
+
+
+bool Database::compactIncrementally(size_t max_bytes_to_move)
+{
+	if(wal_size > WAL_HEADER_SIZE)
+		checkpoint();
+
+	openOutFileIfNeeded(); // Makes sure any stale records are marked as free on disk.
+
+	const size_t initial_file_size = append_offset;
+
+	trimFreeBlocksAtEnd();
+
+	// Get the live records nearest the end of the file, in descending offset order.
+	compaction_candidates.clear();
+	for(auto it = key_to_info_map.begin(); it != key_to_info_map.end(); ++it)
+		compaction_candidates.push_back(std::make_pair((size_t)it->second.offset, it->first));
+
+	const size_t max_num_candidates = myMin(compaction_candidates.size(), (size_t)256);
+	std::partial_sort(compaction_candidates.begin(), compaction_candidates.begin() + max_num_candidates, compaction_candidates.end(), 
+		[](const std::pair<size_t, DatabaseKey>& a, const std::pair<size_t, DatabaseKey>& b) { return a.first > b.first; });
+
+	// Choose the records to move, up to max_bytes_to_move of data, and read their data.
+	// We read all the data before writing, since we can't have the file open for writing while it is memory-mapped on Windows.
+	size_t num_candidates = 0;
+	size_t total_len = 0;
+	while((num_candidates < max_num_candidates) && (total_len < max_bytes_to_move) && !free_blocks.empty())
+		total_len += key_to_info_map[compaction_candidates[num_candidates++].second].len;
+
+	if(num_candidates > 0)
+	{
+		closeOutFile();
+
+		compaction_buf.resizeNoCopy(total_len);
+		{
+			MemMappedFile file(db_path);
+			size_t buf_offset = 0;
+			for(size_t i=0; i<num_candidates; ++i)
+			{
+				const RecordInfo& info = key_to_info_map[compaction_candidates[i].second];
+				if(info.offset + RECORD_HEADER_SIZE + info.len > file.fileSize())
+					throw glare::Exception("compactIncrementally(): record extends past end of file.");
+				if(info.len > 0)
+					std::memcpy(&compaction_buf[buf_offset], (const uint8*)file.fileData() + info.offset + RECORD_HEADER_SIZE, info.len);
+				buf_offset += info.len;
+			}
+		}
+
+		openOutFileIfNeeded();
+	}
+
+	// Move the records to free blocks before them in the file, starting with the last record.
+	bool more_work = !free_blocks.empty();
+	size_t buf_offset = 0;
+	for(size_t i=0; i<num_candidates; ++i)
+	{
+		const DatabaseKey key = compaction_candidates[i].second;
+		RecordInfo& info = key_to_info_map[key];
+		const ArrayRef<uint8> data(compaction_buf.data() + buf_offset, info.len);
+		buf_offset += info.len;
+
+		trimFreeBlocksAtEnd();
+		if(info.offset + recordSize(info.capacity) != append_offset) // If the record is not at the end of the file:
+			break;
+
+		const uint32 capacity = Maths::roundUpToMultipleOfPowerOf2(info.len + 64, (uint32)4);
+		size_t new_record_offset;
+		uint32 new_record_capacity;
+		if(!allocFromFreeList(capacity, /*max_offset=*/info.offset, new_record_offset, new_record_capacity))
+		{
+			more_work = false; // No free block before the record is big enough, so we can't compact any further.
+			break;
+		}
+
+		const size_t old_record_offset = info.offset;
+		const uint32 old_record_capacity = info.capacity;
+
+		info.offset = new_record_offset;
+		info.capacity = new_record_capacity;
+		info.seq_num++;
+
+		writeRecord(new_record_offset, key, info, data);
+
+		freeRecordSpace(old_record_offset, old_record_capacity);
+	}
+
+	trimFreeBlocksAtEnd();
+
+	if(append_offset < initial_file_size)
+		truncateDatabaseFile(append_offset);
+
+	return more_work && !free_blocks.empty();
 }
 
 
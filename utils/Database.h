@@ -12,10 +12,15 @@ Copyright Glare Technologies Limited 2021 -
 #include "Hasher.h"
 #include "Vector.h"
 #include "FileInStream.h"
+#include "HashMap.h"
 #include <string>
-#include <unordered_map>
+#include <vector>
+#include <map>
+#include <set>
 class FileInStream;
 class FileOutStream;
+class FileHandle;
+namespace glare { class TaskManager; }
 
 
 // Hash function for DatabaseKey
@@ -49,6 +54,36 @@ for(auto it = database.getRecordMap().begin(); it != database.getRecordMap().end
 database.finishReadingFromDisk();
 
 
+Transactions
+------------
+Updates and deletes can be batched into a transaction:
+
+database.beginTransaction();
+database.updateRecord(key_a, data_a);
+database.deleteRecord(key_b);
+database.commitTransaction();
+
+The operations in a transaction are not written to the database file until commitTransaction().
+commitTransaction() first appends them to a write-ahead log (WAL) file at getWALPath(path), as checksummed frames
+followed by a commit frame, with a single fsync for the whole batch.  Only then are they applied to the database file.
+The database file is fsynced, and the WAL truncated, at checkpoints, which happen when the WAL grows past the checkpoint
+threshold, on flush(), and when the database is closed.
+
+On startReadingFromDisk(), any committed transactions in the WAL are replayed onto the database file.
+Frames of a transaction that did not get its commit frame written, or frames with bad checksums, are discarded.
+
+Updates and deletes made outside of a transaction are written directly to the database file as before.
+
+
+Free space and compaction
+-------------------------
+Deleted records, and old locations of records that have moved, become free blocks, which are reused for new records.
+Free blocks are indexed by size class, and the index is rebuilt when the database is loaded.
+
+compactIncrementally() moves live records from the end of the file into free blocks earlier in the file, then truncates the file.
+It does a bounded amount of work per call, and the database can be updated between calls, so it can be called periodically,
+e.g. once per server main loop iteration, from the thread that owns the database.
+
 
 Tests are in DatabaseTests.
 =====================================================================*/
@@ -60,9 +95,13 @@ public:
 
 	static void makeOrClearDatabase(const std::string& path);
 
+	static const std::string getWALPath(const std::string& db_path) { return db_path + ".wal"; }
+
 	void openAndMakeOrClearDatabase(const std::string& path);
 
-	void startReadingFromDisk(const std::string& path);
+	// Replays any committed transactions from the WAL first.
+	// If task_manager is non-null, it is used to read the file, and to decode record headers and build the record index for ranges of records, in parallel.
+	void startReadingFromDisk(const std::string& path, glare::TaskManager* task_manager = NULL);
 
 	void removeOldRecordsOnDisk(const std::string& path); // Removes deleted records, removes old records.  Database can't have had any updates made to it since opening. (so that file_out is NULL)
 
@@ -78,11 +117,28 @@ public:
 
 	DatabaseKey allocUnusedKey();
 
+	// If in a transaction, the update or delete is buffered until commitTransaction(), and is not reflected in getRecordMap() until then.
 	void updateRecord(const DatabaseKey& key, ArrayRef<uint8> data);
 
 	void deleteRecord(const DatabaseKey& key);
 
-	void flush();
+	void beginTransaction(); // Throws glare::Exception if already in a transaction.
+	void commitTransaction(); // Makes the transaction durable in the WAL, then applies it to the database file.  Throws glare::Exception on failure.
+	void abortTransaction(); // Discards the buffered operations of the current transaction.
+	bool isInTransaction() const { return in_transaction; }
+
+	void setWALCheckpointThreshold(size_t num_bytes) { wal_checkpoint_threshold = num_bytes; }
+
+	void checkpoint(); // Makes the database file durable and truncates the WAL.
+
+	void flush(); // Flushes the database file, and does a checkpoint if there are committed transactions in the WAL.
+
+	// Moves up to roughly max_bytes_to_move bytes of records from the end of the file into free blocks, and truncates the file.
+	// Returns true if calling again may make more progress.
+	bool compactIncrementally(size_t max_bytes_to_move);
+
+	size_t getFileSize() const { return append_offset; } // Size of the database file in bytes.
+	size_t getFreeSpaceSize() const { return free_bytes; } // Total size of free blocks in the database file in bytes, including block headers.
 
 	size_t numRecords() const; // Get number of valid records. NOTE: linear time on number of records.
 
@@ -96,12 +152,35 @@ public:
 		bool isRecordValid() const { return len != std::numeric_limits<uint32>::max(); }
 	};
 
-	const std::unordered_map<DatabaseKey, RecordInfo, DatabaseKeyHash>& getRecordMap() const { return key_to_info_map; }
+	typedef HashMap<DatabaseKey, RecordInfo, DatabaseKeyHash> RecordMap;
+
+	const RecordMap& getRecordMap() const { return key_to_info_map; }
 
 private:
+	void readRecordIndex(bool stop_at_torn_record, glare::TaskManager* task_manager);
+	void recoverFromWAL(const std::string& path, glare::TaskManager* task_manager);
+	void openOutFileIfNeeded();
+	void writeRecordUpdate(const DatabaseKey& key, ArrayRef<uint8> data);
+	void writeRecordDeletion(const DatabaseKey& key);
+	void appendWALFrame(uint32 frame_type, const DatabaseKey& key, ArrayRef<uint8> data);
+	void resetWAL();
+	void closeOutFile();
+	void syncDatabaseFile();
+	void truncateDatabaseFile(size_t new_size);
+
+	void writeRecord(size_t offset, const DatabaseKey& key, const RecordInfo& info, ArrayRef<uint8> data);
+	void writeFreeBlockHeader(size_t offset, uint32 capacity);
+	void freeRecordSpace(size_t offset, uint32 capacity);
+	void convertStaleRecordsToFreeBlocks();
+
+	void addFreeBlock(size_t offset, uint32 capacity);
+	void removeFreeBlock(size_t offset);
+	bool allocFromFreeList(uint32 capacity, size_t max_offset, size_t& offset_out, uint32& capacity_out);
+	void trimFreeBlocksAtEnd();
+
 	void allocRecordSpace(uint32 data_size, size_t& offset_out, uint32& capacity_out);
 
-	std::unordered_map<DatabaseKey, RecordInfo, DatabaseKeyHash> key_to_info_map;
+	RecordMap key_to_info_map; // Only contains valid (non-deleted) records, once loading has finished.
 
 	std::string db_path;
 
@@ -113,4 +192,31 @@ private:
 	size_t append_offset;
 
 	uint64 next_unused_key;
+
+	struct WALOp
+	{
+		DatabaseKey key;
+		uint32 frame_type;
+		uint32 data_len;
+		size_t data_offset; // Offset of the op data in the buffer holding the WAL frames.
+	};
+
+	bool in_transaction;
+	std::vector<WALOp> pending_ops; // Operations in the current transaction.
+	js::Vector<uint8, 16> wal_buf; // WAL frames for the current transaction.
+	uint64 next_txn_id;
+
+	FileHandle* wal_file;
+	size_t wal_size; // Size of the WAL file in bytes, or 0 if we have not opened it.
+	size_t wal_checkpoint_threshold;
+
+	static const int NUM_FREE_BLOCK_SIZE_CLASSES = 32;
+	std::map<size_t, uint32> free_blocks; // Map from offset of free block to capacity of free block.
+	std::set<size_t> free_block_size_classes[NUM_FREE_BLOCK_SIZE_CLASSES]; // Offsets of free blocks, bucketed by floor(log2(capacity)).
+	size_t free_bytes;
+
+	std::vector<RecordInfo> stale_records; // Superseded or deleted records found when loading, that need to be marked as free on disk before we write to the file.
+
+	std::vector<std::pair<size_t, DatabaseKey> > compaction_candidates;
+	js::Vector<uint8, 16> compaction_buf;
 };
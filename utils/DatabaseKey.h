@@ -17,6 +17,7 @@ struct DatabaseKey
 
 	bool operator < (const DatabaseKey& other) const { return val < other.val; }
 	bool operator == (const DatabaseKey& other) const { return val == other.val; }
+	bool operator != (const DatabaseKey& other) const { return val != other.val; }
 
 	uint64 value() const { return val; }
 
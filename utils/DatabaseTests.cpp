@@ -16,6 +16,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "ConPrint.h"
 #include "PlatformUtils.h"
 #include "Timer.h"
+#include "TaskManager.h"
 #include "../maths/PCG32.h"
 #include <map>
 
@@ -83,7 +84,12 @@ static void doRandomTests(uint64 seed)
 				}
 			}
 		}
-		else// if(ur < 0.7)
+		else if(ur < 0.93)
+		{
+			// Do some compaction
+			db->compactIncrementally(/*max_bytes_to_move=*/rng.nextUInt(10000));
+		}
+		else
 		{
 			// conPrint("reopening DB, cur size: " + toString(ref_map.size()));
 
@@ -119,6 +125,557 @@ static void doRandomTests(uint64 seed)
 }
 
 
+static void checkRecordData(const Database& db, const DatabaseKey& key, const std::vector<uint8>& ref_data)
+{
+	auto res = db.getRecordMap().find(key);
+	testAssert(res != db.getRecordMap().end());
+	testAssert(res->second.isRecordValid());
+	testAssert(res->second.len == ref_data.size());
+	const uint8* data = db.getInitialRecordData(res->second);
+	for(size_t z=0; z<ref_data.size(); ++z)
+		testAssert(data[z] == ref_data[z]);
+}
+
+
+static void testTransactions()
+{
+	const std::string db_path = "./test.db";
+	const std::string wal_path = Database::getWALPath(db_path);
+
+	const std::vector<uint8> data_a(10, 1);
+	const std::vector<uint8> data_b(300, 2);
+	const std::vector<uint8> data_c(5, 3);
+
+	// Test committing a transaction
+	{
+		{
+			Database db;
+			db.openAndMakeOrClearDatabase(db_path);
+
+			db.updateRecord(DatabaseKey(1), data_a); // Non-transactional update
+
+			db.beginTransaction();
+			testAssert(db.isInTransaction());
+			db.updateRecord(DatabaseKey(2), data_a);
+			db.updateRecord(DatabaseKey(1), data_b); // Update with bigger data, forcing a new record location
+			db.updateRecord(DatabaseKey(3), data_c);
+			db.deleteRecord(DatabaseKey(3));
+			testAssert(db.numRecords() == 1); // Operations shouldn't be visible until committed.
+			db.commitTransaction();
+			testAssert(!db.isInTransaction());
+			testAssert(db.numRecords() == 2);
+
+			db.updateRecord(DatabaseKey(4), data_c); // Non-transactional update after a transaction
+		}
+		testAssert(!FileUtils::fileExists(wal_path)); // WAL should be removed on clean close.
+
+		Database db;
+		db.startReadingFromDisk(db_path);
+		testAssert(db.numRecords() == 3);
+		checkRecordData(db, DatabaseKey(1), data_b);
+		checkRecordData(db, DatabaseKey(2), data_a);
+		checkRecordData(db, DatabaseKey(4), data_c);
+		db.finishReadingFromDisk();
+	}
+
+	// Test aborting a transaction
+	{
+		{
+			Database db;
+			db.openAndMakeOrClearDatabase(db_path);
+			db.updateRecord(DatabaseKey(1), data_a);
+
+			db.beginTransaction();
+			db.updateRecord(DatabaseKey(1), data_b);
+			db.deleteRecord(DatabaseKey(1));
+			db.updateRecord(DatabaseKey(2), data_a);
+			db.abortTransaction();
+
+			db.beginTransaction();
+			db.updateRecord(DatabaseKey(5), data_a);
+			// Destroy DB with transaction still open, should be discarded.
+		}
+
+		Database db;
+		db.startReadingFromDisk(db_path);
+		testAssert(db.numRecords() == 1);
+		checkRecordData(db, DatabaseKey(1), data_a);
+		db.finishReadingFromDisk();
+	}
+
+	// Test recovery from the WAL.
+	// We simulate a crash after some transactions have been committed to the WAL, but before any of their writes to the database file reached the disk,
+	// by taking a copy of the database file from before the transactions, along with a copy of the WAL after them.
+	{
+		const std::string crash_db_path = "./test_crash.db";
+		const std::string crash_wal_path = Database::getWALPath(crash_db_path);
+		const std::string base_db_path = "./test_base.db";
+
+		{
+			Database db;
+			db.openAndMakeOrClearDatabase(db_path);
+			db.updateRecord(DatabaseKey(1), data_a);
+			db.updateRecord(DatabaseKey(2), data_a);
+		}
+		FileUtils::copyFile(db_path, base_db_path);
+
+		{
+			Database db;
+			db.startReadingFromDisk(db_path);
+			db.finishReadingFromDisk();
+			db.setWALCheckpointThreshold(std::numeric_limits<size_t>::max()); // Don't checkpoint while the DB is open.
+
+			db.beginTransaction();
+			db.updateRecord(DatabaseKey(1), data_b);
+			db.updateRecord(DatabaseKey(3), data_c);
+			db.commitTransaction();
+
+			db.beginTransaction();
+			db.deleteRecord(DatabaseKey(2));
+			db.updateRecord(DatabaseKey(4), data_b);
+			db.commitTransaction();
+
+			FileUtils::copyFile(wal_path, crash_wal_path + "_full");
+		}
+
+		// Replay the full WAL: both transactions should be applied.
+		{
+			FileUtils::copyFile(base_db_path, crash_db_path);
+			FileUtils::copyFile(crash_wal_path + "_full", crash_wal_path);
+
+			Database db;
+			db.startReadingFromDisk(crash_db_path);
+			testAssert(!FileUtils::fileExists(crash_wal_path));
+			testAssert(db.numRecords() == 3);
+			checkRecordData(db, DatabaseKey(1), data_b);
+			checkRecordData(db, DatabaseKey(3), data_c);
+			checkRecordData(db, DatabaseKey(4), data_b);
+			db.finishReadingFromDisk();
+		}
+
+		std::vector<unsigned char> full_wal;
+		FileUtils::readEntireFile(crash_wal_path + "_full", full_wal);
+
+		// Truncate the WAL partway through the second transaction, as if we crashed while writing it.  Only the first transaction should be applied.
+		for(size_t trunc_amount = 1; trunc_amount < 40; trunc_amount += 13)
+		{
+			FileUtils::copyFile(base_db_path, crash_db_path);
+			FileUtils::writeEntireFile(crash_wal_path, (const char*)full_wal.data(), full_wal.size() - trunc_amount);
+
+			Database db;
+			db.startReadingFromDisk(crash_db_path);
+			testAssert(db.numRecords() == 3);
+			checkRecordData(db, DatabaseKey(1), data_b);
+			checkRecordData(db, DatabaseKey(2), data_a);
+			checkRecordData(db, DatabaseKey(3), data_c);
+			db.finishReadingFromDisk();
+		}
+
+		// Corrupt a data byte in the last frame of the second transaction, the second transaction should be discarded.
+		{
+			std::vector<unsigned char> corrupt_wal = full_wal;
+			corrupt_wal[corrupt_wal.size() - 32 - 10] ^= 0xFF; // Last frame is the commit frame (32 byte header only), so this is in the data of the update of key 4.
+
+			FileUtils::copyFile(base_db_path, crash_db_path);
+			FileUtils::writeEntireFile(crash_wal_path, (const char*)corrupt_wal.data(), corrupt_wal.size());
+
+			Database db;
+			db.startReadingFromDisk(crash_db_path);
+			testAssert(db.numRecords() == 3);
+			checkRecordData(db, DatabaseKey(2), data_a);
+			testAssert(db.getRecordMap().count(DatabaseKey(4)) == 0);
+			db.finishReadingFromDisk();
+		}
+
+		// Simulate a crash while a record was being appended to the database file: the torn record should be removed during recovery.
+		{
+			std::vector<unsigned char> db_data;
+			FileUtils::readEntireFile(base_db_path, db_data);
+			const uint64 torn_key = 1000;
+			const uint32 torn_len = 50, torn_capacity = 200, torn_seq_num = 0;
+			const size_t torn_offset = db_data.size();
+			db_data.resize(db_data.size() + 20 + 30);
+			std::memcpy(&db_data[torn_offset +  0], &torn_key, 8);
+			std::memcpy(&db_data[torn_offset +  8], &torn_len, 4);
+			std::memcpy(&db_data[torn_offset + 12], &torn_capacity, 4);
+			std::memcpy(&db_data[torn_offset + 16], &torn_seq_num, 4);
+
+			FileUtils::writeEntireFile(crash_db_path, (const char*)db_data.data(), db_data.size());
+			FileUtils::copyFile(crash_wal_path + "_full", crash_wal_path);
+
+			{
+				Database db;
+				db.startReadingFromDisk(crash_db_path);
+				testAssert(db.numRecords() == 3);
+				checkRecordData(db, DatabaseKey(1), data_b);
+				checkRecordData(db, DatabaseKey(4), data_b);
+				db.finishReadingFromDisk();
+			}
+
+			// Database should now be readable without the WAL.
+			Database db;
+			db.startReadingFromDisk(crash_db_path);
+			testAssert(db.numRecords() == 3);
+			db.finishReadingFromDisk();
+		}
+
+		FileUtils::deleteFile(crash_db_path);
+		FileUtils::deleteFile(crash_wal_path + "_full");
+		FileUtils::deleteFile(base_db_path);
+	}
+
+	// Test that a stale WAL is not replayed onto a cleared database
+	{
+		{
+			Database db;
+			db.openAndMakeOrClearDatabase(db_path);
+			db.setWALCheckpointThreshold(std::numeric_limits<size_t>::max());
+			db.beginTransaction();
+			db.updateRecord(DatabaseKey(1), data_a);
+			db.commitTransaction();
+			FileUtils::copyFile(wal_path, wal_path + "_copy");
+		}
+		FileUtils::moveFile(wal_path + "_copy", wal_path);
+
+		Database::makeOrClearDatabase(db_path);
+
+		Database db;
+		db.startReadingFromDisk(db_path);
+		testAssert(db.numRecords() == 0);
+		db.finishReadingFromDisk();
+	}
+
+	// Speed test: batches of small updates, one fsync per batch.
+	{
+		const int N = 10000;
+		const int batch_size = 100;
+
+		Timer timer;
+		{
+			Database db;
+			db.openAndMakeOrClearDatabase(db_path);
+
+			for(int i=0; i<N; i += batch_size)
+			{
+				db.beginTransaction();
+				for(int z=i; z<i + batch_size; ++z)
+				{
+					std::vector<uint8> data(3);
+					data[0] = (uint8)(z % 256);
+					db.updateRecord(DatabaseKey(z), data);
+				}
+				db.commitTransaction();
+			}
+		}
+		conPrint("Transactional writes / s (batch size " + toString(batch_size) + "): " + doubleToStringNSigFigs(N / timer.elapsed(), 4));
+
+		Database db;
+		db.startReadingFromDisk(db_path);
+		testAssert(db.numRecords() == N);
+		for(int i=0; i<N; ++i)
+			checkRecordData(db, DatabaseKey(i), std::vector<uint8>({ (uint8)(i % 256), 0, 0 }));
+		db.finishReadingFromDisk();
+	}
+}
+
+
+
+static void checkDatabaseContents(const std::string& db_path, const std::map<DatabaseKey, std::vector<uint8> >& ref_map, glare::TaskManager* task_manager = NULL)
+{
+	Database db;
+	db.startReadingFromDisk(db_path, task_manager);
+	testAssert(db.numRecords() == ref_map.size());
+	for(auto it = ref_map.begin(); it != ref_map.end(); ++it)
+		checkRecordData(db, it->first, it->second);
+	db.finishReadingFromDisk();
+}
+
+
+static void testFreeSpaceReuseAndCompaction()
+{
+	const std::string db_path = "./test.db";
+
+	// Test that space from deleted records is reused
+	{
+		std::map<DatabaseKey, std::vector<uint8> > ref_map;
+		size_t initial_file_size;
+		{
+			Database db;
+			db.openAndMakeOrClearDatabase(db_path);
+			for(int i=0; i<100; ++i)
+			{
+				ref_map[DatabaseKey(i)] = std::vector<uint8>(100, (uint8)i);
+				db.updateRecord(DatabaseKey(i), ref_map[DatabaseKey(i)]);
+			}
+			initial_file_size = db.getFileSize();
+
+			for(int i=0; i<100; i += 2)
+			{
+				db.deleteRecord(DatabaseKey(i));
+				ref_map.erase(DatabaseKey(i));
+			}
+			testAssert(db.getFreeSpaceSize() > 0);
+
+			// Add new records with the same or smaller size, file size should not grow.
+			for(int i=100; i<150; ++i)
+			{
+				ref_map[DatabaseKey(i)] = std::vector<uint8>(50 + (i % 50), (uint8)i);
+				db.updateRecord(DatabaseKey(i), ref_map[DatabaseKey(i)]);
+			}
+			testAssert(db.getFileSize() == initial_file_size);
+		}
+		testAssert(FileUtils::getFileSize(db_path) == initial_file_size);
+		checkDatabaseContents(db_path, ref_map);
+
+		// Delete some records, then reopen the DB: the free block index should be rebuilt, and the space reused.
+		{
+			Database db;
+			db.startReadingFromDisk(db_path);
+			db.finishReadingFromDisk();
+			for(int i=1; i<100; i += 2)
+			{
+				db.deleteRecord(DatabaseKey(i));
+				ref_map.erase(DatabaseKey(i));
+			}
+		}
+		{
+			Database db;
+			db.startReadingFromDisk(db_path);
+			db.finishReadingFromDisk();
+			testAssert(db.getFreeSpaceSize() > 0);
+			for(int i=200; i<250; ++i)
+			{
+				ref_map[DatabaseKey(i)] = std::vector<uint8>(100, (uint8)i);
+				db.updateRecord(DatabaseKey(i), ref_map[DatabaseKey(i)]);
+			}
+			testAssert(db.getFileSize() == initial_file_size);
+		}
+		checkDatabaseContents(db_path, ref_map);
+	}
+
+	// Test that the space a record moves out of, when it grows, is reused.
+	{
+		Database db;
+		db.openAndMakeOrClearDatabase(db_path);
+		db.updateRecord(DatabaseKey(1), std::vector<uint8>(100, 1));
+		db.updateRecord(DatabaseKey(2), std::vector<uint8>(100, 2));
+		const size_t file_size = db.getFileSize();
+
+		db.updateRecord(DatabaseKey(1), std::vector<uint8>(1000, 1)); // Moves record 1 to the end of the file.
+		testAssert(db.getFileSize() > file_size);
+
+		const size_t file_size_2 = db.getFileSize();
+		db.updateRecord(DatabaseKey(3), std::vector<uint8>(100, 3)); // Should go in the old location of record 1.
+		testAssert(db.getFileSize() == file_size_2);
+	}
+	{
+		std::map<DatabaseKey, std::vector<uint8> > ref_map;
+		ref_map[DatabaseKey(1)] = std::vector<uint8>(1000, 1);
+		ref_map[DatabaseKey(2)] = std::vector<uint8>(100, 2);
+		ref_map[DatabaseKey(3)] = std::vector<uint8>(100, 3);
+		checkDatabaseContents(db_path, ref_map);
+	}
+
+	// Test a database written with the old scheme, where moved records were not marked free, and deleted records kept their key.
+	// Key 1 has a superseded record with seq num 0 and a deleted record with seq num 1.  Key 1 should not come back when the space is reused.
+	{
+		{
+			FileOutStream file(db_path, std::ios::binary | std::ios::trunc);
+			file.writeUInt32(287173871); // magic number
+			file.writeUInt32(1); // version
+
+			const uint32 capacities[3] = { 100, 100, 100 };
+			const uint32 lens[3] = { 10, std::numeric_limits<uint32>::max(), 20 };
+			const uint64 keys[3] = { 1, 1, 2 };
+			const uint32 seq_nums[3] = { 0, 1, 0 };
+			for(int i=0; i<3; ++i)
+			{
+				file.writeUInt64(keys[i]);
+				file.writeUInt32(lens[i]);
+				file.writeUInt32(capacities[i]);
+				file.writeUInt32(seq_nums[i]);
+				std::vector<uint8> data(capacities[i], (uint8)keys[i]);
+				file.writeData(data.data(), data.size());
+			}
+		}
+
+		std::map<DatabaseKey, std::vector<uint8> > ref_map;
+		ref_map[DatabaseKey(2)] = std::vector<uint8>(20, 2);
+		checkDatabaseContents(db_path, ref_map);
+
+		{
+			Database db;
+			db.startReadingFromDisk(db_path);
+			db.finishReadingFromDisk();
+			const size_t file_size = db.getFileSize();
+			db.updateRecord(DatabaseKey(3), std::vector<uint8>(100, 3)); // Fits in the merged space of the two old key 1 records.
+			testAssert(db.getFileSize() == file_size);
+			ref_map[DatabaseKey(3)] = std::vector<uint8>(100, 3);
+		}
+		checkDatabaseContents(db_path, ref_map);
+	}
+
+	// Test incremental compaction, with updates between compaction steps.
+	{
+		PCG32 rng(1);
+		std::map<DatabaseKey, std::vector<uint8> > ref_map;
+		size_t full_file_size;
+		{
+			Database db;
+			db.openAndMakeOrClearDatabase(db_path);
+			for(int i=0; i<1000; ++i)
+			{
+				ref_map[DatabaseKey(i)] = std::vector<uint8>(rng.nextUInt(300), (uint8)i);
+				db.updateRecord(DatabaseKey(i), ref_map[DatabaseKey(i)]);
+			}
+			full_file_size = db.getFileSize();
+
+			// Delete 90% of the records
+			for(int i=0; i<1000; ++i)
+				if(rng.unitRandom() < 0.9f)
+				{
+					db.deleteRecord(DatabaseKey(i));
+					ref_map.erase(DatabaseKey(i));
+				}
+		}
+
+		{
+			Database db;
+			db.startReadingFromDisk(db_path);
+			db.finishReadingFromDisk();
+
+			int num_steps = 0;
+			while(db.compactIncrementally(/*max_bytes_to_move=*/4096))
+			{
+				num_steps++;
+
+				// Do some updates while compacting
+				const DatabaseKey key(rng.nextUInt(1100));
+				if(rng.unitRandom() < 0.5f)
+				{
+					ref_map[key] = std::vector<uint8>(rng.nextUInt(300), (uint8)num_steps);
+					db.updateRecord(key, ref_map[key]);
+				}
+				else
+				{
+					db.deleteRecord(key);
+					ref_map.erase(key);
+				}
+
+				testAssert(num_steps < 10000);
+			}
+
+			conPrint("Compacted in " + toString(num_steps) + " steps, file size " + toString(full_file_size) + " B -> " + toString(db.getFileSize()) + " B, free space: " + toString(db.getFreeSpaceSize()) + " B");
+			testAssert(db.getFileSize() < full_file_size / 4);
+			testAssert(FileUtils::getFileSize(db_path) == db.getFileSize());
+		}
+		checkDatabaseContents(db_path, ref_map);
+	}
+}
+
+
+
+// Test that loading the index in parallel (record ranges indexed on separate tasks, then merged) gives the same result as a serial load,
+// when there are enough records for multiple ranges, and keys are updated and deleted in ranges other than the one they were first written in.
+static void testParallelIndexLoad()
+{
+	const std::string db_path = "./test.db";
+	const int N = 300000;
+	std::map<DatabaseKey, std::vector<uint8> > ref_map;
+	{
+		PCG32 rng(1);
+		Database db;
+		db.openAndMakeOrClearDatabase(db_path);
+		std::vector<uint8> data;
+		for(int i=0; i<N; ++i)
+		{
+			data.resize(1 + rng.nextUInt(32));
+			for(size_t z=0; z<data.size(); ++z)
+				data[z] = (uint8)(i + z);
+			db.updateRecord(DatabaseKey(i), data);
+			ref_map[DatabaseKey(i)] = data;
+		}
+		for(int i=0; i<N; i += 7) // Update some records with larger data so they are rewritten later in the file.
+		{
+			data.resize(100);
+			for(size_t z=0; z<data.size(); ++z)
+				data[z] = (uint8)(i * 3 + z);
+			db.updateRecord(DatabaseKey(i), data);
+			ref_map[DatabaseKey(i)] = data;
+		}
+		for(int i=3; i<N; i += 11) // Delete some records.
+		{
+			db.deleteRecord(DatabaseKey(i));
+			ref_map.erase(DatabaseKey(i));
+		}
+	}
+
+	size_t serial_free_space;
+	{
+		Database db;
+		db.startReadingFromDisk(db_path);
+		serial_free_space = db.getFreeSpaceSize();
+		db.finishReadingFromDisk();
+	}
+
+	glare::TaskManager task_manager("Database load task manager");
+	{
+		Database db;
+		db.startReadingFromDisk(db_path, &task_manager);
+		testAssert(db.getFreeSpaceSize() == serial_free_space);
+		db.finishReadingFromDisk();
+	}
+
+	checkDatabaseContents(db_path, ref_map);
+	checkDatabaseContents(db_path, ref_map, &task_manager);
+}
+
+
+
+// Measure the speed of loading the index for a database with many small records, with and without a task manager.
+static void doLoadSpeedBenchmark()
+{
+	const std::string db_path = "./test.db";
+	const int N = 500000;
+	{
+		PCG32 rng(1);
+		Database db;
+		db.openAndMakeOrClearDatabase(db_path);
+		std::vector<uint8> data;
+		for(int i=0; i<N; ++i)
+		{
+			data.resize(rng.nextUInt(64));
+			db.updateRecord(DatabaseKey(i), data);
+		}
+		for(int i=0; i<N; i += 10) // Update some records with larger data so they move, leaving free blocks.
+		{
+			data.resize(200);
+			db.updateRecord(DatabaseKey(i), data);
+		}
+	}
+
+	glare::TaskManager task_manager("Database load task manager");
+
+	for(int use_task_manager=0; use_task_manager<2; ++use_task_manager)
+	{
+		double min_elapsed = 1.0e10;
+		for(int trial=0; trial<3; ++trial)
+		{
+			Timer timer;
+			Database db;
+			db.startReadingFromDisk(db_path, use_task_manager ? &task_manager : NULL);
+			min_elapsed = myMin(min_elapsed, timer.elapsed());
+
+			testAssert(db.numRecords() == N);
+			db.finishReadingFromDisk();
+		}
+		conPrint(std::string(use_task_manager ? "With task manager (" + toString(task_manager.getNumThreads()) + " threads)" : "Without task manager") + ": loaded " + toString(N) + " records in " + 
+			doubleToStringNSigFigs(min_elapsed * 1.0e3, 4) + " ms (" + doubleToStringNSigFigs(N / min_elapsed * 1.0e-6, 4) + " M records / s)");
+	}
+}
+
+
+
 
 
 void DatabaseTests::test()
@@ -665,6 +1222,14 @@ void DatabaseTests::test()
 
 
 
+	testTransactions();
+
+	testFreeSpaceReuseAndCompaction();
+
+	testParallelIndexLoad();
+
+	doLoadSpeedBenchmark();
+
 	doRandomTests(/*seed=*/1);
 
 	conPrint("DatabaseTests::test() done");
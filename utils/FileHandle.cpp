@@ -10,6 +10,11 @@ Copyright Glare Technologies Limited 2021 -
 #include "PlatformUtils.h"
 #include "Exception.h"
 #include <assert.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 
 FileHandle::FileHandle()
@@ -64,3 +69,37 @@ int FileHandle::getFileDescriptor()
 	else
 		return -1;
 }
+
+
+void FileHandle::flushToDisk()
+{
+	assert(f);
+
+	if(fflush(f) != 0)
+		throw glare::Exception("fflush failed: " + PlatformUtils::getLastErrorString());
+
+#if defined(_WIN32)
+	if(_commit(_fileno(f)) != 0)
+		throw glare::Exception("_commit failed: " + PlatformUtils::getLastErrorString());
+#else
+	if(fsync(fileno(f)) != 0)
+		throw glare::Exception("fsync failed: " + PlatformUtils::getLastErrorString());
+#endif
+}
+
+
+void FileHandle::truncate(uint64 new_size)
+{
+	assert(f);
+
+	if(fflush(f) != 0)
+		throw glare::Exception("fflush failed: " + PlatformUtils::getLastErrorString());
+
+#if defined(_WIN32)
+	if(_chsize_s(_fileno(f), (__int64)new_size) != 0)
+		throw glare::Exception("_chsize_s failed: " + PlatformUtils::getLastErrorString());
+#else
+	if(ftruncate(fileno(f), (off_t)new_size) != 0)
+		throw glare::Exception("ftruncate failed: " + PlatformUtils::getLastErrorString());
+#endif
+}
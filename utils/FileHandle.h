@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2021 -
 #pragma once
 
 
+#include "Platform.h"
 #include <string>
 #include <cstdio>
 
@@ -29,6 +30,11 @@ public:
 
 	int getFileDescriptor();
 
+	// Flushes the stdio buffer and asks the OS to write the file data through to the storage device (fsync / _commit).
+	void flushToDisk(); // throws glare::Exception
+
+	void truncate(uint64 new_size); // Sets the size of the file.  Throws glare::Exception on failure.
+
 private:
 	FileHandle(const FileHandle& );
 	FileHandle& operator = (const FileHandle& );
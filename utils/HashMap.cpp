@@ -270,6 +270,43 @@ void testHashMap()
 		printVar(m.buckets_size);
 	}
 
+	// Test reserve()
+	{
+		HashMap<int, int> m(/*empty key=*/std::numeric_limits<int>::max());
+		for(int i=0; i<10; ++i)
+			m.insert(std::make_pair(i, i * 2));
+
+		m.reserve(1000);
+		const size_t buckets_size = m.buckets_size;
+		testAssert(buckets_size >= 1000);
+		for(int i=0; i<10; ++i)
+			testAssert(m.find(i) != m.end() && m.find(i)->second == i * 2);
+
+		for(int i=10; i<1000; ++i)
+			m.insert(std::make_pair(i, i * 2));
+		testAssert(m.buckets_size == buckets_size); // Should not have expanded
+		testAssert(m.size() == 1000);
+
+		m.reserve(10); // Should not shrink
+		testAssert(m.buckets_size == buckets_size);
+	}
+
+	// Test swap()
+	{
+		HashMap<int, int> a(/*empty key=*/std::numeric_limits<int>::max());
+		HashMap<int, int> b(/*empty key=*/std::numeric_limits<int>::max());
+		for(int i=0; i<100; ++i)
+			a.insert(std::make_pair(i, i * 2));
+		b.insert(std::make_pair(-1, 7));
+
+		a.swap(b);
+		testAssert(a.size() == 1 && a.find(-1) != a.end() && a.find(-1)->second == 7);
+		testAssert(b.size() == 100);
+		for(int i=0; i<100; ++i)
+			testAssert(b.find(i) != b.end() && b.find(i)->second == i * 2);
+		testAssert(b.find(-1) == b.end());
+	}
+
 	// Test hash function performance
 	{
 		const int N = 1000000;
@@ -12,6 +12,7 @@ Copyright Glare Technologies Limited 2025 -
 #include <assert.h>
 #include <functional>
 #include <type_traits>
+#include <utility>
 
 
 #ifdef _WIN32
@@ -369,6 +370,26 @@ public:
 		}
 	}
 
+	// Makes sure that expected_num_items items can be stored without the map having to expand.
+	void reserve(size_t expected_num_items)
+	{
+		const size_t new_buckets_size = Maths::roundToNextHighestPowerOf2(divideByMaxLoadFactor(expected_num_items) + 1);
+		if(new_buckets_size > buckets_size)
+			rehash(new_buckets_size);
+	}
+
+	// Swaps the contents of this map with other, without copying any items.
+	void swap(HashMap& other)
+	{
+		std::swap(buckets, other.buckets);
+		std::swap(buckets_size, other.buckets_size);
+		std::swap(hash_func, other.hash_func);
+		std::swap(empty_key, other.empty_key);
+		std::swap(allocator, other.allocator);
+		std::swap(num_items, other.num_items);
+		std::swap(hash_mask, other.hash_mask);
+	}
+
 	bool empty() const { return num_items == 0; }
 
 	size_t size() const { return num_items; }
@@ -396,13 +417,20 @@ private:
 
 
 	void expand()
+	{
+		rehash(buckets_size * 2);
+	}
+
+
+	// Moves items into a new bucket array with new_buckets_size buckets.  new_buckets_size must be a power of 2 and large enough to hold the items.
+	void rehash(size_t new_buckets_size)
 	{
 		// Get pointer to old buckets
 		const std::pair<Key, Value>* const old_buckets = this->buckets;
 		const size_t old_buckets_size = this->buckets_size;
 
 		// Allocate new buckets
-		this->buckets_size = old_buckets_size * 2;
+		this->buckets_size = new_buckets_size;
 
 		if(allocator)
 			this->buckets = (std::pair<Key, Value>*)allocator->alloc       (sizeof(std::pair<Key, Value>) * this->buckets_size, 64);
@@ -26,6 +26,10 @@ public:
 	size_t fileSize() const { return file_size; } // Returns file size in bytes.
 	const void* fileData() const { return file_data; } // Returns pointer to file data.  NOTE: This pointer will be the null pointer if the file size is zero.
 
+#if !defined(_WIN32)
+	int getFileDescriptor() const { return linux_file_handle; } // The file stays open while mapped, e.g. for use with sendfile().
+#endif
+
 	static void test();
 
 private:
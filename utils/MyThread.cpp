@@ -39,9 +39,9 @@ MyThread::~MyThread()
 #else
 	// Mark the thread resources as freeable if needed.
 	// Each pthread must either have pthread_join() or pthread_detach() call on it.
-	// So we'll call pthread_detach() only if we haven't joined it.
+	// So we'll call pthread_detach() only if we haven't joined it, and only if it was launched.
 	// See: http://www.kernel.org/doc/man-pages/online/pages/man3/pthread_detach.3.html
-	if(!joined)
+	if(!joined && thread_handle != 0)
 	{
 		const int result = pthread_detach(thread_handle);
 		assertOrDeclareUsed(result == 0);
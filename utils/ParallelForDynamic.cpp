@@ -0,0 +1,54 @@
+/*=====================================================================
+ParallelForDynamic.cpp
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ParallelForDynamic.h"
+
+
+#include "StringUtils.h"
+
+
+namespace glare
+{
+
+
+double ParallelForStats::getMaxBusyTime() const
+{
+	double max_time = 0;
+	for(size_t i=0; i<task_stats.size(); ++i)
+		max_time = myMax(max_time, task_stats[i].busy_time);
+	return max_time;
+}
+
+
+double ParallelForStats::getMeanBusyTime() const
+{
+	if(task_stats.empty())
+		return 0;
+
+	double sum = 0;
+	for(size_t i=0; i<task_stats.size(); ++i)
+		sum += task_stats[i].busy_time;
+	return sum / task_stats.size();
+}
+
+
+double ParallelForStats::getImbalance() const
+{
+	const double mean = getMeanBusyTime();
+	return (mean > 0) ? (getMaxBusyTime() / mean) : 1.0;
+}
+
+
+const std::string ParallelForStats::toString() const
+{
+	std::string s = "elapsed: " + doubleToStringNSigFigs(elapsed_time * 1.0e3, 4) + " ms, imbalance (max / mean busy time): " + doubleToStringNSigFigs(getImbalance(), 4) + "\n";
+	for(size_t i=0; i<task_stats.size(); ++i)
+		s += "task " + ::toString(i) + " (thread " + ::toString(task_stats[i].thread_index) + "): busy " + doubleToStringNSigFigs(task_stats[i].busy_time * 1.0e3, 4) + " ms, " + 
+			::toString(task_stats[i].num_chunks) + " chunks, " + ::toString(task_stats[i].num_indices) + " indices\n";
+	return s;
+}
+
+
+} // end namespace glare
@@ -0,0 +1,159 @@
+/*=====================================================================
+ParallelForDynamic.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "Task.h"
+#include "Timer.h"
+#include "Platform.h"
+#include "../maths/mathstypes.h"
+#include <atomic>
+#include <vector>
+#include <string>
+
+
+namespace glare
+{
+
+
+// Statistics for a single task of TaskManager::runParallelForDynamic().
+struct ParallelForTaskStats
+{
+	size_t thread_index;	// Index of the thread the task ran on.
+	double busy_time;		// Time spent processing chunks, in seconds.
+	size_t num_chunks;		// Number of chunks claimed by the task.
+	size_t num_indices;		// Number of indices processed by the task.
+};
+
+
+/*=====================================================================
+ParallelForStats
+----------------
+Per-task busy times etc. from TaskManager::runParallelForDynamic(), 
+for seeing how well balanced the work was.
+=====================================================================*/
+class ParallelForStats
+{
+public:
+	ParallelForStats() : elapsed_time(0) {}
+
+	double getMaxBusyTime() const;
+	double getMeanBusyTime() const;
+	double getImbalance() const; // Max busy time / mean busy time.  1 = perfectly balanced.
+
+	const std::string toString() const;
+
+	std::vector<ParallelForTaskStats> task_stats;
+	double elapsed_time; // Wall-clock time for the whole loop, in seconds.
+};
+
+
+/*=====================================================================
+ParallelForRange
+----------------
+An index range [begin, end) that tasks claim chunks of indices from, using an atomic counter.
+
+If grain_size is non-zero, chunks are grain_size indices.
+If grain_size is zero, chunk sizes are chosen automatically ('guided' scheduling): each chunk is
+the remaining number of indices / (2 * num_tasks), but at least one index.  So chunks start off large 
+(low overhead), and get smaller towards the end of the range, where load balancing matters.
+=====================================================================*/
+class GLARE_ALIGN(64) ParallelForRange // Aligned so that the counter doesn't share a cache line with other data.
+{
+public:
+	ParallelForRange(size_t begin, size_t end_, size_t grain_size_, size_t num_tasks_) : next(begin), end(end_), grain_size(grain_size_), num_tasks(num_tasks_) {}
+
+	// Returns false if there are no indices left.
+	inline bool claimChunk(size_t& chunk_begin_out, size_t& chunk_end_out);
+
+	std::atomic<size_t> next;
+	size_t end;
+	size_t grain_size;
+	size_t num_tasks;
+};
+
+
+bool ParallelForRange::claimChunk(size_t& chunk_begin_out, size_t& chunk_end_out)
+{
+	if(grain_size != 0)
+	{
+		const size_t chunk_begin = next.fetch_add(grain_size, std::memory_order_relaxed);
+		if(chunk_begin >= end)
+			return false;
+		chunk_begin_out = chunk_begin;
+		chunk_end_out = myMin(chunk_begin + grain_size, end);
+		return true;
+	}
+	else
+	{
+		size_t chunk_begin = next.load(std::memory_order_relaxed);
+		while(chunk_begin < end)
+		{
+			const size_t chunk_size = myMax<size_t>(1, (end - chunk_begin) / (2 * num_tasks));
+			if(next.compare_exchange_weak(chunk_begin, chunk_begin + chunk_size, std::memory_order_relaxed)) // If successfully claimed (otherwise chunk_begin is updated with the current value)
+			{
+				chunk_begin_out = chunk_begin;
+				chunk_end_out = chunk_begin + chunk_size;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+
+/*=====================================================================
+ParallelForDynamicTask
+----------------------
+Task used by TaskManager::runParallelForDynamic().
+Keeps claiming chunks from the shared range and calling func on them until the range is exhausted.
+=====================================================================*/
+template <class RangeFunc>
+class ParallelForDynamicTask : public Task
+{
+public:
+	ParallelForDynamicTask() : func(NULL), range(NULL), stats(NULL) {}
+
+	void set(const RangeFunc* func_, ParallelForRange* range_, ParallelForTaskStats* stats_)
+	{
+		func = func_;
+		range = range_;
+		stats = stats_;
+	}
+
+	virtual void run(size_t thread_index)
+	{
+		size_t chunk_begin, chunk_end;
+		if(stats)
+		{
+			stats->thread_index = thread_index;
+			stats->busy_time = 0;
+			stats->num_chunks = 0;
+			stats->num_indices = 0;
+
+			while(range->claimChunk(chunk_begin, chunk_end))
+			{
+				Timer timer;
+				(*func)(chunk_begin, chunk_end, thread_index);
+				stats->busy_time += timer.elapsed();
+				stats->num_chunks++;
+				stats->num_indices += chunk_end - chunk_begin;
+			}
+		}
+		else
+		{
+			while(range->claimChunk(chunk_begin, chunk_end))
+				(*func)(chunk_begin, chunk_end, thread_index);
+		}
+	}
+
+	const RangeFunc* func;
+	ParallelForRange* range;
+	ParallelForTaskStats* stats; // May be NULL.
+};
+
+
+} // end namespace glare
@@ -82,6 +82,15 @@ Copyright Glare Technologies Limited 2021 -
 #endif
 
 
+// Allows a function to use AVX2 and FMA intrinsics without compiling the whole translation unit with AVX2 enabled.
+// The caller needs to check for CPU support at runtime (see PlatformUtils::getCPUInfo()) before calling the function.
+#ifdef COMPILER_MSVC
+#define GLARE_TARGET_AVX2
+#else
+#define GLARE_TARGET_AVX2 __attribute__ ((target ("avx2,fma")))
+#endif
+
+
 #ifdef COMPILER_MSVC
 #define GLARE_ALIGN(x) _CRT_ALIGN(x)
 #else
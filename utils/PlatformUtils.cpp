@@ -205,6 +205,29 @@ static void doCPUID(unsigned int infotype, unsigned int* out)
 	__get_cpuid(infotype, out, out + 1, out + 2, out + 3);
 #endif
 }
+
+
+static void doCPUIDWithSubleaf(unsigned int infotype, unsigned int subleaf, unsigned int* out)
+{
+#if defined(_WIN32)
+	__cpuidex((int*)out, infotype, subleaf);
+#else
+	__get_cpuid_count(infotype, subleaf, out, out + 1, out + 2, out + 3);
+#endif
+}
+
+
+// Returns the XCR0 register, which says which register states the OS saves on context switches.  Only call if the OSXSAVE CPUID flag is set.
+static uint64 getXCR0()
+{
+#if defined(_WIN32)
+	return _xgetbv(0);
+#else
+	uint32 eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64)edx << 32) | eax;
+#endif
+}
 #endif
 
 
@@ -217,6 +240,10 @@ void PlatformUtils::getCPUInfo(CPUInfo& info_out)
 	const int SSE3_FLAG = 1;
 	const int SSE_4_1_FLAG = 1 << 19; // SSE4.1 Extensions
 	const int SSE_4_2_FLAG = 1 << 20; // SSE4.2 Extensions
+	const int FMA_FLAG = 1 << 12;
+	const int OSXSAVE_FLAG = 1 << 27; // OS has enabled XSETBV/XGETBV
+	const int AVX_FLAG = 1 << 28;
+	const int AVX2_FLAG = 1 << 5; // In EBX of CPUID leaf 7
 
 
 	unsigned int cpu_info[4];
@@ -239,6 +266,19 @@ void PlatformUtils::getCPUInfo(CPUInfo& info_out)
 	info_out.sse3     = (cpu_info[2] & SSE3_FLAG   ) != 0;
 	info_out.sse4_1   = (cpu_info[2] & SSE_4_1_FLAG) != 0;
 	info_out.sse4_2   = (cpu_info[2] & SSE_4_2_FLAG) != 0;
+
+	// AVX instructions can only be used if the OS saves the YMM registers (XCR0 bits 1 and 2).
+	const bool os_saves_ymm = ((cpu_info[2] & OSXSAVE_FLAG) != 0) && ((getXCR0() & 0x6) == 0x6);
+	info_out.avx      = os_saves_ymm && ((cpu_info[2] & AVX_FLAG) != 0);
+	info_out.fma      = info_out.avx && ((cpu_info[2] & FMA_FLAG) != 0);
+	info_out.avx2     = false;
+	if(info_out.avx && highest_param >= 7)
+	{
+		unsigned int leaf_7_info[4] = { 0, 0, 0, 0 }; // Zero-initialise, as __get_cpuid_count() may not write its outputs.
+		doCPUIDWithSubleaf(/*infotype=*/7, /*subleaf=*/0, leaf_7_info);
+		info_out.avx2 = (leaf_7_info[1] & AVX2_FLAG) != 0;
+	}
+
 	info_out.stepping = (cpu_info[0] & 0xF);
 	info_out.model    = (cpu_info[0] >> 4) & 0xF;
 	info_out.family   = (cpu_info[0] >> 8) & 0xF;
@@ -1148,6 +1188,9 @@ void PlatformUtils::testPlatformUtils()
 			conPrint("sse3:       " + boolToString(info.sse3));
 			conPrint("sse4_1:     " + boolToString(info.sse4_1));
 			conPrint("sse4_2:     " + boolToString(info.sse4_2));
+			conPrint("avx:        " + boolToString(info.avx));
+			conPrint("avx2:       " + boolToString(info.avx2));
+			conPrint("fma:        " + boolToString(info.fma));
 		}
 #endif
 
@@ -46,6 +46,7 @@ class CPUInfo
 public:
 	char vendor[13]; // Includes an extra char to force null termination.
 	bool mmx, sse1, sse2, sse3, sse4_1, sse4_2;
+	bool avx, avx2, fma; // avx, avx2 and fma are only set if the OS also supports saving the AVX registers.
 	unsigned int stepping;
 	unsigned int model;
 	unsigned int family;
@@ -0,0 +1,219 @@
+/*=====================================================================
+ShardedLRUCache.cpp
+-------------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#include "ShardedLRUCache.h"
+
+
+#if BUILD_TESTS
+
+
+#include "MyThread.h"
+#include "Reference.h"
+#include "ConPrint.h"
+#include "TestUtils.h"
+#include "Timer.h"
+#include "StringUtils.h"
+#include <string>
+
+
+namespace
+{
+
+class ShardedLRUCacheTestThread : public MyThread
+{
+public:
+	ShardedLRUCacheTestThread(ShardedLRUCache<int, std::string>* cache_, int thread_index_) : cache(cache_), thread_index(thread_index_) {}
+
+	virtual void run()
+	{
+		uint32 rng_state = 1234567u + thread_index * 7919u;
+		for(int i=0; i<100000; ++i)
+		{
+			rng_state = rng_state * 1664525u + 1013904223u; // LCG
+			const int key = (int)((rng_state >> 8) % 1000);
+			const uint32 op = (rng_state >> 4) % 8;
+
+			std::string value;
+			if(op == 0)
+				cache->insert(key, toString(key), /*size_B=*/10, /*used=*/false);
+			else if(op == 1)
+			{
+				if(cache->findAndMarkUsed(key, value))
+				{
+					testAssert(value == toString(key));
+					cache->itemBecameUnused(key);
+				}
+			}
+			else if(op == 2)
+				cache->erase(key);
+			else
+			{
+				if(cache->find(key, value))
+					testAssert(value == toString(key));
+			}
+		}
+	}
+
+	ShardedLRUCache<int, std::string>* cache;
+	int thread_index;
+};
+
+}
+
+
+void testShardedLRUCache()
+{
+	conPrint("testShardedLRUCache()");
+
+	// Test unused items are evicted in LRU order when over budget, and used items are never evicted.
+	{
+		std::vector<std::string> evicted;
+		ShardedLRUCache<std::string, int> cache(/*max_size_B=*/3 * sizeof(int), /*num_shards=*/4);
+		cache.setEvictionCallback([&](const std::string& key, int& /*value*/) { evicted.push_back(key); });
+
+		cache.insert("a", 1, sizeof(int), /*used=*/false);
+		cache.insert("b", 2, sizeof(int), /*used=*/false);
+		cache.insert("c", 3, sizeof(int), /*used=*/false);
+		testAssert(cache.numItems() == 3);
+		testAssert(cache.numUnusedItems() == 3);
+		testAssert(cache.totalValueSizeB() == 3 * sizeof(int));
+		testAssert(evicted.empty());
+		cache.invariant();
+
+		cache.itemWasUsed("a"); // LRU order is now b, c, a
+
+		cache.insert("d", 4, sizeof(int), /*used=*/false);
+		testAssert(evicted.size() == 1 && evicted[0] == "b");
+		testAssert(!cache.isInserted("b"));
+		testAssert(cache.totalValueSizeB() == 3 * sizeof(int));
+
+		int val = 0;
+		testAssert(cache.find("c", val) && val == 3); // LRU order is now a, d, c
+		cache.insert("e", 5, sizeof(int), /*used=*/false);
+		testAssert(evicted.size() == 2 && evicted[1] == "a");
+		cache.invariant();
+
+		// Mark all items as used.  Inserting more items should go over budget without evicting anything.
+		testAssert(cache.findAndMarkUsed("c", val) && val == 3);
+		cache.itemBecameUsed("d");
+		cache.itemBecameUsed("e");
+		testAssert(cache.numUnusedItems() == 0);
+		cache.insert("f", 6, sizeof(int), /*used=*/true);
+		testAssert(evicted.size() == 2);
+		testAssert(cache.numItems() == 4);
+		testAssert(cache.totalValueSizeB() == 4 * sizeof(int));
+		cache.invariant();
+
+		// When an item becomes unused while over budget, it should be evicted.
+		cache.itemBecameUnused("d");
+		testAssert(evicted.size() == 3 && evicted[2] == "d");
+		testAssert(cache.numItems() == 3);
+		testAssert(cache.numUnusedItems() == 0);
+
+		// Reducing the budget evicts unused items.
+		cache.itemBecameUnused("f");
+		cache.itemBecameUnused("c");
+		testAssert(evicted.size() == 3);
+		cache.setMaxSizeB(sizeof(int));
+		testAssert(evicted.size() == 5 && evicted[3] == "f" && evicted[4] == "c");
+		testAssert(cache.numItems() == 1 && cache.isInserted("e"));
+		cache.invariant();
+	}
+
+	// Test insert replacing an existing item, erase, removeLRUUnusedItem and clear.
+	{
+		ShardedLRUCache<std::string, int> cache(/*max_size_B=*/1000);
+
+		cache.insert("a", 1, 10, /*used=*/false);
+		cache.insert("a", 2, 20, /*used=*/false);
+		testAssert(cache.numItems() == 1);
+		testAssert(cache.numUnusedItems() == 1);
+		testAssert(cache.totalValueSizeB() == 20);
+		int val = 0;
+		testAssert(cache.find("a", val) && val == 2);
+
+		cache.insert("a", 3, 5, /*used=*/true);
+		testAssert(cache.numUnusedItems() == 0);
+		testAssert(cache.totalValueSizeB() == 5);
+
+		testAssert(!cache.erase("z"));
+		testAssert(cache.erase("a"));
+		testAssert(!cache.find("a", val));
+		testAssert(cache.numItems() == 0);
+		testAssert(cache.totalValueSizeB() == 0);
+
+		cache.insert("b", 1, 10, /*used=*/false);
+		cache.insert("c", 2, 10, /*used=*/true);
+		cache.insert("d", 3, 10, /*used=*/false);
+		std::string removed_key;
+		int removed_val;
+		testAssert(cache.removeLRUUnusedItem(removed_key, removed_val) && removed_key == "b" && removed_val == 1);
+		testAssert(cache.removeLRUUnusedItem(removed_key, removed_val) && removed_key == "d" && removed_val == 3);
+		testAssert(!cache.removeLRUUnusedItem(removed_key, removed_val));
+		testAssert(cache.numItems() == 1);
+		cache.invariant();
+
+		// Functions taking a key should have no effect for keys that are not inserted.
+		cache.itemWasUsed("z");
+		cache.itemBecameUsed("z");
+		cache.itemBecameUnused("z");
+		testAssert(!cache.findAndMarkUsed("z", val));
+
+		cache.clear();
+		testAssert(cache.numItems() == 0);
+		testAssert(cache.numUnusedItems() == 0);
+		testAssert(cache.totalValueSizeB() == 0);
+		cache.invariant();
+
+		// Slots should be reused after clear.
+		for(int i=0; i<100; ++i)
+			cache.insert(toString(i), i, 1, /*used=*/(i % 2) == 0);
+		testAssert(cache.numItems() == 100);
+		testAssert(cache.numUnusedItems() == 50);
+		cache.invariant();
+	}
+
+	// Test that references held by values are released on eviction.
+	{
+		Reference<ThreadSafeRefCounted> ob = new ThreadSafeRefCounted();
+		ShardedLRUCache<int, Reference<ThreadSafeRefCounted>> cache(/*max_size_B=*/1);
+		cache.insert(0, ob, 1, /*used=*/false);
+		testAssert(ob->getRefCount() == 2);
+		cache.insert(1, ob, 1, /*used=*/false); // Should evict item 0.
+		testAssert(!cache.isInserted(0));
+		testAssert(ob->getRefCount() == 2);
+		cache.clear();
+		testAssert(ob->getRefCount() == 1);
+	}
+
+	// Stress test with multiple threads
+	{
+		ShardedLRUCache<int, std::string> cache(/*max_size_B=*/10 * 300);
+		size_t num_evicted = 0;
+		Mutex evicted_mutex;
+		cache.setEvictionCallback([&](const int& key, std::string& value) { testAssert(value == toString(key)); Lock lock(evicted_mutex); num_evicted++; });
+
+		Timer timer;
+		std::vector<Reference<ShardedLRUCacheTestThread>> threads;
+		for(int i=0; i<8; ++i)
+		{
+			threads.push_back(new ShardedLRUCacheTestThread(&cache, i));
+			threads.back()->launch();
+		}
+		for(size_t i=0; i<threads.size(); ++i)
+			threads[i]->join();
+
+		cache.invariant();
+		testAssert(cache.totalValueSizeB() <= 10 * 300);
+		testAssert(cache.totalValueSizeB() == cache.numItems() * 10);
+		testAssert(cache.numUnusedItems() == cache.numItems()); // All items were made unused again after being used.
+		conPrint("Stress test took " + timer.elapsedStringNSigFigs(3) + ", num items: " + toString(cache.numItems()) + ", num evicted: " + toString(num_evicted));
+	}
+
+	conPrint("testShardedLRUCache() done.");
+}
+
+
+#endif // BUILD_TESTS
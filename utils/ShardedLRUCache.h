@@ -0,0 +1,564 @@
+/*=====================================================================
+ShardedLRUCache.h
+-----------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include "HashMap2.h"
+#include "Mutex.h"
+#include "Lock.h"
+#include "Platform.h"
+#include "ThreadSafetyAnalysis.h"
+#include "../maths/mathstypes.h"
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <assert.h>
+
+
+/*=====================================================================
+ShardedLRUCache
+---------------
+A thread-safe cache, with the same used/unused semantics as ManagerWithCache.
+
+Items are split over a number of shards, chosen by key hash, each with its own mutex,
+so threads working on different keys rarely contend.
+
+Items that are in use are never evicted.  Items that are not in use are kept in a
+per-shard intrusive LRU list, threaded through the shard's slot array, so inserting
+and touching items does not allocate per item.
+
+The total size of all items (used and unused) is limited by a cache-wide byte budget.
+When the budget is exceeded, unused items are evicted in approximately global LRU order:
+each unused item is stamped with a cache-wide tick, and the shard whose oldest unused item
+has the smallest tick is chosen for eviction.
+
+The eviction callback, if set, is called for items evicted to stay within the budget,
+or removed with removeLRUUnusedItemsUntilSizeLessEqualN().  It is called without any shard locks held,
+so it may call back into the cache.
+=====================================================================*/
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedLRUCache
+{
+public:
+	typedef std::function<void(const Key& key, Value& value)> EvictionCallback;
+
+	// num_shards will be rounded up to a power of 2.
+	ShardedLRUCache(size_t max_size_B, size_t num_shards = 16);
+	~ShardedLRUCache();
+
+	void setEvictionCallback(EvictionCallback callback) { eviction_callback = callback; } // Not thread-safe, call before using the cache from multiple threads.
+
+	void setMaxSizeB(size_t max_size_B); // Evicts unused items if needed to get within the new budget.
+	size_t getMaxSizeB() const { return max_size_B.load(std::memory_order_relaxed); }
+
+	// Inserts the item, or replaces the value and size if an item with this key is already present.
+	// If used is false the item is added as the most recently used unused item, and may be evicted immediately if the cache is over budget.
+	void insert(const Key& key, const Value& value, size_t value_size_B, bool used = true);
+
+	// Copies the value to value_out and returns true if present.  If the item is unused, it is marked as the most recently used unused item.
+	bool find(const Key& key, Value& value_out);
+
+	// Copies the value to value_out, marks the item as used, and returns true if present.
+	bool findAndMarkUsed(const Key& key, Value& value_out);
+
+	bool isInserted(const Key& key) const;
+
+	// The following have no effect if the key is not present.
+	void itemWasUsed(const Key& key); // If unused, marks as the most recently used unused item.
+	void itemBecameUsed(const Key& key);
+	void itemBecameUnused(const Key& key); // Evicts unused items if the cache is over budget.
+
+	// Removes the item without calling the eviction callback.  Returns true if it was present.
+	bool erase(const Key& key);
+
+	// Removes the (approximately) least recently used unused item.  Does not call the eviction callback.
+	// Returns false if there are no unused items.
+	bool removeLRUUnusedItem(Key& removed_key_out, Value& removed_value_out);
+
+	// Removes unused items, calling the eviction callback on each, until totalValueSizeB() <= max_N or there are no unused items left.
+	void removeLRUUnusedItemsUntilSizeLessEqualN(size_t max_N);
+
+	size_t totalValueSizeB() const { return total_size_B.load(std::memory_order_relaxed); }
+	size_t numItems() const { return num_items.load(std::memory_order_relaxed); }
+	size_t numUnusedItems() const { return num_unused_items.load(std::memory_order_relaxed); }
+	size_t numShards() const { return num_shards; }
+
+	// Removes all items, without calling the eviction callback.
+	void clear();
+
+	void invariant();
+
+private:
+	GLARE_DISABLE_COPY(ShardedLRUCache);
+
+	static constexpr uint32 INVALID_INDEX = std::numeric_limits<uint32>::max();
+	static constexpr uint64 NO_UNUSED_ITEMS_TICK = std::numeric_limits<uint64>::max();
+
+	struct Slot
+	{
+		Key key;
+		Value value;
+		size_t size_B;
+		uint64 unused_tick; // Value of next_tick when the item was last made unused or touched while unused.
+		uint32 prev; // Links in the unused LRU list.  For free slots, next links the free list.
+		uint32 next;
+		bool used;
+		bool occupied;
+	};
+
+	struct GLARE_ALIGN(64) Shard
+	{
+		Shard() : free_slot_head(INVALID_INDEX), lru_head(INVALID_INDEX), lru_tail(INVALID_INDEX), oldest_unused_tick(NO_UNUSED_ITEMS_TICK) {}
+
+		Mutex mutex;
+		HashMap2<Key, uint32, Hash> key_to_slot GUARDED_BY(mutex);
+		std::vector<Slot> slots GUARDED_BY(mutex);
+		uint32 free_slot_head GUARDED_BY(mutex);
+		uint32 lru_head GUARDED_BY(mutex); // Least recently used unused item.
+		uint32 lru_tail GUARDED_BY(mutex); // Most recently used unused item.
+
+		// Tick of the item at lru_head, or NO_UNUSED_ITEMS_TICK.  Written with the mutex held, read without it to pick a shard to evict from.
+		std::atomic<uint64> oldest_unused_tick;
+	};
+
+	Shard& shardForKey(const Key& key) const;
+
+	void unlinkFromLRUList(Shard& shard, uint32 slot_i) REQUIRES(shard.mutex);
+	void appendToLRUList(Shard& shard, uint32 slot_i) REQUIRES(shard.mutex);
+	void markUnused(Shard& shard, uint32 slot_i) REQUIRES(shard.mutex);
+	void markUsed(Shard& shard, uint32 slot_i) REQUIRES(shard.mutex);
+	void freeSlot(Shard& shard, uint32 slot_i, Key* removed_key_out, Value* removed_value_out) REQUIRES(shard.mutex);
+
+	void evictUntilWithinBudget();
+
+	Shard* shards;
+	size_t num_shards;
+	size_t shard_mask;
+	Hash hash_func;
+
+	std::atomic<size_t> max_size_B;
+	std::atomic<size_t> total_size_B;
+	std::atomic<size_t> num_items;
+	std::atomic<size_t> num_unused_items;
+	std::atomic<uint64> next_tick;
+
+	EvictionCallback eviction_callback;
+};
+
+
+void testShardedLRUCache();
+
+
+template <typename Key, typename Value, typename Hash>
+ShardedLRUCache<Key, Value, Hash>::ShardedLRUCache(size_t max_size_B_, size_t num_shards_)
+:	max_size_B(max_size_B_), total_size_B(0), num_items(0), num_unused_items(0), next_tick(0)
+{
+	num_shards = Maths::roundToNextHighestPowerOf2(myMax<size_t>(1, num_shards_));
+	shard_mask = num_shards - 1;
+	shards = new Shard[num_shards];
+}
+
+
+template <typename Key, typename Value, typename Hash>
+ShardedLRUCache<Key, Value, Hash>::~ShardedLRUCache()
+{
+	delete[] shards;
+}
+
+
+template <typename Key, typename Value, typename Hash>
+typename ShardedLRUCache<Key, Value, Hash>::Shard& ShardedLRUCache<Key, Value, Hash>::shardForKey(const Key& key) const
+{
+	// The shard hash maps use the low bits of the hash, so mix and use the high bits to pick the shard.
+	const uint64 h = (uint64)hash_func(key) * 0x9E3779B97F4A7C15ull;
+	return shards[(h >> 40) & shard_mask];
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::unlinkFromLRUList(Shard& shard, uint32 slot_i)
+{
+	Slot& slot = shard.slots[slot_i];
+	if(slot.prev != INVALID_INDEX)
+		shard.slots[slot.prev].next = slot.next;
+	else
+		shard.lru_head = slot.next;
+
+	if(slot.next != INVALID_INDEX)
+		shard.slots[slot.next].prev = slot.prev;
+	else
+		shard.lru_tail = slot.prev;
+
+	slot.prev = slot.next = INVALID_INDEX;
+	shard.oldest_unused_tick.store((shard.lru_head != INVALID_INDEX) ? shard.slots[shard.lru_head].unused_tick : NO_UNUSED_ITEMS_TICK, std::memory_order_relaxed);
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::appendToLRUList(Shard& shard, uint32 slot_i)
+{
+	Slot& slot = shard.slots[slot_i];
+	slot.unused_tick = next_tick.fetch_add(1, std::memory_order_relaxed);
+	slot.prev = shard.lru_tail;
+	slot.next = INVALID_INDEX;
+	if(shard.lru_tail != INVALID_INDEX)
+		shard.slots[shard.lru_tail].next = slot_i;
+	else
+		shard.lru_head = slot_i;
+	shard.lru_tail = slot_i;
+
+	shard.oldest_unused_tick.store(shard.slots[shard.lru_head].unused_tick, std::memory_order_relaxed);
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::markUnused(Shard& shard, uint32 slot_i)
+{
+	Slot& slot = shard.slots[slot_i];
+	if(slot.used)
+	{
+		slot.used = false;
+		appendToLRUList(shard, slot_i);
+		num_unused_items.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::markUsed(Shard& shard, uint32 slot_i)
+{
+	Slot& slot = shard.slots[slot_i];
+	if(!slot.used)
+	{
+		unlinkFromLRUList(shard, slot_i);
+		slot.used = true;
+		num_unused_items.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+
+// Removes the item in the slot from the shard and adds the slot to the free list.
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::freeSlot(Shard& shard, uint32 slot_i, Key* removed_key_out, Value* removed_value_out)
+{
+	Slot& slot = shard.slots[slot_i];
+	assert(slot.occupied);
+	if(!slot.used)
+	{
+		unlinkFromLRUList(shard, slot_i);
+		num_unused_items.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	shard.key_to_slot.erase(slot.key);
+	total_size_B.fetch_sub(slot.size_B, std::memory_order_relaxed);
+	num_items.fetch_sub(1, std::memory_order_relaxed);
+
+	if(removed_key_out)
+		*removed_key_out = slot.key;
+	if(removed_value_out)
+		*removed_value_out = std::move(slot.value);
+
+	slot.key = Key();
+	slot.value = Value(); // Release any references held by the value now.
+	slot.occupied = false;
+	slot.used = true;
+	slot.next = shard.free_slot_head;
+	shard.free_slot_head = slot_i;
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::setMaxSizeB(size_t new_max_size_B)
+{
+	max_size_B.store(new_max_size_B, std::memory_order_relaxed);
+	evictUntilWithinBudget();
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::insert(const Key& key, const Value& value, size_t value_size_B, bool used)
+{
+	{
+		Shard& shard = shardForKey(key);
+		Lock lock(shard.mutex);
+
+		auto res = shard.key_to_slot.find(key);
+		if(res != shard.key_to_slot.end())
+		{
+			const uint32 slot_i = res->second;
+			Slot& slot = shard.slots[slot_i];
+			slot.value = value;
+			total_size_B.fetch_add(value_size_B, std::memory_order_relaxed);
+			total_size_B.fetch_sub(slot.size_B, std::memory_order_relaxed);
+			slot.size_B = value_size_B;
+
+			if(used)
+				markUsed(shard, slot_i);
+			else if(slot.used)
+				markUnused(shard, slot_i);
+			else
+			{
+				unlinkFromLRUList(shard, slot_i);
+				appendToLRUList(shard, slot_i);
+			}
+		}
+		else
+		{
+			uint32 slot_i;
+			if(shard.free_slot_head != INVALID_INDEX)
+			{
+				slot_i = shard.free_slot_head;
+				shard.free_slot_head = shard.slots[slot_i].next;
+			}
+			else
+			{
+				slot_i = (uint32)shard.slots.size();
+				shard.slots.resize(shard.slots.size() + 1);
+			}
+
+			Slot& slot = shard.slots[slot_i];
+			slot.key = key;
+			slot.value = value;
+			slot.size_B = value_size_B;
+			slot.unused_tick = 0;
+			slot.prev = slot.next = INVALID_INDEX;
+			slot.used = true;
+			slot.occupied = true;
+			shard.key_to_slot.insert(std::make_pair(key, slot_i));
+
+			total_size_B.fetch_add(value_size_B, std::memory_order_relaxed);
+			num_items.fetch_add(1, std::memory_order_relaxed);
+
+			if(!used)
+				markUnused(shard, slot_i);
+		}
+	}
+
+	evictUntilWithinBudget();
+}
+
+
+template <typename Key, typename Value, typename Hash>
+bool ShardedLRUCache<Key, Value, Hash>::find(const Key& key, Value& value_out)
+{
+	Shard& shard = shardForKey(key);
+	Lock lock(shard.mutex);
+
+	auto res = shard.key_to_slot.find(key);
+	if(res == shard.key_to_slot.end())
+		return false;
+
+	const uint32 slot_i = res->second;
+	if(!shard.slots[slot_i].used)
+	{
+		unlinkFromLRUList(shard, slot_i);
+		appendToLRUList(shard, slot_i);
+	}
+	value_out = shard.slots[slot_i].value;
+	return true;
+}
+
+
+template <typename Key, typename Value, typename Hash>
+bool ShardedLRUCache<Key, Value, Hash>::findAndMarkUsed(const Key& key, Value& value_out)
+{
+	Shard& shard = shardForKey(key);
+	Lock lock(shard.mutex);
+
+	auto res = shard.key_to_slot.find(key);
+	if(res == shard.key_to_slot.end())
+		return false;
+
+	markUsed(shard, res->second);
+	value_out = shard.slots[res->second].value;
+	return true;
+}
+
+
+template <typename Key, typename Value, typename Hash>
+bool ShardedLRUCache<Key, Value, Hash>::isInserted(const Key& key) const
+{
+	Shard& shard = shardForKey(key);
+	Lock lock(shard.mutex);
+	return shard.key_to_slot.count(key) != 0;
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::itemWasUsed(const Key& key)
+{
+	Shard& shard = shardForKey(key);
+	Lock lock(shard.mutex);
+
+	auto res = shard.key_to_slot.find(key);
+	if(res != shard.key_to_slot.end() && !shard.slots[res->second].used)
+	{
+		unlinkFromLRUList(shard, res->second);
+		appendToLRUList(shard, res->second);
+	}
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::itemBecameUsed(const Key& key)
+{
+	Shard& shard = shardForKey(key);
+	Lock lock(shard.mutex);
+
+	auto res = shard.key_to_slot.find(key);
+	if(res != shard.key_to_slot.end())
+		markUsed(shard, res->second);
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::itemBecameUnused(const Key& key)
+{
+	{
+		Shard& shard = shardForKey(key);
+		Lock lock(shard.mutex);
+
+		auto res = shard.key_to_slot.find(key);
+		if(res == shard.key_to_slot.end())
+			return;
+
+		markUnused(shard, res->second);
+	}
+
+	evictUntilWithinBudget();
+}
+
+
+template <typename Key, typename Value, typename Hash>
+bool ShardedLRUCache<Key, Value, Hash>::erase(const Key& key)
+{
+	Value removed_value; // Destroy the removed value after the lock is released.
+	{
+		Shard& shard = shardForKey(key);
+		Lock lock(shard.mutex);
+
+		auto res = shard.key_to_slot.find(key);
+		if(res == shard.key_to_slot.end())
+			return false;
+
+		freeSlot(shard, res->second, /*removed_key_out=*/NULL, &removed_value);
+	}
+	return true;
+}
+
+
+template <typename Key, typename Value, typename Hash>
+bool ShardedLRUCache<Key, Value, Hash>::removeLRUUnusedItem(Key& removed_key_out, Value& removed_value_out)
+{
+	while(1)
+	{
+		// Find the shard whose oldest unused item is the oldest.  This is done without locking, so the choice may be slightly stale.
+		size_t best_shard = 0;
+		uint64 best_tick = NO_UNUSED_ITEMS_TICK;
+		for(size_t i=0; i<num_shards; ++i)
+		{
+			const uint64 tick = shards[i].oldest_unused_tick.load(std::memory_order_relaxed);
+			if(tick < best_tick)
+			{
+				best_tick = tick;
+				best_shard = i;
+			}
+		}
+
+		if(best_tick == NO_UNUSED_ITEMS_TICK)
+			return false;
+
+		Shard& shard = shards[best_shard];
+		Lock lock(shard.mutex);
+		if(shard.lru_head != INVALID_INDEX) // Another thread may have emptied the list since we read oldest_unused_tick, in which case try again.
+		{
+			freeSlot(shard, shard.lru_head, &removed_key_out, &removed_value_out);
+			return true;
+		}
+	}
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::removeLRUUnusedItemsUntilSizeLessEqualN(size_t max_N)
+{
+	Key key;
+	Value value;
+	while(totalValueSizeB() > max_N)
+	{
+		if(!removeLRUUnusedItem(key, value))
+			break;
+
+		if(eviction_callback)
+			eviction_callback(key, value);
+		value = Value();
+	}
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::evictUntilWithinBudget()
+{
+	removeLRUUnusedItemsUntilSizeLessEqualN(max_size_B.load(std::memory_order_relaxed));
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::clear()
+{
+	for(size_t i=0; i<num_shards; ++i)
+	{
+		Shard& shard = shards[i];
+		Lock lock(shard.mutex);
+
+		for(size_t z=0; z<shard.slots.size(); ++z)
+			if(shard.slots[z].occupied)
+				freeSlot(shard, (uint32)z, /*removed_key_out=*/NULL, /*removed_value_out=*/NULL);
+	}
+}
+
+
+template <typename Key, typename Value, typename Hash>
+void ShardedLRUCache<Key, Value, Hash>::invariant()
+{
+#ifndef NDEBUG
+	for(size_t i=0; i<num_shards; ++i)
+	{
+		Shard& shard = shards[i];
+		Lock lock(shard.mutex);
+
+		size_t num_occupied = 0;
+		size_t num_unused = 0;
+		for(size_t z=0; z<shard.slots.size(); ++z)
+			if(shard.slots[z].occupied)
+			{
+				num_occupied++;
+				if(!shard.slots[z].used)
+					num_unused++;
+				assert(shard.key_to_slot.count(shard.slots[z].key) == 1);
+			}
+		assert(num_occupied == shard.key_to_slot.size());
+
+		// Walk the LRU list, check it contains each unused item once, in increasing tick order.
+		size_t list_len = 0;
+		uint64 last_tick = 0;
+		uint32 prev = INVALID_INDEX;
+		for(uint32 z = shard.lru_head; z != INVALID_INDEX; z = shard.slots[z].next)
+		{
+			assert(shard.slots[z].occupied && !shard.slots[z].used);
+			assert(shard.slots[z].prev == prev);
+			assert(shard.slots[z].unused_tick >= last_tick);
+			last_tick = shard.slots[z].unused_tick;
+			prev = z;
+			list_len++;
+		}
+		assert(prev == shard.lru_tail);
+		assert(list_len == num_unused);
+		assert(shard.oldest_unused_tick.load() == ((shard.lru_head != INVALID_INDEX) ? shard.slots[shard.lru_head].unused_tick : NO_UNUSED_ITEMS_TICK));
+	}
+#endif
+}
@@ -11,7 +11,7 @@ namespace glare
 
 
 Task::Task()
-:	task_group(NULL), allocator(NULL), in_queue(false), is_quit_runner_task(false)
+:	task_group(NULL), allocator(NULL), queue(NULL), is_quit_runner_task(false)
 {}
 
 
@@ -20,4 +20,9 @@ Task::~Task()
 }
 
 
+TaskGroup::TaskGroup()
+:	num_unfinished_tasks(0), parent_group(NULL), child_groups_version(0), num_helper_threads(0)
+{}
+
+
 } // end namespace glare 
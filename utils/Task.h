@@ -12,6 +12,7 @@ Copyright Glare Technologies Limited 2024 -
 #include "Condition.h"
 #include <stdlib.h>
 #include <vector>
+#include <atomic>
 
 
 namespace glare
@@ -19,6 +20,7 @@ namespace glare
 
 class Task;
 class TaskGroup;
+class TaskDeque;
 
 
 class TaskAllocator
@@ -53,7 +55,7 @@ public:
 	// Task manager task queue linked list pointers:
 	Task* prev;		// guarded by task manager queue mutex.
 	Task* next;		// guarded by task manager queue mutex.
-	bool in_queue;	// guarded by task manager queue mutex.
+	std::atomic<TaskDeque*> queue; // The queue this task is currently in, or NULL if not in a queue.  Only modified while holding the mutex of that queue.
 
 	bool is_quit_runner_task;
 private:
@@ -66,11 +68,19 @@ typedef Reference<Task> TaskRef;
 class TaskGroup : public ::ThreadSafeRefCounted
 {
 public:
+	TaskGroup();
+
 	std::vector<TaskRef> tasks;
 
 	Condition num_unfinished_tasks_cond;
 	mutable ::Mutex num_unfinished_tasks_mutex;
 	int num_unfinished_tasks	GUARDED_BY(num_unfinished_tasks_mutex);
+
+	// Used by TaskManager::runTaskGroup() to let a thread waiting for this group execute queued tasks from task groups run by tasks in this group.
+	TaskGroup* parent_group							GUARDED_BY(num_unfinished_tasks_mutex); // Group of the task that called runTaskGroup() on this group, if any.
+	std::vector<Reference<TaskGroup> > child_groups	GUARDED_BY(num_unfinished_tasks_mutex); // Groups currently being run by tasks in this group, or by their descendants' tasks.
+	int64 child_groups_version						GUARDED_BY(num_unfinished_tasks_mutex); // Incremented when a descendant group starts running.
+	int num_helper_threads							GUARDED_BY(num_unfinished_tasks_mutex); // Number of threads currently looking for queued tasks in this group.
 };
 
 typedef Reference<TaskGroup> TaskGroupRef;
@@ -0,0 +1,141 @@
+/*=====================================================================
+TaskDeque.cpp
+-------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "TaskDeque.h"
+
+
+#include "Lock.h"
+
+
+namespace glare
+{
+
+
+TaskDeque::TaskDeque()
+{
+	Lock lock(mutex);
+	head = NULL;
+	tail = NULL;
+}
+
+
+TaskDeque::~TaskDeque()
+{
+	// Release any references to tasks still in the deque.
+	Lock lock(mutex);
+	while(head)
+		popFrontLocked();
+}
+
+
+void TaskDeque::pushBackLocked(Task* task)
+{
+	assert(task->queue.load() == NULL);
+
+	task->incRefCount(); // Add queue reference
+
+	if(tail)
+	{
+		tail->next = task;
+		task->prev = tail;
+		task->next = NULL;
+		tail = task;
+	}
+	else // else if queue was empty:
+	{
+		task->prev = NULL;
+		task->next = NULL;
+		head = tail = task;
+	}
+	task->queue = this;
+}
+
+
+TaskRef TaskDeque::popFrontLocked()
+{
+	if(!head)
+		return TaskRef();
+
+	TaskRef removed_task = head;
+	assert(removed_task->getRefCount() >= 2); // There should be removed_task reference and queue reference.
+	removed_task->decRefCount(); // Remove queue reference to task
+
+	Task* next_task = head->next;
+	if(next_task)
+	{
+		head = next_task;
+		next_task->prev = NULL;
+	}
+	else // else we removed the only task in the queue:
+	{
+		head = tail = NULL;
+	}
+
+	removed_task->queue = NULL;
+	return removed_task;
+}
+
+
+TaskRef TaskDeque::popBackLocked()
+{
+	if(!tail)
+		return TaskRef();
+
+	TaskRef removed_task = tail;
+	assert(removed_task->getRefCount() >= 2); // There should be removed_task reference and queue reference.
+	removed_task->decRefCount(); // Remove queue reference to task
+
+	Task* prev_task = tail->prev;
+	if(prev_task)
+	{
+		tail = prev_task;
+		prev_task->next = NULL;
+	}
+	else // else we removed the only task in the queue:
+	{
+		head = tail = NULL;
+	}
+
+	removed_task->queue = NULL;
+	return removed_task;
+}
+
+
+bool TaskDeque::removeLocked(Task* task)
+{
+	if(task->queue.load() != this)
+		return false;
+
+	if(head == task)
+		head = task->next;
+	if(tail == task)
+		tail = task->prev;
+
+	if(task->prev)
+		task->prev->next = task->next;
+	if(task->next)
+		task->next->prev = task->prev;
+
+	task->decRefCount(); // Remove queue reference
+	assert(task->getRefCount() >= 1); // Caller should be holding a reference as well.
+	task->queue = NULL;
+	return true;
+}
+
+
+bool TaskDeque::tryRemoveFromQueue(Task* task)
+{
+	// Since task->queue is only modified while holding the mutex of the queue the task is being inserted into or removed from, 
+	// if task->queue is still the same queue after we lock the queue mutex, the task is in that queue.
+	TaskDeque* queue = task->queue.load();
+	if(!queue)
+		return false;
+
+	Lock lock(queue->mutex);
+	return queue->removeLocked(task);
+}
+
+
+} // end namespace glare 
@@ -0,0 +1,56 @@
+/*=====================================================================
+TaskDeque.h
+-----------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "Task.h"
+#include "Mutex.h"
+#include "ThreadSafetyAnalysis.h"
+
+
+namespace glare
+{
+
+
+/*=====================================================================
+TaskDeque
+---------
+An intrusive doubly-linked list of tasks, using Task::prev, Task::next and 
+Task::queue.  Used by TaskManager for the global task queue, and for the 
+per-thread deques in work-stealing mode.
+
+The owning thread pushes and pops at the back, thieves pop from the front.
+
+The deque holds a reference to each task in it.
+The 'Locked' methods should only be called while holding mutex.
+=====================================================================*/
+class GLARE_ALIGN(64) TaskDeque // Aligned to avoid false sharing between per-thread deques.
+{
+public:
+	TaskDeque();
+	~TaskDeque();
+
+	void pushBackLocked(Task* task) REQUIRES(mutex);
+
+	TaskRef popFrontLocked() REQUIRES(mutex); // Returns NULL reference if empty.
+	TaskRef popBackLocked() REQUIRES(mutex); // Returns NULL reference if empty.
+
+	// Removes task from this deque, if it is in this deque.  Returns true if removed.
+	bool removeLocked(Task* task) REQUIRES(mutex);
+
+	// Removes task from whatever deque it is in, if any.  Locks the deque mutex.  Returns true if removed.
+	// Whoever removes the task from its deque is responsible for executing it.
+	static bool tryRemoveFromQueue(Task* task);
+
+	bool emptyLocked() const REQUIRES(mutex) { return head == NULL; }
+
+	mutable ::Mutex mutex;
+	Task* head GUARDED_BY(mutex);
+	Task* tail GUARDED_BY(mutex);
+};
+
+
+} // end namespace glare 
@@ -17,11 +17,20 @@ namespace glare
 {
 
 
+// The task manager and thread index of the TaskRunnerThread running on the current thread, if any.
+static GLARE_THREAD_LOCAL TaskManager* current_thread_task_manager = NULL;
+static GLARE_THREAD_LOCAL size_t current_thread_index = 0;
+
+// The task group of the task currently being executed on this thread (and the manager executing it), if any.
+static GLARE_THREAD_LOCAL TaskGroup* current_thread_task_group = NULL;
+static GLARE_THREAD_LOCAL TaskManager* current_thread_task_group_manager = NULL;
+
+
 TaskManager::TaskManager(size_t num_threads)
 :	num_unfinished_tasks(0),
 	name("task manager")
 {
-	init(num_threads);
+	init(num_threads, SchedulingMode_GlobalQueue);
 }
 
 
@@ -29,23 +38,40 @@ TaskManager::TaskManager(const std::string& name_, size_t num_threads)
 :	num_unfinished_tasks(0),
 	name(name_)
 {
-	init(num_threads);
+	init(num_threads, SchedulingMode_GlobalQueue);
 }
 
 
-void TaskManager::init(size_t num_threads)
+TaskManager::TaskManager(const std::string& name_, size_t num_threads, SchedulingMode scheduling_mode_)
+:	num_unfinished_tasks(0),
+	name(name_)
 {
-	{
-		Lock lock(queue_mutex);
-		task_queue_head = NULL;
-		task_queue_tail = NULL;
-	}
+	init(num_threads, scheduling_mode_);
+}
+
 
+void TaskManager::init(size_t num_threads, SchedulingMode scheduling_mode_)
+{
 	if(num_threads == std::numeric_limits<size_t>::max()) // If auto-choosing num threads
 		threads.resize(myMax<unsigned int>(1, PlatformUtils::getNumLogicalProcessors()) - 1); // Since we will process work on the calling thread of runTaskGroup, we only need getNumLogicalProcessors() - 1 worker threads.
 	else
 		threads.resize(num_threads);
 
+	// Work stealing needs at least one worker thread with a deque.  With zero threads, tasks are executed in waitForTasksToComplete() from the global queue.
+	scheduling_mode = threads.empty() ? SchedulingMode_GlobalQueue : scheduling_mode_;
+
+	thread_queues = NULL;
+	next_thread_queue = 0;
+	num_queued_tasks = 0;
+	num_sleeping_threads = 0;
+	{
+		Lock lock(sleep_mutex);
+		quitting = false;
+	}
+
+	if(scheduling_mode == SchedulingMode_WorkStealing)
+		thread_queues = new TaskDeque[threads.size()];
+
 	for(size_t i=0; i<threads.size(); ++i)
 	{
 		threads[i] = new TaskRunnerThread(this, i);
@@ -64,14 +90,26 @@ public:
 
 TaskManager::~TaskManager()
 {
-	// Send a QuitRunnerTask task to all threads, to tell them to quit.
-	// NOTE: can't use the same QuitRunnerTask object for all threads as each object can only be inserted in queue once due to linked list stuff.
-	for(size_t i=0; i<threads.size(); ++i)
-		enqueueTaskInternal(new QuitRunnerTask());
+	if(scheduling_mode == SchedulingMode_GlobalQueue)
+	{
+		// Send a QuitRunnerTask task to all threads, to tell them to quit.
+		// NOTE: can't use the same QuitRunnerTask object for all threads as each object can only be inserted in queue once due to linked list stuff.
+		for(size_t i=0; i<threads.size(); ++i)
+			enqueueTaskInternal(new QuitRunnerTask());
+	}
+	else
+	{
+		// Threads will terminate once they run out of tasks to execute.
+		Lock lock(sleep_mutex);
+		quitting = true;
+		work_available.notifyAll();
+	}
 
 	// Wait for threads to quit.
 	for(size_t i=0; i<threads.size(); ++i)
 		threads[i]->join();
+
+	delete[] thread_queues;
 }
 
 
@@ -86,25 +124,16 @@ void TaskManager::setThreadPriorities(MyThread::Priority priority)
 
 void TaskManager::enqueueTaskInternal(Task* task)
 {
-	task->incRefCount();
+	if(scheduling_mode == SchedulingMode_WorkStealing)
+	{
+		const TaskRef task_ref(task);
+		enqueueWorkStealingTasks(&task_ref, 1);
+		return;
+	}
 
 	{
-		Lock lock(queue_mutex);
-		// Insert at tail of queue linked list
-		if(task_queue_tail)
-		{
-			task_queue_tail->next = task;
-			task->prev = task_queue_tail;
-			task->next = NULL;
-			task_queue_tail = task;
-		}
-		else // else if queue was empty:
-		{
-			task->prev = NULL;
-			task->next = NULL;
-			task_queue_head = task_queue_tail = task;
-		}
-		task->in_queue = true;
+		Lock lock(global_queue.mutex);
+		global_queue.pushBackLocked(task);
 	}
 
 	queue_nonempty.notify();
@@ -113,30 +142,17 @@ void TaskManager::enqueueTaskInternal(Task* task)
 
 void TaskManager::enqueueTasksInternal(const TaskRef* tasks, size_t num_tasks)
 {
+	if(scheduling_mode == SchedulingMode_WorkStealing)
 	{
-		Lock lock(queue_mutex);
+		enqueueWorkStealingTasks(tasks, num_tasks);
+		return;
+	}
 
-		for(size_t i=0; i<num_tasks; ++i)
-		{
-			Task* task = tasks[i].ptr();
-			task->incRefCount();
+	{
+		Lock lock(global_queue.mutex);
 
-			// Insert at tail of queue linked list
-			if(task_queue_tail)
-			{
-				task_queue_tail->next = task;
-				task->prev = task_queue_tail;
-				task->next = NULL;
-				task_queue_tail = task;
-			}
-			else // else if queue was empty:
-			{
-				task->prev = NULL;
-				task->next = NULL;
-				task_queue_head = task_queue_tail = task;
-			}
-			task->in_queue = true;
-		}
+		for(size_t i=0; i<num_tasks; ++i)
+			global_queue.pushBackLocked(tasks[i].ptr());
 	}
 
 	 // Notify all suspended threads that there are items in the queue.  NOTE: the use of notifyAll here is potentially slow if the number of threads is >> num_tasks.
@@ -147,33 +163,152 @@ void TaskManager::enqueueTasksInternal(const TaskRef* tasks, size_t num_tasks)
 // Blocks until there is something to remove from queue
 TaskRef TaskManager::dequeueTaskInternal()
 {
-	Lock lock(queue_mutex);
+	Lock lock(global_queue.mutex);
 
 	while(1)
 	{
-		if(task_queue_head)
+		TaskRef removed_task = global_queue.popFrontLocked();
+		if(removed_task)
+			return removed_task;
+
+		queue_nonempty.wait(global_queue.mutex);
+	}
+}
+
+
+size_t TaskManager::getCurrentThreadIndex() const
+{
+	return (current_thread_task_manager == this) ? current_thread_index : threads.size();
+}
+
+
+bool TaskManager::tryRemoveQueuedTask(Task* task)
+{
+	if(TaskDeque::tryRemoveFromQueue(task))
+	{
+		if(scheduling_mode == SchedulingMode_WorkStealing)
+			num_queued_tasks--;
+		return true;
+	}
+	else
+		return false;
+}
+
+
+void TaskManager::enqueueWorkStealingTasks(const TaskRef* tasks, size_t num_tasks)
+{
+	assert(scheduling_mode == SchedulingMode_WorkStealing);
+	if(num_tasks == 0)
+		return;
+
+	const size_t num_queues = threads.size();
+	const size_t cur_thread_index = getCurrentThreadIndex();
+	if(cur_thread_index < num_queues)
+	{
+		// We are being called from a task running in one of our TaskRunnerThreads.  Push the tasks onto the deque for this thread.
+		// Other threads can steal them if they are idle.
+		TaskDeque& queue = thread_queues[cur_thread_index];
+		Lock lock(queue.mutex);
+		for(size_t i=0; i<num_tasks; ++i)
+			queue.pushBackLocked(tasks[i].ptr());
+	}
+	else
+	{
+		// Distribute tasks round-robin over the thread deques.
+		const size_t first_queue_index = next_thread_queue.fetch_add(num_tasks) % num_queues;
+
+		for(size_t i=0; i<num_tasks; ++i)
 		{
-			TaskRef removed_task = task_queue_head;
-			assert(removed_task->getRefCount() >= 2); // There should be removed_task reference and queue reference.
-			removed_task->decRefCount(); // Remove queue reference to task
+			TaskDeque& queue = thread_queues[(first_queue_index + i) % num_queues];
+			Lock lock(queue.mutex);
+			queue.pushBackLocked(tasks[i].ptr());
+		}
+	}
 
-			// Update queue head, tail and next task pointers.
-			Task* next_task = task_queue_head->next;
-			if(next_task)
-			{
-				task_queue_head = next_task;
-				next_task->prev = NULL;
-			}
-			else // else we removed the only task in the queue:
-			{
-				task_queue_head = task_queue_tail = NULL;
-			}
+	num_queued_tasks += (int)num_tasks;
 
-			removed_task->in_queue = false;
-			return removed_task;
+	notifyWorkStealingThreads(num_tasks);
+}
+
+
+void TaskManager::notifyWorkStealingThreads(size_t num_tasks)
+{
+	// num_queued_tasks has been incremented before we read num_sleeping_threads here, and a thread going to sleep increments num_sleeping_threads before re-reading
+	// num_queued_tasks while holding sleep_mutex.  Since both are sequentially consistent, either we will see the sleeping thread, or it will see the new tasks.
+	if(num_sleeping_threads.load() > 0)
+	{
+		Lock lock(sleep_mutex);
+		if(num_tasks == 1)
+			work_available.notify();
+		else
+			work_available.notifyAll();
+	}
+}
+
+
+// Returns a NULL reference if no task could be found.
+TaskRef TaskManager::tryDequeueWorkStealingTask(size_t thread_index)
+{
+	if(num_queued_tasks.load() <= 0)
+		return TaskRef();
+
+	// Pop from the back of our own deque.
+	{
+		TaskDeque& queue = thread_queues[thread_index];
+		Lock lock(queue.mutex);
+		TaskRef task = queue.popBackLocked();
+		if(task)
+		{
+			num_queued_tasks--;
+			return task;
+		}
+	}
+
+	// Our deque is empty, try and steal from the front of the other threads' deques.
+	const size_t num_queues = threads.size();
+	for(size_t i=1; i<num_queues; ++i)
+	{
+		TaskDeque& victim_queue = thread_queues[(thread_index + i) % num_queues];
+		Lock lock(victim_queue.mutex);
+		TaskRef task = victim_queue.popFrontLocked();
+		if(task)
+		{
+			num_queued_tasks--;
+			return task;
+		}
+	}
+
+	return TaskRef();
+}
+
+
+// Blocks until there is a task to execute.  Returns a NULL reference if the task manager is quitting and there are no more tasks.
+TaskRef TaskManager::dequeueWorkStealingTask(size_t thread_index)
+{
+	while(1)
+	{
+		TaskRef task = tryDequeueWorkStealingTask(thread_index);
+		if(task)
+			return task;
+
+		Lock lock(sleep_mutex);
+		num_sleeping_threads++;
+
+		if(num_queued_tasks.load() > 0)
+		{
+			// A task was queued since we looked, go and get it.
+			num_sleeping_threads--;
+			continue;
+		}
+
+		if(quitting)
+		{
+			num_sleeping_threads--;
+			return TaskRef();
 		}
 
-		queue_nonempty.wait(queue_mutex);
+		work_available.wait(sleep_mutex);
+		num_sleeping_threads--;
 	}
 }
 
@@ -205,9 +340,17 @@ void TaskManager::runTaskGroup(TaskGroupRef task_group)
 	if(task_group->tasks.empty())
 		return;
 
+	// If we are being called from a task in a TaskRunnerThread, run tasks with that thread's index, so that per-thread data indexed by thread_index is not shared with another thread.
+	const size_t thread_index = getCurrentThreadIndex();
+
+	// If we are being called from a task in a task group of this task manager, this group is nested in that group.
+	TaskGroup* parent_group = (current_thread_task_group_manager == this) ? current_thread_task_group : NULL;
+
 	{
 		Lock lock(task_group->num_unfinished_tasks_mutex);
+		assert(task_group->num_unfinished_tasks == 0 && task_group->num_helper_threads == 0 && task_group->child_groups.empty());
 		task_group->num_unfinished_tasks = (int)task_group->tasks.size();
+		task_group->parent_group = parent_group;
 	}
 
 	for(size_t i=0; i<task_group->tasks.size(); ++i)
@@ -218,70 +361,155 @@ void TaskManager::runTaskGroup(TaskGroupRef task_group)
 		num_unfinished_tasks += (int)task_group->tasks.size();
 	}
 
+	if(parent_group)
+		registerChildGroup(parent_group, task_group);
+
 	// Add all but the first task to the queue.  We will start processing the first task directly below.
 	assert(task_group->tasks.size() >= 1);
 	enqueueTasksInternal(task_group->tasks.data() + 1, task_group->tasks.size() - 1);
 
+	// Task 0 was never inserted into queue
+	executeTask(task_group->tasks[0].ptr(), thread_index);
 
-	for(size_t i=0; i<task_group->tasks.size(); ++i)
+	for(size_t i=1; i<task_group->tasks.size(); ++i)
 	{
 		Task* task = task_group->tasks[i].ptr();
-		// Try and remove this task from the global task queue.  Note that the task may not be at the head of the queue.
+		// Try and remove this task from the task queue it was inserted into.  Note that the task may not be at the head of the queue.
 		// It also may not be in the queue at all, if it has already been removed by a TaskRunnerThread.
-		// We will detect this by checking task->in_queue.
-		bool run_task;
-		if(i == 0)
+		if(tryRemoveQueuedTask(task))
+			executeTask(task, thread_index);
+	}
+
+	// Block until all group tasks are done, i.e. task_group->num_unfinished_tasks == 0.
+	// While waiting, execute any queued tasks from groups that the group's tasks (running in other threads) are running.
+	while(1)
+	{
+		int64 child_groups_version;
 		{
-			// Task 0 was never inserted into queue
-			run_task = true;
+			Lock lock(task_group->num_unfinished_tasks_mutex);
+			if(task_group->num_unfinished_tasks == 0)
+				break;
+			child_groups_version = task_group->child_groups_version;
 		}
-		else
+
+		if(runQueuedDescendantGroupTasks(task_group.ptr(), thread_index))
+			continue;
+
+		// There was nothing to help with.  Wait until either all tasks are done, or a new descendant group has started.
+		Lock lock(task_group->num_unfinished_tasks_mutex);
+		while((task_group->num_unfinished_tasks != 0) && (task_group->child_groups_version == child_groups_version))
+			task_group->num_unfinished_tasks_cond.wait(task_group->num_unfinished_tasks_mutex);
+	}
+
+	if(parent_group)
+		unregisterChildGroup(parent_group, task_group.ptr());
+
+	// Wait for any threads looking for queued tasks in this group to finish, as the group (and its tasks vector) may be modified or freed as soon as we return.
+	{
+		Lock lock(task_group->num_unfinished_tasks_mutex);
+		while(task_group->num_helper_threads != 0)
+			task_group->num_unfinished_tasks_cond.wait(task_group->num_unfinished_tasks_mutex);
+		task_group->parent_group = NULL;
+	}
+}
+
+
+void TaskManager::registerChildGroup(TaskGroup* parent_group, const TaskGroupRef& child_group)
+{
+	{
+		Lock lock(parent_group->num_unfinished_tasks_mutex);
+		parent_group->child_groups.push_back(child_group);
+	}
+
+	// Wake up any thread waiting on the parent group or its ancestors, so that it can help execute the tasks of the new group.
+	// The ancestor groups can't finish while we are running, so the parent_group pointers are valid.
+	for(TaskGroup* group = parent_group; group != NULL; )
+	{
+		Lock lock(group->num_unfinished_tasks_mutex);
+		group->child_groups_version++;
+		group->num_unfinished_tasks_cond.notifyAll();
+		group = group->parent_group;
+	}
+}
+
+
+void TaskManager::unregisterChildGroup(TaskGroup* parent_group, TaskGroup* child_group)
+{
+	Lock lock(parent_group->num_unfinished_tasks_mutex);
+	for(size_t i=0; i<parent_group->child_groups.size(); ++i)
+		if(parent_group->child_groups[i].ptr() == child_group)
 		{
-			Lock lock(queue_mutex);
-			run_task = task->in_queue;
-			if(task->in_queue)
-			{
-				// Remove from queue:
-				if(task_queue_head == task)
-					task_queue_head = task->next;
-
-				if(task_queue_tail == task)
-					task_queue_tail = task->prev;
-
-				if(task->prev)
-					task->prev->next = task->next;
-				if(task->next)
-					task->next->prev = task->prev;
-				
-				task->decRefCount(); // Remove queue reference
-				assert(task->getRefCount() >= 1); // There should still be the reference from task_group->tasks.
-				task->in_queue = false;
-			}
+			parent_group->child_groups[i] = parent_group->child_groups.back();
+			parent_group->child_groups.pop_back();
+			return;
 		}
+	assert(0);
+}
 
-		if(run_task)
-		{
-			task_group->tasks[i]->run(/*thread index=*/threads.size());
 
-			taskFinished();
+bool TaskManager::runQueuedDescendantGroupTasks(TaskGroup* task_group, size_t thread_index)
+{
+	std::vector<TaskGroupRef> child_groups;
+	{
+		Lock lock(task_group->num_unfinished_tasks_mutex);
+		if(task_group->child_groups.empty())
+			return false;
+		child_groups = task_group->child_groups;
+	}
 
+	bool executed_task = false;
+	for(size_t z=0; z<child_groups.size(); ++z)
+	{
+		TaskGroup* child_group = child_groups[z].ptr();
+
+		// The thread running the child group may have finished with it since we copied child_groups.  Only look at it if it is still running.
+		// Incrementing num_helper_threads stops runTaskGroup() from returning (and the group's tasks vector from being modified) until we are done with it.
+		{
+			Lock lock(child_group->num_unfinished_tasks_mutex);
+			if(child_group->num_unfinished_tasks == 0)
+				continue;
+			child_group->num_helper_threads++;
+		}
+
+		for(size_t i=0; i<child_group->tasks.size(); ++i)
+		{
+			Task* task = child_group->tasks[i].ptr();
+			if(tryRemoveQueuedTask(task))
 			{
-				Lock lock(task_group->num_unfinished_tasks_mutex);
-				task_group->num_unfinished_tasks--;
+				executeTask(task, thread_index);
+				executed_task = true;
 			}
 		}
-	}
 
-	// Block until all group tasks are done, i.e. task_group->num_unfinished_tasks == 0
-	{
-		Lock lock(task_group->num_unfinished_tasks_mutex);
-		while(1)
-		{	
-			if(task_group->num_unfinished_tasks == 0)
-				break;
-			task_group->num_unfinished_tasks_cond.wait(task_group->num_unfinished_tasks_mutex);
+		if(runQueuedDescendantGroupTasks(child_group, thread_index))
+			executed_task = true;
+
+		{
+			Lock lock(child_group->num_unfinished_tasks_mutex);
+			child_group->num_helper_threads--;
+			if(child_group->num_helper_threads == 0)
+				child_group->num_unfinished_tasks_cond.notifyAll();
 		}
 	}
+
+	return executed_task;
+}
+
+
+void TaskManager::executeTask(Task* task, size_t thread_index)
+{
+	// Set the current task group, so that any task groups run by the task are known to be nested in it.
+	TaskGroup* const prev_task_group = current_thread_task_group;
+	TaskManager* const prev_task_group_manager = current_thread_task_group_manager;
+	current_thread_task_group = task->task_group;
+	current_thread_task_group_manager = this;
+
+	task->run(thread_index);
+
+	current_thread_task_group = prev_task_group;
+	current_thread_task_group_manager = prev_task_group_manager;
+
+	taskFinished(task);
 }
 
 
@@ -301,21 +529,30 @@ bool TaskManager::areAllTasksComplete() const
 
 void TaskManager::removeQueuedTasks()
 {
-	Lock lock(queue_mutex);
-	while(task_queue_head)
+	const size_t num_queues = (scheduling_mode == SchedulingMode_WorkStealing) ? threads.size() : 1;
+	for(size_t q=0; q<num_queues; ++q)
 	{
-		TaskRef task = task_queue_head; // Make a reference that can destroy the object if needed.
-		task->removedFromQueue();
-		task_queue_head->decRefCount(); // Remove queue reference
-		task_queue_head = task_queue_head->next;
+		TaskDeque& queue = (scheduling_mode == SchedulingMode_WorkStealing) ? thread_queues[q] : global_queue;
 
+		Lock lock(queue.mutex);
+		while(1)
 		{
-			Lock lock2(num_unfinished_tasks_mutex);
-			num_unfinished_tasks--;
-			assert(num_unfinished_tasks >= 0);
+			TaskRef task = queue.popFrontLocked(); // Make a reference that can destroy the object if needed.
+			if(!task)
+				break;
+
+			if(scheduling_mode == SchedulingMode_WorkStealing)
+				num_queued_tasks--;
+
+			task->removedFromQueue();
+
+			{
+				Lock lock2(num_unfinished_tasks_mutex);
+				num_unfinished_tasks--;
+				assert(num_unfinished_tasks >= 0);
+			}
 		}
 	}
-	task_queue_tail = NULL;
 }
 
 
@@ -335,18 +572,17 @@ void TaskManager::waitForTasksToComplete()
 	if(threads.empty()) // If there are zero worker threads:
 	{
 		// Do the work in this thread!
-		Lock lock(queue_mutex);
-
-		while(task_queue_head)
+		while(1)
 		{
-			TaskRef task = dequeueTaskInternal();
-			task->run(0);
-
+			TaskRef task;
 			{
-				Lock lock2(num_unfinished_tasks_mutex);
-				num_unfinished_tasks--;
-				assert(num_unfinished_tasks >= 0);
+				Lock lock(global_queue.mutex);
+				task = global_queue.popFrontLocked();
 			}
+			if(!task)
+				break;
+
+			executeTask(task.ptr(), /*thread_index=*/0);
 		}
 	}
 	else
@@ -366,17 +602,28 @@ bool TaskManager::areAllThreadsBusy()
 }
 
 
-TaskRef TaskManager::dequeueTask() // called by TaskRunnerThread
+void TaskManager::threadStarted(size_t thread_index) // called by TaskRunnerThread
+{
+	current_thread_task_manager = this;
+	current_thread_index = thread_index;
+}
+
+
+TaskRef TaskManager::dequeueTask(size_t thread_index) // called by TaskRunnerThread
 {
-	return dequeueTaskInternal();
+	if(scheduling_mode == SchedulingMode_WorkStealing)
+		return dequeueWorkStealingTask(thread_index);
+	else
+		return dequeueTaskInternal();
 }
 
 
-void TaskManager::taskFinished() // called by TaskRunnerThread
+void TaskManager::taskFinished(Task* task)
 {
 	//conPrint("taskFinished()");
 	//conPrint("num_unfinished_tasks: " + toString(num_unfinished_tasks));
 
+	// Decrement num_unfinished_tasks before the task group count, so that once runTaskGroup() returns, the group's tasks are no longer counted as unfinished.
 	int new_num_unfinished_tasks;
 	{
 		Lock lock(num_unfinished_tasks_mutex);
@@ -384,9 +631,19 @@ void TaskManager::taskFinished() // called by TaskRunnerThread
 		assert(num_unfinished_tasks >= 0);
 		new_num_unfinished_tasks = num_unfinished_tasks;
 	}
-	
+
 	if(new_num_unfinished_tasks == 0)
 		num_unfinished_tasks_cond.notifyAll(); // There could be multiple threads waiting on this condition, so use notifyAll().
+
+	TaskGroup* task_group = task->task_group;
+	if(task_group)
+	{
+		// Notify while holding the mutex, as the thread in runTaskGroup() may free the task group as soon as it sees num_unfinished_tasks == 0.
+		Lock lock(task_group->num_unfinished_tasks_mutex);
+		task_group->num_unfinished_tasks--;
+		if(task_group->num_unfinished_tasks == 0)
+			task_group->num_unfinished_tasks_cond.notifyAll();
+	}
 }
 
 
@@ -396,4 +653,4 @@ const std::string& TaskManager::getName() // called by TaskRunnerThread
 }
 
 
-} // end namespace glare 
+} // end namespace glare
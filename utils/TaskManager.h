@@ -7,6 +7,8 @@ Copyright Glare Technologies Limited 2024 -
 
 
 #include "Task.h"
+#include "TaskDeque.h"
+#include "ParallelForDynamic.h"
 #include "Mutex.h"
 #include "Reference.h"
 #include "Condition.h"
@@ -16,6 +18,7 @@ Copyright Glare Technologies Limited 2024 -
 #include <vector>
 #include <limits>
 #include <string>
+#include <atomic>
 
 
 namespace glare
@@ -30,13 +33,33 @@ TaskManager
 -----------
 Manages and runs Tasks on multiple threads.
 
+There are two scheduling modes:
+
+SchedulingMode_GlobalQueue: All tasks are inserted into a single queue, protected by a single mutex.  
+Tasks are executed in FIFO order.
+
+SchedulingMode_WorkStealing: Each TaskRunnerThread has its own deque.
+Tasks added from inside a running task (e.g. a task that adds subtasks) are pushed onto the back of the 
+deque of the thread running the task.  Tasks added from other threads are distributed round-robin over the deques.
+A thread pops tasks from the back of its own deque (LIFO, for cache locality), and when that is empty, 
+steals tasks from the front of other threads' deques.
+This greatly reduces contention on the queue mutex when many threads are adding and executing tasks.
+If there are zero worker threads, SchedulingMode_GlobalQueue is used.
+
 Tests in TaskTests.
 =====================================================================*/
 class TaskManager
 {
 public:
+	enum SchedulingMode
+	{
+		SchedulingMode_GlobalQueue,
+		SchedulingMode_WorkStealing
+	};
+
 	TaskManager(size_t num_threads = std::numeric_limits<size_t>::max());
 	TaskManager(const std::string& name, size_t num_threads = std::numeric_limits<size_t>::max()); // Name is used to name TaskRunnerThreads in the debugger.
+	TaskManager(const std::string& name, size_t num_threads, SchedulingMode scheduling_mode);
 
 	~TaskManager();
 
@@ -52,6 +75,9 @@ public:
 	void addTasks(ArrayRef<TaskRef> tasks);
 	
 	// Blocks until all tasks in task group have finished being executed.
+	// The calling thread executes the group's tasks that have not been started by other threads yet.
+	// While waiting for the remaining tasks, it also executes queued tasks of any task groups that those tasks run (nested fork/join).
+	// May be called from a task running in a TaskRunnerThread of this task manager.
 	void runTaskGroup(TaskGroupRef task_group);
 
 	size_t getNumUnfinishedTasks() const;
@@ -65,6 +91,7 @@ public:
 
 	// Blocks until all tasks have finished being executed.
 	// NOTE: Prefer to use runTaskGroup, as waitForTasksToComplete waits for all tasks, from any (logical) task group.
+	// Don't call from a task, it will deadlock.
 	void waitForTasksToComplete();
 
 	// Removes queued tasks, calls cancelTask() on all tasks being currently executed in TaskRunnerThreads, then blocks until all tasks have completed.
@@ -75,6 +102,8 @@ public:
 
 	bool areAllThreadsBusy();
 
+	SchedulingMode getSchedulingMode() const { return scheduling_mode; }
+
 
 	template <class Task, class TaskClosure> 
 	void runParallelForTasks(const TaskClosure& closure, size_t begin, size_t end);
@@ -97,14 +126,46 @@ public:
 	template <class Task, class TaskClosure> 
 	void runParallelForTasksInterleaved(const TaskClosure& closure, size_t begin, size_t end);
 
+	/*
+	Dynamically load-balanced parallel for loop over [begin, end).
+	Instead of splitting the range into equal static ranges, one per task, tasks repeatedly claim the next chunk of indices with an atomic counter, 
+	so threads that finish their chunks early keep taking work.  Use this when the cost per index is uneven.
+
+	func must be callable as func(size_t chunk_begin, size_t chunk_end, size_t thread_index), and may be called concurrently from different threads.
+	If grain_size is zero, chunk sizes are chosen automatically, see ParallelForRange.
+	If stats_out is non-null, per-task busy times etc. are written to it.
+	*/
+	template <class RangeFunc>
+	void runParallelForDynamic(const RangeFunc& func, size_t begin, size_t end, size_t grain_size = 0, ParallelForStats* stats_out = NULL);
 
-	TaskRef dequeueTask(); // called by TaskRunnerThread
-	void taskFinished(); // called by TaskRunnerThread
+	// As above, but stores references to the tasks in the task group, and reuses them if the references are non-null.  
+	// group must be non-null, and should only be used with the same RangeFunc type.
+	template <class RangeFunc>
+	void runParallelForDynamic(const RangeFunc& func, size_t begin, size_t end, size_t grain_size, glare::TaskGroupRef group, ParallelForStats* stats_out = NULL);
+
+
+	void threadStarted(size_t thread_index); // called by TaskRunnerThread
+	TaskRef dequeueTask(size_t thread_index); // called by TaskRunnerThread.  Returns a NULL reference when the thread should terminate.
+	void executeTask(Task* task, size_t thread_index); // called by TaskRunnerThread.  Runs the task, then updates the unfinished task counts.
 private:
-	void init(size_t num_threads);
+	void init(size_t num_threads, SchedulingMode scheduling_mode);
 	void enqueueTaskInternal(Task* task);
 	void enqueueTasksInternal(const TaskRef* tasks, size_t num_tasks);
 	TaskRef dequeueTaskInternal();
+	void taskFinished(Task* task);
+	size_t getCurrentThreadIndex() const; // Returns index of the TaskRunnerThread of this task manager calling this method, or threads.size() if not called from such a thread.
+	bool tryRemoveQueuedTask(Task* task); // Returns true if the task was in a queue and was removed.  The caller should then execute it.
+
+	// Nested task groups:
+	void registerChildGroup(TaskGroup* parent_group, const TaskGroupRef& child_group);
+	void unregisterChildGroup(TaskGroup* parent_group, TaskGroup* child_group);
+	bool runQueuedDescendantGroupTasks(TaskGroup* task_group, size_t thread_index); // Returns true if any tasks were executed.
+
+	// Work-stealing mode:
+	void enqueueWorkStealingTasks(const TaskRef* tasks, size_t num_tasks);
+	void notifyWorkStealingThreads(size_t num_tasks);
+	TaskRef tryDequeueWorkStealingTask(size_t thread_index);
+	TaskRef dequeueWorkStealingTask(size_t thread_index);
 
 	Condition num_unfinished_tasks_cond;
 	mutable ::Mutex num_unfinished_tasks_mutex;
@@ -112,11 +173,20 @@ private:
 	
 	std::string name;
 
-	mutable ::Mutex queue_mutex;
-	Task* task_queue_head		GUARDED_BY(queue_mutex);
-	Task* task_queue_tail		GUARDED_BY(queue_mutex);
+	SchedulingMode scheduling_mode;
+
+	TaskDeque global_queue; // Used in SchedulingMode_GlobalQueue.
 	Condition queue_nonempty;
 
+	// Used in SchedulingMode_WorkStealing:
+	TaskDeque* thread_queues; // Array of threads.size() deques.
+	std::atomic<size_t> next_thread_queue; // Deque index that the next task from a non-TaskRunnerThread will be inserted into.
+	std::atomic<int> num_queued_tasks; // Number of tasks in all thread deques.  (May temporarily exceed the actual number)
+	std::atomic<int> num_sleeping_threads;
+	::Mutex sleep_mutex;
+	Condition work_available;
+	bool quitting GUARDED_BY(sleep_mutex);
+
 	std::vector<Reference<TaskRunnerThread> > threads;
 };
 
@@ -209,4 +279,52 @@ void TaskManager::runParallelForTasksInterleaved(const TaskClosure& closure, siz
 }
 
 
+template <class RangeFunc>
+void TaskManager::runParallelForDynamic(const RangeFunc& func, size_t begin, size_t end, size_t grain_size, ParallelForStats* stats_out)
+{
+	runParallelForDynamic(func, begin, end, grain_size, /*group=*/new glare::TaskGroup(), stats_out);
+}
+
+
+template <class RangeFunc>
+void TaskManager::runParallelForDynamic(const RangeFunc& func, size_t begin, size_t end, size_t grain_size, glare::TaskGroupRef group, ParallelForStats* stats_out)
+{
+	assert(group);
+
+	if(stats_out)
+	{
+		stats_out->task_stats.clear();
+		stats_out->elapsed_time = 0;
+	}
+
+	if(begin >= end)
+		return;
+
+	Timer timer;
+
+	const size_t num_indices = end - begin;
+	const size_t max_num_chunks = (grain_size == 0) ? num_indices : Maths::roundedUpDivide(num_indices, grain_size);
+	const size_t num_tasks = myMin(max_num_chunks, getConcurrency());
+
+	ParallelForRange range(begin, end, grain_size, num_tasks);
+
+	if(stats_out)
+		stats_out->task_stats.resize(num_tasks);
+
+	group->tasks.resize(num_tasks);
+
+	for(size_t t=0; t<num_tasks; ++t)
+	{
+		if(group->tasks[t].isNull())
+			group->tasks[t] = new ParallelForDynamicTask<RangeFunc>();
+		group->tasks[t].template downcastToPtr<ParallelForDynamicTask<RangeFunc> >()->set(&func, &range, stats_out ? &stats_out->task_stats[t] : NULL);
+	}
+
+	runTaskGroup(group); // Blocks
+
+	if(stats_out)
+		stats_out->elapsed_time = timer.elapsed();
+}
+
+
 } // end namespace glare 
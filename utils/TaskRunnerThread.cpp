@@ -60,11 +60,13 @@ void TaskRunnerThread::run()
 {
 	PlatformUtils::setCurrentThreadNameIfTestsEnabled(manager->getName() + " thread " + toString(thread_index));
 
+	manager->threadStarted(thread_index);
+
 	while(1)
 	{
-		Reference<Task> task = manager->dequeueTask();
+		Reference<Task> task = manager->dequeueTask(thread_index);
 		
-		if(task->is_quit_runner_task)
+		if(task.isNull() || task->is_quit_runner_task)
 			break; // All tasks are finished, terminate thread by returning from run().
 
 		this->current_task = task;
@@ -74,28 +76,12 @@ void TaskRunnerThread::run()
 		task_times->back().dequeue_time = Clock::getCurTimeRealSec();
 #endif
 		
-		// Execute the task
-		task->run(thread_index);
-
-		if(task->task_group)
-		{
-			int new_num_unfinished_group_tasks;
-			{
-				Lock lock(task->task_group->num_unfinished_tasks_mutex);
-				task->task_group->num_unfinished_tasks--;
-				new_num_unfinished_group_tasks = task->task_group->num_unfinished_tasks;
-			}
-			
-			if(new_num_unfinished_group_tasks == 0)
-				task->task_group->num_unfinished_tasks_cond.notify();
-		}
+		// Execute the task.  The task manager also updates the unfinished task counts, including for the task's group, if any.
+		manager->executeTask(task.ptr(), thread_index);
 
 		TASK_STATS_DO(task_times->back().finish_time = Clock::getCurTimeRealSec());
 
 		this->current_task = NULL;
-
-		// Inform the task manager that we have executed the task.
-		manager->taskFinished();
 	}
 }
 
@@ -85,6 +85,28 @@ public:
 };
 
 
+// Adds child tasks from inside run(), to test tasks being added from TaskRunnerThreads.
+class SpawningTestTask : public Task
+{
+public:
+	SpawningTestTask(TaskManager& manager_, AtomicInt& x_, int depth_) : manager(manager_), x(x_), depth(depth_) {}
+
+	static int64 numTasksForDepth(int depth) { return (depth == 0) ? 1 : (1 + 4 * numTasksForDepth(depth - 1)); }
+
+	virtual void run(size_t thread_index)
+	{
+		if(depth > 0)
+			for(int i=0; i<4; ++i)
+				manager.addTask(new SpawningTestTask(manager, x, depth - 1));
+		x++;
+	}
+
+	TaskManager& manager;
+	AtomicInt& x;
+	int depth;
+};
+
+
 class ForLoopTaskClosure
 {
 public:
@@ -140,6 +162,28 @@ public:
 };
 
 
+// Variant that doesn't print anything, for benchmarking.
+class QuietForLoopTask : public glare::Task
+{
+public:
+	void set(const ForLoopTaskClosure* closure_, size_t begin_, size_t end_)
+	{
+		closure = closure_;
+		begin = begin_;
+		end = end_;
+	}
+
+	virtual void run(size_t thread_index)
+	{
+		for(size_t i = begin; i < end; ++i)
+			(*closure->touch_count)[i]++;
+	}
+
+	const ForLoopTaskClosure* closure;
+	size_t begin, end;
+};
+
+
 class ForLoopTaskInterleaved : public glare::Task
 {
 public:
@@ -255,6 +299,347 @@ void testForLoopTaskRun(TaskManager& task_manager, size_t N)
 }
 
 
+struct TouchRangeFunc
+{
+	void operator() (size_t begin, size_t end, size_t thread_index) const
+	{
+		for(size_t i = begin; i < end; ++i)
+			(*touch_count)[i]++;
+	}
+
+	std::vector<int>* touch_count;
+};
+
+
+static void testParallelForDynamic(TaskManager& task_manager, size_t N, size_t grain_size)
+{
+	// We will add a border of elements that should be zero afterwards.
+	const size_t border = 10;
+	std::vector<int> touch_count(2*border + N, 0);
+
+	TouchRangeFunc func;
+	func.touch_count = &touch_count;
+
+	ParallelForStats stats;
+	task_manager.runParallelForDynamic(func, border, N + border, grain_size, &stats);
+	testAssert(task_manager.areAllTasksComplete());
+
+	for(size_t i=0; i<touch_count.size(); ++i)
+		testAssert(touch_count[i] == ((i >= border && i < N + border) ? 1 : 0));
+
+	size_t num_indices_processed = 0;
+	for(size_t i=0; i<stats.task_stats.size(); ++i)
+	{
+		num_indices_processed += stats.task_stats[i].num_indices;
+		if(grain_size != 0)
+			testAssert(stats.task_stats[i].num_indices <= stats.task_stats[i].num_chunks * grain_size);
+	}
+	testAssert(num_indices_processed == N);
+	testAssert(stats.task_stats.size() <= task_manager.getConcurrency());
+
+	// Test with a task group that is reused
+	TaskGroupRef group = new TaskGroup();
+	for(int z=0; z<2; ++z)
+		task_manager.runParallelForDynamic(func, border, N + border, grain_size, group);
+
+	for(size_t i=0; i<touch_count.size(); ++i)
+		testAssert(touch_count[i] == ((i >= border && i < N + border) ? 3 : 0));
+}
+
+
+// Per-index cost increases steeply with index, so static equal-size ranges are very unbalanced.
+struct UnevenWorkClosure
+{
+	void processRange(size_t begin, size_t end) const
+	{
+		for(size_t i = begin; i < end; ++i)
+		{
+			const size_t cost = (i * i) / 64;
+			float x = (float)i;
+			for(size_t z=0; z<cost; ++z)
+				x = x * 0.999f + 1.f;
+			(*results)[i] = x;
+		}
+	}
+
+	void operator() (size_t begin, size_t end, size_t thread_index) const { processRange(begin, end); }
+
+	std::vector<float>* results;
+};
+
+
+class UnevenWorkTask : public glare::Task
+{
+public:
+	UnevenWorkTask(const UnevenWorkClosure& closure_, size_t begin_, size_t end_) : closure(closure_), begin(begin_), end(end_) {}
+
+	virtual void run(size_t thread_index) { closure.processRange(begin, end); }
+
+	const UnevenWorkClosure& closure;
+	size_t begin, end;
+};
+
+
+static void doParallelForDynamicBenchmark(size_t num_threads)
+{
+	TaskManager m("benchmark", num_threads);
+
+	const size_t N = 2000;
+	std::vector<float> results(N);
+	UnevenWorkClosure closure;
+	closure.results = &results;
+
+	Timer timer;
+	m.runParallelForTasks<UnevenWorkTask, UnevenWorkClosure>(closure, 0, N);
+	const double static_elapsed = timer.elapsed();
+
+	ParallelForStats auto_grain_stats;
+	m.runParallelForDynamic(closure, 0, N, /*grain size=*/0, &auto_grain_stats);
+
+	ParallelForStats grain_16_stats;
+	m.runParallelForDynamic(closure, 0, N, /*grain size=*/16, &grain_16_stats);
+
+	conPrint("Uneven work parallel for, " + toString(num_threads) + " threads:");
+	conPrint("    static ranges:      " + doubleToStringNSigFigs(static_elapsed * 1.0e3, 4) + " ms");
+	conPrint("    dynamic, auto grain: " + doubleToStringNSigFigs(auto_grain_stats.elapsed_time * 1.0e3, 4) + " ms, imbalance: " + doubleToStringNSigFigs(auto_grain_stats.getImbalance(), 4));
+	conPrint("    dynamic, grain 16:   " + doubleToStringNSigFigs(grain_16_stats.elapsed_time * 1.0e3, 4) + " ms, imbalance: " + doubleToStringNSigFigs(grain_16_stats.getImbalance(), 4));
+	conPrint(auto_grain_stats.toString());
+}
+
+
+// Closure for testing nested task groups.  
+struct NestedTaskClosure
+{
+	TaskManager* manager;
+	std::vector<AtomicInt>* thread_in_use; // One per thread index, used to check that the same thread index is not used concurrently by different threads.
+	AtomicInt* leaf_counter;
+	int depth; // Number of levels of nesting below this level.
+	size_t num_inner_indices;
+};
+
+
+// Runs a nested parallel for loop for each index, or touches the index if at the lowest level.
+class NestedForLoopTask : public glare::Task
+{
+public:
+	NestedForLoopTask(const NestedTaskClosure& closure_, size_t begin_, size_t end_) : closure(closure_), begin(begin_), end(end_) {}
+
+	virtual void run(size_t thread_index)
+	{
+		if(closure.depth == 0)
+		{
+			testAssert(thread_index < closure.thread_in_use->size());
+			const int64 prev_in_use = (*closure.thread_in_use)[thread_index].increment();
+			testAssert(prev_in_use == 0);
+
+			(*closure.leaf_counter) += (int64)(end - begin);
+
+			(*closure.thread_in_use)[thread_index].decrement();
+		}
+		else
+		{
+			for(size_t i = begin; i < end; ++i)
+			{
+				NestedTaskClosure inner_closure = closure;
+				inner_closure.depth = closure.depth - 1;
+				closure.manager->runParallelForTasks<NestedForLoopTask, NestedTaskClosure>(inner_closure, 0, closure.num_inner_indices);
+			}
+		}
+	}
+
+	const NestedTaskClosure& closure;
+	size_t begin, end;
+};
+
+
+// Test calling runParallelForTasks from inside tasks.
+static void testNestedTaskGroups(TaskManager& m, int depth, size_t num_inner_indices)
+{
+	std::vector<AtomicInt> thread_in_use(m.getNumThreads() + 1);
+	AtomicInt leaf_counter(0);
+
+	NestedTaskClosure closure;
+	closure.manager = &m;
+	closure.thread_in_use = &thread_in_use;
+	closure.leaf_counter = &leaf_counter;
+	closure.depth = depth;
+	closure.num_inner_indices = num_inner_indices;
+
+	m.runParallelForTasks<NestedForLoopTask, NestedTaskClosure>(closure, 0, num_inner_indices);
+
+	testAssert(m.areAllTasksComplete());
+
+	int64 expected_num_leaf_indices = num_inner_indices;
+	for(int i=0; i<depth; ++i)
+		expected_num_leaf_indices *= num_inner_indices;
+	testAssert(leaf_counter == expected_num_leaf_indices);
+}
+
+
+// Outer tasks that each run a nested task group, with more outer tasks than threads, so that all threads are blocked in nested runTaskGroup() calls.
+class BlockingOuterTask : public glare::Task
+{
+public:
+	BlockingOuterTask(TaskManager& manager_, AtomicInt& x_) : manager(manager_), x(x_) {}
+
+	virtual void run(size_t thread_index)
+	{
+		TaskGroupRef group = new TaskGroup();
+		for(int i=0; i<8; ++i)
+			group->tasks.push_back(new CancellableTestTask(x));
+		manager.runTaskGroup(group);
+	}
+
+	TaskManager& manager;
+	AtomicInt& x;
+};
+
+
+static void testNestedTaskGroupsForManager(TaskManager& m)
+{
+	testNestedTaskGroups(m, /*depth=*/0, /*num_inner_indices=*/1000);
+	testNestedTaskGroups(m, /*depth=*/1, /*num_inner_indices=*/100);
+	testNestedTaskGroups(m, /*depth=*/2, /*num_inner_indices=*/30);
+	testNestedTaskGroups(m, /*depth=*/3, /*num_inner_indices=*/10);
+
+	{
+		AtomicInt exec_counter(0);
+		TaskGroupRef group = new TaskGroup();
+		const int num_outer = (int)m.getConcurrency() * 2;
+		for(int i=0; i<num_outer; ++i)
+			group->tasks.push_back(new BlockingOuterTask(m, exec_counter));
+
+		m.runTaskGroup(group);
+		testAssert(exec_counter == num_outer * 8 * CancellableTestTask::numSubTasks());
+		testAssert(m.areAllTasksComplete());
+	}
+}
+
+
+static void testWorkStealingMode(size_t num_threads)
+{
+	// Test construction and destruction
+	{
+		TaskManager m("test", num_threads, TaskManager::SchedulingMode_WorkStealing);
+	}
+
+	{
+		TaskManager m("test", num_threads, TaskManager::SchedulingMode_WorkStealing);
+		AtomicInt exec_counter(0);
+
+		for(int i=0; i<1000; ++i)
+			m.addTask(new TestTask(exec_counter));
+
+		m.waitForTasksToComplete();
+		testAssert(exec_counter == 1000);
+	}
+
+	// Test tasks that add tasks from inside run().
+	{
+		TaskManager m("test", num_threads, TaskManager::SchedulingMode_WorkStealing);
+		AtomicInt exec_counter(0);
+
+		m.addTask(new SpawningTestTask(m, exec_counter, /*depth=*/5));
+
+		m.waitForTasksToComplete();
+		testAssert(exec_counter == SpawningTestTask::numTasksForDepth(5));
+	}
+
+	// Test destroying the task manager while tasks are still queued.  Queued tasks should still be executed.
+	{
+		AtomicInt exec_counter(0);
+		{
+			TaskManager m("test", num_threads, TaskManager::SchedulingMode_WorkStealing);
+			for(int i=0; i<100; ++i)
+				m.addTask(new TestTask(exec_counter));
+		}
+		testAssert(exec_counter == 100);
+	}
+
+	// Test task group
+	{
+		TaskManager m("test", num_threads, TaskManager::SchedulingMode_WorkStealing);
+		AtomicInt exec_counter(0);
+
+		TaskGroupRef group = new TaskGroup();
+		for(int i=0; i<100; ++i)
+			group->tasks.push_back(new TestTask(exec_counter));
+
+		m.runTaskGroup(group);
+		testAssert(exec_counter == 100);
+		testAssert(m.areAllTasksComplete());
+
+		m.runTaskGroup(group); // Run again
+		testAssert(exec_counter == 200);
+		testAssert(m.areAllTasksComplete());
+	}
+
+	{
+		TaskManager m("test", num_threads, TaskManager::SchedulingMode_WorkStealing);
+
+		testForLoopTaskRun(m, 0);
+		testForLoopTaskRun(m, 1);
+		testForLoopTaskRun(m, 7);
+		testForLoopTaskRun(m, 16);
+		testForLoopTaskRun(m, 1000000);
+	}
+
+	// Test cancelAndWaitForTasksToComplete
+	{
+		TaskManager m("test", num_threads, TaskManager::SchedulingMode_WorkStealing);
+		AtomicInt sub_exec_counter(0);
+
+		const int NUM_TASKS = 1000;
+		for(int i=0; i<NUM_TASKS; ++i)
+			m.addTask(new CancellableTestTask(sub_exec_counter));
+
+		PlatformUtils::Sleep(10);
+		m.cancelAndWaitForTasksToComplete();
+		testAssert(m.areAllTasksComplete());
+		testAssert(sub_exec_counter >= 0 && sub_exec_counter <= (int64)NUM_TASKS * CancellableTestTask::numSubTasks());
+	}
+}
+
+
+// Measure the time to execute lots of small tasks, where tasks are added both from inside tasks and from the main thread.
+static void doContentionBenchmark(TaskManager::SchedulingMode scheduling_mode, const std::string& mode_name, size_t num_threads)
+{
+	TaskManager m("benchmark", num_threads, scheduling_mode);
+
+	AtomicInt exec_counter(0);
+	const int depth = 7;
+	const int num_iters = 10;
+
+	Timer timer;
+	for(int i=0; i<num_iters; ++i)
+	{
+		m.addTask(new SpawningTestTask(m, exec_counter, depth));
+		m.waitForTasksToComplete();
+	}
+	const double spawn_elapsed = timer.elapsed();
+
+	testAssert(exec_counter == num_iters * SpawningTestTask::numTasksForDepth(depth));
+
+	// Run lots of small task groups from the main thread.
+	const int num_groups = 10000;
+	std::vector<int> touch_count(64, 0);
+	ForLoopTaskClosure closure;
+	closure.touch_count = &touch_count;
+	TaskGroupRef group = new TaskGroup();
+	timer.reset();
+	for(int i=0; i<num_groups; ++i)
+		m.runParallelForTasks<QuietForLoopTask, ForLoopTaskClosure>(&closure, 0, touch_count.size(), group);
+	const double group_elapsed = timer.elapsed();
+
+	for(size_t i=0; i<touch_count.size(); ++i)
+		testAssert(touch_count[i] == num_groups);
+
+	const int64 num_spawned_tasks = num_iters * SpawningTestTask::numTasksForDepth(depth);
+	conPrint(rightPad(mode_name, ' ', 14) + ": " + toString(num_threads) + " threads, spawned tasks: " + doubleToStringNSigFigs(spawn_elapsed * 1.0e9 / num_spawned_tasks, 4) + " ns/task, " + 
+		"task groups: " + doubleToStringNSigFigs(group_elapsed * 1.0e6 / num_groups, 4) + " us/group");
+}
+
+
 void TaskTests::test()
 {
 	conPrint("TaskTests");
@@ -513,6 +898,53 @@ void TaskTests::test()
 
 
 
+	//-------------------- Test runParallelForDynamic -----------------------------
+	{
+		const size_t thread_counts[] = { 0, 1, 4 };
+		const size_t Ns[] = { 0, 1, 2, 7, 16, 100, 100000 };
+		const size_t grain_sizes[] = { 0, 1, 3, 64, 1000000 };
+		for(size_t i=0; i<staticArrayNumElems(thread_counts); ++i)
+		for(size_t mode=0; mode<2; ++mode)
+		{
+			TaskManager m("test", thread_counts[i], (mode == 0) ? TaskManager::SchedulingMode_GlobalQueue : TaskManager::SchedulingMode_WorkStealing);
+			for(size_t n=0; n<staticArrayNumElems(Ns); ++n)
+			for(size_t g=0; g<staticArrayNumElems(grain_sizes); ++g)
+				testParallelForDynamic(m, Ns[n], grain_sizes[g]);
+		}
+
+		doParallelForDynamicBenchmark(myMax<size_t>(2, PlatformUtils::getNumLogicalProcessors()));
+	}
+
+	//-------------------- Test nested task groups -----------------------------
+	{
+		const size_t thread_counts[] = { 0, 1, 2, 4, 16 };
+		for(size_t i=0; i<staticArrayNumElems(thread_counts); ++i)
+		{
+			{
+				TaskManager m("test", thread_counts[i], TaskManager::SchedulingMode_GlobalQueue);
+				testNestedTaskGroupsForManager(m);
+			}
+			{
+				TaskManager m("test", thread_counts[i], TaskManager::SchedulingMode_WorkStealing);
+				testNestedTaskGroupsForManager(m);
+			}
+		}
+	}
+
+	//-------------------- Test work-stealing scheduling mode -----------------------------
+	testWorkStealingMode(1);
+	testWorkStealingMode(2);
+	testWorkStealingMode(4);
+	testWorkStealingMode(PlatformUtils::getNumLogicalProcessors());
+
+	// Contention benchmark: global queue vs work-stealing
+	{
+		const size_t num_threads = myMax<size_t>(2, PlatformUtils::getNumLogicalProcessors());
+		doContentionBenchmark(TaskManager::SchedulingMode_GlobalQueue,  "global queue", num_threads);
+		doContentionBenchmark(TaskManager::SchedulingMode_WorkStealing, "work stealing", num_threads);
+	}
+
+
 	// Perf test - fixed size allocator vs global allocator
 	/*{
 
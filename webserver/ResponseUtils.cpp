@@ -10,11 +10,13 @@ Copyright Glare Technologies Limited 2021 -
 #include <Clock.h>
 #include <Exception.h>
 #include <networking/MySocket.h>
+#include <MemMappedFile.h>
 #include <Lock.h>
 #include <StringUtils.h>
 #include <PlatformUtils.h>
 #include "RequestInfo.h"
 #include "Escaping.h"
+#include "StaticAssetManager.h"
 #include "../maths/mathstypes.h"
 #include <cstring>
 
@@ -40,6 +42,23 @@ void writeData(ReplyInfo& reply_info, const void* data, size_t datalen)
 }
 
 
+// Writes the header and data with a single gather write when writing to a socket, so the body isn't copied and the header doesn't get its own packet.
+void writeHeaderAndData(ReplyInfo& reply_info, const std::string& header, const void* data, size_t datalen)
+{
+	SocketInterface* socket = dynamic_cast<SocketInterface*>(reply_info.socket);
+	if(socket)
+	{
+		const ArrayRef<uint8> slices[2] = { ArrayRef<uint8>((const uint8*)header.data(), header.size()), ArrayRef<uint8>((const uint8*)data, datalen) };
+		socket->writeDataSlices(ArrayRef<ArrayRef<uint8>>(slices, 2));
+	}
+	else
+	{
+		writeRawString(reply_info, header);
+		writeData(reply_info, data, datalen);
+	}
+}
+
+
 // Text
 void writeHTTPOKHeaderAndData(ReplyInfo& reply_info, const void* data, size_t datalen)
 {
@@ -50,8 +69,7 @@ void writeHTTPOKHeaderAndData(ReplyInfo& reply_info, const void* data, size_t da
 		"Content-Length: " + toString(datalen) + "\r\n"
 		"\r\n";
 
-	writeRawString(reply_info, response);
-	writeData(reply_info, data, datalen);
+	writeHeaderAndData(reply_info, response, data, datalen);
 }
 
 
@@ -65,8 +83,7 @@ void writeHTTPOKHeaderAndData(ReplyInfo& reply_info, const void* data, size_t da
 		"Content-Length: " + toString(datalen) + "\r\n"
 		"\r\n";
 
-	writeRawString(reply_info, response);
-	writeData(reply_info, data, datalen);
+	writeHeaderAndData(reply_info, response, data, datalen);
 }
 
 
@@ -88,8 +105,7 @@ void writeHTTPOKHeaderAndDataWithCacheMaxAge(ReplyInfo& reply_info, const void*
 		"Content-Length: " + toString(datalen) + "\r\n"
 		"\r\n";
 
-	writeRawString(reply_info, response);
-	writeData(reply_info, data, datalen);
+	writeHeaderAndData(reply_info, response, data, datalen);
 }
 
 
@@ -105,8 +121,7 @@ void writeHTTPOKHeaderAndDataWithCacheControl(ReplyInfo& reply_info, const void*
 		"Content-Length: " + toString(datalen) + "\r\n"
 		"\r\n";
 
-	writeRawString(reply_info, response);
-	writeData(reply_info, data, datalen);
+	writeHeaderAndData(reply_info, response, data, datalen);
 }
 
 
@@ -123,8 +138,7 @@ void writeHTTPOKHeaderWithCacheMaxAgeAndContentEncoding(ReplyInfo& reply_info, c
 		"Content-Length: " + toString(datalen) + "\r\n"
 		"\r\n";
 
-	writeRawString(reply_info, response);
-	writeData(reply_info, data, datalen);
+	writeHeaderAndData(reply_info, response, data, datalen);
 }
 
 
@@ -141,8 +155,89 @@ void writeHTTPOKHeaderWithCacheControlAndContentEncoding(ReplyInfo& reply_info,
 		"Content-Length: " + toString(datalen) + "\r\n"
 		"\r\n";
 
-	writeRawString(reply_info, response);
-	writeData(reply_info, data, datalen);
+	writeHeaderAndData(reply_info, response, data, datalen);
+}
+
+
+// Writes the header, then part of a variant of the asset.
+// The uncompressed variant is written straight from the file (with sendfile() for plain TCP sockets on Linux), compressed variants from memory.
+static void writeStaticAssetData(ReplyInfo& reply_info, const std::string& header, const StaticAsset& asset, StaticAsset::Encoding encoding, size_t offset, size_t num_bytes)
+{
+	SocketInterface* socket = dynamic_cast<SocketInterface*>(reply_info.socket);
+	if(socket && encoding == StaticAsset::Encoding_Identity)
+		socket->writeFileData(ArrayRef<uint8>((const uint8*)header.data(), header.size()), *asset.file, offset, num_bytes);
+	else
+		writeHeaderAndData(reply_info, header, asset.getData(encoding) + offset, num_bytes);
+}
+
+
+void writeStaticAssetResponse(const RequestInfo& request_info, ReplyInfo& reply_info, const StaticAsset& asset, const string_view cache_control)
+{
+	const StaticAsset::Encoding encoding = asset.chooseEncoding(request_info.deflate_accept_encoding, request_info.zstd_accept_encoding);
+	const char* content_encoding = StaticAsset::contentEncodingName(encoding);
+
+	std::string common_headers = 
+		"Cache-Control: " + toString(cache_control) + "\r\n"
+		"ETag: " + asset.getETag(encoding) + "\r\n"
+		"Vary: Accept-Encoding\r\n"
+		"Connection: Keep-Alive\r\n";
+
+	// If the client already has the current version, just reply with 304 Not Modified.
+	for(size_t i=0; i<request_info.headers.size(); ++i)
+	{
+		if(StringUtils::equalCaseInsensitive(request_info.headers[i].key, "if-none-match") && asset.ifNoneMatchMatches(request_info.headers[i].value, encoding))
+		{
+			writeRawString(reply_info, "HTTP/1.1 304 Not Modified\r\n" + common_headers + "Content-Length: 0\r\n\r\n");
+			return;
+		}
+	}
+
+	common_headers += 
+		"Content-Type: " + asset.mime_type + "\r\n"
+		"Cross-Origin-Opener-Policy: same-origin\r\n" // To enable SharedArrayBuffer in js, see https://web.dev/articles/cross-origin-isolation-guide.  For webclient.
+		"Cross-Origin-Embedder-Policy: require-corp\r\n"
+		"Accept-Ranges: bytes\r\n";
+	if(content_encoding)
+		common_headers += "Content-Encoding: " + std::string(content_encoding) + "\r\n";
+
+	const int64 data_size = (int64)asset.getDataSize(encoding);
+
+	// NOTE: only handle a single range, multiple ranges would need a multipart/byteranges response.  For multiple ranges we just send the whole thing, which is allowed.
+	if(request_info.ranges.size() == 1)
+	{
+		const Range& range = request_info.ranges[0];
+		const int64 range_end_incl = (range.end_incl == -1) ? (data_size - 1) : myMin(range.end_incl, data_size - 1); // Clamp end to the data, as per RFC 9110 14.1.2.
+		if(range.start < 0 || range.start >= data_size || range.start > range_end_incl)
+		{
+			writeRawString(reply_info, 
+				"HTTP/1.1 416 Range Not Satisfiable\r\n" + 
+				common_headers + 
+				"Content-Range: bytes */" + toString(data_size) + "\r\n"
+				"Content-Length: 0\r\n"
+				"\r\n"
+			);
+			return;
+		}
+
+		const int64 range_size = range_end_incl - range.start + 1;
+		writeStaticAssetData(reply_info, 
+			"HTTP/1.1 206 Partial Content\r\n" + 
+			common_headers + 
+			"Content-Range: bytes " + toString(range.start) + "-" + toString(range_end_incl) + "/" + toString(data_size) + "\r\n"
+			"Content-Length: " + toString(range_size) + "\r\n"
+			"\r\n",
+			asset, encoding, (size_t)range.start, (size_t)range_size
+		);
+		return;
+	}
+
+	writeStaticAssetData(reply_info, 
+		"HTTP/1.1 200 OK\r\n" + 
+		common_headers + 
+		"Content-Length: " + toString(data_size) + "\r\n"
+		"\r\n",
+		asset, encoding, 0, (size_t)data_size
+	);
 }
 
 
@@ -165,8 +260,7 @@ void writeHTTPNotFoundHeaderAndData(ReplyInfo& reply_info, const std::string& s)
 		"Content-Length: " + toString(s.length()) + "\r\n"
 		"\r\n";
 
-	writeRawString(reply_info, response);
-	writeData(reply_info, s.c_str(), s.size());
+	writeHeaderAndData(reply_info, response, s.c_str(), s.size());
 }
 
 
@@ -177,8 +271,7 @@ void writeHTTPUnauthorizedHeaderAndData(ReplyInfo& reply_info, const std::string
 		"Content-Length: " + toString(s.length()) + "\r\n"
 		"\r\n";
 
-	writeRawString(reply_info, response);
-	writeData(reply_info, s.c_str(), s.size());
+	writeHeaderAndData(reply_info, response, s.c_str(), s.size());
 }
 
 
@@ -345,10 +438,190 @@ std::string getPrefixWithStrippedTags(const std::string& s, size_t max_len)
 
 
 #include "../utils/TestUtils.h"
+#include "../utils/BufferOutStream.h"
+#include "../utils/FileUtils.h"
+#include "../utils/TaskManager.h"
+#include "../maths/PCG32.h"
+
+
+static std::string getStaticAssetResponse(const web::RequestInfo& request_info, const web::StaticAsset& asset)
+{
+	BufferOutStream buffer;
+	web::ReplyInfo reply_info;
+	reply_info.socket = &buffer;
+	web::ResponseUtils::writeStaticAssetResponse(request_info, reply_info, asset, "max-age=60");
+	return std::string((const char*)buffer.buf.data(), buffer.buf.size());
+}
+
+
+static std::string getResponseBody(const std::string& response)
+{
+	const size_t header_end = response.find("\r\n\r\n");
+	testAssert(header_end != std::string::npos);
+	return response.substr(header_end + 4);
+}
+
+
+static void testStaticAssetResponses()
+{
+	try
+	{
+		// Make a file that compresses well
+		std::string contents;
+		for(int i=0; i<1000; ++i)
+			contents += "function f" + toString(i % 10) + "() { return 1; }\n";
+		const std::string path = PlatformUtils::getTempDirPath() + "/static_asset_test.js";
+		FileUtils::writeEntireFile(path, contents);
+
+		{
+			web::StaticAssetManager manager;
+			web::StaticAssetRef asset = new web::StaticAsset(path, "text/javascript");
+			manager.addStaticAsset("/test.js", asset);
+
+			testAssert(asset->etag.size() > 2 && asset->etag.front() == '"' && asset->etag.back() == '"');
+			testAssert(asset->etag != asset->zstd_etag && asset->etag != asset->deflate_etag);
+			testAssert(asset->chooseEncoding(true, true) == web::StaticAsset::Encoding_Identity); // No variants built yet
+
+			{
+				glare::TaskManager task_manager(2);
+				manager.buildCompressedVariants(task_manager);
+			}
+			testAssert(asset->compressed_variants_built);
+			testAssert(!asset->zstd_data.empty() && asset->zstd_data.size() < contents.size());
+			testAssert(!asset->deflate_data.empty() && asset->deflate_data.size() < contents.size());
+
+			// Test encoding choice: should pick the smallest accepted variant.
+			testAssert(asset->chooseEncoding(false, false) == web::StaticAsset::Encoding_Identity);
+			testAssert(asset->chooseEncoding(true, false) == web::StaticAsset::Encoding_Deflate);
+			testAssert(asset->chooseEncoding(false, true) == web::StaticAsset::Encoding_Zstd);
+			const web::StaticAsset::Encoding both = asset->chooseEncoding(true, true);
+			testAssert(asset->getDataSize(both) == myMin(asset->zstd_data.size(), asset->deflate_data.size()));
+
+			// Test If-None-Match parsing
+			const web::StaticAsset::Encoding identity = web::StaticAsset::Encoding_Identity;
+			testAssert(asset->ifNoneMatchMatches(asset->etag, identity));
+			testAssert(asset->ifNoneMatchMatches("W/" + asset->zstd_etag, web::StaticAsset::Encoding_Zstd));
+			testAssert(asset->ifNoneMatchMatches("\"abc\", " + asset->deflate_etag, web::StaticAsset::Encoding_Deflate));
+			testAssert(asset->ifNoneMatchMatches("*", identity));
+			testAssert(!asset->ifNoneMatchMatches("\"abc\"", identity));
+			testAssert(!asset->ifNoneMatchMatches("", identity));
+			testAssert(!asset->ifNoneMatchMatches("\"abc", identity));
+			testAssert(!asset->ifNoneMatchMatches(asset->etag.substr(1, asset->etag.size() - 2), identity)); // Unquoted
+
+			// The ETag of another variant should not match, as the client may not be able to decode the variant it has cached.
+			testAssert(!asset->ifNoneMatchMatches(asset->zstd_etag, identity));
+			testAssert(!asset->ifNoneMatchMatches("W/" + asset->deflate_etag, identity));
+			testAssert(!asset->ifNoneMatchMatches(asset->etag, web::StaticAsset::Encoding_Zstd));
+			testAssert(asset->ifNoneMatchMatches(asset->etag + ", " + asset->zstd_etag, web::StaticAsset::Encoding_Zstd));
+
+			// Plain request
+			{
+				web::RequestInfo request_info;
+				const std::string response = getStaticAssetResponse(request_info, *asset);
+				testAssert(::hasPrefix(response, "HTTP/1.1 200 OK\r\n"));
+				testAssert(response.find("Content-Encoding") == std::string::npos);
+				testAssert(response.find("ETag: " + asset->etag + "\r\n") != std::string::npos);
+				testAssert(getResponseBody(response) == contents);
+			}
+
+			// Zstd accepted
+			{
+				web::RequestInfo request_info;
+				request_info.zstd_accept_encoding = true;
+				const std::string response = getStaticAssetResponse(request_info, *asset);
+				testAssert(::hasPrefix(response, "HTTP/1.1 200 OK\r\n"));
+				testAssert(response.find("Content-Encoding: zstd\r\n") != std::string::npos);
+				testAssert(response.find("ETag: " + asset->zstd_etag + "\r\n") != std::string::npos);
+				testAssert(getResponseBody(response) == std::string((const char*)asset->zstd_data.data(), asset->zstd_data.size()));
+			}
+
+			// If-None-Match matching
+			{
+				web::RequestInfo request_info;
+				const std::string if_none_match = asset->etag;
+				request_info.headers.push_back(web::Header());
+				request_info.headers.back().key = "If-None-Match";
+				request_info.headers.back().value = if_none_match;
+				const std::string response = getStaticAssetResponse(request_info, *asset);
+				testAssert(::hasPrefix(response, "HTTP/1.1 304 Not Modified\r\n"));
+				testAssert(getResponseBody(response).empty());
+			}
+
+			// If-None-Match with the zstd ETag, from a client that doesn't accept zstd.  Should get the full identity response, not a 304.
+			{
+				web::RequestInfo request_info;
+				request_info.headers.push_back(web::Header());
+				request_info.headers.back().key = "If-None-Match";
+				request_info.headers.back().value = asset->zstd_etag;
+				const std::string response = getStaticAssetResponse(request_info, *asset);
+				testAssert(::hasPrefix(response, "HTTP/1.1 200 OK\r\n"));
+				testAssert(response.find("ETag: " + asset->etag + "\r\n") != std::string::npos);
+				testAssert(getResponseBody(response) == contents);
+
+				request_info.zstd_accept_encoding = true;
+				testAssert(::hasPrefix(getStaticAssetResponse(request_info, *asset), "HTTP/1.1 304 Not Modified\r\n"));
+			}
+
+			// Range request on deflate variant
+			{
+				web::RequestInfo request_info;
+				request_info.deflate_accept_encoding = true;
+				request_info.ranges.push_back(web::Range(10, 19));
+				const std::string response = getStaticAssetResponse(request_info, *asset);
+				testAssert(::hasPrefix(response, "HTTP/1.1 206 Partial Content\r\n"));
+				testAssert(response.find("Content-Range: bytes 10-19/" + toString(asset->deflate_data.size()) + "\r\n") != std::string::npos);
+				testAssert(getResponseBody(response) == std::string((const char*)asset->deflate_data.data() + 10, 10));
+			}
+
+			// Range to end, and range extending past end, which should be clamped
+			{
+				web::RequestInfo request_info;
+				request_info.ranges.push_back(web::Range(contents.size() - 5, -1));
+				testAssert(getResponseBody(getStaticAssetResponse(request_info, *asset)) == contents.substr(contents.size() - 5));
+
+				request_info.ranges[0] = web::Range(contents.size() - 5, contents.size() + 100);
+				testAssert(getResponseBody(getStaticAssetResponse(request_info, *asset)) == contents.substr(contents.size() - 5));
+			}
+
+			// Unsatisfiable range
+			{
+				web::RequestInfo request_info;
+				request_info.ranges.push_back(web::Range(contents.size(), -1));
+				const std::string response = getStaticAssetResponse(request_info, *asset);
+				testAssert(::hasPrefix(response, "HTTP/1.1 416 Range Not Satisfiable\r\n"));
+				testAssert(response.find("Content-Range: bytes */" + toString(contents.size()) + "\r\n") != std::string::npos);
+			}
+		} // Release the memory-mapped file before deleting it
+
+		FileUtils::deleteFile(path);
+
+		// An incompressible file should get no variants, but still be marked as built, so it isn't compressed again.
+		std::string random_contents(10000, '\0');
+		PCG32 rng(1);
+		for(size_t i=0; i<random_contents.size(); ++i)
+			random_contents[i] = (char)rng.nextUInt(256);
+		const std::string random_path = PlatformUtils::getTempDirPath() + "/static_asset_test.bin";
+		FileUtils::writeEntireFile(random_path, random_contents);
+		{
+			web::StaticAssetRef asset = new web::StaticAsset(random_path, "application/octet-stream");
+			asset->buildCompressedVariants();
+			testAssert(asset->compressed_variants_built);
+			testAssert(asset->zstd_data.empty() && asset->deflate_data.empty());
+			testAssert(asset->chooseEncoding(true, true) == web::StaticAsset::Encoding_Identity);
+		}
+		FileUtils::deleteFile(random_path);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+}
 
 
 void web::ResponseUtils::test()
 {
+	testStaticAssetResponses();
+
 	testAssert(getPrefixWithStrippedTags("", /*max len=*/0) == "");
 	testAssert(getPrefixWithStrippedTags("", /*max len=*/100) == "");
 
@@ -369,4 +642,4 @@ void web::ResponseUtils::test()
 }
 
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -22,6 +22,7 @@ namespace web
 
 class RequestInfo;
 class ReplyInfo;
+class StaticAsset;
 
 
 namespace ResponseUtils
@@ -41,6 +42,10 @@ namespace ResponseUtils
 	void writeHTTPOKHeaderWithCacheMaxAgeAndContentEncoding(ReplyInfo& reply_info, const void* data, size_t datalen, const string_view content_type, const string_view content_encoding, int max_age_s);
 	void writeHTTPOKHeaderWithCacheControlAndContentEncoding(ReplyInfo& reply_info, const void* data, size_t datalen, const string_view content_type, const string_view cache_control, const string_view content_encoding);
 
+	// Writes the smallest variant of the asset that the client accepts.  Handles If-None-Match (replies with 304 Not Modified) and single-range Range requests.
+	// Ranges apply to the chosen (possibly compressed) variant.
+	void writeStaticAssetResponse(const RequestInfo& request_info, ReplyInfo& reply_info, const StaticAsset& asset, const string_view cache_control);
+
 	void writeHTTPNotFoundHeaderAndData(ReplyInfo& reply_info, const std::string& s);
 	void writeHTTPUnauthorizedHeaderAndData(ReplyInfo& reply_info, const std::string& s);
 
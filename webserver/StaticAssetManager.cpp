@@ -10,10 +10,15 @@ Generated at 2013-04-14 15:39:35 +0100
 #include "WebsiteExcep.h"
 #include <MemMappedFile.h>
 #include <Exception.h>
-#include <SHA256.h>
 #include <FileUtils.h>
 #include <StringUtils.h>
 #include <ConPrint.h>
+#include <TaskManager.h>
+#include <Lock.h>
+#include <Timer.h>
+#include <IncludeXXHash.h>
+#include <zstd.h>
+#include <zlib.h>
 
 
 namespace web
@@ -22,18 +27,19 @@ namespace web
 
 StaticAsset::StaticAsset(const std::string& disk_path_, const std::string& mime_type_)
 :	disk_path(disk_path_),
-	mime_type(mime_type_)
+	mime_type(mime_type_),
+	compressed_variants_built(false)
 {
 	try
 	{
 		file = new MemMappedFile(disk_path);
 
-		// Compute ETag as the base64 encoded hash of the file
-
-		//std::vector<unsigned char> digest;
-		//SHA256::hash((const unsigned char*)file->fileData(), (const unsigned char*)file->fileData() + file->fileSize(), digest);
-
-		//Base64::encode(&digest[0], digest.size(), this->etag);
+		// Compute ETag from a hash of the file contents.  A fast non-cryptographic hash is fine here, the ETag just needs to change when the contents change.
+		const uint64 hash = XXH64(file->fileData(), file->fileSize(), /*seed=*/1);
+		const std::string tag = ::toHexString(hash) + "-" + ::toHexString(file->fileSize());
+		etag         = "\"" + tag + "\"";
+		deflate_etag = "\"" + tag + "-deflate\"";
+		zstd_etag    = "\"" + tag + "-zstd\"";
 	}
 	catch(glare::Exception& e)
 	{
@@ -48,6 +54,148 @@ StaticAsset::~StaticAsset()
 }
 
 
+// Only keep a compressed variant if it saves at least this fraction of the original size, otherwise just serve the original.  (For already-compressed files like png, jpg, mp4)
+static const double MAX_COMPRESSED_SIZE_RATIO = 0.95;
+
+
+void StaticAsset::buildCompressedVariants()
+{
+	const size_t src_size = file->fileSize();
+	const size_t max_keep_size = (size_t)(src_size * MAX_COMPRESSED_SIZE_RATIO);
+
+	// zstd.  Compression is only done once at load time, so use a high compression level.
+	{
+		std::vector<uint8> compressed(ZSTD_compressBound(src_size));
+		const size_t compressed_size = ZSTD_compress(compressed.data(), compressed.size(), file->fileData(), src_size, /*compression level=*/15);
+		if(ZSTD_isError(compressed_size))
+			throw WebsiteExcep("ZSTD_compress failed: " + std::string(ZSTD_getErrorName(compressed_size)));
+
+		if(compressed_size <= max_keep_size)
+		{
+			compressed.resize(compressed_size);
+			zstd_data.swap(compressed);
+		}
+		else
+			zstd_data.clear();
+	}
+
+	// deflate (zlib format)
+	{
+		uLongf compressed_size = compressBound((uLong)src_size);
+		std::vector<uint8> compressed(compressed_size);
+		const int result = compress2(compressed.data(), &compressed_size, (const Bytef*)file->fileData(), (uLong)src_size, /*level=*/9);
+		if(result != Z_OK)
+			throw WebsiteExcep("compress2 failed: " + toString(result));
+
+		if(compressed_size <= max_keep_size)
+		{
+			compressed.resize(compressed_size);
+			deflate_data.swap(compressed);
+		}
+		else
+			deflate_data.clear();
+	}
+
+	compressed_variants_built = true;
+}
+
+
+StaticAsset::Encoding StaticAsset::chooseEncoding(bool deflate_accepted, bool zstd_accepted) const
+{
+	Encoding best = Encoding_Identity;
+	size_t best_size = file->fileSize();
+	if(deflate_accepted && !deflate_data.empty() && deflate_data.size() < best_size)
+	{
+		best = Encoding_Deflate;
+		best_size = deflate_data.size();
+	}
+	if(zstd_accepted && !zstd_data.empty() && zstd_data.size() < best_size)
+	{
+		best = Encoding_Zstd;
+		best_size = zstd_data.size();
+	}
+	return best;
+}
+
+
+const uint8* StaticAsset::getData(Encoding encoding) const
+{
+	switch(encoding)
+	{
+	case Encoding_Deflate: return deflate_data.data();
+	case Encoding_Zstd: return zstd_data.data();
+	default: return (const uint8*)file->fileData();
+	}
+}
+
+
+size_t StaticAsset::getDataSize(Encoding encoding) const
+{
+	switch(encoding)
+	{
+	case Encoding_Deflate: return deflate_data.size();
+	case Encoding_Zstd: return zstd_data.size();
+	default: return file->fileSize();
+	}
+}
+
+
+const std::string& StaticAsset::getETag(Encoding encoding) const
+{
+	switch(encoding)
+	{
+	case Encoding_Deflate: return deflate_etag;
+	case Encoding_Zstd: return zstd_etag;
+	default: return etag;
+	}
+}
+
+
+const char* StaticAsset::contentEncodingName(Encoding encoding)
+{
+	switch(encoding)
+	{
+	case Encoding_Deflate: return "deflate";
+	case Encoding_Zstd: return "zstd";
+	default: return NULL;
+	}
+}
+
+
+// If-None-Match is "*" or a comma-separated list of entity tags, e.g. 
+// If-None-Match: "abc", W/"def"
+// Uses weak comparison, so W/ prefixes are ignored.
+bool StaticAsset::ifNoneMatchMatches(const string_view value, Encoding encoding) const
+{
+	const std::string& variant_etag = getETag(encoding);
+
+	size_t i = 0;
+	while(i < value.size())
+	{
+		const char c = value[i];
+		if(c == ' ' || c == '\t' || c == ',')
+			i++;
+		else if(c == '*')
+			return true;
+		else if(c == 'W' && i + 1 < value.size() && value[i + 1] == '/')
+			i += 2;
+		else if(c == '"')
+		{
+			const size_t closing_quote_i = value.find('"', i + 1);
+			if(closing_quote_i == string_view::npos)
+				return false;
+			const string_view tag = value.substr(i, closing_quote_i + 1 - i); // Include quotes
+			if(tag == variant_etag)
+				return true;
+			i = closing_quote_i + 1;
+		}
+		else
+			return false; // Invalid syntax
+	}
+	return false;
+}
+
+
 StaticAssetManager::StaticAssetManager()
 {}
 
@@ -89,4 +237,42 @@ void StaticAssetManager::addAllFilesInDir(const std::string& URL_path_prefix, co
 }
 
 
+void StaticAssetManager::buildCompressedVariants(glare::TaskManager& task_manager)
+{
+	Timer timer;
+
+	std::vector<StaticAsset*> assets;
+	for(auto it = static_assets.begin(); it != static_assets.end(); ++it)
+		if(!it->second->compressed_variants_built)
+			assets.push_back(it->second.ptr());
+
+	// Compression time is roughly proportional to file size, which varies a lot, so use dynamic load balancing with one asset per chunk.
+	// Exceptions can't be thrown out of tasks, so record the first error and throw it afterwards.
+	Mutex error_mutex;
+	std::string error_msg;
+	task_manager.runParallelForDynamic([&](size_t begin, size_t end, size_t /*thread_index*/)
+		{
+			for(size_t i=begin; i<end; ++i)
+			{
+				try
+				{
+					assets[i]->buildCompressedVariants();
+				}
+				catch(glare::Exception& e)
+				{
+					Lock lock(error_mutex);
+					if(error_msg.empty())
+						error_msg = "Error while compressing '" + assets[i]->disk_path + "': " + e.what();
+				}
+			}
+		}, 
+		/*begin=*/0, /*end=*/assets.size(), /*grain_size=*/1);
+
+	if(!error_msg.empty())
+		throw WebsiteExcep(error_msg);
+
+	conPrint("Built compressed variants of " + toString(assets.size()) + " static asset(s) in " + timer.elapsedStringNSigFigs(3));
+}
+
+
 } // end namespace web
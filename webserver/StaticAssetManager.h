@@ -9,10 +9,13 @@ Generated at 2013-04-14 15:39:35 +0100
 
 #include <ThreadSafeRefCounted.h>
 #include <Reference.h>
+#include <Platform.h>
+#include <string_view.h>
 #include <string>
 #include <vector>
 #include <map>
 class MemMappedFile;
+namespace glare { class TaskManager; }
 
 
 namespace web
@@ -20,9 +23,13 @@ namespace web
 
 
 /*=====================================================================
-StaticAssetManager
--------------------
+StaticAsset
+-----------
+A file served as-is from disk, plus optional precompressed variants of it.
 
+The ETag is computed from a hash of the file contents, so it changes iff the
+file contents change.  Each encoding variant gets its own ETag (with a suffix),
+as they are different representations of the resource.
 =====================================================================*/
 class StaticAsset : public ThreadSafeRefCounted
 {
@@ -30,10 +37,40 @@ public:
 	StaticAsset(const std::string& disk_path, const std::string& mime_type);
 	~StaticAsset();
 
+	enum Encoding
+	{
+		Encoding_Identity,
+		Encoding_Deflate,
+		Encoding_Zstd
+	};
+
+	// Builds the deflate and zstd variants.  A variant is only kept if it is significantly smaller than the original file.
+	// Throws WebsiteExcep on failure.
+	void buildCompressedVariants();
+
+	// Returns the smallest variant that the client accepts.
+	Encoding chooseEncoding(bool deflate_accepted, bool zstd_accepted) const;
+
+	const uint8* getData(Encoding encoding) const;
+	size_t getDataSize(Encoding encoding) const;
+	const std::string& getETag(Encoding encoding) const;
+	static const char* contentEncodingName(Encoding encoding); // Returns NULL for Encoding_Identity.
+
+	// Returns true if the If-None-Match header value matches the ETag of the given variant of this asset.
+	// Only the variant being served is matched, as a client with a cached copy of another variant may not be able to decode it.
+	bool ifNoneMatchMatches(const string_view if_none_match_value, Encoding encoding) const;
+
 	std::string disk_path;
 	std::string mime_type;
-	//std::string etag;
 	MemMappedFile* file;
+
+	std::string etag; // Includes the double quotes.
+	std::string deflate_etag;
+	std::string zstd_etag;
+
+	std::vector<uint8> deflate_data; // zlib format, which is what HTTP calls 'deflate'.  Empty if not built.
+	std::vector<uint8> zstd_data; // Empty if not built.
+	bool compressed_variants_built; // Set by buildCompressedVariants(), even if no variants were kept.
 };
 typedef Reference<StaticAsset> StaticAssetRef;
 
@@ -47,6 +84,9 @@ public:
 	void addStaticAsset(const std::string& URL_path, StaticAssetRef static_asset);
 
 	void addAllFilesInDir(const std::string& URL_path_prefix, const std::string& dir);
+
+	// Builds compressed variants of all static assets that don't have them yet, in parallel.
+	void buildCompressedVariants(glare::TaskManager& task_manager);
 	
 	const std::map<std::string, StaticAssetRef>& getStaticAssets() const { return static_assets; }
 private:
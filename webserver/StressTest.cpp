@@ -20,6 +20,10 @@ Copyright Glare Technologies Limited 2021 -
 #include <TLSSocket.h>
 #include <tls.h>
 #endif
+#include <stdio.h>
+#if defined(__linux__)
+#include <unistd.h>
+#endif
 
 
 namespace web
@@ -123,6 +127,75 @@ const std::string readWebsocketTextMessage(const Reference<SocketInterface>& soc
 }
 
 
+// Read a complete HTTP response, using the Content-Length header to get the length of the content.
+static void readResponse(const Reference<SocketInterface>& sock)
+{
+	// Read data until we have the complete response header.
+	char buf[100000];
+	size_t total_num_bytes_read = 0;
+	bool got_header = false;
+	int header_len = 0;
+	while(!got_header)
+	{
+		const size_t num_bytes_read = sock->readSomeBytes(buf + total_num_bytes_read, sizeof(buf) - total_num_bytes_read);
+		if(num_bytes_read == 0)
+			break;
+		total_num_bytes_read += num_bytes_read;
+
+		// Look for double CRLF
+		for(int z=3; z<(int)total_num_bytes_read; ++z)
+			if(buf[z-3] == '\r' && buf[z-2] == '\n' && buf[z-1] == '\r' && buf[z] == '\n') // If found CRLFCRLF
+			{
+				header_len = z + 1;
+				got_header = true;
+				break;
+			}
+	}
+
+	//conPrint("Got header: (header_len: " + toString(header_len) + ")");
+	//conPrint(std::string(buf, buf + header_len));
+
+
+	// Parse header (and get content length)
+	Parser parser(buf, header_len);
+	parser.advancePastLine(); // Go past HTTP/1.1 200 OK\r\n
+		
+	string_view header_key;
+	uint32 content_length = 0;
+	while(1)
+	{
+		if(parser.currentIsChar('\r'))
+		{
+			parser.parseChar('\n');
+			break;
+		}
+
+		parser.parseToChar(':', header_key);
+		parser.advance(); // advance past ':'
+		parser.parseWhiteSpace();
+		if(StringUtils::equalCaseInsensitive(header_key, "Content-Length"))
+			parser.parseUnsignedInt(content_length);
+
+		parser.advancePastLine();
+
+		if(parser.eof())
+			throw MySocketExcep("EOF while parsing header.");
+	}
+
+
+	const int full_reponse_size = header_len + content_length;
+
+	// Now get content
+	int remaining_data = (int)full_reponse_size - (int)total_num_bytes_read;
+	while(remaining_data > 0)
+	{
+		const int chunk_size = myMin(remaining_data, (int)sizeof(buf));
+		sock->readData(buf, chunk_size);
+		remaining_data -= chunk_size;
+	}
+}
+
+
 class PageLoadTask : public glare::Task
 {
 public:
@@ -186,67 +259,7 @@ public:
 				}
 
 
-				// Read data until we have the complete response header.
-				char buf[100000];
-				size_t total_num_bytes_read = 0;
-				bool got_header = false;
-				int header_len = 0;
-				while(!got_header)
-				{
-					const size_t num_bytes_read = sock->readSomeBytes(buf + total_num_bytes_read, sizeof(buf) - total_num_bytes_read);
-					if(num_bytes_read == 0)
-						break;
-					total_num_bytes_read += num_bytes_read;
-
-					// Look for double CRLF
-					for(int z=3; z<(int)total_num_bytes_read; ++z)
-						if(buf[z-3] == '\r' && buf[z-2] == '\n' && buf[z-1] == '\r' && buf[z] == '\n') // If found CRLFCRLF
-						{
-							header_len = z + 1;
-							got_header = true;
-							break;
-						}
-				}
-
-				//conPrint("Got header: (header_len: " + toString(header_len) + ")");
-				//conPrint(std::string(buf, buf + header_len));
-
-
-				// Parse header (and get content length)
-				Parser parser(buf, header_len);
-				parser.advancePastLine(); // Go past HTTP/1.1 200 OK\r\n
-					
-				string_view header_key;
-				uint32 content_length = 0;
-				while(1)
-				{
-					if(parser.currentIsChar('\r'))
-					{
-						parser.parseChar('\n');
-						break;
-					}
-
-					parser.parseToChar(':', header_key);
-					parser.advance(); // advance past ':'
-					parser.parseWhiteSpace();
-					if(header_key == "Content-Length")
-						parser.parseUnsignedInt(content_length);
-
-					parser.advancePastLine();
-
-					if(parser.eof())
-						throw MySocketExcep("EOF while parsing header.");
-				}
-
-
-				const int full_reponse_size = header_len + content_length;
-
-				// Now get content
-				const int remaining_data = (int)full_reponse_size - (int)total_num_bytes_read;
-
-				if(remaining_data > 0)
-					sock->readData(buf, remaining_data);
-					
+				readResponse(sock);
 
 				//const std::string response_content(buf + header_len, buf + full_reponse_size);
 				//conPrint("response_content:");
@@ -322,12 +335,141 @@ void testPageLoadsWithNThreads(int listen_port, int num_threads)
 }
 
 
+// Returns resident memory usage of this process in bytes, or 0 if unknown.
+static size_t getResidentMemoryUsage()
+{
+#if defined(__linux__)
+	FILE* f = fopen("/proc/self/statm", "r");
+	if(f)
+	{
+		unsigned long size_pages, resident_pages;
+		const int num_parsed = fscanf(f, "%lu %lu", &size_pages, &resident_pages);
+		fclose(f);
+		if(num_parsed == 2)
+			return (size_t)resident_pages * (size_t)sysconf(_SC_PAGESIZE);
+	}
+#endif
+	return 0;
+}
+
+
+// Opens num_connections keep-alive connections and keeps them open, then makes a number of rounds of requests over all of them.
+// Prints request throughput, and the increase in memory usage of this process per connection (only meaningful if the server is running in this process).
+// Run against the server in thread-per-connection mode and in event-loop mode to compare the two.
+void testKeepAliveConnections(int listen_port, int num_connections)
+{
+	conPrint("Running keep-alive stress test, num connections: " + toString(num_connections));
+
+	const size_t initial_mem_usage = getResidentMemoryUsage();
+
+	const IPAddress ip_addr("127.0.0.1");
+	std::vector<SocketInterfaceRef> sockets;
+	for(int i=0; i<num_connections; ++i)
+		sockets.push_back(new MySocket(ip_addr, listen_port));
+
+	// Do one request on each connection, so that the server has fully set up each connection.
+	const std::string query = "GET /sdfds HTTP/1.1" + CRLFCRLF;
+	for(size_t i=0; i<sockets.size(); ++i)
+	{
+		sockets[i]->writeData(query.c_str(), query.size());
+		readResponse(sockets[i]);
+	}
+
+	const size_t mem_usage = getResidentMemoryUsage();
+
+	const int num_rounds = 10;
+	Timer timer;
+	for(int r=0; r<num_rounds; ++r)
+	{
+		for(size_t i=0; i<sockets.size(); ++i)
+			sockets[i]->writeData(query.c_str(), query.size());
+		for(size_t i=0; i<sockets.size(); ++i)
+			readResponse(sockets[i]);
+	}
+
+	const double elapsed = timer.elapsed();
+	const int num_queries = num_rounds * num_connections;
+	conPrint("--------------------------------");
+	conPrint("num connections: " + toString(num_connections));
+	conPrint("num queries: " + toString(num_queries));
+	conPrint("time / query: " + toString(elapsed / num_queries) + " s (" + toString((float)(num_queries / elapsed)) + " queries/s)");
+	if(initial_mem_usage != 0)
+		conPrint("memory usage increase / connection: " + toString((double)((int64)mem_usage - (int64)initial_mem_usage) / num_connections) + " B");
+}
+
+
+// Opens num_slow_clients connections that send a POST request header and then stall partway through the body (slow writers), and num_slow_clients 
+// connections that pipeline many requests but never read the responses (slow readers), then times a request made on a new connection.
+// In event-loop mode the slow connections can occupy all of the server's request threads, so the request only completes once the server 
+// has timed them out.  Checks that the request completes within max_latency_s.
+void testSlowClients(int listen_port, int num_slow_clients, double max_latency_s)
+{
+	conPrint("Running slow clients stress test, num slow writers: " + toString(num_slow_clients) + ", num slow readers: " + toString(num_slow_clients));
+
+	const IPAddress ip_addr("127.0.0.1");
+	std::vector<MySocketRef> slow_sockets;
+
+	// Slow readers.  Keep writing requests until the server stops reading them, because it is blocked writing responses that we don't read.
+	// These are made first, as each takes a while to set up.
+	std::string requests;
+	for(int i=0; i<1000; ++i)
+		requests += "GET /sdfds HTTP/1.1" + CRLFCRLF;
+	for(int i=0; i<num_slow_clients; ++i)
+	{
+		MySocketRef sock = new MySocket(ip_addr, listen_port);
+		sock->setTimeout(1.0);
+		try
+		{
+			for(int z=0; z<1000; ++z)
+				sock->writeData(requests.c_str(), requests.size());
+		}
+		catch(MySocketExcep& )
+		{} // Write timed out (or the server closed the connection).
+		slow_sockets.push_back(sock);
+	}
+
+	// Slow writers.  These are made just before the request, so that they are all still occupying request threads.
+	const std::string post_header = "POST / HTTP/1.1" + CRLF + "Content-Length: 100000" + CRLFCRLF;
+	const std::string partial_body(1000, 'a');
+	for(int i=0; i<num_slow_clients; ++i)
+	{
+		MySocketRef sock = new MySocket(ip_addr, listen_port);
+		sock->writeData(post_header.c_str(), post_header.size());
+		sock->writeData(partial_body.c_str(), partial_body.size());
+		slow_sockets.push_back(sock);
+	}
+
+	// Make a request on a new connection.
+	Timer timer;
+	try
+	{
+		MySocketRef sock = new MySocket(ip_addr, listen_port);
+		sock->setTimeout(max_latency_s);
+		const std::string query = "GET /sdfds HTTP/1.1" + CRLFCRLF;
+		sock->writeData(query.c_str(), query.size());
+		readResponse(sock);
+	}
+	catch(MySocketExcep& e)
+	{
+		failTest("Request with slow clients connected failed after " + timer.elapsedStringNSigFigs(3) + ": " + e.what());
+	}
+
+	conPrint("--------------------------------");
+	conPrint("request latency with slow clients connected: " + timer.elapsedStringNSigFigs(3));
+	testAssert(timer.elapsed() < max_latency_s);
+}
+
+
 void test(int listen_port)
 {
 	try
 	{
 		const int num_threads = 8;
 		testPageLoadsWithNThreads(listen_port, num_threads);
+
+		testKeepAliveConnections(listen_port, /*num_connections=*/1000);
+
+		testSlowClients(listen_port, /*num_slow_clients=*/16, /*max_latency_s=*/120.0);
 	}
 	catch(WebsiteExcep& e)
 	{
@@ -357,4 +499,4 @@ Plain HTTP: 7980.2744 queries/s
 
 ECDHE-RSA-CHACHA20-POLY1305
 
-*/
\ No newline at end of file
+*/
\ No newline at end of file
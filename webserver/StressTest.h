@@ -16,5 +16,9 @@ namespace web
 namespace StressTest
 {
 	void test(int listen_port);
+
+	void testKeepAliveConnections(int listen_port, int num_connections);
+
+	void testSlowClients(int listen_port, int num_slow_clients, double max_latency_s);
 }
 }
@@ -0,0 +1,313 @@
+/*=====================================================================
+WebIOThread.cpp
+---------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#include "WebIOThread.h"
+
+
+#include "WebWorkerThread.h"
+#include "WebsiteExcep.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <Lock.h>
+#include <StringUtils.h>
+#include <PlatformUtils.h>
+#include <ThreadManager.h>
+#include <TaskManager.h>
+#include <Task.h>
+#include <networking/MySocket.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+
+namespace web
+{
+
+
+static const size_t READ_CHUNK_SIZE = 2048;
+static const size_t MAX_BUFFERED_BYTES = 16 * 1024 * 1024; // Close connections that send this much data without completing requests.
+
+
+class HandleConnectionRequestsTask : public glare::Task
+{
+public:
+	HandleConnectionRequestsTask(const Reference<WebIOThread>& io_thread_, const Reference<WebIOConnection>& conn_) : io_thread(io_thread_), conn(conn_) {}
+
+	virtual void run(size_t /*thread_index*/) override
+	{
+		io_thread->handleRequestsForConnection(conn.ptr());
+	}
+
+	Reference<WebIOThread> io_thread;
+	Reference<WebIOConnection> conn;
+};
+
+
+// Reads all data that can be read without blocking into the connection's socket buffer.
+// Returns false if the connection was closed by the other end.
+static bool readAvailableData(WebIOConnection* conn, bool& wait_for_writable_out)
+{
+	std::vector<uint8>& buf = conn->worker->getSocketBuffer();
+	while(1)
+	{
+		const size_t old_size = buf.size();
+		if(old_size > MAX_BUFFERED_BYTES)
+			throw WebsiteExcep("Too much buffered data");
+
+		buf.resize(old_size + READ_CHUNK_SIZE);
+		size_t num_bytes_read = 0;
+		const bool did_read = conn->socket->tryReadSomeBytes(buf.data() + old_size, READ_CHUNK_SIZE, num_bytes_read, wait_for_writable_out);
+		buf.resize(old_size + (did_read ? num_bytes_read : 0)); // Trim the buffer down so it only extends to what we actually read.
+
+		if(!did_read)
+			return true;
+		if(num_bytes_read == 0) // if connection was closed gracefully
+			return false;
+	}
+}
+
+
+WebIOThread::WebIOThread(glare::TaskManager* request_task_manager_, ThreadManager* websocket_thread_manager_, double request_timeout_s_)
+:	request_task_manager(request_task_manager_),
+	websocket_thread_manager(websocket_thread_manager_),
+	request_timeout_s(request_timeout_s_),
+	epoll_fd(-1)
+{
+#if defined(__linux__)
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd == -1)
+		throw glare::Exception("epoll_create1 failed: " + PlatformUtils::getLastErrorString());
+
+	epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = NULL; // NULL marks the kill event fd.
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, kill_event_fd.efd, &event) != 0)
+	{
+		close(epoll_fd);
+		throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+	}
+#else
+	throw glare::Exception("WebIOThread is only supported on Linux.");
+#endif
+}
+
+
+WebIOThread::~WebIOThread()
+{
+#if defined(__linux__)
+	if(epoll_fd != -1)
+		close(epoll_fd);
+#endif
+}
+
+
+void WebIOThread::addConnection(const Reference<WorkerThread>& worker, const SocketInterfaceRef& socket, int socket_handle)
+{
+	Reference<WebIOConnection> conn = new WebIOConnection();
+	conn->worker = worker;
+	conn->socket = socket;
+	conn->socket_handle = socket_handle;
+	conn->closing = false;
+
+	worker->setWebsocketThreadManager(websocket_thread_manager);
+	socket->setTimeout(request_timeout_s); // Only has an effect in blocking mode, i.e. while a request task is handling requests on the connection.
+	socket->setBlocking(false);
+
+	{
+		Lock lock(mutex);
+		connections.insert(conn);
+	}
+
+#if defined(__linux__)
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	event.data.ptr = conn.ptr();
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_handle, &event) != 0)
+	{
+		const std::string error_string = PlatformUtils::getLastErrorString();
+		removeConnection(conn.ptr(), /*shutdown_socket=*/true);
+		throw glare::Exception("epoll_ctl failed: " + error_string);
+	}
+#endif
+}
+
+
+size_t WebIOThread::getNumConnections()
+{
+	Lock lock(mutex);
+	return connections.size();
+}
+
+
+void WebIOThread::rearmConnection(WebIOConnection* conn, bool wait_for_writable)
+{
+#if defined(__linux__)
+	epoll_event event;
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT | (wait_for_writable ? EPOLLOUT : 0);
+	event.data.ptr = conn;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->socket_handle, &event) != 0)
+		throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+#endif
+}
+
+
+// Stops watching the connection, and drops our references to it.
+// If shutdown_socket is false, the socket is left open, e.g. for when it has been handed off to a websocket thread.
+void WebIOThread::removeConnection(WebIOConnection* conn, bool shutdown_socket)
+{
+	Reference<WebIOConnection> conn_ref = conn; // Keep alive until end of function.
+
+#if defined(__linux__)
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->socket_handle, NULL); // May fail if the socket has already been closed, which is fine.
+#endif
+
+	if(shutdown_socket)
+		conn->socket->ungracefulShutdown();
+
+	Lock lock(mutex);
+	connections.erase(conn_ref);
+}
+
+
+// Called on the IO thread when epoll reports the connection is readable (or writable, or closed).
+void WebIOThread::handleConnectionEvent(WebIOConnection* conn)
+{
+	Reference<WebIOConnection> conn_ref = conn; // removeConnection() may drop the last other reference, so keep the connection alive while we hold its mutex.
+	Lock conn_lock(conn->mutex);
+
+	try
+	{
+		if(conn->closing)
+		{
+			// Discard any data until the other end closes the connection.
+			conn->worker->getSocketBuffer().clear();
+			bool wait_for_writable;
+			if(readAvailableData(conn, wait_for_writable))
+				rearmConnection(conn, wait_for_writable);
+			else
+				removeConnection(conn, /*shutdown_socket=*/true);
+			return;
+		}
+
+		bool wait_for_writable;
+		const bool open = readAvailableData(conn, wait_for_writable);
+
+		if(conn->worker->hasCompleteRequestHeader())
+			request_task_manager->addTask(new HandleConnectionRequestsTask(this, conn)); // The connection is disarmed until the task re-arms it.
+		else if(!open)
+			removeConnection(conn, /*shutdown_socket=*/true);
+		else
+			rearmConnection(conn, wait_for_writable);
+	}
+	catch(glare::Exception& )
+	{
+		removeConnection(conn, /*shutdown_socket=*/true);
+	}
+}
+
+
+void WebIOThread::handleRequestsForConnection(WebIOConnection* conn)
+{
+	Lock conn_lock(conn->mutex); // The task holds a reference to conn, so it stays alive.
+
+	try
+	{
+		while(1)
+		{
+			// RequestHandlers write to the socket (and may read the rest of a POST body) with blocking calls, so use blocking mode while handling requests.
+			// The socket timeouts set in addConnection() stop a slow or stalled client from holding this request thread for longer than request_timeout_s per call.
+			conn->socket->setBlocking(true);
+
+			const WorkerThread::HandleRequestResult result = conn->worker->processBufferedRequests(/*wait_for_graceful_disconnect=*/false);
+			if(result == WorkerThread::HandleRequestResult_ConnectionHandledElsewhere)
+			{
+				removeConnection(conn, /*shutdown_socket=*/false);
+				return;
+			}
+
+			conn->socket->setBlocking(false);
+
+			if(result == WorkerThread::HandleRequestResult_Finished)
+			{
+				// A graceful shutdown has been started.  Let the IO thread wait for the other end to close the connection, instead of blocking this thread.
+				conn->closing = true;
+				rearmConnection(conn, /*wait_for_writable=*/false);
+				return;
+			}
+
+			// Read any data that arrived while we were handling requests.  This also makes sure we don't leave data sitting in a TLS read buffer, where epoll can't see it.
+			bool wait_for_writable;
+			const bool open = readAvailableData(conn, wait_for_writable);
+			if(!conn->worker->hasCompleteRequestHeader())
+			{
+				if(open)
+					rearmConnection(conn, wait_for_writable);
+				else
+					removeConnection(conn, /*shutdown_socket=*/true);
+				return;
+			}
+		}
+	}
+	catch(glare::Exception& ) // MySocketExcep, WebsiteExcep etc.
+	{
+		removeConnection(conn, /*shutdown_socket=*/true);
+	}
+	catch(std::exception& e) // catch std::bad_alloc etc..
+	{
+		conPrint(std::string("WebIOThread: Caught std::exception: ") + e.what());
+		removeConnection(conn, /*shutdown_socket=*/true);
+	}
+}
+
+
+void WebIOThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("WebIOThread");
+
+#if defined(__linux__)
+	const int MAX_EVENTS = 256;
+	epoll_event events[MAX_EVENTS];
+
+	while(!should_quit)
+	{
+		const int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, /*timeout=*/-1);
+		if(num_events == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			conPrint("WebIOThread: epoll_wait failed: " + PlatformUtils::getLastErrorString());
+			break;
+		}
+
+		for(int i=0; i<num_events; ++i)
+		{
+			if(events[i].data.ptr == NULL) // If the kill event fd was signalled:
+				kill_event_fd.read();
+			else
+				handleConnectionEvent((WebIOConnection*)events[i].data.ptr);
+		}
+	}
+#endif
+
+	// Shut down all connections.  This will also cause any request tasks blocked on a socket to return.
+	std::set<Reference<WebIOConnection>> connections_copy;
+	{
+		Lock lock(mutex);
+		connections_copy.swap(connections);
+	}
+	for(auto it = connections_copy.begin(); it != connections_copy.end(); ++it)
+		(*it)->socket->ungracefulShutdown();
+}
+
+
+void WebIOThread::kill()
+{
+	should_quit = 1;
+	kill_event_fd.notify();
+}
+
+
+} // end namespace web
@@ -0,0 +1,112 @@
+/*=====================================================================
+WebIOThread.h
+-------------
+Copyright Glare Technologies Limited 2025 -
+=====================================================================*/
+#pragma once
+
+
+#include <MessageableThread.h>
+#include <Reference.h>
+#include <ThreadSafeRefCounted.h>
+#include <Platform.h>
+#include <EventFD.h>
+#include <Mutex.h>
+#include <AtomicInt.h>
+#include <networking/SocketInterface.h>
+#include <set>
+class ThreadManager;
+namespace glare { class TaskManager; }
+
+
+namespace web
+{
+
+
+class WorkerThread;
+
+
+/*=====================================================================
+WebIOConnection
+---------------
+A connection being handled by a WebIOThread.
+=====================================================================*/
+class WebIOConnection : public ThreadSafeRefCounted
+{
+public:
+	// Held by whichever of the IO thread or a request task is currently processing the connection.  EPOLLONESHOT means only one of them is
+	// processing it at a time, apart from when a task re-arms the connection: the IO thread may get the next event for it and wait on this mutex 
+	// until the task returns.  Also makes the handoff between threads explicit (epoll_ctl/epoll_wait ordering is invisible to race detectors).
+	Mutex mutex;
+
+	Reference<WorkerThread> worker; // Not launched, just holds the HTTP connection state (socket buffer etc.)
+	SocketInterfaceRef socket;
+	int socket_handle;
+	bool closing; // We have started a graceful shutdown and are waiting for the other end to close the connection.
+};
+
+
+/*=====================================================================
+WebIOThread
+-----------
+Used in the event-loop server mode of WebListenerThread.
+
+Multiplexes many non-blocking connections using epoll.  Each connection is
+registered with EPOLLONESHOT, so at any time it is owned by either the IO
+thread or a single request-handling task.
+
+When the complete header of a request has been read on a connection, the
+connection is passed to a task on the request task manager, which switches the
+socket to blocking mode and handles the request with the RequestHandler.
+The connection is then switched back to non-blocking mode and re-armed.
+
+The request tasks run on a fixed number of threads, so while handling requests
+the socket has send and receive timeouts set (request_timeout_s).  A client that
+stalls partway through sending a request body, or stops reading the response, 
+is then disconnected instead of holding a request thread indefinitely.
+
+Idle keep-alive connections therefore just cost a socket and a buffer, instead
+of a thread.  Upgraded websocket connections are handed off to their own thread,
+as RequestHandler::handleWebSocketConnection() blocks.
+
+Linux only.
+=====================================================================*/
+class WebIOThread : public MessageableThread
+{
+public:
+	// request_timeout_s is the send and receive timeout for blocking socket calls made while handling requests.
+	WebIOThread(glare::TaskManager* request_task_manager, ThreadManager* websocket_thread_manager, double request_timeout_s);
+	virtual ~WebIOThread();
+
+	virtual void doRun() override;
+
+	virtual void kill() override;
+
+	// Threadsafe.  socket_handle is the handle of the underlying plain socket.
+	void addConnection(const Reference<WorkerThread>& worker, const SocketInterfaceRef& socket, int socket_handle);
+
+	size_t getNumConnections();
+
+	// Called from a request task.  Handles all complete requests buffered on the connection, then re-arms the connection or closes it.
+	void handleRequestsForConnection(WebIOConnection* conn);
+
+private:
+	void handleConnectionEvent(WebIOConnection* conn);
+	void rearmConnection(WebIOConnection* conn, bool wait_for_writable);
+	void removeConnection(WebIOConnection* conn, bool shutdown_socket);
+
+	glare::TaskManager* request_task_manager;
+	ThreadManager* websocket_thread_manager;
+	double request_timeout_s;
+
+	int epoll_fd;
+	EventFD kill_event_fd;
+
+	Mutex mutex;
+	std::set<Reference<WebIOConnection>> connections GUARDED_BY(mutex);
+
+	glare::AtomicInt should_quit;
+};
+
+
+} // end namespace web
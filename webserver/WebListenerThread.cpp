@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2021 -
 
 
 #include "WebWorkerThread.h"
+#include "WebIOThread.h"
 #include "RequestHandler.h"
 #include <ConPrint.h>
 #include <networking/MySocket.h>
@@ -15,6 +16,8 @@ Copyright Glare Technologies Limited 2021 -
 #include <PlatformUtils.h>
 #include <KillThreadMessage.h>
 #include <Exception.h>
+#include <TaskManager.h>
+#include <UniqueRef.h>
 #include <tls.h>
 #include <networking/TLSSocket.h>
 
@@ -24,7 +27,7 @@ namespace web
 
 
 WebListenerThread::WebListenerThread(int listenport_, Reference<SharedRequestHandler> shared_request_handler_, struct tls_config* tls_configuration_)
-:	listenport(listenport_), shared_request_handler(shared_request_handler_), tls_configuration(tls_configuration_)
+:	listenport(listenport_), event_loop_mode(false), num_io_threads(0), num_request_threads(0), request_timeout_s(30.0), shared_request_handler(shared_request_handler_), tls_configuration(tls_configuration_)
 {
 }
 
@@ -34,10 +37,26 @@ WebListenerThread::~WebListenerThread()
 }
 
 
+void WebListenerThread::enableEventLoopMode(size_t num_io_threads_, size_t num_request_threads_, double request_timeout_s_)
+{
+#if defined(__linux__)
+	event_loop_mode = true;
+	num_io_threads = num_io_threads_;
+	num_request_threads = num_request_threads_;
+	request_timeout_s = request_timeout_s_;
+#else
+	conPrint("WebListenerThread: event-loop mode is not supported on this platform, using thread-per-connection mode.");
+#endif
+}
+
+
 void WebListenerThread::doRun()
 {
 	PlatformUtils::setCurrentThreadNameIfTestsEnabled("WebListenerThread");
 
+	// For event-loop mode.  Destroyed after the IO threads have been killed, as request tasks may be blocked on sockets until then.
+	UniqueRef<glare::TaskManager> request_task_manager;
+
 	try
 	{
 		MySocketRef sock;
@@ -81,6 +100,24 @@ void WebListenerThread::doRun()
 				throw MySocketExcep("tls_configure failed: " + getTLSErrorString(tls_context));
 		}
 
+		std::vector<Reference<WebIOThread>> io_threads;
+		if(event_loop_mode)
+		{
+			const size_t num_procs = myMax<size_t>(1, PlatformUtils::getNumLogicalProcessors());
+			const size_t use_num_io_threads      = (num_io_threads      != 0) ? num_io_threads      : myMax<size_t>(1, num_procs / 4);
+			const size_t use_num_request_threads = (num_request_threads != 0) ? num_request_threads : myMax<size_t>(4, num_procs * 2); // Request handlers do blocking IO, so use more threads than processors.
+
+			request_task_manager.set(new glare::TaskManager("web request task manager", use_num_request_threads));
+
+			for(size_t i=0; i<use_num_io_threads; ++i)
+			{
+				io_threads.push_back(new WebIOThread(request_task_manager.ptr(), &thread_manager, request_timeout_s));
+				thread_manager.addThread(io_threads.back());
+			}
+
+			conPrint("WebListenerThread: Using event-loop mode with " + toString(use_num_io_threads) + " IO thread(s) and " + toString(use_num_request_threads) + " request thread(s).");
+		}
+
 		while(!should_quit)
 		{
 			try
@@ -114,9 +151,15 @@ void WebListenerThread::doRun()
 					tls_context != NULL // tls_connection
 				);
 
+				if(!io_threads.empty())
+				{
+					// Distribute connections over the IO threads round-robin.  The worker thread is not launched, it just holds the connection state.
+					io_threads[next_thread_id % io_threads.size()]->addConnection(worker_thread, use_socket, (int)plain_worker_sock->getSocketHandle());
+				}
+				else
+					thread_manager.addThread(worker_thread);
+
 				next_thread_id++;
-			
-				thread_manager.addThread(worker_thread);
 			}
 			catch(glare::Exception& e)
 			{
@@ -138,6 +181,8 @@ void WebListenerThread::doRun()
 	// Kill the child WorkerThread threads now
 	thread_manager.killThreadsBlocking();
 
+	request_task_manager.set(NULL); // Waits for any remaining request tasks to finish.
+
 	conPrint("WebListenerThread terminating.");
 }
 
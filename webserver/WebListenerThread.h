@@ -27,7 +27,11 @@ class SharedRequestHandler;
 /*=====================================================================
 WebListenerThread
 -----------------
+By default creates a WorkerThread for each accepted connection.
 
+In the event-loop mode (see enableEventLoopMode()), accepted connections are
+instead distributed over a fixed number of WebIOThreads, and requests are
+handled on a fixed-size pool of request threads.
 =====================================================================*/
 class WebListenerThread : public MessageableThread
 {
@@ -40,11 +44,24 @@ public:
 
 	virtual void kill() override;
 
+	// Use the event-loop server mode.  Only supported on Linux, on other platforms the thread-per-connection mode is used.
+	// Must be called before the thread is launched.
+	// A value of zero for num_io_threads or num_request_threads means choose automatically, based on the number of processors.
+	// request_timeout_s is the socket send and receive timeout while handling a request, after which a slow or stalled client is disconnected, 
+	// so that it can't hold one of the request threads indefinitely.
+	void enableEventLoopMode(size_t num_io_threads, size_t num_request_threads, double request_timeout_s = 30.0);
+
 private:
 	int listenport;
 
+	bool event_loop_mode;
+	size_t num_io_threads;
+	size_t num_request_threads;
+	double request_timeout_s;
+
 	// Child threads are
 	// * WorkerThread's
+	// * WebIOThread's and websocket connection threads, in event-loop mode.
 	ThreadManager thread_manager;
 
 	Reference<SharedRequestHandler> shared_request_handler;
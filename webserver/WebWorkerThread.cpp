@@ -37,12 +37,62 @@ static const std::string CRLF = "\r\n";
 static const bool VERBOSE = false;
 
 
+// Handles a websocket connection upgraded from a connection in the event-loop server mode.
+// RequestHandler::handleWebSocketConnection() blocks for the lifetime of the connection, so it gets its own thread.
+class WebSocketConnectionThread : public MessageableThread
+{
+public:
+	WebSocketConnectionThread(const RequestInfo& request_info_, const Reference<SocketInterface>& socket_, const Reference<RequestHandler>& request_handler_, const Reference<WorkerThread>& connection_)
+	:	request_info(request_info_), socket(socket_), request_handler(request_handler_), connection(connection_)
+	{}
+
+	virtual void doRun() override
+	{
+		PlatformUtils::setCurrentThreadNameIfTestsEnabled("WebSocketConnectionThread");
+
+		try
+		{
+			socket->enableTCPKeepAlive(30.0f); // Keep alive the connection.
+
+			request_handler->handleWebSocketConnection(request_info, socket);
+		}
+		catch(glare::Exception& )
+		{}
+		catch(std::exception& e) // catch std::bad_alloc etc..
+		{
+			conPrint(std::string("Caught std::exception: ") + e.what());
+		}
+
+		// See WorkerThread::doRun()
+		connection = NULL;
+		socket = NULL;
+		ERR_remove_thread_state(/*thread id=*/NULL);
+	}
+
+	virtual void kill() override
+	{
+		Reference<SocketInterface> socket_ = socket;
+		if(socket_)
+			socket_->ungracefulShutdown();
+	}
+
+private:
+	RequestInfo request_info;
+	Reference<SocketInterface> socket;
+	Reference<RequestHandler> request_handler;
+	Reference<WorkerThread> connection; // Keeps the socket buffer alive, as request_info.headers point into it.
+};
+
+
 WorkerThread::WorkerThread(int thread_id_, const Reference<SocketInterface>& socket_, 
 	const Reference<RequestHandler>& request_handler_, bool tls_connection_)
 :	thread_id(thread_id_),
 	socket(socket_),
 	request_handler(request_handler_),
-	tls_connection(tls_connection_)
+	request_start_index(0),
+	double_crlf_scan_position(0),
+	tls_connection(tls_connection_),
+	websocket_thread_manager(NULL)
 {
 }
 
@@ -460,7 +510,14 @@ WorkerThread::HandleRequestResult WorkerThread::handleSingleRequest(size_t reque
 		// Advance request_start_index to point to after end of this post body.
 		request_start_index += request_header_size; // TODO: skip over content as well (if content length > 0)?
 
-		handleWebsocketConnection(request_info); // May throw exception
+		if(websocket_thread_manager)
+		{
+			// In event-loop mode the WebIOThread sets a request timeout on the socket.  Websocket connections may be idle for long periods, so clear it.
+			socket->setTimeout(0);
+			websocket_thread_manager->addThread(new WebSocketConnectionThread(request_info, socket, request_handler, /*connection=*/this));
+		}
+		else
+			handleWebsocketConnection(request_info); // May throw exception
 
 		return HandleRequestResult_ConnectionHandledElsewhere;
 	}
@@ -745,11 +802,70 @@ void WorkerThread::handleWebsocketConnection(RequestInfo& request_info)
 }
 
 
+bool WorkerThread::hasCompleteRequestHeader()
+{
+	const size_t socket_buf_size = socket_buffer.size();
+	if(socket_buf_size >= 4) // Make sure socket_buf_size is >= 4, to avoid underflow and wraparound when computing 'socket_buf_size - 4' below.
+		for(; double_crlf_scan_position <= socket_buf_size - 4; ++double_crlf_scan_position)
+			if(socket_buffer[double_crlf_scan_position] == '\r' && socket_buffer[double_crlf_scan_position+1] == '\n' && socket_buffer[double_crlf_scan_position+2] == '\r' && socket_buffer[double_crlf_scan_position+3] == '\n')
+				return true; // Leave double_crlf_scan_position at the CRLFCRLF, processBufferedRequests() will find it there.
+
+	return false;
+}
+
+
+WorkerThread::HandleRequestResult WorkerThread::processBufferedRequests(bool wait_for_graceful_disconnect)
+{
+	// Process any complete requests
+	// Look for the double CRLF at the end of the request header.
+	const size_t socket_buf_size = socket_buffer.size();
+	if(socket_buf_size >= 4) // Make sure socket_buf_size is >= 4, to avoid underflow and wraparound when computing 'socket_buf_size - 4' below.
+		for(; double_crlf_scan_position <= socket_buf_size - 4; ++double_crlf_scan_position)
+			if(socket_buffer[double_crlf_scan_position] == '\r' && socket_buffer[double_crlf_scan_position+1] == '\n' && socket_buffer[double_crlf_scan_position+2] == '\r' && socket_buffer[double_crlf_scan_position+3] == '\n')
+			{
+				// We have found the CRLFCRLF at index 'double_crlf_scan_position'.
+				const size_t request_header_end = double_crlf_scan_position + 4;
+						
+				// Process the request:
+				const size_t request_header_size = request_header_end - request_start_index;
+				const HandleRequestResult result = handleSingleRequest(request_header_size); // Advances this->request_start_index. to index after the current request (e.g. will be at the beginning of the next request)
+
+				double_crlf_scan_position = request_start_index;
+
+				if(result != HandleRequestResult_KeepAlive)
+				{
+					// If result is HandleRequestResult_ConnectionHandledElsewhere, then another thread might be still using the socket.  So don't call startGracefulShutdown() on it.
+					if(result == HandleRequestResult_Finished)
+					{
+						socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
+						if(wait_for_graceful_disconnect)
+							socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
+					}
+					return result;
+				}
+			}
+
+	runtimeCheck(double_crlf_scan_position >= request_start_index);
+		
+	// If the current request does not start at byte zero in the buffer,
+	// then move the remaining data (if any) in the buffer to the start of the buffer.
+	if(request_start_index > 0)
+	{
+		const size_t old_request_start_index = request_start_index;
+		moveToFrontOfBufferAndTrimBuffer(socket_buffer, request_start_index);
+		request_start_index = 0;
+		double_crlf_scan_position -= old_request_start_index;
+	}
+
+	return HandleRequestResult_KeepAlive;
+}
+
+
 // This main loop code is in a separate function so we can easily return from it, while still executing the thread cleanup code in doRun().
 void WorkerThread::doRunMainLoop()
 {
 	request_start_index = 0; // Index in socket_buffer of the start of the current request.
-	size_t double_crlf_scan_position = 0; // Index in socket_buffer of the last place we looked for a double CRLF.
+	double_crlf_scan_position = 0;
 	// Loop to handle multiple requests (HTTP persistent connection)
 	while(!should_quit)
 	{
@@ -763,45 +879,8 @@ void WorkerThread::doRunMainLoop()
 			return;
 		socket_buffer.resize(old_socket_buffer_size + num_bytes_read); // Trim the buffer down so it only extends to what we actually read.
 
-		// Process any complete requests
-		// Look for the double CRLF at the end of the request header.
-		const size_t socket_buf_size = socket_buffer.size();
-		if(socket_buf_size >= 4) // Make sure socket_buf_size is >= 4, to avoid underflow and wraparound when computing 'socket_buf_size - 4' below.
-			for(; double_crlf_scan_position <= socket_buf_size - 4; ++double_crlf_scan_position)
-				if(socket_buffer[double_crlf_scan_position] == '\r' && socket_buffer[double_crlf_scan_position+1] == '\n' && socket_buffer[double_crlf_scan_position+2] == '\r' && socket_buffer[double_crlf_scan_position+3] == '\n')
-				{
-					// We have found the CRLFCRLF at index 'double_crlf_scan_position'.
-					const size_t request_header_end = double_crlf_scan_position + 4;
-							
-					// Process the request:
-					const size_t request_header_size = request_header_end - request_start_index;
-					const HandleRequestResult result = handleSingleRequest(request_header_size); // Advances this->request_start_index. to index after the current request (e.g. will be at the beginning of the next request)
-
-					double_crlf_scan_position = request_start_index;
-
-					if(result != HandleRequestResult_KeepAlive)
-					{
-						// If result is HandleRequestResult_ConnectionHandledElsewhere, then another thread might be still using the socket.  So don't call startGracefulShutdown() on it.
-						if(result == HandleRequestResult_Finished)
-						{
-							socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
-							socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
-						}
-						return;
-					}
-				}
-
-		runtimeCheck(double_crlf_scan_position >= request_start_index);
-			
-		// If the current request does not start at byte zero in the buffer,
-		// then move the remaining data (if any) in the buffer to the start of the buffer.
-		if(request_start_index > 0)
-		{
-			const size_t old_request_start_index = request_start_index;
-			moveToFrontOfBufferAndTrimBuffer(socket_buffer, request_start_index);
-			request_start_index = 0;
-			double_crlf_scan_position -= old_request_start_index;
-		}
+		if(processBufferedRequests(/*wait_for_graceful_disconnect=*/true) != HandleRequestResult_KeepAlive)
+			return;
 	}
 }
 
@@ -37,6 +37,13 @@ class Range;
 WorkerThread
 ------------
 Webserver worker thread
+
+In the thread-per-connection server mode, this thread is launched and reads
+from the socket and handles requests until the connection is closed.
+
+In the event-loop server mode (see WebIOThread), the thread is never launched.
+It is just used to hold the connection state: an IO thread appends data to the
+socket buffer, and processBufferedRequests() is called on a request-handling thread.
 =====================================================================*/
 class WorkerThread : public MessageableThread
 {
@@ -55,9 +62,7 @@ public:
 
 
 	void doRunMainLoop();
-private:
-	void handleWebsocketConnection(RequestInfo& request_info);
-	
+
 	// Returns if should keep connection alive
 	enum HandleRequestResult
 	{
@@ -65,6 +70,23 @@ private:
 		HandleRequestResult_Finished,
 		HandleRequestResult_ConnectionHandledElsewhere
 	};
+
+	//----------------------- Event-loop server mode -----------------------
+	std::vector<uint8>& getSocketBuffer() { return socket_buffer; }
+
+	// Returns true if the socket buffer contains a complete request header that has not been handled yet.
+	bool hasCompleteRequestHeader();
+
+	// Handles all requests in the socket buffer for which the complete header has been received.
+	// If the result is HandleRequestResult_Finished, a graceful shutdown has been started on the socket.  If wait_for_graceful_disconnect is true, also waits for the other end to disconnect.
+	HandleRequestResult processBufferedRequests(bool wait_for_graceful_disconnect);
+
+	// If set, websocket connections are handed off to a new thread added to this thread manager, instead of being handled on the calling thread.
+	void setWebsocketThreadManager(ThreadManager* websocket_thread_manager_) { websocket_thread_manager = websocket_thread_manager_; }
+	//----------------------------------------------------------------------
+private:
+	void handleWebsocketConnection(RequestInfo& request_info);
+	
 	HandleRequestResult handleSingleRequest(size_t request_header_size);
 public:
 	static void parseRanges(const string_view field_value, std::vector<web::Range>& ranges_out); // Just public for testing
@@ -81,9 +103,12 @@ private:
 	std::vector<uint8> socket_buffer;
 	Reference<RequestHandler> request_handler;
 	size_t request_start_index; // Start index of request that we current processing.
+	size_t double_crlf_scan_position; // Index in socket_buffer of the last place we looked for a double CRLF.
 
 	bool tls_connection;
 
+	ThreadManager* websocket_thread_manager;
+
 	glare::AtomicInt should_quit;
 };
 
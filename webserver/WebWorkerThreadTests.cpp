@@ -20,6 +20,7 @@ Copyright Glare Technologies Limited 2021 -
 #include <maths/mathstypes.h>
 #include <ConPrint.h>
 #include <Clock.h>
+#include <Timer.h>
 #include <AESEncryption.h>
 #include <SHA256.h>
 #include <Base64.h>
@@ -188,6 +189,37 @@ static void testPacketBreaksWithRequest(const std::string& request, int expected
 }
 
 
+// As above, but feed the data to the worker the way WebIOThread does in event-loop mode.
+static void testPacketBreaksWithRequestEventLoopMode(const std::string& request, int expected_num_requests)
+{
+	PCG32 rng(1);
+	for(int i=0; i<100; ++i)
+	{
+		TestSocketRef test_socket = new TestSocket();
+		Reference<TestRequestHandler> request_handler = new TestRequestHandler();
+		Reference<web::WorkerThread> worker = new web::WorkerThread(0, test_socket, request_handler, /*tls connection=*/false);
+
+		try
+		{
+			for(size_t last_break_i = 0; last_break_i < request.size(); )
+			{
+				const size_t break_i = myMin(request.size(), last_break_i + 1 + (size_t)(rng.unitRandom() * 10));
+				worker->getSocketBuffer().insert(worker->getSocketBuffer().end(), request.begin() + last_break_i, request.begin() + break_i);
+				last_break_i = break_i;
+
+				if(worker->hasCompleteRequestHeader())
+					if(worker->processBufferedRequests(/*wait_for_graceful_disconnect=*/false) != web::WorkerThread::HandleRequestResult_KeepAlive)
+						break;
+			}
+		}
+		catch(glare::Exception& )
+		{}
+
+		testAssert(request_handler->num_requests_handled == expected_num_requests);
+	}
+}
+
+
 
 
 static void testConnectAndRequest(const std::string& request)
@@ -562,88 +594,38 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 #endif
 
 
-void WebWorkerThreadTests::test()
+// Open many connections and keep them all open, then make a request on each one.
+// In thread-per-connection mode each connection will have its own server thread, in event-loop mode they are multiplexed over the IO threads.
+static void testManyKeepAliveConnections(int num_connections)
 {
-	//=========================== Test parseQuotedHeaderValue ===============================
-	{
-		testParseQuotedHeaderValue("\"\"", "");
-		testParseQuotedHeaderValue("\"a\"", "a");
-		testParseQuotedHeaderValue("\"abcdef\"", "abcdef");
-		testParseQuotedHeaderValue("\"abc\\Qdef\"", "abcQdef");
-		testParseQuotedHeaderValue("\"abc\\\"def\"", "abc\"def");
-
-		testParseQuotedHeaderValueExcepExpected("");
-		testParseQuotedHeaderValueExcepExpected("\""); // no terminating "
-		testParseQuotedHeaderValueExcepExpected("\"aaa"); // no terminating "
-		testParseQuotedHeaderValueExcepExpected("\"\\"); // backslash before last "
-	}
-
-
-	//=========================== Test accept-encoding parsing ===============================
-	{
-		testAcceptEncodingParsing("", /*expected_deflate_accept_encoding=*/false, /*expected_zstd_accept_encoding=*/false);
-		testAcceptEncodingParsing("deflate", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/false);
-		testAcceptEncodingParsing("zstd", /*expected_deflate_accept_encoding=*/false, /*expected_zstd_accept_encoding=*/true);
-		testAcceptEncodingParsing("deflate,zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
-		testAcceptEncodingParsing("deflate, zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
-		testAcceptEncodingParsing("deflate,  zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
-		testAcceptEncodingParsing("deflate ,  zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
-		testAcceptEncodingParsing("deflate ,zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
-
-		// Test quality stuff (see https://www.rfc-editor.org/rfc/rfc9110#field.accept-encoding)
-		testAcceptEncodingParsing("deflate;q=1.0", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/false);
-		testAcceptEncodingParsing("deflate;q=1.0, zstd;q=0", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
-
-		testAcceptEncodingParsing("abc", /*expected_deflate_accept_encoding=*/false, /*expected_zstd_accept_encoding=*/false);
-		testAcceptEncodingParsing("abc, zstd", /*expected_deflate_accept_encoding=*/false, /*expected_zstd_accept_encoding=*/true);
-		testAcceptEncodingParsing("abc, deflate", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/false);
-	}
-
+	Timer timer;
+	std::vector<Reference<MySocket>> sockets;
+	for(int i=0; i<num_connections; ++i)
+		sockets.push_back(new MySocket("localhost", port));
 
-	//=========================== Test range parsing ===============================
+	const std::string std_request = "GET / HTTP/1.1" + CRLF + "Host: localhost" + CRLF + CRLF;
+	for(int z=0; z<2; ++z)
 	{
-		// See https://developer.mozilla.org/en-US/docs/Web/HTTP/Headers/Range
+		for(size_t i=0; i<sockets.size(); ++i)
+			sockets[i]->write(std_request.c_str(), std_request.size(), NULL);
 
-		testRangeParsing("", std::vector<web::Range>());
-		testRangeParsing("bleh", std::vector<web::Range>());
-		testRangeParsing("bytes", std::vector<web::Range>());
-		testRangeParsing("bytes=", std::vector<web::Range>());
-		testRangeParsing("bytes=,", std::vector<web::Range>());
-		testRangeParsing("bytes=-123", std::vector<web::Range>());
-		testRangeParsing("bytes=123", std::vector<web::Range>());
-		testRangeParsing("bytes=123-", std::vector<web::Range>(1, web::Range(123, -1)));
-		testRangeParsing("bytes=123-456", std::vector<web::Range>(1, web::Range(123, 456)));
-		testRangeParsing("bytes=123-456 ", std::vector<web::Range>(1, web::Range(123, 456)));
-		testRangeParsing("bytes=123-456 ,", std::vector<web::Range>(1, web::Range(123, 456)));
-		testRangeParsing("bytes=123-456,", std::vector<web::Range>(1, web::Range(123, 456)));
-
-		{
-			std::vector<web::Range> ranges(1, web::Range(123, 456));
-			ranges.push_back(web::Range(1000, -1));
-			testRangeParsing("bytes=123-456, 1000-", ranges);
-		}
+		for(size_t i=0; i<sockets.size(); ++i)
 		{
-			std::vector<web::Range> ranges(1, web::Range(123, 456));
-			ranges.push_back(web::Range(1000, 2000));
-			testRangeParsing("bytes=123-456, 1000-2000", ranges);
+			char buf[4];
+			sockets[i]->readTo(buf, sizeof(buf));
+			testAssert(std::string(buf, buf + 4) == "ping");
 		}
 	}
 
-	
+	conPrint("testManyKeepAliveConnections: " + toString(num_connections) + " connections, " + toString(2 * num_connections) + " requests took " + timer.elapsedStringNSigFigs(3));
+}
+
+
+// Runs tests against a WebListenerThread, either in thread-per-connection mode or in event-loop mode.
+static void testServer(bool event_loop_mode)
+{
+	conPrint("testServer(), event_loop_mode: " + boolToString(event_loop_mode));
 
-	//testConnectAndRequest();
-	{
-		testPacketBreaksWithRequest("BLEH", /*expected_num_requests=*/0);
-		testPacketBreaksWithRequest("BLEH" + CRLFCRLF, 0);
-		testPacketBreaksWithRequest("GET / HTTP/1.1" + CRLFCRLF, 1);
-		testPacketBreaksWithRequest("GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1", 1); // No trailing double CRLF on second request
-		testPacketBreaksWithRequest("GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1" + CRLF, 1); // No trailing double CRLF on second request
-		testPacketBreaksWithRequest("GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1" + CRLFCRLF, 2);
-		testPacketBreaksWithRequest(CRLFCRLF, 0);
-		testPacketBreaksWithRequest(CRLFCRLF + CRLFCRLF, 0);
-		testPacketBreaksWithRequest(CRLFCRLF + CRLFCRLF + CRLFCRLF, 0);
-	}
-	
 	// Create and launch a server listener thread.
 	
 	Reference<TestSharedRequestHandler> shared_request_handler = new TestSharedRequestHandler();
@@ -652,8 +634,24 @@ void WebWorkerThreadTests::test()
 	Reference<WebListenerThread> listener_thread = new WebListenerThread(port, shared_request_handler.getPointer(), 
 		NULL // tls_configuration
 	);
+	if(event_loop_mode)
+		listener_thread->enableEventLoopMode(/*num_io_threads=*/2, /*num_request_threads=*/4);
 	thread_manager.addThread(listener_thread);
 
+	// Wait until the listener thread is accepting connections.
+	for(int i=0; i<100; ++i)
+	{
+		try
+		{
+			MySocketRef socket = new MySocket("localhost", port);
+			break;
+		}
+		catch(MySocketExcep& )
+		{
+			PlatformUtils::Sleep(50);
+		}
+	}
+
 	
 	//=========================== Test range handling ===============================
 	try
@@ -843,6 +841,9 @@ void WebWorkerThreadTests::test()
 
 	}
 
+	//=========================== Test many simultaneous keep-alive connections ===============================
+	testManyKeepAliveConnections(/*num_connections=*/500);
+
 	
 
 
@@ -922,6 +923,105 @@ void WebWorkerThreadTests::test()
 }
 
 
+void WebWorkerThreadTests::test()
+{
+	//=========================== Test parseQuotedHeaderValue ===============================
+	{
+		testParseQuotedHeaderValue("\"\"", "");
+		testParseQuotedHeaderValue("\"a\"", "a");
+		testParseQuotedHeaderValue("\"abcdef\"", "abcdef");
+		testParseQuotedHeaderValue("\"abc\\Qdef\"", "abcQdef");
+		testParseQuotedHeaderValue("\"abc\\\"def\"", "abc\"def");
+
+		testParseQuotedHeaderValueExcepExpected("");
+		testParseQuotedHeaderValueExcepExpected("\""); // no terminating "
+		testParseQuotedHeaderValueExcepExpected("\"aaa"); // no terminating "
+		testParseQuotedHeaderValueExcepExpected("\"\\"); // backslash before last "
+	}
+
+
+	//=========================== Test accept-encoding parsing ===============================
+	{
+		testAcceptEncodingParsing("", /*expected_deflate_accept_encoding=*/false, /*expected_zstd_accept_encoding=*/false);
+		testAcceptEncodingParsing("deflate", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/false);
+		testAcceptEncodingParsing("zstd", /*expected_deflate_accept_encoding=*/false, /*expected_zstd_accept_encoding=*/true);
+		testAcceptEncodingParsing("deflate,zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
+		testAcceptEncodingParsing("deflate, zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
+		testAcceptEncodingParsing("deflate,  zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
+		testAcceptEncodingParsing("deflate ,  zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
+		testAcceptEncodingParsing("deflate ,zstd", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
+
+		// Test quality stuff (see https://www.rfc-editor.org/rfc/rfc9110#field.accept-encoding)
+		testAcceptEncodingParsing("deflate;q=1.0", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/false);
+		testAcceptEncodingParsing("deflate;q=1.0, zstd;q=0", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/true);
+
+		testAcceptEncodingParsing("abc", /*expected_deflate_accept_encoding=*/false, /*expected_zstd_accept_encoding=*/false);
+		testAcceptEncodingParsing("abc, zstd", /*expected_deflate_accept_encoding=*/false, /*expected_zstd_accept_encoding=*/true);
+		testAcceptEncodingParsing("abc, deflate", /*expected_deflate_accept_encoding=*/true, /*expected_zstd_accept_encoding=*/false);
+	}
+
+
+	//=========================== Test range parsing ===============================
+	{
+		// See https://developer.mozilla.org/en-US/docs/Web/HTTP/Headers/Range
+
+		testRangeParsing("", std::vector<web::Range>());
+		testRangeParsing("bleh", std::vector<web::Range>());
+		testRangeParsing("bytes", std::vector<web::Range>());
+		testRangeParsing("bytes=", std::vector<web::Range>());
+		testRangeParsing("bytes=,", std::vector<web::Range>());
+		testRangeParsing("bytes=-123", std::vector<web::Range>());
+		testRangeParsing("bytes=123", std::vector<web::Range>());
+		testRangeParsing("bytes=123-", std::vector<web::Range>(1, web::Range(123, -1)));
+		testRangeParsing("bytes=123-456", std::vector<web::Range>(1, web::Range(123, 456)));
+		testRangeParsing("bytes=123-456 ", std::vector<web::Range>(1, web::Range(123, 456)));
+		testRangeParsing("bytes=123-456 ,", std::vector<web::Range>(1, web::Range(123, 456)));
+		testRangeParsing("bytes=123-456,", std::vector<web::Range>(1, web::Range(123, 456)));
+
+		{
+			std::vector<web::Range> ranges(1, web::Range(123, 456));
+			ranges.push_back(web::Range(1000, -1));
+			testRangeParsing("bytes=123-456, 1000-", ranges);
+		}
+		{
+			std::vector<web::Range> ranges(1, web::Range(123, 456));
+			ranges.push_back(web::Range(1000, 2000));
+			testRangeParsing("bytes=123-456, 1000-2000", ranges);
+		}
+	}
+
+	
+
+	//testConnectAndRequest();
+	{
+		testPacketBreaksWithRequest("BLEH", /*expected_num_requests=*/0);
+		testPacketBreaksWithRequest("BLEH" + CRLFCRLF, 0);
+		testPacketBreaksWithRequest("GET / HTTP/1.1" + CRLFCRLF, 1);
+		testPacketBreaksWithRequest("GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1", 1); // No trailing double CRLF on second request
+		testPacketBreaksWithRequest("GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1" + CRLF, 1); // No trailing double CRLF on second request
+		testPacketBreaksWithRequest("GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1" + CRLFCRLF, 2);
+		testPacketBreaksWithRequest(CRLFCRLF, 0);
+		testPacketBreaksWithRequest(CRLFCRLF + CRLFCRLF, 0);
+		testPacketBreaksWithRequest(CRLFCRLF + CRLFCRLF + CRLFCRLF, 0);
+	}
+
+	{
+		testPacketBreaksWithRequestEventLoopMode("BLEH", /*expected_num_requests=*/0);
+		testPacketBreaksWithRequestEventLoopMode("BLEH" + CRLFCRLF, 0);
+		testPacketBreaksWithRequestEventLoopMode("GET / HTTP/1.1" + CRLFCRLF, 1);
+		testPacketBreaksWithRequestEventLoopMode("GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1", 1); // No trailing double CRLF on second request
+		testPacketBreaksWithRequestEventLoopMode("GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1" + CRLFCRLF, 2);
+		testPacketBreaksWithRequestEventLoopMode("GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1" + CRLFCRLF + "GET / HTTP/1.1" + CRLFCRLF, 3);
+		testPacketBreaksWithRequestEventLoopMode(CRLFCRLF + CRLFCRLF, 0);
+	}
+	
+	testServer(/*event_loop_mode=*/false);
+#if defined(__linux__)
+	testServer(/*event_loop_mode=*/true);
+#endif
+}
+
+
 } // end namespace web
 
 